@@ -0,0 +1,124 @@
+//! Area scan on a crowded town map: the grid's intrusive block_list chains
+//! versus the compact per-cell index.
+//!
+//!     cargo bench --bench cell_index
+
+use std::hint::black_box;
+use std::ptr;
+
+use criterion::{criterion_group, criterion_main, Criterion};
+use yuri::database::cell_index::{CellEntry, CellIndex};
+use yuri::database::map_db::{BlockList, BLOCK_SIZE};
+
+const XS: usize = 100;
+const YS: usize = 100;
+const ENTITIES: usize = 2000;
+
+/// Stand-in for a map_sessiondata/MOB/NPC: the block_list header followed by
+/// a few KB of state the scan never reads.
+#[repr(C)]
+struct Entity {
+    bl: BlockList,
+    _rest: [u8; 4096],
+}
+
+struct Town {
+    _entities: Vec<Box<Entity>>,
+    heads: Vec<*mut BlockList>,
+    index: CellIndex,
+    bxs: usize,
+}
+
+/// Most of the crowd stands around the square in the middle of the map.
+fn town() -> Town {
+    let bxs = XS.div_ceil(BLOCK_SIZE);
+    let bys = YS.div_ceil(BLOCK_SIZE);
+    let mut heads = vec![ptr::null_mut::<BlockList>(); bxs * bys];
+    let mut index = CellIndex::new(bxs, bys);
+    let mut entities = Vec::with_capacity(ENTITIES);
+    let mut seed = 0x2545_f491u32;
+    for i in 0..ENTITIES {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        let spread = if i % 4 == 0 { XS } else { 30 };
+        let x = (XS - spread) / 2 + seed as usize % spread;
+        let y = (YS - spread) / 2 + (seed >> 16) as usize % spread;
+        let mut e = Box::new(Entity {
+            bl: BlockList {
+                next: ptr::null_mut(),
+                prev: ptr::null_mut(),
+                id: i as u32 + 1,
+                bx: 0,
+                by: 0,
+                graphic_id: 0,
+                graphic_color: 0,
+                m: 0,
+                x: x as u16,
+                y: y as u16,
+                bl_type: 1 << (i % 4),
+                subtype: 0,
+            },
+            _rest: [0; 4096],
+        });
+        let cell = x / BLOCK_SIZE + y / BLOCK_SIZE * bxs;
+        e.bl.next = heads[cell];
+        heads[cell] = &mut e.bl;
+        index.insert(CellEntry {
+            addr: &e.bl as *const BlockList as usize,
+            id: e.bl.id,
+            serial: 0,
+            x: e.bl.x,
+            y: e.bl.y,
+            bl_type: e.bl.bl_type,
+        });
+        entities.push(e);
+    }
+    Town { _entities: entities, heads, index, bxs }
+}
+
+/// The AREA (AREAX_SIZE x AREAY_SIZE each way) rectangle around the square.
+const RECT: (i32, i32, i32, i32) = (50 - 18, 50 - 16, 50 + 18, 50 + 16);
+
+fn chain_scan(t: &Town, mask: u8) -> usize {
+    let (x0, y0, x1, y1) = RECT;
+    let bs = BLOCK_SIZE as i32;
+    let mut n = 0;
+    for by in y0 / bs..=y1 / bs {
+        for bx in x0 / bs..=x1 / bs {
+            let mut bl = t.heads[bx as usize + by as usize * t.bxs];
+            while !bl.is_null() {
+                let b = unsafe { &*bl };
+                let (x, y) = (b.x as i32, b.y as i32);
+                if x >= x0 && x <= x1 && y >= y0 && y <= y1 && b.bl_type & mask != 0 {
+                    n += 1;
+                }
+                bl = b.next;
+            }
+        }
+    }
+    n
+}
+
+fn index_scan(t: &Town, mask: u8) -> usize {
+    let (x0, y0, x1, y1) = RECT;
+    let mut n = 0;
+    t.index.scan(x0, y0, x1, y1, |e| {
+        if e.bl_type & mask != 0 {
+            n += 1;
+        }
+    });
+    n
+}
+
+fn bench_area_scan(c: &mut Criterion) {
+    let t = town();
+    assert_eq!(chain_scan(&t, 0xff), index_scan(&t, 0xff));
+    let mut group = c.benchmark_group("town_area_scan");
+    group.bench_function("intrusive_chains", |b| b.iter(|| chain_scan(black_box(&t), black_box(1))));
+    group.bench_function("cell_index", |b| b.iter(|| index_scan(black_box(&t), black_box(1))));
+    group.finish();
+}
+
+criterion_group!(benches, bench_area_scan);
+criterion_main!(benches);
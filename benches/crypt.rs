@@ -0,0 +1,71 @@
+//! Packet cipher: tk_crypt_static (login server, static map opcodes),
+//! tk_crypt_dynamic (every other map packet) and the per-packet key
+//! derivation, over packet sizes from a walk to a full board page.
+//!
+//!     cargo bench --bench crypt
+//!
+//! The kernel picked for this CPU is in the bench id, so results from
+//! different machines do not get compared against each other by accident.
+
+use std::hint::black_box;
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use yuri::network::crypt::{
+    crypt_kernel_name, generate_key2, populate_table, tk_crypt_dynamic, tk_crypt_static,
+};
+
+const XOR_KEY: &[u8] = b"Urk#nI7ni";
+/// Frame sizes: walk, chat line, item list, board page
+const SIZES: &[usize] = &[16, 128, 1024, 8192];
+
+/// A framed packet of `size` bytes, trailer included, as the client sends it.
+fn packet(size: usize) -> Vec<u8> {
+    let mut p: Vec<u8> = (0..size).map(|i| (i * 31 + 7) as u8).collect();
+    let len = (size - 3) as u16;
+    p[0] = 0xAA;
+    p[1..3].copy_from_slice(&len.to_be_bytes());
+    p[3] = 0x0E;
+    p[4] = 0x21;
+    p
+}
+
+fn bench_crypt(c: &mut Criterion) {
+    let kernel = crypt_kernel_name();
+    let mut table = vec![0u8; 0x401];
+    populate_table(b"Loadbot", &mut table);
+
+    let mut group = c.benchmark_group(format!("tk_crypt_dynamic/{kernel}"));
+    for &size in SIZES {
+        let mut p = packet(size);
+        let mut key = [0u8; 10];
+        generate_key2(&p, &table, &mut key, true);
+        group.throughput(Throughput::Bytes(size as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(size), &size, |b, _| {
+            b.iter(|| tk_crypt_dynamic(black_box(&mut p), &key[..9]))
+        });
+    }
+    group.finish();
+
+    let mut group = c.benchmark_group(format!("tk_crypt_static/{kernel}"));
+    for &size in SIZES {
+        let mut p = packet(size);
+        group.throughput(Throughput::Bytes(size as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(size), &size, |b, _| {
+            b.iter(|| tk_crypt_static(black_box(&mut p), XOR_KEY))
+        });
+    }
+    group.finish();
+
+    // Once per packet whatever its size; the trailer is all it hashes
+    let p = packet(128);
+    c.bench_function("generate_key2", |b| {
+        let mut key = [0u8; 10];
+        b.iter(|| {
+            generate_key2(black_box(&p), &table, &mut key, true);
+            key
+        })
+    });
+}
+
+criterion_group!(benches, bench_crypt);
+criterion_main!(benches);
@@ -0,0 +1,60 @@
+//! Map tile loading: parsing a `.map` file against mapping its map cache
+//! entry, for a town-sized and a large field-sized map.
+//!
+//!     cargo bench --bench map_file
+//!
+//! The maps are synthetic, written to a temp dir on start.
+
+use std::hint::black_box;
+use std::path::PathBuf;
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use yuri::database::map_db::{load_tiles, parse_map_file};
+
+const SIZES: &[(u16, u16)] = &[(100, 100), (500, 500)];
+
+/// `[xs][ys]` then xs*ys × (tile, pass, obj), all big-endian u16.
+fn write_map(dir: &PathBuf, xs: u16, ys: u16) -> String {
+    let mut data = Vec::with_capacity(4 + xs as usize * ys as usize * 6);
+    data.extend_from_slice(&xs.to_be_bytes());
+    data.extend_from_slice(&ys.to_be_bytes());
+    for i in 0..xs as u32 * ys as u32 {
+        let tile = (i % 700) as u16;
+        let pass = (i % 13 == 0) as u16;
+        let obj = if i % 29 == 0 { (i % 300) as u16 } else { 0 };
+        for v in [tile, pass, obj] {
+            data.extend_from_slice(&v.to_be_bytes());
+        }
+    }
+    let path = dir.join(format!("{xs}x{ys}.map"));
+    std::fs::write(&path, data).unwrap();
+    path.to_string_lossy().into_owned()
+}
+
+fn bench_map_file(c: &mut Criterion) {
+    let dir = std::env::temp_dir().join(format!("yuri_bench_maps_{}", std::process::id()));
+    let cache = dir.join("cache");
+    std::fs::create_dir_all(&cache).unwrap();
+    let cache_dir = cache.to_string_lossy().into_owned();
+
+    let mut group = c.benchmark_group("map_file");
+    for &(xs, ys) in SIZES {
+        let path = write_map(&dir, xs, ys);
+        let name = format!("{xs}x{ys}");
+        group.throughput(Throughput::Elements(xs as u64 * ys as u64));
+        group.bench_with_input(BenchmarkId::new("parse_map_file", &name), &path, |b, path| {
+            b.iter(|| parse_map_file(black_box(path)).unwrap())
+        });
+        // First call writes the cache entry; every timed one maps it
+        let map_file = format!("{name}.map");
+        drop(load_tiles(&path, &map_file, &cache_dir).unwrap());
+        group.bench_with_input(BenchmarkId::new("load_tiles_cached", &name), &path, |b, path| {
+            b.iter(|| load_tiles(black_box(path), &map_file, &cache_dir).unwrap())
+        });
+    }
+    group.finish();
+    let _ = std::fs::remove_dir_all(&dir);
+}
+
+criterion_group!(benches, bench_map_file);
+criterion_main!(benches);
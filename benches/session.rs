@@ -0,0 +1,63 @@
+//! Session FIFO accessors on the packet path: what clif_parse does per
+//! inbound packet (RFIFOW, RFIFOSKIP) and what every clif_send* does per
+//! outbound one (WFIFOP + memcpy, WFIFOSET).
+//!
+//!     cargo bench --bench session
+//!
+//! Each iteration moves a burst of packets, so the numbers include the
+//! compaction rdata does once fully read.
+
+use std::hint::black_box;
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use yuri::session::Session;
+
+/// Packets per iteration; a busy client's read, or a tick's worth of sends
+const BURST: usize = 64;
+/// A 0x0E chat line on the wire
+const FRAME: usize = 48;
+
+fn frame() -> Vec<u8> {
+    let mut p = vec![0x5Au8; FRAME];
+    p[0] = 0xAA;
+    p[1..3].copy_from_slice(&((FRAME - 3) as u16).to_be_bytes());
+    p[3] = 0x0E;
+    p
+}
+
+fn bench_session(c: &mut Criterion) {
+    let wire: Vec<u8> = frame().repeat(BURST);
+    let mut group = c.benchmark_group("session");
+    group.throughput(Throughput::Elements(BURST as u64));
+
+    group.bench_function("read_u16+skip", |b| {
+        let mut s = Session::new(-1);
+        b.iter(|| {
+            s.push_read(black_box(&wire));
+            let mut sum = 0u32;
+            for _ in 0..BURST {
+                // SWAP16(RFIFOW(fd, 1)): the frame length is big-endian
+                let len = s.read_u16(1).unwrap().swap_bytes() as usize;
+                sum += len as u32;
+                s.skip(len + 3).unwrap();
+            }
+            sum
+        })
+    });
+
+    let p = frame();
+    group.bench_function("write_buf+commit_write", |b| {
+        let mut s = Session::new(-1);
+        b.iter(|| {
+            for _ in 0..BURST {
+                s.write_buf(0, black_box(&p)).unwrap();
+                s.commit_write(p.len()).unwrap();
+            }
+            s.discard_wdata()
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(benches, bench_session);
+criterion_main!(benches);
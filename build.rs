@@ -26,6 +26,8 @@ fn main() {
             target_dir.display()
         );
         println!("cargo:rustc-link-arg-bin=map_server=-Wl,--end-group");
+        // Lets dladdr name timer callbacks in slow-tick logs (timer_stats.rs)
+        println!("cargo:rustc-link-arg-bin=map_server=-Wl,--export-dynamic");
 
         // External deps required by map_game and deps
         println!("cargo:rustc-link-lib=luajit-5.1");
@@ -9,7 +9,8 @@
  *  (4) Protected functions used in the interface of the database
  *  (5) Public functions
  *
- *  The databases are structured as a hashtable of RED-BLACK trees.
+ *  The databases are structured as a hashtable of RED-BLACK trees, or, with
+ *  DB_OPT_OPEN_ADDRESS, as a growing open-addressing table of nodes.
  *
  *  <B>Properties of the RED-BLACK trees being used:</B>
  *  1. The value of any node is greater than the value of its left child and
@@ -48,6 +49,7 @@
  *  - CALLOC a db that organizes itself by splaying
  *
  *  HISTORY:
+ *    2026/10/14 - Added the DB_OPT_OPEN_ADDRESS backend.
  *    2008/02/19 - Fixed db_obj_get not handling deleted entries correctly.
  *    2007/11/09 - Added an iterator to the database.
  *    2006/12/21 - Added 1-node cache to the database.
@@ -85,6 +87,7 @@
  *  DBNColor        - Enumeration of colors of the nodes.                    *
  *  DBNode          - Structure of a node in RED-BLACK trees.                *
  *  struct db_free  - Structure that holds a deleted node to be freed.       *
+ *  struct db_slot  - Slot of the open-addressing table.                     *
  *  DBMap_impl      - Struture of the database.                              *
  *  stats           - Statistics about the database system.                  *
 \*****************************************************************************/
@@ -108,6 +111,13 @@
  */
 #define HASH_SIZE (256 + 27)
 
+/**
+ * Initial number of slots of an open-addressing database (power of 2).
+ * @private
+ * @see DBMap_impl#slots
+ */
+#define DB_OA_MIN_SLOTS 64
+
 /**
  * The color of individual nodes.
  * @private
@@ -152,6 +162,20 @@ struct db_free {
   DBNode* root;
 };
 
+/**
+ * Slot of the open-addressing table.
+ * Deleted nodes keep their slot until the database is unlocked, like they
+ * keep their place in a tree.
+ * @param node Node in this slot or NULL if the slot is free
+ * @param hash Full hash of the key of the node
+ * @private
+ * @see DBMap_impl#slots
+ */
+struct db_slot {
+  DBNode node;
+  unsigned int hash;
+};
+
 /**
  * Complete database structure.
  * @param vtable Interface of the database
@@ -166,6 +190,12 @@ struct db_free {
  * @param hash Hasher of the database
  * @param release Releaser of the database
  * @param ht Hashtable of RED-BLACK trees
+ * @param slots Open-addressing table (DB_OPT_OPEN_ADDRESS), NULL otherwise
+ * @param slot_mask Number of slots minus one
+ * @param slot_used Number of slots in use, deleted nodes included
+ * @param slot_retired Tables replaced by a growth while locked, still walked
+ *          by iterators and foreach callers
+ * @param retired_count Number of tables in slot_retired
  * @param type Type of the database
  * @param options Options of the database
  * @param item_count Number of items in the database
@@ -191,6 +221,11 @@ typedef struct DBMap_impl {
   DBHasher hash;
   DBReleaser release;
   DBNode ht[HASH_SIZE];
+  struct db_slot* slots;
+  unsigned int slot_mask;
+  unsigned int slot_used;
+  struct db_slot** slot_retired;
+  unsigned int retired_count;
   DBNode cache;
   DBType type;
   DBOptions options;
@@ -203,7 +238,10 @@ typedef struct DBMap_impl {
  * Complete iterator structure.
  * @param vtable Interface of the iterator
  * @param db Parent database
- * @param ht_index Current index of the hashtable
+ * @param ht_index Current index of the hashtable (or slot of the
+ *          open-addressing table)
+ * @param slots Open-addressing table being walked
+ * @param slot_mask Number of slots of that table minus one
  * @param node Current node
  * @private
  * @see #DBIterator
@@ -215,6 +253,8 @@ typedef struct DBIterator_impl {
   struct DBIterator vtable;
   DBMap_impl* db;
   int ht_index;
+  struct db_slot* slots;
+  unsigned int slot_mask;
   DBNode node;
 } DBIterator_impl;
 
@@ -691,6 +731,8 @@ static void db_dup_key_free(DBMap_impl* db, DBKey key) {
  * @see #db_obj_remove(DBMap*,DBKey)
  * @see #db_free_remove(DBMap_impl*,DBNode)
  */
+static void db_oa_erase(DBMap_impl* db, DBNode node);
+
 static void db_free_add(DBMap_impl* db, DBNode node, DBNode* root) {
   DBKey old_key;
 
@@ -815,12 +857,159 @@ static void db_free_unlock(DBMap_impl* db) {
   }
 
   for (i = 0; i < db->free_count; i++) {
-    db_rebalance_erase(db->free_list[i].node, db->free_list[i].root);
+    if (db->slots) {
+      db_oa_erase(db, db->free_list[i].node);
+    } else {
+      db_rebalance_erase(db->free_list[i].node, db->free_list[i].root);
+    }
     db_dup_key_free(db, db->free_list[i].node->key);
     DB_COUNTSTAT(db_node_free);
     ers_free(db->nodes, db->free_list[i].node);
   }
   db->free_count = 0;
+  for (i = 0; i < db->retired_count; i++) {
+    free(db->slot_retired[i]);
+  }
+  db->retired_count = 0;
+}
+
+/**
+ * Returns the home slot of a hash in the open-addressing table.
+ * The hash is mixed first: the default int hashers return the key itself.
+ * @param db Target database
+ * @param hash Full hash of a key
+ * @return Index of the home slot
+ * @private
+ */
+static unsigned int db_oa_home(DBMap_impl* db, unsigned int hash) {
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3bu;
+  hash ^= hash >> 16;
+  return hash & db->slot_mask;
+}
+
+/**
+ * Finds the slot of a key in the open-addressing table.
+ * Returns the slot holding the key (possibly a deleted node) or the free
+ * slot where it would be inserted.
+ * @param db Target database
+ * @param key Key being searched
+ * @param hash Full hash of the key
+ * @return Slot of the key
+ * @private
+ */
+static struct db_slot* db_oa_probe(DBMap_impl* db, DBKey key,
+                                   unsigned int hash) {
+  unsigned int i = db_oa_home(db, hash);
+
+  while (db->slots[i].node) {
+    if (db->slots[i].hash == hash &&
+        db->cmp(key, db->slots[i].node->key, db->maxlen) == 0) {
+      break;
+    }
+    i = (i + 1) & db->slot_mask;
+  }
+  return &db->slots[i];
+}
+
+/**
+ * Makes room for one more node in the open-addressing table.
+ * The table doubles at 3/4 load. While someone holds a free_lock (an
+ * iterator or a foreach caller) the old table is kept until the last unlock:
+ * those walk the table they started on, which still holds every node that
+ * was there, and deleted nodes are only erased from the new one.
+ * @param db Target database
+ * @private
+ * @see #db_free_unlock(DBMap_impl*)
+ */
+static void db_oa_reserve(DBMap_impl* db) {
+  unsigned int size = db->slot_mask + 1;
+  unsigned int i, j, old_size;
+  struct db_slot* old;
+
+  if ((db->slot_used + 1) * 4 <= size * 3) {
+    return;
+  }
+  old = db->slots;
+  old_size = size;
+  size <<= 1;
+  CALLOC(db->slots, struct db_slot, size);
+  db->slot_mask = size - 1;
+  for (i = 0; i < old_size; i++) {
+    if (old[i].node == NULL) {
+      continue;
+    }
+    j = db_oa_home(db, old[i].hash);
+    while (db->slots[j].node) {
+      j = (j + 1) & db->slot_mask;
+    }
+    db->slots[j] = old[i];
+  }
+  if (db->free_lock == 0) {
+    free(old);
+    return;
+  }
+  REALLOC(db->slot_retired, struct db_slot*, db->retired_count + 1);
+  db->slot_retired[db->retired_count++] = old;
+}
+
+/**
+ * Removes a node from the open-addressing table.
+ * Later members of its probe run are shifted back over the hole, so no
+ * tombstones are needed. Only called when the database is unlocked.
+ * @param db Target database
+ * @param node Node being removed
+ * @private
+ * @see #db_free_unlock(DBMap_impl*)
+ */
+static void db_oa_erase(DBMap_impl* db, DBNode node) {
+  unsigned int mask = db->slot_mask;
+  unsigned int i = db_oa_home(db, db->hash(node->key, db->maxlen));
+  unsigned int j, home;
+
+  while (db->slots[i].node != node) {
+    if (db->slots[i].node == NULL) {
+      ShowWarning(
+          "db_oa_erase: node was not found - database allocated at %s:%d\n",
+          db->alloc_file, db->alloc_line);
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  for (j = (i + 1) & mask; db->slots[j].node; j = (j + 1) & mask) {
+    home = db_oa_home(db, db->slots[j].hash);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      db->slots[i] = db->slots[j];
+      i = j;
+    }
+  }
+  db->slots[i].node = NULL;
+  db->slot_used--;
+}
+
+/**
+ * Allocates a node in a free slot of the open-addressing table.
+ * @param db Target database
+ * @param slot Free slot returned by db_oa_probe
+ * @param hash Full hash of the key of the node
+ * @return New node without key and data
+ * @private
+ */
+static DBNode db_oa_insert(DBMap_impl* db, struct db_slot* slot,
+                           unsigned int hash) {
+  DBNode node;
+
+  DB_COUNTSTAT(db_node_alloc);
+  node = ers_alloc(db->nodes, struct dbn);
+  node->parent = NULL;
+  node->left = NULL;
+  node->right = NULL;
+  node->deleted = 0;
+  slot->node = node;
+  slot->hash = hash;
+  db->slot_used++;
+  db->item_count++;
+  return node;
 }
 
 /*****************************************************************************\
@@ -1146,6 +1335,8 @@ void* dbit_obj_first(DBIterator* self, DBKey* out_key) {
 
   DB_COUNTSTAT(dbit_first);
   // position before the first entry
+  it->slots = it->db->slots;
+  it->slot_mask = it->db->slot_mask;
   it->ht_index = -1;
   it->node = NULL;
   // get next entry
@@ -1167,7 +1358,9 @@ void* dbit_obj_last(DBIterator* self, DBKey* out_key) {
 
   DB_COUNTSTAT(dbit_last);
   // position after the last entry
-  it->ht_index = HASH_SIZE;
+  it->slots = it->db->slots;
+  it->slot_mask = it->db->slot_mask;
+  it->ht_index = it->slots ? (int)(it->slot_mask + 1) : HASH_SIZE;
   it->node = NULL;
   // get previous entry
   return self->prev(self, out_key);
@@ -1190,6 +1383,20 @@ void* dbit_obj_next(DBIterator* self, DBKey* out_key) {
   struct dbn fake;
 
   DB_COUNTSTAT(dbit_next);
+  if (it->slots) {  // slots in table order
+    while (++(it->ht_index) <= (int)it->slot_mask) {
+      node = it->slots[it->ht_index].node;
+      if (node && !node->deleted) {
+        it->node = node;
+        if (out_key) {
+          memcpy(out_key, &node->key, sizeof(DBKey));
+        }
+        return node->data;
+      }
+    }
+    it->node = NULL;
+    return NULL;  // not found
+  }
   if (it->ht_index < 0) {  // get first node
     it->ht_index = 0;
     it->node = NULL;
@@ -1259,6 +1466,23 @@ void* dbit_obj_prev(DBIterator* self, DBKey* out_key) {
   struct dbn fake;
 
   DB_COUNTSTAT(dbit_prev);
+  if (it->slots) {  // slots in reverse table order
+    if (it->ht_index > (int)it->slot_mask + 1) {
+      it->ht_index = (int)it->slot_mask + 1;
+    }
+    while (--(it->ht_index) >= 0) {
+      node = it->slots[it->ht_index].node;
+      if (node && !node->deleted) {
+        it->node = node;
+        if (out_key) {
+          memcpy(out_key, &node->key, sizeof(DBKey));
+        }
+        return node->data;
+      }
+    }
+    it->node = NULL;
+    return NULL;  // not found
+  }
   if (it->ht_index >= HASH_SIZE) {  // get last node
     it->ht_index = HASH_SIZE - 1;
     it->node = NULL;
@@ -1352,7 +1576,7 @@ void* dbit_obj_remove(DBIterator* self) {
     }
     data = node->data;
     db->release(node->key, node->data, DB_RELEASE_DATA);
-    db_free_add(db, node, &db->ht[it->ht_index]);
+    db_free_add(db, node, db->slots ? NULL : &db->ht[it->ht_index]);
   }
   return data;
 }
@@ -1398,6 +1622,8 @@ static DBIterator* db_obj_iterator(DBMap* self) {
   /* Initial state (before the first entry) */
   it->db = db;
   it->ht_index = -1;
+  it->slots = db->slots;
+  it->slot_mask = db->slot_mask;
   it->node = NULL;
   /* Lock the database */
   db_free_lock(db);
@@ -1442,7 +1668,16 @@ static void* db_obj_get(DBMap* self, DBKey key) {
   }
 
   db_free_lock(db);
-  node = db->ht[db->hash(key, db->maxlen) % HASH_SIZE];
+  if (db->slots) {
+    node = db_oa_probe(db, key, db->hash(key, db->maxlen))->node;
+    if (node && !(node->deleted)) {
+      data = node->data;
+      db->cache = node;
+    }
+    node = NULL;
+  } else {
+    node = db->ht[db->hash(key, db->maxlen) % HASH_SIZE];
+  }
   while (node) {
     c = db->cmp(key, node->key, db->maxlen);
     if (c == 0) {
@@ -1482,6 +1717,8 @@ static unsigned int db_obj_vgetall(DBMap* self, void** buf, unsigned int max,
                                    DBMatcher match, va_list args) {
   DBMap_impl* db = (DBMap_impl*)self;
   unsigned int i;
+  unsigned int mask;
+  struct db_slot* slots;
   DBNode node;
   DBNode parent;
   unsigned int ret = 0;
@@ -1495,7 +1732,23 @@ static unsigned int db_obj_vgetall(DBMap* self, void** buf, unsigned int max,
   }
 
   db_free_lock(db);
-  for (i = 0; i < HASH_SIZE; i++) {
+  slots = db->slots;
+  mask = db->slot_mask;
+  for (i = 0; slots && i <= mask; i++) {
+    node = slots[i].node;
+    if (node && !(node->deleted)) {
+      va_list argscopy;
+      va_copy(argscopy, args);
+      if (match(node->key, node->data, argscopy) == 0) {
+        if (buf && ret < max) {
+          buf[ret] = node->data;
+        }
+        ret++;
+      }
+      va_end(argscopy);
+    }
+  }
+  for (i = 0; !db->slots && i < HASH_SIZE; i++) {
     // Match in the order: current node, left tree, right tree
     node = db->ht[i];
     while (node) {
@@ -1609,6 +1862,43 @@ static void* db_obj_vensure(DBMap* self, DBKey key, DBCreateData create,
     return db->cache->data;  // cache hit
   }
 
+  if (db->slots) {
+    struct db_slot* slot;
+
+    db_oa_reserve(db);
+    db_free_lock(db);
+    hash = db->hash(key, db->maxlen);
+    slot = db_oa_probe(db, key, hash);
+    if (slot->node == NULL) {
+      va_list argscopy;
+      if (db->item_count == UINT32_MAX) {
+        ShowError(
+            "db_vensure: item_count overflow, aborting item insertion.\n"
+            "Database allocated at %s:%d",
+            db->alloc_file, db->alloc_line);
+        db_free_unlock(db);
+        return NULL;
+      }
+      node = db_oa_insert(db, slot, hash);
+      if (db->options & DB_OPT_DUP_KEY) {
+        node->key = db_dup_key(db, key);
+        if (db->options & DB_OPT_RELEASE_KEY) {
+          db->release(key, data, DB_RELEASE_KEY);
+        }
+      } else {
+        node->key = key;
+      }
+      va_copy(argscopy, args);
+      node->data = create(key, argscopy);
+      va_end(argscopy);
+    }
+    node = slot->node;
+    data = node->data;
+    db->cache = node;
+    db_free_unlock(db);
+    return data;
+  }
+
   db_free_lock(db);
   hash = db->hash(key, db->maxlen) % HASH_SIZE;
   node = db->ht[hash];
@@ -1758,6 +2048,37 @@ static void* db_obj_put(DBMap* self, DBKey key, void* data) {
         db->alloc_file, db->alloc_line);
     return NULL;
   }
+  if (db->slots) {
+    struct db_slot* slot;
+
+    db_oa_reserve(db);
+    db_free_lock(db);
+    hash = db->hash(key, db->maxlen);
+    slot = db_oa_probe(db, key, hash);
+    node = slot->node;
+    if (node) {  // equal entry, replace
+      if (node->deleted) {
+        db_free_remove(db, node);
+      } else {
+        db->release(node->key, node->data, DB_RELEASE_BOTH);
+      }
+      old_data = node->data;
+    } else {
+      node = db_oa_insert(db, slot, hash);
+    }
+    if (db->options & DB_OPT_DUP_KEY) {
+      node->key = db_dup_key(db, key);
+      if (db->options & DB_OPT_RELEASE_KEY) {
+        db->release(key, data, DB_RELEASE_KEY);
+      }
+    } else {
+      node->key = key;
+    }
+    node->data = data;
+    db->cache = node;
+    db_free_unlock(db);
+    return old_data;
+  }
   // search for an equal node
   db_free_lock(db);
   hash = db->hash(key, db->maxlen) % HASH_SIZE;
@@ -1859,6 +2180,19 @@ static void* db_obj_remove(DBMap* self, DBKey key) {
   }
 
   db_free_lock(db);
+  if (db->slots) {
+    node = db_oa_probe(db, key, db->hash(key, db->maxlen))->node;
+    if (node && !(node->deleted)) {
+      if (db->cache == node) {
+        db->cache = NULL;
+      }
+      data = node->data;
+      db->release(node->key, node->data, DB_RELEASE_DATA);
+      db_free_add(db, node, NULL);
+    }
+    db_free_unlock(db);
+    return data;
+  }
   hash = db->hash(key, db->maxlen) % HASH_SIZE;
   for (node = db->ht[hash]; node;) {
     c = db->cmp(key, node->key, db->maxlen);
@@ -1896,6 +2230,8 @@ static void* db_obj_remove(DBMap* self, DBKey key) {
 static int db_obj_vforeach(DBMap* self, DBApply func, va_list args) {
   DBMap_impl* db = (DBMap_impl*)self;
   unsigned int i;
+  unsigned int mask;
+  struct db_slot* slots;
   int sum = 0;
   DBNode node;
   DBNode parent;
@@ -1911,7 +2247,18 @@ static int db_obj_vforeach(DBMap* self, DBApply func, va_list args) {
   }
 
   db_free_lock(db);
-  for (i = 0; i < HASH_SIZE; i++) {
+  slots = db->slots;
+  mask = db->slot_mask;
+  for (i = 0; slots && i <= mask; i++) {
+    node = slots[i].node;
+    if (node && !(node->deleted)) {
+      va_list argscopy;
+      va_copy(argscopy, args);
+      sum += func(node->key, node->data, argscopy);
+      va_end(argscopy);
+    }
+  }
+  for (i = 0; !db->slots && i < HASH_SIZE; i++) {
     // Apply func in the order: current node, left node, right node
     node = db->ht[i];
     while (node) {
@@ -1997,7 +2344,29 @@ static int db_obj_vclear(DBMap* self, DBApply func, va_list args) {
 
   db_free_lock(db);
   db->cache = NULL;
-  for (i = 0; i < HASH_SIZE; i++) {
+  for (i = 0; db->slots && i <= db->slot_mask; i++) {
+    node = db->slots[i].node;
+    if (node == NULL) {
+      continue;
+    }
+    db->slots[i].node = NULL;
+    if (node->deleted) {
+      db_dup_key_free(db, node->key);
+    } else {
+      if (func) {
+        va_list argscopy;
+        va_copy(argscopy, args);
+        sum += func(node->key, node->data, argscopy);
+        va_end(argscopy);
+      }
+      db->release(node->key, node->data, DB_RELEASE_BOTH);
+      node->deleted = 1;
+    }
+    DB_COUNTSTAT(db_node_free);
+    ers_free(db->nodes, node);
+  }
+  db->slot_used = 0;
+  for (i = 0; !db->slots && i < HASH_SIZE; i++) {
     // Apply the func and delete in the order: left tree, right tree, current
     // node
     node = db->ht[i];
@@ -2133,6 +2502,13 @@ static int db_obj_vdestroy(DBMap* self, DBApply func, va_list args) {
   free(db->free_list);
   db->free_list = NULL;
   db->free_max = 0;
+  free(db->slots);
+  db->slots = NULL;
+  while (db->retired_count) {
+    free(db->slot_retired[--db->retired_count]);
+  }
+  free(db->slot_retired);
+  db->slot_retired = NULL;
   ers_destroy(db->nodes);
   db_free_unlock(db);
   free(db);
@@ -2471,6 +2847,16 @@ DBMap* db_alloc(const char* file, int line, DBType type, DBOptions options,
   for (i = 0; i < HASH_SIZE; i++) {
     db->ht[i] = NULL;
   }
+  if (options & DB_OPT_OPEN_ADDRESS) {
+    CALLOC(db->slots, struct db_slot, DB_OA_MIN_SLOTS);
+    db->slot_mask = DB_OA_MIN_SLOTS - 1;
+  } else {
+    db->slots = NULL;
+    db->slot_mask = 0;
+  }
+  db->slot_used = 0;
+  db->slot_retired = NULL;
+  db->retired_count = 0;
   db->cache = NULL;
   db->type = type;
   db->options = options;
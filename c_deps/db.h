@@ -123,6 +123,10 @@ typedef enum DBType { DB_INT, DB_UINT, DB_STRING, DB_ISTRING } DBType;
  * @param DB_OPT_RELEASE_BOTH Releases both key and data.
  * @param DB_OPT_ALLOW_NULL_KEY Allow NULL keys in the database.
  * @param DB_OPT_ALLOW_NULL_DATA Allow NULL data in the database.
+ * @param DB_OPT_OPEN_ADDRESS Store the entries in a growing open-addressing
+ *          table (linear probing) instead of the fixed hashtable of
+ *          RED-BLACK trees. Meant for large databases; iterators walk the
+ *          table order instead of key order within a bucket.
  * @public
  * @see #db_fix_options(DBType,DBOptions)
  * @see #db_default_release(DBType,DBOptions)
@@ -136,6 +140,7 @@ typedef enum DBOptions {
   DB_OPT_RELEASE_BOTH = 6,
   DB_OPT_ALLOW_NULL_KEY = 8,
   DB_OPT_ALLOW_NULL_DATA = 16,
+  DB_OPT_OPEN_ADDRESS = 32,
 } DBOptions;
 
 /**
@@ -0,0 +1,126 @@
+// DBMap backend benchmark: the hashtable of RED-BLACK trees against the
+// DB_OPT_OPEN_ADDRESS table, on an id_db-sized uint database.
+//
+//   ./bin/db_bench [--json] [entries] [lookups]
+//
+// --json prints one JSON object per backend and operation instead of the
+// table, for scripts that compare runs.
+// Every pass also checks that both backends return the same results, so a
+// broken backend fails loudly instead of benchmarking well.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "db.h"
+
+static int json;
+
+static double now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int count_sub(DBKey key, void* data, va_list ap) {
+  (void)key;
+  return data != NULL;
+}
+
+static void check(int ok, const char* what) {
+  if (!ok) {
+    fprintf(stderr, "db_bench: %s mismatch\n", what);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Runs the workload on one database; returns a checksum of what it saw.
+static uint64_t run(const char* name, DBOptions opt, unsigned int n,
+                    unsigned int lookups) {
+  DBMap* db = uidb_alloc(opt);
+  DBIterator* iter;
+  uint64_t sum = 0;
+  double t0, t_put, t_get, t_iter, t_del;
+  unsigned int i, seen;
+  void* data;
+
+  t0 = now_ms();
+  // Entity ids are handed out densely from a base, like map_addiddb's
+  for (i = 0; i < n; i++) {
+    uidb_put(db, 1000000 + i, (void*)(uintptr_t)(i + 1));
+  }
+  t_put = now_ms();
+
+  for (i = 0; i < lookups; i++) {
+    // Mostly hits, every 8th a miss
+    unsigned int id = 1000000 + (unsigned int)((i * 2654435761u) % (n + n / 8));
+    sum += (uintptr_t)uidb_get(db, id);
+  }
+  t_get = now_ms();
+
+  seen = 0;
+  iter = db_iterator(db);
+  for (data = dbi_first(iter); dbi_exists(iter); data = dbi_next(iter)) {
+    sum += (uintptr_t)data;
+    seen++;
+    // Remove a quarter of the entries while iterating; must not disturb the
+    // walk. Chosen by value, since the backends iterate in different orders.
+    if ((uintptr_t)data % 4 == 0) {
+      iter->remove(iter);
+    }
+  }
+  dbi_destroy(iter);
+  check(seen == n, "iteration count");
+  t_iter = now_ms();
+
+  for (i = 0; i < n; i += 2) {
+    uidb_remove(db, 1000000 + i);
+  }
+  sum += db->size(db) * 7919u + (unsigned int)db->foreach(db, count_sub);
+  t_del = now_ms();
+
+  if (json) {
+    const char* ops[] = {"put", "get", "iter", "remove"};
+    double ms[] = {t_put - t0, t_get - t_put, t_iter - t_get, t_del - t_iter};
+    unsigned int counts[] = {n, lookups, n, (n + 1) / 2};
+    int k;
+
+    for (k = 0; k < 4; k++) {
+      printf("{\"bench\":\"db/%s/%s\",\"entries\":%u,\"ops\":%u,"
+             "\"ns_per_op\":%.1f}\n",
+             name, ops[k], n, counts[k],
+             counts[k] ? ms[k] * 1e6 / counts[k] : 0.0);
+    }
+  } else {
+    printf("%-14s put %8.2f ms  get %8.2f ms  iter %8.2f ms  remove %8.2f ms\n",
+           name, t_put - t0, t_get - t_put, t_iter - t_get, t_del - t_iter);
+  }
+  db_destroy(db);
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  unsigned int n, lookups;
+  uint64_t rb, oa;
+
+  if (argc > 1 && strcmp(argv[1], "--json") == 0) {
+    json = 1;
+    argc--;
+    argv++;
+  }
+  n = argc > 1 ? (unsigned int)atoi(argv[1]) : 50000;
+  lookups = argc > 2 ? (unsigned int)atoi(argv[2]) : 5000000;
+
+  db_init();
+  if (!json) {
+    printf("%u entries, %u lookups\n", n, lookups);
+  }
+  rb = run("rb-tree", DB_OPT_BASE, n, lookups);
+  oa = run("open-address", DB_OPT_OPEN_ADDRESS, n, lookups);
+  check(rb == oa, "checksum");
+  db_final();
+  return 0;
+}
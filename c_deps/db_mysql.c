@@ -13,6 +13,9 @@
 #include <mysql.h>
 #include <string.h>
 
+/// Most statements kept prepared per Sql handle
+#define SQL_STMT_CACHE_MAX 128
+
 /// Sql handle
 struct Sql {
   StringBuf buf;
@@ -21,6 +24,11 @@ struct Sql {
   MYSQL_ROW row;
   unsigned long* lengths;
   int keepalive;
+  // Statements prepared by SqlStmt_Cached, keyed by their query text
+  struct SqlStmt* stmt_cache[SQL_STMT_CACHE_MAX];
+  size_t stmt_cache_num;
+  // Connection the cached statements were prepared on
+  unsigned long stmt_cache_thread;
 };
 
 // Column length receiver.
@@ -42,6 +50,10 @@ struct SqlStmt {
   size_t max_columns;
   bool bind_params;
   bool bind_columns;
+  // Owned by Sql::stmt_cache; SqlStmt_Free only releases it
+  bool cached;
+  bool in_use;
+  unsigned int hash;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -63,6 +75,7 @@ Sql* Sql_Malloc(void) {
 }
 
 static int Sql_P_Keepalive(Sql* self);
+static void Sql_P_ClearStmtCache(Sql* self);
 
 /// Establishes a connection.
 int Sql_Connect(Sql* self, const char* user, const char* passwd,
@@ -164,6 +177,9 @@ static int Sql_P_KeepaliveTimer(int data, int none) {
 static int Sql_P_Keepalive(Sql* self) {
   uint32_t timeout, ping_interval;
 
+  // A new connection knows none of the statements prepared on the old one
+  Sql_P_ClearStmtCache(self);
+
   // set a default value first
   timeout = 28800;  // 8 hours
 
@@ -342,6 +358,7 @@ void Sql_ShowDebug_(Sql* self, const char* debug_file,
 /// Frees a Sql handle returned by Sql_Malloc.
 void Sql_Free(Sql* self) {
   if (self) {
+    Sql_P_ClearStmtCache(self);
     Sql_FreeResult(self);
     StringBuf_Destroy(&self->buf);
     if (self->keepalive != INVALID_TIMER) {
@@ -569,6 +586,74 @@ SqlStmt* SqlStmt_Malloc(Sql* sql) {
   return self;
 }
 
+/// FNV-1a of a query template.
+///
+/// @private
+static unsigned int SqlStmt_P_Hash(const char* query) {
+  unsigned int h = 2166136261u;
+
+  while (*query) h = (h ^ (unsigned char)*query++) * 16777619u;
+  return h;
+}
+
+/// Closes every cached statement of the handle. Statements still in use
+/// are only dropped from the cache; their owner's SqlStmt_Free closes them.
+///
+/// @private
+static void Sql_P_ClearStmtCache(Sql* self) {
+  size_t i;
+
+  for (i = 0; i < self->stmt_cache_num; ++i) {
+    self->stmt_cache[i]->cached = false;
+    if (!self->stmt_cache[i]->in_use) SqlStmt_Free(self->stmt_cache[i]);
+  }
+  self->stmt_cache_num = 0;
+  self->stmt_cache_thread = mysql_thread_id(&self->handle);
+}
+
+/// Returns the cached statement for query, prepared on first use.
+SqlStmt* SqlStmt_Cached(Sql* sql, const char* query) {
+  SqlStmt* self;
+  unsigned int hash;
+  size_t i;
+
+  if (sql == NULL) {
+    return NULL;
+  }
+
+  // Reconnected since the statements were prepared: they are gone
+  if (sql->stmt_cache_thread != mysql_thread_id(&sql->handle)) {
+    Sql_P_ClearStmtCache(sql);
+  }
+
+  hash = SqlStmt_P_Hash(query);
+  for (i = 0; i < sql->stmt_cache_num; ++i) {
+    self = sql->stmt_cache[i];
+    if (self->hash == hash && !self->in_use &&
+        strcmp(StringBuf_Value(&self->buf), query) == 0) {
+      self->in_use = true;
+      self->bind_params = false;
+      return self;
+    }
+  }
+
+  self = SqlStmt_Malloc(sql);
+  if (self == NULL) {
+    return NULL;
+  }
+  if (SQL_ERROR == SqlStmt_PrepareStr(self, query)) {
+    // Keep it uncached so the caller's ShowDebug/Free still work
+    return self;
+  }
+  if (sql->stmt_cache_num < SQL_STMT_CACHE_MAX) {
+    self->cached = true;
+    self->in_use = true;
+    self->hash = hash;
+    sql->stmt_cache[sql->stmt_cache_num++] = self;
+  }
+  return self;
+}
+
 /// Prepares the statement.
 int SqlStmt_Prepare(SqlStmt* self, const char* query, ...) {
   int res;
@@ -859,6 +944,12 @@ void SqlStmt_ShowDebug_(SqlStmt* self, const char* debug_file,
 
 /// Frees a SqlStmt returned by SqlStmt_Malloc.
 void SqlStmt_Free(SqlStmt* self) {
+  if (self && self->cached) {
+    // Back to the cache, ready for the next SqlStmt_Cached
+    SqlStmt_FreeResult(self);
+    self->in_use = false;
+    return;
+  }
   if (self) {
     SqlStmt_FreeResult(self);
     StringBuf_Destroy(&self->buf);
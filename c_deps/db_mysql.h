@@ -183,6 +183,18 @@ void Sql_Free(Sql* self);
 /// @return SqlStmt handle or NULL if an error occured
 struct SqlStmt* SqlStmt_Malloc(Sql* sql);
 
+/// Returns a prepared statement for the query, reused across calls.
+///
+/// The query is a fixed template: pass values with '?' placeholders and
+/// SqlStmt_BindParam, never by formatting them in. The statement is
+/// prepared on the server the first time the template is seen and kept
+/// until the connection changes. Release it with SqlStmt_Free. If preparing
+/// fails, the returned statement shows the error through SqlStmt_ShowDebug
+/// and SqlStmt_Execute fails.
+///
+/// @return SqlStmt handle or NULL if an error occured
+struct SqlStmt* SqlStmt_Cached(Sql* sql, const char* query);
+
 /// Prepares the statement.
 /// Any previous result is freed and all parameter bindings are removed.
 /// The query is constructed as if it was sprintf.
@@ -268,4 +280,5 @@ void SqlStmt_ShowDebug_(SqlStmt* self, const char* debug_file,
                         const unsigned long debug_line);
 
 /// Frees a SqlStmt returned by SqlStmt_Malloc.
+/// A statement from SqlStmt_Cached is released back to its cache instead.
 void SqlStmt_Free(SqlStmt* self);
\ No newline at end of file
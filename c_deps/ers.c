@@ -28,19 +28,28 @@
  *    destroyed so memory will usually only be recovered near the end.       *
  *  - Always wastes space for entries smaller than a pointer.                *
  *                                                                           *
- *  WARNING: The system is not thread-safe at the moment.                    *
+ *  WARNING: The entry managers are not thread-safe at the moment.           *
+ *                                                                           *
+ *  <H2>Size-class pools:</H2>                                               *
+ *  The pools are a thread-safe global backend shared by every caller, with  *
+ *  one free list per size class and a small cache per thread in front of    *
+ *  it. Entries are freed with the size they were allocated with. Usage and  *
+ *  high-water counts are kept per class and can be read at any time.        *
  *                                                                           *
  *  HISTORY:                                                                 *
  *    0.1 - Initial version                                                  *
+ *    0.2 - Thread-safe size-class pools with live statistics                *
  *                                                                           *
- * @version 0.1 - Initial version                                            *
+ * @version 0.2 - Thread-safe size-class pools                               *
  * @author Flavio @ Amazon Project                                           *
  * @encoding US-ASCII                                                        *
  * @see common#ers.h                                                         *
 \*****************************************************************************/
 #include "ers.h"
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "showmsg.h"
 #include "strlib.h"
@@ -509,4 +518,383 @@ void ers_force_destroy_all(void) {
   }
   ers_num = 0;
 }
+
+/*****************************************************************************\
+ *  (4) Size-class pools.                                                    *
+ *  ERS_POOL_CLASSES  - Number of size classes.                              *
+ *  ERS_POOL_CACHE    - Entries a thread caches per class.                   *
+ *  ERS_POOL_CHUNK    - Bytes of each chunk of entries.                      *
+ *  ers_pool_class    - Global free list and statistics of a size class.     *
+ *  ers_pool_cache    - Per-thread cache in front of the classes.            *
+ *  ers_pool_alloc    - Allocate a zeroed entry from the size pools.         *
+ *  ers_pool_free     - Free an entry allocated from the size pools.         *
+ *  ers_pool_stats    - Copy the statistics of the size pools.               *
+ *  ers_pool_report   - Print a report about the size pools.                 *
+\*****************************************************************************/
+
+/**
+ * Number of size classes.
+ * Classes go 16, 32, 48, 64, 96, 128, 192, ... up to 64KB: every power of two
+ * and the midpoint above it, so no entry wastes more than a third of itself.
+ * @private
+ */
+#define ERS_POOL_CLASSES 24
+
+/**
+ * Entries a thread keeps cached per class.
+ * A thread takes half of this from the class when its cache runs dry and
+ * gives half back when the cache overflows, so it only takes the class lock
+ * once every ERS_POOL_CACHE / 2 operations.
+ * @private
+ */
+#define ERS_POOL_CACHE 64
+
+/**
+ * Bytes of each chunk of entries a class allocates.
+ * Classes with entries too big to fit 16 of them in a chunk use bigger
+ * chunks.
+ * @private
+ */
+#define ERS_POOL_CHUNK (64 * 1024)
+
+/**
+ * Global free list and statistics of a size class.
+ * The list and chunks are protected by lock. The statistics are updated with
+ * atomics, outside the lock.
+ * @param lock Lock of the free list and chunks
+ * @param reuse Linked list of free entries
+ * @param chunks Array with the chunks of entries
+ * @param num Number of chunks in the array
+ * @param max Current maximum capacity of the array
+ * @param unused Entries never handed out in the last chunk
+ * @param size Size of the entries of the class
+ * @param chunk_entries Entries in each chunk
+ * @param used Entries currently allocated
+ * @param high_water Highest value reached by used
+ * @param allocs Allocations since startup
+ * @param frees Frees since startup
+ * @private
+ */
+struct ers_pool_class {
+  pthread_mutex_t lock;
+  ERLinkedList reuse;
+  uint8_t **chunks;
+  uint32_t num;
+  uint32_t max;
+  uint32_t unused;
+  uint32_t size;
+  uint32_t chunk_entries;
+  uint32_t used;
+  uint32_t high_water;
+  uint64_t allocs;
+  uint64_t frees;
+};
+
+/**
+ * Per-thread cache in front of the classes.
+ * @param reuse Linked lists of cached entries, one per class
+ * @param num Number of entries in each list
+ * @private
+ */
+struct ers_pool_cache {
+  ERLinkedList reuse[ERS_POOL_CLASSES];
+  uint32_t num[ERS_POOL_CLASSES];
+};
+
+/**
+ * The size classes.
+ * @private
+ * @static
+ */
+static struct ers_pool_class ers_pool[ERS_POOL_CLASSES];
+
+/**
+ * Cache of the current thread.
+ * @private
+ * @static
+ */
+static __thread struct ers_pool_cache ers_pool_tcache;
+
+/**
+ * Whether the cache of the current thread is registered with ers_pool_key.
+ * @private
+ * @static
+ */
+static __thread int ers_pool_tcache_init = 0;
+
+/**
+ * Key whose destructor gives back the cache of an exiting thread.
+ * @private
+ * @static
+ */
+static pthread_key_t ers_pool_key;
+
+/**
+ * Guard for ers_pool_init.
+ * @private
+ * @static
+ */
+static pthread_once_t ers_pool_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Return the class of entries of the specified size.
+ * @param size Size of the entry in bytes
+ * @return Index of the class, or -1 if the entry is too big for the classes
+ * @private
+ */
+static int ers_pool_class_of(size_t size) {
+  int i;
+
+  for (i = 0; i < ERS_POOL_CLASSES; i++) {
+    if (size <= ers_pool[i].size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Give a list of entries back to a class.
+ * @param c Class index
+ * @param head First entry of the list
+ * @param tail Last entry of the list
+ * @private
+ */
+static void ers_pool_release(int c, ERLinkedList head, ERLinkedList tail) {
+  struct ers_pool_class *pc = &ers_pool[c];
+
+  pthread_mutex_lock(&pc->lock);
+  tail->next = pc->reuse;
+  pc->reuse = head;
+  pthread_mutex_unlock(&pc->lock);
+}
+
+/**
+ * Give back the cache of an exiting thread.
+ * @param cache Cache of the thread
+ * @private
+ */
+static void ers_pool_cache_destroy(void *cache) {
+  struct ers_pool_cache *tc = (struct ers_pool_cache *)cache;
+  ERLinkedList tail;
+  int c;
+
+  for (c = 0; c < ERS_POOL_CLASSES; c++) {
+    if (tc->reuse[c] == NULL) {
+      continue;
+    }
+    for (tail = tc->reuse[c]; tail->next; tail = tail->next) {
+    }
+    ers_pool_release(c, tc->reuse[c], tail);
+    tc->reuse[c] = NULL;
+    tc->num[c] = 0;
+  }
+}
+
+/**
+ * Initialize the size classes.
+ * @private
+ */
+static void ers_pool_init(void) {
+  size_t size = 16;
+  int i;
+
+  for (i = 0; i < ERS_POOL_CLASSES; i++) {
+    pthread_mutex_init(&ers_pool[i].lock, NULL);
+    ers_pool[i].size = (uint32_t)size;
+    ers_pool[i].chunk_entries = ERS_POOL_CHUNK / size < 16
+                                    ? 16
+                                    : (uint32_t)(ERS_POOL_CHUNK / size);
+    // 16, 32, then alternately the midpoint and the next power of two
+    size += (size & (size - 1)) ? size / 3 : (size < 32 ? size : size / 2);
+  }
+  pthread_key_create(&ers_pool_key, ers_pool_cache_destroy);
+}
+
+/**
+ * Return the cache of the current thread, setting it up on first use.
+ * @return Cache of the thread
+ * @private
+ */
+static struct ers_pool_cache *ers_pool_cache_get(void) {
+  if (!ers_pool_tcache_init) {
+    pthread_once(&ers_pool_once, ers_pool_init);
+    pthread_setspecific(ers_pool_key, &ers_pool_tcache);
+    ers_pool_tcache_init = 1;
+  }
+  return &ers_pool_tcache;
+}
+
+/**
+ * Move up to half a cache of entries from a class into a thread cache,
+ * carving a new chunk if the class has no free entries.
+ * @param c Class index
+ * @param tc Cache of the thread
+ * @private
+ */
+static void ers_pool_refill(int c, struct ers_pool_cache *tc) {
+  struct ers_pool_class *pc = &ers_pool[c];
+  uint8_t *entry;
+
+  pthread_mutex_lock(&pc->lock);
+  while (tc->num[c] < ERS_POOL_CACHE / 2) {
+    if (pc->reuse) {  // Reusable entry
+      entry = (uint8_t *)pc->reuse;
+      pc->reuse = pc->reuse->next;
+    } else {
+      if (pc->unused == 0) {      // allocate a new chunk
+        if (pc->num == pc->max) {  // expand the chunk array
+          pc->max = pc->max ? pc->max * 2 : 16;
+          REALLOC(pc->chunks, uint8_t *, pc->max);
+        }
+        CALLOC(pc->chunks[pc->num], uint8_t,
+               (size_t)pc->size * pc->chunk_entries);
+        pc->num++;
+        pc->unused = pc->chunk_entries;
+      }
+      pc->unused--;
+      entry = &pc->chunks[pc->num - 1][(size_t)pc->unused * pc->size];
+    }
+    ((ERLinkedList)entry)->next = tc->reuse[c];
+    tc->reuse[c] = (ERLinkedList)entry;
+    tc->num[c]++;
+  }
+  pthread_mutex_unlock(&pc->lock);
+}
+
+/**
+ * Allocate a zeroed entry of the specified size from the size-class pools.
+ * Safe to call from any thread. Entries bigger than the largest class are
+ * allocated with calloc.
+ * @param size Size of the entry in bytes
+ * @return An entry, zeroed like calloc
+ * @see #ers_pool_refill
+ */
+void *ers_pool_alloc(size_t size) {
+  struct ers_pool_cache *tc = ers_pool_cache_get();
+  struct ers_pool_class *pc;
+  ERLinkedList entry;
+  uint32_t used, high;
+  int c = ers_pool_class_of(size);
+
+  if (c < 0) {
+    void *ret;
+
+    CALLOC(ret, uint8_t, size);
+    return ret;
+  }
+  pc = &ers_pool[c];
+  if (tc->reuse[c] == NULL) {
+    ers_pool_refill(c, tc);
+  }
+  entry = tc->reuse[c];
+  tc->reuse[c] = entry->next;
+  tc->num[c]--;
+
+  __atomic_add_fetch(&pc->allocs, 1, __ATOMIC_RELAXED);
+  used = __atomic_add_fetch(&pc->used, 1, __ATOMIC_RELAXED);
+  high = __atomic_load_n(&pc->high_water, __ATOMIC_RELAXED);
+  while (used > high &&
+         !__atomic_compare_exchange_n(&pc->high_water, &high, used, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+  memset(entry, 0, size);
+  return entry;
+}
+
+/**
+ * Free an entry allocated from the size-class pools.
+ * WARNING: size must be the size the entry was allocated with.
+ * Safe to call from any thread, not only the one that allocated the entry.
+ * @param entry Entry to be freed, may be NULL
+ * @param size Size the entry was allocated with
+ * @see #ers_pool_release
+ */
+void ers_pool_free(void *entry, size_t size) {
+  struct ers_pool_cache *tc;
+  ERLinkedList head, tail;
+  uint32_t i;
+  int c;
+
+  if (entry == NULL) {
+    return;
+  }
+  tc = ers_pool_cache_get();
+  c = ers_pool_class_of(size);
+  if (c < 0) {
+    free(entry);
+    return;
+  }
+  __atomic_add_fetch(&ers_pool[c].frees, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&ers_pool[c].used, 1, __ATOMIC_RELAXED);
+
+  ((ERLinkedList)entry)->next = tc->reuse[c];
+  tc->reuse[c] = (ERLinkedList)entry;
+  if (++tc->num[c] < ERS_POOL_CACHE) {
+    return;
+  }
+  // Cache full: give the older half back to the class
+  tail = tc->reuse[c];
+  for (i = 1; i < ERS_POOL_CACHE / 2; i++) {
+    tail = tail->next;
+  }
+  head = tail->next;
+  tail->next = NULL;
+  tc->num[c] = ERS_POOL_CACHE / 2;
+  for (tail = head; tail->next; tail = tail->next) {
+  }
+  ers_pool_release(c, head, tail);
+}
+
+/**
+ * Copy the statistics of the size classes that have been used so far.
+ * The counts are read without stopping other threads, so they are only
+ * consistent with each other to within a few entries.
+ * @param out Array receiving the statistics
+ * @param max Capacity of out
+ * @return Number of entries written to out
+ */
+int ers_pool_stats(struct ers_pool_stat *out, int max) {
+  struct ers_pool_class *pc;
+  int i, n = 0;
+
+  pthread_once(&ers_pool_once, ers_pool_init);
+  for (i = 0; i < ERS_POOL_CLASSES && n < max; i++) {
+    pc = &ers_pool[i];
+    if (__atomic_load_n(&pc->allocs, __ATOMIC_RELAXED) == 0) {
+      continue;
+    }
+    out[n].entry_size = pc->size;
+    out[n].used = __atomic_load_n(&pc->used, __ATOMIC_RELAXED);
+    out[n].high_water = __atomic_load_n(&pc->high_water, __ATOMIC_RELAXED);
+    out[n].allocs = __atomic_load_n(&pc->allocs, __ATOMIC_RELAXED);
+    out[n].frees = __atomic_load_n(&pc->frees, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pc->lock);
+    out[n].reserved = (size_t)pc->num * pc->chunk_entries * pc->size;
+    pthread_mutex_unlock(&pc->lock);
+    n++;
+  }
+  return n;
+}
+
+/**
+ * Print a report about the current state of the size-class pools.
+ * Shows the usage of every size class that has been used so far.
+ * @see #ers_pool_stats
+ */
+void ers_pool_report(void) {
+  struct ers_pool_stat st[ERS_POOL_CLASSES];
+  int i, n = ers_pool_stats(st, ERS_POOL_CLASSES);
+
+  ShowMessage(CL_BOLD "Entry Reusage System pool report:\n" CL_NORMAL);
+  for (i = 0; i < n; i++) {
+    ShowMessage(
+        "\tsize %5u : used %8u (high %8u)  reserved %8u KB  allocs %llu  "
+        "frees %llu\n",
+        (unsigned int)st[i].entry_size, st[i].used, st[i].high_water,
+        (unsigned int)(st[i].reserved / 1024),
+        (unsigned long long)st[i].allocs, (unsigned long long)st[i].frees);
+  }
+  ShowMessage("End of report\n");
+}
 #endif /* not DISABLE_ERS */
@@ -30,12 +30,19 @@
  *    destroyed so memory will usually only be recovered near the end.       *
  *  - Always wastes space for entries smaller than a pointer.                *
  *                                                                           *
- *  WARNING: The system is not thread-safe at the moment.                    *
+ *  WARNING: The entry managers are not thread-safe at the moment.           *
+ *                                                                           *
+ *  <H2>Size-class pools:</H2>                                               *
+ *  The pools are a thread-safe global backend shared by every caller, with  *
+ *  one free list per size class and a small cache per thread in front of    *
+ *  it. Entries are freed with the size they were allocated with. Usage and  *
+ *  high-water counts are kept per class and can be read at any time.        *
  *                                                                           *
  *  HISTORY:                                                                 *
  *    0.1 - Initial version                                                  *
+ *    0.2 - Thread-safe size-class pools with live statistics                *
  *                                                                           *
- * @version 0.1 - Initial version                                            *
+ * @version 0.2 - Thread-safe size-class pools                               *
  * @author Flavio @ Amazon Project                                           *
  * @encoding US-ASCII                                                        *
 \*****************************************************************************/
@@ -48,6 +55,10 @@
  *  ers_new               - Allocate an instance of an entry manager.        *
  *  ers_report            - Print a report about the current state.          *
  *  ers_force_destroy_all - Force the destruction of all the managers.       *
+ *  ers_pool_alloc        - Allocate a zeroed entry from the size pools.     *
+ *  ers_pool_free         - Free an entry allocated from the size pools.     *
+ *  ers_pool_stats        - Copy the statistics of the size pools.           *
+ *  ers_pool_report       - Print a report about the size pools.             *
 \*****************************************************************************/
 
 #include <stddef.h>
@@ -114,6 +125,24 @@ typedef struct eri {
 
 } * ERS;
 
+/**
+ * Statistics of one size class of the pools.
+ * @param entry_size Size of the entries of the class in bytes
+ * @param used Entries currently allocated
+ * @param high_water Highest value reached by used
+ * @param allocs Allocations since startup
+ * @param frees Frees since startup
+ * @param reserved Bytes of memory obtained for the class
+ */
+struct ers_pool_stat {
+  size_t entry_size;
+  uint32_t used;
+  uint32_t high_water;
+  uint64_t allocs;
+  uint64_t frees;
+  size_t reserved;
+};
+
 #ifdef DISABLE_ERS
 // Use memory manager to allocate/free and disable other interface functions
 #define ers_alloc(obj, type) (type *)malloc(sizeof(type))
@@ -124,6 +153,10 @@ typedef struct eri {
 #define ers_new(size) NULL
 #define ers_report()
 #define ers_force_destroy_all()
+#define ers_pool_alloc(size) calloc(1, (size))
+#define ers_pool_free(entry, size) free(entry)
+#define ers_pool_stats(out, max) 0
+#define ers_pool_report()
 #else /* not DISABLE_ERS */
 // These defines should be used to allow the code to keep working whenever
 // the system is disabled
@@ -162,4 +195,37 @@ void ers_report(void);
  * allocated by this system is released.
  */
 void ers_force_destroy_all(void);
+
+/**
+ * Allocate a zeroed entry of the specified size from the size-class pools.
+ * Safe to call from any thread. Entries bigger than the largest class are
+ * allocated with calloc.
+ * @param size Size of the entry in bytes
+ * @return An entry, zeroed like calloc
+ */
+void *ers_pool_alloc(size_t size);
+
+/**
+ * Free an entry allocated from the size-class pools.
+ * WARNING: size must be the size the entry was allocated with.
+ * Safe to call from any thread, not only the one that allocated the entry.
+ * @param entry Entry to be freed, may be NULL
+ * @param size Size the entry was allocated with
+ */
+void ers_pool_free(void *entry, size_t size);
+
+/**
+ * Copy the statistics of the size classes that have been used so far.
+ * The counts are read without stopping other threads, so they are only
+ * consistent with each other to within a few entries.
+ * @param out Array receiving the statistics
+ * @param max Capacity of out
+ * @return Number of entries written to out
+ */
+int ers_pool_stats(struct ers_pool_stat *out, int max);
+
+/**
+ * Print a report about the current state of the size-class pools.
+ */
+void ers_pool_report(void);
 #endif /* DISABLE_ERS / not DISABLE_ERS */
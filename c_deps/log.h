@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "yuri.h"
+
+// Levels of rust_log_admit/rust_log_emit.
+#define YURI_LOG_ERROR 0
+#define YURI_LOG_WARN 1
+#define YURI_LOG_INFO 2
+#define YURI_LOG_DEBUG 3
+
+// Log a printf-style line through Rust's tracing (target yuri::c). The
+// filter and this callsite's per-second budget are checked before anything
+// is formatted; admitted lines go to a background writer (c_log.rs).
+#define yuri_log(level, fmt, ...)                                        \
+  do {                                                                   \
+    static struct rust_log_site _log_site_;                              \
+    int _log_skipped_ = rust_log_admit((level), &_log_site_);            \
+    if (_log_skipped_ >= 0) {                                            \
+      char _log_buf_[2048];                                              \
+      snprintf(_log_buf_, sizeof(_log_buf_), fmt, ##__VA_ARGS__);        \
+      rust_log_emit((level), _log_skipped_, _log_buf_);                  \
+    }                                                                    \
+  } while (0)
+
+#define log_error(fmt, ...) yuri_log(YURI_LOG_ERROR, fmt, ##__VA_ARGS__)
+#define log_warn(fmt, ...) yuri_log(YURI_LOG_WARN, fmt, ##__VA_ARGS__)
+#define log_info(fmt, ...) yuri_log(YURI_LOG_INFO, fmt, ##__VA_ARGS__)
+#define log_debug(fmt, ...) yuri_log(YURI_LOG_DEBUG, fmt, ##__VA_ARGS__)
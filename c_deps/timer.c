@@ -7,7 +7,9 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "log.h"
 #include "strlib.h"
+#include "yuri.h"
 
 #define TIMER_MIN_INTERVAL 50
 #define TIMER_MAX_INTERVAL 1000
@@ -18,15 +20,16 @@ static struct TimerData* timer_data = NULL;
 static int timer_data_max = 0;
 static int timer_data_num = 0;
 
-// free timers (array)
+// free timers (FIFO ring: free_timer_list_pos ids from free_timer_list_head)
 static int* free_timer_list = NULL;
 static int free_timer_list_max = 0;
+static int free_timer_list_head = 0;
 static int free_timer_list_pos = 0;
 
-// timer heap (ordered array of tid's)
-static int timer_heap_num = 0;
-static int timer_heap_max = 0;
-static int* timer_heap = NULL;
+// A freed id is only handed out again once this many ids were freed after
+// it, so a caller still holding a stale tid does not at once get to cancel
+// or inspect whichever timer was started next.
+#define TIMER_REUSE_DELAY 256
 
 /*----------------------------
  * 	Get tick time
@@ -63,9 +66,17 @@ int getSecond(void) {
   return d->tm_sec;
 }
 
+// replaces the system clock when set (packet replay runs on a virtual clock)
+static unsigned int (*tick_source)(void) = NULL;
+
+void timer_set_tick_source(unsigned int (*source)(void)) {
+  tick_source = source;
+}
+
 /// platform-abstracted tick retrieval
 
 static unsigned int tick(void) {
+  if (tick_source) return tick_source();
 #if defined(WIN32)
   return GetTickCount();
 #elif (defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 &&            \
@@ -109,55 +120,106 @@ unsigned int gettick(void) { return tick(); }
 //////////////////////////////////////////////////////////////////////////
 
 /*======================================
- * 	CORE : Timer Heap
+ * 	CORE : Timer Wheel
  *--------------------------------------*/
 
-// searches for the target tick's position and stores it in pos (binary search)
-#define HEAP_SEARCH(target, from, to, pos)                           \
-  do {                                                               \
-    int max, pivot;                                                  \
-    max = to;                                                        \
-    pos = from;                                                      \
-    while (pos < max) {                                              \
-      pivot = (pos + max) / 2;                                       \
-      if (DIFF_TICK(target, timer_data[timer_heap[pivot]].tick) < 0) \
-        pos = pivot + 1;                                             \
-      else                                                           \
-        max = pivot;                                                 \
-    }                                                                \
-  } while (0)
-
-/// Adds a timer to the timer_heap
-static void push_timer_heap(int tid) {
-  int pos;
+// Hierarchical timing wheel with 1 ms resolution. Level 0 holds the next
+// 256 ms one slot per tick; each higher level covers 64x the span of the one
+// below, so five levels cover the whole 32-bit tick range. A timer sits in a
+// doubly linked slot list (heap_pos is the list id), which makes insert and
+// cancel O(1). timer_do only walks the level 0 slots for the elapsed ticks
+// and, every 256 ms, cascades one higher-level slot down.
+#define WHEEL_L0_BITS 8
+#define WHEEL_LN_BITS 6
+#define WHEEL_L0_SIZE (1 << WHEEL_L0_BITS)
+#define WHEEL_LN_SIZE (1 << WHEEL_LN_BITS)
+#define WHEEL_LEVELS 5
+#define WHEEL_SLOTS (WHEEL_L0_SIZE + (WHEEL_LEVELS - 1) * WHEEL_LN_SIZE)
+#define WHEEL_RUNNING WHEEL_SLOTS  // list of timers due in the current tick
+#define WHEEL_NONE -1
+
+static int wheel_head[WHEEL_SLOTS + 1];
+static int wheel_tail[WHEEL_SLOTS + 1];
+static unsigned int wheel_tick;  // next tick to process
+static int wheel_started = 0;
+
+static void wheel_start(void) {
+  int i;
+
+  if (wheel_started) return;
+  for (i = 0; i <= WHEEL_SLOTS; i++) wheel_head[i] = wheel_tail[i] = -1;
+  wheel_tick = gettick();
+  wheel_started = 1;
+}
 
-  // check available space
-  if (timer_heap_num >= timer_heap_max) {
-    timer_heap_max += 256;
-    if (timer_heap) {
-      REALLOC(timer_heap, int, timer_heap_max);
-    } else
-      CALLOC(timer_heap, int, timer_heap_max);
-    memset(timer_heap + (timer_heap_max - 256), 0, sizeof(int) * 256);
+static void wheel_link(int list, int tid) {
+  timer_data[tid].heap_pos = list;
+  timer_data[tid].next = -1;
+  timer_data[tid].prev = wheel_tail[list];
+  if (wheel_tail[list] >= 0)
+    timer_data[wheel_tail[list]].next = tid;
+  else
+    wheel_head[list] = tid;
+  wheel_tail[list] = tid;
+}
+
+static void wheel_unlink(int tid) {
+  int list = timer_data[tid].heap_pos;
+
+  if (list == WHEEL_NONE) return;
+  if (timer_data[tid].prev >= 0)
+    timer_data[timer_data[tid].prev].next = timer_data[tid].next;
+  else
+    wheel_head[list] = timer_data[tid].next;
+  if (timer_data[tid].next >= 0)
+    timer_data[timer_data[tid].next].prev = timer_data[tid].prev;
+  else
+    wheel_tail[list] = timer_data[tid].prev;
+  timer_data[tid].heap_pos = WHEEL_NONE;
+}
+
+/// Links a timer into the slot for its tick. Ticks already due go into the
+/// next slot timer_do will process.
+static void push_timer_heap(int tid) {
+  unsigned int expires = timer_data[tid].tick;
+  int diff = DIFF_TICK(expires, wheel_tick);
+  unsigned int delta;
+  int level, shift, list;
+
+  if (diff < 0) {
+    expires = wheel_tick;
+    diff = 0;
   }
+  delta = (unsigned int)diff;
 
-  // do a sorting from higher to lower
-  if (timer_heap_num == 0 ||
-      DIFF_TICK(timer_data[tid].tick,
-                timer_data[timer_heap[timer_heap_num - 1]].tick) < 0) {
-    timer_heap[timer_heap_num] =
-        tid;  // if lower actual item is higher than new
+  if (delta < WHEEL_L0_SIZE) {
+    list = expires & (WHEEL_L0_SIZE - 1);
   } else {
-    // searching position
-    HEAP_SEARCH(timer_data[tid].tick, 0, timer_heap_num - 1, pos);
-    // move elements
-    memmove(&timer_heap[pos + 1], &timer_heap[pos],
-            sizeof(int) * (timer_heap_num - pos));
-    // save new element
-    timer_heap[pos] = tid;
+    shift = WHEEL_L0_BITS;
+    for (level = 1; level < WHEEL_LEVELS - 1; level++) {
+      if (delta < (1u << (shift + WHEEL_LN_BITS))) break;
+      shift += WHEEL_LN_BITS;
+    }
+    list = WHEEL_L0_SIZE + (level - 1) * WHEEL_LN_SIZE +
+           ((expires >> shift) & (WHEEL_LN_SIZE - 1));
   }
+  wheel_link(list, tid);
+}
 
-  timer_heap_num++;
+/// Re-files every timer of one higher-level slot; returns the slot index.
+static int wheel_cascade(int level) {
+  int shift = WHEEL_L0_BITS + (level - 1) * WHEEL_LN_BITS;
+  int index = (wheel_tick >> shift) & (WHEEL_LN_SIZE - 1);
+  int list = WHEEL_L0_SIZE + (level - 1) * WHEEL_LN_SIZE + index;
+  int tid = wheel_head[list];
+
+  wheel_head[list] = wheel_tail[list] = -1;
+  while (tid >= 0) {
+    int next = timer_data[tid].next;
+    push_timer_heap(tid);
+    tid = next;
+  }
+  return index;
 }
 
 /*==========================
@@ -168,11 +230,11 @@ static void push_timer_heap(int tid) {
 static int acquire_timer(void) {
   int tid;
 
-  // select a free timer
-  if (free_timer_list_pos) {
-    do {
-      tid = free_timer_list[--free_timer_list_pos];
-    } while (tid >= timer_data_num && free_timer_list_pos > 0);
+  // select the oldest free timer, or a new one while few are free
+  if (free_timer_list_pos > TIMER_REUSE_DELAY) {
+    tid = free_timer_list[free_timer_list_head];
+    free_timer_list_head = (free_timer_list_head + 1) % free_timer_list_max;
+    free_timer_list_pos--;
   } else {
     tid = timer_data_num;
   }
@@ -201,12 +263,35 @@ static int acquire_timer(void) {
   return tid;
 }
 
+/// Returns a timer id to the back of the free list.
+static void release_timer(int tid) {
+  timer_data[tid].type = 0;
+  timer_data[tid].heap_pos = WHEEL_NONE;
+  timer_data[tid].func = NULL;
+  if (free_timer_list_pos >= free_timer_list_max) {  // grow, unwrapping the ring
+    int* list;
+    int i;
+
+    CALLOC(list, int, free_timer_list_max + 256);
+    for (i = 0; i < free_timer_list_pos; i++)
+      list[i] = free_timer_list[(free_timer_list_head + i) % free_timer_list_max];
+    FREE(free_timer_list);
+    free_timer_list = list;
+    free_timer_list_max += 256;
+    free_timer_list_head = 0;
+  }
+  free_timer_list[(free_timer_list_head + free_timer_list_pos) %
+                  free_timer_list_max] = tid;
+  free_timer_list_pos++;
+}
+
 /// Starts a new timer that is deleted once it expires (single-use).
 /// Returns the timer's id.
 int timer_insert(unsigned int tick, unsigned int interval,
                  int (*func)(int, int), int data1, int data2) {
   int tid;
 
+  wheel_start();
   tid = acquire_timer();
   timer_data[tid].tick = gettick() + tick;
   timer_data[tid].func = func;
@@ -220,109 +305,135 @@ int timer_insert(unsigned int tick, unsigned int interval,
   return tid;
 }
 
+/// Number of timers allocated: pending, running or freed inside their own
+/// callback and not yet released.
+int timer_count(void) {
+  return timer_data_num - free_timer_list_pos;
+}
+
 /// Retrieves internal timer data
 const struct TimerData* get_timer(int tid) {
   return (tid >= 0 && tid < timer_data_num) ? &timer_data[tid] : NULL;
 }
 
-/// Marks a timer specified by 'id' for immediate deletion once it expires.
-/// Param 'func' is used for debug/verification purposes.
+/// Cancels a timer. A pending timer is unlinked and its id freed at once;
+/// a timer cancelled from inside its own callback is freed by timer_do when
+/// the callback returns.
 /// Returns 0 on success, < 0 on failure.
 int timer_remove(int tid) {
   if (tid < 0 || tid >= timer_data_num) {
-    printf("timer_remove error: no such timer %d\n", tid);
+    log_error("timer_remove error: no such timer %d\n", tid);
     // ShowError("delete_timer error : no such timer %d\n", tid);
     return -1;
   }
 
-  timer_data[tid].func = NULL;
-  timer_data[tid].type = TIMER_ONCE_AUTODEL;
+  if (timer_data[tid].type == 0) return 0;  // already freed
+
+  if (timer_data[tid].type & TIMER_REMOVE_HEAP) {
+    timer_data[tid].func = NULL;
+    timer_data[tid].type = TIMER_ONCE_AUTODEL | TIMER_REMOVE_HEAP;
+    return 0;
+  }
 
+  wheel_unlink(tid);
+  release_timer(tid);
   return 0;
 }
 
-/// Adjusts a timer's expiration time.
-/// Returns the new tick value, or -1 if it fails.
+/// Returns ms until the next level 0 timer, or TIMER_MAX_INTERVAL if none is
+/// due within the level 0 span.
+static int wheel_next_diff(void) {
+  int i;
+
+  for (i = 0; i < WHEEL_L0_SIZE && i < TIMER_MAX_INTERVAL; i++)
+    if (wheel_head[(wheel_tick + i) & (WHEEL_L0_SIZE - 1)] >= 0) return i + 1;
+  return TIMER_MAX_INTERVAL;
+}
 
 /// Executes all expired timers.
 /// Returns the value of the smallest non-expired timer (or 1 second if there
 /// aren't any).
 int timer_do(unsigned int tick) {
-  int diff = 1000;  // return value
-  int toDel = 0;
-  // process all timers one by one
-  while (timer_heap_num) {
-    int tid =
-        timer_heap[timer_heap_num - 1];  // last element in heap (smallest tick)
-    toDel = 0;
-    diff = DIFF_TICK(timer_data[tid].tick, tick);
-    if (diff > 0) {
-      break;  // no more expired timers to process
+  uint64_t tick_started = rust_timer_clock();
+
+  wheel_start();
+
+  // process every elapsed tick one slot at a time
+  while (DIFF_TICK(tick, wheel_tick) >= 0) {
+    int index = wheel_tick & (WHEEL_L0_SIZE - 1);
+    int level, tid;
+
+    if (index == 0) {
+      for (level = 1; level < WHEEL_LEVELS; level++)
+        if (wheel_cascade(level) != 0) break;
     }
 
-    --timer_heap_num;  // suppress the actual element from the table
-
-    // mark timer as 'to be removed'
-    timer_data[tid].type |= TIMER_REMOVE_HEAP;
-    // if(tid=3915) printf("CONNECT CHAR!\n");
-    if (timer_data[tid].func) {
-      // printf("%u\n",(int)timer_data[tid].func);
-      if (diff <= -1000) {
-        toDel =
-            timer_data[tid].func(timer_data[tid].data1, timer_data[tid].data2);
-      } else {
-        toDel =
-            timer_data[tid].func(timer_data[tid].data1, timer_data[tid].data2);
+    // move the slot to the running list, then advance so timers a callback
+    // schedules for "now" land in the next slot instead of this one
+    wheel_head[WHEEL_RUNNING] = wheel_head[index];
+    wheel_tail[WHEEL_RUNNING] = wheel_tail[index];
+    for (tid = wheel_head[index]; tid >= 0; tid = timer_data[tid].next)
+      timer_data[tid].heap_pos = WHEEL_RUNNING;
+    wheel_head[index] = wheel_tail[index] = -1;
+    wheel_tick++;
+
+    while ((tid = wheel_head[WHEEL_RUNNING]) >= 0) {
+      int toDel = 0;
+
+      wheel_unlink(tid);
+
+      // mark timer as running
+      timer_data[tid].type |= TIMER_REMOVE_HEAP;
+      if (timer_data[tid].func) {
+        // the callback may remove its timer and clear func; keep it for stats
+        int (*func)(int, int) = timer_data[tid].func;
+        int late = DIFF_TICK(gettick(), timer_data[tid].tick);
+        uint64_t started = rust_timer_clock();
+
+        toDel = func(timer_data[tid].data1, timer_data[tid].data2);
+        rust_timer_record((const void *)func, late, started);
+      }
+      if (toDel) {
+        timer_remove(tid);
       }
-    }
-    // printf("Diff: %d\n",diff);
-    if (toDel) {
-      timer_remove(tid);
-    }
 
-    // in the case the function didn't change anything...
-    if (timer_data[tid].type & TIMER_REMOVE_HEAP) {
-      timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
-
-      switch (timer_data[tid].type) {
-        case TIMER_ONCE_AUTODEL:
-          timer_data[tid].type = 0;
-          if (free_timer_list_pos >= free_timer_list_max) {
-            free_timer_list_max += 256;
-            REALLOC(free_timer_list, int, free_timer_list_max);
-            memset(free_timer_list + (free_timer_list_max - 256), 0,
-                   256 * sizeof(int));
-          }
-          free_timer_list[free_timer_list_pos++] = tid;
-          break;
-        case TIMER_INTERVAL:
-          if (DIFF_TICK(timer_data[tid].tick, tick) < -1000) {
-            timer_data[tid].tick = tick + timer_data[tid].interval;
-          } else {
-            timer_data[tid].tick += timer_data[tid].interval;
-          }
-          timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
-          push_timer_heap(tid);
-          break;
+      // in the case the function didn't change anything...
+      if (timer_data[tid].type & TIMER_REMOVE_HEAP) {
+        timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
+
+        switch (timer_data[tid].type) {
+          case TIMER_INTERVAL:
+            if (DIFF_TICK(timer_data[tid].tick, tick) < -1000) {
+              timer_data[tid].tick = tick + timer_data[tid].interval;
+            } else {
+              timer_data[tid].tick += timer_data[tid].interval;
+            }
+            push_timer_heap(tid);
+            break;
+          default:
+            release_timer(tid);
+            break;
+        }
       }
     }
   }
 
-  return cap_value(diff, TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
+  rust_timer_tick_end(tick_started);
+  return cap_value(wheel_next_diff(), TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
 }
 
-void timer_init() {}
+void timer_init() { wheel_start(); }
 
 int timer_clear() {
   if (timer_data) {
     FREE(timer_data);
   }
-  if (timer_heap) {
-    FREE(timer_heap);
-  }
   if (free_timer_list) {
     FREE(free_timer_list);
   }
+  timer_data_num = timer_data_max = 0;
+  free_timer_list_head = free_timer_list_pos = free_timer_list_max = 0;
+  wheel_started = 0;
 
   return 0;
 }
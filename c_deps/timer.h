@@ -15,7 +15,8 @@ struct TimerData {
   int (*func)(int, int);
   int type;
   unsigned int interval;
-  int heap_pos;
+  int heap_pos;  // wheel slot list the timer is linked on, -1 if none
+  int next, prev;
 
   // general-purpose storage
   int id;
@@ -26,6 +27,7 @@ struct TimerData {
 int timer_insert(unsigned int, unsigned int, int (*)(int, int), int, int);
 int timer_remove(int);
 int timer_do(unsigned int tick);
+int timer_count(void);
 int getDay(void);
 int getHour(void);
 int getMinute(void);
@@ -34,3 +36,4 @@ int timer_clear();
 void timer_init();
 unsigned int gettick_nocache();
 unsigned int gettick();
+void timer_set_tick_source(unsigned int (*)(void));
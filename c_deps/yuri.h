@@ -39,6 +39,11 @@
  */
 #define DDOS_AUTORESET ((10 * 60) * 1000)
 
+/**
+ * Number of keys remembered per session.
+ */
+#define CRYPT_KEY_CACHE_SLOTS 8
+
 #define BLOCK_SIZE 8
 
 #define MAX_MAPREG 500
@@ -97,6 +102,11 @@
  */
 #define MAX_SESSIONS 1024
 
+/**
+ * Number of span slots. Session fds are allocated in 1..=MAX_SESSIONS.
+ */
+#define SESSION_SPAN_SLOTS (MAX_SESSIONS + 1)
+
 typedef struct BoardData {
   int id;
   int level;
@@ -344,12 +354,85 @@ typedef struct RecipeData {
   unsigned int skill_required;
 } RecipeData;
 
+/**
+ * One row of a ranking page, as filled in for C.
+ */
+typedef struct RankingRow {
+  char name[16];
+  int score;
+  int rank;
+} RankingRow;
+
+/**
+ * Pinned view of one session's FIFO buffers.
+ *
+ * The RFIFO and WFIFO macros in session.h index straight into these pointers
+ * instead of taking the session lock for every byte. A side is only valid
+ * while pinned; unpinned sides are NULL and the macros fall back to the
+ * locked rust_session_rdata_ptr / rust_session_wdata_ptr path.
+ */
+typedef struct SessionSpan {
+  /**
+   * rdata + rdata_pos, or NULL when the read side is not pinned
+   */
+  const uint8_t *rdata;
+  /**
+   * Unread bytes available at `rdata`
+   */
+  uintptr_t rlen;
+  /**
+   * wdata + wdata_size, or NULL when the write side is not pinned
+   */
+  uint8_t *wdata;
+  /**
+   * Bytes writable at `wdata` before the buffer has to grow
+   */
+  uintptr_t wlen;
+} SessionSpan;
+
+/**
+ * Per-session cache of generate_key2 results.
+ *
+ * Embedded in USER next to `EncHash` (a zeroed struct is an empty cache).
+ * A key depends only on the session's table, the direction and the three
+ * index bytes in the packet trailer. The table is fixed for the session,
+ * so the trailer bytes plus direction are the whole cache key. Server-bound
+ * packets always carry the same trailer (see set_packet_indexes), so
+ * encrypt() hits every time after the first packet.
+ */
+typedef struct CryptKeyCache {
+  /**
+   * Per slot: 1<<25 (valid) | fromclient<<24 | k1<<16 | k2
+   */
+  uint32_t tags[CRYPT_KEY_CACHE_SLOTS];
+  /**
+   * Cached 9-byte keys
+   */
+  uint8_t keys[CRYPT_KEY_CACHE_SLOTS][9];
+  /**
+   * Lookups served from this cache
+   */
+  uint32_t hits;
+  /**
+   * Lookups that had to derive the key
+   */
+  uint32_t misses;
+} CryptKeyCache;
+
 /**
  * Exposed for C code that declares `extern struct class_data* cdata[20]`.
  * Unused in practice but required by the C headers.
  */
 extern struct ClassData *cdata[20];
 
+/**
+ * Span table indexed by fd, read directly by C (declared in yuri.h).
+ *
+ * Only written by Session methods while the session lock is held, so every
+ * update is ordered with the buffer mutation it describes.
+ */
+extern struct SessionSpan rust_session_spans[SESSION_SPAN_SLOTS];
+
 int rust_boarddb_init(void);
 
 void rust_boarddb_term(void);
@@ -480,6 +563,44 @@ struct ClanData *rust_clandb_searchname(const char *s);
 
 const char *rust_clandb_name(int id);
 
+int rust_rankingdb_init(void);
+
+/**
+ * Score of `cha_id` in `eventid`, 0 if they have none.
+ */
+int rust_ranking_score(int eventid, unsigned int cha_id);
+
+/**
+ * 1-based rank of `cha_id` in `eventid`, 0 if they have no score.
+ */
+int rust_ranking_rank(int eventid, unsigned int cha_id);
+
+/**
+ * `EventClaim` of `cha_id` in `eventid`; 2 (no reward) if they have no row.
+ */
+int rust_ranking_claim(int eventid, unsigned int cha_id);
+
+int rust_ranking_count(int eventid);
+
+/**
+ * Fill `out` with up to `max` standings from 0-based position `offset`.
+ * Names are cut to 15 bytes. Returns the number written.
+ *
+ * # Safety
+ * `out` must point to at least `max` writable `RankingRow`s.
+ */
+int rust_ranking_page(int eventid, int offset, struct RankingRow *out, int max);
+
+/**
+ * Set the claim state of an existing row and queue its save.
+ */
+void rust_ranking_set_claim(int eventid, unsigned int cha_id, int claim);
+
+/**
+ * Queue a rewrite of the event's `Rank` column.
+ */
+void rust_ranking_save_ranks(int eventid);
+
 /**
  * Load configuration from file (C-compatible entry point)
  *
@@ -649,6 +770,12 @@ void rust_handle_signal(int signum);
  */
 void rust_request_shutdown(void);
 
+/**
+ * Withdraw a shutdown requested with rust_request_shutdown, so the session
+ * loop can be run again
+ */
+void rust_cancel_shutdown(void);
+
 /**
  * Check if server shutdown has been requested
  * Returns 1 if shutdown requested, 0 otherwise
@@ -701,6 +828,27 @@ char *rust_crypt_generate_key2(unsigned char *packet,
                                char *keyout,
                                int fromclient);
 
+/**
+ * Like `rust_crypt_generate_key2`, but served from the session's key cache
+ * (`sd->EncKeys`) when the packet's index bytes have been seen before.
+ * Returns `keyout` on success.
+ */
+char *rust_crypt_generate_key2_cached(unsigned char *packet,
+                                      const char *table,
+                                      struct CryptKeyCache *cache,
+                                      char *keyout,
+                                      int fromclient);
+
+/**
+ * Empty a session's key cache (call whenever its EncHash table changes).
+ */
+void rust_crypt_key_cache_reset(struct CryptKeyCache *cache);
+
+/**
+ * Process-wide key cache hits/misses since startup. Either pointer may be NULL.
+ */
+void rust_crypt_key_cache_totals(uint64_t *hits, uint64_t *misses);
+
 /**
  * XOR-encrypts/decrypts `buff` in-place using a 9-byte `key`.
  */
@@ -717,6 +865,34 @@ void rust_crypt_static(unsigned char *buff, const char *xor_key);
  */
 int rust_db_connect(const char *url);
 
+/**
+ * Queue a game-thread write for the DB worker. A non-null `key` coalesces
+ * it with any queued write under the same key. Returns 0 if nothing was
+ * queued (no worker running); the caller then runs `sql` itself.
+ */
+int rust_dbq_push(const char *key, const char *sql);
+
+/**
+ * Block until every queued write has been executed, buffered registry
+ * writes included. Called from map_do_term.
+ */
+void rust_dbq_flush(void);
+
+/**
+ * Buffer map `m`'s registry `ident` (slot `pos`) as `val`; 0 deletes it.
+ */
+void rust_reg_write_map(int m, const char *ident, int val, int pos);
+
+/**
+ * Buffer game registry `ident` of server `server_id` as `val`; 0 deletes it.
+ */
+void rust_reg_write_game(int server_id, const char *ident, int val);
+
+/**
+ * Timer callback: flush buffered registry writes every `FLUSH_MS`.
+ */
+int rust_reg_flush_timer(int _id, int _data);
+
 int rust_itemdb_init(void);
 
 void rust_itemdb_term(void);
@@ -910,9 +1086,10 @@ const char *rust_magicdb_script3(int _id);
 int rust_map_init(const char *maps_dir, int server_id);
 
 /**
- * Reload map metadata + registry in-place (tile arrays reallocated, block grid preserved).
- * Replaces map_reload() body. Returns 0 on success, -1 on error.
- * NOTE: C wrapper still calls map_foreachinarea(sl_updatepeople,...) after this returns.
+ * Reload the maps whose Maps row or map file changed, in place (block grid
+ * and entities preserved). Replaces map_reload() body. Returns 0 on success, -1 on error.
+ * NOTE: C wrapper still calls map_foreachinarea(sl_updatepeople,...) for each
+ * map rust_map_changed() reports.
  */
 int rust_map_reload(const char *maps_dir, int server_id);
 
@@ -922,6 +1099,18 @@ int rust_map_reload(const char *maps_dir, int server_id);
  */
 int rust_map_loadregistry(int map_id);
 
+/**
+ * 1 if the last rust_map_reload changed map `map_id` (its players need
+ * refreshing), else 0.
+ */
+int rust_map_changed(int map_id);
+
+/**
+ * Free the tile arrays of map `map_id` (unmapping them if they came from the
+ * map cache). Called from map_do_term(); C must not FREE tile/pass/obj/map.
+ */
+void rust_map_free_tiles(int map_id);
+
 int rust_mobdb_init(void);
 
 void rust_mobdb_term(void);
@@ -1031,7 +1220,7 @@ int rust_session_skip(int fd, uintptr_t len);
 uintptr_t rust_session_available(int fd);
 
 /**
- * Commit write buffer (like WFIFOSET).
+ * Commit write buffer (like WFIFOSET) and release the pin WFIFOHEAD took.
  * Returns 0 on success, -1 on error.
  */
 int rust_session_commit(int fd, uintptr_t len);
@@ -1064,9 +1253,60 @@ uint8_t *rust_session_wdata_ptr(int fd, uintptr_t pos);
 /**
  * Ensure write buffer has room for `size` bytes (like WFIFOHEAD).
  * Returns 0 on success, -1 on error.
+ *
+ * WFIFOHEAD starts every outgoing packet, so this also pins the write span:
+ * the WFIFOB/WFIFOW/WFIFOL writes that follow go straight into the buffer
+ * instead of through rust_session_wdata_ptr. WFIFOSET releases the pin.
  */
 int rust_session_wfifohead(int fd, uintptr_t size);
 
+/**
+ * Pin the read buffer and return a pointer to the first unread byte.
+ * Writes the number of unread bytes to `len` (if non-NULL).
+ * Returns NULL if the session does not exist.
+ *
+ * While pinned, RFIFOB/RFIFOW/RFIFOL/RFIFOP index the span published in
+ * rust_session_spans without a session lookup. RFIFOSKIP/RFIFOFLUSH keep
+ * the span current. session_io_task pins around every parse pass, so only
+ * code reading a session outside its own parse callback needs this.
+ *
+ * # Safety
+ * `len` must be NULL or point to writable memory.
+ */
+const uint8_t *rust_session_begin_read(int fd, uintptr_t *len);
+
+/**
+ * Release a read pin taken by rust_session_begin_read.
+ */
+void rust_session_end_read(int fd);
+
+/**
+ * Reserve `size` bytes, pin the write buffer and return a pointer to the
+ * next unwritten byte (WFIFOP(fd, 0)). Writes the writable length to `len`
+ * (if non-NULL). Returns NULL on error.
+ *
+ * # Safety
+ * `len` must be NULL or point to writable memory.
+ */
+uint8_t *rust_session_begin_write(int fd, uintptr_t size, uintptr_t *len);
+
+/**
+ * Commit `len` bytes (0 = nothing) and release the write pin.
+ * Returns 0 on success, -1 on error.
+ */
+int rust_session_end_write(int fd, uintptr_t len);
+
+/**
+ * Append a finished (already encrypted) packet to the write buffer and
+ * commit it: WFIFOHEAD + memcpy + WFIFOSET under a single session lock.
+ * Used by broadcast fan-out, which encrypts once and copies to every fd.
+ * Returns 0 on success, -1 on error.
+ *
+ * # Safety
+ * `buf` must point to at least `len` readable bytes.
+ */
+int rust_session_send_bytes(int fd, const uint8_t *buf, uintptr_t len);
+
 /**
  * Flush read buffer - compact unread data (like RFIFOFLUSH).
  */
@@ -1175,6 +1415,28 @@ void rust_session_call_parse(int fd);
  */
 void rust_log_c(int level, const char *msg);
 
+/**
+ * Per-callsite rate limit state of the log.h macros (c_log::LogSite).
+ * Zero-initialized static storage is a fresh site.
+ */
+struct rust_log_site {
+  uint32_t window;
+  uint32_t count;
+  uint32_t suppressed;
+};
+
+/**
+ * Whether a log.h callsite should format its line: -1 to skip it (filtered
+ * out, or over the callsite's budget), else how many lines the site skipped
+ * since the last one it logged.
+ */
+int rust_log_admit(int level, const struct rust_log_site *site);
+
+/**
+ * Queue a line rust_log_admit let through.
+ */
+void rust_log_emit(int level, int skipped, const char *msg);
+
 /**
  * Get a snapshot of all active session fds (for iteration in C).
  * Writes fds into caller-provided buffer, returns count written.
@@ -1213,6 +1475,36 @@ void rust_add_throttle(uint32_t ip);
  */
 int rust_remove_throttle(int _id, int _data);
 
+/**
+ * Start time of a timer callback or of a whole `timer_do`.
+ */
+uint64_t rust_timer_clock(void);
+
+/**
+ * Timer callback `func` ran from `start`, `late` ticks after it was due.
+ */
+void rust_timer_record(const void *func, int late, uint64_t start);
+
+/**
+ * `timer_do` started at `start` has finished; logs it if it was slow.
+ */
+void rust_timer_tick_end(uint64_t start);
+
+/**
+ * Start time of a packet, for `rust_opcode_in` / `rust_opcode_out`.
+ */
+uint64_t rust_opcode_clock(void);
+
+/**
+ * Record an inbound client packet of `len` bytes, handled since `start`.
+ */
+void rust_opcode_in(int op, int len, uint64_t start);
+
+/**
+ * Record an outbound client packet of `len` bytes, encrypted since `start`.
+ */
+void rust_opcode_out(int op, int len, uint64_t start);
+
 /**
  * Get current tick count in milliseconds (monotonic clock)
  */
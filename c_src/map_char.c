@@ -57,6 +57,7 @@ int intif_mmo_tosd(int fd, struct mmo_charstatus* p) {
   rust_session_set_data(fd, sd);
 
   populate_table(sd->status.name, sd->EncHash, sizeof(sd->EncHash));
+  rust_crypt_key_cache_reset(&sd->EncKeys);
   sd->bl.id = sd->status.id;
   sd->bl.prev = sd->bl.next = NULL;
 
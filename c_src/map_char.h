@@ -15,6 +15,7 @@ void rust_intif_load(int fd, uint32_t char_id, const char* name);
 void rust_intif_quit(uint32_t char_id);
 void rust_intif_save(const uint8_t* data, uint32_t len);
 void rust_intif_savequit(const uint8_t* data, uint32_t len);
+void rust_intif_save_status(const uint8_t* status, uint32_t len, int logout);
 
 // ---------------------------------------------------------------------------
 // auth_db helpers — still backed by SQL (Authorize table) in map_char.c
@@ -46,7 +47,8 @@ static inline int intif_load(int fd, int id, char* name) {
   return 0;
 }
 
-// intif_save: compress mmo_charstatus and send 0x3004 to char_server.
+// intif_save: hand mmo_charstatus to Rust, which compresses and sends it to
+// char_server off the game thread (0x3004, or batched 0x3012).
 static inline int intif_save(USER* sd) {
   if (!sd) return -1;
   sd->status.last_pos.m = sd->bl.m;
@@ -55,24 +57,11 @@ static inline int intif_save(USER* sd) {
   sd->status.disguise       = sd->disguise;
   sd->status.disguisecolor  = sd->disguise_color;
 
-  size_t ulen = sizeof(struct mmo_charstatus);
-  uLongf clen = compressBound(ulen);
-  uint8_t* buf = (uint8_t*)malloc(clen + 6);
-  if (!buf) return -1;
-
-  if (compress2(buf + 6, &clen, (const uint8_t*)&sd->status, ulen, 1) != Z_OK) {
-    free(buf);
-    return -1;
-  }
-  buf[0] = 0x04; buf[1] = 0x30; // 0x3004 LE
-  uint32_t total = (uint32_t)(clen + 6);
-  memcpy(buf + 2, &total, 4);
-  rust_intif_save(buf, total);
-  free(buf);
+  rust_intif_save_status((const uint8_t*)&sd->status, sizeof(struct mmo_charstatus), 0);
   return 0;
 }
 
-// intif_savequit: same as intif_save but uses 0x3007 cmd and updates dest_pos.
+// intif_savequit: same as intif_save but logs out (0x3007) and updates dest_pos.
 static inline int intif_savequit(USER* sd) {
   if (!sd) return -1;
   if (!map_isloaded(sd->status.dest_pos.m)) {
@@ -92,19 +81,6 @@ static inline int intif_savequit(USER* sd) {
   sd->status.disguise      = sd->disguise;
   sd->status.disguisecolor = sd->disguise_color;
 
-  size_t ulen = sizeof(struct mmo_charstatus);
-  uLongf clen = compressBound(ulen);
-  uint8_t* buf = (uint8_t*)malloc(clen + 6);
-  if (!buf) return -1;
-
-  if (compress2(buf + 6, &clen, (const uint8_t*)&sd->status, ulen, 1) != Z_OK) {
-    free(buf);
-    return -1;
-  }
-  buf[0] = 0x07; buf[1] = 0x30; // 0x3007 LE
-  uint32_t total = (uint32_t)(clen + 6);
-  memcpy(buf + 2, &total, 4);
-  rust_intif_savequit(buf, total);
-  free(buf);
+  rust_intif_save_status((const uint8_t*)&sd->status, sizeof(struct mmo_charstatus), 1);
   return 0;
 }
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <zlib.h>
 
@@ -17,6 +18,7 @@
 #include "core.h"
 #include "creation_db.h"
 #include "db_mysql.h"
+#include "ers.h"
 #include "gm_command.h"
 #include "item_db.h"
 #include "magic_db.h"
@@ -25,6 +27,7 @@
 #include "mmo.h"
 #include "mob.h"
 #include "net_crypt.h"
+#include "packet.h"
 #include "pc.h"
 #include "rndm.h"
 #include "scripting.h"
@@ -119,15 +122,13 @@ char *clif_getName(unsigned int id) {
 
   SqlStmt *stmt;
 
-  stmt = SqlStmt_Malloc(sql_handle);
+  stmt = SqlStmt_Cached(sql_handle,
+                        "SELECT `ChaName` FROM `Character` WHERE `ChaId` = ?");
   if (stmt == NULL) {
     SqlStmt_ShowDebug(stmt);
   }
 
-  if (SQL_ERROR == SqlStmt_Prepare(
-                       stmt,
-                       "SELECT `ChaName` FROM `Character` WHERE `ChaId` = '%u'",
-                       id) ||
+  if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_UINT, &id, 0) ||
       SQL_ERROR == SqlStmt_Execute(stmt) ||
       SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_STRING, &name,
                                       sizeof(name), NULL, NULL)) {
@@ -275,16 +276,15 @@ int clif_accept2(int fd, char *name, int name_len) {
   int id = 0;
 
   SqlStmt *stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
+  stmt = SqlStmt_Cached(sql_handle,
+                        "SELECT `ChaId` FROM `Character` WHERE `ChaName` = ?");
   if (stmt == NULL) {
     SqlStmt_ShowDebug(stmt);
     return -1;
   }
 
-  if (SQL_ERROR == SqlStmt_Prepare(
-                       stmt,
-                       "SELECT `ChaId` FROM `Character` WHERE `ChaName` = '%s'",
-                       n) ||
+  if (SQL_ERROR ==
+          SqlStmt_BindParam(stmt, 0, SQLDT_STRING, n, name_len) ||
       SQL_ERROR == SqlStmt_Execute(stmt) ||
       SQL_ERROR ==
           SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &id, 0, NULL, NULL)) {
@@ -293,9 +293,8 @@ int clif_accept2(int fd, char *name, int name_len) {
     return -1;
   }
 
-  if (SQL_SUCCESS == SqlStmt_NextRow(stmt)) {
-    SqlStmt_Free(stmt);
-  }
+  SqlStmt_NextRow(stmt);
+  SqlStmt_Free(stmt);
 
   // session[fd]->name removed — name field is write-only (all reads are commented out)
   intif_load(fd, id, n);
@@ -1106,11 +1105,30 @@ void clif_delay(int milliseconds) {
     ;
 }
 
+// Health bar packet (0x13) body
+static inline void clif_health_fields(struct pkt_writer *w, USER *sd,
+                                      int critical, int percentage,
+                                      int damage) {
+  pkt_u32(w, sd->bl.id);
+  pkt_u8(w, critical);
+  pkt_u8(w, percentage);
+  pkt_u32(w, (unsigned int)damage);
+}
+
+// Script handle of the global onKill, run for every kill
+static int onkill_handle(void) {
+  static int h;
+  if (!h) h = sl_handle("onKill", NULL);
+  return h;
+}
+
 int clif_send_pc_healthscript(USER *sd, int damage, int critical) {
   unsigned int maxvita;
   unsigned int currentvita;
   float percentage;
   unsigned char buf[32];
+  struct pkt_writer w;
+  int len;
   int x;
   USER *tsd = NULL;
   MOB *tmob = NULL;
@@ -1168,20 +1186,18 @@ int clif_send_pc_healthscript(USER *sd, int damage, int critical) {
 
   if (((int)percentage) == 0 && currentvita != 0) percentage = (float)1;
   // 8 hit types * 32 colors
-  WBUFB(buf, 0) = 0xAA;
-  WBUFW(buf, 1) = SWAP16(12);
-  WBUFB(buf, 3) = 0x13;
-  // WBUFB(buf,4)=0x03;
-  WBUFL(buf, 5) = SWAP32(sd->bl.id);
-  WBUFB(buf, 9) = critical;
-  WBUFB(buf, 10) = (int)percentage;
-  WBUFL(buf, 11) = SWAP32((unsigned int)damage);
-
-  // clif_send(buf,32,&sd->bl,AREA);
-  if (sd->status.state == 2)
-    clif_send(buf, 32, &sd->bl, SELF);
-  else
-    clif_send(buf, 32, &sd->bl, AREA);
+  // Ghosts only see their own bar, so build it straight into the WFIFO;
+  // everyone else's goes through clif_send for the area fan-out.
+  if (sd->status.state == 2) {
+    if (pkt_begin(&w, sd->fd, 0x13, 10) == 0) {
+      clif_health_fields(&w, sd, critical, (int)percentage, damage);
+      pkt_send(&w);
+    }
+  } else {
+    pkt_begin_buf(&w, buf, sizeof(buf), 0x13);
+    clif_health_fields(&w, sd, critical, (int)percentage, damage);
+    if ((len = pkt_end(&w)) > 0) clif_send(buf, len, &sd->bl, AREA);
+  }
 
   if (sd->status.hp && damage > 0) {
     for (x = 0; x < MAX_SPELLS; x++) {
@@ -1225,7 +1241,7 @@ int clif_send_pc_healthscript(USER *sd, int damage, int critical) {
   if (!sd->status.hp) {
     sl_doscript_blargs("onDeathPlayer", NULL, 1, &sd->bl);
 
-    if (tsd != NULL) sl_doscript_blargs("onKill", NULL, 2, &sd->bl, &tsd->bl);
+    if (tsd != NULL) sl_doscript_handle(onkill_handle(), 2, &sd->bl, &tsd->bl);
 
     /*for(x=0;x<14;x++) {
             if(sd->status.equip[x].id > 0) {
@@ -1937,8 +1953,9 @@ int clif_send_aether(USER *sd, int id, int time) {
   return 0;
 }
 
+// Each call queues the move for one observer; the old code re-broadcast to
+// the whole area once per observer.
 int clif_npc_move(struct block_list *bl, va_list ap) {
-  unsigned char *buf;
   USER *sd = NULL;
   NPC *nd = NULL;
 
@@ -1946,29 +1963,8 @@ int clif_npc_move(struct block_list *bl, va_list ap) {
   nullpo_ret(0, sd = (USER *)bl);
   nullpo_ret(0, nd = va_arg(ap, NPC *));
 
-  CALLOC(buf, unsigned char, 32);
-  WBUFB(buf, 0) = 0xAA;
-  WBUFB(buf, 1) = 0x00;
-  WBUFB(buf, 2) = 0x0C;
-  WBUFB(buf, 3) = 0x0C;
-  // WBUFB(buf, 4) = 0x03;
-  WBUFL(buf, 5) = SWAP32(nd->bl.id);
-  WBUFW(buf, 9) = SWAP16(nd->bl.bx);
-  WBUFW(buf, 11) = SWAP16(nd->bl.by);
-  WBUFB(buf, 13) = nd->side;
-  WBUFB(buf, 14) = 0x00;
-
-  clif_send(buf, 32, &nd->bl, AREA_WOS);  // come back
-  FREE(buf);
-
-  /*WFIFOHEAD(sd->fd,14);
-  WFIFOHEADER(sd->fd, 0x0C, 11);
-  WFIFOL(sd->fd,5) = SWAP32(cnd->bl.id);
-  WFIFOW(sd->fd,9) = SWAP16(cnd->bl.bx);
-  WFIFOW(sd->fd,11) = SWAP16(cnd->bl.by);
-  WFIFOB(sd->fd,13) = cnd->side;
-  encrypt(sd->fd);
-  WFIFOSET(sd->fd,14);*/
+  rust_move_queue(sd->fd, sd->bl.id, nd->bl.id, nd->bl.bx, nd->bl.by,
+                  nd->side);
   return 0;
 }
 
@@ -1988,21 +1984,59 @@ int clif_mob_move(struct block_list *bl, va_list ap) {
     if (mob->state == MOB_DEAD) return 0;
   }
 
-  if (!rust_session_exists(sd->fd)) {
-    rust_session_set_eof(sd->fd, 8);
-    return 0;
+  rust_move_queue(sd->fd, sd->bl.id, mob->bl.id, mob->bx, mob->by, mob->side);
+  return 0;
+}
+
+// Writes `n` taken moves to fd as 0x0C packets. A client whose fd now
+// belongs to another player is skipped.
+static void clif_write_moves(int fd, unsigned int owner,
+                             const struct pending_move *mv, int n) {
+  struct pkt_writer w;
+  USER *sd = map_id2sd(owner);
+  int i;
+
+  if (!sd || sd->fd != fd) return;
+
+  if (!rust_session_exists(fd)) {
+    rust_session_set_eof(fd, 8);
+    return;
   }
 
-  WFIFOHEAD(sd->fd, 14);
-  WFIFOHEADER(sd->fd, 0x0C, 11);
-  WFIFOL(sd->fd, 5) = SWAP32(mob->bl.id);
-  WFIFOW(sd->fd, 9) = SWAP16(mob->bx);
-  WFIFOW(sd->fd, 11) = SWAP16(mob->by);
-  WFIFOB(sd->fd, 13) = mob->side;
-  WFIFOSET(sd->fd, encrypt(sd->fd));
-  // printf("Moved\n");
-  return 0;
+  for (i = 0; i < n; i++) {
+    if (pkt_begin(&w, fd, 0x0C, 9) != 0) break;
+    pkt_u32(&w, mv[i].id);
+    pkt_u16(&w, mv[i].x);
+    pkt_u16(&w, mv[i].y);
+    pkt_u8(&w, mv[i].side);
+    pkt_send(&w);
+  }
 }
+
+// Writes out the 0x0C packets queued by clif_mob_move/clif_npc_move, grouped
+// by client.
+void clif_flush_moves(void) {
+  struct pending_move mv[256];
+  unsigned int owner;
+  int fd, n;
+
+  while ((n = rust_move_take(&fd, &owner, mv, 256)) > 0) {
+    clif_write_moves(fd, owner, mv, n);
+  }
+}
+
+// Writes out the moves queued for one client; runs before any other packet
+// is written to it, so the 0x0C packets keep their place in its stream.
+void clif_flush_moves_fd(int fd) {
+  struct pending_move mv[256];
+  unsigned int owner;
+  int n;
+
+  while ((n = rust_move_take_fd(fd, &owner, mv, 256)) > 0) {
+    clif_write_moves(fd, owner, mv, n);
+  }
+}
+
 int clif_mob_damage(USER *sd, MOB *mob) {
   int damage;
   int x;
@@ -2390,7 +2424,7 @@ int clif_send_mob_healthscript(MOB *mob, int damage, int critical) {
 
       SqlStmt_Free(stmt);*/
 
-      sl_doscript_blargs("onKill", NULL, 2, &mob->bl, &sd->bl);
+      sl_doscript_handle(onkill_handle(), 2, &mob->bl, &sd->bl);
     }
 
     for (x = 0; x < MAX_MAGIC_TIMERS; x++) {
@@ -2515,21 +2549,70 @@ int clif_parsenpcdialog(USER *sd) {
 
   return 0;
 }
-int clif_send_sub(struct block_list *bl, va_list ap) {
-  unsigned char *buf = NULL;
+// Broadcasts hand every recipient the same packet bytes. Opcodes that use
+// the static xor_key therefore encrypt to identical ciphertext for everyone
+// (the sequence byte at [4] is part of buf, not per-session), so encrypt
+// once into this scratch buffer and copy the finished bytes to each
+// recipient instead of re-running encrypt() per fd.
+static unsigned char clif_shared_enc[WFIFO_SIZE];
+
+// Returns the encrypted length in clif_shared_enc, or 0 when the packet must
+// be encrypted per recipient (dynamic-key opcode or oversized packet).
+static int clif_encrypt_shared(const unsigned char *buf, int len) {
+  int psize;
+
+  if (len < 5 || is_key_server(buf[3])) return 0;
+
+  psize = (buf[1] << 8) | buf[2];
+  if (len + 3 > (int)sizeof(clif_shared_enc) ||
+      psize + 6 > (int)sizeof(clif_shared_enc))
+    return 0;
+
+  memcpy(clif_shared_enc, buf, len);
+  if (!set_packet_indexes(clif_shared_enc)) return 0;
+  tk_crypt_static(clif_shared_enc);
+
+  return (int)SWAP16(*(unsigned short *)(clif_shared_enc + 1)) + 3;
+}
+
+// Queue one recipient's copy of a packet: the pre-encrypted shared bytes when
+// available, otherwise copy buf into the WFIFO and encrypt for this session.
+static inline void clif_send_to_fd(int fd, const unsigned char *buf, int len,
+                                   const unsigned char *enc, int enc_len) {
+  if (enc_len > 0) {
+    // Encrypted once for every recipient; only the copy is this one's cost
+    uint64_t started = rust_opcode_clock();
+    rust_session_send_bytes(fd, enc, enc_len);
+    rust_opcode_out(enc[3], enc_len, started);
+    return;
+  }
+
+  if (WFIFOHEAD(fd, len + 3) != 0) return;  // session already gone
+  memcpy(WFIFOP(fd, 0), buf, len);
+  WFIFOSET(fd, encrypt(fd));
+}
+
+// One area broadcast: what clif_send_sub used to unpack from its va_list
+// for every recipient.
+struct clif_send_ctx {
+  unsigned char *buf;
   int len;
-  struct block_list *src_bl = NULL;
+  struct block_list *src_bl;
   int type;
+  const unsigned char *enc;  // shared ciphertext, used when enc_len > 0
+  int enc_len;
+};
+
+static int clif_send_visit(struct block_list *bl, void *ctx) {
+  const struct clif_send_ctx *c = ctx;
+  unsigned char *buf = c->buf;
+  int len = c->len;
+  struct block_list *src_bl = c->src_bl;
   USER *sd = NULL;
   USER *tsd = NULL;
 
-  // nullpo_ret(0, bl);
-  nullpo_ret(0, ap);
   nullpo_ret(0, sd = (USER *)bl);
-
-  buf = va_arg(ap, unsigned char *);
-  len = va_arg(ap, int);
-  nullpo_ret(0, src_bl = va_arg(ap, struct block_list *));
+  nullpo_ret(0, src_bl);
   if (src_bl->type == BL_PC) tsd = (USER *)src_bl;
 
   if (tsd) {
@@ -2549,9 +2632,7 @@ int clif_send_sub(struct block_list *bl, va_list ap) {
     if (RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) return 0;
   }
 
-  type = va_arg(ap, int);
-
-  switch (type) {
+  switch (c->type) {
     case AREA_WOS:
     case SAMEAREA_WOS:
       if (bl == src_bl) return 0;
@@ -2564,49 +2645,27 @@ int clif_send_sub(struct block_list *bl, va_list ap) {
   }
 
   if (RBUFB(buf, 3) == 0x0D && RBUFB(buf, 5) >= 10) {
-    if (pc_readglobalreg(sd, "chann_en") >= 1 && RBUFB(buf, 5) == 10) {
-      WBUFB(buf, 5) = 0;
-      WFIFOHEAD(sd->fd, len + 3);
-      if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
-        memcpy(WFIFOP(sd->fd, 0), buf, len);
-      if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
-      WBUFB(buf, 5) = 10;
-    } else if (pc_readglobalreg(sd, "chann_es") >= 1 && RBUFB(buf, 5) == 11) {
-      WBUFB(buf, 5) = 0;
-      WFIFOHEAD(sd->fd, len + 3);
-      if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
-        memcpy(WFIFOP(sd->fd, 0), buf, len);
-      if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
-      WBUFB(buf, 5) = 11;
-    } else if (pc_readglobalreg(sd, "chann_fr") >= 1 && RBUFB(buf, 5) == 12) {
-      WBUFB(buf, 5) = 0;
-      WFIFOHEAD(sd->fd, len + 3);
-      if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
-        memcpy(WFIFOP(sd->fd, 0), buf, len);
-      if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
-      WBUFB(buf, 5) = 12;
-    } else if (pc_readglobalreg(sd, "chann_cn") >= 1 && RBUFB(buf, 5) == 13) {
-      WBUFB(buf, 5) = 0;
-      WFIFOHEAD(sd->fd, len + 3);
-      if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
-        memcpy(WFIFOP(sd->fd, 0), buf, len);
-      if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
-      WBUFB(buf, 5) = 13;
-    } else if (pc_readglobalreg(sd, "chann_pt") >= 1 && RBUFB(buf, 5) == 14) {
-      WBUFB(buf, 5) = 0;
-      WFIFOHEAD(sd->fd, len + 3);
-      if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
-        memcpy(WFIFOP(sd->fd, 0), buf, len);
-      if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
-      WBUFB(buf, 5) = 14;
-    } else if (pc_readglobalreg(sd, "chann_id") >= 1 && RBUFB(buf, 5) == 15) {
-      WBUFB(buf, 5) = 0;
-      WFIFOHEAD(sd->fd, len + 3);
-      if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
-        memcpy(WFIFOP(sd->fd, 0), buf, len);
-      if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
-      WBUFB(buf, 5) = 15;
+    // Channels 10..15; registry ids interned once, read per recipient
+    static const char *chann_regs[] = {"chann_en", "chann_es", "chann_fr",
+                                       "chann_cn", "chann_pt", "chann_id"};
+    static int chann_ids[6];
+    int ch = RBUFB(buf, 5) - 10;
+
+    if (ch < 6) {
+      if (!chann_ids[ch]) chann_ids[ch] = rust_reg_intern(chann_regs[ch]);
+      if (pc_readglobalreg_id(sd, chann_ids[ch]) >= 1) {
+        WBUFB(buf, 5) = 0;
+        WFIFOHEAD(sd->fd, len + 3);
+        if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
+          memcpy(WFIFOP(sd->fd, 0), buf, len);
+        if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
+        WBUFB(buf, 5) = ch + 10;
+        return 1;
+      }
     }
+    return 0;
+  } else if (c->enc_len > 0) {
+    if (isActive(sd)) clif_send_to_fd(sd->fd, buf, len, c->enc, c->enc_len);
   } else {
     WFIFOHEAD(sd->fd, len + 3);
     if (isActive(sd) && WFIFOP(sd->fd, 0) != (char *)buf)
@@ -2614,70 +2673,96 @@ int clif_send_sub(struct block_list *bl, va_list ap) {
     if (sd) WFIFOSET(sd->fd, encrypt(sd->fd));
   }
 
-  return 0;
+  // counted as one packet queued, for the per-map cost of the broadcast
+  return 1;
+}
+
+int clif_send_sub(struct block_list *bl, va_list ap) {
+  struct clif_send_ctx c;
+
+  nullpo_ret(0, ap);
+  c.buf = va_arg(ap, unsigned char *);
+  c.len = va_arg(ap, int);
+  c.src_bl = va_arg(ap, struct block_list *);
+  c.type = va_arg(ap, int);
+  c.enc = va_arg(ap, const unsigned char *);
+  c.enc_len = va_arg(ap, int);
+  return clif_send_visit(bl, &c);
+}
+
+// Send to every player in `area` around bl through the typed block query.
+// The fan-out is charged to bl's map (game::map_cost).
+static void clif_send_area(const unsigned char *buf, int len,
+                           struct block_list *bl, int type, int area,
+                           int enc_len) {
+  struct clif_send_ctx c = {(unsigned char *)buf, len, bl, type,
+                            clif_shared_enc, enc_len};
+  int sent;
+
+  rust_map_cost_enter(bl->m, MAP_COST_SEND);
+  sent = map_query_area(bl->m, bl->x, bl->y, area, BL_PC, clif_send_visit, &c);
+  rust_map_cost_leave(sent);
 }
 
 int clif_send(const unsigned char *buf, int len, struct block_list *bl,
               int type) {
   USER *sd = NULL;
   USER *tsd = NULL;
-  int i;
+  USER *users[MAX_SESSIONS];
+  int i, n;
+  int enc_len = 0;
+
+  // Chat channel packets (0x0D with [5] >= 10) are rewritten per recipient
+  // in clif_send_sub, so they can't share one ciphertext.
+  if (type != SELF && !(RBUFB(buf, 3) == 0x0D && RBUFB(buf, 5) >= 10))
+    enc_len = clif_encrypt_shared(buf, len);
 
   switch (type) {
     case ALL_CLIENT:
     case SAMESRV:
-      for (i = 0; i < fd_max; i++) {
-        if (rust_session_exists(i) && (sd = rust_session_get_data(i))) {
-          if (bl->type == BL_PC) tsd = (USER *)bl;
+      n = map_online_users(-1, (struct block_list **)users, MAX_SESSIONS);
+      for (i = 0; i < n; i++) {
+        sd = users[i];
+        if (bl->type == BL_PC) tsd = (USER *)bl;
 
-          if (tsd && RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) continue;
+        if (tsd && RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) continue;
 
-          WFIFOHEAD(i, len + 3);
-          memcpy(WFIFOP(i, 0), buf, len);
-          WFIFOSET(i, encrypt(i));
-        }
+        clif_send_to_fd(sd->fd, buf, len, clif_shared_enc, enc_len);
       }
       break;
     case SAMEMAP:
-      for (i = 0; i < fd_max; i++) {
-        if (rust_session_exists(i) && (sd = rust_session_get_data(i)) && sd->bl.m == bl->m) {
-          if (bl->type == BL_PC) tsd = (USER *)bl;
+      n = map_online_users(bl->m, (struct block_list **)users, MAX_SESSIONS);
+      for (i = 0; i < n; i++) {
+        sd = users[i];
+        if (bl->type == BL_PC) tsd = (USER *)bl;
 
-          if (tsd && RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) continue;
+        if (tsd && RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) continue;
 
-          WFIFOHEAD(i, len + 3);
-          memcpy(WFIFOP(i, 0), buf, len);
-          WFIFOSET(i, encrypt(i));
-        }
+        clif_send_to_fd(sd->fd, buf, len, clif_shared_enc, enc_len);
       }
       break;
     case SAMEMAP_WOS:
-      for (i = 0; i < fd_max; i++) {
-        if (rust_session_exists(i) && (sd = rust_session_get_data(i)) && sd->bl.m == bl->m &&
-            sd != (USER *)bl) {
-          if (bl->type == BL_PC) tsd = (USER *)bl;
+      n = map_online_users(bl->m, (struct block_list **)users, MAX_SESSIONS);
+      for (i = 0; i < n; i++) {
+        sd = users[i];
+        if (sd == (USER *)bl) continue;
+        if (bl->type == BL_PC) tsd = (USER *)bl;
 
-          if (tsd && RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) continue;
+        if (tsd && RBUFB(buf, 3) == 0x0D && !clif_isignore(tsd, sd)) continue;
 
-          WFIFOHEAD(i, len + 3);
-          memcpy(WFIFOP(i, 0), buf, len);
-          WFIFOSET(i, encrypt(i));
-        }
+        clif_send_to_fd(sd->fd, buf, len, clif_shared_enc, enc_len);
       }
       break;
     case AREA:
     case AREA_WOS:
-      map_foreachinarea(clif_send_sub, bl->m, bl->x, bl->y, AREA, BL_PC, buf,
-                        len, bl, type);
+      clif_send_area(buf, len, bl, type, AREA, enc_len);
       break;
     case SAMEAREA:
     case SAMEAREA_WOS:
-      map_foreachinarea(clif_send_sub, bl->m, bl->x, bl->y, SAMEAREA, BL_PC,
-                        buf, len, bl, type);
+      clif_send_area(buf, len, bl, type, SAMEAREA, enc_len);
       break;
     case CORNER:
-      map_foreachinarea(clif_send_sub, bl->m, bl->x, bl->y, CORNER, BL_PC, buf,
-                        len, bl, type);
+      clif_send_area(buf, len, bl, type, CORNER, enc_len);
       break;
     case SELF:
       sd = (USER *)bl;
@@ -2693,51 +2778,44 @@ int clif_send(const unsigned char *buf, int len, struct block_list *bl,
 int clif_sendtogm(unsigned char *buf, int len, struct block_list *bl,
                   int type) {
   USER *sd = NULL;
-  int i;
+  USER *users[MAX_SESSIONS];
+  int i, n;
+  int enc_len = 0;
+
+  if (type != SELF && !(RBUFB(buf, 3) == 0x0D && RBUFB(buf, 5) >= 10))
+    enc_len = clif_encrypt_shared(buf, len);
 
   switch (type) {
     case ALL_CLIENT:
     case SAMESRV:
-      for (i = 0; i < fd_max; i++) {
-        if (rust_session_exists(i) && (sd = rust_session_get_data(i))) {
-          WFIFOHEAD(i, len + 3);
-          memcpy(WFIFOP(i, 0), buf, len);
-          WFIFOSET(i, encrypt(i));
-        }
+      n = map_online_users(-1, (struct block_list **)users, MAX_SESSIONS);
+      for (i = 0; i < n; i++) {
+        clif_send_to_fd(users[i]->fd, buf, len, clif_shared_enc, enc_len);
       }
       break;
     case SAMEMAP:
-      for (i = 0; i < fd_max; i++) {
-        if (rust_session_exists(i) && (sd = rust_session_get_data(i)) && sd->bl.m == bl->m) {
-          WFIFOHEAD(i, len + 3);
-          memcpy(WFIFOP(i, 0), buf, len);
-          WFIFOSET(i, encrypt(i));
-        }
+      n = map_online_users(bl->m, (struct block_list **)users, MAX_SESSIONS);
+      for (i = 0; i < n; i++) {
+        clif_send_to_fd(users[i]->fd, buf, len, clif_shared_enc, enc_len);
       }
       break;
     case SAMEMAP_WOS:
-      for (i = 0; i < fd_max; i++) {
-        if (rust_session_exists(i) && (sd = rust_session_get_data(i)) && sd->bl.m == bl->m &&
-            sd != (USER *)bl) {
-          WFIFOHEAD(i, len + 3);
-          memcpy(WFIFOP(i, 0), buf, len);
-          WFIFOSET(i, encrypt(i));
-        }
+      n = map_online_users(bl->m, (struct block_list **)users, MAX_SESSIONS);
+      for (i = 0; i < n; i++) {
+        if (users[i] == (USER *)bl) continue;
+        clif_send_to_fd(users[i]->fd, buf, len, clif_shared_enc, enc_len);
       }
       break;
     case AREA:
     case AREA_WOS:
-      map_foreachinarea(clif_send_sub, bl->m, bl->x, bl->y, AREA, BL_PC, buf,
-                        len, bl, type);
+      clif_send_area(buf, len, bl, type, AREA, enc_len);
       break;
     case SAMEAREA:
     case SAMEAREA_WOS:
-      map_foreachinarea(clif_send_sub, bl->m, bl->x, bl->y, SAMEAREA, BL_PC,
-                        buf, len, bl, type);
+      clif_send_area(buf, len, bl, type, SAMEAREA, enc_len);
       break;
     case CORNER:
-      map_foreachinarea(clif_send_sub, bl->m, bl->x, bl->y, CORNER, BL_PC, buf,
-                        len, bl, type);
+      clif_send_area(buf, len, bl, type, CORNER, enc_len);
       break;
     case SELF:
       sd = (USER *)bl;
@@ -4403,6 +4481,8 @@ int clif_sendmapinfo(USER *sd) {
   char len;
 
   if (!sd) return 0;
+  // The client redraws from scratch; nothing it was shown still counts.
+  rust_aoi_reset(&sd->bl);
   // Map Title and Map X-Y
   if (!rust_session_exists(sd->fd)) {
     rust_session_set_eof(sd->fd, 8);
@@ -4488,46 +4568,51 @@ int clif_sendmapinfo(USER *sd) {
   return 0;
 }
 
-int clif_sendxy(USER *sd) {
-  if (!rust_session_exists(sd->fd)) {
-    rust_session_set_eof(sd->fd, 8);
-    return 0;
-  }
-
-  WFIFOHEAD(sd->fd, 14);
-  WFIFOB(sd->fd, 0) = 0xAA;
-  WFIFOW(sd->fd, 1) = SWAP16(0x0D);
-  WFIFOB(sd->fd, 3) = 0x04;
-
-  WFIFOW(sd->fd, 5) = SWAP16(sd->bl.x);
-  WFIFOW(sd->fd, 7) = SWAP16(sd->bl.y);
-
-  // WFIFOW(sd->fd,9) = SWAP16(  (int)((16-map[sd->bl.m].xs)/2) + sd->bl.x );
-  // WFIFOW(sd->fd,11) = SWAP16(  (int)((14-map[sd->bl.m].ys)/2) + sd->bl.y );
+// Position + viewport packet (0x04) shared by clif_sendxy and
+// clif_sendxynoclick. The declared length runs two bytes past the last
+// field; the old writer left them stale, they are now sent as zero. Like
+// before, the packet does not consume a sequence number.
+static void clif_sendxy_packet(USER *sd) {
+  struct pkt_writer w;
+  int vx, vy;
 
   if (map[sd->bl.m].xs >= 16) {
     if (sd->bl.x < 8)
-      WFIFOW(sd->fd, 9) = SWAP16(sd->bl.x);
+      vx = sd->bl.x;
     else if (sd->bl.x >= map[sd->bl.m].xs - 8)
-      WFIFOW(sd->fd, 9) = SWAP16(sd->bl.x - map[sd->bl.m].xs + 17);
+      vx = sd->bl.x - map[sd->bl.m].xs + 17;
     else
-      WFIFOW(sd->fd, 9) = SWAP16(8);
+      vx = 8;
   } else
-    WFIFOW(sd->fd, 9) = SWAP16((int)((16 - map[sd->bl.m].xs) / 2) + sd->bl.x);
+    vx = (int)((16 - map[sd->bl.m].xs) / 2) + sd->bl.x;
 
   if (map[sd->bl.m].ys >= 14) {
     if (sd->bl.y < 7)
-      WFIFOW(sd->fd, 11) = SWAP16(sd->bl.y);
+      vy = sd->bl.y;
     else if (sd->bl.y >= map[sd->bl.m].ys - 7)
-      WFIFOW(sd->fd, 11) = SWAP16(sd->bl.y - map[sd->bl.m].ys + 15);
+      vy = sd->bl.y - map[sd->bl.m].ys + 15;
     else
-      WFIFOW(sd->fd, 11) = SWAP16(7);
+      vy = 7;
   } else
-    WFIFOW(sd->fd, 11) = SWAP16((int)((14 - map[sd->bl.m].ys) / 2) + sd->bl.y);
+    vy = (int)((14 - map[sd->bl.m].ys) / 2) + sd->bl.y;
 
-  WFIFOB(sd->fd, 13) = 0x00;
-  WFIFOSET(sd->fd, encrypt(sd->fd));
+  if (pkt_begin_noseq(&w, sd->fd, 0x04, 11) != 0) return;
+  pkt_u16(&w, sd->bl.x);
+  pkt_u16(&w, sd->bl.y);
+  pkt_u16(&w, vx);
+  pkt_u16(&w, vy);
+  pkt_u8(&w, 0x00);
+  pkt_zero(&w, 2);
+  pkt_send(&w);
+}
+
+int clif_sendxy(USER *sd) {
+  if (!rust_session_exists(sd->fd)) {
+    rust_session_set_eof(sd->fd, 8);
+    return 0;
+  }
 
+  clif_sendxy_packet(sd);
   pc_runfloor_sub(sd);
 
   return 0;
@@ -4539,43 +4624,15 @@ int clif_sendxynoclick(USER *sd) {
     return 0;
   }
 
-  WFIFOHEAD(sd->fd, 14);
-  WFIFOB(sd->fd, 0) = 0xAA;
-  WFIFOW(sd->fd, 1) = SWAP16(0x0D);
-  WFIFOB(sd->fd, 3) = 0x04;
-  // WFIFOB(sd->fd, 4) = 0x03;
-  WFIFOW(sd->fd, 5) = SWAP16(sd->bl.x);
-  WFIFOW(sd->fd, 7) = SWAP16(sd->bl.y);
-
-  if (map[sd->bl.m].xs >= 16) {
-    if (sd->bl.x < 8)
-      WFIFOW(sd->fd, 9) = SWAP16(sd->bl.x);
-    else if (sd->bl.x >= map[sd->bl.m].xs - 8)
-      WFIFOW(sd->fd, 9) = SWAP16(sd->bl.x - map[sd->bl.m].xs + 17);
-    else
-      WFIFOW(sd->fd, 9) = SWAP16(8);
-  } else
-    WFIFOW(sd->fd, 9) = SWAP16((int)((16 - map[sd->bl.m].xs) / 2) + sd->bl.x);
-
-  if (map[sd->bl.m].ys >= 14) {
-    if (sd->bl.y < 7)
-      WFIFOW(sd->fd, 11) = SWAP16(sd->bl.y);
-    else if (sd->bl.y >= map[sd->bl.m].ys - 7)
-      WFIFOW(sd->fd, 11) = SWAP16(sd->bl.y - map[sd->bl.m].ys + 15);
-    else
-      WFIFOW(sd->fd, 11) = SWAP16(7);
-  } else
-    WFIFOW(sd->fd, 11) = SWAP16((int)((14 - map[sd->bl.m].ys) / 2) + sd->bl.y);
-
-  WFIFOB(sd->fd, 13) = 0x00;
-  WFIFOSET(sd->fd, encrypt(sd->fd));
-
+  clif_sendxy_packet(sd);
   pc_runfloor_sub(sd);
 
   return 0;
 }
 
 int clif_sendxychange(USER *sd, int dx, int dy) {
+  struct pkt_writer w;
+
   nullpo_ret(0, sd);
 
   if (!rust_session_exists(sd->fd)) {
@@ -4583,31 +4640,24 @@ int clif_sendxychange(USER *sd, int dx, int dy) {
     return 0;
   }
 
-  WFIFOHEAD(sd->fd, 14);
-  WFIFOB(sd->fd, 0) = 0xAA;
-  WFIFOB(sd->fd, 1) = 0x00;
-  WFIFOB(sd->fd, 2) = 0x0A;
-  WFIFOB(sd->fd, 3) = 0x04;
-  WFIFOW(sd->fd, 5) = SWAP16(sd->bl.x);
-  WFIFOW(sd->fd, 7) = SWAP16(sd->bl.y);
-
   if (sd->bl.x - dx < 0)
     dx--;
   else if (sd->bl.x + (16 - dx) >= map[sd->bl.m].xs)
     dx++;
-
-  WFIFOW(sd->fd, 9) = SWAP16(dx);
   sd->viewx = dx;
 
   if (sd->bl.y - dy < 0)
     dy--;
   else if (sd->bl.y + (14 - dy) >= map[sd->bl.m].ys)
     dy++;
-
-  WFIFOW(sd->fd, 11) = SWAP16(dy);
   sd->viewy = dy;
 
-  WFIFOSET(sd->fd, encrypt(sd->fd));
+  if (pkt_begin_noseq(&w, sd->fd, 0x04, 8) != 0) return 0;
+  pkt_u16(&w, sd->bl.x);
+  pkt_u16(&w, sd->bl.y);
+  pkt_u16(&w, dx);
+  pkt_u16(&w, dy);
+  pkt_send(&w);
 
   return 0;
 }
@@ -4732,8 +4782,51 @@ int clif_spawn(USER *sd) {
   return 0;
 }
 
+// Calls a va_list look sub on one block, as map_foreachin* would.
+static int clif_look_apply(int (*func)(struct block_list *, va_list),
+                           struct block_list *bl, ...) {
+  va_list ap;
+  int ret;
+
+  va_start(ap, bl);
+  ret = func(bl, ap);
+  va_end(ap);
+  return ret;
+}
+
+// Sends sd the looks for the strip (x0, y0)-(x1, y1) that scrolled into view,
+// skipping entities its client was already shown (src/game/aoi.rs). (vx, vy)
+// is the top-left tile of the view before the step. Players in the strip
+// still get sd's look.
+static void clif_look_entering(USER *sd, int vx, int vy, int x0, int y0,
+                               int x1, int y1) {
+  struct block_list *fresh[512];
+  int i, n;
+
+  n = rust_aoi_collect_entering(&sd->bl, vx, vy, x0, y0, x1, y1, fresh, 512);
+
+  clif_mob_look_start(sd);
+  for (i = 0; i < n; i++)
+    clif_look_apply(clif_object_look_sub, fresh[i], LOOK_GET, sd);
+  clif_mob_look_close(sd);
+  for (i = 0; i < n; i++) {
+    if (fresh[i]->type == BL_PC)
+      clif_look_apply(clif_charlook_sub, fresh[i], LOOK_GET, sd);
+  }
+  for (i = 0; i < n; i++) {
+    if (fresh[i]->type == BL_NPC)
+      clif_look_apply(clif_cnpclook_sub, fresh[i], LOOK_GET, sd);
+  }
+  for (i = 0; i < n; i++) {
+    if (fresh[i]->type == BL_MOB)
+      clif_look_apply(clif_cmoblook_sub, fresh[i], LOOK_GET, sd);
+  }
+  map_foreachinblock(clif_charlook_sub, sd->bl.m, x0, y0, x1, y1, BL_PC,
+                     LOOK_SEND, sd);
+}
+
 int clif_parsewalk(USER *sd) {
-  int dx, dy, xold, yold, c = 0;
+  int dx, dy, xold, yold, vx, vy, c = 0;
   struct warp_list *x = NULL;
   int x0 = 0, y0 = 0, x1 = 0, y1 = 0, direction = 0;
   unsigned short checksum = 0;
@@ -4835,6 +4928,9 @@ int clif_parsewalk(USER *sd) {
     return 0;
   }
 
+  // View before the step; the look set is pruned against it
+  vx = sd->bl.x - sd->viewx;
+  vy = sd->bl.y - sd->viewy;
   if (direction == 0 &&
       (dy <= sd->viewy || ((map[sd->bl.m].ys - 1 - dy) < 7 && sd->viewy > 7)))
     sd->viewy--;
@@ -4925,23 +5021,7 @@ int clif_parsewalk(USER *sd) {
   if (RFIFOB(sd->fd, 3) == 0x06) {
     clif_sendmapdata(sd, sd->bl.m, x0, y0, x1, y1, checksum);
     // this is where all the "finding" code goes
-
-    clif_mob_look_start(sd);
-
-    map_foreachinblock(clif_object_look_sub, sd->bl.m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_ALL, LOOK_GET, sd);
-    // map_foreachinarea(clif_mob_look_sub,sd->bl.m,x0,y0,x0+(x1-1),y0+(y1-1),SAMEAREA,
-    // BL_MOB,LOOK_GET,sd);
-    // map_foreachinblock(clif_itemlook_sub2,sd->bl.m,x0,y0,x0+(x1-1),y0+(y1-1),BL_ALL,LOOK_GET,def,sd);
-    clif_mob_look_close(sd);
-    map_foreachinblock(clif_charlook_sub, sd->bl.m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_PC, LOOK_GET, sd);
-    map_foreachinblock(clif_cnpclook_sub, sd->bl.m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_NPC, LOOK_GET, sd);
-    map_foreachinblock(clif_cmoblook_sub, sd->bl.m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_MOB, LOOK_GET, sd);
-    map_foreachinblock(clif_charlook_sub, sd->bl.m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_PC, LOOK_SEND, sd);
+    clif_look_entering(sd, vx, vy, x0, y0, x0 + (x1 - 1), y0 + (y1 - 1));
   }
 
 
@@ -5044,7 +5124,7 @@ int clif_parsewalk(USER *sd) {
 
 int clif_noparsewalk(USER *sd, char speed) {
   char flag;
-  int dx, dy, xold, yold, c = 0;
+  int dx, dy, xold, yold, vx, vy, c = 0;
   struct warp_list *x = NULL;
   int x0 = 0, y0 = 0, x1 = 0, y1 = 0, direction = 0;
   unsigned short m = sd->bl.m;
@@ -5130,6 +5210,9 @@ int clif_noparsewalk(USER *sd, char speed) {
 
   if (dx == sd->bl.x && dy == sd->bl.y) return 0;
 
+  // View before the step; the look set is pruned against it
+  vx = sd->bl.x - sd->viewx;
+  vy = sd->bl.y - sd->viewy;
   if (direction == 0 &&
       (dy <= sd->viewy || ((map[m].ys - 1 - dy) < 7 && sd->viewy > 7)))
     sd->viewy--;
@@ -5201,18 +5284,7 @@ int clif_noparsewalk(USER *sd, char speed) {
   if (x0 >= 0 && y0 >= 0 && x0 + (x1 - 1) < map[m].xs &&
       y0 + (y1 - 1) < map[m].ys) {
     clif_sendmapdata(sd, m, x0, y0, x1, y1, 0);
-    clif_mob_look_start(sd);
-    map_foreachinblock(clif_object_look_sub, m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_ALL, LOOK_GET, sd);
-    clif_mob_look_close(sd);
-    map_foreachinblock(clif_charlook_sub, m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_PC, LOOK_GET, sd);
-    map_foreachinblock(clif_cnpclook_sub, m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_NPC, LOOK_GET, sd);
-    map_foreachinblock(clif_cmoblook_sub, m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_MOB, LOOK_GET, sd);
-    map_foreachinblock(clif_charlook_sub, m, x0, y0, x0 + (x1 - 1),
-                       y0 + (y1 - 1), BL_PC, LOOK_SEND, sd);
+    clif_look_entering(sd, vx, vy, x0, y0, x0 + (x1 - 1), y0 + (y1 - 1));
   }
 
 
@@ -5582,25 +5654,8 @@ int clif_getReward(USER *sd, int fd) {
 
   SqlStmt_Free(stmt);
 
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `Rank` FROM `RankingScores` WHERE "
-                                   "`ChaId` = '%i' AND `EventId` = '%i'",
-                                   sd->status.id, eventid) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_INT, &rank, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }  // end if statement
-
-  if (SQL_SUCCESS != SqlStmt_NextRow(stmt)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  SqlStmt_Free(stmt);
+  rank = rust_ranking_rank(eventid, sd->status.id);
+  if (!rank) return 0;
 
   if (cur_season == 1) {
     strcpy(season, "Winter");
@@ -5786,18 +5841,8 @@ int clif_getReward(USER *sd, int fd) {
       1) {  // This function disables the reward after character claims. Will
             // only function if items were claimed successfully prior
 
-    if (SQL_ERROR == Sql_Query(sql_handle,
-                               "UPDATE `RankingScores` SET `EventClaim` = 2 "
-                               "WHERE `EventId` = '%u' AND `ChaId` = '%u'",
-                               eventid, sd->status.id)) {
-      Sql_ShowDebug(sql_handle);
-      return -1;  // db error
-    }
-    if (SQL_SUCCESS != Sql_NextRow(sql_handle)) {
-      Sql_FreeResult(sql_handle);
-      clif_parseranking(sd, fd);
-      return 0;  // name is free
-    }
+    rust_ranking_set_claim(eventid, sd->status.id, 2);
+    clif_parseranking(sd, fd);
   }
 
   return 0;
@@ -6194,132 +6239,20 @@ void retrieveEventDates(int eventid, int pos, int fd) {
 }
 
 int checkPlayerScore(int eventid, USER *sd) {
-  int score = 0;
-
-  SqlStmt *stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `Score` FROM `RankingScores` WHERE "
-                                   "`EventId` = '%u' AND `ChaId` = '%u'",
-                                   eventid, sd->status.id) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &score, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  if (SQL_SUCCESS != SqlStmt_NextRow(stmt)) {
-    // SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  SqlStmt_Free(stmt);
-
-  return score;
+  return rust_ranking_score(eventid, sd->status.id);
 }
 
-void updateRanks(int eventid) {
-  SqlStmt *stmt = SqlStmt_Malloc(sql_handle);
-
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return;
-  }
-
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `Rank` FROM `RankingScores` WHERE "
-                                   "`EventId` = '%i' ORDER BY `Score` DESC",
-                                   eventid) ||
-      SQL_ERROR == SqlStmt_Execute(stmt)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return;
-  }
-
-  if (SQL_ERROR == Sql_Query(sql_handle, "SET @r=0")) {
-    Sql_ShowDebug(sql_handle);
-    Sql_FreeResult(sql_handle);
-    return;
-  }
-
-  if (SQL_ERROR == Sql_Query(sql_handle,
-                             "UPDATE `RankingScores` SET `Rank`= @r:= (@r+1) "
-                             "WHERE `EventId` = '%i' ORDER BY `Score` DESC",
-                             eventid)) {
-    Sql_ShowDebug(sql_handle);
-    Sql_FreeResult(sql_handle);
-    return;
-  }
-}
+// Ranks are kept live in memory; this only brings the Rank column up to
+// date for readers outside the server.
+void updateRanks(int eventid) { rust_ranking_save_ranks(eventid); }
 
 int checkPlayerRank(int eventid, USER *sd) {
-  int rank = 0;
-
-  SqlStmt *stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `Rank` FROM `RankingScores` WHERE "
-                                   "`EventId` = '%u' AND `ChaId` = '%i'",
-                                   eventid, sd->status.id) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_INT, &rank, 0, NULL, NULL)) {
-    // SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  if (SQL_SUCCESS != SqlStmt_NextRow(stmt)) {
-    // SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-  return rank;
+  return rust_ranking_rank(eventid, sd->status.id);
 }
 
 int checkevent_claim(int eventid, int fd, USER *sd) {
-  int claim = 0;
-
-  SqlStmt *stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `EventClaim` FROM `RankingScores` "
-                                   "WHERE `EventId` = '%u' AND `ChaId` = '%u'",
-                                   eventid, sd->status.id) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &claim, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return claim;
-  }
-
-  if (SQL_SUCCESS !=
-      SqlStmt_NextRow(stmt)) {  // If no record found, set claim=2 (no icon,
-                                // disabled getreward)
-    // SqlStmt_ShowDebug(stmt);
-    claim = 2;
-  }
-
-  SqlStmt_Free(stmt);
-  return claim;
+  // No row: claim=2 (no icon, disabled getreward)
+  return rust_ranking_claim(eventid, sd->status.id);
 }
 
 void dateevent_block(int pos, int eventid, int fd, USER *sd) {
@@ -6350,30 +6283,7 @@ void filler_block(int pos, int eventid, int fd, USER *sd) {
   WFIFOB(fd, pos + 13) = checkevent_claim(eventid, fd, sd);
 }
 
-int gettotalscores(int eventid) {
-  int scores;
-
-  SqlStmt *stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-  if (SQL_ERROR ==
-          SqlStmt_Prepare(
-              stmt,
-              "SELECT `ChaId` FROM `RankingScores` WHERE `EventId` = '%u'",
-              eventid) ||
-      SQL_ERROR == SqlStmt_Execute(stmt)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-  scores = SqlStmt_NumRows(stmt);
-  SqlStmt_Free(stmt);
-
-  return scores;
-}
+int gettotalscores(int eventid) { return rust_ranking_count(eventid); }
 
 int getevents() {
   int events;
@@ -6433,67 +6343,33 @@ int getevent_name(int pos, int fd, USER *sd) {
 }
 
 int getevent_playerscores(int eventid, int totalscores, int pos, int fd) {
-  char name[16];
-  int score;
-  int rank;
-  char buf[40];
+  struct RankingRow rows[10];
   int offset =
       RFIFOB(fd, 17) -
       10;  // The purpose of this -10 is because the packet request is value 10
-           // for page 1. Because of mysql integration, we want to offset so we
-           // start on row 0 for player scores loading
+           // for page 1, and we want to start on row 0 for player scores
   int i = 0;
+  int n;
 
-  SqlStmt *stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-
-  if (totalscores > 10) {
-    SqlStmt_Prepare(
-        stmt,
-        "SELECT `ChaName`, `Score`, `Rank` FROM `RankingScores` WHERE "
-        "`EventId` = '%u' ORDER BY `Rank` ASC LIMIT 10 OFFSET %u",
-        eventid, offset);
-  } else {
-    SqlStmt_Prepare(stmt,
-                    "SELECT `ChaName`, `Score`, `Rank` FROM `RankingScores` "
-                    "WHERE `EventId` = '%u' ORDER BY `Rank` ASC LIMIT 10",
-                    eventid);
-  }
+  if (totalscores <= 10) offset = 0;
+  n = rust_ranking_page(eventid, offset, rows, 10);
 
-  if (SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_STRING, &name,
-                                      sizeof(name), NULL, NULL) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 1, SQLDT_INT, &score, 0, NULL, NULL) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 2, SQLDT_INT, &rank, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  if (SqlStmt_NumRows(stmt) < 10) {
-    WFIFOB(fd, pos - 1) = SqlStmt_NumRows(stmt);
+  if (n < 10) {
+    WFIFOB(fd, pos - 1) = n;
   }  // added 04-26-2017 removes trailing zeros that were present in the ranking
      // feature
 
-  for (i = 0;
-       (i < SqlStmt_NumRows(stmt)) && (SQL_SUCCESS == SqlStmt_NextRow(stmt));
-       i++) {
-    sprintf(buf, "%s", name);
-    WFIFOB(fd, pos) = strlen(buf);
+  for (i = 0; i < n; i++) {
+    int len = strlen(rows[i].name);
+    WFIFOB(fd, pos) = len;
     pos++;
-    strncpy(WFIFOP(fd, pos), buf, strlen(buf));
-    pos += strlen(buf);
+    strncpy(WFIFOP(fd, pos), rows[i].name, len);
+    pos += len;
     pos += 3;
 
-    WFIFOB(fd, pos) = rank;  // # of rank
+    WFIFOB(fd, pos) = rows[i].rank;  // # of rank
     pos += 4;
-    clif_intcheck(score, pos, fd);
+    clif_intcheck(rows[i].score, pos, fd);
     pos++;
   }
 
@@ -7250,6 +7126,7 @@ int clif_deductduraequip(USER *sd) {
         return 0;
       }
 
+      if (!rust_pc_bod_items(sd)) return 0;
       memcpy(&sd->boditems.item[sd->boditems.bod_count],
              &sd->status.equip[equip], sizeof(sd->status.equip[equip]));
       sd->boditems.bod_count++;
@@ -7298,6 +7175,7 @@ int clif_deductduraequip(USER *sd) {
 
   sl_doscript_blargs("characterLog", "bodLog", 1, &sd->bl);
   sd->boditems.bod_count = 0;
+  rust_pc_bod_free(sd);
 
   return 0;
 }
@@ -7331,6 +7209,7 @@ int clif_checkinvbod(USER *sd) {  // handles items in inventory
         return 0;
       }
 
+      if (!rust_pc_bod_items(sd)) return 0;
       memcpy(&sd->boditems.item[sd->boditems.bod_count],
              &sd->status.inventory[x], sizeof(sd->status.inventory[x]));
       sd->boditems.bod_count++;
@@ -7361,6 +7240,7 @@ int clif_checkinvbod(USER *sd) {  // handles items in inventory
 
   sl_doscript_blargs("characterLog", "bodLog", 1, &sd->bl);
   sd->boditems.bod_count = 0;
+  rust_pc_bod_free(sd);
 
   return 0;
 }
@@ -7879,10 +7759,7 @@ int ignorelist_add(USER *sd, const char *name) {
   }
 
   // If name wasnt already on list, add it to chain
-  struct sd_ignorelist *New = NULL;
-  CALLOC(New, struct sd_ignorelist, 1);
-  // struct sd_ignorelist *New = (struct sd_ignorelist*)calloc(sizeof(struct
-  // sd_ignorelist));
+  struct sd_ignorelist *New = ers_pool_alloc(sizeof(struct sd_ignorelist));
 
   strcpy(New->name, name);
   New->Next = sd->IgnoreList;
@@ -7921,13 +7798,10 @@ int ignorelist_remove(USER *sd, const char *name) {
     if (ret == 0) {
       if (Prev) {
         Prev->Next = Current->Next;
-        // Current->Next=NULL;
-        // Current->Prev=NULL;
-        FREE(Current);
       } else {
-        FREE(sd->IgnoreList);
-        sd->IgnoreList = NULL;
+        sd->IgnoreList = Current->Next;
       }
+      ers_pool_free(Current, sizeof(struct sd_ignorelist));
     }
 
   } else
@@ -10724,7 +10598,7 @@ int clif_dropgold(USER *sd, unsigned int amounts) {
   int def[1];
   clif_sendaction(&sd->bl, 5, 20, 0);
   def[0] = 0;
-  CALLOC(fl, FLOORITEM, 1);
+  fl = ers_pool_alloc(sizeof(FLOORITEM));
   fl->bl.m = sd->bl.m;
   fl->bl.x = sd->bl.x;
   fl->bl.y = sd->bl.y;
@@ -10813,7 +10687,7 @@ int clif_dropgold(USER *sd, unsigned int amounts) {
                       BL_PC, LOOK_SEND, &fl->bl);
 
   } else {
-    FREE(fl);
+    ers_pool_free(fl, sizeof(FLOORITEM));
   }
 
   clif_sendstatus(sd, SFLAG_XPMONEY);
@@ -10871,7 +10745,7 @@ int clif_throwitem_sub(USER *sd, int id, int type, int x, int y) {
     return 0;
   }
 
-  CALLOC(fl, FLOORITEM, 1);
+  fl = ers_pool_alloc(sizeof(FLOORITEM));
   fl->bl.m = sd->bl.m;
   fl->bl.x = x;
   fl->bl.y = y;
@@ -10893,7 +10767,7 @@ int clif_throwitem_script(USER *sd) {
   int y = sd->throwy;
   int type = 0;
 
-  CALLOC(fl, FLOORITEM, 1);
+  fl = ers_pool_alloc(sizeof(FLOORITEM));
   fl->bl.m = sd->bl.m;
   fl->bl.x = x;
   fl->bl.y = y;
@@ -10962,7 +10836,7 @@ int clif_throwitem_script(USER *sd) {
     map_foreachinarea(clif_object_look_sub2, sd->bl.m, sd->bl.x, sd->bl.y, AREA,
                       BL_PC, LOOK_SEND, &fl->bl);
   } else {
-    FREE(fl);
+    ers_pool_free(fl, sizeof(FLOORITEM));
   }
 
   return 0;
@@ -11207,6 +11081,11 @@ int clif_changeprofile(USER *sd) {
   sd->profilepic_size = SWAP16(RFIFOW(sd->fd, 5)) + 2;
   sd->profile_size = RFIFOB(sd->fd, 5 + sd->profilepic_size) + 1;
 
+  if (!rust_pc_profilepic(sd)) {
+    sd->profilepic_size = 0;
+    sd->profile_size = 0;
+    return 0;
+  }
   memcpy(sd->profilepic_data, RFIFOP(sd->fd, 5), sd->profilepic_size);
   memcpy(sd->profile_data, RFIFOP(sd->fd, 5 + sd->profilepic_size),
          sd->profile_size);
@@ -11270,6 +11149,13 @@ int clif_handle_disconnect(USER *sd) {
   clif_quit(sd);
   map_deliddb(&sd->bl);
 
+  while (sd->IgnoreList) {
+    struct sd_ignorelist *next = sd->IgnoreList->Next;
+    ers_pool_free(sd->IgnoreList, sizeof(struct sd_ignorelist));
+    sd->IgnoreList = next;
+  }
+  rust_pc_cold_free(sd);
+
   if (SQL_ERROR ==
       Sql_Query(sql_handle,
                 "UPDATE `Character` SET `ChaOnline` = '0' WHERE `ChaId` = '%u'",
@@ -11588,6 +11474,8 @@ int clif_parse(int fd) {
   unsigned short len;
   USER *sd = NULL;
   unsigned char CurrentSeed;
+  unsigned char op;
+  uint64_t started;
 
   if (fd < 0) return 0;
   if (!rust_session_exists(fd)) return 0;
@@ -11677,7 +11565,9 @@ int clif_parse(int fd) {
     }
   }
 
-  // Incoming Packet Decryption
+  // Incoming Packet Decryption; the opcode byte is not encrypted
+  op = RFIFOB(fd, 3);
+  started = rust_opcode_clock();
   decrypt(fd);
 
   // printf("packet id: %i\n",RFIFOB(fd,3));
@@ -12070,60 +11960,111 @@ printf("\n");*/
       break;
   }
 
+  rust_opcode_in(op, len, started);
   RFIFOSKIP(fd, len);
   //}
   return 0;
 }
 
-unsigned int metacrc(char *file) {
-  FILE *fp = NULL;
+// Meta files, CRC'd and compressed once. Every client request used to
+// re-read the file twice, CRC it and compress it again, so a login wave did
+// that thousands of times for the same handful of files. Entries are checked
+// against the file's mtime and size at most once a second and rebuilt when
+// it changes; map_meta_reload forces a check.
+struct meta_entry {
+  unsigned int crc;
+  Bytef *data;  // zlib-compressed contents
+  uLongf clen;
+  time_t mtime;
+  off_t size;
+  int ok;
+};
+
+static struct meta_entry meta_cache[META_MAX];
+static unsigned int meta_checked;
+static int meta_primed;
+
+static void meta_drop(struct meta_entry *e) {
+  if (e->data) FREE(e->data);
+  memset(e, 0, sizeof(*e));
+}
+
+/// Bring meta_cache[x] up to date with meta_file[x] on disk.
+static void meta_load(int x) {
+  struct meta_entry *e = &meta_cache[x];
+  char path[512];
+  struct stat st;
+  FILE *fp;
+  Bytef *ubuf, *cbuf;
+  uLongf clen;
+  int retval;
+
+  snprintf(path, sizeof(path), "%s%s", meta_dir, meta_file[x]);
+  if (stat(path, &st) != 0) {
+    meta_drop(e);
+    return;
+  }
+  if (e->ok && e->mtime == st.st_mtime && e->size == st.st_size) return;
 
-  unsigned int checksum = 0;
-  unsigned int size;
-  Bytef fileinf[196608];
-  fp = fopen(file, "rb");
-  if (!fp) return 0;
-  fseek(fp, 0, SEEK_END);
-  size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  fread(fileinf, 1, size, fp);
+  fp = fopen(path, "rb");
+  if (!fp) {
+    meta_drop(e);
+    return;
+  }
+  CALLOC(ubuf, Bytef, st.st_size + 1);
+  if (fread(ubuf, 1, st.st_size, fp) != (size_t)st.st_size) {
+    fclose(fp);
+    FREE(ubuf);
+    meta_drop(e);
+    return;
+  }
   fclose(fp);
-  checksum = crc32(checksum, fileinf, size);
 
-  return checksum;
+  clen = compressBound(st.st_size);
+  CALLOC(cbuf, Bytef, clen + 1);
+  retval = compress(cbuf, &clen, ubuf, st.st_size);
+  if (retval != Z_OK) {
+    printf("Error retval=%d compressing %s\n", retval, path);
+    FREE(cbuf);
+    FREE(ubuf);
+    meta_drop(e);
+    return;
+  }
+
+  meta_drop(e);
+  e->crc = crc32(0, ubuf, st.st_size);
+  e->data = cbuf;
+  e->clen = clen;
+  e->mtime = st.st_mtime;
+  e->size = st.st_size;
+  e->ok = 1;
+  FREE(ubuf);
+}
+
+static void meta_refresh(int force) {
+  unsigned int tick = gettick();
+  int x;
+
+  if (!force && meta_primed && DIFF_TICK(tick, meta_checked) < 1000) return;
+  meta_checked = tick;
+  meta_primed = 1;
+  for (x = 0; x < metamax; x++) meta_load(x);
 }
 
+void map_meta_reload(void) { meta_refresh(1); }
+
 int send_metafile(USER *sd, char *file) {
   int len = 0;
-  unsigned int checksum = 0;
-  uLongf clen = 0;
-  Bytef *ubuf;
-  Bytef *cbuf;
-  unsigned int ulen = 0;
-  char filebuf[255];
-  unsigned int retval;
-  FILE *fp = NULL;
-
-  sprintf(filebuf, "%s%s", meta_dir, file);
-
-  checksum = metacrc(filebuf);
-
-  fp = fopen(filebuf, "rb");
-  if (!fp) return 0;
-
-  fseek(fp, 0, SEEK_END);
-  ulen = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-  // CALLOC(ubuf,0,ulen);
-  ubuf = calloc(ulen + 1, sizeof(Bytef));
-  clen = compressBound(ulen);
-  cbuf = calloc(clen + 1, sizeof(Bytef));
-  fread(ubuf, 1, ulen, fp);
-  fclose(fp);
+  int x;
+  struct meta_entry *e;
 
-  retval = compress(cbuf, &clen, ubuf, ulen);
+  meta_refresh(0);
+  // Only files from the meta list are served; the name comes from the client
+  for (x = 0; x < metamax; x++)
+    if (!strcmp(meta_file[x], file)) break;
+  if (x == metamax || !meta_cache[x].ok) return 0;
+  e = &meta_cache[x];
 
-  if (retval != 0) printf("Error retval=%d\n", retval);
   WFIFOHEAD(sd->fd, 65535 * 2);
   WFIFOB(sd->fd, 0) = 0xAA;
   WFIFOB(sd->fd, 3) = 0x6F;
@@ -12132,12 +12073,12 @@ int send_metafile(USER *sd, char *file) {
   WFIFOB(sd->fd, 6) = strlen(file);
   strcpy(WFIFOP(sd->fd, 7), file);
   len += strlen(file) + 1;
-  WFIFOL(sd->fd, len + 6) = SWAP32(checksum);
+  WFIFOL(sd->fd, len + 6) = SWAP32(e->crc);
   len += 4;
-  WFIFOW(sd->fd, len + 6) = SWAP16(clen);
+  WFIFOW(sd->fd, len + 6) = SWAP16(e->clen);
   len += 2;
-  memcpy(WFIFOP(sd->fd, len + 6), cbuf, clen);
-  len += clen;
+  memcpy(WFIFOP(sd->fd, len + 6), e->data, e->clen);
+  len += e->clen;
   WFIFOB(sd->fd, len + 6) = 0;
   len += 1;
   // printf("%s\n",file);
@@ -12146,8 +12087,6 @@ int send_metafile(USER *sd, char *file) {
   tk_crypt_static((unsigned char *)WFIFOP(sd->fd, 0));
   WFIFOSET(sd->fd, len + 6 + 3);
 
-  free(cbuf);
-  free(ubuf);
   return 0;
 }
 int send_meta(USER *sd) {
@@ -12162,10 +12101,9 @@ int send_meta(USER *sd) {
 }
 int send_metalist(USER *sd) {
   int len = 0;
-  unsigned int checksum;
-  char filebuf[6000];
   int x;
 
+  meta_refresh(0);
   WFIFOHEAD(sd->fd, 65535 * 2);
   WFIFOB(sd->fd, 0) = 0xAA;
   WFIFOB(sd->fd, 3) = 0x6F;
@@ -12177,9 +12115,7 @@ int send_metalist(USER *sd) {
     WFIFOB(sd->fd, (len + 6)) = strlen(meta_file[x]);
     memcpy(WFIFOP(sd->fd, len + 7), meta_file[x], strlen(meta_file[x]));
     len += strlen(meta_file[x]) + 1;
-    sprintf(filebuf, "%s%s", meta_dir, meta_file[x]);
-    checksum = metacrc(filebuf);
-    WFIFOL(sd->fd, len + 6) = SWAP32(checksum);
+    WFIFOL(sd->fd, len + 6) = SWAP32(meta_cache[x].crc);
     len += 4;
   }
 
@@ -12214,8 +12150,8 @@ int clif_handle_obstruction(USER *sd) {
       break;
   }
 
-  sd->bl.x = nx;
-  sd->bl.y = ny;
+  // Through map_moveblock so the grid cell and cell index follow the bl.
+  map_moveblock(&sd->bl, nx, ny);
 
   // if(clif_canmove(sd)) {
   //		sd->bl.x=xold;
@@ -13865,8 +13801,11 @@ int clif_clickonplayer(USER *sd, struct block_list *bl) {
   WFIFOW(sd->fd, len + 6) = 0;
   len += 2;
 
-  memcpy(WFIFOP(sd->fd, len + 6), tsd->profilepic_data, tsd->profilepic_size);
-  len += tsd->profilepic_size;
+  if (tsd->profilepic_data) {
+    memcpy(WFIFOP(sd->fd, len + 6), tsd->profilepic_data,
+           tsd->profilepic_size);
+    len += tsd->profilepic_size;
+  }
 
   memcpy(WFIFOP(sd->fd, len + 6), tsd->profile_data, tsd->profile_size);
   len += tsd->profile_size;
@@ -14862,6 +14801,7 @@ int clif_handitem(USER *sd) {
       mob = (MOB *)map_id2mob(bl->id);
 
       if (itemdb_exchangeable(sd->status.inventory[slot].id) == 1) return 0;
+      if (!rust_mob_inventory(mob)) return 0;
 
       for (int i = 0; i < MAX_INVENTORY; i++) {
         if (mob->inventory[i].id == sd->status.inventory[slot].id &&
@@ -14917,6 +14857,7 @@ int clif_exchange_cleanup(USER *sd) {
   sd->exchange.exchange_done = 0;
   sd->exchange.gold = 0;
   sd->exchange.item_count = 0;
+  rust_pc_exchange_free(sd);
   return 0;
 }
 
@@ -15325,6 +15266,7 @@ int clif_exchange_additem(USER *sd, USER *tsd, int id, int amount) {
                       "Receiving player does not have enough inventory space.");
     return 0;
   }
+  if (!rust_pc_exchange_items(sd)) return 0;
 
   sd->exchange.item[sd->exchange.item_count] = sd->status.inventory[id];
   sd->exchange.item[sd->exchange.item_count].amount = amount;
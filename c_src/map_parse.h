@@ -58,6 +58,8 @@ int clif_mob_look_start(USER *);
 int clif_mob_look_close(USER *);
 int clif_npc_move(struct block_list *, va_list);
 int clif_mob_move(struct block_list *, va_list);
+void clif_flush_moves(void);
+void clif_flush_moves_fd(int fd);
 int clif_mob_damage(USER *, MOB *);
 int clif_send_mob_health(MOB *, int, int);
 int clif_send_mob_healthscript(MOB *, int, int);
@@ -237,4 +239,5 @@ char *clif_getaccountemail(unsigned int id);
 int clif_canmove_sub(struct block_list *, va_list);
 
 int send_meta(USER *);
-int send_metalist(USER *);
\ No newline at end of file
+int send_metalist(USER *);
+void map_meta_reload(void);
\ No newline at end of file
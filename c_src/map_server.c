@@ -24,6 +24,7 @@
 #include "gm_command.h"
 #include "db.h"
 #include "db_mysql.h"
+#include "ers.h"
 #include "item_db.h"
 #include "magic_db.h"
 #include "map_char.h"
@@ -86,6 +87,7 @@ int oldHour;
 int oldMinute;
 int cronjobtimer;
 unsigned char *objectFlags;
+int objectFlagsCount;
 int old_time, cur_time, cur_year, cur_day, cur_season;
 
 #define BL_LIST_MAX 32768
@@ -126,24 +128,156 @@ int nmail_sendmessage(USER* sd, char* message, int other, int type) {
   return 0;
 }
 
+// Mob, floor item and NPC ids are handed out densely from the bottom of
+// their ranges, so each range is a direct-index slab: id - base is the slot.
+// Ids past ID_SLAB_MAX into a range (never seen in practice) and everything
+// outside them (players, F1_NPC) stay in id_db, as does an entity whose slab
+// could not grow, so an empty slot falls back to id_db. A slot is cleared on
+// map_deliddb.
+//
+// Onetime mob and floor item ids are reused, so a bare id kept across ticks
+// can find a later entity. Each slot therefore has a generation, bumped
+// whenever an entity is put in it: holders that keep an id take
+// map_id_gen(id) along with it and look it up with map_id2bl_gen, which
+// misses once the slot has been reused. Entities kept in id_db have
+// generation 0.
+#define ID_SLAB_MAX (1u << 22)
+
+struct id_slab {
+  unsigned int base, end;
+  unsigned int len;
+  struct block_list** slot;
+  unsigned int* gen;
+};
+
+static struct id_slab id_slabs[] = {
+    {MOB_START_NUM, MOBOT_START_NUM, 0, NULL, NULL},
+    {MOBOT_START_NUM, FLOORITEM_START_NUM, 0, NULL, NULL},
+    {FLOORITEM_START_NUM, NPC_START_NUM, 0, NULL, NULL},
+    {NPC_START_NUM, NPCT_START_NUM, 0, NULL, NULL},
+    {NPCT_START_NUM, F1_NPC, 0, NULL, NULL},
+};
+
+#define ID_SLABS (sizeof(id_slabs) / sizeof(id_slabs[0]))
+
+static struct id_slab* id_slab_of(unsigned int id) {
+  int i;
+
+  if (id < MOB_START_NUM || id >= F1_NPC) return NULL;
+  for (i = (int)ID_SLABS - 1; i > 0 && id < id_slabs[i].base; i--)
+    ;
+  if (id - id_slabs[i].base >= ID_SLAB_MAX) return NULL;
+  return &id_slabs[i];
+}
+
+static int id_slab_put(struct id_slab* s, unsigned int off,
+                       struct block_list* bl) {
+  if (off >= s->len) {
+    unsigned int len = s->len ? s->len : 1024;
+    struct block_list** slot = s->slot;
+    unsigned int* gen = s->gen;
+
+    while (len <= off) len *= 2;
+    REALLOC(slot, struct block_list*, len);
+    if (!slot) return -1;
+    s->slot = slot;
+    REALLOC(gen, unsigned int, len);
+    if (!gen) return -1;
+    s->gen = gen;
+    memset(slot + s->len, 0, (len - s->len) * sizeof(*slot));
+    memset(gen + s->len, 0, (len - s->len) * sizeof(*gen));
+    s->len = len;
+  }
+  s->slot[off] = bl;
+  // Never 0, which stands for "kept in id_db"
+  if (++s->gen[off] == 0) s->gen[off] = 1;
+  return 0;
+}
+
 struct block_list* map_id2bl(unsigned int id) {
-  struct block_list* bl = NULL;
-  bl = uidb_get(id_db, id);
-  return bl;
+  struct id_slab* s = id_slab_of(id);
+
+  if (s) {
+    unsigned int off = id - s->base;
+    if (off < s->len && s->slot[off]) return s->slot[off];
+  }
+  return uidb_get(id_db, id);
+}
+
+unsigned int map_id_gen(unsigned int id) {
+  struct id_slab* s = id_slab_of(id);
+
+  if (s) {
+    unsigned int off = id - s->base;
+    if (off < s->len && s->slot[off]) return s->gen[off];
+  }
+  return 0;
 }
 
-void map_deliddb(struct block_list* bl) { uidb_remove(id_db, bl->id); }
+struct block_list* map_id2bl_gen(unsigned int id, unsigned int gen) {
+  struct id_slab* s = id_slab_of(id);
+
+  if (s) {
+    unsigned int off = id - s->base;
+    if (off < s->len && s->slot[off])
+      return s->gen[off] == gen ? s->slot[off] : NULL;
+  }
+  return gen == 0 ? uidb_get(id_db, id) : NULL;
+}
+
+void map_deliddb(struct block_list* bl) {
+  if (bl->type == BL_PC) {
+    map_online_del(bl);
+    rust_aoi_reset(bl);
+  }
+  if (bl->type == BL_MOB) rust_mob_sched_del(bl);
+  if (bl->type == BL_ITEM) map_sweepdel((FLOORITEM*)bl);
+  if (bl->type == BL_NPC) rust_npc_timers_del(bl);
+  if (bl->type == BL_PC || bl->type == BL_MOB) rust_reg_index_reset(bl);
+  rust_sl_release_bl(bl);
+
+  struct id_slab* s = id_slab_of(bl->id);
+  if (s) {
+    unsigned int off = bl->id - s->base;
+    if (off < s->len && s->slot[off] == bl) {
+      s->slot[off] = NULL;
+      return;
+    }
+  }
+  uidb_remove(id_db, bl->id);
+}
 
 void map_addiddb(struct block_list* bl) {
   // if(bl->type==BL_MOB)
   // uidb_put(mobid_db,bl->id,bl);
 
-  uidb_put(id_db, bl->id, bl);
+  struct id_slab* s = id_slab_of(bl->id);
+  if (!s || id_slab_put(s, bl->id - s->base, bl))
+    uidb_put(id_db, bl->id, bl);
+  if (bl->type == BL_PC || bl->type == BL_MOB) rust_reg_index_reset(bl);
+  if (bl->type == BL_PC) map_online_add(bl);
+  if (bl->type == BL_MOB) rust_mob_sched_add(bl);
+  if (bl->type == BL_NPC) rust_npc_timers_add(bl);
+}
+
+/// Entities of BL_* mask `type` in the id slabs (mobs, floor items, NPCs).
+/// Players and F1_NPC live in id_db and are not counted.
+int map_iddb_count(int type) {
+  int i, n = 0;
+  unsigned int off;
+
+  for (i = 0; i < (int)ID_SLABS; i++) {
+    for (off = 0; off < id_slabs[i].len; off++) {
+      struct block_list* bl = id_slabs[i].slot[off];
+      if (bl && (bl->type & type)) n++;
+    }
+  }
+  return n;
 }
 
 void map_initiddb() {
-  id_db = uidb_alloc(DB_OPT_BASE);
-  mobid_db = uidb_alloc(DB_OPT_BASE);
+  id_db = uidb_alloc(DB_OPT_OPEN_ADDRESS);
+  mobid_db = uidb_alloc(DB_OPT_OPEN_ADDRESS);
   // mobsearch_db=numdb_init();
 }
 
@@ -171,10 +305,16 @@ int map_finaliddb(void* key, void* data, va_list ap) {
 }
 
 void map_termiddb() {
+  int i;
+
   if (id_db) {
     // uidb_final(id_db,map_finaliddb);
     id_db = NULL;
   }
+  for (i = 0; i < (int)ID_SLABS; i++) {
+    FREE(id_slabs[i].slot);
+    id_slabs[i].len = 0;
+  }
 }
 
 void map_clritem() {
@@ -182,6 +322,22 @@ void map_clritem() {
   object_n = 0;
 }
 
+/// Frees a non-player block. Floor items, temporary NPCs and onetime mobs
+/// come from the ERS size-class pools; everything else from malloc.
+void map_freebl(struct block_list* bl) {
+  if (!bl) return;
+
+  if (bl->type == BL_MOB) rust_mob_cold_free((MOB*)bl);
+  if (bl->type == BL_ITEM)
+    ers_pool_free(bl, sizeof(FLOORITEM));
+  else if (bl->type == BL_NPC && bl->id >= NPCT_START_NUM && bl->id != F1_NPC)
+    ers_pool_free(bl, sizeof(NPC));
+  else if (bl->type == BL_MOB && ((MOB*)bl)->onetime)
+    ers_pool_free(bl, sizeof(MOB));
+  else
+    free(bl);
+}
+
 void map_delitem(unsigned int id) {
   struct block_list* bl;
   bl = map_id2bl(id);
@@ -189,7 +345,7 @@ void map_delitem(unsigned int id) {
 
   map_deliddb(bl);
   map_delblock(bl);
-  FREE(bl);
+  map_freebl(bl);
 
   id -= FLOORITEM_START_NUM;
   if (id >= object_n || id < 0) return;
@@ -224,6 +380,41 @@ void map_additem(struct block_list* bl) {
   bl->next = NULL;
   map_addiddb(bl);
   map_addblock(bl);
+  map_sweepadd((FLOORITEM*)bl);
+}
+
+// With item_sweep on, floor items expire `sweeptime` milliseconds after they
+// are dropped (0 = never). map_deliddb cancels the expiry. Traps are placed
+// on purpose and stay until they are triggered or removed.
+int map_sweepadd(FLOORITEM* fl) {
+  nullpo_ret(0, fl);
+  if (!map_isloaded(fl->bl.m) || !map[fl->bl.m].sweeptime) return 0;
+  if (itemdb_type(fl->data.id) == ITM_TRAPS) return 0;
+
+  return rust_sweep_add(fl->bl.id, gettick(), map[fl->bl.m].sweeptime);
+}
+
+int map_sweepdel(FLOORITEM* fl) {
+  nullpo_ret(0, fl);
+  return rust_sweep_del(fl->bl.id);
+}
+
+// Remove the floor items due by tick `t`; called once a second from
+// map_cronjob.
+static void map_sweep(unsigned int t) {
+  unsigned int ids[256];
+  int i, n;
+
+  do {
+    n = rust_sweep_due(t, ids, 256);
+    for (i = 0; i < n; i++) {
+      struct block_list* bl = map_id2bl(ids[i]);
+
+      if (!bl || bl->type != BL_ITEM) continue;
+      clif_lookgone(bl);
+      map_delitem(ids[i]);
+    }
+  } while (n == 256);
 }
 
 int map_src_clear() {
@@ -286,7 +477,7 @@ int map_src_add(const char* r1) {
 USER* map_id2sd(unsigned int id) {
   USER* sd = NULL;
 
-  sd = (USER*)uidb_get(id_db, id);
+  sd = (USER*)map_id2bl(id);
   // nullpo_ret(0,sd=(USER*)uidb_get(id_db,id));
   return sd;
 }
@@ -369,13 +560,12 @@ FLOORITEM* map_id2fl(unsigned int id) {
 }
 
 USER* map_name2sd(const char* name) {
-  int i;
-  USER* sd = NULL;
+  USER* users[MAX_SESSIONS];
+  int i, n;
 
-  for (i = 0; i < fd_max; i++) {
-    if (rust_session_exists(i) && (sd = rust_session_get_data(i))) {
-      if (strcasecmp(name, sd->status.name) == 0) return sd;
-    }
+  n = map_online_users(-1, (struct block_list**)users, MAX_SESSIONS);
+  for (i = 0; i < n; i++) {
+    if (strcasecmp(name, users[i]->status.name) == 0) return users[i];
   }
   return NULL;
 }
@@ -408,292 +598,78 @@ int map_freeblock_unlock() {
 */
 
 
-int map_foreachinarea(int (*func)(struct block_list*, va_list), int m, int x,
-                      int y, int area, int type, ...) {
-  int nAreaSizeX = AREAX_SIZE, nAreaSizeY = AREAY_SIZE;
+// Variadic adapters over the typed queries (map_query_*). Each match gets
+// its own copy of the caller's argument list, as before.
+struct foreach_va {
+  int (*func)(struct block_list*, va_list);
   va_list ap;
-  va_start(ap, type);
-
-  int x0 = x - 9;
-  int y0 = y - 8;
-  int x1 = x + 9;
-  int y1 = y + 8;
+};
 
-  if (x0 < 0) {
-    x1 += -x0;
-    x0 = 0;
-    if (x1 >= map[m].xs) x1 = map[m].xs - 1;
-  }
-  if (y0 < 0) {
-    y1 += -y0;
-    y0 = 0;
-    if (y1 >= map[m].ys) y1 = map[m].ys - 1;
-  }
-  if (x1 >= map[m].xs) {
-    x0 -= x1 - map[m].xs + 1;
-    x1 = map[m].xs - 1;
-    if (x0 < 0) x0 = 0;
-  }
-  if (y1 >= map[m].ys) {
-    y0 -= y1 - map[m].ys + 1;
-    y1 = map[m].ys - 1;
-    if (y0 < 0) y0 = 0;
-  }
+static int foreach_va_visit(struct block_list* bl, void* ctx) {
+  struct foreach_va* f = ctx;
+  va_list ap;
+  int ret;
 
-  switch (area) {
-    case AREA:
+  va_copy(ap, f->ap);
+  ret = f->func(bl, ap);
+  va_end(ap);
+  return ret;
+}
 
-      map_foreachinblockva(func, m, x - (nAreaSizeX + 1), y - (nAreaSizeY + 1),
-                           x + (nAreaSizeX + 1), y + (nAreaSizeY + 1), type,
-                           ap);
-      break;
-    case CORNER:
-      if (map[m].xs > (nAreaSizeX * 2 + 1) &&
-          map[m].ys > (nAreaSizeY * 2 + 1)) {
-        if (x < (nAreaSizeX * 2 + 2) && x > nAreaSizeX)
-          map_foreachinblockva(func, m, 0, y - (nAreaSizeY + 1),
-                               x - (nAreaSizeX + 2), y + (nAreaSizeY + 1), type,
-                               ap);
-        if (y < (nAreaSizeY * 2 + 2) && y > nAreaSizeY) {
-          map_foreachinblockva(func, m, x - (nAreaSizeX + 1), 0,
-                               x + (nAreaSizeX + 1), y - (nAreaSizeY + 2), type,
-                               ap);
-          if (x < (nAreaSizeX * 2 + 2) && x > nAreaSizeX)
-            map_foreachinblockva(func, m, 0, 0, x - (nAreaSizeX + 2),
-                                 y - (nAreaSizeY + 2), type, ap);
-          else if (x > map[m].xs - (nAreaSizeX * 2 + 3) &&
-                   x < map[m].xs - (nAreaSizeX + 1))
-            map_foreachinblockva(func, m, x + (nAreaSizeX + 2), 0,
-                                 map[m].xs - 1, y + (nAreaSizeY + 2), type, ap);
-        }
-        if (x > map[m].xs - (nAreaSizeX * 2 + 3) &&
-            x < map[m].xs - (nAreaSizeX + 1))
-          map_foreachinblockva(func, m, x + (nAreaSizeX + 2),
-                               y - (nAreaSizeY + 1), map[m].xs - 1,
-                               y + (nAreaSizeY + 1), type, ap);
-        if (y > map[m].ys - (nAreaSizeY * 2 + 3) &&
-            y < map[m].ys - (nAreaSizeY + 1)) {
-          map_foreachinblockva(func, m, x - (nAreaSizeX + 1),
-                               y + (nAreaSizeY + 2), x + (nAreaSizeX + 1),
-                               map[m].ys - 1, type, ap);
-          if (x < (nAreaSizeX * 2 + 2) && x > nAreaSizeX)
-            map_foreachinblockva(func, m, 0, y + (nAreaSizeY + 2),
-                                 x - (nAreaSizeX + 2), map[m].ys - 1, type, ap);
-          else if (x > map[m].xs - (nAreaSizeX * 2 + 3) &&
-                   x < map[m].xs - (nAreaSizeX + 1))
-            map_foreachinblockva(func, m, x + (nAreaSizeX + 2),
-                                 y + (nAreaSizeY + 2), map[m].xs - 1,
-                                 map[m].ys - 1, type, ap);
-        }
-      }
-      break;
-    case SAMEAREA:
-      /*if (x <= nAreaSizeX && y <= nAreaSizeY)
-              map_foreachinblockva(func,m,0,0,(nAreaSizeX*2+2),(nAreaSizeY*2+2),type,ap);
-      else if (x <= nAreaSizeX && y >= map[m].ys-(nAreaSizeY+1))
-              map_foreachinblockva(func,m,0,map[m].ys-(nAreaSizeY*2+3),(nAreaSizeX*2+2),map[m].ys-1,type,ap);
-      else if (x >= map[m].xs-(nAreaSizeX+1) && y <= nAreaSizeY)
-              map_foreachinblockva(func,m,map[m].xs-(nAreaSizeX*2+3),0,map[m].xs-1,(nAreaSizeY*2+2),type,ap);
-      else if (x >= map[m].xs-(nAreaSizeX+1) && y >= map[m].ys-(nAreaSizeY+1))
-              map_foreachinblockva(func,m,map[m].xs-(nAreaSizeX*2+3),map[m].ys-(nAreaSizeY*2+3),map[m].xs-1,map[m].ys-1,type,ap);
-      else
-              map_foreachinblockva(func,m,x-(nAreaSizeX+1),y-(nAreaSizeY+1),x+(nAreaSizeX+1),y+(nAreaSizeY+1),type,ap);*/
-      map_foreachinblockva(func, m, x0, y0, x1, y1, type, ap);
-      break;
-    case SAMEMAP:
-      map_foreachinblockva(func, m, 0, 0, map[m].xs - 1, map[m].ys - 1, type,
-                           ap);
-      break;
-  }
+int map_foreachinarea(int (*func)(struct block_list*, va_list), int m, int x,
+                      int y, int area, int type, ...) {
+  struct foreach_va f = {func};
+  va_list ap;
 
+  va_start(ap, type);
+  va_copy(f.ap, ap);
+  map_query_area(m, x, y, area, type, foreach_va_visit, &f);
+  va_end(f.ap);
   va_end(ap);
   return 0;
 }
 
 int map_foreachinblockva(int (*func)(struct block_list*, va_list), int m,
                          int x0, int y0, int x1, int y1, int type, va_list ap) {
-  int bx, by;
-  int returnCount = 0;  // total sum of returned values of func() [Skotlex]
-  struct block_list* bl = NULL;
-  int blockcount = 0;
-  int i;
-
-  if (m < 0) return 0;
-
-  if (!map_isloaded(m)) return 0;
-
-  if (x0 < 0) x0 = 0;
-  if (y0 < 0) y0 = 0;
-  if (x1 >= map[m].xs) x1 = map[m].xs - 1;
-  if (y1 >= map[m].ys) y1 = map[m].ys - 1;
-
-  if ((type & ~BL_MOB))
-    for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++)
-      for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++)
-        for (bl = map[m].block[bx + by * map[m].bxs];
-             bl && blockcount < BL_LIST_MAX; bl = bl->next) {
-          if ((bl->type & type) && bl->x >= x0 && bl->x <= x1 && bl->y >= y0 &&
-              bl->y <= y1 && blockcount < BL_LIST_MAX)
-            bl_list[blockcount++] = bl;
-        }
-
-  if ((type & BL_MOB))
-    for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++)
-      for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++)
-        for (bl = map[m].block_mob[bx + by * map[m].bxs];
-             bl && blockcount < BL_LIST_MAX; bl = bl->next) {
-          MOB* mob = (MOB*)bl;
-          if (mob->state != MOB_DEAD && bl->x >= x0 && bl->x <= x1 &&
-              bl->y >= y0 && bl->y <= y1 && blockcount < BL_LIST_MAX)
-            bl_list[blockcount++] = bl;
-        }
-
-  if (blockcount >= BL_LIST_MAX)
-    printf("map_foreachinarea: block count too many!\n");
-
-  for (i = 0; i < blockcount; i++) {
-    if (bl_list[i]->prev) {  // �L?���ǂ����`�F�b�N
+  struct foreach_va f = {func};
+  int ret;
 
-      va_list ap_copy;
-      va_copy(ap_copy, ap);
-      returnCount += func(bl_list[i], ap_copy);
-      va_end(ap_copy);
-    }
-  }
-
-  /*for (i = blockcount; i >= 0; i--)
-          if (bl_list[i]->prev)
-                  returnCount += func(bl_list[i],ap);*/
-
-  // bl_list_count = blockcount;
-  return returnCount;
+  va_copy(f.ap, ap);
+  ret = map_query_block(m, x0, y0, x1, y1, type, foreach_va_visit, &f);
+  va_end(f.ap);
+  return ret;
 }
 
 int map_foreachinblock(int (*func)(struct block_list*, va_list), int m, int x0,
                        int y0, int x1, int y1, int type, ...) {
   va_list ap;
-  va_start(ap, type);
-  if (x0 < 0) x0 = 0;
-  if (y0 < 0) y0 = 0;
-  if (x1 >= map[m].xs) x1 = map[m].xs - 1;
-  if (y1 >= map[m].ys) y1 = map[m].ys - 1;
 
+  va_start(ap, type);
   map_foreachinblockva(func, m, x0, y0, x1, y1, type, ap);
-
   va_end(ap);
   return 0;
 }
 
 int map_foreachincell(int (*func)(struct block_list*, va_list), int m, int x,
                       int y, int type, ...) {
-  int bx, by;
-  int returnCount = 0;  // total sum of returned values of func() [Skotlex]
-  struct block_list* bl = NULL;
-  int blockcount = 0;
-
-  if (x < 0 || y < 0 || x >= map[m].xs || y >= map[m].ys) return 0;
-
-  by = y / BLOCK_SIZE;
-  bx = x / BLOCK_SIZE;
-
-  if ((type & ~BL_MOB))
-    for (bl = map[m].block[bx + by * map[m].bxs];
-         bl && blockcount < BL_LIST_MAX; bl = bl->next) {
-      if ((bl->type & type) && bl->x == x && bl->y == y &&
-          blockcount < BL_LIST_MAX) {
-        if (bl->type != BL_ITEM)
-          bl_list[blockcount++] = bl;
-        else {
-          FLOORITEM* fl = (FLOORITEM*)bl;
-          if (itemdb_type(fl->data.id) != ITM_TRAPS) bl_list[blockcount++] = bl;
-        }
-      }
-    }
-
-  if ((type & BL_MOB))
-    for (bl = map[m].block_mob[bx + by * map[m].bxs];
-         bl && blockcount < BL_LIST_MAX; bl = bl->next) {
-      MOB* mob = (MOB*)bl;
-      if (mob->state != MOB_DEAD && bl->x == x && bl->y == y &&
-          blockcount < BL_LIST_MAX)
-        bl_list[blockcount++] = bl;
-    }
+  struct foreach_va f = {func};
+  int ret;
 
-  if (blockcount >= BL_LIST_MAX)
-    printf("Map_foreachincell: block count too many!\n");
-  // ShowWarning("map_foreachincell: block count too many!\n");
-
-  // map_freeblock_lock();	//
-  // ����������̉�����֎~����
-  // - Prohibit release from memory
-
-  for (int i = 0; i < blockcount; i++)
-    if (bl_list[i]->prev)  // �L?���ǂ����`�F�b�N - Check if there is
-    {
-      va_list ap;
-      va_start(ap, type);
-      returnCount += func(bl_list[i], ap);
-      va_end(ap);
-    }
-
-  // map_freeblock_unlock();	// ����������� - Allow
-  // release
-
-  // bl_list_count = blockcount;
-  return returnCount;
+  va_start(f.ap, type);
+  ret = map_query_cell(m, x, y, type, 0, foreach_va_visit, &f);
+  va_end(f.ap);
+  return ret;
 }
 
 int map_foreachincellwithtraps(int (*func)(struct block_list*, va_list), int m,
                                int x, int y, int type, ...) {
-  int bx, by;
-  int returnCount = 0;  // total sum of returned values of func() [Skotlex]
-  struct block_list* bl = NULL;
-  int blockcount = 0;
-  int i;
-
-  if (x < 0 || y < 0 || x >= map[m].xs || y >= map[m].ys) return 0;
-
-  by = y / BLOCK_SIZE;
-  bx = x / BLOCK_SIZE;
-
-  if ((type & ~BL_MOB))
-    for (bl = map[m].block[bx + by * map[m].bxs];
-         bl && blockcount < BL_LIST_MAX; bl = bl->next) {
-      if ((bl->type & type) && bl->x == x && bl->y == y &&
-          blockcount < BL_LIST_MAX) {
-        bl_list[blockcount++] = bl;
-      }
-    }
-
-  if ((type & BL_MOB))
-    for (bl = map[m].block_mob[bx + by * map[m].bxs];
-         bl && blockcount < BL_LIST_MAX; bl = bl->next) {
-      MOB* mob = (MOB*)bl;
-      if (mob->state != MOB_DEAD && bl->x == x && bl->y == y &&
-          blockcount < BL_LIST_MAX)
-        bl_list[blockcount++] = bl;
-    }
-
-  if (blockcount >= BL_LIST_MAX)
-    printf("Map_foreachincell: block count too many!\n");
-  // ShowWarning("map_foreachincell: block count too many!\n");
-
-  // map_freeblock_lock();	//
-  // ����������̉�����֎~����
-
-  for (i = 0; i < blockcount; i++)
-    if (bl_list[i]->prev)  // �L?���ǂ����`�F�b�N
-    {
-      va_list ap;
-      va_start(ap, type);
-      returnCount += func(bl_list[i], ap);
-      va_end(ap);
-    }
-
-  // map_freeblock_unlock();	// �����������
+  struct foreach_va f = {func};
+  int ret;
 
-  // bl_list_count = blockcount;
-  return returnCount;
+  va_start(f.ap, type);
+  ret = map_query_cell(m, x, y, type, 1, foreach_va_visit, &f);
+  va_end(f.ap);
+  return ret;
 }
 
 struct block_list* map_firstincell(int m, int x, int y, int type) {
@@ -812,82 +788,42 @@ int map_respawnmobs(int (*func)(struct block_list*, va_list), int m, int type,
 int map_loadregistry(int id) {
   return rust_map_loadregistry(id);
 }
-int map_lastdeath_mob(MOB* p) {
-  if (SQL_ERROR ==
-      Sql_Query(sql_handle,
-                "UPDATE `Spawns%i` SET `SpnLastDeath`='%u' WHERE `SpnX`='%u' "
-                "AND `SpnY`='%u' AND `SpnMapId`='%u' AND `SpnId`='%u'",
-                serverid, p->last_death, p->startx, p->starty, p->bl.m,
-                p->id)) {
+/// Queue a write for the DB worker instead of running it on the game thread.
+/// Writes under the same non-NULL key coalesce to the last one queued. Runs
+/// on sql_handle when no worker is running.
+void map_dbwrite(const char* key, const char* fmt, ...) {
+  StringBuf buf;
+  va_list ap;
+
+  StringBuf_Init(&buf);
+  va_start(ap, fmt);
+  StringBuf_Vprintf(&buf, fmt, ap);
+  va_end(ap);
+
+  if (!rust_dbq_push(key, StringBuf_Value(&buf)) &&
+      SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)))
     Sql_ShowDebug(sql_handle);
-  }
 
-  return 0;
+  StringBuf_Destroy(&buf);
 }
 
-int map_registrysave(int m, int i) {
-  struct global_reg* p = &map[m].registry[i];
-  long long save_id = -1;
-  SqlStmt* stmt;
-  unsigned int reg_id;
+int map_lastdeath_mob(MOB* p) {
+  char key[64];
 
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-  if (SQL_ERROR ==
-          SqlStmt_Prepare(stmt,
-                          "SELECT `MrgPosition` FROM `MapRegistry` WHERE "
-                          "`MrgMapId` = '%d' AND `MrgIdentifier`='%s'",
-                          m, p->str) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &reg_id, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
+  snprintf(key, sizeof(key), "lastdeath:%u", p->id);
+  map_dbwrite(key,
+              "UPDATE `Spawns%i` SET `SpnLastDeath`='%u' WHERE `SpnX`='%u' "
+              "AND `SpnY`='%u' AND `SpnMapId`='%u' AND `SpnId`='%u'",
+              serverid, p->last_death, p->startx, p->starty, p->bl.m, p->id);
 
-  if (SQL_SUCCESS == SqlStmt_NextRow(stmt)) {
-    save_id = reg_id;
-  }
-  SqlStmt_Free(stmt);
+  return 0;
+}
 
-  if (save_id != -1) {
-    if (p->val == 0) {
-      if (SQL_ERROR == Sql_Query(sql_handle,
-                                 "DELETE FROM `MapRegistry` WHERE `MrgMapId` = "
-                                 "'%u' AND `MrgIdentifier` = '%s'",
-                                 m, p->str)) {
-        Sql_ShowDebug(sql_handle);
-        return 0;
-      }
-    } else {
-      if (SQL_ERROR ==
-          Sql_Query(
-              sql_handle,
-              "UPDATE `MapRegistry` SET `MrgIdentifier` = '%s', `MrgValue` = "
-              "'%d' WHERE `MrgMapId` = '%u' AND `MrgPosition`='%d'",
-              p->str, p->val, m, save_id)) {
-        Sql_ShowDebug(sql_handle);
-        return 0;
-      }
-    }
-  } else {
-    if (p->val > 0) {
-      if (SQL_ERROR ==
-          Sql_Query(
-              sql_handle,
-              "INSERT INTO `MapRegistry` (`MrgMapId`, `MrgIdentifier`, "
-              "`MrgValue`, `MrgPosition`) VALUES ('%d', '%s', '%d', '%u')",
-              m, p->str, p->val, i)) {
-        Sql_ShowDebug(sql_handle);
-        return 0;
-      }
-    }
-  }
+int map_registrysave(int m, int i) {
+  struct global_reg* p = &map[m].registry[i];
 
+  // Buffered: flushed as one batched upsert/delete every few hundred ms
+  rust_reg_write_map(m, p->str, p->val, i);
   return 0;
 }
 /*int map_registrydelete(int m, int i) {
@@ -1109,7 +1045,7 @@ int map_reload() {
     return -1;
   }
   for (i = 0; i < map_n; i++) {
-    if (map_isloaded(i))
+    if (map_isloaded(i) && rust_map_changed(i))
       map_foreachinarea(sl_updatepeople, i, 0, 0, SAMEMAP, BL_PC);
   }
   printf("Map data file reading finished. %d map loaded!\n", map_n);
@@ -1197,9 +1133,7 @@ void map_do_term(void) {
   map_clritem();
   map_termiddb();
   for (i = 0; i < MAX_MAP_PER_SERVER; i++) {
-    FREE(map[i].tile);
-    FREE(map[i].obj);
-    FREE(map[i].map);
+    rust_map_free_tiles(i);
     FREE(map[i].block);
     // FREE(map[i].block_npc);
     // FREE(map[i].block_count);
@@ -1212,6 +1146,7 @@ void map_do_term(void) {
   itemdb_term();
   magicdb_term();
   classdb_term();
+  rust_dbq_flush();
   // boarddb_term();
   // mobdb_term();
   // sql_close();
@@ -1251,11 +1186,10 @@ int change_time_char(int none, int none2) {
     }
   }
 
-  if (SQL_ERROR == Sql_Query(sql_handle,
-                             "UPDATE `Time` SET `TimHour` ='%d', "
-                             "`TimDay`='%d', `TimSeason`='%d', `TimYear`='%d'",
-                             cur_time, cur_day, cur_season, cur_year))
-    Sql_ShowDebug(sql_handle);
+  map_dbwrite("time",
+              "UPDATE `Time` SET `TimHour` ='%d', "
+              "`TimDay`='%d', `TimSeason`='%d', `TimYear`='%d'",
+              cur_time, cur_day, cur_season, cur_year);
 
   return 0;
 }
@@ -1298,15 +1232,10 @@ int get_time_thing(void) {
   return 0;
 }
 int uptime(void) {
-  if (SQL_ERROR ==
-      Sql_Query(sql_handle, "DELETE FROM `UpTime` WHERE `UtmId` = '3'"))
-    Sql_ShowDebug(sql_handle);
-
-  if (SQL_ERROR ==
-      Sql_Query(sql_handle,
-                "INSERT INTO `UpTime`(`UtmId`, `UtmValue`) VALUES('3', '%d')",
-                gettickthing()))
-    Sql_ShowDebug(sql_handle);
+  // REPLACE: the DELETE + INSERT of row 3 as one queued statement
+  map_dbwrite("uptime",
+              "REPLACE INTO `UpTime`(`UtmId`, `UtmValue`) VALUES('3', '%d')",
+              gettickthing());
 
   return 0;
 }
@@ -1345,6 +1274,7 @@ int object_flag_init(void) {
 
   fread(&num, 4, 1, fi);
   CALLOC(objectFlags, unsigned char, num + 1);
+  objectFlagsCount = num + 1;
   fread(&flag, 1, 1, fi);
 
   while (!feof(fi)) {
@@ -1613,14 +1543,10 @@ int nmail_luascript(USER* sd, int to, int topic, int msg) {
 
   Sql_EscapeString(sql_handle, escape, message);
 
-  if (SQL_ERROR ==
-      Sql_Query(sql_handle,
-                "INSERT INTO `Mail` (`MalChaName`, `MalChaNameDestination`, "
-                "`MalBody`) VALUES ('%s', 'Lua', '%s')",
-                sd->status.name, escape)) {
-    Sql_ShowDebug(sql_handle);
-    return 0;
-  }
+  map_dbwrite(NULL,
+              "INSERT INTO `Mail` (`MalChaName`, `MalChaNameDestination`, "
+              "`MalBody`) VALUES ('%s', 'Lua', '%s')",
+              sd->status.name, escape);
 
   sl_exec(sd, message);
   return 0;
@@ -1698,6 +1624,7 @@ int nmail_poemscript(USER* sd, char* topic, char* message) {
     return 1;
   }
 
+  map_boardchanged(19);
   nmail_sendmessage(sd, "Poem submitted.", 6, 1);
 
   return 0;
@@ -1849,12 +1776,23 @@ int map_addmob(USER* sd, unsigned int id, int start, int end,
     Sql_ShowDebug(sql_handle);
   return 0;
 }
+// Tell the char server a board was written here, so it drops its cached
+// pages of that board.
+int map_boardchanged(int board) {
+  if (!char_fd) return 0;
+  WFIFOHEAD(char_fd, 6);
+  WFIFOW(char_fd, 0) = 0x3011;
+  WFIFOL(char_fd, 2) = board;
+  WFIFOSET(char_fd, 6);
+  return 0;
+}
 int map_changepostcolor(int board, int post, int color) {
   if (SQL_ERROR == Sql_Query(sql_handle,
                              "UPDATE `Boards` SET `BrdHighlighted` = '%d' "
                              "WHERE `BrdBnmId` = '%d' AND `BrdPosition` = '%d'",
                              color, board, post))
     Sql_ShowDebug(sql_handle);
+  map_boardchanged(board);
   // sql_request("UPDATE boards SET color=%d WHERE board_id=%d AND
   // post_id=%d",color,board,post); sql_get_row(); sql_free_row();
   return 0;
@@ -1863,17 +1801,16 @@ int map_getpostcolor(int board, int post) {
   int color;
   SqlStmt* stmt;
 
-  stmt = SqlStmt_Malloc(sql_handle);
+  stmt = SqlStmt_Cached(sql_handle,
+                        "SELECT `BrdHighlighted` FROM `Boards` WHERE "
+                        "`BrdBnmId` = ? AND `BrdPosition` = ?");
   if (stmt == NULL) {
     SqlStmt_ShowDebug(stmt);
     return -1;
   }
 
-  if (SQL_ERROR ==
-          SqlStmt_Prepare(stmt,
-                          "SELECT `BrdHighlighted` FROM `Boards` WHERE "
-                          "`BrdBnmId` = '%d' AND `BrdPosition` = '%d'",
-                          board, post) ||
+  if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_INT, &board, 0) ||
+      SQL_ERROR == SqlStmt_BindParam(stmt, 1, SQLDT_INT, &post, 0) ||
       SQL_ERROR == SqlStmt_Execute(stmt) ||
       SQL_ERROR ==
           SqlStmt_BindColumn(stmt, 0, SQLDT_INT, &color, 0, NULL, NULL)) {
@@ -1906,16 +1843,14 @@ char* map_id2name(unsigned int id) {
   }
 
   SqlStmt* stmt;
-  stmt = SqlStmt_Malloc(sql_handle);
+  stmt = SqlStmt_Cached(sql_handle,
+                        "SELECT `ChaName` FROM `Character` WHERE `ChaId` = ?");
   if (stmt == NULL) {
     SqlStmt_ShowDebug(stmt);
     return 0;
   }
 
-  if (SQL_ERROR == SqlStmt_Prepare(
-                       stmt,
-                       "SELECT `ChaName` FROM `Character` WHERE `ChaId` = '%u'",
-                       id) ||
+  if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_UINT, &id, 0) ||
       SQL_ERROR == SqlStmt_Execute(stmt) ||
       SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_STRING, &name,
                                       sizeof(name), NULL, NULL)) {
@@ -1936,8 +1871,10 @@ char* map_id2name(unsigned int id) {
 void mmo_setonline(unsigned int id, int val) {
   int a, b, c, d, regid;
   char addr[255];
+  char key[32];
   USER* sd = map_id2sd(id);
-  SqlStmt* stmt = SqlStmt_Malloc(sql_handle);
+  SqlStmt* stmt = SqlStmt_Cached(
+      sql_handle, "SELECT `ChaId` FROM `Character` WHERE `ChaId` = ?");
 
   if (stmt == NULL) {
     SqlStmt_ShowDebug(stmt);
@@ -1945,10 +1882,7 @@ void mmo_setonline(unsigned int id, int val) {
     return;
   }
 
-  if (SQL_ERROR == SqlStmt_Prepare(
-                       stmt,
-                       "SELECT `ChaId` FROM `Character` WHERE `ChaId` = '%u'",
-                       id) ||
+  if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_UINT, &id, 0) ||
       SQL_ERROR == SqlStmt_Execute(stmt) ||
       SQL_ERROR ==
           SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &regid, 0, NULL, NULL)) {
@@ -1978,11 +1912,11 @@ void mmo_setonline(unsigned int id, int val) {
     }*/
   }
 
-  if (SQL_ERROR == Sql_Query(sql_handle,
-                             "UPDATE `Character` SET `ChaOnline` = '%d', "
-                             "`ChaLastIP` = '%s' WHERE `ChaId` = '%u'",
-                             val, addr, id))
-    Sql_ShowDebug(sql_handle);
+  snprintf(key, sizeof(key), "online:%u", id);
+  map_dbwrite(key,
+              "UPDATE `Character` SET `ChaOnline` = '%d', "
+              "`ChaLastIP` = '%s' WHERE `ChaId` = '%u'",
+              val, addr, id);
 
   SqlStmt_Free(stmt);
 }
@@ -2190,66 +2124,9 @@ int map_loadgameregistry() {
 // saves gameregistries
 int map_savegameregistry(int i) {
   struct global_reg* p = &gamereg.registry[i];
-  unsigned int save_id = 0;
-  SqlStmt* stmt;
-  unsigned int gameregid;
-
-  stmt = SqlStmt_Malloc(sql_handle);
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `GrgId` FROM `GameRegistry%d` WHERE "
-                                   "`GrgIdentifier` = '%s'",
-                                   serverid, p->str) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &gameregid, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  if (SQL_SUCCESS == SqlStmt_NextRow(stmt)) {
-    save_id = gameregid;
-  }
-
-  SqlStmt_Free(stmt);
-
-  if (save_id) {
-    if (p->val == 0) {
-      if (SQL_ERROR ==
-          Sql_Query(sql_handle,
-                    "DELETE FROM `GameRegistry%d` WHERE `GrgIdentifier` = '%s'",
-                    serverid, p->str)) {
-        Sql_ShowDebug(sql_handle);
-        return 0;
-      }
-    } else {
-      if (SQL_ERROR ==
-          Sql_Query(sql_handle,
-                    "UPDATE `GameRegistry%d` SET `GrgIdentifier` = '%s', "
-                    "`GrgValue` = '%d' WHERE `GrgId` = '%d'",
-                    serverid, p->str, p->val, save_id)) {
-        Sql_ShowDebug(sql_handle);
-        return 0;
-      }
-    }
-  } else {
-    if (p->val > 0) {
-      if (SQL_ERROR ==
-          Sql_Query(sql_handle,
-                    "INSERT INTO `GameRegistry%d` (`GrgIdentifier`, "
-                    "`GrgValue`) VALUES ('%s', '%d')",
-                    serverid, p->str, p->val)) {
-        Sql_ShowDebug(sql_handle);
-        return 0;
-      }
-    }
-  }
 
+  // Buffered like map_registrysave
+  rust_reg_write_game(serverid, p->str, p->val);
   return 0;
 }
 // sets game registry
@@ -2396,107 +2273,73 @@ int map_loadclanbank(int id) {
 }
 
 int map_saveclanbank(int id) {
-  SqlStmt* stmt;
-
   unsigned int max = 255;
-
-  int save_id[max];
-  int item_id = -1;
-  int i;
-  char escape[64];
-  char escape2[300];
+  int i, n = 0;
+  char escape[129];
+  char escape2[601];
+  char key[32];
+  StringBuf rows, kept;
 
   struct clan_data* clan = NULL;
   clan = (struct clan_data*)rust_clandb_search(id);
 
   if (clan == NULL) return 0;
 
-  memset(save_id, 0, max * sizeof(int));
-  stmt = SqlStmt_Malloc(sql_handle);
-
-  if (stmt == NULL) {
-    SqlStmt_ShowDebug(stmt);
-    return 0;
-  }
-
-  if (SQL_ERROR == SqlStmt_Prepare(stmt,
-                                   "SELECT `CbkPosition` FROM `ClanBanks` "
-                                   "WHERE `CbkClnId` = '%u' LIMIT 255",
-                                   id) ||
-      SQL_ERROR == SqlStmt_Execute(stmt) ||
-      SQL_ERROR ==
-          SqlStmt_BindColumn(stmt, 0, SQLDT_INT, &item_id, 0, NULL, NULL)) {
-    SqlStmt_ShowDebug(stmt);
-    SqlStmt_Free(stmt);
-    return 0;
-  }
-
-  for (i = 0; i < max; i++) save_id[i] = -1;
-
-  for (i = 0; i < SqlStmt_NumRows(stmt) && SQL_SUCCESS == SqlStmt_NextRow(stmt);
-       i++)
-    save_id[item_id] = item_id;
-
-  SqlStmt_Free(stmt);
-
+  // One upsert for every filled slot and one delete for the emptied ones,
+  // keyed per clan so repeated saves coalesce to the last snapshot
+  StringBuf_Init(&rows);
+  StringBuf_Init(&kept);
   for (i = 0; i < max; i++) {
-    Sql_EscapeString(sql_handle, escape, clan->clanbanks[i].real_name);
-    Sql_EscapeString(sql_handle, escape2, clan->clanbanks[i].note);
-
-    if (save_id[i] == i) {
-      if (clan->clanbanks[i].item_id == 0) {
-        if (SQL_ERROR == Sql_Query(sql_handle,
-                                   "DELETE FROM `ClanBanks` WHERE `CbkClnId` = "
-                                   "'%u' AND `CbkPosition` = '%d'",
-                                   id, i)) {
-          Sql_ShowDebug(sql_handle);
-          return 0;
-        }
-      } else {
-        if (SQL_ERROR ==
-            Sql_Query(
-                sql_handle,
-                "UPDATE `ClanBanks` SET `CbkItmId` = '%u', `CbkAmount` = '%u', "
-                "`CbkChaIdOwner` = '%u', `CbkTimer` = '%u', `CbkEngrave` = "
-                "'%s', `CbkCustomLook` = '%u', `CbkCustomLookColor` = '%u', "
-                "`CbkCustomIcon` = '%u', `CbkCustomIconColor` = '%u', "
-                "`CbkProtected` = '%d', `CbkNote` = '%s' WHERE `CbkClnId` = "
-                "'%u' AND `CbkPosition` = '%d'",
-                clan->clanbanks[i].item_id, clan->clanbanks[i].amount,
-                clan->clanbanks[i].owner, clan->clanbanks[i].time, escape,
-                clan->clanbanks[i].customLook,
-                clan->clanbanks[i].customLookColor,
-                clan->clanbanks[i].customIcon,
-                clan->clanbanks[i].customIconColor,
-                clan->clanbanks[i].protected, escape2, id, i)) {
-          Sql_ShowDebug(sql_handle);
-          return 0;
-        }
-      }
-    } else {
-      if (clan->clanbanks[i].item_id > 0) {
-        if (SQL_ERROR ==
-            Sql_Query(sql_handle,
-                      "INSERT INTO `ClanBanks` (`CBkClnId`, `CbkItmId`, "
-                      "`CbkAmount`, `CbkChaIdOwner`, `CbkTimer`, `CbkEngrave`, "
-                      "`CbkCustomLook`, `CbkCustomLookColor`, `CbkCustomIcon`, "
-                      "`CbkCustomIconColor`, `CbkProtected`, `CbkNote`, "
-                      "`CbkPosition`) VALUES ('%u', '%u', '%u', '%u', '%u', "
-                      "'%s', '%u', '%u', '%u', '%u', '%d', '%s', '%d')",
-                      id, clan->clanbanks[i].item_id, clan->clanbanks[i].amount,
-                      clan->clanbanks[i].owner, clan->clanbanks[i].time, escape,
-                      clan->clanbanks[i].customLook,
-                      clan->clanbanks[i].customLookColor,
-                      clan->clanbanks[i].customIcon,
-                      clan->clanbanks[i].customIconColor,
-                      clan->clanbanks[i].protected, escape2, i)) {
-          Sql_ShowDebug(sql_handle);
-          return 0;
-        }
-      }
-    }
-  }
-
+    struct clan_bank* bank = &clan->clanbanks[i];
+
+    if (bank->item_id == 0) continue;
+
+    Sql_EscapeString(sql_handle, escape, bank->real_name);
+    Sql_EscapeString(sql_handle, escape2, bank->note);
+    StringBuf_Printf(&rows,
+                     "%s('%u', '%u', '%u', '%u', '%u', '%s', '%u', '%u', '%u', "
+                     "'%u', '%d', '%s', '%d')",
+                     n ? ", " : "", id, bank->item_id, bank->amount,
+                     bank->owner, bank->time, escape, bank->customLook,
+                     bank->customLookColor, bank->customIcon,
+                     bank->customIconColor, bank->protected, escape2, i);
+    StringBuf_Printf(&kept, "%s'%d'", n ? ", " : "", i);
+    n++;
+  }
+
+  snprintf(key, sizeof(key), "clanbank:%d:del", id);
+  if (n)
+    map_dbwrite(key,
+                "DELETE FROM `ClanBanks` WHERE `CbkClnId` = '%u' AND "
+                "`CbkPosition` NOT IN (%s)",
+                id, StringBuf_Value(&kept));
+  else
+    map_dbwrite(key, "DELETE FROM `ClanBanks` WHERE `CbkClnId` = '%u'", id);
+
+  if (n) {
+    snprintf(key, sizeof(key), "clanbank:%d:put", id);
+    map_dbwrite(key,
+                "INSERT INTO `ClanBanks` (`CBkClnId`, `CbkItmId`, "
+                "`CbkAmount`, `CbkChaIdOwner`, `CbkTimer`, `CbkEngrave`, "
+                "`CbkCustomLook`, `CbkCustomLookColor`, `CbkCustomIcon`, "
+                "`CbkCustomIconColor`, `CbkProtected`, `CbkNote`, "
+                "`CbkPosition`) VALUES %s ON DUPLICATE KEY UPDATE "
+                "`CbkItmId` = VALUES(`CbkItmId`), "
+                "`CbkAmount` = VALUES(`CbkAmount`), "
+                "`CbkChaIdOwner` = VALUES(`CbkChaIdOwner`), "
+                "`CbkTimer` = VALUES(`CbkTimer`), "
+                "`CbkEngrave` = VALUES(`CbkEngrave`), "
+                "`CbkCustomLook` = VALUES(`CbkCustomLook`), "
+                "`CbkCustomLookColor` = VALUES(`CbkCustomLookColor`), "
+                "`CbkCustomIcon` = VALUES(`CbkCustomIcon`), "
+                "`CbkCustomIconColor` = VALUES(`CbkCustomIconColor`), "
+                "`CbkProtected` = VALUES(`CbkProtected`), "
+                "`CbkNote` = VALUES(`CbkNote`)",
+                StringBuf_Value(&rows));
+  }
+
+  StringBuf_Destroy(&rows);
+  StringBuf_Destroy(&kept);
   return 1;
 }
 
@@ -2512,6 +2355,8 @@ int map_weather(int id, int n) {
 int map_cronjob(int none, int nonetoo) {
   unsigned int t = time(NULL);
 
+  map_sweep(gettick());
+
   if (t % 60 == 0) {
     sl_doscript_blargs("cronJobMin", NULL, 0);
   }
@@ -2538,14 +2383,12 @@ int map_cronjob(int none, int nonetoo) {
 }
 
 int map_savechars(int none, int nonetoo) {
-  USER* sd = NULL;
-  int x;
+  USER* users[MAX_SESSIONS];
+  int x, n;
 
-  for (x = 0; x < fd_max; x++) {
-    if (rust_session_exists(x) && (sd = (USER*)rust_session_get_data(x)) &&
-        !rust_session_get_eof(x)) {
-      intif_save(sd);
-    }
+  n = map_online_users(-1, (struct block_list**)users, MAX_SESSIONS);
+  for (x = 0; x < n; x++) {
+    if (!rust_session_get_eof(users[x]->fd)) intif_save(users[x]);
   }
   return 0;
 }
@@ -176,10 +176,13 @@ struct mobdb_data {
 struct mobspawn_data {
   struct block_list bl;
   struct skill_info da[MAX_MAGIC_TIMERS];
-  struct item inventory[MAX_INVENTORY];
+  // MAX_INVENTORY items, NULL until something is given to the mob
+  // (rust_mob_inventory allocates)
+  struct item *inventory;
   struct mobdb_data *data;
   struct threat_table threat[MAX_THREATCOUNT];
-  struct global_reg registry[MAX_GLOBALMOBREG];
+  // MAX_GLOBALMOBREG entries, NULL until the first registry write
+  struct global_reg *registry;
   struct gfxViewer gfx;
   unsigned short startm, startx, starty, bx, by, look;
   short miss, protection;
@@ -257,6 +260,7 @@ struct map_sessiondata {
   unsigned char confused, talktype, pickuptype, invslot, equipslot, spottraps;
   unsigned short throwx, throwy, viewx, viewy, bindmap;
   char EncHash[0x401];
+  struct CryptKeyCache EncKeys;  // generate_key2 results for EncHash
 
   // npc
   int npc_id, npc_pos, npc_lastpos, npc_menu, npc_amount, npc_g, npc_gc, target,
@@ -272,8 +276,11 @@ struct map_sessiondata {
   unsigned int group_leader;  //, group[MAX_GROUP];
   // exchange
   int exchange_on;
+  // exchange.item and boditems.item hold 52 items while an exchange or a
+  // break-on-death pass is under way, NULL otherwise
+  // (rust_pc_exchange_items / rust_pc_bod_items allocate)
   struct {
-    struct item item[52];
+    struct item *item;
     int item_count, exchange_done, list_count;
     unsigned int gold, target;
   } exchange;
@@ -282,7 +289,7 @@ struct map_sessiondata {
   } state;
 
   struct {
-    struct item item[52];
+    struct item *item;
     int bod_count;
   } boditems;
 
@@ -293,7 +300,8 @@ struct map_sessiondata {
   int creation_works, creation_item, creation_itemamount;
   // boards
   int board_candel, board_canwrite, board, board_popup, co_timer;
-  char question[64], speech[255], profilepic_data[65535], profile_data[255];
+  char question[64], speech[255], profile_data[255];
+  char *profilepic_data;  // 65535 bytes once a picture is uploaded
   unsigned short profilepic_size;
   unsigned char profile_size;
   // mob
@@ -378,6 +386,7 @@ struct game_data {
 #define OBJ_LEFT 8
 
 extern unsigned char *objectFlags;
+extern int objectFlagsCount;
 
 struct flooritem_data {
   struct block_list bl;
@@ -414,6 +423,7 @@ struct npc_chardata *map_id2cnpc(unsigned int);
 
 void map_clritem();
 void map_delitem(unsigned int);
+void map_freebl(struct block_list *);
 void map_additem(struct block_list *);
 void map_deliddb(struct block_list *);
 void map_addiddb(struct block_list *);
@@ -426,6 +436,80 @@ void map_termblock();
 void map_initblock();
 int map_addblock(struct block_list *);
 int map_delblock(struct block_list *);
+// Dense online-player indexes kept by the Rust block grid (src/ffi/block.rs).
+// map_online_users snapshots players on map m (or everyone when m < 0).
+void map_online_add(struct block_list *);
+void map_online_del(struct block_list *);
+int map_online_users(int m, struct block_list **buf, int buf_len);
+int map_online_count(int m);
+// Mob tick scheduler (src/game/mob_sched.rs): registers BL_MOB entries as
+// they enter and leave id_db.
+void rust_mob_sched_add(struct block_list *);
+void rust_mob_sched_del(struct block_list *);
+// NPC timer queue (src/game/npc_sched.rs): same, for BL_NPC entries.
+void rust_npc_timers_add(struct block_list *);
+void rust_npc_timers_del(struct block_list *);
+// Walk look sets (src/game/aoi.rs): which entities a player's client has
+// been shown, so scrolled-in strips only send looks for new ones.
+int rust_aoi_collect_entering(struct block_list *sd, int vx, int vy, int x0,
+                              int y0, int x1, int y1, struct block_list **buf,
+                              int cap);
+void rust_aoi_reset(struct block_list *sd);
+// Registry indexes (src/game/reg_index.rs): rust_reg_intern turns a registry
+// name into an id for pc_readglobalreg_id/mob_readglobalreg_id; the index
+// of a player or mob is dropped as it enters and leaves id_db.
+int rust_reg_intern(const char *reg);
+void rust_reg_index_reset(struct block_list *bl);
+// Cold sub-structures (src/game/cold.rs). The getters allocate on first use
+// and return NULL only if that fails; the frees may be called on NULL.
+struct item *rust_mob_inventory(struct mobspawn_data *mob);
+void rust_mob_cold_free(struct mobspawn_data *mob);
+struct item *rust_pc_exchange_items(struct map_sessiondata *sd);
+void rust_pc_exchange_free(struct map_sessiondata *sd);
+struct item *rust_pc_bod_items(struct map_sessiondata *sd);
+void rust_pc_bod_free(struct map_sessiondata *sd);
+char *rust_pc_profilepic(struct map_sessiondata *sd);
+void rust_pc_cold_free(struct map_sessiondata *sd);
+// Per-tick move packet queue (src/game/move_bundle.rs). clif_mob_move and
+// clif_npc_move queue here; clif_flush_moves writes the queue out.
+struct pending_move {
+  unsigned int id;
+  unsigned short x, y;
+  unsigned char side;
+};
+void rust_move_queue(int fd, unsigned int owner, unsigned int id,
+                     unsigned short x, unsigned short y, unsigned char side);
+int rust_move_take(int *fd, unsigned int *owner, struct pending_move *buf,
+                   int cap);
+int rust_move_take_fd(int fd, unsigned int *owner, struct pending_move *buf,
+                      int cap);
+int rust_move_pending(void);
+// Floor item expiry (src/game/item_sweep.rs), fed by map_sweepadd.
+int rust_sweep_add(unsigned int id, unsigned int now, unsigned int sweeptime);
+int rust_sweep_del(unsigned int id);
+int rust_sweep_due(unsigned int now, unsigned int *buf, int cap);
+// Per-map cost scopes (src/game/map_cost.rs); every enter needs its leave.
+enum { MAP_COST_MOB, MAP_COST_NPC, MAP_COST_SEND, MAP_COST_LUA };
+void rust_map_cost_enter(int m, int kind);
+void rust_map_cost_leave(int packets);
+// Typed spatial queries (src/game/block_query.rs). `type` is a BL_* mask and
+// `area` a map_parse.h send mode (AREA, SAMEAREA, CORNER, SAMEMAP). Matches
+// are collected first, then `fn(bl, ctx)` runs on each one still in the
+// grid, so it may move, remove or query entities; the sum of its results is
+// returned. The collect variants copy at most `cap` matches into `buf` and
+// return the count, for callers that batch their work.
+typedef int (*bl_visit_fn)(struct block_list *bl, void *ctx);
+int map_query_area(int m, int x, int y, int area, int type, bl_visit_fn fn,
+                   void *ctx);
+int map_query_block(int m, int x0, int y0, int x1, int y1, int type,
+                    bl_visit_fn fn, void *ctx);
+int map_query_cell(int m, int x, int y, int type, int traps, bl_visit_fn fn,
+                   void *ctx);
+int map_collect_area(int m, int x, int y, int area, int type,
+                     struct block_list **buf, int cap);
+int map_collect_block(int m, int x0, int y0, int x1, int y1, int type,
+                      struct block_list **buf, int cap);
+// Variadic adapters over map_query_*.
 int map_foreachincell(int (*)(struct block_list *, va_list), int, int, int, int,
                       ...);
 int map_foreachincellwithtraps(int (*)(struct block_list *, va_list), int, int,
@@ -452,6 +536,11 @@ int map_canmove(int, int, int);
 int map_addspawn(struct mobspawn_data *);
 int map_removespawn(struct mobspawn_data *);
 struct block_list *map_id2bl(unsigned int id);
+// Generation of the entity now holding `id`, and a lookup that misses once
+// the id has been given to another entity (see the id slabs in map_server.c)
+unsigned int map_id_gen(unsigned int id);
+struct block_list *map_id2bl_gen(unsigned int id, unsigned int gen);
+int map_iddb_count(int type);
 int map_sweepadd(struct flooritem_data *);
 int map_sweepdel(struct flooritem_data *);
 int map_moveblock(struct block_list *, int, int);
@@ -467,6 +556,7 @@ int map_adduserlist(struct map_sessiondata *);
 int map_deluserlist(struct map_sessiondata *);
 int lang_read(const char *);
 int map_changepostcolor(int, int, int);
+int map_boardchanged(int);
 int map_getpostcolor(int, int);
 char *map_id2name(unsigned int);
 void help_screen();
@@ -507,4 +597,5 @@ int nmail_sendmessage(USER *, char *, int, int);
 int boards_delete(USER *, int);
 int nmail_write(USER *);
 int map_lastdeath_mob(MOB *p);
+void map_dbwrite(const char *key, const char *fmt, ...);
 int map_saveclanbank(int id);
\ No newline at end of file
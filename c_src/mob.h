@@ -40,6 +40,7 @@ int rust_mob_warp(MOB*, int, int, int);
 unsigned int* rust_mobspawn_onetime(unsigned int, int, int, int, int, int, int,
                                     unsigned int, unsigned int);
 int rust_mob_readglobalreg(MOB*, const char*);
+int rust_mob_readglobalreg_id(MOB*, int);
 int rust_mob_setglobalreg(MOB*, const char*, int);
 int rust_mob_drops(MOB*, void* /*USER**/);
 int rust_mob_handle_sub(MOB*);
@@ -55,6 +56,7 @@ static inline unsigned int* mobspawn_onetime(unsigned int id, int m, int x, int
   return rust_mobspawn_onetime(id, m, x, y, t, s, e, r, o);
 }
 static inline int mob_readglobalreg(MOB* m, const char* r) { return rust_mob_readglobalreg(m, r); }
+static inline int mob_readglobalreg_id(MOB* m, int id)     { return rust_mob_readglobalreg_id(m, id); }
 static inline int mob_setglobalreg(MOB* m, const char* r, int v) { return rust_mob_setglobalreg(m, r, v); }
 static inline int mobdb_drops(MOB* m, USER* sd)         { return rust_mob_drops(m, (void*)sd); }
 static inline int mob_handle_sub(MOB* m)                { return rust_mob_handle_sub(m); }
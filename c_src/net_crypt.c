@@ -16,28 +16,30 @@ int encrypt(int fd) {
   USER *sd = rust_session_get_data(fd);
 
   if (sd == NULL) {
-    printf("[encrypt] sd is NULL for fd=%d\n", fd);
+    log_error("[encrypt] sd is NULL for fd=%d\n", fd);
     fflush(stdout);
     return 1;
   }
 
   unsigned char *buf = (unsigned char *)WFIFOP(fd, 0);
   if (!buf) {
-    printf("[encrypt] WFIFOP returned NULL for fd=%d\n", fd);
+    log_error("[encrypt] WFIFOP returned NULL for fd=%d\n", fd);
     fflush(stdout);
     return 1;
   }
 
+  uint64_t started = rust_opcode_clock();
   set_packet_indexes(buf);
 
   if (is_key_server(buf[3])) {
     char key[10];
-    generate_key2(buf, sd->EncHash, key, 0);
+    generate_key2_cached(buf, sd->EncHash, &sd->EncKeys, key, 0);
     tk_crypt_dynamic(buf, key);
   } else {
     tk_crypt_static(buf);
   }
   int pkt_len = (int)SWAP16(*(unsigned short *)(buf + 1)) + 3;
+  rust_opcode_out(buf[3], pkt_len, started);
   return pkt_len;
 }
 
@@ -48,7 +50,7 @@ int decrypt(int fd) {
 
   if (is_key_client(RFIFOB(fd, 3))) {
     char key[10];
-    generate_key2((unsigned char *)RFIFOP(fd, 0), sd->EncHash, key, 1);
+    generate_key2_cached((unsigned char *)RFIFOP(fd, 0), sd->EncHash, &sd->EncKeys, key, 1);
     tk_crypt_dynamic((unsigned char *)RFIFOP(fd, 0), key);
   } else {
     tk_crypt_static((unsigned char *)RFIFOP(fd, 0));
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define SWAP16(x) (short)(((x) << 8) | ((x) >> 8))
 #define SWAP32(x) \
@@ -9,12 +10,18 @@
 #define RAND_INC rand() % 0xFF
 
 /* ── Rust crypto primitives — explicit declarations (mirrors yuri.h) ─────── */
+struct CryptKeyCache;
+
 bool   rust_crypt_is_key_client(int opcode);
 bool   rust_crypt_is_key_server(int opcode);
 char  *rust_crypt_generate_hashvalues(const char *name, char *buffer, int buflen);
 char  *rust_crypt_populate_table(const char *name, char *table, int tablelen);
 int    rust_crypt_set_packet_indexes(unsigned char *packet);
 char  *rust_crypt_generate_key2(unsigned char *packet, const char *table, char *keyout, int fromclient);
+char  *rust_crypt_generate_key2_cached(unsigned char *packet, const char *table,
+                                       struct CryptKeyCache *cache, char *keyout, int fromclient);
+void   rust_crypt_key_cache_reset(struct CryptKeyCache *cache);
+void   rust_crypt_key_cache_totals(uint64_t *hits, uint64_t *misses);
 void   rust_crypt_dynamic(unsigned char *buff, const char *key);
 void   rust_crypt_static(unsigned char *buff, const char *xor_key);
 
@@ -38,6 +45,10 @@ static inline int set_packet_indexes(unsigned char *pkt) {
 static inline char *generate_key2(unsigned char *pkt, char *table, char *key, int fc) {
     return rust_crypt_generate_key2(pkt, table, key, fc);
 }
+static inline char *generate_key2_cached(unsigned char *pkt, char *table,
+                                         struct CryptKeyCache *cache, char *key, int fc) {
+    return rust_crypt_generate_key2_cached(pkt, table, cache, key, fc);
+}
 static inline void tk_crypt_dynamic(unsigned char *buff, const char *key) {
     rust_crypt_dynamic(buff, key);
 }
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include "net_crypt.h"
+#include "session.h"
+
+// Typed builder for outgoing 0xAA packets.
+//
+// pkt_begin pins the session's write span and hands back a pointer into it,
+// so fields are stored straight into wdata with no per-field span lookup and
+// no staging buffer. The length word is filled in from the bytes actually
+// written and the sequence byte is stamped from the session counter
+// (pkt_begin_noseq leaves it 0, for senders that never stamped it).
+// pkt_begin_buf builds the same layout into a caller buffer for packets that
+// go out through clif_send (broadcast fan-out needs one shared copy).
+//
+// The span stays pinned from pkt_begin until pkt_send, which releases it on
+// every path: WFIFOSET unpins after committing, and a packet that overflowed
+// is dropped with rust_session_end_write. A packet that is started but not
+// sent must be released with pkt_cancel. A pkt_begin that fails holds no pin.
+//
+//   struct pkt_writer w;
+//   if (pkt_begin(&w, sd->fd, 0x0C, 9) == 0) {
+//     pkt_u32(&w, mob->bl.id);
+//     ...
+//     pkt_send(&w);
+//   }
+//
+// Multi-byte fields are written big-endian, i.e. what SWAP16/SWAP32 produce.
+
+#define PKT_HEADER_LEN 5   // 0xAA, length (BE16), opcode, sequence
+#define PKT_TRAILER_LEN 3  // key bytes appended by set_packet_indexes
+
+struct pkt_writer {
+  int fd;            // owning session, or -1 for a caller buffer
+  unsigned char *p;  // packet start; NULL if pkt_begin failed
+  size_t cap;        // bytes writable at p, trailer excluded
+  size_t pos;        // next write offset
+  int overflow;      // a field did not fit; the packet is dropped
+};
+
+static inline void pkt_header(struct pkt_writer *w, unsigned char opcode,
+                              unsigned char seq) {
+  w->p[0] = 0xAA;
+  w->p[3] = opcode;
+  w->p[4] = seq;
+  w->pos = PKT_HEADER_LEN;
+  w->overflow = 0;
+}
+
+// Start a packet of `body` bytes (everything after the sequence byte) in
+// fd's write buffer with the sequence byte left 0 and the session counter
+// untouched. Only for the position packets (0x04), which never carried a
+// sequence number. Returns 0, or -1 if the session is gone.
+static inline int pkt_begin_noseq(struct pkt_writer *w, int fd,
+                                  unsigned char opcode, size_t body) {
+  size_t span = 0;
+
+  w->fd = fd;
+  w->p = rust_session_begin_write(fd, PKT_HEADER_LEN + body + PKT_TRAILER_LEN,
+                                  &span);
+  if (!w->p || span < PKT_HEADER_LEN + PKT_TRAILER_LEN) {
+    if (w->p) rust_session_end_write(fd, 0);
+    w->p = NULL;
+    return -1;
+  }
+  w->cap = span - PKT_TRAILER_LEN;
+  pkt_header(w, opcode, 0);
+  return 0;
+}
+
+// Same, stamping the sequence byte from the session counter like
+// WFIFOHEADER. Returns 0, or -1 if the session is gone.
+static inline int pkt_begin(struct pkt_writer *w, int fd, unsigned char opcode,
+                            size_t body) {
+  if (pkt_begin_noseq(w, fd, opcode, body) != 0) return -1;
+  w->p[4] = rust_session_increment(fd);
+  return 0;
+}
+
+// Start a packet in `buf` (`cap` bytes) for clif_send. The sequence byte is
+// left 0: one buffer is shared by every recipient.
+static inline void pkt_begin_buf(struct pkt_writer *w, unsigned char *buf,
+                                 size_t cap, unsigned char opcode) {
+  w->fd = -1;
+  w->p = buf;
+  w->cap = cap - PKT_TRAILER_LEN;
+  pkt_header(w, opcode, 0);
+}
+
+static inline unsigned char *pkt_reserve(struct pkt_writer *w, size_t n) {
+  unsigned char *at;
+
+  if (!w->p || w->overflow || w->pos + n > w->cap) {
+    w->overflow = 1;
+    return NULL;
+  }
+  at = w->p + w->pos;
+  w->pos += n;
+  return at;
+}
+
+static inline void pkt_u8(struct pkt_writer *w, unsigned int v) {
+  unsigned char *at = pkt_reserve(w, 1);
+  if (at) at[0] = (unsigned char)v;
+}
+
+static inline void pkt_u16(struct pkt_writer *w, unsigned int v) {
+  unsigned char *at = pkt_reserve(w, 2);
+  if (!at) return;
+  at[0] = (unsigned char)(v >> 8);
+  at[1] = (unsigned char)v;
+}
+
+static inline void pkt_u32(struct pkt_writer *w, unsigned int v) {
+  unsigned char *at = pkt_reserve(w, 4);
+  if (!at) return;
+  at[0] = (unsigned char)(v >> 24);
+  at[1] = (unsigned char)(v >> 16);
+  at[2] = (unsigned char)(v >> 8);
+  at[3] = (unsigned char)v;
+}
+
+// `n` zero bytes, for packets whose declared length runs past their fields.
+static inline void pkt_zero(struct pkt_writer *w, size_t n) {
+  unsigned char *at = pkt_reserve(w, n);
+  if (at) memset(at, 0, n);
+}
+
+// Fill in the length word. Returns the packet length (header included),
+// or -1 if the packet overflowed or never started.
+static inline int pkt_end(struct pkt_writer *w) {
+  size_t len;
+
+  if (!w->p || w->overflow) return -1;
+  len = w->pos - 3;
+  w->p[1] = (unsigned char)(len >> 8);
+  w->p[2] = (unsigned char)len;
+  return (int)w->pos;
+}
+
+// Drop a pkt_begin packet without sending it and release the pin.
+static inline void pkt_cancel(struct pkt_writer *w) {
+  if (w->fd >= 0 && w->p) rust_session_end_write(w->fd, 0);
+  w->p = NULL;
+}
+
+// Finish, encrypt and commit a pkt_begin packet, releasing the pin either
+// way. Returns 0 or -1.
+static inline int pkt_send(struct pkt_writer *w) {
+  if (w->fd < 0) return -1;
+  if (pkt_end(w) < 0) {
+    if (w->p && w->overflow)
+      printf("[packet] opcode 0x%02X overflowed fd=%d\n", w->p[3], w->fd);
+    pkt_cancel(w);
+    return -1;
+  }
+  return WFIFOSET(w->fd, encrypt(w->fd));
+}
@@ -8,7 +8,7 @@
 /* pc game logic — implemented in Rust (src/game/pc.rs) */
 
 /* ── timer callbacks ───────────────────────────────────────────────────────── */
-int rust_pc_item_timer(int id, int none);
+int rust_pc_item_timer(int id, int gen);
 int rust_pc_savetimer(int id, int none);
 int rust_pc_castusetimer(int id, int none);
 int rust_pc_afktimer(int id, int none);
@@ -18,7 +18,7 @@ int rust_pc_atkspeed(int id, int none);
 int rust_pc_disptimertick(int id, int none);
 int rust_pc_sendpong(int id, int none);  /* timer callback; C still defines pc_sendpong in map_parse.c */
 
-static inline int pc_item_timer(int id, int n)      { return rust_pc_item_timer(id, n); }
+static inline int pc_item_timer(int id, int g)      { return rust_pc_item_timer(id, g); }
 static inline int pc_timer(int id, int n)           { return rust_pc_timer(id, n); }
 static inline int pc_scripttimer(int id, int n)     { return rust_pc_scripttimer(id, n); }
 static inline int pc_atkspeed(int id, int n)        { return rust_pc_atkspeed(id, n); }
@@ -84,9 +84,11 @@ static inline int   pc_setglobalregstring(USER *sd, const char *r, const char *v
 
 /* ── registry (global int) ─────────────────────────────────────────────────── */
 int rust_pc_readglobalreg(USER *sd, const char *reg);
+int rust_pc_readglobalreg_id(USER *sd, int id);
 int rust_pc_setglobalreg(USER *sd, const char *reg, unsigned long val);
 
 static inline int pc_readglobalreg(USER *sd, const char *r)            { return rust_pc_readglobalreg(sd, r); }
+static inline int pc_readglobalreg_id(USER *sd, int id)                { return rust_pc_readglobalreg_id(sd, id); }
 static inline int pc_setglobalreg(USER *sd, const char *r, unsigned long v){ return rust_pc_setglobalreg(sd, r, v); }
 
 /* ── params ────────────────────────────────────────────────────────────────── */
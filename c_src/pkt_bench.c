@@ -0,0 +1,123 @@
+// Packet builder benchmark: the 0x0C mob move written with the old
+// WFIFOHEAD/WFIFOHEADER/WFIFOL code and with struct pkt_writer.
+//
+//   ./bin/pkt_bench [--json] [packets...]   (at most 250000 per run)
+//
+// Both sides build and commit the same 14 bytes into a session created with
+// rust_make_connection (never connected, so nothing is flushed). encrypt is
+// left out of both: it needs a logged-in USER and costs the same either way.
+// --json prints one JSON object per measurement instead of the table.
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "packet.h"
+
+// session.h routes printf through tracing; the report goes to stdout
+#undef printf
+
+#define MOVE_LEN 14
+// Packets per run that fit in one session's 4 MB write buffer
+#define MAX_PACKETS 250000
+
+static int json;
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char* bench, unsigned int n, double ns) {
+  double per = n ? ns / n : 0.0;
+
+  if (json) {
+    printf("{\"bench\":\"%s\",\"packets\":%u,\"ns_per_op\":%.1f}\n", bench, n,
+           per);
+  } else {
+    printf("%-14s %9u packets %10.1f ns/op %9.2f ms\n", bench, n, per,
+           ns / 1e6);
+  }
+}
+
+// A session with an empty write buffer; each run gets its own so wdata
+// never nears its size limit.
+static int bench_session(void) {
+  int fd = rust_make_connection(htonl(INADDR_LOOPBACK), 9);
+
+  if (fd < 0) {
+    fprintf(stderr, "pkt_bench: cannot create a session\n");
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+static void run_wfifo(unsigned int n) {
+  int fd = bench_session();
+  unsigned int i;
+  double t0 = now_ns();
+
+  for (i = 0; i < n; i++) {
+    WFIFOHEAD(fd, MOVE_LEN);
+    WFIFOHEADER(fd, 0x0C, 11);
+    WFIFOL(fd, 5) = SWAP32(0x40000000u + i);
+    WFIFOW(fd, 9) = SWAP16(i & 0xFF);
+    WFIFOW(fd, 11) = SWAP16((i >> 8) & 0xFF);
+    WFIFOB(fd, 13) = i & 3;
+    WFIFOSET(fd, MOVE_LEN);
+  }
+  report("wfifo", n, now_ns() - t0);
+  rust_session_set_eof(fd, 1);
+}
+
+static void run_pkt_writer(unsigned int n) {
+  int fd = bench_session();
+  unsigned int i;
+  struct pkt_writer w;
+  double t0 = now_ns();
+
+  for (i = 0; i < n; i++) {
+    if (pkt_begin(&w, fd, 0x0C, 9) != 0) {
+      fprintf(stderr, "pkt_bench: pkt_begin failed\n");
+      exit(EXIT_FAILURE);
+    }
+    pkt_u32(&w, 0x40000000u + i);
+    pkt_u16(&w, i & 0xFF);
+    pkt_u16(&w, (i >> 8) & 0xFF);
+    pkt_u8(&w, i & 3);
+    // pkt_send without encrypt
+    WFIFOSET(fd, pkt_end(&w));
+  }
+  report("pkt_writer", n, now_ns() - t0);
+  rust_session_set_eof(fd, 1);
+}
+
+int main(int argc, char** argv) {
+  int i, sized = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      json = 1;
+    }
+  }
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") != 0) {
+      unsigned int n = (unsigned int)atoi(argv[i]);
+
+      if (n > MAX_PACKETS) n = MAX_PACKETS;
+      run_wfifo(n);
+      run_pkt_writer(n);
+      sized = 1;
+    }
+  }
+  if (!sized) {
+    run_wfifo(100000);
+    run_pkt_writer(100000);
+  }
+  return 0;
+}
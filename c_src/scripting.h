@@ -18,6 +18,9 @@ extern int   rust_sl_doscript_blargs_vec(const char *root, const char *method,
 extern int   rust_sl_doscript_strings_vec(const char *root, const char *method,
                                            int nargs, const char **args);
 extern int   rust_sl_doscript_stackargs(const char *root, const char *method, int nargs);
+extern int   rust_sl_handle(const char *root, const char *method);
+extern int   rust_sl_doscript_handle_vec(int handle, int nargs, struct block_list **args);
+extern void  rust_sl_release_bl(struct block_list *bl);
 extern int   rust_sl_updatepeople(struct block_list *bl, void *ap);
 extern void  rust_sl_resumemenu(unsigned int id, void *sd);
 extern void  rust_sl_resumemenuseq(unsigned int id, int choice, void *sd);
@@ -38,9 +41,20 @@ static inline int sl_reload(lua_State *L) {
     (void)L; return rust_sl_reload();
 }
 
+/* sl_doscript_* return 1 if the handler ran, 0 if there is none, and
+ * SL_QUEUED when called off the game loop thread: the call was queued for
+ * the next tick and has not run yet. */
+#define SL_QUEUED (-1)
+
 extern int   sl_doscript_blargs(const char *root, const char *method, int nargs, ...);
 extern int   sl_doscript_strings(const char *root, const char *method, int nargs, ...);
 
+/* Script handles: resolve root.method (method may be NULL) once, keep the
+ * handle in a static and dispatch by it. The function behind a handle is
+ * cached until the next sl_reload. */
+#define sl_handle(root, method)        rust_sl_handle(root, method)
+extern int   sl_doscript_handle(int handle, int nargs, ...);
+
 #define sl_doscript_stackargs(r,m,n)   rust_sl_doscript_stackargs(r,m,n)
 extern int   sl_updatepeople(struct block_list *bl, void *ap);
 #define sl_resumemenu(id, sd)          rust_sl_resumemenu(id, sd)
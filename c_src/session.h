@@ -6,16 +6,13 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include "log.h"
 #include "yuri.h"
 #include "net_crypt.h"
 
-// Route all C printf() calls through Rust's tracing system for unified output.
-// snprintf into a fixed buffer then hand off to rust_log_c(level=2 = INFO).
-#define printf(fmt, ...) do { \
-    char _log_buf_[2048]; \
-    snprintf(_log_buf_, sizeof(_log_buf_), fmt, ##__VA_ARGS__); \
-    rust_log_c(2, _log_buf_); \
-} while(0)
+// Route all C printf() calls through Rust's tracing system for unified output,
+// as INFO lines (see log.h).
+#define printf(fmt, ...) log_info(fmt, ##__VA_ARGS__)
 
 #ifdef __INTERIX
 #define FD_SETSIZE 4096
@@ -25,21 +22,42 @@
 
 extern int fd_max;
 
+// Span lookups for the FIFO macros. When the session's buffer is pinned
+// (rust_session_begin_read/begin_write, or implicitly by session_io_task and
+// WFIFOHEAD) the access is a bounds check plus an index into the span Rust
+// published in rust_session_spans. Otherwise, or when the access runs past
+// the span, fall back to the locked FFI path which also grows wdata.
+static inline unsigned char *session_rspan(int fd, size_t pos, size_t width) {
+  if ((unsigned)fd < SESSION_SPAN_SLOTS) {
+    const SessionSpan *s = &rust_session_spans[fd];
+    if (s->rdata && pos + width <= s->rlen) return (unsigned char *)s->rdata + pos;
+  }
+  return (unsigned char *)rust_session_rdata_ptr(fd, pos);
+}
+
+static inline unsigned char *session_wspan(int fd, size_t pos, size_t width) {
+  if ((unsigned)fd < SESSION_SPAN_SLOTS) {
+    const SessionSpan *s = &rust_session_spans[fd];
+    if (s->wdata && pos + width <= s->wlen) return s->wdata + pos;
+  }
+  return rust_session_wdata_ptr(fd, pos);
+}
+
 // Buffer access macros - Rust-backed via FFI
-#define RFIFOP(fd, pos)  ((unsigned char *)rust_session_rdata_ptr((fd), (pos)))
-#define RFIFOB(fd, pos)  (*(unsigned char *)rust_session_rdata_ptr((fd), (pos)))
-#define RFIFOW(fd, pos)  (*(unsigned short *)rust_session_rdata_ptr((fd), (pos)))
-#define RFIFOL(fd, pos)  (*(unsigned int *)rust_session_rdata_ptr((fd), (pos)))
+#define RFIFOP(fd, pos)  session_rspan((fd), (pos), 1)
+#define RFIFOB(fd, pos)  (*(unsigned char *)session_rspan((fd), (pos), 1))
+#define RFIFOW(fd, pos)  (*(unsigned short *)session_rspan((fd), (pos), 2))
+#define RFIFOL(fd, pos)  (*(unsigned int *)session_rspan((fd), (pos), 4))
 #define RFIFOSKIP(fd, len) rust_session_skip((fd), (len))
 #define RFIFOREST(fd)    ((int)rust_session_available((fd)))
 #define RFIFOFLUSH(fd)   rust_session_rfifoflush((fd))
 #define RFIFOSPACE(fd)   (16 * 1024)
 #define WFIFOHEAD(fd, size) rust_session_wfifohead((fd), (size))
 #define WFIFOSPACE(fd)   (16 * 1024)
-#define WFIFOP(fd, pos)  ((char *)rust_session_wdata_ptr((fd), (pos)))
-#define WFIFOB(fd, pos)  (*(unsigned char *)rust_session_wdata_ptr((fd), (pos)))
-#define WFIFOW(fd, pos)  (*(unsigned short *)rust_session_wdata_ptr((fd), (pos)))
-#define WFIFOL(fd, pos)  (*(unsigned int *)rust_session_wdata_ptr((fd), (pos)))
+#define WFIFOP(fd, pos)  ((char *)session_wspan((fd), (pos), 1))
+#define WFIFOB(fd, pos)  (*(unsigned char *)session_wspan((fd), (pos), 1))
+#define WFIFOW(fd, pos)  (*(unsigned short *)session_wspan((fd), (pos), 2))
+#define WFIFOL(fd, pos)  (*(unsigned int *)session_wspan((fd), (pos), 4))
 #define WFIFOSET(fd, len) rust_session_commit((fd), (len))
 
 // Raw buffer macros - operate on arbitrary pointers, not sessions
@@ -70,7 +88,7 @@ static inline int null_parse(int fd) {
     rust_session_set_eof(fd, 1);
     return 0;
   }
-  printf("[session] null_parse fd=%d\n", fd);
+  log_warn("[session] null_parse fd=%d\n", fd);
   RFIFOSKIP(fd, RFIFOREST(fd));
   return 0;
 }
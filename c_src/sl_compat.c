@@ -17,6 +17,7 @@
 #include "clan_db.h"
 #include "config.h"
 #include "db_mysql.h"
+#include "ers.h"
 #include "mob.h"
 #include "npc.h"
 #include "pc.h"
@@ -56,6 +57,15 @@ int sl_doscript_blargs(const char *root, const char *method, int nargs, ...) {
     return rust_sl_doscript_blargs_vec(root, method, nargs, args);
 }
 
+int sl_doscript_handle(int handle, int nargs, ...) {
+    struct block_list *args[16] = {0};
+    va_list ap; va_start(ap, nargs);
+    for (int i = 0; i < nargs && i < 16; i++)
+        args[i] = va_arg(ap, struct block_list *);
+    va_end(ap);
+    return rust_sl_doscript_handle_vec(handle, nargs, args);
+}
+
 int sl_doscript_strings(const char *root, const char *method, int nargs, ...) {
     const char *args[16] = {0};
     va_list ap; va_start(ap, nargs);
@@ -225,19 +235,15 @@ int sl_g_setmap(int m, const char *mapfile, const char *title,
     map[m].indoor = indoor; map[m].warpout = warpout;
     map[m].bind = bind; map[m].reqlvl = reqlvl;
     map[m].reqvita = reqvita; map[m].reqmana = reqmana;
+    /* Tiles may be mapped from the map cache; never REALLOC them. Freed
+       while xs/ys still describe them. */
+    if (map_isloaded(m)) rust_map_free_tiles(m);
     fread(&buff, 2, 1, fp); map[m].xs = SWAP16(buff);
     fread(&buff, 2, 1, fp); map[m].ys = SWAP16(buff);
-    if (map_isloaded(m)) {
-        REALLOC(map[m].tile, unsigned short, map[m].xs * map[m].ys);
-        REALLOC(map[m].obj,  unsigned short, map[m].xs * map[m].ys);
-        REALLOC(map[m].map,  unsigned char,  map[m].xs * map[m].ys);
-        REALLOC(map[m].pass, unsigned short, map[m].xs * map[m].ys);
-    } else {
-        CALLOC(map[m].tile, unsigned short, map[m].xs * map[m].ys);
-        CALLOC(map[m].obj,  unsigned short, map[m].xs * map[m].ys);
-        CALLOC(map[m].map,  unsigned char,  map[m].xs * map[m].ys);
-        CALLOC(map[m].pass, unsigned short, map[m].xs * map[m].ys);
-    }
+    CALLOC(map[m].tile, unsigned short, map[m].xs * map[m].ys);
+    CALLOC(map[m].obj,  unsigned short, map[m].xs * map[m].ys);
+    CALLOC(map[m].map,  unsigned char,  map[m].xs * map[m].ys);
+    CALLOC(map[m].pass, unsigned short, map[m].xs * map[m].ys);
     map[m].bxs = (map[m].xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
     map[m].bys = (map[m].ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
     if (map_isloaded(m)) {
@@ -302,6 +308,7 @@ void sl_g_throw(int id, int m, int x, int y, int x2, int y2,
 void sl_g_sendmeta(void) {
     USER *tsd;
     int i;
+    map_meta_reload();
     for (i = 0; i < fd_max; i++) {
         if (rust_session_exists(i) && !rust_session_get_eof(i) &&
             (tsd = (USER*)rust_session_get_data(i)))
@@ -326,11 +333,11 @@ int sl_g_addmob(int m, int x, int y, int mobid) {
 int sl_g_checkonline_id(int id) {
     unsigned int cha_id = 0;
     int result = 0;
-    SqlStmt *stmt = SqlStmt_Malloc(sql_handle);
+    unsigned int uid = (unsigned)id;
+    SqlStmt *stmt = SqlStmt_Cached(sql_handle,
+        "SELECT `ChaId` FROM `Character` WHERE `ChaOnline`='1' AND `ChaId`=?");
     if (!stmt) return 0;
-    if (SQL_ERROR == SqlStmt_Prepare(stmt,
-        "SELECT `ChaId` FROM `Character` WHERE `ChaOnline`='1' AND `ChaId`='%u'",
-        (unsigned)id) ||
+    if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_UINT, &uid, 0) ||
         SQL_ERROR == SqlStmt_Execute(stmt) ||
         SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &cha_id, 0, NULL, NULL)) {
         SqlStmt_ShowDebug(stmt); SqlStmt_Free(stmt); return 0;
@@ -343,13 +350,11 @@ int sl_g_checkonline_id(int id) {
 int sl_g_checkonline_name(const char *name) {
     unsigned int cha_id = 0;
     int result = 0;
-    char esc[128] = {0};
-    SqlStmt *stmt = SqlStmt_Malloc(sql_handle);
+    SqlStmt *stmt = SqlStmt_Cached(sql_handle,
+        "SELECT `ChaId` FROM `Character` WHERE `ChaOnline`='1' AND `ChaName`=?");
     if (!stmt) return 0;
-    Sql_EscapeStringLen(sql_handle, esc, name, strnlen(name, 64));
-    if (SQL_ERROR == SqlStmt_Prepare(stmt,
-        "SELECT `ChaId` FROM `Character` WHERE `ChaOnline`='1' AND `ChaName`='%s'",
-        esc) ||
+    if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_STRING, (void *)name,
+                                       strnlen(name, 64)) ||
         SQL_ERROR == SqlStmt_Execute(stmt) ||
         SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &cha_id, 0, NULL, NULL)) {
         SqlStmt_ShowDebug(stmt); SqlStmt_Free(stmt); return 0;
@@ -362,12 +367,11 @@ int sl_g_checkonline_name(const char *name) {
 /* --- getOfflineID --- */
 int sl_g_getofflineid(const char *name) {
     unsigned int id = 0;
-    char esc[128] = {0};
-    SqlStmt *stmt = SqlStmt_Malloc(sql_handle);
+    SqlStmt *stmt = SqlStmt_Cached(sql_handle,
+        "SELECT `ChaId` FROM `Character` WHERE `ChaName`=?");
     if (!stmt) return 0;
-    Sql_EscapeStringLen(sql_handle, esc, name, strnlen(name, 64));
-    if (SQL_ERROR == SqlStmt_Prepare(stmt,
-        "SELECT `ChaId` FROM `Character` WHERE `ChaName`='%s'", esc) ||
+    if (SQL_ERROR == SqlStmt_BindParam(stmt, 0, SQLDT_STRING, (void *)name,
+                                       strnlen(name, 64)) ||
         SQL_ERROR == SqlStmt_Execute(stmt) ||
         SQL_ERROR == SqlStmt_BindColumn(stmt, 0, SQLDT_UINT, &id, 0, NULL, NULL)) {
         SqlStmt_ShowDebug(stmt); SqlStmt_Free(stmt); return 0;
@@ -1783,8 +1787,7 @@ int sl_g_getobjectsinmap(int m, int type, void **out_ptrs, int max_count) {
 void sl_g_addnpc(const char *name, int m, int x, int y, int subtype,
                  int timer, int duration, int owner, int movetime,
                  const char *npc_yname) {
-    struct npc_data *nd;
-    CALLOC(nd, struct npc_data, 1);
+    struct npc_data *nd = ers_pool_alloc(sizeof(struct npc_data));
     strncpy(nd->name,     name,                              sizeof(nd->name)     - 1);
     strncpy(nd->npc_name, npc_yname ? npc_yname : "nothing", sizeof(nd->npc_name) - 1);
     nd->bl.type        = BL_NPC;
@@ -1827,7 +1830,7 @@ void sl_g_delete_bl(void *bl_ptr) {
     map_deliddb(bl);
     if (bl->id > 0) {
         clif_lookgone(bl);
-        FREE(bl);
+        map_freebl(bl);
     }
 }
 
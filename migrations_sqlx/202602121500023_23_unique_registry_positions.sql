@@ -0,0 +1,19 @@
+-- Character saves upsert registry rows keyed on (character, position), like the
+-- other per-character tables already are. Drop any duplicate positions first,
+-- keeping the newest row.
+
+DELETE r1 FROM `Registry` r1
+  JOIN `Registry` r2 ON r1.`RegChaId` = r2.`RegChaId` AND r1.`RegPosition` = r2.`RegPosition` AND r1.`RegId` < r2.`RegId`;
+ALTER TABLE `Registry` ADD UNIQUE KEY `uq_char_position` (`RegChaId`, `RegPosition`);
+
+DELETE r1 FROM `RegistryString` r1
+  JOIN `RegistryString` r2 ON r1.`RegChaId` = r2.`RegChaId` AND r1.`RegPosition` = r2.`RegPosition` AND r1.`RegId` < r2.`RegId`;
+ALTER TABLE `RegistryString` ADD UNIQUE KEY `uq_char_position` (`RegChaId`, `RegPosition`);
+
+DELETE r1 FROM `NPCRegistry` r1
+  JOIN `NPCRegistry` r2 ON r1.`NrgChaId` = r2.`NrgChaId` AND r1.`NrgPosition` = r2.`NrgPosition` AND r1.`NrgId` < r2.`NrgId`;
+ALTER TABLE `NPCRegistry` ADD UNIQUE KEY `uq_char_position` (`NrgChaId`, `NrgPosition`);
+
+DELETE r1 FROM `QuestRegistry` r1
+  JOIN `QuestRegistry` r2 ON r1.`QrgChaId` = r2.`QrgChaId` AND r1.`QrgPosition` = r2.`QrgPosition` AND r1.`QrgId` < r2.`QrgId`;
+ALTER TABLE `QuestRegistry` ADD UNIQUE KEY `uq_char_position` (`QrgChaId`, `QrgPosition`);
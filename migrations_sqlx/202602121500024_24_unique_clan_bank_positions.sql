@@ -0,0 +1,6 @@
+-- Clan bank saves upsert rows keyed on (clan, position). Drop any duplicate
+-- positions first, keeping the newest row.
+
+DELETE b1 FROM `ClanBanks` b1
+  JOIN `ClanBanks` b2 ON b1.`CbkClnId` = b2.`CbkClnId` AND b1.`CbkPosition` = b2.`CbkPosition` AND b1.`CbkId` < b2.`CbkId`;
+ALTER TABLE `ClanBanks` ADD UNIQUE KEY `uq_clan_position` (`CbkClnId`, `CbkPosition`);
@@ -0,0 +1,11 @@
+-- Map and game registry writes are batched upserts keyed on the identifier
+-- (per map for MapRegistry). Drop duplicate identifiers first, keeping the
+-- newest row.
+
+DELETE r1 FROM `MapRegistry` r1
+  JOIN `MapRegistry` r2 ON r1.`MrgMapId` = r2.`MrgMapId` AND r1.`MrgIdentifier` = r2.`MrgIdentifier` AND r1.`MrgId` < r2.`MrgId`;
+ALTER TABLE `MapRegistry` ADD UNIQUE KEY `uq_map_identifier` (`MrgMapId`, `MrgIdentifier`);
+
+DELETE r1 FROM `GameRegistry0` r1
+  JOIN `GameRegistry0` r2 ON r1.`GrgIdentifier` = r2.`GrgIdentifier` AND r1.`GrgId` < r2.`GrgId`;
+ALTER TABLE `GameRegistry0` ADD UNIQUE KEY `uq_identifier` (`GrgIdentifier`);
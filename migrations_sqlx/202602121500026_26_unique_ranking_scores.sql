@@ -0,0 +1,7 @@
+-- Ranking scores are held in memory and saved as upserts keyed on the
+-- character's row in the event. Drop duplicate rows first, keeping the
+-- newest.
+
+DELETE r1 FROM `RankingScores` r1
+  JOIN `RankingScores` r2 ON r1.`EventId` = r2.`EventId` AND r1.`ChaId` = r2.`ChaId` AND r1.`Index` < r2.`Index`;
+ALTER TABLE `RankingScores` ADD UNIQUE KEY `uq_event_cha` (`EventId`, `ChaId`);
@@ -0,0 +1,45 @@
+-- Migration 25 keys GameRegistry0 only, but each map server reads and
+-- writes its own GameRegistry<server id>. Give every other per-server table
+-- the same unique identifier key, dropping duplicates newest-first. Tables
+-- added later should be created LIKE GameRegistry0, which carries the key.
+
+DROP PROCEDURE IF EXISTS `yuri_key_game_registries`;
+
+CREATE PROCEDURE `yuri_key_game_registries`()
+BEGIN
+  DECLARE done INT DEFAULT 0;
+  DECLARE tbl VARCHAR(64);
+  DECLARE cur CURSOR FOR
+    SELECT t.`TABLE_NAME` FROM information_schema.`TABLES` t
+     WHERE t.`TABLE_SCHEMA` = DATABASE()
+       AND t.`TABLE_NAME` REGEXP '^GameRegistry[0-9]+$'
+       AND NOT EXISTS (
+         SELECT 1 FROM information_schema.`STATISTICS` s
+          WHERE s.`TABLE_SCHEMA` = t.`TABLE_SCHEMA` AND s.`TABLE_NAME` = t.`TABLE_NAME`
+            AND s.`INDEX_NAME` = 'uq_identifier');
+  DECLARE CONTINUE HANDLER FOR NOT FOUND SET done = 1;
+
+  OPEN cur;
+  next_table: LOOP
+    FETCH cur INTO tbl;
+    IF done THEN
+      LEAVE next_table;
+    END IF;
+
+    SET @sql = CONCAT('DELETE r1 FROM `', tbl, '` r1 JOIN `', tbl, '` r2 ',
+                      'ON r1.`GrgIdentifier` = r2.`GrgIdentifier` AND r1.`GrgId` < r2.`GrgId`');
+    PREPARE stmt FROM @sql;
+    EXECUTE stmt;
+    DEALLOCATE PREPARE stmt;
+
+    SET @sql = CONCAT('ALTER TABLE `', tbl, '` ADD UNIQUE KEY `uq_identifier` (`GrgIdentifier`)');
+    PREPARE stmt FROM @sql;
+    EXECUTE stmt;
+    DEALLOCATE PREPARE stmt;
+  END LOOP;
+  CLOSE cur;
+END;
+
+CALL `yuri_key_game_registries`();
+
+DROP PROCEDURE `yuri_key_game_registries`;
@@ -62,6 +62,10 @@ async fn main() -> Result<()> {
 
     let bind_addr = format!("{}:{}", config.char_ip, config.char_port);
     let state = Arc::new(CharState::new(pool, config));
+    CharState::register_metrics(&state);
+    yuri::servers::char::hash_pool::start(&state.config);
+    yuri::metrics::spawn(&state.config.metrics_ip, state.config.char_metrics_port);
+    yuri::profiler::spawn_signal_trigger(yuri::profiler::Options::from_config(&state.config, "char"));
 
     // Spawn login server reconnect loop
     {
@@ -71,5 +75,20 @@ async fn main() -> Result<()> {
         });
     }
 
-    CharState::run(state, &bind_addr).await
+    // Commit queued saves before exiting on Ctrl-C or SIGTERM (systemd, docker)
+    let mut term = tokio::signal::unix::signal(tokio::signal::unix::SignalKind::terminate())
+        .context("Cannot install the SIGTERM handler")?;
+    tokio::select! {
+        r = CharState::run(Arc::clone(&state), &bind_addr) => r,
+        _ = tokio::signal::ctrl_c() => {
+            yuri::servers::char::map::flush_saves(&state).await;
+            tracing::info!("[char] [shutdown] queued saves committed");
+            Ok(())
+        }
+        _ = term.recv() => {
+            yuri::servers::char::map::flush_saves(&state).await;
+            tracing::info!("[char] [shutdown] SIGTERM, queued saves committed");
+            Ok(())
+        }
+    }
 }
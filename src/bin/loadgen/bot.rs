@@ -0,0 +1,324 @@
+//! One simulated client: log in through the login server, follow the
+//! redirect to a map server, then act out its profile until the run ends.
+
+use std::net::SocketAddr;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::tcp::OwnedWriteHalf;
+use tokio::net::TcpStream;
+use tokio::sync::mpsc;
+
+use crate::profile::{Action, Profile, Rng, LINES};
+use crate::proto::{self, Crypt};
+use crate::report::Stats;
+
+/// Longest wait for any one login-server reply.
+const REPLY_TIMEOUT: Duration = Duration::from_secs(10);
+/// Time between refresh probes, and how long one may go unanswered.
+const PROBE_EVERY: Duration = Duration::from_secs(2);
+const PROBE_TIMEOUT: Duration = Duration::from_secs(5);
+/// Ping (0x60) so idle bots look like idle clients.
+const PING_EVERY: Duration = Duration::from_secs(30);
+
+pub struct Config {
+    pub login: String,
+    pub version: u16,
+    pub prefix: String,
+    pub password: String,
+    /// Register and create the character before logging in
+    pub create: bool,
+    /// Connect here instead of where the login server redirects to
+    pub map_addr: Option<SocketAddr>,
+    pub profile: &'static Profile,
+    pub seed: u64,
+}
+
+/// Character name of bot `idx`: the prefix and the index in letters, since
+/// names may only hold letters. `main` keeps the prefix to 2..=8 letters.
+pub fn name(prefix: &str, idx: usize) -> String {
+    let mut digits = Vec::new();
+    let mut n = idx;
+    loop {
+        digits.push(b'a' + (n % 26) as u8);
+        n /= 26;
+        if n == 0 {
+            break;
+        }
+    }
+    let mut name = prefix.to_string();
+    name.extend(digits.iter().rev().map(|&d| d as char));
+    name
+}
+
+/// Run bot `idx` until `until`; failures are counted in `stats`.
+pub async fn run(idx: usize, cfg: Arc<Config>, stats: Arc<Stats>, until: Instant) {
+    let name = name(&cfg.prefix, idx);
+    let mut bot = Bot {
+        rng: Rng::new(cfg.seed, idx as u64),
+        seq: 0,
+        stats: stats.clone(),
+        profile: cfg.profile,
+        x: 0,
+        y: 0,
+        dir: 0,
+        walk_step: 0,
+    };
+    bot.dir = bot.rng.below(4) as u8;
+    let started = Instant::now();
+    let (redirect, xor) = match bot.login(&cfg, &name).await {
+        Ok(r) => r,
+        Err(e) => return stats.failed(format!("login: {e}"), false),
+    };
+    if let Err(e) = bot.play(&cfg, &name, redirect, &xor, started, until).await {
+        stats.failed(e, true);
+    }
+}
+
+struct Bot {
+    rng: Rng,
+    seq: u8,
+    stats: Arc<Stats>,
+    profile: &'static Profile,
+    /// Where the bot thinks it stands; the server corrects it with 0x04
+    x: u16,
+    y: u16,
+    dir: u8,
+    walk_step: u8,
+}
+
+type Res<T> = Result<T, String>;
+
+async fn reply(s: &mut TcpStream) -> Res<Vec<u8>> {
+    match tokio::time::timeout(REPLY_TIMEOUT, proto::read_packet(s)).await {
+        Ok(Ok(p)) => Ok(p),
+        Ok(Err(e)) => Err(e.to_string()),
+        Err(_) => Err("timed out".into()),
+    }
+}
+
+impl Bot {
+    fn trailer(&mut self) -> [u8; 3] {
+        let r = self.rng.next().to_le_bytes();
+        [r[0], r[1], r[2]]
+    }
+
+    fn seal(&mut self, c: &Crypt, op: u8, body: &[u8]) -> Vec<u8> {
+        self.seq = self.seq.wrapping_add(1);
+        let t = self.trailer();
+        c.seal(op, self.seq, body, t)
+    }
+
+    async fn send(&mut self, w: &mut (impl AsyncWriteExt + Unpin), op: u8, p: &[u8]) -> Res<()> {
+        w.write_all(p).await.map_err(|e| e.to_string())?;
+        self.stats.sent(op, p.len());
+        Ok(())
+    }
+
+    /// Login-server reply, decrypted; an error for any failure message.
+    async fn message(&mut self, s: &mut TcpStream, c: &Crypt, what: &str) -> Res<()> {
+        let mut p = reply(s).await.map_err(|e| format!("{what}: {e}"))?;
+        self.stats.recv(p[3], p.len());
+        c.open(&mut p);
+        match proto::message_code(&p) {
+            Some(0) => Ok(()),
+            Some(code) => Err(format!("{what}: code {code}")),
+            None => Err(format!("{what}: unexpected {:#04x}", p[3])),
+        }
+    }
+
+    /// Version check, optional register and create, and log in. Returns the
+    /// map-server redirect and the static key.
+    async fn login(&mut self, cfg: &Config, name: &str) -> Res<(proto::Redirect, Vec<u8>)> {
+        let mut s = TcpStream::connect(&cfg.login).await.map_err(|e| format!("connect: {e}"))?;
+        s.set_nodelay(true).ok();
+        let mut banner = [0u8; proto::BANNER_LEN];
+        tokio::time::timeout(REPLY_TIMEOUT, s.read_exact(&mut banner))
+            .await
+            .map_err(|_| "banner: timed out".to_string())?
+            .map_err(|e| format!("banner: {e}"))?;
+
+        self.send(&mut s, 0x00, &proto::version(cfg.version, 0)).await?;
+        let p = reply(&mut s).await.map_err(|e| format!("version: {e}"))?;
+        self.stats.recv(p[3], p.len());
+        let xor = proto::version_key(&p).ok_or("version: server wants a patch")?;
+        let c = Crypt::login(&xor);
+        let creds = proto::credentials(name, &cfg.password);
+
+        if cfg.create {
+            let p = self.seal(&c, 0x02, &creds);
+            self.send(&mut s, 0x02, &p).await?;
+            // An existing account fails with "already exists"; just log in
+            if self.message(&mut s, &c, "register").await.is_ok() {
+                let look = proto::create_char(self.rng.below(256) as u8);
+                let p = self.seal(&c, 0x04, &look);
+                self.send(&mut s, 0x04, &p).await?;
+                self.message(&mut s, &c, "create").await?;
+            }
+        }
+
+        let p = self.seal(&c, 0x03, &creds);
+        self.send(&mut s, 0x03, &p).await?;
+        self.message(&mut s, &c, "auth").await?;
+        let p = reply(&mut s).await.map_err(|e| format!("redirect: {e}"))?;
+        self.stats.recv(p[3], p.len());
+        let r = proto::redirect(&p).ok_or_else(|| format!("redirect: unexpected {:#04x}", p[3]))?;
+        Ok((r, xor))
+    }
+
+    async fn play(
+        &mut self,
+        cfg: &Config,
+        name: &str,
+        r: proto::Redirect,
+        xor: &[u8],
+        started: Instant,
+        until: Instant,
+    ) -> Res<()> {
+        let addr = cfg.map_addr.unwrap_or(r.addr);
+        let s = TcpStream::connect(addr).await.map_err(|e| format!("map connect {addr}: {e}"))?;
+        s.set_nodelay(true).ok();
+        let (mut rd, mut w) = s.into_split();
+        self.send(&mut w, 0x10, &proto::map_login(&r.ticket)).await?;
+
+        // read_packet is not cancel-safe, so frames are read on their own task
+        let (tx, mut rx) = mpsc::unbounded_channel::<(Vec<u8>, Instant)>();
+        let stats = self.stats.clone();
+        let reader = tokio::spawn(async move {
+            while let Ok(p) = proto::read_packet(&mut rd).await {
+                stats.recv(p[3], p.len());
+                if tx.send((p, Instant::now())).is_err() {
+                    break;
+                }
+            }
+        });
+
+        let c = Crypt::map(xor, name);
+        let result = self.act(&c, &mut w, &mut rx, started, until).await;
+        reader.abort();
+        result
+    }
+
+    async fn act(
+        &mut self,
+        c: &Crypt,
+        w: &mut OwnedWriteHalf,
+        rx: &mut mpsc::UnboundedReceiver<(Vec<u8>, Instant)>,
+        started: Instant,
+        until: Instant,
+    ) -> Res<()> {
+        let mut step = tokio::time::interval(Duration::from_millis(self.profile.step_ms));
+        step.set_missed_tick_behavior(tokio::time::MissedTickBehavior::Delay);
+        let mut online = false;
+        let mut probe: Option<Instant> = None;
+        let mut next_probe = Instant::now() + PROBE_EVERY;
+        let mut next_ping = Instant::now() + PING_EVERY;
+        let end = tokio::time::Instant::from_std(until);
+
+        loop {
+            tokio::select! {
+                got = rx.recv() => {
+                    let Some((mut p, at)) = got else {
+                        return Err(if online { "map: disconnected".into() } else { "map: refused".into() });
+                    };
+                    if !online {
+                        online = true;
+                        self.stats.logged_in(at - started);
+                    }
+                    match p[3] {
+                        // Sent in the clear; closes the reply to a refresh
+                        0x22 => if let Some(sent) = probe.take() {
+                            self.stats.rtt(at - sent);
+                        },
+                        0x04 => {
+                            c.open(&mut p);
+                            if let Some(pos) = proto::position(&p) {
+                                (self.x, self.y) = pos;
+                            }
+                        }
+                        _ => {}
+                    }
+                }
+                _ = step.tick(), if online => {
+                    let now = Instant::now();
+                    if probe.is_some_and(|t| now - t > PROBE_TIMEOUT) {
+                        probe = None;
+                    }
+                    if probe.is_none() && now >= next_probe {
+                        let p = self.seal(c, 0x38, &[]);
+                        self.send(w, 0x38, &p).await?;
+                        self.stats.probes_sent.fetch_add(1, std::sync::atomic::Ordering::Relaxed);
+                        probe = Some(Instant::now());
+                        next_probe = now + PROBE_EVERY;
+                    }
+                    if now >= next_ping {
+                        let p = self.seal(c, 0x60, &[]);
+                        self.send(w, 0x60, &p).await?;
+                        next_ping = now + PING_EVERY;
+                    }
+                    self.step(c, w).await?;
+                }
+                _ = tokio::time::sleep_until(end) => return Ok(()),
+            }
+        }
+    }
+
+    /// One roll of the profile.
+    async fn step(&mut self, c: &Crypt, w: &mut OwnedWriteHalf) -> Res<()> {
+        match self.profile.pick(&mut self.rng) {
+            Action::Walk => {
+                // Mostly keep going; a wall just earns a 0x04 back
+                if self.rng.below(4) == 0 {
+                    self.dir = self.rng.below(4) as u8;
+                }
+                self.walk_step = self.walk_step.wrapping_add(1);
+                let body = proto::walk(self.dir, self.walk_step, self.x, self.y);
+                let p = self.seal(c, 0x32, &body);
+                self.send(w, 0x32, &p).await?;
+                match self.dir {
+                    0 => self.y = self.y.saturating_sub(1),
+                    1 => self.x += 1,
+                    2 => self.y += 1,
+                    _ => self.x = self.x.saturating_sub(1),
+                }
+            }
+            Action::Say => {
+                let line = LINES[self.rng.below(LINES.len() as u32) as usize];
+                let p = self.seal(c, 0x0E, &proto::say(line));
+                self.send(w, 0x0E, &p).await?;
+            }
+            Action::Cast(slot) => {
+                let p = self.seal(c, 0x0F, &[slot]);
+                self.send(w, 0x0F, &p).await?;
+            }
+            Action::Fight => {
+                let side = self.rng.below(4) as u8;
+                let p = self.seal(c, 0x11, &[side]);
+                self.send(w, 0x11, &p).await?;
+                let p = self.seal(c, 0x13, &[]);
+                self.send(w, 0x13, &p).await?;
+            }
+            Action::Idle => {}
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_names_are_valid_and_distinct() {
+        let valid = |s: &str| (3..=12).contains(&s.len()) && s.chars().all(|c| c.is_ascii_alphabetic());
+        let names: Vec<String> = (0..2000).map(|i| name("Bot", i)).collect();
+        assert_eq!(names[0], "Bota");
+        assert_eq!(names[27], "Botbb");
+        assert!(names.iter().all(|n| valid(n)));
+        let mut unique = names.clone();
+        unique.sort();
+        unique.dedup();
+        assert_eq!(unique.len(), names.len());
+    }
+}
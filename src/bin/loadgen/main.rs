@@ -0,0 +1,129 @@
+//! Headless bot clients for load testing.
+//!
+//! Starts N clients that log in through the login server like the game
+//! client does (PROTOCOL.md), follow the redirect to a map server and then
+//! walk, chat, cast and fight as their profile says. At the end it prints
+//! what the bots sent and received, login and round-trip latency, and, with
+//! `--metrics`, the map server's own tick times over the run.
+
+mod bot;
+mod profile;
+mod proto;
+mod report;
+
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+use anyhow::{bail, Context, Result};
+
+const USAGE: &str = "\
+Usage: loadgen [options]
+  --login HOST:PORT    login server (127.0.0.1:2000)
+  --clients N          bots to run (10)
+  --ramp MS            delay between bot starts (50)
+  --duration S         seconds to run once all bots started (60)
+  --profile NAME       behaviour, see below (mixed)
+  --prefix NAME        character name prefix, 2-8 letters (Bot)
+  --password PW        password of every bot (loadtest)
+  --create             register and create the characters first
+  --version N          client version to present (750)
+  --map-addr HOST:PORT connect here instead of following the redirect
+  --metrics HOST:PORT  map server metrics endpoint to read tick times from
+  --seed N             run seed; same seed, same packets (1)";
+
+fn value<'a>(args: &'a [String], i: &mut usize) -> Result<&'a str> {
+    *i += 1;
+    match args.get(*i) {
+        Some(v) => Ok(v),
+        None => bail!("{} requires a value", args[*i - 1]),
+    }
+}
+
+#[tokio::main]
+async fn main() -> Result<()> {
+    let mut login = "127.0.0.1:2000".to_string();
+    let mut clients = 10usize;
+    let mut ramp_ms = 50u64;
+    let mut duration = 60u64;
+    let mut profile_name = "mixed".to_string();
+    let mut prefix = "Bot".to_string();
+    let mut password = "loadtest".to_string();
+    let mut create = false;
+    let mut version = 750u16;
+    let mut map_addr = None;
+    let mut metrics = None;
+    let mut seed = 1u64;
+
+    let args: Vec<String> = std::env::args().collect();
+    let mut i = 1;
+    while i < args.len() {
+        match args[i].as_str() {
+            "--help" | "--h" | "--?" | "/?" => {
+                println!("{USAGE}\n\nProfiles:");
+                for p in profile::PROFILES {
+                    println!("  {:<10} {} (every {} ms)", p.name, p.about, p.step_ms);
+                }
+                return Ok(());
+            }
+            "--login" => login = value(&args, &mut i)?.to_string(),
+            "--clients" => clients = value(&args, &mut i)?.parse().context("--clients")?,
+            "--ramp" => ramp_ms = value(&args, &mut i)?.parse().context("--ramp")?,
+            "--duration" => duration = value(&args, &mut i)?.parse().context("--duration")?,
+            "--profile" => profile_name = value(&args, &mut i)?.to_string(),
+            "--prefix" => prefix = value(&args, &mut i)?.to_string(),
+            "--password" => password = value(&args, &mut i)?.to_string(),
+            "--create" => create = true,
+            "--version" => version = value(&args, &mut i)?.parse().context("--version")?,
+            "--map-addr" => map_addr = Some(value(&args, &mut i)?.parse().context("--map-addr")?),
+            "--metrics" => metrics = Some(value(&args, &mut i)?.to_string()),
+            "--seed" => seed = value(&args, &mut i)?.parse().context("--seed")?,
+            other => bail!("unknown option {other}\n{USAGE}"),
+        }
+        i += 1;
+    }
+
+    let Some(profile) = profile::by_name(&profile_name) else {
+        bail!("unknown profile {profile_name}; see --help");
+    };
+    if !(2..=8).contains(&prefix.len()) || !prefix.chars().all(|c| c.is_ascii_alphabetic()) {
+        bail!("--prefix must be 2 to 8 letters");
+    }
+    if !(3..=8).contains(&password.len()) || !password.chars().all(|c| c.is_ascii_alphanumeric()) {
+        bail!("--password must be 3 to 8 letters or digits");
+    }
+
+    let cfg = Arc::new(bot::Config { login, version, prefix, password, create, map_addr, profile, seed });
+    let stats = Arc::new(report::Stats::default());
+    let before = match &metrics {
+        Some(addr) => Some(report::scrape(addr).await.with_context(|| format!("metrics {addr}"))?),
+        None => None,
+    };
+
+    let ramp = Duration::from_millis(ramp_ms);
+    let start = Instant::now();
+    let until = start + ramp * clients as u32 + Duration::from_secs(duration);
+    println!("loadgen: {clients} x {} against {}", profile.name, cfg.login);
+    let mut bots = Vec::with_capacity(clients);
+    for idx in 0..clients {
+        bots.push(tokio::spawn(bot::run(idx, cfg.clone(), stats.clone(), until)));
+        tokio::time::sleep(ramp).await;
+    }
+    for b in bots {
+        let _ = b.await;
+    }
+    let elapsed = start.elapsed();
+
+    let after = match &metrics {
+        Some(addr) => match report::scrape(addr).await {
+            Ok(s) => Some(s),
+            Err(e) => {
+                eprintln!("metrics {addr}: {e}");
+                None
+            }
+        },
+        None => None,
+    };
+    let server = before.as_ref().zip(after.as_ref());
+    report::print(&stats, clients, elapsed, server);
+    Ok(())
+}
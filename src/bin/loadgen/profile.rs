@@ -0,0 +1,125 @@
+//! Scripted bot behaviour.
+//!
+//! A profile is how often a bot acts and the odds of each action. Every
+//! bot draws from its own xorshift stream seeded from the run seed and its
+//! index, so a run with the same seed sends the same packets in the same
+//! order whatever the server answers.
+
+/// One thing a bot does in a step.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Action {
+    /// Walk one cell, usually on in the direction of the last step
+    Walk,
+    Say,
+    /// Cast the spell in this spell-book slot (1-based)
+    Cast(u8),
+    /// Face a random way and swing: hits whatever mob stands there
+    Fight,
+    Idle,
+}
+
+pub struct Profile {
+    pub name: &'static str,
+    pub about: &'static str,
+    /// Time between steps
+    pub step_ms: u64,
+    /// Relative odds of walk, say, cast, fight and idle
+    pub weights: [u32; 5],
+}
+
+pub const PROFILES: &[Profile] = &[
+    Profile { name: "idle", about: "log in and stand still", step_ms: 1000, weights: [0, 0, 0, 0, 1] },
+    Profile { name: "walker", about: "walk around the map", step_ms: 350, weights: [1, 0, 0, 0, 0] },
+    Profile { name: "chatter", about: "walk a little, talk a lot", step_ms: 800, weights: [3, 6, 0, 0, 1] },
+    Profile { name: "caster", about: "cast spells between short walks", step_ms: 600, weights: [2, 0, 6, 0, 2] },
+    Profile { name: "fighter", about: "hunt: walk and swing at mobs", step_ms: 450, weights: [4, 0, 1, 5, 0] },
+    Profile { name: "mixed", about: "a bit of everything, like a busy town", step_ms: 500, weights: [6, 1, 1, 2, 2] },
+];
+
+pub fn by_name(name: &str) -> Option<&'static Profile> {
+    PROFILES.iter().find(|p| p.name.eq_ignore_ascii_case(name))
+}
+
+impl Profile {
+    /// The action for a roll of `rng`.
+    pub fn pick(&self, rng: &mut Rng) -> Action {
+        let total: u32 = self.weights.iter().sum();
+        let mut roll = rng.below(total.max(1));
+        for (i, &w) in self.weights.iter().enumerate() {
+            if roll < w {
+                return match i {
+                    0 => Action::Walk,
+                    1 => Action::Say,
+                    2 => Action::Cast(1 + rng.below(3) as u8),
+                    3 => Action::Fight,
+                    _ => Action::Idle,
+                };
+            }
+            roll -= w;
+        }
+        Action::Idle
+    }
+}
+
+/// xorshift64*, one stream per bot.
+pub struct Rng(u64);
+
+impl Rng {
+    pub fn new(seed: u64, stream: u64) -> Self {
+        // splitmix64 of the pair, so neighbouring bots do not correlate
+        let mut z = seed ^ stream.wrapping_mul(0x9E37_79B9_7F4A_7C15);
+        z = (z ^ (z >> 30)).wrapping_mul(0xBF58_476D_1CE4_E5B9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94D0_49BB_1331_11EB);
+        Rng((z ^ (z >> 31)) | 1)
+    }
+
+    pub fn next(&mut self) -> u64 {
+        self.0 ^= self.0 >> 12;
+        self.0 ^= self.0 << 25;
+        self.0 ^= self.0 >> 27;
+        self.0.wrapping_mul(0x2545_F491_4F6C_DD1D)
+    }
+
+    /// Uniform in `0..n`.
+    pub fn below(&mut self, n: u32) -> u32 {
+        ((self.next() >> 32) * n as u64 >> 32) as u32
+    }
+}
+
+/// Lines the chatter bots say; none start with a command prefix.
+pub const LINES: &[&str] = &[
+    "hello", "anyone want to group?", "selling hides", "where is the inn", "nice weather today",
+    "brb", "lol", "how do i get to the caves", "thanks!", "wts potions cheap",
+];
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_rng_streams_are_repeatable_and_distinct() {
+        let (mut a, mut b) = (Rng::new(7, 1), Rng::new(7, 1));
+        let mut c = Rng::new(7, 2);
+        let xs: Vec<u64> = (0..8).map(|_| a.next()).collect();
+        assert_eq!(xs, (0..8).map(|_| b.next()).collect::<Vec<_>>());
+        assert_ne!(xs, (0..8).map(|_| c.next()).collect::<Vec<_>>());
+        assert!((0..1000).all(|_| a.below(3) < 3));
+    }
+
+    #[test]
+    fn test_profiles_follow_their_weights() {
+        assert!(by_name("Walker").is_some());
+        assert!(by_name("nope").is_none());
+        let mut rng = Rng::new(1, 0);
+        assert!((0..100).all(|_| by_name("walker").unwrap().pick(&mut rng) == Action::Walk));
+        assert!((0..100).all(|_| by_name("idle").unwrap().pick(&mut rng) == Action::Idle));
+
+        let fighter = by_name("fighter").unwrap();
+        let picks: Vec<Action> = (0..2000).map(|_| fighter.pick(&mut rng)).collect();
+        let fights = picks.iter().filter(|a| **a == Action::Fight).count();
+        // 5 of 10
+        assert!((800..1200).contains(&fights), "{fights}");
+        assert!(!picks.contains(&Action::Say));
+        assert!(picks.iter().all(|a| !matches!(a, Action::Cast(s) if !(1..=3).contains(s))));
+    }
+}
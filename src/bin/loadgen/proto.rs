@@ -0,0 +1,277 @@
+//! The client's side of the wire format (see PROTOCOL.md).
+//!
+//! Frames are `0xAA, len (BE16), opcode, seq, body..., trailer (3)`, where
+//! `len` counts every byte after itself, trailer included. The login server
+//! decrypts every client packet with the static `xor_key`; the map server
+//! uses the static key for the opcodes of `is_key_client` and a key derived
+//! from the trailer and the character name's table for the rest. Server
+//! packets are the mirror image (`is_key_server`).
+
+use std::net::{Ipv4Addr, SocketAddr, SocketAddrV4};
+
+use tokio::io::{AsyncRead, AsyncReadExt};
+use yuri::network::crypt::{
+    generate_key2, is_key_client, is_key_server, populate_table, tk_crypt_dynamic, tk_crypt_static,
+};
+
+/// "CONNECTED SERVER" banner the login server sends on accept.
+pub const BANNER_LEN: usize = 22;
+
+/// Keys of one connection.
+pub struct Crypt {
+    xor: Vec<u8>,
+    /// Name table once logged in to a map server; `None` on the login server
+    table: Option<Vec<u8>>,
+}
+
+impl Crypt {
+    pub fn login(xor: &[u8]) -> Self {
+        Crypt { xor: xor.to_vec(), table: None }
+    }
+
+    pub fn map(xor: &[u8], name: &str) -> Self {
+        let mut table = vec![0u8; 0x401];
+        populate_table(name.as_bytes(), &mut table);
+        Crypt { xor: xor.to_vec(), table: Some(table) }
+    }
+
+    /// Frame and encrypt `body` as opcode `op`. `trailer` picks the session
+    /// key; any three bytes do.
+    pub fn seal(&self, op: u8, seq: u8, body: &[u8], trailer: [u8; 3]) -> Vec<u8> {
+        let len = 5 + body.len();
+        let mut p = Vec::with_capacity(len + 3);
+        p.push(0xAA);
+        p.extend_from_slice(&(len as u16).to_be_bytes());
+        p.push(op);
+        p.push(seq);
+        p.extend_from_slice(body);
+        p.extend_from_slice(&trailer);
+        match &self.table {
+            Some(table) if is_key_client(op) => {
+                let mut key = [0u8; 10];
+                generate_key2(&p, table, &mut key, true);
+                tk_crypt_dynamic(&mut p, &key[..9]);
+            }
+            _ => tk_crypt_static(&mut p, &self.xor),
+        }
+        p
+    }
+
+    /// Decrypt a server packet in place. Packets the server sends in the
+    /// clear (0x22, the login redirect) come out garbled past byte 4; only
+    /// decrypt what is read.
+    pub fn open(&self, p: &mut [u8]) {
+        if p.len() < 8 {
+            return;
+        }
+        match &self.table {
+            Some(table) if is_key_server(p[3]) => {
+                let mut key = [0u8; 10];
+                generate_key2(p, table, &mut key, false);
+                tk_crypt_dynamic(p, &key[..9]);
+            }
+            _ => tk_crypt_static(p, &self.xor),
+        }
+    }
+}
+
+/// Read one frame. Frames are `len + 3` bytes long.
+pub async fn read_packet<R: AsyncRead + Unpin>(r: &mut R) -> std::io::Result<Vec<u8>> {
+    let mut head = [0u8; 3];
+    r.read_exact(&mut head).await?;
+    if head[0] != 0xAA {
+        return Err(std::io::Error::new(std::io::ErrorKind::InvalidData, "frame without 0xAA"));
+    }
+    let len = u16::from_be_bytes([head[1], head[2]]) as usize;
+    let mut p = vec![0u8; len + 3];
+    p[..3].copy_from_slice(&head);
+    r.read_exact(&mut p[3..]).await?;
+    Ok(p)
+}
+
+/// Version check (0x00), sent in the clear.
+pub fn version(ver: u16, deep: u16) -> Vec<u8> {
+    let mut p = vec![0xAA, 0x00, 0x06, 0x00];
+    p.extend_from_slice(&ver.to_be_bytes());
+    p.push(0x00);
+    p.extend_from_slice(&deep.to_be_bytes());
+    p
+}
+
+/// The static key from a version-ok reply, or `None` for a patch reply.
+pub fn version_key(p: &[u8]) -> Option<Vec<u8>> {
+    if p.len() < 20 || p[3] != 0x00 || p[4] != 0x00 {
+        return None;
+    }
+    let key = &p[11..20];
+    Some(key[..key.iter().position(|&b| b == 0).unwrap_or(9)].to_vec())
+}
+
+/// Body of a name/password packet: 0x02 (register) or 0x03 (log in).
+pub fn credentials(name: &str, pass: &str) -> Vec<u8> {
+    let mut b = Vec::with_capacity(name.len() + pass.len() + 2);
+    b.push(name.len() as u8);
+    b.extend_from_slice(name.as_bytes());
+    b.push(pass.len() as u8);
+    b.extend_from_slice(pass.as_bytes());
+    b
+}
+
+/// Body of a create-character packet (0x04): face, hair, colours, sex, totem.
+pub fn create_char(look: u8) -> Vec<u8> {
+    vec![0x00, look % 6, look % 10, 0, look % 8, look % 2, 0, look % 4]
+}
+
+/// Result code of a login-server message (0x02), already decrypted:
+/// 0 is success.
+pub fn message_code(p: &[u8]) -> Option<u8> {
+    (p.len() > 5 && p[3] == 0x02).then(|| p[5])
+}
+
+/// Where the login server sends us, and what to present there.
+#[derive(Debug, PartialEq, Eq)]
+pub struct Redirect {
+    pub addr: SocketAddr,
+    /// Key length, key, name length, name and session id, echoed in 0x10
+    pub ticket: Vec<u8>,
+}
+
+/// Parse the 0x03 redirect. It is sent unencrypted.
+pub fn redirect(p: &[u8]) -> Option<Redirect> {
+    if p.len() < 27 || p[3] != 0x03 {
+        return None;
+    }
+    // The address is sent byte-swapped, port big-endian (see send_auth_success)
+    let ip = Ipv4Addr::new(p[7], p[6], p[5], p[4]);
+    let port = u16::from_be_bytes([p[8], p[9]]);
+    let name_len = p[22] as usize;
+    let end = 27 + name_len;
+    if p.len() < end {
+        return None;
+    }
+    Some(Redirect { addr: SocketAddr::V4(SocketAddrV4::new(ip, port)), ticket: p[11..end].to_vec() })
+}
+
+/// Map-server login (0x10): the ticket from the redirect, in the clear.
+pub fn map_login(ticket: &[u8]) -> Vec<u8> {
+    let len = 1 + ticket.len();
+    let mut p = vec![0xAA];
+    p.extend_from_slice(&(len as u16).to_be_bytes());
+    p.push(0x10);
+    p.extend_from_slice(ticket);
+    p
+}
+
+/// Walk one cell (0x32) from `(x, y)` towards `dir` (0 up, 1 right, 2 down,
+/// 3 left).
+pub fn walk(dir: u8, step: u8, x: u16, y: u16) -> Vec<u8> {
+    let mut b = vec![dir, step, 80];
+    b.extend_from_slice(&x.to_be_bytes());
+    b.extend_from_slice(&y.to_be_bytes());
+    b
+}
+
+/// Say (0x0E) `msg` in normal chat.
+pub fn say(msg: &str) -> Vec<u8> {
+    let msg = &msg.as_bytes()[..msg.len().min(100)];
+    let mut b = vec![0x00, msg.len() as u8];
+    b.extend_from_slice(msg);
+    b.push(0);
+    b
+}
+
+/// Position from a decrypted 0x04.
+pub fn position(p: &[u8]) -> Option<(u16, u16)> {
+    (p.len() >= 9 && p[3] == 0x04)
+        .then(|| (u16::from_be_bytes([p[5], p[6]]), u16::from_be_bytes([p[7], p[8]])))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_sealed_packets_decrypt_like_the_servers() {
+        let xor = b"Urk#nI7ni";
+        let body = say("hello");
+
+        // Login server: tk_crypt_static over the whole frame
+        let mut p = Crypt::login(xor).seal(0x03, 1, &body, [0x12, 0x34, 0x56]);
+        assert_eq!(p.len(), 5 + body.len() + 3);
+        assert_eq!(u16::from_be_bytes([p[1], p[2]]) as usize + 3, p.len());
+        tk_crypt_static(&mut p, xor);
+        assert_eq!(&p[5..5 + body.len()], &body[..]);
+
+        // Map server: decrypt() in net_crypt.c
+        let bot = Crypt::map(xor, "Loadbot");
+        let mut table = vec![0u8; 0x401];
+        populate_table(b"Loadbot", &mut table);
+        let mut p = bot.seal(0x0E, 7, &body, [0x9A, 0xBC, 0xDE]);
+        assert_eq!(p[3], 0x0E);
+        let mut key = [0u8; 10];
+        generate_key2(&p, &table, &mut key, true);
+        tk_crypt_dynamic(&mut p, &key[..9]);
+        assert_eq!(&p[5..5 + body.len()], &body[..]);
+        // 0x0B is one of the static client opcodes
+        let mut p = bot.seal(0x0B, 8, &[1, 2], [0; 3]);
+        tk_crypt_static(&mut p, xor);
+        assert_eq!(&p[5..7], &[1, 2]);
+    }
+
+    #[test]
+    fn test_server_packets_open() {
+        let xor = b"Urk#nI7ni";
+        let bot = Crypt::map(xor, "Loadbot");
+        let mut table = vec![0u8; 0x401];
+        populate_table(b"Loadbot", &mut table);
+        // encrypt() in net_crypt.c for a 0x04 at (12, 34)
+        let mut p = vec![0xAA, 0, 13, 0x04, 3, 0, 12, 0, 34, 0, 8, 0, 7, 0, 0, 0, 0, 0, 0];
+        yuri::network::crypt::set_packet_indexes(&mut p);
+        let mut key = [0u8; 10];
+        generate_key2(&p, &table, &mut key, false);
+        tk_crypt_dynamic(&mut p, &key[..9]);
+        bot.open(&mut p);
+        assert_eq!(position(&p), Some((12, 34)));
+    }
+
+    #[test]
+    fn test_redirect_ticket() {
+        // send_auth_success for "Loadbot", 127.0.0.1:2001, session 5
+        let name = b"Loadbot";
+        let mut p = vec![0u8; 27 + name.len() + 3];
+        p[0] = 0xAA;
+        p[3] = 0x03;
+        p[4..8].copy_from_slice(&[1, 0, 0, 127]);
+        p[8..10].copy_from_slice(&2001u16.to_be_bytes());
+        p[11..13].copy_from_slice(&9u16.to_be_bytes());
+        p[13..22].copy_from_slice(b"Urk#nI7ni");
+        p[22] = name.len() as u8;
+        p[23..30].copy_from_slice(name);
+        p[30..34].copy_from_slice(&5u32.to_be_bytes());
+        let r = redirect(&p).unwrap();
+        assert_eq!(r.addr, "127.0.0.1:2001".parse().unwrap());
+
+        // clif_parse reads the name length at 15 and the name from 16
+        let login = map_login(&r.ticket);
+        assert_eq!(login[3], 0x10);
+        assert_eq!(login[15] as usize, name.len());
+        assert_eq!(&login[16..16 + name.len()], name);
+        assert_eq!(u16::from_be_bytes([login[1], login[2]]) as usize + 3, login.len());
+    }
+
+    #[test]
+    fn test_version_and_credentials() {
+        let v = version(750, 0);
+        assert_eq!(u16::from_be_bytes([v[4], v[5]]), 750);
+        assert_eq!(u16::from_be_bytes([v[1], v[2]]) as usize + 3, v.len());
+
+        let mut ok = vec![0u8; 20];
+        ok[..11].copy_from_slice(&[0xAA, 0x00, 0x11, 0x00, 0x00, 0x27, 0x4F, 0x8A, 0x4A, 0x00, 0x09]);
+        ok[11..17].copy_from_slice(b"abcdef");
+        assert_eq!(version_key(&ok), Some(b"abcdef".to_vec()));
+
+        let c = credentials("Loadbot", "pw123");
+        // dispatch_login reads the name length at 5 of the frame
+        assert_eq!((c[0], c[8]), (7, 5));
+    }
+}
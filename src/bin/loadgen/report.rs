@@ -0,0 +1,300 @@
+//! What a run measured, and the summary printed at the end.
+
+use std::collections::BTreeMap;
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+use std::sync::Mutex;
+use std::time::Duration;
+
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+
+/// Counters shared by every bot.
+pub struct Stats {
+    pub sent: [AtomicU64; 256],
+    pub recv: [AtomicU64; 256],
+    pub bytes_out: AtomicU64,
+    pub bytes_in: AtomicU64,
+    /// Bots that reached a map server
+    pub online: AtomicU64,
+    pub logins_failed: AtomicU64,
+    pub disconnects: AtomicU64,
+    pub probes_sent: AtomicU64,
+    /// Microseconds from connect to the first map-server packet
+    login_us: Mutex<Vec<u32>>,
+    /// Microseconds from a refresh (0x38) to its closing 0x22
+    rtt_us: Mutex<Vec<u32>>,
+    failures: Mutex<BTreeMap<String, u64>>,
+}
+
+impl Default for Stats {
+    fn default() -> Self {
+        Stats {
+            sent: std::array::from_fn(|_| AtomicU64::new(0)),
+            recv: std::array::from_fn(|_| AtomicU64::new(0)),
+            bytes_out: AtomicU64::new(0),
+            bytes_in: AtomicU64::new(0),
+            online: AtomicU64::new(0),
+            logins_failed: AtomicU64::new(0),
+            disconnects: AtomicU64::new(0),
+            probes_sent: AtomicU64::new(0),
+            login_us: Mutex::default(),
+            rtt_us: Mutex::default(),
+            failures: Mutex::default(),
+        }
+    }
+}
+
+fn micros(d: Duration) -> u32 {
+    d.as_micros().min(u32::MAX as u128) as u32
+}
+
+impl Stats {
+    pub fn sent(&self, op: u8, bytes: usize) {
+        self.sent[op as usize].fetch_add(1, Relaxed);
+        self.bytes_out.fetch_add(bytes as u64, Relaxed);
+    }
+
+    pub fn recv(&self, op: u8, bytes: usize) {
+        self.recv[op as usize].fetch_add(1, Relaxed);
+        self.bytes_in.fetch_add(bytes as u64, Relaxed);
+    }
+
+    pub fn logged_in(&self, took: Duration) {
+        self.online.fetch_add(1, Relaxed);
+        self.login_us.lock().unwrap_or_else(|e| e.into_inner()).push(micros(took));
+    }
+
+    pub fn rtt(&self, took: Duration) {
+        self.rtt_us.lock().unwrap_or_else(|e| e.into_inner()).push(micros(took));
+    }
+
+    /// A bot gave up; `why` is grouped in the summary.
+    pub fn failed(&self, why: String, logged_in: bool) {
+        if logged_in {
+            self.disconnects.fetch_add(1, Relaxed);
+        } else {
+            self.logins_failed.fetch_add(1, Relaxed);
+        }
+        *self.failures.lock().unwrap_or_else(|e| e.into_inner()).entry(why).or_default() += 1;
+    }
+}
+
+/// The `p`th percentile (0..=100) of sorted `xs`, nearest rank.
+pub fn percentile(xs: &[u32], p: f64) -> u32 {
+    if xs.is_empty() {
+        return 0;
+    }
+    let rank = ((p / 100.0) * xs.len() as f64).ceil() as usize;
+    xs[rank.clamp(1, xs.len()) - 1]
+}
+
+fn latency_line(label: &str, xs: &mut Vec<u32>) -> String {
+    xs.sort_unstable();
+    if xs.is_empty() {
+        return format!("{label:<12} no samples");
+    }
+    let ms = |us: u32| us as f64 / 1000.0;
+    format!(
+        "{label:<12} n={} p50={:.2}ms p90={:.2}ms p99={:.2}ms max={:.2}ms",
+        xs.len(),
+        ms(percentile(xs, 50.0)),
+        ms(percentile(xs, 90.0)),
+        ms(percentile(xs, 99.0)),
+        ms(*xs.last().unwrap())
+    )
+}
+
+/// The server-side figures scraped from a server's `/metrics` endpoint.
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct Scrape {
+    /// Cumulative `yuri_tick_seconds` buckets as (upper bound, count)
+    pub tick_buckets: Vec<(f64, u64)>,
+    pub tick_sum: f64,
+    pub tick_count: u64,
+    pub sessions: Option<f64>,
+    pub lua_heap: Option<f64>,
+    pub db_lag: Option<f64>,
+}
+
+fn value(line: &str) -> Option<f64> {
+    line.rsplit(' ').next()?.parse().ok()
+}
+
+impl Scrape {
+    pub fn parse(text: &str) -> Scrape {
+        let mut s = Scrape::default();
+        for line in text.lines().filter(|l| !l.starts_with('#')) {
+            if let Some(rest) = line.strip_prefix("yuri_tick_seconds_bucket{le=\"") {
+                let le = rest.split('"').next().unwrap_or("");
+                let le = if le == "+Inf" { f64::INFINITY } else { le.parse().unwrap_or(f64::NAN) };
+                if let Some(n) = value(line) {
+                    s.tick_buckets.push((le, n as u64));
+                }
+            } else if line.starts_with("yuri_tick_seconds_sum ") {
+                s.tick_sum = value(line).unwrap_or(0.0);
+            } else if line.starts_with("yuri_tick_seconds_count ") {
+                s.tick_count = value(line).unwrap_or(0.0) as u64;
+            } else if line.starts_with("yuri_sessions ") {
+                s.sessions = value(line);
+            } else if line.starts_with("yuri_lua_heap_bytes ") {
+                s.lua_heap = value(line);
+            } else if line.starts_with("yuri_db_queue_lag_seconds ") {
+                s.db_lag = value(line);
+            }
+        }
+        s
+    }
+
+    /// Ticks between `before` and `self`: count, mean seconds, and the upper
+    /// bound of the buckets holding the 50th and 99th percentiles.
+    pub fn ticks_since(&self, before: &Scrape) -> Option<(u64, f64, f64, f64)> {
+        let n = self.tick_count.checked_sub(before.tick_count).filter(|&n| n > 0)?;
+        let mean = (self.tick_sum - before.tick_sum) / n as f64;
+        let bound = |q: f64| {
+            let want = (q * n as f64).ceil() as u64;
+            self.tick_buckets
+                .iter()
+                .map(|&(le, c)| {
+                    let was = before.tick_buckets.iter().find(|b| b.0 == le).map_or(0, |b| b.1);
+                    (le, c.saturating_sub(was))
+                })
+                .find(|&(_, c)| c >= want)
+                .map_or(f64::INFINITY, |(le, _)| le)
+        };
+        Some((n, mean, bound(0.5), bound(0.99)))
+    }
+}
+
+/// GET `/metrics` from `addr`.
+pub async fn scrape(addr: &str) -> std::io::Result<Scrape> {
+    let mut s = tokio::time::timeout(Duration::from_secs(3), tokio::net::TcpStream::connect(addr))
+        .await
+        .map_err(|_| std::io::Error::new(std::io::ErrorKind::TimedOut, "metrics connect"))??;
+    s.write_all(format!("GET /metrics HTTP/1.0\r\nHost: {addr}\r\n\r\n").as_bytes()).await?;
+    let mut body = String::new();
+    tokio::time::timeout(Duration::from_secs(3), s.read_to_string(&mut body))
+        .await
+        .map_err(|_| std::io::Error::new(std::io::ErrorKind::TimedOut, "metrics read"))??;
+    let text = body.split_once("\r\n\r\n").map_or("", |(_, b)| b);
+    Ok(Scrape::parse(text))
+}
+
+/// Opcodes as "0x32=1200" pairs, busiest first.
+fn opcode_line(counts: &[AtomicU64; 256]) -> String {
+    let mut ops: Vec<(usize, u64)> =
+        counts.iter().enumerate().map(|(op, n)| (op, n.load(Relaxed))).filter(|&(_, n)| n > 0).collect();
+    ops.sort_by(|a, b| b.1.cmp(&a.1).then(a.0.cmp(&b.0)));
+    let ops: Vec<String> = ops.iter().take(10).map(|(op, n)| format!("{op:#04x}={n}")).collect();
+    ops.join(" ")
+}
+
+pub fn print(stats: &Stats, clients: usize, elapsed: Duration, server: Option<(&Scrape, &Scrape)>) {
+    let secs = elapsed.as_secs_f64().max(1e-9);
+    let total = |c: &[AtomicU64; 256]| c.iter().map(|n| n.load(Relaxed)).sum::<u64>();
+    let (sent, recv) = (total(&stats.sent), total(&stats.recv));
+
+    println!("loadgen: {clients} clients for {secs:.1}s");
+    println!(
+        "  online {}  login failures {}  disconnects {}",
+        stats.online.load(Relaxed),
+        stats.logins_failed.load(Relaxed),
+        stats.disconnects.load(Relaxed)
+    );
+    for (why, n) in stats.failures.lock().unwrap_or_else(|e| e.into_inner()).iter() {
+        println!("    {n:>6} {why}");
+    }
+    println!(
+        "  sent {sent} packets ({:.0}/s, {:.1} KiB/s)  received {recv} ({:.0}/s, {:.1} KiB/s)",
+        sent as f64 / secs,
+        stats.bytes_out.load(Relaxed) as f64 / 1024.0 / secs,
+        recv as f64 / secs,
+        stats.bytes_in.load(Relaxed) as f64 / 1024.0 / secs
+    );
+    println!("    out: {}", opcode_line(&stats.sent));
+    println!("    in:  {}", opcode_line(&stats.recv));
+
+    let mut login = std::mem::take(&mut *stats.login_us.lock().unwrap_or_else(|e| e.into_inner()));
+    let mut rtt = std::mem::take(&mut *stats.rtt_us.lock().unwrap_or_else(|e| e.into_inner()));
+    let probes = stats.probes_sent.load(Relaxed);
+    println!("  {}", latency_line("login", &mut login));
+    println!("  {}  ({} of {probes} refreshes answered)", latency_line("round trip", &mut rtt), rtt.len());
+
+    if let Some((before, after)) = server {
+        match after.ticks_since(before) {
+            Some((n, mean, p50, p99)) => println!(
+                "  server ticks n={n} mean={:.2}ms p50<={:.1}ms p99<={:.1}ms",
+                mean * 1000.0,
+                p50 * 1000.0,
+                p99 * 1000.0
+            ),
+            None => println!("  server ticks: none recorded"),
+        }
+        if let Some(n) = after.sessions {
+            println!("  server sessions {n}");
+        }
+        if let Some(b) = after.lua_heap {
+            println!("  server lua heap {:.1} MiB", b / 1048576.0);
+        }
+        if let Some(lag) = after.db_lag {
+            println!("  server db queue lag {:.2}s", lag);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_percentile_nearest_rank() {
+        assert_eq!(percentile(&[], 50.0), 0);
+        let xs: Vec<u32> = (1..=100).collect();
+        assert_eq!(percentile(&xs, 50.0), 50);
+        assert_eq!(percentile(&xs, 99.0), 99);
+        assert_eq!(percentile(&xs, 100.0), 100);
+        assert_eq!(percentile(&xs, 0.0), 1);
+        assert_eq!(percentile(&[7], 99.0), 7);
+    }
+
+    #[test]
+    fn test_tick_histogram_delta() {
+        let page = |b1: u64, b2: u64, inf: u64, sum: f64| {
+            format!(
+                "# TYPE yuri_tick_seconds histogram\n\
+                 yuri_tick_seconds_bucket{{le=\"0.001\"}} {b1}\n\
+                 yuri_tick_seconds_bucket{{le=\"0.01\"}} {b2}\n\
+                 yuri_tick_seconds_bucket{{le=\"+Inf\"}} {inf}\n\
+                 yuri_tick_seconds_sum {sum}\n\
+                 yuri_tick_seconds_count {inf}\n\
+                 yuri_sessions 42\n"
+            )
+        };
+        let before = Scrape::parse(&page(10, 10, 10, 0.005));
+        assert_eq!(before.tick_buckets.len(), 3);
+        assert_eq!(before.sessions, Some(42.0));
+        assert_eq!(before.ticks_since(&before), None);
+
+        // 100 more ticks: 60 under 1ms, 39 under 10ms, one slower
+        let after = Scrape::parse(&page(70, 109, 110, 0.305));
+        let (n, mean, p50, p99) = after.ticks_since(&before).unwrap();
+        assert_eq!(n, 100);
+        assert!((mean - 0.003).abs() < 1e-9);
+        assert_eq!(p50, 0.001);
+        assert_eq!(p99, 0.01);
+    }
+
+    #[test]
+    fn test_stats_count_by_opcode() {
+        let s = Stats::default();
+        s.sent(0x32, 20);
+        s.sent(0x32, 20);
+        s.recv(0x0C, 30);
+        s.failed("login: code 3".into(), false);
+        s.failed("login: code 3".into(), false);
+        s.failed("eof".into(), true);
+        assert_eq!(opcode_line(&s.sent), "0x32=2");
+        assert_eq!(s.bytes_in.load(Relaxed), 30);
+        assert_eq!(s.logins_failed.load(Relaxed), 2);
+        assert_eq!(s.disconnects.load(Relaxed), 1);
+        assert_eq!(s.failures.lock().unwrap()["login: code 3"], 2);
+    }
+}
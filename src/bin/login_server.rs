@@ -69,6 +69,9 @@ async fn main() -> Result<()> {
 
     let bind = format!("{}:{}", config.login_ip, config.login_port);
     let state = Arc::new(LoginState::new(pool, config, messages));
+    LoginState::register_metrics(&state);
+    yuri::metrics::spawn(&state.config.metrics_ip, state.config.login_metrics_port);
+    yuri::profiler::spawn_signal_trigger(yuri::profiler::Options::from_config(&state.config, "login"));
 
     LoginState::run(state, &bind).await?;
     Ok(())
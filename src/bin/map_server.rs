@@ -13,6 +13,7 @@ extern "C" {
     fn warp_init() -> i32;
     fn intif_init() -> i32;
     fn object_flag_init() -> i32;
+    fn map_meta_reload();
     fn rust_sl_init();
     fn rust_sl_doscript_blargs_vec(
         root: *const i8, method: *const i8,
@@ -28,6 +29,7 @@ extern "C" {
     fn rust_mob_timer_spawns(id: i32, n: i32) -> i32;
     fn map_cronjob(id: i32, n: i32) -> i32;
     fn npc_runtimers(id: i32, n: i32) -> i32;
+    fn rust_pc_autosave_timer(id: i32, n: i32) -> i32;
 
     // Legacy C SQL functions from libdeps.a
     fn Sql_Malloc() -> *mut std::ffi::c_void;
@@ -40,21 +42,17 @@ extern "C" {
 }
 
 // Rust FFI functions from libyuri.a (these replace the static-inline C shims).
-// boarddb_init() → rust_boarddb_init(), etc.
+// The static table loaders are called through yuri::database::load_static.
 extern "C" {
-    fn rust_boarddb_init() -> i32;
-    fn rust_clandb_init() -> i32;
-    fn rust_classdb_init(data_dir: *const i8) -> i32;
-    fn rust_itemdb_init() -> i32;
-    fn rust_recipedb_init() -> i32;
-    fn rust_magicdb_init() -> i32;
-    fn rust_mobdb_init() -> i32;
     fn rust_mobspawn_read() -> i32;
     // Session functions (from libyuri.a ffi/session.rs)
     fn rust_session_set_default_parse(f: unsafe extern "C" fn(i32) -> i32);
     fn rust_session_set_default_timeout(f: unsafe extern "C" fn(i32) -> i32);
     fn rust_make_listen_port(port: i32) -> i32;
     fn rust_set_termfunc(f: Option<unsafe extern "C" fn()>);
+    // Move packet queue flush (map_parse.c)
+    fn clif_flush_moves();
+    fn clif_flush_moves_fd(fd: i32);
 }
 
 // sql_handle is defined in map_server.c; we write to it after Sql_Connect succeeds.
@@ -86,6 +84,8 @@ async fn main() -> Result<()> {
         .with_ansi(std::io::IsTerminal::is_terminal(&std::io::stderr()))
         .with_env_filter(tracing_subscriber::EnvFilter::from_default_env())
         .init();
+    // C log lines go through a background writer from here on
+    let _c_log = yuri::c_log::start();
 
     // Initialize C core state (mirrors core.c main() preamble).
     unsafe {
@@ -97,17 +97,21 @@ async fn main() -> Result<()> {
 
     let mut conf_file = "conf/server.yaml".to_string();
     let mut lang_file = "conf/lang.yaml".to_string();
+    let mut replay_file: Option<String> = None;
+    let mut takeover = false;
 
     let args: Vec<String> = std::env::args().collect();
     let mut i = 1;
     while i < args.len() {
         match args[i].as_str() {
             "--help" | "--h" | "--?" | "/?" => {
-                println!("Usage: map_server [--conf FILE] [--lang FILE]");
+                println!("Usage: map_server [--conf FILE] [--lang FILE] [--replay TRACE] [--takeover]");
                 return Ok(());
             }
             "--conf" if i + 1 < args.len() => { i += 1; conf_file = args[i].clone(); }
             "--lang" if i + 1 < args.len() => { i += 1; lang_file = args[i].clone(); }
+            "--replay" if i + 1 < args.len() => { i += 1; replay_file = Some(args[i].clone()); }
+            "--takeover" => takeover = true,
             _ => {}
         }
         i += 1;
@@ -120,6 +124,9 @@ async fn main() -> Result<()> {
         ServerConfig::from_str(&content)
             .with_context(|| format!("Cannot parse config: {}", conf_file))?
     };
+    if takeover && config.handoff_socket.is_empty() {
+        anyhow::bail!("--takeover needs handoff_socket set in {}", conf_file);
+    }
 
     // Call rust_config_read so C code can access config globals
     {
@@ -158,6 +165,8 @@ async fn main() -> Result<()> {
     // block_on-inside-runtime panic (we're already inside #[tokio::main]).
     yuri::database::set_pool(pool.clone())
         .context("Failed to register DB pool with Rust DB modules")?;
+    // Game-thread writes go through the write-behind worker from here on
+    yuri::database::write_behind::start(pool.clone());
 
     // Legacy C SQL handle
     unsafe {
@@ -177,11 +186,13 @@ async fn main() -> Result<()> {
         sql_handle = handle;
     }
 
-    // Reset online flags
-    sqlx::query("UPDATE `Character` SET `ChaOnline` = 0 WHERE `ChaOnline` = 1")
-        .execute(&pool)
-        .await
-        .ok();
+    // Reset online flags, unless the players are about to be taken over
+    if !takeover {
+        sqlx::query("UPDATE `Character` SET `ChaOnline` = 0 WHERE `ChaOnline` = 1")
+            .execute(&pool)
+            .await
+            .ok();
+    }
 
     // Run all blocking init (rust_map_init, rust_*db_init, C game init) on a
     // dedicated thread. spawn_blocking is required because these functions call
@@ -189,8 +200,11 @@ async fn main() -> Result<()> {
     {
         let maps_dir = config.maps_dir.clone();
         let data_dir = config.data_dir.clone();
+        yuri::database::snapshot::set_dir(&config.db_snapshot_dir);
+        yuri::timer_stats::with(|s| s.set_budget_ms(config.timer_slow_tick_ms.max(0) as u32));
         let serverid = config.server_id;
         let map_port = config.map_port;
+        let listen = replay_file.is_none() && !takeover;
 
         tokio::task::spawn_blocking(move || -> anyhow::Result<()> {
             let maps_dir_c = CString::new(maps_dir.as_str()).unwrap();
@@ -206,22 +220,24 @@ async fn main() -> Result<()> {
                 map_initiddb();
                 npc_init();
                 warp_init();
-                rust_itemdb_init();
-                rust_recipedb_init();
-                rust_mobdb_init();
-                rust_mobspawn_read();
-                rust_magicdb_init();
+                // Items, recipes, mobs, spells, classes, clans and boards
+                // load concurrently; spawns need the mob db, so they follow.
                 let data_dir_c = CString::new(data_dir.as_str()).unwrap();
-                rust_classdb_init(data_dir_c.as_ptr());
-                rust_clandb_init();
-                rust_boarddb_init();
+                let failed = yuri::database::load_static(&data_dir_c);
+                if !failed.is_empty() {
+                    tracing::error!("[map] static table loads failed: {}", failed.join(", "));
+                }
+                rust_mobspawn_read();
                 intif_init();
                 object_flag_init();
+                map_meta_reload();
                 rust_sl_init();
                 map_loadgameregistry();
                 rust_session_set_default_parse(clif_parse);
                 rust_session_set_default_timeout(clif_timeout);
-                rust_make_listen_port(map_port as i32);
+                if listen {
+                    rust_make_listen_port(map_port as i32);
+                }
                 authdb_init();
 
                 // Timers from the old do_init — restored here after do_init was removed.
@@ -230,6 +246,10 @@ async fn main() -> Result<()> {
                 yuri::ffi::timer::timer_insert(50,   50,   Some(rust_mob_timer_spawns), 0, 0);
                 yuri::ffi::timer::timer_insert(100,  100,  Some(npc_runtimers),    0, 0);
                 yuri::ffi::timer::timer_insert(1000, 1000, Some(map_cronjob),      0, 0);
+                let tick = yuri::game::autosave::TICK_MS;
+                yuri::ffi::timer::timer_insert(tick, tick, Some(rust_pc_autosave_timer), 0, 0);
+                let reg = yuri::database::registry_writes::FLUSH_MS;
+                yuri::ffi::timer::timer_insert(reg, reg, Some(yuri::ffi::database::rust_reg_flush_timer), 0, 0);
 
                 rust_set_termfunc(Some(map_do_term));
             }
@@ -238,6 +258,11 @@ async fn main() -> Result<()> {
           .context("Init thread panicked")??;
     }
 
+    // From here on scripts run only on this thread, which drives the session
+    // loop below; work from the char server connection and other threads
+    // waits for the start of a tick.
+    yuri::game::scripting::executor::claim();
+
     let state = Arc::new(MapState::new(pool, config));
 
     // Register state with FFI bridge so C game logic can send packets to char_server.
@@ -245,6 +270,48 @@ async fn main() -> Result<()> {
     // Register intif_mmo_tosd so packet.rs can call it without linking map_game into libyuri.
     yuri::ffi::map_char::set_mmo_tosd_fn(intif_mmo_tosd);
 
+    // A replay has no network: no char server, no listener, no metrics
+    if let Some(path) = replay_file {
+        set_loop_hooks(&state);
+        let trace = std::fs::read(&path).with_context(|| format!("Cannot read trace: {}", path))?;
+        let events = yuri::capture::decode(&trace).map_err(|e| anyhow::anyhow!("{}: {}", path, e))?;
+        tracing::info!("[map] [replay] {} records from {}", events.len(), path);
+        let report = unsafe { yuri::capture::replay(&events) };
+        println!("{}", report.summary());
+        unsafe { rust_set_termfunc(None); }
+        unsafe { map_do_term(); }
+        return Ok(());
+    }
+
+    // Hot restart: the running server hands over its listener and players
+    if takeover {
+        let path = state.config.handoff_socket.clone();
+        let taken = tokio::task::spawn_blocking(move || yuri::servers::map::handoff::take_over(&path))
+            .await
+            .context("Takeover thread panicked")?;
+        match taken {
+            Ok((snapshot, fds)) => unsafe {
+                yuri::game::handoff::adopt(snapshot, fds);
+            },
+            Err(e) => {
+                tracing::error!("[map] [handoff] takeover from {} failed: {}; starting cold",
+                    state.config.handoff_socket, e);
+                if unsafe { rust_make_listen_port(state.config.map_port as i32) } < 0 {
+                    anyhow::bail!("Cannot listen on port {}", state.config.map_port);
+                }
+            }
+        }
+    }
+    if !state.config.handoff_socket.is_empty() {
+        yuri::servers::map::handoff::serve(&state.config.handoff_socket, yuri::game::handoff::request)
+            .with_context(|| format!("Cannot listen on {}", state.config.handoff_socket))?;
+    }
+
+    if !state.config.packet_capture_file.is_empty() {
+        yuri::capture::start(&state.config.packet_capture_file)
+            .with_context(|| format!("Cannot create capture: {}", state.config.packet_capture_file))?;
+    }
+
     // Spawn char server reconnect loop (replaces check_connect_char timer)
     {
         let s = Arc::clone(&state);
@@ -265,18 +332,82 @@ async fn main() -> Result<()> {
         });
     }
 
+    yuri::game::metrics::register();
+    {
+        let pool = state.db.clone();
+        yuri::metrics::register(move |w| yuri::metrics::db_pool(w, &pool));
+    }
+    yuri::metrics::spawn(&state.config.metrics_ip, state.config.map_metrics_port);
+    yuri::profiler::spawn_signal_trigger(yuri::profiler::Options::from_config(&state.config, "map"));
+
     tracing::info!("[map] [ready] Listening on {}:{}", state.config.map_ip, state.config.map_port);
 
     // Run the C session event loop. LocalSet is required for spawn_local (accept_loop,
     // session_io_task). This drives client accept + I/O until shutdown is signalled.
+    set_loop_hooks(&state);
     let local = tokio::task::LocalSet::new();
-    local.run_until(yuri::session::run_async_server(state.config.map_port)).await
-        .map_err(|e| anyhow::anyhow!("session loop error: {}", e))?;
+    loop {
+        local.run_until(yuri::session::run_async_server(state.config.map_port)).await
+            .map_err(|e| anyhow::anyhow!("session loop error: {}", e))?;
+        if !yuri::session::handed_off() {
+            break;
+        }
+
+        // Handed off: the players belong to the new process now, so no
+        // map_do_term (it would save them again and free the maps)
+        unsafe { rust_set_termfunc(None); }
+        if let Some(sock) = yuri::servers::map::handoff::requested() {
+            match yuri::game::handoff::hand_off(&state, sock).await {
+                Ok(Some(n)) => tracing::info!("[map] [handoff] handed {} players over", n),
+                // Nothing was sent: keep the players and serve on, the char
+                // link reconnects on its own
+                Ok(None) => {
+                    yuri::session::clear_handed_off();
+                    yuri::ffi::core::rust_cancel_shutdown();
+                    unsafe { rust_set_termfunc(Some(map_do_term)); }
+                    tracing::warn!("[map] [handoff] handoff aborted, still serving");
+                    continue;
+                }
+                Err(e) => tracing::error!("[map] [handoff] handoff failed: {}", e),
+            }
+        }
+        yuri::capture::finish();
+        return Ok(());
+    }
 
     tracing::info!("[map] Shutting down...");
+    yuri::capture::finish();
     // Deregister the term callback before calling map_do_term() explicitly so
     // a signal arriving after the session loop cannot fire it a second time.
     unsafe { rust_set_termfunc(None); }
     unsafe { map_do_term(); }
+    // map_do_term only queued the final saves; wait for the encoder and for
+    // the char link to write them before the runtime goes away
+    yuri::ffi::map_char::drain().await;
+    if !yuri::servers::map::char::close_char_link(&state, std::time::Duration::from_secs(10)).await {
+        tracing::error!("[map] char link was not closed cleanly, final saves may be lost");
+    }
     Ok(())
 }
+
+/// Write settings and per-tick hooks of the session loop (and of a replay).
+fn set_loop_hooks(state: &MapState) {
+    yuri::session::set_write_config(yuri::session::WriteConfig {
+        coalesce: state.config.write_coalesce,
+        flush_latency: std::time::Duration::from_millis(state.config.write_flush_ms),
+        tcp_nodelay: state.config.tcp_nodelay,
+        tcp_cork: state.config.tcp_cork,
+    });
+    // Moves queued during a tick go out ahead of the tick's socket flush.
+    yuri::session::set_before_flush(|| unsafe { clif_flush_moves() });
+    // and any other packet to a client goes out after the moves queued for it
+    yuri::session::set_before_write(|fd| unsafe { clif_flush_moves_fd(fd) });
+    // Queued work runs first; the heap sample then closes the previous tick.
+    yuri::session::set_before_tick(|| unsafe {
+        yuri::game::scripting::executor::drain();
+        yuri::game::scripting::sl_tick();
+        yuri::game::metrics::sample();
+    });
+    // Idle time at the end of a tick goes to the Lua collector
+    yuri::session::set_after_tick(|idle| unsafe { yuri::game::scripting::sl_gc_idle(idle) });
+}
@@ -0,0 +1,353 @@
+//! Sink for C log lines (the `printf`/`log_*` macros in c_deps/log.h).
+//!
+//! Each C callsite carries a static [`LogSite`]. Before formatting anything
+//! the macro asks [`admit`] whether the line would pass the `tracing` filter
+//! (target `yuri::c`) and the site's per-second budget, so a filtered or
+//! flooding callsite costs neither a snprintf nor a String.
+//!
+//! Admitted lines go into a fixed-size lock-free ring. Once [`start`] has run
+//! a background thread drains it into `tracing`, so the game thread never
+//! waits on stderr; before that (CLI tools, tests) lines are emitted inline.
+//! A full ring drops the line and counts it rather than blocking.
+
+use std::cell::UnsafeCell;
+use std::mem::MaybeUninit;
+use std::sync::atomic::{fence, AtomicBool, AtomicU32, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::thread::{JoinHandle, Thread};
+use std::time::{Duration, Instant};
+
+/// `tracing` target of every C line; `RUST_LOG=yuri::c=warn` filters them.
+pub const TARGET: &str = "yuri::c";
+
+/// Lines one callsite may log per second; the rest are counted and the
+/// next admitted line reports how many were skipped.
+pub const SITE_LINES_PER_SEC: u32 = 20;
+
+/// Lines the ring holds before new ones are dropped.
+pub const RING_SLOTS: usize = 4096;
+
+pub const ERROR: i32 = 0;
+pub const WARN: i32 = 1;
+pub const INFO: i32 = 2;
+pub const DEBUG: i32 = 3;
+
+/// Per-callsite rate limit state. Lives zero-initialized in C static storage
+/// (`struct rust_log_site` in yuri.h), hence the fixed layout.
+#[repr(C)]
+#[derive(Default)]
+pub struct LogSite {
+    /// Second (since the first C line) the budget below applies to
+    window: AtomicU32,
+    /// Lines admitted in `window`
+    count: AtomicU32,
+    /// Lines refused since the last one admitted
+    suppressed: AtomicU32,
+}
+
+impl LogSite {
+    /// Spend one line of the budget at second `now`. `Some(n)` admits the
+    /// line, `n` being how many were refused before it.
+    pub fn take(&self, now: u32, limit: u32) -> Option<u32> {
+        let window = self.window.load(Ordering::Relaxed);
+        if window != now
+            && self
+                .window
+                .compare_exchange(window, now, Ordering::Relaxed, Ordering::Relaxed)
+                .is_ok()
+        {
+            self.count.store(0, Ordering::Relaxed);
+        }
+        if self.count.fetch_add(1, Ordering::Relaxed) < limit {
+            Some(self.suppressed.swap(0, Ordering::Relaxed))
+        } else {
+            self.suppressed.fetch_add(1, Ordering::Relaxed);
+            None
+        }
+    }
+}
+
+/// Whether `tracing` would record a C line at `level` (0 error .. 3 debug).
+pub fn enabled(level: i32) -> bool {
+    use tracing::Level;
+    match level {
+        ERROR => tracing::enabled!(target: TARGET, Level::ERROR),
+        WARN => tracing::enabled!(target: TARGET, Level::WARN),
+        DEBUG => tracing::enabled!(target: TARGET, Level::DEBUG),
+        _ => tracing::enabled!(target: TARGET, Level::INFO),
+    }
+}
+
+fn now_secs() -> u32 {
+    static EPOCH: OnceLock<Instant> = OnceLock::new();
+    EPOCH.get_or_init(Instant::now).elapsed().as_secs() as u32
+}
+
+/// Gate in front of the C macros' snprintf: `None` skips the line.
+pub fn admit(level: i32, site: &LogSite) -> Option<u32> {
+    if !enabled(level) {
+        return None;
+    }
+    site.take(now_secs(), SITE_LINES_PER_SEC)
+}
+
+/// One formatted line.
+#[derive(Debug)]
+pub struct Line {
+    pub level: i32,
+    pub text: String,
+}
+
+struct Slot {
+    seq: AtomicUsize,
+    line: UnsafeCell<MaybeUninit<Line>>,
+}
+
+/// Bounded multi-producer queue (Vyukov): a slot's sequence number says
+/// whether it is free for the producer at that position or full for the
+/// consumer, so neither side takes a lock.
+pub struct Ring {
+    slots: Box<[Slot]>,
+    mask: usize,
+    head: AtomicUsize,
+    tail: AtomicUsize,
+}
+
+// Slots are only touched by the side their sequence number hands them to.
+unsafe impl Sync for Ring {}
+
+impl Ring {
+    /// `capacity` is rounded up to a power of two.
+    pub fn new(capacity: usize) -> Self {
+        let capacity = capacity.max(2).next_power_of_two();
+        let slots = (0..capacity)
+            .map(|i| Slot { seq: AtomicUsize::new(i), line: UnsafeCell::new(MaybeUninit::uninit()) })
+            .collect();
+        Ring { slots, mask: capacity - 1, head: AtomicUsize::new(0), tail: AtomicUsize::new(0) }
+    }
+
+    /// Queue `line`, or hand it back when the ring is full.
+    pub fn push(&self, line: Line) -> Result<(), Line> {
+        let mut pos = self.head.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let seq = slot.seq.load(Ordering::Acquire);
+            match seq as isize - pos as isize {
+                0 => match self.head.compare_exchange_weak(pos, pos + 1, Ordering::Relaxed, Ordering::Relaxed) {
+                    Ok(_) => {
+                        unsafe { (*slot.line.get()).write(line) };
+                        slot.seq.store(pos + 1, Ordering::Release);
+                        return Ok(());
+                    }
+                    Err(now) => pos = now,
+                },
+                d if d < 0 => return Err(line),
+                _ => pos = self.head.load(Ordering::Relaxed),
+            }
+        }
+    }
+
+    /// Whether the next pop would find nothing.
+    pub fn is_empty(&self) -> bool {
+        let pos = self.tail.load(Ordering::Relaxed);
+        self.slots[pos & self.mask].seq.load(Ordering::Acquire) != pos + 1
+    }
+
+    /// Oldest queued line.
+    pub fn pop(&self) -> Option<Line> {
+        let mut pos = self.tail.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let seq = slot.seq.load(Ordering::Acquire);
+            match seq as isize - (pos + 1) as isize {
+                0 => match self.tail.compare_exchange_weak(pos, pos + 1, Ordering::Relaxed, Ordering::Relaxed) {
+                    Ok(_) => {
+                        let line = unsafe { (*slot.line.get()).assume_init_read() };
+                        slot.seq.store(pos + self.mask + 1, Ordering::Release);
+                        return Some(line);
+                    }
+                    Err(now) => pos = now,
+                },
+                d if d < 0 => return None,
+                _ => pos = self.tail.load(Ordering::Relaxed),
+            }
+        }
+    }
+}
+
+impl Drop for Ring {
+    fn drop(&mut self) {
+        while self.pop().is_some() {}
+    }
+}
+
+static RING: OnceLock<Ring> = OnceLock::new();
+static ASYNC: AtomicBool = AtomicBool::new(false);
+static STOP: AtomicBool = AtomicBool::new(false);
+/// Set by the writer just before it parks; a producer that clears it wakes it.
+static PARKED: AtomicBool = AtomicBool::new(false);
+static DROPPED: AtomicU64 = AtomicU64::new(0);
+static WRITER: OnceLock<Thread> = OnceLock::new();
+static JOIN: Mutex<Option<JoinHandle<()>>> = Mutex::new(None);
+
+fn emit(level: i32, text: &str) {
+    let text = text.trim_end_matches('\n');
+    match level {
+        ERROR => tracing::error!(target: TARGET, "{text}"),
+        WARN => tracing::warn!(target: TARGET, "{text}"),
+        DEBUG => tracing::debug!(target: TARGET, "{text}"),
+        _ => tracing::info!(target: TARGET, "{text}"),
+    }
+}
+
+/// Log a formatted C line; `suppressed` is what [`admit`] returned.
+pub fn log(level: i32, suppressed: u32, msg: &[u8]) {
+    let mut text = String::from_utf8_lossy(msg).into_owned();
+    if suppressed > 0 {
+        while text.ends_with('\n') {
+            text.pop();
+        }
+        text.push_str(&format!(" (+{suppressed} like it suppressed)"));
+    }
+    if !ASYNC.load(Ordering::Acquire) {
+        emit(level, &text);
+        return;
+    }
+    let ring = RING.get_or_init(|| Ring::new(RING_SLOTS));
+    if ring.push(Line { level, text }).is_err() {
+        DROPPED.fetch_add(1, Ordering::Relaxed);
+    }
+    // Pairs with the fence in the writer: either it sees this line before
+    // parking or this sees it parked
+    fence(Ordering::SeqCst);
+    if PARKED.swap(false, Ordering::SeqCst) {
+        if let Some(writer) = WRITER.get() {
+            writer.unpark();
+        }
+    }
+}
+
+fn drain(ring: &Ring) {
+    while let Some(line) = ring.pop() {
+        emit(line.level, &line.text);
+    }
+    let dropped = DROPPED.swap(0, Ordering::Relaxed);
+    if dropped > 0 {
+        tracing::warn!(target: TARGET, "[log] C log ring full, dropped {dropped} lines");
+    }
+}
+
+/// Stops the writer (see [`stop`]) when dropped, so an early return from
+/// main still flushes.
+#[must_use = "dropping the guard stops the writer"]
+pub struct Writer;
+
+impl Drop for Writer {
+    fn drop(&mut self) {
+        stop();
+    }
+}
+
+/// Move C logging onto a background writer thread. Only the first call in
+/// a process starts one.
+pub fn start() -> Writer {
+    let mut join = JOIN.lock().unwrap_or_else(|e| e.into_inner());
+    if WRITER.get().is_some() {
+        return Writer;
+    }
+    let ring = RING.get_or_init(|| Ring::new(RING_SLOTS));
+    let spawned = std::thread::Builder::new().name("c-log".into()).spawn(move || loop {
+        drain(ring);
+        if STOP.load(Ordering::Acquire) {
+            return;
+        }
+        PARKED.store(true, Ordering::SeqCst);
+        fence(Ordering::SeqCst);
+        if ring.is_empty() && !STOP.load(Ordering::Acquire) {
+            std::thread::park_timeout(Duration::from_millis(100));
+        }
+        PARKED.store(false, Ordering::SeqCst);
+    });
+    match spawned {
+        Ok(handle) => {
+            let _ = WRITER.set(handle.thread().clone());
+            *join = Some(handle);
+            ASYNC.store(true, Ordering::Release);
+        }
+        Err(e) => tracing::warn!("[log] no C log writer thread, logging inline: {e}"),
+    }
+    Writer
+}
+
+/// Flush the ring and go back to inline logging. Called on shutdown so no
+/// line is lost with the process.
+pub fn stop() {
+    let Some(handle) = JOIN.lock().unwrap_or_else(|e| e.into_inner()).take() else {
+        return;
+    };
+    ASYNC.store(false, Ordering::Release);
+    STOP.store(true, Ordering::Release);
+    handle.thread().unpark();
+    let _ = handle.join();
+    // Lines a producer queued while ASYNC was switching off
+    if let Some(ring) = RING.get() {
+        drain(ring);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_site_budget_per_second() {
+        let site = LogSite::default();
+        assert_eq!(site.take(5, 3), Some(0));
+        assert_eq!(site.take(5, 3), Some(0));
+        assert_eq!(site.take(5, 3), Some(0));
+        assert_eq!(site.take(5, 3), None);
+        assert_eq!(site.take(5, 3), None);
+        // New second: budget back, and the refused lines are reported once
+        assert_eq!(site.take(6, 3), Some(2));
+        assert_eq!(site.take(6, 3), Some(0));
+    }
+
+    #[test]
+    fn test_ring_is_fifo_and_bounded() {
+        let ring = Ring::new(3);
+        for i in 0..4 {
+            assert!(ring.push(Line { level: i, text: i.to_string() }).is_ok());
+        }
+        assert_eq!(ring.push(Line { level: 9, text: "full".into() }).err().map(|l| l.text), Some("full".into()));
+        assert_eq!(ring.pop().map(|l| l.text), Some("0".into()));
+        assert!(ring.push(Line { level: 4, text: "4".into() }).is_ok());
+        let rest: Vec<String> = std::iter::from_fn(|| ring.pop()).map(|l| l.text).collect();
+        assert_eq!(rest, ["1", "2", "3", "4"]);
+        assert!(ring.pop().is_none());
+    }
+
+    #[test]
+    fn test_ring_many_producers() {
+        let ring = Ring::new(1 << 12);
+        std::thread::scope(|s| {
+            for t in 0..4 {
+                let ring = &ring;
+                s.spawn(move || {
+                    for i in 0..1000 {
+                        ring.push(Line { level: t, text: i.to_string() }).unwrap();
+                    }
+                });
+            }
+        });
+        let mut last = [-1i64; 4];
+        let mut n = 0;
+        while let Some(line) = ring.pop() {
+            // Each producer's lines stay in its own order
+            let i: i64 = line.text.parse().unwrap();
+            assert!(i > last[line.level as usize]);
+            last[line.level as usize] = i;
+            n += 1;
+        }
+        assert_eq!(n, 4000);
+    }
+}
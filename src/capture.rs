@@ -0,0 +1,521 @@
+//! Inbound packet capture and replay for the map server.
+//!
+//! With `packet_capture_file` set, the map server records every client
+//! connection it accepts: the connect, each read, and the hang-up, with
+//! microsecond timestamps and the fd. Reads are kept as they came off the
+//! socket, still encrypted; `clif_parse` decrypts them, so a replay pays the
+//! same decrypt cost live traffic does. The character loads the char server
+//! sends (the `mmo_charstatus` handed to `intif_mmo_tosd`) are recorded too,
+//! since a replay has no char server to supply them.
+//!
+//! `map_server --replay FILE` boots the world from its database as usual,
+//! then `replay` feeds the trace through the session callbacks with no
+//! sockets. Time is virtual: `timer_do` runs for every 10 ms of trace time
+//! and the C tick reads the trace clock, so timers fire at the same points
+//! between the same packets on every run, as fast as the CPU allows. Run it
+//! against a copy of the database the trace was taken on.
+//!
+//! A trace is `MAGIC` followed by records of kind (u8), fd (u16 LE),
+//! microseconds since the previous record (varint), payload length (varint)
+//! and the payload.
+
+use std::fs::File;
+use std::io::{BufWriter, Write};
+use std::sync::atomic::{AtomicBool, Ordering::Relaxed};
+use std::sync::Mutex;
+use std::time::Instant;
+
+pub const MAGIC: &[u8; 5] = b"YTRC\x01";
+
+const OPEN: u8 = 1;
+const DATA: u8 = 2;
+const CHAR_LOAD: u8 = 3;
+const CLOSE: u8 = 4;
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub enum Record {
+    /// Accepted from `ip` (network order, as `client_addr_raw`)
+    Open { ip: u32 },
+    /// Bytes read from the socket
+    Data(Vec<u8>),
+    /// Decompressed `mmo_charstatus` from the char server
+    CharLoad(Vec<u8>),
+    /// Peer hung up or the server closed the session
+    Close,
+}
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct Event {
+    /// Microseconds since the capture started
+    pub at_us: u64,
+    pub fd: u16,
+    pub record: Record,
+}
+
+fn put_varint(out: &mut Vec<u8>, mut v: u64) {
+    while v >= 0x80 {
+        out.push(v as u8 | 0x80);
+        v >>= 7;
+    }
+    out.push(v as u8);
+}
+
+fn get_varint(buf: &[u8], pos: &mut usize) -> Option<u64> {
+    let mut v = 0u64;
+    for shift in (0..64).step_by(7) {
+        let b = *buf.get(*pos)?;
+        *pos += 1;
+        v |= ((b & 0x7F) as u64) << shift;
+        if b & 0x80 == 0 {
+            return Some(v);
+        }
+    }
+    None
+}
+
+/// Appends records to a trace; timestamps are stored as deltas.
+#[derive(Default)]
+pub struct Encoder {
+    last_us: u64,
+}
+
+impl Encoder {
+    pub fn encode(&mut self, out: &mut Vec<u8>, at_us: u64, fd: u16, kind: u8, payload: &[u8]) {
+        out.push(kind);
+        out.extend_from_slice(&fd.to_le_bytes());
+        put_varint(out, at_us.saturating_sub(self.last_us));
+        self.last_us = self.last_us.max(at_us);
+        put_varint(out, payload.len() as u64);
+        out.extend_from_slice(payload);
+    }
+
+    pub fn event(&mut self, out: &mut Vec<u8>, e: &Event) {
+        match &e.record {
+            Record::Open { ip } => self.encode(out, e.at_us, e.fd, OPEN, &ip.to_be_bytes()),
+            Record::Data(b) => self.encode(out, e.at_us, e.fd, DATA, b),
+            Record::CharLoad(b) => self.encode(out, e.at_us, e.fd, CHAR_LOAD, b),
+            Record::Close => self.encode(out, e.at_us, e.fd, CLOSE, &[]),
+        }
+    }
+}
+
+/// Parse a whole trace. A trace cut short by a crash keeps every complete
+/// record before the cut.
+pub fn decode(buf: &[u8]) -> Result<Vec<Event>, String> {
+    if !buf.starts_with(MAGIC) {
+        return Err("not a packet trace (bad magic or version)".into());
+    }
+    let mut pos = MAGIC.len();
+    let mut at_us = 0u64;
+    let mut events = Vec::new();
+    while pos < buf.len() {
+        let Some(e) = (|| {
+            let kind = *buf.get(pos)?;
+            let fd = u16::from_le_bytes([*buf.get(pos + 1)?, *buf.get(pos + 2)?]);
+            pos += 3;
+            let dt = get_varint(buf, &mut pos)?;
+            let len = get_varint(buf, &mut pos)? as usize;
+            let payload = buf.get(pos..pos.checked_add(len)?)?;
+            pos += len;
+            at_us += dt;
+            let record = match kind {
+                OPEN => Record::Open { ip: u32::from_be_bytes(payload.try_into().ok()?) },
+                DATA => Record::Data(payload.to_vec()),
+                CHAR_LOAD => Record::CharLoad(payload.to_vec()),
+                CLOSE => Record::Close,
+                _ => return None,
+            };
+            Some(Event { at_us, fd, record })
+        })() else {
+            tracing::warn!("[capture] trace ends in a partial or unknown record at byte {}", pos);
+            break;
+        };
+        events.push(e);
+    }
+    Ok(events)
+}
+
+struct Capture {
+    out: BufWriter<File>,
+    enc: Encoder,
+    start: Instant,
+    buf: Vec<u8>,
+}
+
+static ON: AtomicBool = AtomicBool::new(false);
+static CAPTURE: Mutex<Option<Capture>> = Mutex::new(None);
+
+/// Start recording to `path`, replacing any file there.
+pub fn start(path: &str) -> std::io::Result<()> {
+    let mut out = BufWriter::with_capacity(1 << 20, File::create(path)?);
+    out.write_all(MAGIC)?;
+    *CAPTURE.lock().unwrap_or_else(|e| e.into_inner()) =
+        Some(Capture { out, enc: Encoder::default(), start: Instant::now(), buf: Vec::new() });
+    ON.store(true, Relaxed);
+    tracing::info!("[capture] recording client packets to {}", path);
+    Ok(())
+}
+
+#[inline]
+pub fn enabled() -> bool {
+    ON.load(Relaxed)
+}
+
+fn record(fd: i32, kind: u8, payload: &[u8]) {
+    let mut guard = CAPTURE.lock().unwrap_or_else(|e| e.into_inner());
+    let Some(c) = guard.as_mut() else { return };
+    let at_us = c.start.elapsed().as_micros() as u64;
+    c.buf.clear();
+    c.enc.encode(&mut c.buf, at_us, fd as u16, kind, payload);
+    if let Err(e) = c.out.write_all(&c.buf) {
+        tracing::error!("[capture] write failed, capture stopped: {}", e);
+        ON.store(false, Relaxed);
+        *guard = None;
+    }
+}
+
+pub fn open(fd: i32, ip: u32) {
+    record(fd, OPEN, &ip.to_be_bytes());
+}
+
+pub fn data(fd: i32, bytes: &[u8]) {
+    if !bytes.is_empty() {
+        record(fd, DATA, bytes);
+    }
+}
+
+pub fn char_load(fd: i32, status: &[u8]) {
+    if enabled() {
+        record(fd, CHAR_LOAD, status);
+    }
+}
+
+pub fn close(fd: i32) {
+    record(fd, CLOSE, &[]);
+}
+
+/// Flush and close the trace.
+pub fn finish() {
+    ON.store(false, Relaxed);
+    if let Some(mut c) = CAPTURE.lock().unwrap_or_else(|e| e.into_inner()).take() {
+        if let Err(e) = c.out.flush() {
+            tracing::error!("[capture] flush failed: {}", e);
+        }
+    }
+}
+
+/// What a replay did and what it cost.
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct ReplayReport {
+    /// Trace time covered, in microseconds
+    pub span_us: u64,
+    pub sessions: u64,
+    /// Parse callbacks that consumed input, one per packet
+    pub packets: u64,
+    pub bytes_in: u64,
+    /// Bytes the server wrote back (discarded)
+    pub bytes_out: u64,
+    pub char_loads: u64,
+    pub ticks: u64,
+    /// Sessions the server closed itself before the trace did
+    pub kicked: u64,
+    /// Records for sessions already closed
+    pub dropped: u64,
+    /// Game-thread CPU and wall time of the whole replay
+    pub cpu_ns: u64,
+    pub wall_ns: u64,
+}
+
+impl ReplayReport {
+    /// CPU seconds spent per second of replayed traffic.
+    pub fn cpu_per_second(&self) -> f64 {
+        if self.span_us == 0 {
+            return 0.0;
+        }
+        (self.cpu_ns as f64 / 1e9) / (self.span_us as f64 / 1e6)
+    }
+
+    pub fn summary(&self) -> String {
+        format!(
+            "replayed {:.1}s in {:.2}s wall: cpu {:.3}s ({:.2} ms per replayed second, {:.1} us per packet), \
+             {} sessions, {} packets, {} KiB in, {} KiB out, {} char loads, {} ticks, {} kicked, {} dropped",
+            self.span_us as f64 / 1e6,
+            self.wall_ns as f64 / 1e9,
+            self.cpu_ns as f64 / 1e9,
+            self.cpu_per_second() * 1000.0,
+            self.cpu_ns as f64 / 1e3 / self.packets.max(1) as f64,
+            self.sessions,
+            self.packets,
+            self.bytes_in / 1024,
+            self.bytes_out / 1024,
+            self.char_loads,
+            self.ticks,
+            self.kicked,
+            self.dropped
+        )
+    }
+}
+
+#[cfg(not(test))]
+mod replay {
+    use std::collections::HashMap;
+    use std::sync::atomic::{AtomicU32, Ordering::Relaxed};
+    use std::sync::Arc;
+    use std::time::Instant;
+
+    use tokio::sync::Mutex;
+
+    use super::{Event, Record, ReplayReport};
+    use crate::ffi::timer;
+    use crate::session::{self, get_session_manager, Session, SessionManager};
+
+    /// Trace time between two `timer_do` calls, as in run_async_server.
+    const TICK_US: u64 = 10_000;
+
+    static VIRTUAL_MS: AtomicU32 = AtomicU32::new(0);
+
+    unsafe extern "C" fn virtual_tick() -> u32 {
+        VIRTUAL_MS.load(Relaxed)
+    }
+
+    fn thread_cpu_ns() -> u64 {
+        let mut ts: libc::timespec = unsafe { std::mem::zeroed() };
+        unsafe { libc::clock_gettime(libc::CLOCK_THREAD_CPUTIME_ID, &mut ts) };
+        ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+    }
+
+    struct Replay<'a> {
+        manager: &'a SessionManager,
+        /// Trace fd to the fd the replayed session got
+        fds: HashMap<u16, (i32, Arc<Mutex<Session>>)>,
+        r: ReplayReport,
+    }
+
+    impl Replay<'_> {
+        /// The parse loop of session_io_task, over what is in rdata.
+        unsafe fn parse(&mut self, fd: i32, arc: &Arc<Mutex<Session>>) {
+            let (parse_cb, mut available) = {
+                let Ok(mut s) = arc.try_lock() else { return };
+                let (_, available) = s.pin_read();
+                (s.callbacks.parse, available)
+            };
+            if let Some(cb) = parse_cb {
+                while available > 0 {
+                    let ret = cb(fd);
+                    if ret == 2 || self.manager.eof(fd) != 0 {
+                        break;
+                    }
+                    let Ok(new_available) = arc.try_lock().map(|s| s.available()) else { break };
+                    if new_available >= available {
+                        break;
+                    }
+                    self.r.packets += 1;
+                    available = new_available;
+                }
+            }
+            if let Ok(mut s) = arc.try_lock() {
+                s.flush_read_buffer();
+                s.unpin_read();
+            }
+        }
+
+        /// Tear a session down the way session_io_task does on eof.
+        unsafe fn close(&mut self, fd: i32, arc: &Arc<Mutex<Session>>) {
+            let Ok(mut s) = arc.try_lock() else { return };
+            let (parse_cb, shutdown_cb) = (s.callbacks.parse, s.claim_shutdown());
+            drop(s);
+            if let Some(cb) = parse_cb {
+                cb(fd);
+            }
+            if let Some(cb) = shutdown_cb {
+                cb(fd);
+            }
+            self.manager.remove_session(fd);
+        }
+
+        /// Drop what the server wrote, and close sessions it hung up on.
+        unsafe fn settle(&mut self) {
+            let mut closed = Vec::new();
+            for (&tfd, (fd, arc)) in &self.fds {
+                if let Ok(mut s) = arc.try_lock() {
+                    self.r.bytes_out += s.discard_wdata() as u64;
+                }
+                if self.manager.eof(*fd) != 0 {
+                    closed.push(tfd);
+                }
+            }
+            for tfd in closed {
+                let (fd, arc) = self.fds.remove(&tfd).unwrap();
+                self.r.kicked += 1;
+                self.close(fd, &arc);
+            }
+        }
+
+        unsafe fn tick(&mut self) {
+            session::run_before_tick();
+            timer::timer_do(timer::gettick());
+            session::run_before_flush();
+            session::flush_queued_writes();
+            self.r.ticks += 1;
+            self.settle();
+        }
+
+        unsafe fn apply(&mut self, e: &Event) {
+            match &e.record {
+                Record::Open { ip } => {
+                    let Ok(fd) = self.manager.allocate_fd() else {
+                        self.r.dropped += 1;
+                        return;
+                    };
+                    let mut s = Session::new(fd);
+                    s.client_addr_raw = *ip;
+                    s.client_addr = Some((std::net::Ipv4Addr::from(u32::from_be(*ip)), 0).into());
+                    s.callbacks = self.manager.get_default_callbacks();
+                    let accept_cb = s.callbacks.accept;
+                    let arc = Arc::new(Mutex::new(s));
+                    if self.manager.insert_session(fd, arc.clone()).is_err() {
+                        self.r.dropped += 1;
+                        return;
+                    }
+                    crate::ffi::session::update_fd_max_pub(fd);
+                    self.r.sessions += 1;
+                    self.fds.insert(e.fd, (fd, arc));
+                    if let Some(cb) = accept_cb {
+                        cb(fd);
+                    }
+                }
+                Record::Data(bytes) => {
+                    let Some((fd, arc)) = self.fds.get(&e.fd).cloned() else {
+                        self.r.dropped += 1;
+                        return;
+                    };
+                    if let Ok(mut s) = arc.try_lock() {
+                        s.push_read(bytes);
+                    }
+                    self.r.bytes_in += bytes.len() as u64;
+                    self.parse(fd, &arc);
+                }
+                Record::CharLoad(status) => {
+                    let Some(&(fd, _)) = self.fds.get(&e.fd) else {
+                        self.r.dropped += 1;
+                        return;
+                    };
+                    let mut raw = status.clone();
+                    crate::ffi::map_char::call_intif_mmo_tosd(fd, &mut raw);
+                    self.r.char_loads += 1;
+                }
+                Record::Close => {
+                    let Some((fd, arc)) = self.fds.remove(&e.fd) else {
+                        self.r.dropped += 1;
+                        return;
+                    };
+                    self.manager.set_eof(fd, 4);
+                    self.close(fd, &arc);
+                }
+            }
+            self.settle();
+        }
+    }
+
+    /// Replay `events` on the calling thread, which must be the game thread
+    /// with the world loaded and no session loop running.
+    pub unsafe fn replay(events: &[Event]) -> ReplayReport {
+        let mut rp = Replay { manager: get_session_manager(), fds: HashMap::new(), r: ReplayReport::default() };
+        let base = timer::gettick_nocache();
+        VIRTUAL_MS.store(base, Relaxed);
+        timer::timer_set_tick_source(Some(virtual_tick));
+        // Same random stream every run (mob spawns seeded it from the clock)
+        libc::srand(1);
+
+        let (cpu0, wall0) = (thread_cpu_ns(), Instant::now());
+        let mut next_tick_us = 0u64;
+        for e in events {
+            while next_tick_us <= e.at_us {
+                VIRTUAL_MS.store(base.wrapping_add((next_tick_us / 1000) as u32), Relaxed);
+                rp.tick();
+                next_tick_us += TICK_US;
+            }
+            rp.apply(e);
+        }
+        // Whoever is still on hangs up when the trace ends
+        let open: Vec<u16> = rp.fds.keys().copied().collect();
+        for tfd in open {
+            let (fd, arc) = rp.fds.remove(&tfd).unwrap();
+            rp.manager.set_eof(fd, 4);
+            rp.close(fd, &arc);
+        }
+        rp.r.cpu_ns = thread_cpu_ns() - cpu0;
+        rp.r.wall_ns = wall0.elapsed().as_nanos() as u64;
+        rp.r.span_us = events.last().map_or(0, |e| e.at_us);
+
+        timer::timer_set_tick_source(None);
+        rp.r
+    }
+}
+
+#[cfg(not(test))]
+pub use replay::replay;
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn trace(events: &[Event]) -> Vec<u8> {
+        let mut out = MAGIC.to_vec();
+        let mut enc = Encoder::default();
+        for e in events {
+            enc.event(&mut out, e);
+        }
+        out
+    }
+
+    #[test]
+    fn test_trace_round_trip() {
+        let events = vec![
+            Event { at_us: 0, fd: 7, record: Record::Open { ip: 0x0100007F } },
+            Event { at_us: 150, fd: 7, record: Record::Data(vec![0xAA, 0, 4, 0x10, 1, 2, 3]) },
+            Event { at_us: 150, fd: 8, record: Record::Open { ip: 0 } },
+            Event { at_us: 20_000, fd: 7, record: Record::CharLoad(vec![9; 300]) },
+            Event { at_us: 3_000_000_000, fd: 7, record: Record::Close },
+        ];
+        let buf = trace(&events);
+        assert_eq!(decode(&buf).unwrap(), events);
+        // Kind and fd, then varint delta and length: 9 + 13 + 9 + 308 + 9
+        assert_eq!(buf.len(), MAGIC.len() + 348);
+    }
+
+    #[test]
+    fn test_truncated_and_foreign_traces() {
+        assert!(decode(b"GIF89a").is_err());
+        assert_eq!(decode(MAGIC).unwrap(), vec![]);
+
+        let events = vec![
+            Event { at_us: 5, fd: 1, record: Record::Data(vec![1, 2, 3]) },
+            Event { at_us: 9, fd: 1, record: Record::Data(vec![4; 50]) },
+        ];
+        let buf = trace(&events);
+        // Cut into the second record: the first survives
+        assert_eq!(decode(&buf[..buf.len() - 10]).unwrap(), events[..1]);
+    }
+
+    #[test]
+    fn test_varint_bounds() {
+        for v in [0, 1, 127, 128, 300, 1 << 35, u64::MAX] {
+            let mut out = Vec::new();
+            put_varint(&mut out, v);
+            let mut pos = 0;
+            assert_eq!(get_varint(&out, &mut pos), Some(v));
+            assert_eq!(pos, out.len());
+        }
+        assert_eq!(get_varint(&[0x80, 0x80], &mut 0), None);
+    }
+
+    #[test]
+    fn test_report_rates() {
+        let r = ReplayReport { span_us: 10_000_000, cpu_ns: 500_000_000, packets: 1000, ..Default::default() };
+        assert!((r.cpu_per_second() - 0.05).abs() < 1e-12);
+        assert!(r.summary().contains("50.00 ms per replayed second"));
+        assert!(r.summary().contains("500.0 us per packet"));
+        assert_eq!(ReplayReport::default().cpu_per_second(), 0.0);
+    }
+}
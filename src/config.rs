@@ -95,6 +95,10 @@ pub struct ServerConfig {
     #[serde(default)]
     pub server_id: i32,
 
+    /// Map server: log a timer tick that runs longer than this (ms, 0 = off)
+    #[serde(default = "default_timer_slow_tick_ms")]
+    pub timer_slow_tick_ms: i32,
+
     // ============================================
     // Encryption & Security
     // ============================================
@@ -124,6 +128,41 @@ pub struct ServerConfig {
     #[serde(default = "default_save_time")]
     pub save_time: i32,
 
+    /// Most autosaves started per 100 ms scheduler tick
+    #[serde(default = "default_save_budget")]
+    pub save_budget: i32,
+
+    /// Char server: milliseconds of saves merged into one DB transaction
+    #[serde(default = "default_save_batch_ms")]
+    pub save_batch_ms: i32,
+
+    /// Map server: zstd level of batched saves to the char server
+    /// (0 = legacy zlib 0x3004/0x3007 only)
+    #[serde(default = "default_save_zstd_level")]
+    pub save_zstd_level: i32,
+
+    /// Char server: logged-out characters kept in memory for quick relogs
+    #[serde(default = "default_char_cache_size")]
+    pub char_cache_size: i32,
+
+    /// Char server: bcrypt threads for password checks (0 = half the cores)
+    #[serde(default)]
+    pub hash_workers: u32,
+
+    /// Char server: password checks waiting for a bcrypt thread before new
+    /// logins are refused
+    #[serde(default = "default_hash_queue")]
+    pub hash_queue: u32,
+
+    /// Char server: logins from one client address in their password check
+    /// at once
+    #[serde(default = "default_hash_per_ip")]
+    pub hash_per_ip: u32,
+
+    /// Char server: boards and mailboxes whose pages are kept in memory
+    #[serde(default = "default_board_cache_size")]
+    pub board_cache_size: i32,
+
     /// XP rate multiplier
     #[serde(default = "default_xprate")]
     pub xprate: i32,
@@ -132,6 +171,11 @@ pub struct ServerConfig {
     #[serde(default = "default_droprate")]
     pub droprate: i32,
 
+    /// Map server: remove floor items once their map's `sweeptime` has
+    /// passed since they were dropped
+    #[serde(default)]
+    pub item_sweep: bool,
+
     // ============================================
     // Meta Files & Towns
     // ============================================
@@ -157,6 +201,100 @@ pub struct ServerConfig {
 
     #[serde(default = "default_meta_dir")]
     pub meta_dir: String,
+
+    /// Compiled LuaJIT bytecode of the scripts, keyed by source hash;
+    /// empty disables the cache
+    #[serde(default = "default_lua_cache_dir")]
+    pub lua_cache_dir: String,
+
+    /// Precompiled map tiles, memory-mapped and shared by every map server
+    /// on the host; empty disables the cache
+    #[serde(default = "default_map_cache_dir")]
+    pub map_cache_dir: String,
+
+    /// Snapshots of the item, mob, spell and recipe tables, reused while
+    /// the tables are unchanged; empty disables them
+    #[serde(default = "default_db_snapshot_dir")]
+    pub db_snapshot_dir: String,
+
+    // ============================================
+    // Network Write Tuning
+    // ============================================
+    /// Coalesce session writes: packets committed inside one timer/parse
+    /// pass are flushed once at end of tick instead of on every WFIFOSET
+    #[serde(default)]
+    pub write_coalesce: bool,
+
+    /// Longest a coalesced write may wait before it is flushed (milliseconds)
+    #[serde(default = "default_write_flush_ms")]
+    pub write_flush_ms: u64,
+
+    /// Set TCP_NODELAY on client sockets
+    #[serde(default)]
+    pub tcp_nodelay: bool,
+
+    /// Keep client sockets corked between flushes (Linux TCP_CORK)
+    #[serde(default)]
+    pub tcp_cork: bool,
+
+    // ============================================
+    // Lua Collector Tuning
+    // ============================================
+    /// Incremental GC step run in idle loop time each tick (KB); 0 leaves
+    /// collection entirely to LuaJIT
+    #[serde(default = "default_lua_gc_step_kb")]
+    pub lua_gc_step_kb: u32,
+
+    /// Heap growth (percent of the live heap) before LuaJIT starts a new
+    /// cycle on its own
+    #[serde(default = "default_lua_gc_pause")]
+    pub lua_gc_pause: u32,
+
+    // ============================================
+    // Metrics
+    // ============================================
+    /// Address the Prometheus metrics endpoints listen on
+    #[serde(default = "default_metrics_ip")]
+    pub metrics_ip: String,
+
+    /// Metrics port of each server (0 = off)
+    #[serde(default)]
+    pub login_metrics_port: u16,
+    #[serde(default)]
+    pub char_metrics_port: u16,
+    #[serde(default)]
+    pub map_metrics_port: u16,
+
+    // ============================================
+    // Packet Capture
+    // ============================================
+    /// Record the map server's inbound client traffic to this file for
+    /// `map_server --replay` (empty = off)
+    #[serde(default)]
+    pub packet_capture_file: String,
+
+    // ============================================
+    // Profiling
+    // ============================================
+    /// Where `@profile` and SIGUSR2 write their folded stacks
+    #[serde(default = "default_profile_dir")]
+    pub profile_dir: String,
+
+    /// Length of a profile when none is given
+    #[serde(default = "default_profile_seconds")]
+    pub profile_seconds: u64,
+
+    /// Samples per CPU-second
+    #[serde(default = "default_profile_hz")]
+    pub profile_hz: u32,
+
+    // ============================================
+    // Hot Restart
+    // ============================================
+    /// Unix socket a running map server listens on for `map_server
+    /// --takeover`, which inherits its listener and players (empty = off)
+    #[serde(default)]
+    pub handoff_socket: String,
 }
 
 // ============================================
@@ -180,6 +318,10 @@ fn default_map_port() -> u16 {
     2001
 }
 
+fn default_timer_slow_tick_ms() -> i32 {
+    50
+}
+
 fn default_version() -> i32 {
     750
 }
@@ -192,6 +334,34 @@ fn default_save_time() -> i32 {
     60
 }
 
+fn default_save_budget() -> i32 {
+    4
+}
+
+fn default_save_batch_ms() -> i32 {
+    200
+}
+
+fn default_save_zstd_level() -> i32 {
+    1
+}
+
+fn default_char_cache_size() -> i32 {
+    256
+}
+
+fn default_hash_queue() -> u32 {
+    128
+}
+
+fn default_hash_per_ip() -> u32 {
+    2
+}
+
+fn default_board_cache_size() -> i32 {
+    512
+}
+
 fn default_xprate() -> i32 {
     10
 }
@@ -216,6 +386,46 @@ fn default_meta_dir() -> String {
     "./data/meta/".to_string()
 }
 
+fn default_lua_cache_dir() -> String {
+    "./data/cache/lua/".to_string()
+}
+
+fn default_map_cache_dir() -> String {
+    "./data/cache/maps/".to_string()
+}
+
+fn default_db_snapshot_dir() -> String {
+    "./data/cache/db/".to_string()
+}
+
+fn default_write_flush_ms() -> u64 {
+    10
+}
+
+fn default_lua_gc_step_kb() -> u32 {
+    64
+}
+
+fn default_lua_gc_pause() -> u32 {
+    200
+}
+
+fn default_metrics_ip() -> String {
+    "127.0.0.1".to_string()
+}
+
+fn default_profile_dir() -> String {
+    "./data/profiles/".to_string()
+}
+
+fn default_profile_seconds() -> u64 {
+    30
+}
+
+fn default_profile_hz() -> u32 {
+    99
+}
+
 impl ServerConfig {
     /// Load configuration from a YAML file
     ///
@@ -293,6 +503,18 @@ impl ServerConfig {
             );
         }
 
+        anyhow::ensure!(
+            (1..=1000).contains(&self.write_flush_ms),
+            "write_flush_ms out of range: {} (1-1000)",
+            self.write_flush_ms
+        );
+
+        anyhow::ensure!(
+            (100..=1000).contains(&self.lua_gc_pause),
+            "lua_gc_pause out of range: {} (100-1000)",
+            self.lua_gc_pause
+        );
+
         Ok(())
     }
 
@@ -368,12 +590,22 @@ start_point:
         assert_eq!(config.char_port, 2005);
         assert_eq!(config.map_port, 2001);
         assert_eq!(config.server_id, 0);
+        assert_eq!(config.timer_slow_tick_ms, 50);
         assert_eq!(config.version, 750);
         assert_eq!(config.deep, 0);
         assert_eq!(config.require_reg, 1);
         assert_eq!(config.save_time, 60);
+        assert_eq!(config.save_budget, 4);
+        assert_eq!(config.save_batch_ms, 200);
+        assert_eq!(config.save_zstd_level, 1);
+        assert_eq!(config.hash_workers, 0);
+        assert_eq!(config.hash_queue, 128);
+        assert_eq!(config.hash_per_ip, 2);
+        assert_eq!(config.char_cache_size, 256);
+        assert_eq!(config.board_cache_size, 512);
         assert_eq!(config.xprate, 10);
         assert_eq!(config.droprate, 1);
+        assert!(!config.item_sweep);
     }
 
     #[test]
@@ -663,6 +895,68 @@ town:
         assert_eq!(config.start_point, Point::new(0, 1, 1));
     }
 
+    #[test]
+    fn test_write_tuning_defaults() {
+        let config = ServerConfig::from_str(minimal_config()).unwrap();
+        assert!(!config.write_coalesce);
+        assert_eq!(config.write_flush_ms, 10);
+        assert!(!config.tcp_nodelay);
+        assert!(!config.tcp_cork);
+
+        let mut config_str = String::from(minimal_config());
+        config_str.push_str("\nwrite_flush_ms: 0\n");
+        let err_msg = format!("{}", ServerConfig::from_str(&config_str).unwrap_err());
+        assert!(err_msg.contains("write_flush_ms"));
+    }
+
+    #[test]
+    fn test_lua_defaults() {
+        let config = ServerConfig::from_str(minimal_config()).unwrap();
+        assert_eq!(config.lua_gc_step_kb, 64);
+        assert_eq!(config.lua_gc_pause, 200);
+        assert_eq!(config.lua_cache_dir, "./data/cache/lua/");
+        assert_eq!(config.map_cache_dir, "./data/cache/maps/");
+        assert_eq!(config.db_snapshot_dir, "./data/cache/db/");
+
+        let mut config_str = String::from(minimal_config());
+        config_str.push_str("\nlua_gc_pause: 50\n");
+        let err_msg = format!("{}", ServerConfig::from_str(&config_str).unwrap_err());
+        assert!(err_msg.contains("lua_gc_pause"));
+    }
+
+    #[test]
+    fn test_metrics_defaults() {
+        let config = ServerConfig::from_str(minimal_config()).unwrap();
+        assert_eq!(config.metrics_ip, "127.0.0.1");
+        assert_eq!(config.login_metrics_port, 0);
+        assert_eq!(config.char_metrics_port, 0);
+        assert_eq!(config.map_metrics_port, 0);
+    }
+
+    #[test]
+    fn test_packet_capture_off_by_default() {
+        let config = ServerConfig::from_str(minimal_config()).unwrap();
+        assert_eq!(config.packet_capture_file, "");
+        let config = ServerConfig::from_str(&format!("{}\npacket_capture_file: trace.ytr\n", minimal_config())).unwrap();
+        assert_eq!(config.packet_capture_file, "trace.ytr");
+    }
+
+    #[test]
+    fn test_profile_defaults() {
+        let config = ServerConfig::from_str(minimal_config()).unwrap();
+        assert_eq!(config.profile_dir, "./data/profiles/");
+        assert_eq!(config.profile_seconds, 30);
+        assert_eq!(config.profile_hz, 99);
+    }
+
+    #[test]
+    fn test_handoff_off_by_default() {
+        let config = ServerConfig::from_str(minimal_config()).unwrap();
+        assert_eq!(config.handoff_socket, "");
+        let config = ServerConfig::from_str(&format!("{}\nhandoff_socket: /run/yuri/map.sock\n", minimal_config())).unwrap();
+        assert_eq!(config.handoff_socket, "/run/yuri/map.sock");
+    }
+
     #[test]
     fn test_save_and_load() {
         let config = ServerConfig::from_str(minimal_config()).unwrap();
@@ -47,6 +47,11 @@ impl ServerState {
         self.shutdown_requested
     }
 
+    /// Withdraw a shutdown request (an aborted handoff goes back to serving)
+    pub fn cancel_shutdown(&mut self) {
+        self.shutdown_requested = false;
+    }
+
     /// Set the termination callback function
     pub fn set_term_func<F>(&mut self, func: F)
     where
@@ -78,6 +83,13 @@ pub fn create_server_state() -> SharedServerState {
     Arc::new(Mutex::new(ServerState::new()))
 }
 
+/// Monotonic nanoseconds since the first call, for timing work that starts
+/// on one side of the FFI boundary and ends on the other.
+pub fn monotonic_ns() -> u64 {
+    static EPOCH: std::sync::OnceLock<std::time::Instant> = std::sync::OnceLock::new();
+    EPOCH.get_or_init(std::time::Instant::now).elapsed().as_nanos() as u64
+}
+
 /// Signal types that can trigger server shutdown
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum Signal {
@@ -0,0 +1,392 @@
+//! Compact per-cell entity index for the block grid.
+//!
+//! The grid's intrusive `block_list` chains thread through player, mob and
+//! NPC structs several KB apart, so an area scan touches one cache line per
+//! entity just to read its position and type. `CellIndex` mirrors the chains
+//! as one small vector of `CellEntry` per BLOCK_SIZE×BLOCK_SIZE cell. The
+//! vector holds everything a scan filters on, and block cells wholly inside
+//! the query rectangle need no per-entry position test at all.
+//!
+//! `Plan` resolves a set of (possibly overlapping) query rectangles to the
+//! cells they cover, so multi-rectangle queries scan each cell once.
+//!
+//! Kept in step by map_addblock/map_delblock/map_moveblock (ffi/block.rs).
+//! Entries are keyed by block_list address; this module never dereferences them.
+
+use std::collections::HashMap;
+
+use crate::database::map_db::BLOCK_SIZE;
+
+/// One grid entity as seen by a scan. 24 bytes.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct CellEntry {
+    pub addr: usize,
+    pub id: u32,
+    /// Assigned by `insert`, kept by `relocate`: a changed serial means the
+    /// entity left the grid and came back (warp, respawn, id reuse)
+    pub serial: u32,
+    pub x: u16,
+    pub y: u16,
+    pub bl_type: u8,
+}
+
+/// Inclusive tile rectangle (x0, y0, x1, y1), already clamped to the map.
+pub type Tiles = (i32, i32, i32, i32);
+
+#[inline]
+fn tiles_contain(r: &Tiles, x: i32, y: i32) -> bool {
+    x >= r.0 && x <= r.2 && y >= r.1 && y <= r.3
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct PlanCell {
+    cell: u32,
+    /// Range of `Plan::filters` an entry must fall in; empty means the
+    /// query covers the whole cell
+    first: u16,
+    len: u16,
+}
+
+/// A set of tile rectangles resolved to the block cells they touch, each
+/// cell listed once in row-major order. Overlapping rectangles therefore
+/// never scan a cell, or report an entry, twice.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct Plan {
+    bxs: usize,
+    bys: usize,
+    cells: Vec<PlanCell>,
+    filters: Vec<Tiles>,
+}
+
+impl Plan {
+    /// Plan `rects` on a `xs`×`ys` map of `bxs`×`bys` cells.
+    pub fn build(bxs: usize, bys: usize, xs: i32, ys: i32, rects: &[Tiles]) -> Self {
+        let mut plan = Plan { bxs, bys, ..Default::default() };
+        let rects: Vec<Tiles> = rects
+            .iter()
+            .map(|r| (r.0.max(0), r.1.max(0), r.2.min(xs - 1), r.3.min(ys - 1)))
+            .filter(|r| r.0 <= r.2 && r.1 <= r.3)
+            .collect();
+        if rects.is_empty() || bxs == 0 || bys == 0 {
+            return plan;
+        }
+        let bs = BLOCK_SIZE as i32;
+        let by0 = rects.iter().map(|r| r.1 / bs).min().unwrap_or(0);
+        let by1 = rects.iter().map(|r| r.3 / bs).max().unwrap_or(0).min(bys as i32 - 1);
+        let bx0 = rects.iter().map(|r| r.0 / bs).min().unwrap_or(0);
+        let bx1 = rects.iter().map(|r| r.2 / bs).max().unwrap_or(0).min(bxs as i32 - 1);
+        let mut clipped = Vec::new();
+        for by in by0..=by1 {
+            for bx in bx0..=bx1 {
+                // The cell's tiles that exist on the map
+                let cell = (bx * bs, by * bs, (bx * bs + bs - 1).min(xs - 1), (by * bs + bs - 1).min(ys - 1));
+                clipped.clear();
+                clipped.extend(
+                    rects
+                        .iter()
+                        .map(|r| (r.0.max(cell.0), r.1.max(cell.1), r.2.min(cell.2), r.3.min(cell.3)))
+                        .filter(|r| r.0 <= r.2 && r.1 <= r.3),
+                );
+                if clipped.is_empty() {
+                    continue;
+                }
+                let index = (bx as usize + by as usize * bxs) as u32;
+                if clipped.contains(&cell) {
+                    plan.cells.push(PlanCell { cell: index, first: 0, len: 0 });
+                    continue;
+                }
+                let first = plan.filters.len();
+                for (i, r) in clipped.iter().enumerate() {
+                    // Drop pieces another piece already covers
+                    let covered = clipped.iter().enumerate().any(|(j, o)| {
+                        j != i && o.0 <= r.0 && o.1 <= r.1 && o.2 >= r.2 && o.3 >= r.3 && (o != r || j < i)
+                    });
+                    if !covered {
+                        plan.filters.push(*r);
+                    }
+                }
+                let len = plan.filters.len() - first;
+                plan.cells.push(PlanCell { cell: index, first: first as u16, len: len as u16 });
+            }
+        }
+        plan
+    }
+
+    pub fn dims(&self) -> (usize, usize) {
+        (self.bxs, self.bys)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.cells.is_empty()
+    }
+
+    /// Number of block cells the plan scans.
+    pub fn cell_count(&self) -> usize {
+        self.cells.len()
+    }
+}
+
+#[derive(Debug, Default)]
+pub struct CellIndex {
+    bxs: usize,
+    bys: usize,
+    cells: Vec<Vec<CellEntry>>,
+    /// Cell each address is filed under, so removal never depends on the
+    /// entity's current coordinates
+    cell_of: HashMap<usize, u32>,
+    next_serial: u32,
+}
+
+impl CellIndex {
+    pub fn new(bxs: usize, bys: usize) -> Self {
+        Self {
+            bxs,
+            bys,
+            cells: (0..bxs * bys).map(|_| Vec::new()).collect(),
+            cell_of: HashMap::new(),
+            next_serial: 0,
+        }
+    }
+
+    pub fn dims(&self) -> (usize, usize) {
+        (self.bxs, self.bys)
+    }
+
+    /// Cell for tile (x, y); coordinates past the edge land in the last
+    /// row/column so the entry stays findable.
+    #[inline]
+    fn cell(&self, x: u16, y: u16) -> u32 {
+        let bx = (x as usize / BLOCK_SIZE).min(self.bxs.saturating_sub(1));
+        let by = (y as usize / BLOCK_SIZE).min(self.bys.saturating_sub(1));
+        (bx + by * self.bxs) as u32
+    }
+
+    /// Re-file every entry for new block dimensions (map file reloaded).
+    pub fn resize(&mut self, bxs: usize, bys: usize) {
+        if (bxs, bys) == self.dims() {
+            return;
+        }
+        let old = std::mem::replace(self, Self::new(bxs, bys));
+        self.next_serial = old.next_serial;
+        for entry in old.cells.into_iter().flatten() {
+            self.file(entry);
+        }
+    }
+
+    /// File `entry` under a fresh serial, replacing any entry for the same
+    /// address.
+    pub fn insert(&mut self, mut entry: CellEntry) {
+        self.next_serial = self.next_serial.wrapping_add(1);
+        entry.serial = self.next_serial;
+        self.file(entry);
+    }
+
+    fn file(&mut self, entry: CellEntry) {
+        if self.cells.is_empty() {
+            return;
+        }
+        self.remove(entry.addr);
+        let cell = self.cell(entry.x, entry.y);
+        self.cells[cell as usize].push(entry);
+        self.cell_of.insert(entry.addr, cell);
+    }
+
+    pub fn remove(&mut self, addr: usize) -> bool {
+        let Some(cell) = self.cell_of.remove(&addr) else { return false };
+        let list = &mut self.cells[cell as usize];
+        if let Some(i) = list.iter().position(|e| e.addr == addr) {
+            list.swap_remove(i);
+        }
+        true
+    }
+
+    /// Update the position of `addr`. A move within one cell is an in-place
+    /// store. Returns false if `addr` is not indexed.
+    pub fn relocate(&mut self, addr: usize, x: u16, y: u16) -> bool {
+        let Some(&cell) = self.cell_of.get(&addr) else { return false };
+        let to = self.cell(x, y);
+        let list = &mut self.cells[cell as usize];
+        let Some(i) = list.iter().position(|e| e.addr == addr) else { return false };
+        if to == cell {
+            list[i].x = x;
+            list[i].y = y;
+            return true;
+        }
+        let mut entry = list.swap_remove(i);
+        entry.x = x;
+        entry.y = y;
+        self.cell_of.remove(&addr);
+        self.file(entry);
+        true
+    }
+
+    /// Call `f` on every entry inside the inclusive tile rectangle
+    /// (x0, y0)-(x1, y1), which must already be clamped to the map.
+    pub fn scan(&self, x0: i32, y0: i32, x1: i32, y1: i32, mut f: impl FnMut(&CellEntry)) {
+        if self.cells.is_empty() || x0 > x1 || y0 > y1 {
+            return;
+        }
+        let bs = BLOCK_SIZE as i32;
+        let (bx0, by0) = ((x0 / bs) as usize, (y0 / bs) as usize);
+        let bx1 = ((x1 / bs) as usize).min(self.bxs - 1);
+        let by1 = ((y1 / bs) as usize).min(self.bys - 1);
+        for by in by0..=by1 {
+            let row_inside = by as i32 * bs >= y0 && by as i32 * bs + bs - 1 <= y1;
+            for bx in bx0..=bx1 {
+                let list = &self.cells[bx + by * self.bxs];
+                if row_inside && bx as i32 * bs >= x0 && bx as i32 * bs + bs - 1 <= x1 {
+                    list.iter().for_each(&mut f);
+                    continue;
+                }
+                for e in list {
+                    if tiles_contain(&(x0, y0, x1, y1), e.x as i32, e.y as i32) {
+                        f(e);
+                    }
+                }
+            }
+        }
+    }
+
+    /// Call `f` on every entry covered by `plan`, each at most once. Returns
+    /// false, scanning nothing, if the plan was built for other dimensions.
+    pub fn scan_plan(&self, plan: &Plan, mut f: impl FnMut(&CellEntry)) -> bool {
+        if plan.dims() != self.dims() {
+            return false;
+        }
+        for pc in &plan.cells {
+            let list = &self.cells[pc.cell as usize];
+            if pc.len == 0 {
+                list.iter().for_each(&mut f);
+                continue;
+            }
+            let filters = &plan.filters[pc.first as usize..(pc.first + pc.len) as usize];
+            for e in list {
+                let (x, y) = (e.x as i32, e.y as i32);
+                if filters.iter().any(|r| tiles_contain(r, x, y)) {
+                    f(e);
+                }
+            }
+        }
+        true
+    }
+
+    pub fn len(&self) -> usize {
+        self.cell_of.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn entry(addr: usize, x: u16, y: u16) -> CellEntry {
+        CellEntry { addr, id: addr as u32, serial: 0, x, y, bl_type: 1 }
+    }
+
+    fn scan_addrs(idx: &CellIndex, x0: i32, y0: i32, x1: i32, y1: i32) -> Vec<usize> {
+        let mut v = Vec::new();
+        idx.scan(x0, y0, x1, y1, |e| v.push(e.addr));
+        v.sort();
+        v
+    }
+
+    #[test]
+    fn test_scan_matches_brute_force() {
+        // 40x40 tiles, 5x5 cells
+        let mut idx = CellIndex::new(5, 5);
+        let mut all = Vec::new();
+        for i in 0..400usize {
+            let (x, y) = ((i * 7 % 40) as u16, (i * 13 % 40) as u16);
+            idx.insert(entry(i + 1, x, y));
+            all.push((i + 1, x as i32, y as i32));
+        }
+        for &(x0, y0, x1, y1) in &[(0, 0, 39, 39), (3, 5, 20, 17), (8, 8, 15, 15), (9, 30, 9, 39)] {
+            let mut want: Vec<usize> = all
+                .iter()
+                .filter(|&&(_, x, y)| x >= x0 && x <= x1 && y >= y0 && y <= y1)
+                .map(|&(a, _, _)| a)
+                .collect();
+            want.sort();
+            assert_eq!(scan_addrs(&idx, x0, y0, x1, y1), want);
+        }
+    }
+
+    #[test]
+    fn test_relocate_and_remove() {
+        let mut idx = CellIndex::new(4, 4);
+        idx.insert(entry(1, 1, 1));
+        idx.insert(entry(2, 2, 2));
+        // Same cell: in place
+        assert!(idx.relocate(1, 7, 7));
+        assert_eq!(scan_addrs(&idx, 7, 7, 7, 7), vec![1]);
+        // Across cells
+        assert!(idx.relocate(1, 20, 25));
+        assert_eq!(scan_addrs(&idx, 0, 0, 7, 7), vec![2]);
+        assert_eq!(scan_addrs(&idx, 16, 24, 23, 31), vec![1]);
+
+        assert!(idx.remove(1));
+        assert!(!idx.remove(1));
+        assert!(!idx.relocate(1, 0, 0));
+        assert_eq!(idx.len(), 1);
+    }
+
+    #[test]
+    fn test_plan_visits_overlapping_rects_once() {
+        // 40x40 tiles, 5x5 cells
+        let mut idx = CellIndex::new(5, 5);
+        for i in 0..400usize {
+            idx.insert(entry(i + 1, (i * 7 % 40) as u16, (i * 13 % 40) as u16));
+        }
+        let rects = [(0, 0, 20, 10), (15, 5, 39, 12), (-4, -4, 3, 50)];
+        let plan = Plan::build(5, 5, 40, 40, &rects);
+        // Bounding rows 0..=1 over all 5 columns, plus column 0 on rows 2..=4
+        assert_eq!(plan.cell_count(), 13);
+
+        let mut got = Vec::new();
+        assert!(idx.scan_plan(&plan, |e| got.push(e.addr)));
+        let unique: std::collections::HashSet<_> = got.iter().collect();
+        assert_eq!(unique.len(), got.len());
+        got.sort();
+        let mut want: Vec<usize> = rects
+            .iter()
+            .flat_map(|&(x0, y0, x1, y1)| scan_addrs(&idx, x0.max(0), y0.max(0), x1.min(39), y1.min(39)))
+            .collect();
+        want.sort();
+        want.dedup();
+        assert_eq!(got, want);
+
+        // Stale dimensions are refused
+        assert!(!CellIndex::new(4, 4).scan_plan(&plan, |_| ()));
+        assert!(Plan::build(5, 5, 40, 40, &[(50, 50, 60, 60)]).is_empty());
+    }
+
+    #[test]
+    fn test_serial_survives_moves_not_reinserts() {
+        let mut idx = CellIndex::new(4, 4);
+        idx.insert(entry(1, 1, 1));
+        let serial = |idx: &CellIndex| {
+            let mut s = 0;
+            idx.scan(0, 0, 31, 31, |e| s = e.serial);
+            s
+        };
+        let first = serial(&idx);
+        idx.relocate(1, 20, 20);
+        idx.resize(5, 5);
+        assert_eq!(serial(&idx), first);
+        idx.remove(1);
+        idx.insert(entry(1, 20, 20));
+        assert_ne!(serial(&idx), first);
+    }
+
+    #[test]
+    fn test_resize_refiles_entries() {
+        let mut idx = CellIndex::new(4, 4);
+        idx.insert(entry(1, 30, 30));
+        idx.insert(entry(2, 3, 3));
+        idx.resize(2, 2);
+        assert_eq!(idx.len(), 2);
+        // Past the new edge: still removable
+        assert!(idx.remove(1));
+        assert_eq!(scan_addrs(&idx, 0, 0, 15, 15), vec![2]);
+    }
+}
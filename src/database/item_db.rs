@@ -241,7 +241,11 @@ async fn load_items() -> Result<usize, sqlx::Error> {
 
 pub fn init() -> c_int {
     ITEM_DB.get_or_init(|| Mutex::new(HashMap::new()));
-    match blocking_run(load_items()) {
+    // SAFETY: ItemData is plain data; the script pointers are always null.
+    let loaded = unsafe {
+        super::snapshot::load_or("item_db", &["Items"], db(), |i| i.id, || blocking_run(load_items()))
+    };
+    match loaded {
         Ok(n) => {
             tracing::info!("[item_db] read done count={n}");
             0
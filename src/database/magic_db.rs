@@ -104,7 +104,11 @@ async fn load_magic() -> Result<usize, sqlx::Error> {
 
 pub fn init() -> c_int {
     MAGIC_DB.get_or_init(|| Mutex::new(HashMap::new()));
-    match blocking_run(load_magic()) {
+    // SAFETY: MagicData is plain data.
+    let loaded = unsafe {
+        super::snapshot::load_or("magic_db", &["Spells"], db(), |m| m.id, || blocking_run(load_magic()))
+    };
+    match loaded {
         Ok(n) => { tracing::info!("[magic_db] read done count={n}"); 0 }
         Err(e) => { tracing::error!("[magic_db] load failed: {e}"); -1 }
     }
@@ -0,0 +1,250 @@
+//! Precompiled, memory-mapped map tiles.
+//!
+//! A `.map` file is big-endian (tile, pass, obj) triples, so every load used
+//! to read the whole file and byte-swap it into three fresh heap arrays per
+//! map, in every map-server process on the box. The cache stores the same
+//! three arrays once more per map, already in native order and 64-byte
+//! aligned, and `open` maps that file so `tile`/`pass`/`obj` point straight
+//! into the mapping. Startup no longer parses anything for unchanged maps,
+//! and the pages are the page cache's: every map server on the host shares
+//! one copy.
+//!
+//! The mapping is private and writable because scripts can edit cells
+//! (`setObject`, `setTile`, `setPass`). A page a script writes to is copied
+//! for that process only; the cache file never changes under a running
+//! server.
+//!
+//! A cache file records the length and mtime of the `.map` it was built
+//! from, and is rebuilt whenever either differs. Files of another format
+//! version or byte order are rebuilt the same way.
+
+use std::collections::HashMap;
+use std::os::unix::io::AsRawFd;
+use std::path::{Path, PathBuf};
+use std::sync::{Mutex, OnceLock};
+use std::time::UNIX_EPOCH;
+
+const MAGIC: [u8; 8] = *b"YURIMAP\0";
+/// Bump whenever the layout below changes.
+pub const VERSION: u32 = 1;
+/// Read back as another value on a host of the other byte order.
+const ENDIAN: u32 = 0x0102_0304;
+/// Header size and array alignment.
+const ALIGN: usize = 64;
+
+/// The `.map` a cache file was built from.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Source {
+    pub len: u64,
+    pub mtime_ns: u64,
+}
+
+impl Source {
+    pub fn of(path: &str) -> std::io::Result<Source> {
+        let meta = std::fs::metadata(path)?;
+        let mtime_ns = meta
+            .modified()
+            .ok()
+            .and_then(|t| t.duration_since(UNIX_EPOCH).ok())
+            .map_or(0, |d| d.as_nanos() as u64);
+        Ok(Source { len: meta.len(), mtime_ns })
+    }
+}
+
+fn padded(bytes: usize) -> usize {
+    (bytes + ALIGN - 1) / ALIGN * ALIGN
+}
+
+/// Byte offsets of the three arrays, and the file size, for `cells` cells.
+fn layout(cells: usize) -> (usize, usize, usize, usize) {
+    let arr = padded(cells * 2);
+    (ALIGN, ALIGN + arr, ALIGN + 2 * arr, ALIGN + 3 * arr)
+}
+
+/// Cache file of the map file `map_file` (as named in the Maps table).
+pub fn cache_path(dir: &str, map_file: &str) -> PathBuf {
+    Path::new(dir).join(format!("{}.ymc", map_file.replace(['/', '\\'], "_")))
+}
+
+/// Serialize one map's arrays in the cache format.
+pub fn encode(xs: u16, ys: u16, src: Source, tile: &[u16], pass: &[u16], obj: &[u16]) -> Vec<u8> {
+    let cells = xs as usize * ys as usize;
+    let (t, p, o, end) = layout(cells);
+    let mut out = vec![0u8; end];
+    out[0..8].copy_from_slice(&MAGIC);
+    out[8..12].copy_from_slice(&VERSION.to_ne_bytes());
+    out[12..16].copy_from_slice(&ENDIAN.to_ne_bytes());
+    out[16..18].copy_from_slice(&xs.to_ne_bytes());
+    out[18..20].copy_from_slice(&ys.to_ne_bytes());
+    out[24..32].copy_from_slice(&src.len.to_ne_bytes());
+    out[32..40].copy_from_slice(&src.mtime_ns.to_ne_bytes());
+    for (off, arr) in [(t, tile), (p, pass), (o, obj)] {
+        for (i, v) in arr[..cells].iter().enumerate() {
+            out[off + i * 2..off + i * 2 + 2].copy_from_slice(&v.to_ne_bytes());
+        }
+    }
+    out
+}
+
+/// Write `bytes` to `path` under a temporary name first, so a crash or a
+/// concurrent map server never sees a truncated file.
+pub fn write(path: &Path, bytes: &[u8]) -> std::io::Result<()> {
+    if let Some(dir) = path.parent() {
+        std::fs::create_dir_all(dir)?;
+    }
+    let tmp = path.with_extension(format!("tmp{}", std::process::id()));
+    let res = std::fs::write(&tmp, bytes).and_then(|_| std::fs::rename(&tmp, path));
+    if res.is_err() {
+        let _ = std::fs::remove_file(&tmp);
+    }
+    res
+}
+
+/// A private mapping of one cache file. Unmapped on drop.
+pub struct Mapping {
+    ptr: *mut u8,
+    len: usize,
+}
+
+// The mapping is owned by exactly one `Mapping`; nothing else unmaps it.
+unsafe impl Send for Mapping {}
+
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe { libc::munmap(self.ptr as *mut libc::c_void, self.len) };
+    }
+}
+
+/// Tiles of one map, pointing into `mapping`.
+pub struct MappedTiles {
+    pub xs: u16,
+    pub ys: u16,
+    pub tile: *mut u16,
+    pub pass: *mut u16,
+    pub obj: *mut u16,
+    pub mapping: Mapping,
+}
+
+/// Map the cache file at `path` if it was built from `src` by this format
+/// version on this byte order. `None` means the file must be (re)built.
+pub fn open(path: &Path, src: Source) -> Option<MappedTiles> {
+    let file = std::fs::File::open(path).ok()?;
+    let len = file.metadata().ok()?.len() as usize;
+    if len < ALIGN {
+        return None;
+    }
+    let ptr = unsafe {
+        libc::mmap(
+            std::ptr::null_mut(),
+            len,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_PRIVATE,
+            file.as_raw_fd(),
+            0,
+        )
+    };
+    if ptr == libc::MAP_FAILED {
+        return None;
+    }
+    let mapping = Mapping { ptr: ptr as *mut u8, len };
+    let head = unsafe { std::slice::from_raw_parts(mapping.ptr, ALIGN) };
+    let u16_at = |o: usize| u16::from_ne_bytes([head[o], head[o + 1]]);
+    let u32_at = |o: usize| u32::from_ne_bytes(head[o..o + 4].try_into().unwrap());
+    let u64_at = |o: usize| u64::from_ne_bytes(head[o..o + 8].try_into().unwrap());
+    if head[0..8] != MAGIC || u32_at(8) != VERSION || u32_at(12) != ENDIAN {
+        return None;
+    }
+    if (Source { len: u64_at(24), mtime_ns: u64_at(32) }) != src {
+        return None;
+    }
+    let (xs, ys) = (u16_at(16), u16_at(18));
+    let (t, p, o, end) = layout(xs as usize * ys as usize);
+    if len < end {
+        return None;
+    }
+    unsafe {
+        // Every cell is read soon after load; fault the pages in up front
+        libc::madvise(ptr, len, libc::MADV_WILLNEED);
+        Some(MappedTiles {
+            xs,
+            ys,
+            tile: mapping.ptr.add(t) as *mut u16,
+            pass: mapping.ptr.add(p) as *mut u16,
+            obj: mapping.ptr.add(o) as *mut u16,
+            mapping,
+        })
+    }
+}
+
+/// Mappings backing loaded map slots, by the slot's `tile` pointer. A slot
+/// with no entry here owns heap-allocated tile arrays.
+fn mapped() -> &'static Mutex<HashMap<usize, Mapping>> {
+    static MAPPED: OnceLock<Mutex<HashMap<usize, Mapping>>> = OnceLock::new();
+    MAPPED.get_or_init(Default::default)
+}
+
+/// Keep `mapping` alive while a slot's `tile` points into it at `tile`.
+pub fn adopt(tile: usize, mapping: Mapping) {
+    mapped().lock().unwrap_or_else(|e| e.into_inner()).insert(tile, mapping);
+}
+
+/// Unmap the tiles whose `tile` array is at `tile`. False if that array is
+/// not in a mapping (it is on the heap).
+pub fn release(tile: usize) -> bool {
+    mapped().lock().unwrap_or_else(|e| e.into_inner()).remove(&tile).is_some()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_round_trip_and_invalidation() {
+        let dir = std::env::temp_dir().join(format!("yuri_mapcache_{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        let path = cache_path(dir.to_str().unwrap(), "sub/town.map");
+        assert!(path.ends_with("sub_town.map.ymc"));
+
+        let src = Source { len: 4 + 6 * 6, mtime_ns: 1_700_000_000_000_000_000 };
+        let tile: Vec<u16> = (0..6).collect();
+        let pass = vec![0, 1, 0, 1, 1, 0];
+        let obj = vec![0xfffe, 0, 0, 7, 0, 0x1234];
+        write(&path, &encode(3, 2, src, &tile, &pass, &obj)).unwrap();
+
+        let m = open(&path, src).unwrap();
+        assert_eq!((m.xs, m.ys), (3, 2));
+        for p in [m.tile, m.pass, m.obj] {
+            assert_eq!(p as usize % ALIGN, 0);
+        }
+        unsafe {
+            assert_eq!(std::slice::from_raw_parts(m.tile, 6), &tile[..]);
+            assert_eq!(std::slice::from_raw_parts(m.pass, 6), &pass[..]);
+            assert_eq!(std::slice::from_raw_parts(m.obj, 6), &obj[..]);
+            // Writes stay private to the mapping
+            *m.obj.add(3) = 9;
+        }
+        drop(m);
+        let m = open(&path, src).unwrap();
+        assert_eq!(unsafe { *m.obj.add(3) }, 7);
+
+        // A changed source invalidates the entry
+        assert!(open(&path, Source { len: src.len + 6, ..src }).is_none());
+        assert!(open(&path, Source { mtime_ns: 1, ..src }).is_none());
+
+        let tile = m.tile as usize;
+        adopt(tile, m.mapping);
+        assert!(release(tile));
+        assert!(!release(tile));
+
+        // Truncated or foreign files are rejected
+        let bytes = std::fs::read(&path).unwrap();
+        std::fs::write(&path, &bytes[..bytes.len() - 1]).unwrap();
+        assert!(open(&path, src).is_none());
+        let mut other = bytes.clone();
+        other[8] ^= 0xff;
+        std::fs::write(&path, &other).unwrap();
+        assert!(open(&path, src).is_none());
+
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
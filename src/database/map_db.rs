@@ -3,12 +3,15 @@
 //! `MapData` mirrors `struct map_data` from `map_server.h` exactly.
 //! `GlobalReg` mirrors `struct global_reg` from `mmo.h` exactly.
 
+use std::collections::HashMap;
 use std::os::raw::{c_char, c_int, c_uchar, c_uint, c_ushort};
+use std::sync::{Mutex, OnceLock};
 
 use anyhow::{Context, Result};
 use rayon::prelude::*;
 use sqlx::Row;
 
+use crate::database::map_cache::{self, MappedTiles};
 use crate::database::{blocking_run, get_pool};
 
 pub const BLOCK_SIZE: usize = 8;
@@ -118,9 +121,9 @@ pub struct MapData {
     pub can_equip: c_uchar,
 }
 
-/// Tile arrays parsed from a single .map file. Raw pointers are independently
-/// heap-allocated — no aliases — so safe to move across threads.
-struct ParsedTiles {
+/// Tile arrays of a single map. Raw pointers are independently heap-allocated,
+/// or point into `mapping` — no aliases — so safe to move across threads.
+pub struct ParsedTiles {
     xs: c_ushort,
     ys: c_ushort,
     bxs: c_ushort,
@@ -129,8 +132,10 @@ struct ParsedTiles {
     pass: *mut c_ushort,
     obj: *mut c_ushort,
     map: *mut c_uchar,
+    /// Backs tile/pass/obj when they came from the map cache
+    mapping: Option<map_cache::Mapping>,
 }
-// Each pointer is a uniquely-owned allocation with no aliases.
+// Each pointer is a uniquely-owned allocation (or mapping) with no aliases.
 unsafe impl Send for ParsedTiles {}
 
 impl Drop for ParsedTiles {
@@ -142,14 +147,71 @@ impl Drop for ParsedTiles {
         }
         let cell_count = self.xs as usize * self.ys as usize;
         unsafe {
-            free_slice(self.tile, cell_count);
-            free_slice(self.pass, cell_count);
-            free_slice(self.obj, cell_count);
+            if self.mapping.is_none() {
+                free_slice(self.tile, cell_count);
+                free_slice(self.pass, cell_count);
+                free_slice(self.obj, cell_count);
+            }
             free_slice(self.map, cell_count);
         }
     }
 }
 
+impl ParsedTiles {
+    fn mapped(m: MappedTiles) -> Self {
+        let cell_count = m.xs as usize * m.ys as usize;
+        ParsedTiles {
+            xs: m.xs,
+            ys: m.ys,
+            bxs: blocks(m.xs),
+            bys: blocks(m.ys),
+            tile: m.tile,
+            pass: m.pass,
+            obj: m.obj,
+            map: alloc_zeroed_slice::<c_uchar>(cell_count),
+            mapping: Some(m.mapping),
+        }
+    }
+
+    /// Move the arrays into `slot`; nulls them here so drop does not free
+    /// what the slot now owns.
+    fn install(mut self, slot: &mut MapData) {
+        slot.xs = self.xs;
+        slot.ys = self.ys;
+        slot.bxs = self.bxs;
+        slot.bys = self.bys;
+        slot.tile = std::mem::replace(&mut self.tile, std::ptr::null_mut());
+        slot.pass = std::mem::replace(&mut self.pass, std::ptr::null_mut());
+        slot.obj = std::mem::replace(&mut self.obj, std::ptr::null_mut());
+        slot.map = std::mem::replace(&mut self.map, std::ptr::null_mut());
+        if let Some(m) = self.mapping.take() {
+            map_cache::adopt(slot.tile as usize, m);
+        }
+    }
+}
+
+/// Number of BLOCK_SIZE blocks spanning `cells` cells.
+fn blocks(cells: c_ushort) -> c_ushort {
+    ((cells as usize + BLOCK_SIZE - 1) / BLOCK_SIZE) as c_ushort
+}
+
+/// Free the tile arrays of loaded map `slot` and null them: unmapped if they
+/// came from the map cache, else dropped from the heap.
+pub unsafe fn free_tiles(slot: &mut MapData) {
+    let cell_count = slot.xs as usize * slot.ys as usize;
+    let mapped = !slot.tile.is_null() && map_cache::release(slot.tile as usize);
+    for p in [&mut slot.tile, &mut slot.pass, &mut slot.obj] {
+        if !mapped && !p.is_null() {
+            drop(Vec::from_raw_parts(*p, cell_count, cell_count));
+        }
+        *p = std::ptr::null_mut();
+    }
+    if !slot.map.is_null() {
+        drop(Vec::from_raw_parts(slot.map, cell_count, cell_count));
+        slot.map = std::ptr::null_mut();
+    }
+}
+
 /// Allocate a zeroed heap slice and return a raw pointer (caller owns memory).
 fn alloc_zeroed_slice<T: Default + Clone>(len: usize) -> *mut T {
     let mut v: Vec<T> = vec![Default::default(); len];
@@ -200,8 +262,8 @@ pub fn parse_map_file(path: &str) -> Result<ParsedTiles> {
         );
     }
 
-    let bxs = ((xs as usize + BLOCK_SIZE - 1) / BLOCK_SIZE) as c_ushort;
-    let bys = ((ys as usize + BLOCK_SIZE - 1) / BLOCK_SIZE) as c_ushort;
+    let bxs = blocks(xs);
+    let bys = blocks(ys);
 
     let tile = alloc_zeroed_slice::<c_ushort>(cell_count);
     let pass = alloc_zeroed_slice::<c_ushort>(cell_count);
@@ -227,9 +289,37 @@ pub fn parse_map_file(path: &str) -> Result<ParsedTiles> {
         pass,
         obj,
         map,
+        mapping: None,
     })
 }
 
+/// Load the tiles of `map_file` (at `path`): mapped from its entry in
+/// `cache_dir` when that is current, else parsed, with the entry rebuilt for
+/// next time. An empty `cache_dir` always parses.
+pub fn load_tiles(path: &str, map_file: &str, cache_dir: &str) -> Result<ParsedTiles> {
+    if cache_dir.is_empty() {
+        return parse_map_file(path);
+    }
+    let src = map_cache::Source::of(path).with_context(|| format!("map file not found: {path}"))?;
+    let cache = map_cache::cache_path(cache_dir, map_file);
+    if let Some(m) = map_cache::open(&cache, src) {
+        return Ok(ParsedTiles::mapped(m));
+    }
+
+    let tiles = parse_map_file(path)?;
+    let cell_count = tiles.xs as usize * tiles.ys as usize;
+    let bytes = unsafe {
+        let arr = |p: *mut c_ushort| std::slice::from_raw_parts(p, cell_count);
+        map_cache::encode(tiles.xs, tiles.ys, src, arr(tiles.tile), arr(tiles.pass), arr(tiles.obj))
+    };
+    if let Err(e) = map_cache::write(&cache, &bytes) {
+        tracing::warn!("[map] could not write map cache {}: {e}", cache.display());
+        return Ok(tiles);
+    }
+    // Serve the new entry too, so this process shares its pages as well
+    Ok(map_cache::open(&cache, src).map_or(tiles, ParsedTiles::mapped))
+}
+
 /// Write a slice of registry rows into a slot's pre-allocated registry array.
 fn apply_registry(slot: &mut MapData, rows: &[(String, u32)]) {
     slot.registry_num = rows.len().min(MAX_MAPREG) as c_int;
@@ -262,6 +352,10 @@ pub fn load_registry(slot: &mut MapData, map_id: u32) -> Result<()> {
         mrg_value: u32,
     }
 
+    // Read back only after buffered and queued registry writes have landed
+    crate::database::registry_writes::flush();
+    crate::database::write_behind::flush();
+
     let rows: Vec<RegRow> = blocking_run(
         sqlx::query_as(
             "SELECT MrgIdentifier AS mrg_identifier, MrgValue AS mrg_value \
@@ -314,52 +408,47 @@ fn load_all_registries(
     Ok(map)
 }
 
-/// Query the Maps table and populate map slots. Called once at startup.
-/// Returns the number of maps loaded, or an error.
-pub fn load_maps(
-    maps_dir: &str,
-    server_id: i32,
-    slots: &mut [MapData; MAP_SLOTS],
-) -> Result<usize> {
-    // Types match DB schema (all INT UNSIGNED except MapReqLvl which is INT).
-    // All int(10) unsigned → u32; MapReqLvl int(10) → i32.
-    #[derive(sqlx::FromRow)]
-    struct MapRow {
-        map_id: u32,
-        map_name: String,
-        map_bgm: u32,
-        map_bgm_type: u32,
-        map_pv_p: u32,
-        map_spells: u32,
-        map_light: u32,
-        map_weather: u32,
-        map_sweep_time: u32,
-        map_chat: u32,
-        map_ghosts: u32,
-        map_region: u32,
-        map_indoor: u32,
-        map_warpout: u32,
-        map_bind: u32,
-        map_file: String,
-        map_req_lvl: i32,
-        map_req_path: u32,
-        map_req_mark: u32,
-        map_can_summon: u32,
-        map_req_vita: u32,
-        map_req_mana: u32,
-        map_lvl_max: u32,
-        map_vita_max: u32,
-        map_mana_max: u32,
-        map_reject_msg: String,
-        map_can_use: u32,
-        map_can_eat: u32,
-        map_can_smoke: u32,
-        map_can_mount: u32,
-        map_can_group: u32,
-        map_can_equip: u32,
-    }
+/// One row of the Maps table.
+/// Types match DB schema (all INT UNSIGNED except MapReqLvl which is INT).
+/// All int(10) unsigned → u32; MapReqLvl int(10) → i32.
+#[derive(sqlx::FromRow, Hash)]
+struct MapRow {
+    map_id: u32,
+    map_name: String,
+    map_bgm: u32,
+    map_bgm_type: u32,
+    map_pv_p: u32,
+    map_spells: u32,
+    map_light: u32,
+    map_weather: u32,
+    map_sweep_time: u32,
+    map_chat: u32,
+    map_ghosts: u32,
+    map_region: u32,
+    map_indoor: u32,
+    map_warpout: u32,
+    map_bind: u32,
+    map_file: String,
+    map_req_lvl: i32,
+    map_req_path: u32,
+    map_req_mark: u32,
+    map_can_summon: u32,
+    map_req_vita: u32,
+    map_req_mana: u32,
+    map_lvl_max: u32,
+    map_vita_max: u32,
+    map_mana_max: u32,
+    map_reject_msg: String,
+    map_can_use: u32,
+    map_can_eat: u32,
+    map_can_smoke: u32,
+    map_can_mount: u32,
+    map_can_group: u32,
+    map_can_equip: u32,
+}
 
-    let rows: Vec<MapRow> = blocking_run(
+fn fetch_map_rows(server_id: i32) -> Result<Vec<MapRow>> {
+    Ok(blocking_run(
         sqlx::query_as(
             "SELECT MapId AS map_id, MapName AS map_name, MapBGM AS map_bgm,
              MapBGMType AS map_bgm_type, MapPvP AS map_pv_p, MapSpells AS map_spells,
@@ -377,14 +466,133 @@ pub fn load_maps(
         )
         .bind(server_id)
         .fetch_all(get_pool()),
-    )?;
+    )?)
+}
+
+/// Copy a row's scalar fields (everything but tiles and registry) into `slot`.
+fn apply_row(slot: &mut MapData, row: &MapRow) {
+    copy_str_to_fixed(&mut slot.title, &row.map_name);
+    copy_str_to_fixed(&mut slot.mapfile, &row.map_file);
+    copy_str_to_fixed(&mut slot.maprejectmsg, &row.map_reject_msg);
+    slot.id = row.map_id as c_int;
+    slot.bgm = row.map_bgm as c_ushort;
+    slot.bgmtype = row.map_bgm_type as c_ushort;
+    slot.pvp = row.map_pv_p as c_uchar;
+    slot.spell = row.map_spells as c_uchar;
+    slot.light = row.map_light as c_uchar;
+    slot.weather = row.map_weather as c_uchar;
+    slot.sweeptime = row.map_sweep_time;
+    slot.cantalk = row.map_chat as c_uchar;
+    slot.show_ghosts = row.map_ghosts as c_uchar;
+    slot.region = row.map_region as c_uchar;
+    slot.indoor = row.map_indoor as c_uchar;
+    slot.warpout = row.map_warpout as c_uchar;
+    slot.bind = row.map_bind as c_uchar;
+    slot.reqlvl = row.map_req_lvl as c_uint;
+    slot.reqpath = row.map_req_path as c_uchar;
+    slot.reqmark = row.map_req_mark as c_uchar;
+    slot.summon = row.map_can_summon as c_uchar;
+    slot.reqvita = row.map_req_vita;
+    slot.reqmana = row.map_req_mana;
+    slot.lvlmax = row.map_lvl_max;
+    slot.vitamax = row.map_vita_max;
+    slot.manamax = row.map_mana_max;
+    slot.can_use = row.map_can_use as c_uchar;
+    slot.can_eat = row.map_can_eat as c_uchar;
+    slot.can_smoke = row.map_can_smoke as c_uchar;
+    slot.can_mount = row.map_can_mount as c_uchar;
+    slot.can_group = row.map_can_group as c_uchar;
+    slot.can_equip = row.map_can_equip as c_uchar;
+}
+
+/// What a loaded map was loaded from, so a reload can tell what changed.
+#[derive(Debug, Clone, PartialEq, Eq)]
+struct LoadedFrom {
+    /// Hash of the whole Maps row
+    row: u64,
+    map_file: String,
+    /// `None` if the .map file could not be stat'ed
+    source: Option<map_cache::Source>,
+}
+
+impl LoadedFrom {
+    fn of(maps_dir: &str, row: &MapRow) -> Self {
+        use std::hash::{Hash, Hasher};
+        let mut h = std::collections::hash_map::DefaultHasher::new();
+        row.hash(&mut h);
+        LoadedFrom {
+            row: h.finish(),
+            map_file: row.map_file.clone(),
+            source: map_cache::Source::of(&format!("{}{}", maps_dir, row.map_file)).ok(),
+        }
+    }
+}
+
+/// Sources of the maps in the slots, by map id. A loaded map with no entry
+/// was changed some other way (`sl_g_setmap`) and is reloaded in full.
+fn loaded_from() -> &'static Mutex<HashMap<u32, LoadedFrom>> {
+    static LOADED: OnceLock<Mutex<HashMap<u32, LoadedFrom>>> = OnceLock::new();
+    LOADED.get_or_init(Default::default)
+}
+
+/// Forget what map `id` was loaded from; the next reload redoes it.
+pub fn forget_loaded(id: u32) {
+    loaded_from().lock().unwrap_or_else(|e| e.into_inner()).remove(&id);
+}
+
+/// What a reload has to redo for one map.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Change {
+    Unchanged,
+    /// Only the Maps row changed
+    Fields,
+    /// The .map file changed (or is unknown); fields are applied too
+    Tiles,
+    /// Not loaded before
+    New,
+}
+
+fn classify(prev: Option<&LoadedFrom>, now: &LoadedFrom, loaded: bool) -> Change {
+    match prev {
+        _ if !loaded => Change::New,
+        Some(p) if p.source.is_some() && p.source == now.source && p.map_file == now.map_file => {
+            if p.row == now.row {
+                Change::Unchanged
+            } else {
+                Change::Fields
+            }
+        }
+        _ => Change::Tiles,
+    }
+}
+
+/// Result of `reload_maps`.
+#[derive(Debug, Default)]
+pub struct Reloaded {
+    /// Maps whose fields or tiles changed, including new ones
+    pub changed: Vec<u32>,
+    /// Maps loaded for the first time; they need a block grid
+    pub new: Vec<u32>,
+    pub unchanged: usize,
+}
+
+/// Query the Maps table and populate map slots. Called once at startup.
+/// Tiles come from `cache_dir` where possible (see `load_tiles`).
+/// Returns the number of maps loaded, or an error.
+pub fn load_maps(
+    maps_dir: &str,
+    cache_dir: &str,
+    server_id: i32,
+    slots: &mut [MapData; MAP_SLOTS],
+) -> Result<usize> {
+    let rows = fetch_map_rows(server_id)?;
 
     // Phase 1: parse all .map files in parallel across rayon's thread pool.
     let parsed: Vec<(u32, Result<ParsedTiles>)> = rows
         .par_iter()
         .map(|row| {
             let path = format!("{}{}", maps_dir, row.map_file);
-            (row.map_id, parse_map_file(&path))
+            (row.map_id, load_tiles(&path, &row.map_file, cache_dir))
         })
         .collect();
 
@@ -394,207 +602,122 @@ pub fn load_maps(
 
     // Phase 3: apply parsed tiles + scalar fields + registry to slots sequentially.
     let mut loaded = 0usize;
+    let mut sources = loaded_from().lock().unwrap_or_else(|e| e.into_inner());
     for (row, (_, tiles_result)) in rows.iter().zip(parsed.into_iter()) {
         let id = row.map_id as usize;
         if id >= MAP_SLOTS {
             tracing::warn!("[map] map_id={id} >= MAP_SLOTS={MAP_SLOTS}, skipping");
             continue;
         }
-        let mut tiles = tiles_result.with_context(|| format!("loading map id={}", row.map_id))?;
+        let tiles = tiles_result.with_context(|| format!("loading map id={}", row.map_id))?;
         let slot = &mut slots[id];
 
-        copy_str_to_fixed(&mut slot.title, &row.map_name);
-        copy_str_to_fixed(&mut slot.mapfile, &row.map_file);
-        copy_str_to_fixed(&mut slot.maprejectmsg, &row.map_reject_msg);
-        slot.id = row.map_id as c_int;
-        slot.bgm = row.map_bgm as c_ushort;
-        slot.bgmtype = row.map_bgm_type as c_ushort;
-        slot.pvp = row.map_pv_p as c_uchar;
-        slot.spell = row.map_spells as c_uchar;
-        slot.light = row.map_light as c_uchar;
-        slot.weather = row.map_weather as c_uchar;
-        slot.sweeptime = row.map_sweep_time;
-        slot.cantalk = row.map_chat as c_uchar;
-        slot.show_ghosts = row.map_ghosts as c_uchar;
-        slot.region = row.map_region as c_uchar;
-        slot.indoor = row.map_indoor as c_uchar;
-        slot.warpout = row.map_warpout as c_uchar;
-        slot.bind = row.map_bind as c_uchar;
-        slot.reqlvl = row.map_req_lvl as c_uint;
-        slot.reqpath = row.map_req_path as c_uchar;
-        slot.reqmark = row.map_req_mark as c_uchar;
-        slot.summon = row.map_can_summon as c_uchar;
-        slot.reqvita = row.map_req_vita;
-        slot.reqmana = row.map_req_mana;
-        slot.lvlmax = row.map_lvl_max;
-        slot.vitamax = row.map_vita_max;
-        slot.manamax = row.map_mana_max;
-        slot.can_use = row.map_can_use as c_uchar;
-        slot.can_eat = row.map_can_eat as c_uchar;
-        slot.can_smoke = row.map_can_smoke as c_uchar;
-        slot.can_mount = row.map_can_mount as c_uchar;
-        slot.can_group = row.map_can_group as c_uchar;
-        slot.can_equip = row.map_can_equip as c_uchar;
-
-        slot.xs = tiles.xs;
-        slot.ys = tiles.ys;
-        slot.bxs = tiles.bxs;
-        slot.bys = tiles.bys;
-        // Transfer ownership of tile arrays to the slot; null out tiles so
-        // ParsedTiles::drop does not double-free the transferred pointers.
-        slot.tile = std::mem::replace(&mut tiles.tile, std::ptr::null_mut());
-        slot.pass = std::mem::replace(&mut tiles.pass, std::ptr::null_mut());
-        slot.obj = std::mem::replace(&mut tiles.obj, std::ptr::null_mut());
-        slot.map = std::mem::replace(&mut tiles.map, std::ptr::null_mut());
+        apply_row(slot, row);
+        tiles.install(slot);
         slot.registry = alloc_zeroed_registry(MAX_MAPREG);
 
         if let Some(regs) = registries.remove(&row.map_id) {
             apply_registry(slot, &regs);
         }
+        sources.insert(row.map_id, LoadedFrom::of(maps_dir, row));
         loaded += 1;
     }
 
     Ok(loaded)
 }
 
-/// Reload map metadata and tile data in-place. Used by rust_map_reload().
+/// Reload the maps whose Maps row or .map file changed since they were
+/// loaded. Used by rust_map_reload().
+///
+/// Changed tiles are parsed in parallel before any slot is touched, so a bad
+/// file fails the reload with every map as it was. Then the changes are
+/// applied in one pass on the calling (game) thread, between two timer or
+/// packet events. Unchanged maps, their registries, block grids and
+/// entities are not touched at all. A loaded map whose new file has other
+/// dimensions keeps its old tiles, since its block grid cannot be resized
+/// under the entities in it; the row's other fields still apply.
 /// A map is considered "already loaded" if its registry pointer is non-null.
 pub fn reload_maps(
     maps_dir: &str,
+    cache_dir: &str,
     server_id: i32,
     slots: &mut [MapData; MAP_SLOTS],
-) -> Result<usize> {
-    #[derive(sqlx::FromRow)]
-    struct MapRow {
-        map_id: u32,
-        map_name: String,
-        map_bgm: u32,
-        map_bgm_type: u32,
-        map_pv_p: u32,
-        map_spells: u32,
-        map_light: u32,
-        map_weather: u32,
-        map_sweep_time: u32,
-        map_chat: u32,
-        map_ghosts: u32,
-        map_region: u32,
-        map_indoor: u32,
-        map_warpout: u32,
-        map_bind: u32,
-        map_file: String,
-        map_req_lvl: i32,
-        map_req_path: u32,
-        map_req_mark: u32,
-        map_can_summon: u32,
-        map_req_vita: u32,
-        map_req_mana: u32,
-        map_lvl_max: u32,
-        map_vita_max: u32,
-        map_mana_max: u32,
-        map_reject_msg: String,
-        map_can_use: u32,
-        map_can_eat: u32,
-        map_can_smoke: u32,
-        map_can_mount: u32,
-        map_can_group: u32,
-        map_can_equip: u32,
-    }
-
-    let rows: Vec<MapRow> = blocking_run(
-        sqlx::query_as(
-            "SELECT MapId AS map_id, MapName AS map_name, MapBGM AS map_bgm,
-             MapBGMType AS map_bgm_type, MapPvP AS map_pv_p, MapSpells AS map_spells,
-             MapLight AS map_light, MapWeather AS map_weather, MapSweepTime AS map_sweep_time,
-             MapChat AS map_chat, MapGhosts AS map_ghosts, MapRegion AS map_region,
-             MapIndoor AS map_indoor, MapWarpout AS map_warpout, MapBind AS map_bind,
-             MapFile AS map_file, MapReqLvl AS map_req_lvl, MapReqPath AS map_req_path,
-             MapReqMark AS map_req_mark, MapCanSummon AS map_can_summon,
-             MapReqVita AS map_req_vita, MapReqMana AS map_req_mana, MapLvlMax AS map_lvl_max,
-             MapVitaMax AS map_vita_max, MapManaMax AS map_mana_max,
-             MapRejectMsg AS map_reject_msg, MapCanUse AS map_can_use, MapCanEat AS map_can_eat,
-             MapCanSmoke AS map_can_smoke, MapCanMount AS map_can_mount,
-             MapCanGroup AS map_can_group, MapCanEquip AS map_can_equip
-             FROM Maps WHERE MapServer = ? ORDER BY MapId",
-        )
-        .bind(server_id)
-        .fetch_all(get_pool()),
-    )?;
-
-    for row in &rows {
-        let id = row.map_id as usize;
-        if id >= MAP_SLOTS {
-            tracing::warn!("[map] map_id={id} >= MAP_SLOTS={MAP_SLOTS}, skipping");
-            continue;
-        }
-        let slot = &mut slots[id];
-
-        // Parse the map file first — on failure, leave the slot untouched.
-        let path = format!("{}{}", maps_dir, row.map_file);
-        let mut tiles =
-            parse_map_file(&path).with_context(|| format!("reloading map id={}", row.map_id))?;
-
-        // Parse succeeded — now free the old tile arrays and registry.
-        if !slot.registry.is_null() {
-            let old_cells = slot.xs as usize * slot.ys as usize;
-            unsafe {
-                drop(Vec::from_raw_parts(slot.tile, old_cells, old_cells));
-                drop(Vec::from_raw_parts(slot.pass, old_cells, old_cells));
-                drop(Vec::from_raw_parts(slot.obj, old_cells, old_cells));
-                drop(Vec::from_raw_parts(slot.map, old_cells, old_cells));
-                let reg_layout = std::alloc::Layout::array::<GlobalReg>(MAX_MAPREG).unwrap();
-                std::alloc::dealloc(slot.registry as *mut u8, reg_layout);
+) -> Result<Reloaded> {
+    let rows: Vec<MapRow> = fetch_map_rows(server_id)?
+        .into_iter()
+        .filter(|row| {
+            let keep = (row.map_id as usize) < MAP_SLOTS;
+            if !keep {
+                tracing::warn!("[map] map_id={} >= MAP_SLOTS={MAP_SLOTS}, skipping", row.map_id);
+            }
+            keep
+        })
+        .collect();
+    let now: Vec<LoadedFrom> = rows.iter().map(|row| LoadedFrom::of(maps_dir, row)).collect();
+    let plan: Vec<Change> = {
+        let sources = loaded_from().lock().unwrap_or_else(|e| e.into_inner());
+        rows.iter()
+            .zip(&now)
+            .map(|(row, now)| {
+                let loaded = !slots[row.map_id as usize].registry.is_null();
+                classify(sources.get(&row.map_id), now, loaded)
+            })
+            .collect()
+    };
+
+    let mut parsed: Vec<Option<ParsedTiles>> = rows
+        .par_iter()
+        .zip(plan.par_iter())
+        .map(|(row, change)| match change {
+            Change::Tiles | Change::New => {
+                let path = format!("{}{}", maps_dir, row.map_file);
+                load_tiles(&path, &row.map_file, cache_dir)
+                    .with_context(|| format!("reloading map id={}", row.map_id))
+                    .map(Some)
+            }
+            Change::Unchanged | Change::Fields => Ok(None),
+        })
+        .collect::<Result<_>>()?;
+
+    let mut out = Reloaded::default();
+    let mut sources = loaded_from().lock().unwrap_or_else(|e| e.into_inner());
+    for (i, (row, mut now)) in rows.iter().zip(now).enumerate() {
+        let slot = &mut slots[row.map_id as usize];
+        match plan[i] {
+            Change::Unchanged => {
+                out.unchanged += 1;
+                continue;
+            }
+            Change::Fields => apply_row(slot, row),
+            Change::Tiles => {
+                let tiles = parsed[i].take().unwrap();
+                apply_row(slot, row);
+                if (tiles.xs, tiles.ys) != (slot.xs, slot.ys) {
+                    tracing::warn!(
+                        "[map] map id={} changed size ({}x{} -> {}x{}); tiles kept until restart",
+                        row.map_id, slot.xs, slot.ys, tiles.xs, tiles.ys
+                    );
+                    // Not recorded, so the next reload tries again
+                    now.source = None;
+                } else {
+                    unsafe { free_tiles(slot) };
+                    tiles.install(slot);
+                    load_registry(slot, row.map_id)?;
+                }
+            }
+            Change::New => {
+                apply_row(slot, row);
+                parsed[i].take().unwrap().install(slot);
+                slot.registry = alloc_zeroed_registry(MAX_MAPREG);
+                load_registry(slot, row.map_id)?;
+                out.new.push(row.map_id);
             }
         }
-
-        copy_str_to_fixed(&mut slot.title, &row.map_name);
-        copy_str_to_fixed(&mut slot.mapfile, &row.map_file);
-        copy_str_to_fixed(&mut slot.maprejectmsg, &row.map_reject_msg);
-        slot.id = row.map_id as c_int;
-        slot.bgm = row.map_bgm as c_ushort;
-        slot.bgmtype = row.map_bgm_type as c_ushort;
-        slot.pvp = row.map_pv_p as c_uchar;
-        slot.spell = row.map_spells as c_uchar;
-        slot.light = row.map_light as c_uchar;
-        slot.weather = row.map_weather as c_uchar;
-        slot.sweeptime = row.map_sweep_time;
-        slot.cantalk = row.map_chat as c_uchar;
-        slot.show_ghosts = row.map_ghosts as c_uchar;
-        slot.region = row.map_region as c_uchar;
-        slot.indoor = row.map_indoor as c_uchar;
-        slot.warpout = row.map_warpout as c_uchar;
-        slot.bind = row.map_bind as c_uchar;
-        slot.reqlvl = row.map_req_lvl as c_uint;
-        slot.reqpath = row.map_req_path as c_uchar;
-        slot.reqmark = row.map_req_mark as c_uchar;
-        slot.summon = row.map_can_summon as c_uchar;
-        slot.reqvita = row.map_req_vita;
-        slot.reqmana = row.map_req_mana;
-        slot.lvlmax = row.map_lvl_max;
-        slot.vitamax = row.map_vita_max;
-        slot.manamax = row.map_mana_max;
-        slot.can_use = row.map_can_use as c_uchar;
-        slot.can_eat = row.map_can_eat as c_uchar;
-        slot.can_smoke = row.map_can_smoke as c_uchar;
-        slot.can_mount = row.map_can_mount as c_uchar;
-        slot.can_group = row.map_can_group as c_uchar;
-        slot.can_equip = row.map_can_equip as c_uchar;
-
-        slot.xs = tiles.xs;
-        slot.ys = tiles.ys;
-        slot.bxs = tiles.bxs;
-        slot.bys = tiles.bys;
-        // Transfer ownership of tile arrays to the slot; null out tiles so
-        // ParsedTiles::drop does not double-free the transferred pointers.
-        slot.tile = std::mem::replace(&mut tiles.tile, std::ptr::null_mut());
-        slot.pass = std::mem::replace(&mut tiles.pass, std::ptr::null_mut());
-        slot.obj = std::mem::replace(&mut tiles.obj, std::ptr::null_mut());
-        slot.map = std::mem::replace(&mut tiles.map, std::ptr::null_mut());
-        slot.registry = alloc_zeroed_registry(MAX_MAPREG);
-
-        load_registry(slot, row.map_id)?;
+        sources.insert(row.map_id, now);
+        out.changed.push(row.map_id);
     }
 
-    Ok(rows.len())
+    Ok(out)
 }
 
 #[cfg(test)]
@@ -628,3 +751,28 @@ mod layout_tests {
         assert_eq!(std::mem::offset_of!(WarpList, next), 24);
     }
 }
+
+#[cfg(test)]
+mod reload_tests {
+    use super::*;
+
+    #[test]
+    fn classify_reload_changes() {
+        let src = map_cache::Source { len: 40, mtime_ns: 1 };
+        let was = LoadedFrom { row: 1, map_file: "town.map".into(), source: Some(src) };
+        let same = was.clone();
+        assert_eq!(classify(Some(&was), &same, true), Change::Unchanged);
+        assert_eq!(classify(Some(&was), &LoadedFrom { row: 2, ..was.clone() }, true), Change::Fields);
+
+        let touched = LoadedFrom { source: Some(map_cache::Source { mtime_ns: 2, ..src }), ..was.clone() };
+        assert_eq!(classify(Some(&was), &touched, true), Change::Tiles);
+        let renamed = LoadedFrom { map_file: "town2.map".into(), ..was.clone() };
+        assert_eq!(classify(Some(&was), &renamed, true), Change::Tiles);
+        // A file that cannot be stat'ed is never assumed unchanged
+        let gone = LoadedFrom { source: None, ..was.clone() };
+        assert_eq!(classify(Some(&gone), &gone, true), Change::Tiles);
+        // Loaded but unknown (sl_g_setmap) or not loaded at all
+        assert_eq!(classify(None, &same, true), Change::Tiles);
+        assert_eq!(classify(Some(&was), &same, false), Change::New);
+    }
+}
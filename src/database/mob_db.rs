@@ -168,6 +168,24 @@ async fn load_mobs() -> Result<usize, sqlx::Error> {
     .fetch_all(pool)
     .await?;
 
+    // One query for every mob's equipment instead of one per NPC mob; the
+    // per-mob form was most of a cold start. Rows past the 14th of a mob are
+    // dropped, as the old LIMIT 14 did.
+    let eq_rows = sqlx::query("SELECT `MeqMobId`, `MeqLook`, `MeqColor`, `MeqSlot` FROM `MobEquipment`")
+        .fetch_all(pool)
+        .await?;
+    let mut equipment: HashMap<u32, Vec<(u32, u32, usize)>> = HashMap::new();
+    for eq in &eq_rows {
+        let list = equipment.entry(eq.try_get::<u32, _>(0)?).or_default();
+        if list.len() < 14 {
+            list.push((
+                eq.try_get::<u32, _>(1).unwrap_or(0),
+                eq.try_get::<u32, _>(2).unwrap_or(0),
+                eq.try_get::<u8, _>(3).unwrap_or(0) as usize,
+            ));
+        }
+    }
+
     let count = rows.len();
     let mut map = MOB_DB.get().unwrap().lock().unwrap();
 
@@ -213,20 +231,11 @@ async fn load_mobs() -> Result<usize, sqlx::Error> {
         m.isboss     = row.try_get::<u32, _>(34).unwrap_or(0) as c_uchar;
 
         if m.mobtype == 1 {
-            let eq_rows = sqlx::query(
-                "SELECT `MeqLook`, `MeqColor`, `MeqSlot` \
-                 FROM `MobEquipment` WHERE `MeqMobId` = ? LIMIT 14",
-            )
-            .bind(id)
-            .fetch_all(pool)
-            .await?;
-
-            for eq in &eq_rows {
-                let slot = eq.try_get::<u8, _>(2).unwrap_or(0) as usize;
+            for &(look, color, slot) in equipment.get(&id).into_iter().flatten() {
                 if slot < MAX_EQUIP {
-                    m.equip[slot].id     = eq.try_get::<u32, _>(0).unwrap_or(0);
+                    m.equip[slot].id     = look;
                     m.equip[slot].amount = 1;
-                    m.equip[slot].custom = eq.try_get::<u32, _>(1).unwrap_or(0);
+                    m.equip[slot].custom = color;
                 }
             }
         }
@@ -239,7 +248,13 @@ async fn load_mobs() -> Result<usize, sqlx::Error> {
 
 pub fn init() -> c_int {
     MOB_DB.get_or_init(|| Mutex::new(HashMap::new()));
-    match blocking_run(load_mobs()) {
+    // SAFETY: MobDbData is plain data.
+    let loaded = unsafe {
+        super::snapshot::load_or("mob_db", &["Mobs", "MobEquipment"], db(), |m| m.id, || {
+            blocking_run(load_mobs())
+        })
+    };
+    match loaded {
         Ok(n) => { tracing::info!("[mob_db] read done count={n}"); 0 }
         Err(e) => { tracing::error!("[mob_db] load failed: {e}"); -1 }
     }
@@ -5,13 +5,20 @@ use sqlx::MySqlPool;
 use tokio::runtime::Runtime;
 
 pub mod board_db;
+pub mod cell_index;
 pub mod clan_db;
 pub mod class_db;
 pub mod item_db;
 pub mod magic_db;
+pub mod map_cache;
 pub mod map_db;
 pub mod mob_db;
+pub mod pass_grid;
+pub mod ranking_db;
 pub mod recipe_db;
+pub mod registry_writes;
+pub mod snapshot;
+pub mod write_behind;
 
 static DB_POOL: OnceLock<MySqlPool> = OnceLock::new();
 // Single persistent runtime — pool connections are bound to a reactor; reusing
@@ -35,6 +42,47 @@ pub(crate) fn blocking_run<F: Future>(f: F) -> F::Output {
     get_runtime().block_on(f)
 }
 
+/// Load the static game tables (items, recipes, mobs, spells, classes, clans,
+/// boards, event rankings) concurrently, one thread each: they are independent of each other
+/// and of the game state, and each spends most of its time waiting on MySQL.
+/// Returns the names of the loaders that failed.
+pub fn load_static(data_dir: &std::ffi::CStr) -> Vec<&'static str> {
+    let loaders: [(&'static str, &(dyn Fn() -> std::os::raw::c_int + Sync)); 8] = [
+        ("item_db", &item_db::init),
+        ("recipe_db", &recipe_db::init),
+        ("mob_db", &mob_db::init),
+        ("magic_db", &magic_db::init),
+        ("class_db", &|| class_db::init(data_dir.as_ptr())),
+        ("clan_db", &clan_db::init),
+        ("board_db", &board_db::init),
+        ("ranking_db", &ranking_db::init),
+    ];
+    let started = std::time::Instant::now();
+    let failed = std::thread::scope(|s| {
+        let running: Vec<_> = loaders
+            .iter()
+            .map(|&(name, init)| (name, std::thread::Builder::new().name(name.into()).spawn_scoped(s, init)))
+            .collect();
+        let mut failed = Vec::new();
+        for (name, t) in running {
+            // A loader that panicked counts as failed
+            let rc = match t {
+                Ok(t) => t.join().unwrap_or(-1),
+                Err(e) => {
+                    tracing::error!("[db] could not start {name} loader: {e}");
+                    -1
+                }
+            };
+            if rc != 0 {
+                failed.push(name);
+            }
+        }
+        failed
+    });
+    tracing::info!("[db] static tables loaded in {:?}", started.elapsed());
+    failed
+}
+
 /// Connect to the database. Called from ffi::database::rust_db_connect.
 ///
 /// Returns an error if the pool is already initialized or if the connection fails.
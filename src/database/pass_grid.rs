@@ -0,0 +1,336 @@
+//! Bit-packed passability planes for movement checks.
+//!
+//! A step used to read the map's `pass` and `obj` arrays (one `u16` per
+//! tile), look the object up in `objectFlags`, and walk the block chains of
+//! the target cell for players, mobs and NPCs standing on the tile. Here
+//! each map keeps one bit per tile for each of those questions:
+//!
+//! - `wall`: `pass` is non-zero
+//! - `edge[OBJ_*]`: the tile's object blocks that edge (objectFlags bit)
+//! - `occupied`: at least one PC, mob or NPC stands on the tile
+//!
+//! Static planes come from the map arrays and are patched by `set_tile`
+//! when a script rewrites a tile. The occupancy plane is kept in step by
+//! map_addblock/map_delblock/map_moveblock (ffi/block.rs).
+//!
+//! The planes are a filter, not the whole rule: a clear bit answers the
+//! question outright, a set `wall` or `occupied` bit still goes through
+//! the exact check (an unphysical player's id in `pass`, a dead mob, a GM
+//! or ghost on the tile). Most steps end at the clear bits.
+
+use std::collections::HashMap;
+
+/// objectFlags bits, as in map_server.h
+pub const OBJ_UP: u8 = 1;
+pub const OBJ_DOWN: u8 = 2;
+pub const OBJ_RIGHT: u8 = 4;
+pub const OBJ_LEFT: u8 = 8;
+
+/// Edge bits checked per side (0 up, 1 right, 2 down, 3 left): on the
+/// tile entered, and on the tile left (clif_object_canmove/_from).
+const ENTER: [u8; 4] = [OBJ_UP, OBJ_RIGHT, OBJ_DOWN, OBJ_LEFT];
+const LEAVE: [u8; 4] = [OBJ_DOWN, OBJ_LEFT, OBJ_UP, OBJ_RIGHT];
+
+#[derive(Debug, Default, Clone)]
+struct Bits(Vec<u64>);
+
+impl Bits {
+    fn new(len: usize) -> Self {
+        Bits(vec![0; len.div_ceil(64)])
+    }
+
+    #[inline]
+    fn get(&self, i: usize) -> bool {
+        self.0[i >> 6] >> (i & 63) & 1 != 0
+    }
+
+    #[inline]
+    fn set(&mut self, i: usize, on: bool) {
+        let mask = 1u64 << (i & 63);
+        if on {
+            self.0[i >> 6] |= mask;
+        } else {
+            self.0[i >> 6] &= !mask;
+        }
+    }
+}
+
+/// What the planes say about one step. `edge` is final; `wall` and
+/// `occupied` mean the exact check has to run.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct Step {
+    pub edge: bool,
+    pub wall: bool,
+    pub occupied: bool,
+}
+
+/// The four steps out of one tile, one bit per side (1 << side).
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct Steps {
+    /// Off the map
+    pub off: u8,
+    pub edge: u8,
+    pub wall: u8,
+    pub occupied: u8,
+}
+
+impl Steps {
+    /// Sides nothing can be in the way of.
+    pub fn clear(&self) -> u8 {
+        !(self.off | self.edge | self.wall | self.occupied) & 0xF
+    }
+
+    /// Sides that need the exact check before they are known open.
+    pub fn unsure(&self) -> u8 {
+        (self.wall | self.occupied) & !(self.off | self.edge) & 0xF
+    }
+}
+
+#[derive(Debug, Default)]
+pub struct PassGrid {
+    xs: usize,
+    ys: usize,
+    wall: Bits,
+    /// Indexed by objectFlags bit position (up, down, right, left)
+    edge: [Bits; 4],
+    occupied: Bits,
+    /// Occupants beyond the first on tiles that hold more than one
+    stacked: HashMap<u32, u32>,
+    /// Tile each occupant was counted on, so removal never depends on the
+    /// entity's current coordinates
+    tile_of: HashMap<usize, (u16, u16)>,
+}
+
+impl PassGrid {
+    /// Planes for a `xs`×`ys` map. `pass` and `obj` are the map arrays;
+    /// `flags` maps an object id to its objectFlags byte.
+    pub fn build(xs: usize, ys: usize, pass: &[u16], obj: &[u16], flags: impl Fn(u16) -> u8) -> Self {
+        let mut g = PassGrid { xs, ys, occupied: Bits::new(xs * ys), ..Default::default() };
+        g.load(pass, obj, flags);
+        g
+    }
+
+    pub fn dims(&self) -> (usize, usize) {
+        (self.xs, self.ys)
+    }
+
+    /// Rebuild the static planes from reloaded map arrays, keeping the
+    /// occupants (the block grid survives a reload).
+    pub fn reload(&mut self, xs: usize, ys: usize, pass: &[u16], obj: &[u16], flags: impl Fn(u16) -> u8) {
+        self.xs = xs;
+        self.ys = ys;
+        self.load(pass, obj, flags);
+        self.occupied = Bits::new(xs * ys);
+        self.stacked.clear();
+        let tiles: Vec<(u16, u16)> = self.tile_of.values().copied().collect();
+        for (x, y) in tiles {
+            self.count(x, y, 1);
+        }
+    }
+
+    fn load(&mut self, pass: &[u16], obj: &[u16], flags: impl Fn(u16) -> u8) {
+        let n = self.xs * self.ys;
+        self.wall = Bits::new(n);
+        self.edge = Default::default();
+        for e in &mut self.edge {
+            *e = Bits::new(n);
+        }
+        for i in 0..n.min(pass.len()).min(obj.len()) {
+            self.put(i, pass[i], flags(obj[i]));
+        }
+    }
+
+    fn put(&mut self, i: usize, pass: u16, flag: u8) {
+        self.wall.set(i, pass != 0);
+        for (b, e) in self.edge.iter_mut().enumerate() {
+            e.set(i, flag & (1 << b) != 0);
+        }
+    }
+
+    #[inline]
+    fn index(&self, x: u16, y: u16) -> Option<usize> {
+        let (x, y) = (x as usize, y as usize);
+        (x < self.xs && y < self.ys).then_some(x + y * self.xs)
+    }
+
+    /// A script rewrote tile (x, y).
+    pub fn set_tile(&mut self, x: u16, y: u16, pass: u16, flag: u8) {
+        if let Some(i) = self.index(x, y) {
+            self.put(i, pass, flag);
+        }
+    }
+
+    fn count(&mut self, x: u16, y: u16, delta: i32) {
+        let Some(i) = self.index(x, y) else { return };
+        if delta > 0 {
+            if self.occupied.get(i) {
+                *self.stacked.entry(i as u32).or_insert(0) += 1;
+            } else {
+                self.occupied.set(i, true);
+            }
+        } else if let Some(n) = self.stacked.get_mut(&(i as u32)) {
+            *n -= 1;
+            if *n == 0 {
+                self.stacked.remove(&(i as u32));
+            }
+        } else {
+            self.occupied.set(i, false);
+        }
+    }
+
+    /// Count `addr` as standing on (x, y), moving it if it was elsewhere.
+    pub fn occupy(&mut self, addr: usize, x: u16, y: u16) {
+        if let Some((ox, oy)) = self.tile_of.insert(addr, (x, y)) {
+            if (ox, oy) == (x, y) {
+                return;
+            }
+            self.count(ox, oy, -1);
+        }
+        self.count(x, y, 1);
+    }
+
+    pub fn vacate(&mut self, addr: usize) -> bool {
+        let Some((x, y)) = self.tile_of.remove(&addr) else { return false };
+        self.count(x, y, -1);
+        true
+    }
+
+    pub fn is_occupied(&self, x: u16, y: u16) -> bool {
+        self.index(x, y).is_some_and(|i| self.occupied.get(i))
+    }
+
+    /// The step from (x0, y0) onto (x1, y1) heading `side`. A target off
+    /// the map reads as an edge; a side past 3 meets no object edge, as in
+    /// the C switch.
+    pub fn step(&self, x0: u16, y0: u16, x1: u16, y1: u16, side: usize) -> Step {
+        let (Some(from), Some(to)) = (self.index(x0, y0), self.index(x1, y1)) else {
+            return Step { edge: true, ..Step::default() };
+        };
+        let bit = |flag: u8| flag.trailing_zeros() as usize;
+        Step {
+            edge: side < 4
+                && (self.edge[bit(ENTER[side])].get(to) || self.edge[bit(LEAVE[side])].get(from)),
+            wall: self.wall.get(to),
+            occupied: self.occupied.get(to),
+        }
+    }
+
+    /// All four steps out of (x, y) at once.
+    pub fn steps(&self, x: u16, y: u16) -> Steps {
+        let mut s = Steps::default();
+        for side in 0..4 {
+            let bit = 1u8 << side;
+            let (tx, ty) = match side {
+                0 => (Some(x), y.checked_sub(1)),
+                1 => (x.checked_add(1), Some(y)),
+                2 => (Some(x), y.checked_add(1)),
+                _ => (x.checked_sub(1), Some(y)),
+            };
+            let (Some(tx), Some(ty)) = (tx, ty) else {
+                s.off |= bit;
+                continue;
+            };
+            if self.index(tx, ty).is_none() {
+                s.off |= bit;
+                continue;
+            }
+            let step = self.step(x, y, tx, ty, side);
+            s.edge |= bit * step.edge as u8;
+            s.wall |= bit * step.wall as u8;
+            s.occupied |= bit * step.occupied as u8;
+        }
+        s
+    }
+
+    pub fn occupants(&self) -> usize {
+        self.tile_of.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// 4×3 map, wall at (1,0), object 5 at (2,1) with OBJ_RIGHT | OBJ_DOWN.
+    fn grid() -> PassGrid {
+        let mut pass = vec![0u16; 12];
+        pass[1] = 1;
+        let mut obj = vec![0u16; 12];
+        obj[2 + 4] = 5;
+        PassGrid::build(4, 3, &pass, &obj, |o| if o == 5 { OBJ_RIGHT | OBJ_DOWN } else { 0 })
+    }
+
+    #[test]
+    fn test_step_matches_tile_rules() {
+        let g = grid();
+        // Heading right onto the object: OBJ_RIGHT on the tile entered
+        assert!(g.step(1, 1, 2, 1, 1).edge);
+        // Heading up out of it: OBJ_DOWN on the tile left
+        assert!(g.step(2, 1, 2, 0, 0).edge);
+        assert!(g.step(2, 0, 2, 1, 2).edge);
+        // Heading left onto it, or down out of it, is open
+        assert_eq!(g.step(3, 1, 2, 1, 3), Step::default());
+        assert_eq!(g.step(2, 1, 2, 2, 2), Step::default());
+        assert!(g.step(0, 0, 1, 0, 1).wall);
+        assert!(g.step(3, 2, 4, 2, 1).edge);
+        assert!(!g.step(1, 1, 2, 1, 7).edge);
+    }
+
+    #[test]
+    fn test_steps_batches_all_sides() {
+        let mut g = grid();
+        g.occupy(0xA0, 1, 2);
+        let s = g.steps(1, 1);
+        assert_eq!(s.wall, 1 << 0);
+        assert_eq!(s.edge, 1 << 1);
+        assert_eq!(s.occupied, 1 << 2);
+        assert_eq!(s.clear(), 1 << 3);
+        assert_eq!(s.unsure(), 1 << 0 | 1 << 2);
+        // Corner: up and left are off the map
+        let s = g.steps(0, 0);
+        assert_eq!(s.off, 1 << 0 | 1 << 3);
+        assert_eq!(s.wall, 1 << 1);
+        for side in 0..4 {
+            let one = g.steps(1, 1);
+            let (tx, ty) = [(1, 0), (2, 1), (1, 2), (0, 1)][side];
+            let step = g.step(1, 1, tx, ty, side);
+            assert_eq!(one.edge >> side & 1 == 1, step.edge);
+            assert_eq!(one.wall >> side & 1 == 1, step.wall);
+            assert_eq!(one.occupied >> side & 1 == 1, step.occupied);
+        }
+    }
+
+    #[test]
+    fn test_occupancy_counts_stacked_entities() {
+        let mut g = grid();
+        g.occupy(1, 3, 2);
+        g.occupy(2, 3, 2);
+        assert!(g.vacate(1));
+        assert!(g.is_occupied(3, 2));
+        // Moving off the tile clears it; moving again is a no-op
+        g.occupy(2, 0, 2);
+        g.occupy(2, 0, 2);
+        assert!(!g.is_occupied(3, 2));
+        assert!(g.is_occupied(0, 2));
+        assert!(g.vacate(2));
+        assert!(!g.vacate(2));
+        assert!(!g.is_occupied(0, 2));
+        // Off-map occupants are tracked but mark nothing
+        g.occupy(3, 9, 9);
+        assert_eq!(g.occupants(), 1);
+        assert!(g.vacate(3));
+    }
+
+    #[test]
+    fn test_reload_and_set_tile() {
+        let mut g = grid();
+        g.occupy(1, 3, 2);
+        g.set_tile(1, 0, 0, 0);
+        assert!(!g.step(0, 0, 1, 0, 1).wall);
+        // Larger map, no walls: occupant kept at its tile
+        g.reload(5, 5, &[0; 25], &[0; 25], |_| 0);
+        assert_eq!(g.dims(), (5, 5));
+        assert!(g.is_occupied(3, 2));
+        assert_eq!(g.steps(2, 2).clear(), 0b1101);
+    }
+}
@@ -0,0 +1,493 @@
+//! Event leaderboards (`RankingScores`), held in memory.
+//!
+//! The ranking window used to run a query for every figure it showed, and
+//! each time it opened an `UPDATE ... SET Rank = @r := (@r + 1)` over the
+//! whole event, all on the game thread. Every event's scores are now loaded
+//! with the static tables into an order-statistic treap per event, ordered
+//! by score (highest first) and then by row age. A rank is one O(log n)
+//! walk and a page of ten is ten.
+//!
+//! Score changes update the tree and queue an upsert on the write-behind
+//! queue, keyed per row so a score bumped every kill is saved once per
+//! drain. A reward claim only updates `EventClaim` of its row. The `Rank`
+//! column is still rewritten when the window opens, but on the DB worker,
+//! for readers outside the server.
+//!
+//! The board is read once at startup. Scores written to the table from
+//! outside the server are not seen until `@reloadranking`, and a score set
+//! in game overwrites them; scripts should keep scores with
+//! setRankingScore/addRankingScore instead.
+//!
+//! Rows are unique on (EventId, ChaId) from migration 26.
+
+use std::cmp::Reverse;
+use std::collections::HashMap;
+use std::os::raw::c_int;
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+use sqlx::Row;
+
+use super::registry_writes::quote;
+use super::{blocking_run, get_pool};
+
+/// Claim state of a row with no reward to take (also reported for players
+/// with no row, as checkevent_claim did).
+pub const CLAIM_NONE: i32 = 2;
+
+/// Tree order: score descending, then oldest row first.
+type Key = (Reverse<i32>, u64);
+
+const NIL: u32 = u32::MAX;
+
+#[derive(Debug, Clone, Copy)]
+struct Node {
+    key: Key,
+    cha: u32,
+    prio: u32,
+    size: u32,
+    left: u32,
+    right: u32,
+}
+
+/// Order-statistic treap over `Key`, nodes in one vector with a free list.
+#[derive(Debug)]
+struct Treap {
+    nodes: Vec<Node>,
+    free: Vec<u32>,
+    root: u32,
+    rng: u32,
+}
+
+impl Default for Treap {
+    fn default() -> Self {
+        Treap { nodes: Vec::new(), free: Vec::new(), root: NIL, rng: 0x9E37_79B9 }
+    }
+}
+
+impl Treap {
+    fn size(&self, n: u32) -> u32 {
+        if n == NIL { 0 } else { self.nodes[n as usize].size }
+    }
+
+    fn fix(&mut self, n: u32) {
+        let (l, r) = (self.nodes[n as usize].left, self.nodes[n as usize].right);
+        self.nodes[n as usize].size = 1 + self.size(l) + self.size(r);
+    }
+
+    /// Split `n` into keys below `key` and the rest.
+    fn split(&mut self, n: u32, key: &Key) -> (u32, u32) {
+        if n == NIL {
+            return (NIL, NIL);
+        }
+        if self.nodes[n as usize].key < *key {
+            let (a, b) = self.split(self.nodes[n as usize].right, key);
+            self.nodes[n as usize].right = a;
+            self.fix(n);
+            (n, b)
+        } else {
+            let (a, b) = self.split(self.nodes[n as usize].left, key);
+            self.nodes[n as usize].left = b;
+            self.fix(n);
+            (a, n)
+        }
+    }
+
+    fn merge(&mut self, a: u32, b: u32) -> u32 {
+        if a == NIL {
+            return b;
+        }
+        if b == NIL {
+            return a;
+        }
+        if self.nodes[a as usize].prio > self.nodes[b as usize].prio {
+            let r = self.merge(self.nodes[a as usize].right, b);
+            self.nodes[a as usize].right = r;
+            self.fix(a);
+            a
+        } else {
+            let l = self.merge(a, self.nodes[b as usize].left);
+            self.nodes[b as usize].left = l;
+            self.fix(b);
+            b
+        }
+    }
+
+    fn insert(&mut self, key: Key, cha: u32) {
+        // xorshift32: priorities only need to be unpredictable to the input
+        self.rng ^= self.rng << 13;
+        self.rng ^= self.rng >> 17;
+        self.rng ^= self.rng << 5;
+        let node = Node { key, cha, prio: self.rng, size: 1, left: NIL, right: NIL };
+        let n = match self.free.pop() {
+            Some(n) => {
+                self.nodes[n as usize] = node;
+                n
+            }
+            None => {
+                self.nodes.push(node);
+                (self.nodes.len() - 1) as u32
+            }
+        };
+        let (a, b) = self.split(self.root, &key);
+        let a = self.merge(a, n);
+        self.root = self.merge(a, b);
+    }
+
+    fn remove(&mut self, key: &Key) {
+        let (a, b) = self.split(self.root, key);
+        let next = (key.0, key.1 + 1);
+        let (hit, c) = self.split(b, &next);
+        if hit != NIL {
+            self.free.push(hit);
+        }
+        self.root = self.merge(a, c);
+    }
+
+    /// Number of keys below `key`.
+    fn rank(&self, key: &Key) -> usize {
+        let (mut n, mut below) = (self.root, 0);
+        while n != NIL {
+            let node = &self.nodes[n as usize];
+            if node.key < *key {
+                below += self.size(node.left) as usize + 1;
+                n = node.right;
+            } else {
+                n = node.left;
+            }
+        }
+        below
+    }
+
+    /// Character at 0-based position `k`.
+    fn nth(&self, mut k: usize) -> Option<u32> {
+        let mut n = self.root;
+        while n != NIL {
+            let node = &self.nodes[n as usize];
+            let left = self.size(node.left) as usize;
+            match k.cmp(&left) {
+                std::cmp::Ordering::Less => n = node.left,
+                std::cmp::Ordering::Equal => return Some(node.cha),
+                std::cmp::Ordering::Greater => {
+                    k -= left + 1;
+                    n = node.right;
+                }
+            }
+        }
+        None
+    }
+
+    fn len(&self) -> usize {
+        self.size(self.root) as usize
+    }
+}
+
+/// One character's row in one event.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Entry {
+    pub name: String,
+    pub score: i32,
+    pub claim: i32,
+    /// `Index` of a loaded row, or a later number for new ones
+    seq: u64,
+}
+
+impl Entry {
+    fn key(&self) -> Key {
+        (Reverse(self.score), self.seq)
+    }
+}
+
+#[derive(Debug, Default)]
+struct Board {
+    tree: Treap,
+    rows: HashMap<u32, Entry>,
+}
+
+/// One row of a ranking page.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Standing {
+    pub name: String,
+    pub score: i32,
+    /// 1-based
+    pub rank: usize,
+}
+
+#[derive(Debug, Default)]
+pub struct Ranking {
+    boards: HashMap<u32, Board>,
+    next_seq: u64,
+}
+
+impl Ranking {
+    fn row(&self, event: u32, cha: u32) -> Option<&Entry> {
+        self.boards.get(&event)?.rows.get(&cha)
+    }
+
+    /// File a loaded row.
+    fn load(&mut self, index: u64, event: u32, cha: u32, name: String, score: i32, claim: i32) {
+        self.next_seq = self.next_seq.max(index + 1);
+        let board = self.boards.entry(event).or_default();
+        if let Some(old) = board.rows.remove(&cha) {
+            board.tree.remove(&old.key());
+        }
+        let e = Entry { name, score, claim, seq: index };
+        board.tree.insert(e.key(), cha);
+        board.rows.insert(cha, e);
+    }
+
+    pub fn score(&self, event: u32, cha: u32) -> Option<i32> {
+        self.row(event, cha).map(|e| e.score)
+    }
+
+    /// 1-based rank of `cha` in `event`.
+    pub fn rank(&self, event: u32, cha: u32) -> Option<usize> {
+        let e = self.row(event, cha)?;
+        Some(self.boards[&event].tree.rank(&e.key()) + 1)
+    }
+
+    pub fn claim(&self, event: u32, cha: u32) -> Option<i32> {
+        self.row(event, cha).map(|e| e.claim)
+    }
+
+    /// Players with a row in `event`.
+    pub fn count(&self, event: u32) -> usize {
+        self.boards.get(&event).map_or(0, |b| b.tree.len())
+    }
+
+    /// Up to `n` standings from 0-based position `offset`.
+    pub fn page(&self, event: u32, offset: usize, n: usize) -> Vec<Standing> {
+        let Some(b) = self.boards.get(&event) else { return Vec::new() };
+        (offset..offset.saturating_add(n))
+            .map_while(|k| {
+                let cha = b.tree.nth(k)?;
+                let e = &b.rows[&cha];
+                Some(Standing { name: e.name.clone(), score: e.score, rank: k + 1 })
+            })
+            .collect()
+    }
+
+    /// Set `cha`'s score in `event`, adding the row if it is new.
+    pub fn set_score(&mut self, event: u32, cha: u32, name: &str, score: i32) -> &Entry {
+        let seq = self.next_seq;
+        let board = self.boards.entry(event).or_default();
+        let e = match board.rows.remove(&cha) {
+            Some(mut e) => {
+                board.tree.remove(&e.key());
+                e.score = score;
+                e.name = name.to_owned();
+                e
+            }
+            None => {
+                self.next_seq += 1;
+                Entry { name: name.to_owned(), score, claim: 0, seq }
+            }
+        };
+        board.tree.insert(e.key(), cha);
+        board.rows.entry(cha).or_insert(e)
+    }
+
+    /// Set the claim state of an existing row. Returns None if there is no
+    /// row.
+    pub fn set_claim(&mut self, event: u32, cha: u32, claim: i32) -> Option<&Entry> {
+        let e = self.boards.get_mut(&event)?.rows.get_mut(&cha)?;
+        e.claim = claim;
+        Some(e)
+    }
+
+    pub fn rows(&self) -> usize {
+        self.boards.values().map(|b| b.rows.len()).sum()
+    }
+}
+
+static RANKING: OnceLock<Mutex<Ranking>> = OnceLock::new();
+
+pub fn ranking() -> MutexGuard<'static, Ranking> {
+    RANKING
+        .get_or_init(|| Mutex::new(Ranking::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+async fn load_rows() -> Result<Ranking, sqlx::Error> {
+    let rows = sqlx::query(
+        "SELECT `Index`, `EventId`, `ChaId`, `ChaName`, `Score`, `EventClaim` FROM `RankingScores`",
+    )
+    .fetch_all(get_pool())
+    .await?;
+    let mut r = Ranking::default();
+    for row in rows {
+        let index: u32 = row.try_get(0)?;
+        let event: i32 = row.try_get(1)?;
+        let cha: i32 = row.try_get(2)?;
+        r.load(index as u64, event as u32, cha as u32, row.try_get(3)?, row.try_get(4)?, row.try_get(5)?);
+    }
+    Ok(r)
+}
+
+/// Load every event's scores, replacing what is held. Queued writes are
+/// drained first so a reload never reads around them.
+pub fn init() -> c_int {
+    super::write_behind::flush();
+    match blocking_run(load_rows()) {
+        Ok(r) => {
+            tracing::info!("[ranking_db] read done events={} rows={}", r.boards.len(), r.rows());
+            *ranking() = r;
+            0
+        }
+        Err(e) => {
+            tracing::error!("[ranking_db] load failed: {e}");
+            -1
+        }
+    }
+}
+
+fn upsert_sql(event: u32, cha: u32, e: &Entry) -> String {
+    format!(
+        "INSERT INTO `RankingScores` (`EventId`, `ChaId`, `ChaName`, `Score`, `EventClaim`) \
+         VALUES ({event}, {cha}, {}, {}, {}) ON DUPLICATE KEY UPDATE \
+         `ChaName` = VALUES(`ChaName`), `Score` = VALUES(`Score`), `EventClaim` = VALUES(`EventClaim`)",
+        quote(&e.name),
+        e.score,
+        e.claim
+    )
+}
+
+fn claim_sql(event: u32, cha: u32, claim: i32) -> String {
+    format!("UPDATE `RankingScores` SET `EventClaim` = {claim} WHERE `EventId` = {event} AND `ChaId` = {cha}")
+}
+
+/// Queue `sql` under `key`, or run it here if no worker is running.
+fn write(key: String, sql: String) {
+    if !super::write_behind::push(Some(key), sql.clone()) {
+        if let Err(e) = blocking_run(sqlx::raw_sql(&sql).execute(get_pool())) {
+            tracing::error!("[ranking_db] {} sql={:.200}", e, sql);
+        }
+    }
+}
+
+/// Save the row of `cha` in `event` as it is held now.
+pub fn save(event: u32, cha: u32) {
+    let sql = match ranking().row(event, cha) {
+        Some(e) => upsert_sql(event, cha, e),
+        None => return,
+    };
+    write(format!("ranking:{event}:{cha}"), sql);
+}
+
+/// Set `cha`'s claim state in `event` and queue it, leaving the rest of the
+/// row as it is in the DB. False if `cha` has no row in `event`.
+pub fn set_claim(event: u32, cha: u32, claim: i32) -> bool {
+    if ranking().set_claim(event, cha, claim).is_none() {
+        return false;
+    }
+    write(format!("ranking:{event}:{cha}:claim"), claim_sql(event, cha, claim));
+    true
+}
+
+/// Set `cha`'s score in `event` and queue the save.
+pub fn record(event: u32, cha: u32, name: &str, score: i32) {
+    ranking().set_score(event, cha, name, score);
+    save(event, cha);
+}
+
+/// Add `delta` to `cha`'s score in `event` (from 0 if they have none) and
+/// queue the save. Returns the new score.
+pub fn add(event: u32, cha: u32, name: &str, delta: i32) -> i32 {
+    let score = {
+        let mut r = ranking();
+        let score = r.score(event, cha).unwrap_or(0).saturating_add(delta);
+        r.set_score(event, cha, name, score);
+        score
+    };
+    save(event, cha);
+    score
+}
+
+/// Rewrite the `Rank` column of `event` on the DB worker.
+pub fn save_ranks(event: u32) {
+    let sql = format!(
+        "SET @r = 0; UPDATE `RankingScores` SET `Rank` = @r := (@r + 1) \
+         WHERE `EventId` = {event} ORDER BY `Score` DESC, `Index` ASC"
+    );
+    write(format!("ranking:{event}:ranks"), sql);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn brute_rank(scores: &[(u32, i32, u64)], cha: u32) -> usize {
+        let me = scores.iter().find(|s| s.0 == cha).unwrap();
+        1 + scores.iter().filter(|s| (Reverse(s.1), s.2) < (Reverse(me.1), me.2)).count()
+    }
+
+    #[test]
+    fn test_ranks_follow_score_then_age() {
+        let mut r = Ranking::default();
+        r.load(5, 1, 100, "Old".into(), 30, 0);
+        r.load(9, 1, 101, "Young".into(), 30, 1);
+        r.load(7, 1, 102, "Top".into(), 50, 0);
+        r.load(3, 2, 100, "Old".into(), 1, 0);
+        assert_eq!(r.rank(1, 102), Some(1));
+        assert_eq!(r.rank(1, 100), Some(2));
+        assert_eq!(r.rank(1, 101), Some(3));
+        assert_eq!(r.rank(2, 100), Some(1));
+        assert_eq!(r.rank(1, 999), None);
+        assert_eq!(r.count(1), 3);
+        assert_eq!(r.claim(1, 101), Some(1));
+
+        // New rows sort after loaded ones of the same score
+        r.set_score(1, 103, "New", 30);
+        assert_eq!(r.rank(1, 103), Some(4));
+        r.set_score(1, 101, "Young", 60);
+        assert_eq!(r.rank(1, 101), Some(1));
+        assert_eq!(r.claim(1, 101), Some(1));
+        let page = r.page(1, 1, 10);
+        let names: Vec<&str> = page.iter().map(|s| s.name.as_str()).collect();
+        assert_eq!(names, ["Top", "Old", "New"]);
+        assert_eq!(page[2].rank, 4);
+        assert!(r.page(1, 10, 10).is_empty());
+        assert!(r.set_claim(1, 999, 2).is_none());
+    }
+
+    #[test]
+    fn test_tree_matches_brute_force() {
+        let mut r = Ranking::default();
+        let mut scores: Vec<(u32, i32, u64)> = Vec::new();
+        let mut x = 12345u32;
+        for step in 0..2000u32 {
+            x = x.wrapping_mul(1_103_515_245).wrapping_add(12345);
+            let cha = x >> 8 & 255;
+            let score = (x >> 16 & 63) as i32;
+            let seq = r.next_seq;
+            r.set_score(7, cha, "x", score);
+            match scores.iter_mut().find(|s| s.0 == cha) {
+                Some(s) => s.1 = score,
+                None => scores.push((cha, score, seq)),
+            }
+            if step % 97 == 0 {
+                for s in &scores {
+                    assert_eq!(r.rank(7, s.0), Some(brute_rank(&scores, s.0)));
+                }
+            }
+        }
+        assert_eq!(r.count(7), scores.len());
+        let page = r.page(7, 0, usize::MAX);
+        assert_eq!(page.len(), scores.len());
+        assert!(page.windows(2).all(|w| w[0].score >= w[1].score));
+    }
+
+    #[test]
+    fn test_upsert_escapes_name() {
+        let e = Entry { name: "O'Neil".into(), score: 12, claim: 2, seq: 0 };
+        let sql = upsert_sql(3, 44, &e);
+        assert!(sql.contains("VALUES (3, 44, 'O\\'Neil', 12, 2)"));
+        assert!(sql.contains("ON DUPLICATE KEY UPDATE"));
+    }
+
+    #[test]
+    fn test_claim_touches_only_event_claim() {
+        let sql = claim_sql(3, 44, 1);
+        assert_eq!(sql, "UPDATE `RankingScores` SET `EventClaim` = 1 WHERE `EventId` = 3 AND `ChaId` = 44");
+    }
+}
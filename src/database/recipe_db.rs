@@ -107,7 +107,13 @@ async fn load_recipes() -> Result<usize, sqlx::Error> {
 
 pub fn init() -> c_int {
     RECIPE_DB.get_or_init(|| Mutex::new(HashMap::new()));
-    match blocking_run(load_recipes()) {
+    // SAFETY: RecipeData is plain data.
+    let loaded = unsafe {
+        super::snapshot::load_or("recipe_db", &["Recipes"], db(), |r| r.id as u32, || {
+            blocking_run(load_recipes())
+        })
+    };
+    match loaded {
         Ok(n) => { println!("[recipe_db] read done count={}", n); 0 }
         Err(e) => { eprintln!("[recipe_db] load failed: {}", e); -1 }
     }
@@ -0,0 +1,223 @@
+//! Coalescing buffer for map and game registry writes.
+//!
+//! `map_setglobalreg`/`map_setglobalgamereg` run whenever a script touches a
+//! counter, and each used to cost a SELECT for the row followed by an
+//! UPDATE, INSERT or DELETE on the game thread. Writes now only record the
+//! registry's latest value here. Every `FLUSH_MS` the buffer is turned into
+//! one batched `INSERT ... ON DUPLICATE KEY UPDATE` per table for the
+//! non-zero values and one `DELETE` for the zeroed ones, and handed to the
+//! write-behind queue. Anything written twice inside a window is saved once,
+//! with its final value.
+//!
+//! Rows are keyed on (map, identifier) and (identifier): the unique keys
+//! added by migration 25 (`MapRegistry`, `GameRegistry0`) and migration 27
+//! (every other `GameRegistry<server id>`). Identifiers compare
+//! case-insensitively, as strcasecmp does in the C lookups.
+
+use std::collections::HashMap;
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+/// Buffer window, also the period of the flush timer.
+pub const FLUSH_MS: u32 = 500;
+/// Rows per generated statement.
+const ROWS_PER_STMT: usize = 500;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, PartialOrd, Ord)]
+enum Table {
+    /// `MapRegistry`, scoped by map id
+    Map,
+    /// `GameRegistry<server id>`
+    Game,
+}
+
+#[derive(Debug, Clone)]
+struct Pending {
+    ident: String,
+    val: i32,
+    /// `MrgPosition`; unused for game registries
+    pos: u32,
+}
+
+#[derive(Debug, Default)]
+pub struct RegistryWrites {
+    /// (table, map or server id, lowercased identifier) -> latest write
+    pending: HashMap<(Table, u32, String), Pending>,
+    coalesced: u64,
+}
+
+impl RegistryWrites {
+    fn set(&mut self, table: Table, scope: u32, ident: &str, val: i32, pos: u32) {
+        let key = (table, scope, ident.to_ascii_lowercase());
+        let p = Pending { ident: ident.to_owned(), val, pos };
+        if self.pending.insert(key, p).is_some() {
+            self.coalesced += 1;
+        }
+    }
+
+    /// Record map `m`'s registry `ident` (slot `pos`) as `val`; 0 deletes it.
+    pub fn set_map(&mut self, m: u32, ident: &str, val: i32, pos: u32) {
+        self.set(Table::Map, m, ident, val, pos);
+    }
+
+    /// Record game registry `ident` of server `server_id` as `val`; 0 deletes it.
+    pub fn set_game(&mut self, server_id: u32, ident: &str, val: i32) {
+        self.set(Table::Game, server_id, ident, val, 0);
+    }
+
+    pub fn len(&self) -> usize {
+        self.pending.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.pending.is_empty()
+    }
+
+    pub fn coalesced(&self) -> u64 {
+        self.coalesced
+    }
+
+    /// Drain the buffer into SQL statements.
+    pub fn statements(&mut self) -> Vec<String> {
+        let mut groups: HashMap<(Table, u32), (Vec<(u32, Pending)>, Vec<(u32, Pending)>)> = HashMap::new();
+        for ((table, scope, _), p) in self.pending.drain() {
+            let (puts, dels) = groups.entry((table, scope)).or_default();
+            if p.val != 0 { puts.push((scope, p)) } else { dels.push((scope, p)) }
+        }
+        // Map registries of all maps share a table; merge them
+        let mut map_puts = Vec::new();
+        let mut map_dels = Vec::new();
+        let mut out = Vec::new();
+        let mut keys: Vec<_> = groups.keys().copied().collect();
+        keys.sort();
+        for key in keys {
+            let (mut puts, mut dels) = groups.remove(&key).unwrap_or_default();
+            puts.sort_by(|a, b| a.1.ident.cmp(&b.1.ident));
+            dels.sort_by(|a, b| a.1.ident.cmp(&b.1.ident));
+            match key.0 {
+                Table::Map => {
+                    map_puts.extend(puts);
+                    map_dels.extend(dels);
+                }
+                Table::Game => game_sql(key.1, &puts, &dels, &mut out),
+            }
+        }
+        map_sql(&map_puts, &map_dels, &mut out);
+        out
+    }
+}
+
+fn map_sql(puts: &[(u32, Pending)], dels: &[(u32, Pending)], out: &mut Vec<String>) {
+    for chunk in puts.chunks(ROWS_PER_STMT) {
+        let rows: Vec<String> = chunk
+            .iter()
+            .map(|(m, p)| format!("({}, {}, {}, {})", m, quote(&p.ident), p.val, p.pos))
+            .collect();
+        out.push(format!(
+            "INSERT INTO `MapRegistry` (`MrgMapId`, `MrgIdentifier`, `MrgValue`, `MrgPosition`) \
+             VALUES {} ON DUPLICATE KEY UPDATE `MrgIdentifier` = VALUES(`MrgIdentifier`), \
+             `MrgValue` = VALUES(`MrgValue`), `MrgPosition` = VALUES(`MrgPosition`)",
+            rows.join(", ")
+        ));
+    }
+    for chunk in dels.chunks(ROWS_PER_STMT) {
+        let rows: Vec<String> = chunk.iter().map(|(m, p)| format!("({}, {})", m, quote(&p.ident))).collect();
+        out.push(format!(
+            "DELETE FROM `MapRegistry` WHERE (`MrgMapId`, `MrgIdentifier`) IN ({})",
+            rows.join(", ")
+        ));
+    }
+}
+
+fn game_sql(server_id: u32, puts: &[(u32, Pending)], dels: &[(u32, Pending)], out: &mut Vec<String>) {
+    for chunk in puts.chunks(ROWS_PER_STMT) {
+        let rows: Vec<String> = chunk.iter().map(|(_, p)| format!("({}, {})", quote(&p.ident), p.val)).collect();
+        out.push(format!(
+            "INSERT INTO `GameRegistry{}` (`GrgIdentifier`, `GrgValue`) VALUES {} \
+             ON DUPLICATE KEY UPDATE `GrgIdentifier` = VALUES(`GrgIdentifier`), \
+             `GrgValue` = VALUES(`GrgValue`)",
+            server_id,
+            rows.join(", ")
+        ));
+    }
+    for chunk in dels.chunks(ROWS_PER_STMT) {
+        let idents: Vec<String> = chunk.iter().map(|(_, p)| quote(&p.ident)).collect();
+        out.push(format!(
+            "DELETE FROM `GameRegistry{}` WHERE `GrgIdentifier` IN ({})",
+            server_id,
+            idents.join(", ")
+        ));
+    }
+}
+
+/// Single-quoted MySQL string literal, escaped like mysql_real_escape_string.
+pub(crate) fn quote(s: &str) -> String {
+    let mut out = String::with_capacity(s.len() + 2);
+    out.push('\'');
+    for c in s.chars() {
+        match c {
+            '\0' => out.push_str("\\0"),
+            '\n' => out.push_str("\\n"),
+            '\r' => out.push_str("\\r"),
+            '\x1a' => out.push_str("\\Z"),
+            '\\' | '\'' | '"' => {
+                out.push('\\');
+                out.push(c);
+            }
+            _ => out.push(c),
+        }
+    }
+    out.push('\'');
+    out
+}
+
+static WRITES: OnceLock<Mutex<RegistryWrites>> = OnceLock::new();
+
+pub fn writes() -> MutexGuard<'static, RegistryWrites> {
+    WRITES
+        .get_or_init(|| Mutex::new(RegistryWrites::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// Hand everything buffered to the write-behind queue, or run it here if
+/// no worker is running.
+pub fn flush() {
+    let stmts = writes().statements();
+    for sql in stmts {
+        if !super::write_behind::push(None, sql.clone()) {
+            if let Err(e) = super::blocking_run(sqlx::raw_sql(&sql).execute(super::get_pool())) {
+                tracing::error!("[db] [registry] {} sql={:.200}", e, sql);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_writes_coalesce_into_batches() {
+        let mut w = RegistryWrites::default();
+        for kills in 1..=50 {
+            w.set_game(0, "eventKills", kills);
+        }
+        w.set_game(0, "EVENTKILLS", 51);
+        w.set_game(0, "old", 0);
+        w.set_map(3, "weather", 2, 0);
+        w.set_map(7, "it's", 1, 4);
+        w.set_map(7, "gone", 5, 5);
+        w.set_map(7, "gone", 0, 5);
+        assert_eq!(w.len(), 5);
+        assert_eq!(w.coalesced(), 51);
+
+        let sql = w.statements();
+        assert!(w.is_empty());
+        assert_eq!(sql.len(), 4);
+        assert!(sql[0].starts_with("INSERT INTO `GameRegistry0`"));
+        assert!(sql[0].contains("VALUES ('EVENTKILLS', 51) ON DUPLICATE"));
+        assert_eq!(sql[1], "DELETE FROM `GameRegistry0` WHERE `GrgIdentifier` IN ('old')");
+        assert!(sql[2].contains("VALUES (3, 'weather', 2, 0), (7, 'it\\'s', 1, 4) ON DUPLICATE"));
+        assert_eq!(sql[3], "DELETE FROM `MapRegistry` WHERE (`MrgMapId`, `MrgIdentifier`) IN ((7, 'gone'))");
+    }
+}
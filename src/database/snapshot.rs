@@ -0,0 +1,222 @@
+//! On-disk snapshots of the static game tables.
+//!
+//! item_db, mob_db, magic_db and recipe_db decode every row of their tables
+//! at startup, which dominates a cold start. Their records are plain
+//! `#[repr(C)]` data, so after a load the whole table is written to
+//! `db_snapshot_dir` as one file of raw records, and the next start reads it
+//! back with one sequential read instead.
+//!
+//! A snapshot is keyed by the MD5 of each source table's column list, row
+//! count and `CHECKSUM TABLE`, and the record size. Any schema change, row
+//! edit or struct change gives a new key and the tables are loaded from the
+//! database as before. Working out the key costs three small queries per
+//! table, all answered by the server without sending rows.
+
+use std::collections::HashMap;
+use std::hash::Hash;
+use std::path::{Path, PathBuf};
+use std::sync::{Mutex, OnceLock};
+
+use md5::{Digest, Md5};
+use sqlx::Row;
+
+use super::{blocking_run, get_pool};
+
+const MAGIC: [u8; 8] = *b"YURISNAP";
+const VERSION: u32 = 1;
+/// magic, version, record size, key, record count
+const HEADER: usize = 8 + 4 + 4 + 16 + 8;
+
+static DIR: OnceLock<PathBuf> = OnceLock::new();
+
+/// Where snapshots live; empty (or never set) disables them.
+pub fn set_dir(dir: &str) {
+    if !dir.is_empty() {
+        let _ = DIR.set(PathBuf::from(dir));
+    }
+}
+
+/// Snapshot key of `tables` for records of `record_size` bytes.
+async fn key(tables: &[&str], record_size: usize) -> Result<[u8; 16], sqlx::Error> {
+    let pool = get_pool();
+    let mut h = Md5::new();
+    h.update((record_size as u64).to_le_bytes());
+    for table in tables {
+        h.update(table.as_bytes());
+        h.update([0]);
+        let cols = sqlx::query(
+            "SELECT COLUMN_NAME, COLUMN_TYPE FROM information_schema.COLUMNS \
+             WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = ? ORDER BY ORDINAL_POSITION",
+        )
+        .bind(table)
+        .fetch_all(pool)
+        .await?;
+        for col in &cols {
+            for i in 0..2 {
+                // information_schema text comes back as binary on some servers
+                let v = col
+                    .try_get::<String, _>(i)
+                    .map(String::into_bytes)
+                    .or_else(|_| col.try_get::<Vec<u8>, _>(i))?;
+                h.update(&v);
+                h.update([0]);
+            }
+        }
+        let count: i64 = sqlx::query(&format!("SELECT COUNT(*) FROM `{table}`"))
+            .fetch_one(pool)
+            .await?
+            .try_get(0)?;
+        h.update(count.to_le_bytes());
+        let sum = sqlx::query(&format!("CHECKSUM TABLE `{table}`")).fetch_one(pool).await?;
+        let sum: Option<u64> = sum
+            .try_get::<Option<u64>, _>(1)
+            .or_else(|_| sum.try_get::<Option<i64>, _>(1).map(|v| v.map(|v| v as u64)))?;
+        // NULL means the table does not exist; never match a snapshot then
+        h.update(sum.ok_or_else(|| sqlx::Error::RowNotFound)?.to_le_bytes());
+    }
+    Ok(h.finalize().into())
+}
+
+/// Serialize `records` under `key`.
+///
+/// # Safety
+/// `T` must be plain data: integers, arrays of integers, and pointers that
+/// are null in every record.
+unsafe fn encode<T>(key: &[u8; 16], records: &[&T]) -> Vec<u8> {
+    let size = std::mem::size_of::<T>();
+    let mut out = Vec::with_capacity(HEADER + size * records.len());
+    out.extend_from_slice(&MAGIC);
+    out.extend_from_slice(&VERSION.to_le_bytes());
+    out.extend_from_slice(&(size as u32).to_le_bytes());
+    out.extend_from_slice(key);
+    out.extend_from_slice(&(records.len() as u64).to_le_bytes());
+    for r in records {
+        out.extend_from_slice(std::slice::from_raw_parts(*r as *const T as *const u8, size));
+    }
+    out
+}
+
+/// Records of a snapshot written by `encode` under `key`, if `data` is one.
+///
+/// # Safety
+/// As for `encode`; the bytes are copied into `T`s unchecked.
+unsafe fn decode<T>(key: &[u8; 16], data: &[u8]) -> Option<Vec<Box<T>>> {
+    let size = std::mem::size_of::<T>();
+    if data.len() < HEADER
+        || data[0..8] != MAGIC
+        || data[8..12] != VERSION.to_le_bytes()
+        || data[12..16] != (size as u32).to_le_bytes()
+        || data[16..32] != key[..]
+    {
+        return None;
+    }
+    let count = u64::from_le_bytes(data[32..40].try_into().unwrap()) as usize;
+    let body = &data[HEADER..];
+    if body.len() != count.checked_mul(size)? {
+        return None;
+    }
+    Some(
+        body.chunks_exact(size)
+            .map(|rec| {
+                let mut b: Box<T> = Box::new(std::mem::zeroed());
+                std::ptr::copy_nonoverlapping(rec.as_ptr(), &mut *b as *mut T as *mut u8, size);
+                b
+            })
+            .collect(),
+    )
+}
+
+fn write(path: &Path, bytes: &[u8]) -> std::io::Result<()> {
+    if let Some(dir) = path.parent() {
+        std::fs::create_dir_all(dir)?;
+    }
+    let tmp = path.with_extension(format!("tmp{}", std::process::id()));
+    let res = std::fs::write(&tmp, bytes).and_then(|_| std::fs::rename(&tmp, path));
+    if res.is_err() {
+        let _ = std::fs::remove_file(&tmp);
+    }
+    res
+}
+
+/// Fill `map` from the snapshot `name` of `tables` if it is current, else by
+/// running `load` and writing a new snapshot. Returns what `load` would:
+/// the number of records.
+///
+/// # Safety
+/// `T` must be plain data as described at `encode`.
+pub unsafe fn load_or<K, T>(
+    name: &str,
+    tables: &[&str],
+    map: &Mutex<HashMap<K, Box<T>>>,
+    id: impl Fn(&T) -> K,
+    load: impl FnOnce() -> Result<usize, sqlx::Error>,
+) -> Result<usize, sqlx::Error>
+where
+    K: Eq + Hash,
+{
+    let Some(dir) = DIR.get() else { return load() };
+    let path = dir.join(format!("{name}.snap"));
+    let key = match blocking_run(key(tables, std::mem::size_of::<T>())) {
+        Ok(k) => k,
+        Err(e) => {
+            tracing::warn!("[snapshot] {name}: no key, loading from the database: {e}");
+            return load();
+        }
+    };
+
+    if let Some(records) = std::fs::read(&path).ok().and_then(|d| decode::<T>(&key, &d)) {
+        let n = records.len();
+        let mut m = map.lock().unwrap();
+        for r in records {
+            m.insert(id(&r), r);
+        }
+        tracing::info!("[snapshot] {name}: {n} records from {}", path.display());
+        return Ok(n);
+    }
+
+    let n = load()?;
+    let bytes = {
+        let m = map.lock().unwrap();
+        let records: Vec<&T> = m.values().map(|b| &**b).collect();
+        encode(&key, &records)
+    };
+    if let Err(e) = write(&path, &bytes) {
+        tracing::warn!("[snapshot] {name}: could not write {}: {e}", path.display());
+    }
+    Ok(n)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[repr(C)]
+    #[derive(Debug, PartialEq)]
+    struct Rec {
+        id: u32,
+        name: [i8; 6],
+        flag: u8,
+        ptr: *mut u8,
+    }
+
+    #[test]
+    fn test_round_trip() {
+        let a = Rec { id: 7, name: [104, 105, 0, 0, 0, 0], flag: 1, ptr: std::ptr::null_mut() };
+        let b = Rec { id: 9, name: [0; 6], flag: 0, ptr: std::ptr::null_mut() };
+        let key = [3u8; 16];
+        let bytes = unsafe { encode(&key, &[&a, &b]) };
+        assert_eq!(bytes.len(), HEADER + 2 * std::mem::size_of::<Rec>());
+
+        let back = unsafe { decode::<Rec>(&key, &bytes) }.unwrap();
+        assert_eq!(back.len(), 2);
+        assert_eq!(*back[0], a);
+        assert_eq!(*back[1], b);
+
+        // Another key, a truncated file or a different record size never load
+        assert!(unsafe { decode::<Rec>(&[4u8; 16], &bytes) }.is_none());
+        assert!(unsafe { decode::<Rec>(&key, &bytes[..bytes.len() - 1]) }.is_none());
+        assert!(unsafe { decode::<[u8; 3]>(&key, &bytes) }.is_none());
+        let empty = unsafe { encode::<Rec>(&key, &[]) };
+        assert_eq!(unsafe { decode::<Rec>(&key, &empty) }.unwrap().len(), 0);
+    }
+}
@@ -0,0 +1,268 @@
+//! Write-behind queue for game-thread SQL.
+//!
+//! Fire-and-forget writes from the C game code (spawn death times, online
+//! flags, clan banks, the world clock) used to run on `sql_handle` on the
+//! game thread, so one slow MySQL round trip stalled every player. They are
+//! queued here instead and executed in order by a worker task on the sqlx
+//! pool. A write given a coalescing key replaces any queued write with the
+//! same key, so a row rewritten faster than the worker drains costs one
+//! statement carrying its final value.
+//!
+//! The queue holds at most `MAX_QUEUED_BYTES` of SQL: `push` waits for the
+//! worker when it is full rather than drop a write or let one jump the
+//! queue. `flush` (map_do_term) blocks until everything queued has run.
+
+use std::collections::{HashMap, VecDeque};
+use std::sync::{Condvar, Mutex, MutexGuard, OnceLock};
+use std::time::{Duration, Instant};
+
+use sqlx::MySqlPool;
+use tokio::sync::Notify;
+
+/// Queued SQL text the game thread may run ahead of the worker.
+pub const MAX_QUEUED_BYTES: usize = 8 << 20;
+/// Statements the worker takes per connection checkout.
+const BATCH: usize = 64;
+/// Longest `flush` waits for a stuck worker.
+const FLUSH_TIMEOUT: Duration = Duration::from_secs(30);
+
+struct Queued {
+    key: Option<String>,
+    sql: String,
+    at: Instant,
+}
+
+/// Ordered writes; a replaced write leaves a `None` behind.
+#[derive(Default)]
+pub struct WriteQueue {
+    slots: VecDeque<Option<Queued>>,
+    /// Sequence number of `slots[0]`
+    head: u64,
+    /// key -> sequence number of its queued write
+    keyed: HashMap<String, u64>,
+    live: usize,
+    bytes: usize,
+}
+
+impl WriteQueue {
+    /// Append `sql`. Returns true if it replaced a queued write under `key`.
+    pub fn push(&mut self, key: Option<String>, sql: String) -> bool {
+        let seq = self.head + self.slots.len() as u64;
+        let mut replaced = false;
+        if let Some(k) = &key {
+            if let Some(old) = self.keyed.insert(k.clone(), seq) {
+                if let Some(q) = self.slots[(old - self.head) as usize].take() {
+                    self.bytes -= q.sql.len();
+                    self.live -= 1;
+                    replaced = true;
+                }
+            }
+        }
+        self.bytes += sql.len();
+        self.live += 1;
+        self.slots.push_back(Some(Queued { key, sql, at: Instant::now() }));
+        replaced
+    }
+
+    /// Remove up to `max` writes, oldest first.
+    pub fn take(&mut self, max: usize, out: &mut Vec<String>) {
+        while out.len() < max {
+            let Some(slot) = self.slots.pop_front() else { break };
+            let seq = self.head;
+            self.head += 1;
+            let Some(q) = slot else { continue };
+            if let Some(k) = &q.key {
+                if self.keyed.get(k) == Some(&seq) {
+                    self.keyed.remove(k);
+                }
+            }
+            self.bytes -= q.sql.len();
+            self.live -= 1;
+            out.push(q.sql);
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.live
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.live == 0
+    }
+
+    pub fn bytes(&self) -> usize {
+        self.bytes
+    }
+
+    /// When the oldest queued write was pushed. A coalesced write counts
+    /// from its latest push.
+    pub fn oldest(&self) -> Option<Instant> {
+        self.slots.iter().flatten().next().map(|q| q.at)
+    }
+}
+
+#[derive(Default)]
+struct State {
+    queue: WriteQueue,
+    /// Statements taken by the worker and not yet finished
+    in_flight: usize,
+    running: bool,
+    coalesced: u64,
+    failed: u64,
+}
+
+struct Shared {
+    state: Mutex<State>,
+    /// Signalled whenever the worker finishes a batch
+    drained: Condvar,
+    work: Notify,
+}
+
+static SHARED: OnceLock<Shared> = OnceLock::new();
+
+fn shared() -> &'static Shared {
+    SHARED.get_or_init(|| Shared {
+        state: Mutex::new(State::default()),
+        drained: Condvar::new(),
+        work: Notify::new(),
+    })
+}
+
+fn lock() -> MutexGuard<'static, State> {
+    shared().state.lock().unwrap_or_else(|e| e.into_inner())
+}
+
+/// Start the worker on the current tokio runtime.
+pub fn start(pool: MySqlPool) {
+    {
+        let mut st = lock();
+        if st.running {
+            return;
+        }
+        st.running = true;
+    }
+    tokio::spawn(async move {
+        let sh = shared();
+        let mut batch = Vec::with_capacity(BATCH);
+        loop {
+            {
+                let mut st = lock();
+                st.queue.take(BATCH, &mut batch);
+                st.in_flight = batch.len();
+            }
+            if batch.is_empty() {
+                sh.work.notified().await;
+                continue;
+            }
+            let mut failed = 0;
+            match pool.acquire().await {
+                Ok(mut conn) => {
+                    for sql in &batch {
+                        if let Err(e) = sqlx::raw_sql(sql).execute(&mut *conn).await {
+                            failed += 1;
+                            tracing::error!("[db] [write] {} sql={:.200}", e, sql);
+                        }
+                    }
+                }
+                Err(e) => {
+                    failed = batch.len();
+                    tracing::error!("[db] [write] no connection, dropped {} writes: {}", batch.len(), e);
+                }
+            }
+            batch.clear();
+            let mut st = lock();
+            st.in_flight = 0;
+            st.failed += failed as u64;
+            sh.drained.notify_all();
+        }
+    });
+}
+
+/// Queue `sql`, coalescing with a queued write under the same `key`.
+/// Waits while the queue is full. Returns false (nothing queued) if no
+/// worker is running; the caller then runs the statement itself.
+pub fn push(key: Option<String>, sql: String) -> bool {
+    let sh = shared();
+    let mut st = lock();
+    if !st.running {
+        return false;
+    }
+    while st.queue.bytes() + sql.len() > MAX_QUEUED_BYTES && !st.queue.is_empty() {
+        st = sh.drained.wait(st).unwrap_or_else(|e| e.into_inner());
+    }
+    if st.queue.push(key, sql) {
+        st.coalesced += 1;
+    }
+    drop(st);
+    sh.work.notify_one();
+    true
+}
+
+/// What the worker has yet to run, for the metrics endpoint.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct Backlog {
+    pub queued: usize,
+    pub bytes: usize,
+    pub in_flight: usize,
+    /// Age of the oldest queued write
+    pub lag: Duration,
+    pub coalesced: u64,
+    pub failed: u64,
+}
+
+pub fn backlog() -> Backlog {
+    let st = lock();
+    Backlog {
+        queued: st.queue.len(),
+        bytes: st.queue.bytes(),
+        in_flight: st.in_flight,
+        lag: st.queue.oldest().map_or(Duration::ZERO, |t| t.elapsed()),
+        coalesced: st.coalesced,
+        failed: st.failed,
+    }
+}
+
+/// Block until every write queued so far has been executed.
+pub fn flush() {
+    let sh = shared();
+    let deadline = Instant::now() + FLUSH_TIMEOUT;
+    let mut st = lock();
+    while st.running && (!st.queue.is_empty() || st.in_flight > 0) {
+        let Some(left) = deadline.checked_duration_since(Instant::now()) else {
+            tracing::error!("[db] [write] flush timed out with {} writes queued", st.queue.len());
+            return;
+        };
+        st = sh.drained.wait_timeout(st, left).unwrap_or_else(|e| e.into_inner()).0;
+    }
+    tracing::info!("[db] [write] flushed (coalesced={} failed={})", st.coalesced, st.failed);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_keyed_writes_coalesce_in_order() {
+        let mut q = WriteQueue::default();
+        assert!(!q.push(Some("online:1".into()), "a1".into()));
+        assert!(!q.push(None, "b".into()));
+        assert!(!q.push(Some("online:2".into()), "c".into()));
+        // Replaces a1 and moves behind b and c
+        assert!(q.push(Some("online:1".into()), "a2".into()));
+        assert_eq!((q.len(), q.bytes()), (3, 4));
+        // a1's slot is empty now; b is the oldest live write
+        assert!(q.oldest().unwrap() <= Instant::now());
+
+        let mut out = Vec::new();
+        q.take(2, &mut out);
+        assert_eq!(out, vec!["b", "c"]);
+        // online:2 has left the queue; a new write under it appends
+        assert!(!q.push(Some("online:2".into()), "c2".into()));
+        out.clear();
+        q.take(10, &mut out);
+        assert_eq!(out, vec!["a2", "c2"]);
+        assert!(q.is_empty());
+        assert_eq!(q.bytes(), 0);
+        assert!(q.oldest().is_none());
+    }
+}
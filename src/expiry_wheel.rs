@@ -0,0 +1,158 @@
+//! Seconds-granularity timing wheel over wrapping millisecond ticks
+//!
+//! Shared by the DDoS tracker (keyed by IP) and the floor item sweep (keyed
+//! by item id). The owner keeps the authoritative deadline for each key;
+//! the wheel only remembers which slot to look in, so expiry visits the
+//! slots that came due instead of every entry.
+
+use std::sync::Mutex;
+
+/// Wheel slots, one per `TICK_MS`.
+pub const WHEEL_SLOTS: u32 = 1024;
+
+/// Width of one slot (ms).
+pub const TICK_MS: u32 = 1000;
+
+/// Slot tick holding `deadline_ms`. Rounds up, so the slot is only swept
+/// once the deadline has been reached.
+#[inline]
+pub fn tick_of(deadline_ms: u32) -> u32 {
+    deadline_ms.div_ceil(TICK_MS)
+}
+
+/// Timing wheel of (key, deadline_ms) pairs.
+///
+/// Scheduling is lazy: re-scheduling a key pushes a new pair and leaves the
+/// old one in place, and the owner's `advance` callback discards pairs whose
+/// deadline no longer matches its own. A deadline more than one turn out is
+/// handed back by the callback and revisited once per turn.
+pub struct ExpiryWheel<K> {
+    slots: Box<[Mutex<Vec<(K, u32)>>]>,
+    /// Last tick swept; None until the first advance
+    cursor: Mutex<Option<u32>>,
+}
+
+impl<K: Copy> ExpiryWheel<K> {
+    pub fn new() -> Self {
+        Self {
+            slots: (0..WHEEL_SLOTS).map(|_| Mutex::new(Vec::new())).collect(),
+            cursor: Mutex::new(None),
+        }
+    }
+
+    #[inline]
+    fn slot(&self, tick: u32) -> &Mutex<Vec<(K, u32)>> {
+        &self.slots[(tick % WHEEL_SLOTS) as usize]
+    }
+
+    /// Schedule `key` to be looked at once `deadline_ms` has passed.
+    pub fn schedule(&self, key: K, deadline_ms: u32) {
+        self.slot(tick_of(deadline_ms))
+            .lock()
+            .unwrap()
+            .push((key, deadline_ms));
+    }
+
+    /// Visit every pair whose slot came due since the last call.
+    ///
+    /// `f(key, deadline)` returns Some(deadline) to keep the pair (it is not
+    /// due yet, e.g. after a tick wrap), or None to drop it.
+    pub fn advance(&self, now_ms: u32, mut f: impl FnMut(K, u32) -> Option<u32>) {
+        let now = now_ms / TICK_MS;
+        let mut cursor = self.cursor.lock().unwrap();
+        // First sweep, or a jump of a full turn or more: visit every slot once
+        let steps = match *cursor {
+            Some(last) => now.wrapping_sub(last).min(WHEEL_SLOTS),
+            None => WHEEL_SLOTS,
+        };
+        let first = now.wrapping_sub(steps).wrapping_add(1);
+        let mut keep = Vec::new();
+        for i in 0..steps {
+            let due = std::mem::take(&mut *self.slot(first.wrapping_add(i)).lock().unwrap());
+            keep.extend(
+                due.into_iter()
+                    .filter_map(|(key, deadline)| f(key, deadline).map(|d| (key, d))),
+            );
+        }
+        *cursor = Some(now);
+        drop(cursor);
+        for (key, deadline) in keep {
+            self.schedule(key, deadline);
+        }
+    }
+}
+
+impl<K: Copy> Default for ExpiryWheel<K> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Whether `deadline` has been reached at `now` (wrapping ms ticks).
+#[inline]
+pub fn tick_reached(now: u32, deadline: u32) -> bool {
+    (now.wrapping_sub(deadline) as i32) >= 0
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_tick_of_rounds_up() {
+        assert_eq!(tick_of(0), 0);
+        assert_eq!(tick_of(1), 1);
+        assert_eq!(tick_of(999), 1);
+        assert_eq!(tick_of(1000), 1);
+        assert_eq!(tick_of(1001), 2);
+        assert_eq!(tick_of(15_500), 16);
+        assert_eq!(tick_of(u32::MAX), u32::MAX / TICK_MS + 1);
+    }
+
+    #[test]
+    fn test_wheel_visits_only_due_slots() {
+        let wheel = ExpiryWheel::new();
+        wheel.advance(10_000, |_, _| None); // prime the cursor at 10 s
+        wheel.schedule(1u32, 12_000);
+        wheel.schedule(2, 15_500);
+
+        let mut visited = Vec::new();
+        wheel.advance(13_000, |key, d| {
+            visited.push(key);
+            if tick_reached(13_000, d) {
+                None
+            } else {
+                Some(d)
+            }
+        });
+        assert_eq!(visited, vec![1]);
+
+        visited.clear();
+        wheel.advance(16_000, |key, _| {
+            visited.push(key);
+            None
+        });
+        assert_eq!(visited, vec![2]);
+    }
+
+    #[test]
+    fn test_wheel_keeps_pairs_that_are_not_due() {
+        let wheel = ExpiryWheel::new();
+        wheel.schedule(7u32, 5_000);
+        // First advance walks the whole wheel; keep the pair
+        wheel.advance(1_000, |_, d| Some(d));
+        let mut hits = 0;
+        wheel.advance(5_000, |_, _| {
+            hits += 1;
+            None
+        });
+        assert_eq!(hits, 1);
+    }
+
+    #[test]
+    fn test_tick_reached_wraps() {
+        assert!(tick_reached(10, 10));
+        assert!(!tick_reached(9, 10));
+        assert!(tick_reached(5, u32::MAX - 5));
+    }
+}
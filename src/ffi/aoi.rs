@@ -0,0 +1,37 @@
+//! FFI bridge for game::aoi — per-session "already shown" sets used by the
+//! walk look code in map_parse.c.
+
+use std::ffi::c_int;
+
+use crate::database::map_db::BlockList;
+use crate::game::aoi;
+use crate::game::block_query::{with_buffer, Rect};
+
+/// Copy into `buf` (at most `cap`) the entities in (x0, y0)-(x1, y1) that
+/// player `sd` has not been shown yet, after dropping whatever is outside
+/// its view before the step (top-left tile `vx`, `vy`). Returns the count
+/// written; those entities are recorded as shown.
+#[no_mangle]
+pub unsafe extern "C" fn rust_aoi_collect_entering(
+    sd: *mut BlockList, vx: c_int, vy: c_int,
+    x0: c_int, y0: c_int, x1: c_int, y1: c_int,
+    buf: *mut *mut BlockList, cap: c_int,
+) -> c_int {
+    if sd.is_null() || buf.is_null() || cap <= 0 {
+        return 0;
+    }
+    with_buffer(|found| {
+        aoi::collect_entering(sd, vx, vy, Rect::new(x0, y0, x1, y1), cap as usize, found);
+        std::ptr::copy_nonoverlapping(found.as_ptr(), buf, found.len());
+        found.len() as c_int
+    })
+}
+
+/// Forget what player `sd` has been shown. Called from clif_sendmapinfo and
+/// map_deliddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_aoi_reset(sd: *mut BlockList) {
+    if !sd.is_null() {
+        aoi::reset(sd as usize);
+    }
+}
@@ -1,24 +1,357 @@
 //! FFI bridge for block grid mutation functions.
 //!
 //! Rust owns the grid mutation side: addblock, delblock, initblock, moveblock, termblock.
-//! The foreachin* spatial query family stays in C (variadic va_list callbacks).
+//! Spatial queries over the grid live in game::block_query (shims in
+//! ffi/block_query.rs); the variadic map_foreachin* functions in C adapt to them.
+//!
+//! Alongside the grid, Rust keeps dense online-player indexes: one list per map
+//! (maintained by map_addblock/map_delblock) and one global list (maintained by
+//! map_addiddb/map_deliddb, i.e. login/logout). SAMEMAP/ALL_CLIENT broadcasts and
+//! saves iterate these instead of probing every fd up to fd_max.
+//!
+//! Every grid entry is also filed in a compact per-cell index
+//! (database::cell_index) that area scans in game::block_query walk
+//! instead of the chains.
+//!
+//! Players, mobs and NPCs are also counted in their map's occupancy plane
+//! (database::pass_grid), which movement checks test before walking a chain.
 //!
 //! `bl_head` is defined in map_server.c (non-static); imported here for sentinel comparison.
 
-use std::os::raw::{c_int, c_ushort};
+use std::collections::HashMap;
+use std::os::raw::{c_int, c_uchar, c_ushort};
 use std::ptr;
+use std::sync::{Mutex, OnceLock};
 
-use crate::database::map_db::{BlockList, WarpList, MAP_SLOTS, BLOCK_SIZE};
+use crate::database::cell_index::{CellEntry, CellIndex, Plan};
+use crate::database::map_db::{BlockList, MapData, WarpList, MAP_SLOTS, BLOCK_SIZE};
+use crate::database::pass_grid::{PassGrid, Step, Steps};
 use crate::ffi::map_db::map;
 
 const BL_MOB: u8 = 0x02;
 const BL_PC:  u8 = 0x01;
+const BL_NPC: u8 = 0x04;
 
 // Sentinel node — lives in map_server.c, exported via map_server.h.
 // map_addblock sets bl->prev = &bl_head; map_delblock checks bl->prev == &bl_head
 // to know whether the entity is at the head of its chain.
 extern "C" {
     static mut bl_head: BlockList;
+    // Static object table, map_server.c (object_flag_init)
+    static objectFlags: *mut c_uchar;
+    static objectFlagsCount: c_int;
+}
+
+/// Dense set of block_list addresses with O(1) insert/remove (swap_remove).
+#[derive(Default)]
+struct DenseSet {
+    items: Vec<usize>,
+    pos: HashMap<usize, usize>,
+}
+
+impl DenseSet {
+    fn insert(&mut self, addr: usize) {
+        if self.pos.contains_key(&addr) {
+            return;
+        }
+        self.pos.insert(addr, self.items.len());
+        self.items.push(addr);
+    }
+
+    fn remove(&mut self, addr: usize) {
+        let Some(i) = self.pos.remove(&addr) else { return };
+        self.items.swap_remove(i);
+        if let Some(&moved) = self.items.get(i) {
+            self.pos.insert(moved, i);
+        }
+    }
+}
+
+/// Online-player indexes. Only the game loop thread updates them (the block
+/// and id db calls all run there); the Mutex is never contended and only
+/// keeps the static safe to share.
+#[derive(Default)]
+struct OnlineIndex {
+    /// BL_PC entries currently in each map's block grid, keyed by map id.
+    by_map: HashMap<u16, DenseSet>,
+    /// Which `by_map` list each entry is in, so removal never depends on
+    /// `bl->m` still holding the map the entry was added under.
+    map_of: HashMap<usize, u16>,
+    /// Every logged-in BL_PC (map_addiddb → map_deliddb).
+    all: DenseSet,
+}
+
+impl OnlineIndex {
+    fn add_to_map(&mut self, addr: usize, m: u16) {
+        match self.map_of.insert(addr, m) {
+            Some(old) if old == m => return,
+            Some(old) => {
+                if let Some(set) = self.by_map.get_mut(&old) {
+                    set.remove(addr);
+                }
+            }
+            None => {}
+        }
+        self.by_map.entry(m).or_default().insert(addr);
+    }
+
+    fn remove_from_map(&mut self, addr: usize) {
+        if let Some(m) = self.map_of.remove(&addr) {
+            if let Some(set) = self.by_map.get_mut(&m) {
+                set.remove(addr);
+            }
+        }
+    }
+}
+
+static ONLINE: OnceLock<Mutex<OnlineIndex>> = OnceLock::new();
+
+fn online() -> std::sync::MutexGuard<'static, OnlineIndex> {
+    ONLINE
+        .get_or_init(|| Mutex::new(OnlineIndex::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// Per-map cell indexes, by map id. Same locking rationale as ONLINE.
+static CELLS: OnceLock<Mutex<Vec<Option<CellIndex>>>> = OnceLock::new();
+
+fn cells() -> std::sync::MutexGuard<'static, Vec<Option<CellIndex>>> {
+    CELLS
+        .get_or_init(|| Mutex::new(Vec::new()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// The index for map `m`, created or re-filed to match the map's current
+/// block dimensions (sl_g_setmap can reload a map file at a new size).
+unsafe fn cell_index(all: &mut Vec<Option<CellIndex>>, m: usize) -> &mut CellIndex {
+    if all.len() <= m {
+        all.resize_with(m + 1, || None);
+    }
+    let (bxs, bys) = (
+        (*map.add(m)).bxs as usize,
+        (*map.add(m)).bys as usize,
+    );
+    let index = all[m].get_or_insert_with(|| CellIndex::new(bxs, bys));
+    index.resize(bxs, bys);
+    index
+}
+
+fn cell_entry(bl: &BlockList) -> CellEntry {
+    CellEntry {
+        addr: bl as *const BlockList as usize,
+        id: bl.id,
+        serial: 0,
+        x: bl.x,
+        y: bl.y,
+        bl_type: bl.bl_type,
+    }
+}
+
+/// Per-map passability planes, by map id. Same locking rationale as ONLINE.
+static PASS: OnceLock<Mutex<Vec<Option<PassGrid>>>> = OnceLock::new();
+
+fn passes() -> std::sync::MutexGuard<'static, Vec<Option<PassGrid>>> {
+    PASS
+        .get_or_init(|| Mutex::new(Vec::new()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// objectFlags byte of object `obj`; ids past the table block nothing.
+unsafe fn object_flag(obj: u16) -> u8 {
+    if objectFlags.is_null() || obj as c_int >= objectFlagsCount {
+        return 0;
+    }
+    *objectFlags.add(obj as usize)
+}
+
+/// The planes for map `m`, built from its arrays on first use and rebuilt
+/// when the map's size changed. None if the map is not loaded.
+unsafe fn pass_grid(all: &mut Vec<Option<PassGrid>>, m: usize) -> Option<&mut PassGrid> {
+    if m >= MAP_SLOTS || map.is_null() {
+        return None;
+    }
+    let slot = &*map.add(m);
+    if slot.pass.is_null() || slot.obj.is_null() || slot.xs == 0 || slot.ys == 0 {
+        return None;
+    }
+    if all.len() <= m {
+        all.resize_with(m + 1, || None);
+    }
+    let (xs, ys) = (slot.xs as usize, slot.ys as usize);
+    let pass = std::slice::from_raw_parts(slot.pass, xs * ys);
+    let obj = std::slice::from_raw_parts(slot.obj, xs * ys);
+    let g = all[m].get_or_insert_with(|| PassGrid::build(xs, ys, pass, obj, |o| object_flag(o)));
+    if g.dims() != (xs, ys) {
+        g.reload(xs, ys, pass, obj, |o| object_flag(o));
+    }
+    Some(g)
+}
+
+/// Entities that can stand in the way of a step.
+fn blocks_steps(bl: &BlockList) -> bool {
+    matches!(bl.bl_type, BL_PC | BL_MOB | BL_NPC)
+}
+
+unsafe fn occupy(bl: *mut BlockList) {
+    if !blocks_steps(&*bl) {
+        return;
+    }
+    if let Some(g) = pass_grid(&mut passes(), (*bl).m as usize) {
+        g.occupy(bl as usize, (*bl).x, (*bl).y);
+    }
+}
+
+unsafe fn vacate(bl: *mut BlockList) {
+    if let Some(Some(g)) = passes().get_mut((*bl).m as usize) {
+        g.vacate(bl as usize);
+    }
+}
+
+/// What the planes of map `m` say about the step from (x0, y0) onto
+/// (x1, y1) heading `side`. None if the map is not loaded.
+///
+/// # Safety
+/// `map` must be initialized.
+pub unsafe fn pass_step(m: usize, x0: u16, y0: u16, x1: u16, y1: u16, side: usize) -> Option<Step> {
+    pass_grid(&mut passes(), m).map(|g| g.step(x0, y0, x1, y1, side))
+}
+
+/// The four steps out of (x, y) on map `m`. None if the map is not loaded.
+///
+/// # Safety
+/// `map` must be initialized.
+pub unsafe fn pass_steps(m: usize, x: u16, y: u16) -> Option<Steps> {
+    pass_grid(&mut passes(), m).map(|g| g.steps(x, y))
+}
+
+/// Re-read tile (x, y) of map `m` after a script wrote its pass or object.
+///
+/// # Safety
+/// `map` must be initialized and (x, y) inside map `m`.
+pub unsafe fn pass_tile_changed(m: usize, x: u16, y: u16) {
+    let mut all = passes();
+    let Some(g) = pass_grid(&mut all, m) else { return };
+    let slot = &*map.add(m);
+    let i = x as usize + y as usize * slot.xs as usize;
+    g.set_tile(x, y, *slot.pass.add(i), object_flag(*slot.obj.add(i)));
+}
+
+/// Rebuild the static planes of map `m` from its reloaded arrays. Planes
+/// not built yet are left to their first use.
+///
+/// # Safety
+/// `map` must be initialized.
+pub unsafe fn pass_reload(m: usize) {
+    let mut all = passes();
+    let Some(Some(g)) = all.get_mut(m) else { return };
+    let slot = &*map.add(m);
+    if slot.pass.is_null() || slot.obj.is_null() {
+        return;
+    }
+    let (xs, ys) = (slot.xs as usize, slot.ys as usize);
+    let pass = std::slice::from_raw_parts(slot.pass, xs * ys);
+    let obj = std::slice::from_raw_parts(slot.obj, xs * ys);
+    g.reload(xs, ys, pass, obj, |o| object_flag(o));
+}
+
+/// Call `f` on every indexed entry of map `m` inside the inclusive tile
+/// rectangle (x0, y0)-(x1, y1), already clamped to the map.
+///
+/// # Safety
+/// `map` must be initialized and `m` loaded. `f` must not touch the grid.
+pub unsafe fn scan_cells(m: usize, x0: i32, y0: i32, x1: i32, y1: i32, f: impl FnMut(&CellEntry)) {
+    let mut all = cells();
+    cell_index(&mut all, m).scan(x0, y0, x1, y1, f);
+}
+
+/// Call `f` on every indexed entry of map `m` covered by `plan`. Returns
+/// false if the plan does not match the map's current dimensions.
+///
+/// # Safety
+/// Same as `scan_cells`.
+pub unsafe fn scan_plan(m: usize, plan: &Plan, f: impl FnMut(&CellEntry)) -> bool {
+    let mut all = cells();
+    cell_index(&mut all, m).scan_plan(plan, f)
+}
+
+/// Copy up to `buf_len` entries of `set` into `buf`; returns the count copied.
+unsafe fn copy_set(set: Option<&DenseSet>, buf: *mut *mut BlockList, buf_len: c_int) -> c_int {
+    let Some(set) = set else { return 0 };
+    if buf.is_null() || buf_len <= 0 {
+        return 0;
+    }
+    let n = set.items.len().min(buf_len as usize);
+    for (i, &addr) in set.items.iter().take(n).enumerate() {
+        *buf.add(i) = addr as *mut BlockList;
+    }
+    n as c_int
+}
+
+/// Register a logged-in player in the global online list.
+/// Called from map_addiddb for BL_PC entries.
+///
+/// # Safety
+/// `bl` must be null or a valid `BlockList` that stays alive until
+/// `map_online_del` is called for it.
+#[no_mangle]
+pub unsafe extern "C" fn map_online_add(bl: *mut BlockList) {
+    if bl.is_null() || (*bl).bl_type != BL_PC {
+        return;
+    }
+    online().all.insert(bl as usize);
+}
+
+/// Remove a player from the global online list (logout).
+/// Called from map_deliddb for BL_PC entries.
+///
+/// # Safety
+/// `bl` must be null or a valid `BlockList`.
+#[no_mangle]
+pub unsafe extern "C" fn map_online_del(bl: *mut BlockList) {
+    if bl.is_null() || (*bl).bl_type != BL_PC {
+        return;
+    }
+    let mut idx = online();
+    idx.all.remove(bl as usize);
+    // A player that logs out must never linger in a per-map list either.
+    idx.remove_from_map(bl as usize);
+}
+
+/// Snapshot online players into `buf`: those on map `m`, or everyone online
+/// when `m < 0`. Returns the number of entries written (at most `buf_len`).
+///
+/// A snapshot rather than a live view so callers may warp, save or
+/// disconnect players while iterating.
+///
+/// # Safety
+/// `buf` must be null or point to `buf_len` writable pointers.
+#[no_mangle]
+pub unsafe extern "C" fn map_online_users(
+    m: c_int,
+    buf: *mut *mut BlockList,
+    buf_len: c_int,
+) -> c_int {
+    let idx = online();
+    if m < 0 {
+        copy_set(Some(&idx.all), buf, buf_len)
+    } else {
+        copy_set(idx.by_map.get(&(m as u16)), buf, buf_len)
+    }
+}
+
+/// Number of online players on map `m`, or everyone online when `m < 0`.
+#[no_mangle]
+pub extern "C" fn map_online_count(m: c_int) -> c_int {
+    let idx = online();
+    let n = if m < 0 {
+        idx.all.items.len()
+    } else {
+        idx.by_map.get(&(m as u16)).map_or(0, |s| s.items.len())
+    };
+    n as c_int
 }
 
 /// Allocate a zeroed array of `len` null pointers and return a raw pointer.
@@ -47,13 +380,19 @@ pub unsafe extern "C" fn map_initblock() {
         if slot.bxs == 0 || slot.bys == 0 {
             continue; // sparse slot — not a loaded map
         }
-        let cells = slot.bxs as usize * slot.bys as usize;
-        slot.block     = alloc_ptr_array::<BlockList>(cells);
-        slot.block_mob = alloc_ptr_array::<BlockList>(cells);
-        slot.warp      = alloc_ptr_array::<WarpList>(cells);
+        init_block_grid(slot);
     }
 }
 
+/// Allocate the empty block/block_mob/warp arrays of one loaded map slot.
+/// Also used by `rust_map_reload` for maps that were not loaded before.
+pub(crate) unsafe fn init_block_grid(slot: &mut MapData) {
+    let cells = slot.bxs as usize * slot.bys as usize;
+    slot.block     = alloc_ptr_array::<BlockList>(cells);
+    slot.block_mob = alloc_ptr_array::<BlockList>(cells);
+    slot.warp      = alloc_ptr_array::<WarpList>(cells);
+}
+
 /// Free block grid arrays for all map slots.
 /// Replaces `map_termblock()` in `map_server.c`. Currently a no-op (matches C).
 ///
@@ -75,6 +414,20 @@ pub unsafe extern "C" fn map_termblock() {
 /// - `map` global must be initialized via `rust_map_init` and `map_initblock` must have run.
 #[no_mangle]
 pub unsafe extern "C" fn map_addblock(bl: *mut BlockList) -> c_int {
+    let ret = grid_insert(bl);
+    if ret == 0 {
+        cell_index(&mut cells(), (*bl).m as usize).insert(cell_entry(&*bl));
+        occupy(bl);
+        if (*bl).bl_type == BL_PC {
+            online().add_to_map(bl as usize, (*bl).m);
+        }
+    }
+    ret
+}
+
+/// Link `bl` into its grid chain without touching the online index.
+/// Shared by map_addblock and map_moveblock (a move never changes map).
+unsafe fn grid_insert(bl: *mut BlockList) -> c_int {
     if bl.is_null() {
         return 1;
     }
@@ -148,6 +501,23 @@ pub unsafe extern "C" fn map_delblock(bl: *mut BlockList) -> c_int {
     if bl.is_null() {
         return 0;
     }
+    grid_remove(bl);
+    // Also drop the index entries when the grid insert failed (e.g. a
+    // moveblock to an out-of-bounds cell): the indexes must not outlive the bl.
+    cell_remove(bl);
+    vacate(bl);
+    if (*bl).bl_type == BL_PC {
+        online().remove_from_map(bl as usize);
+    }
+    0
+}
+
+/// Unlink `bl` from its grid chain without touching the online index.
+/// Returns true if `bl` was in the grid.
+unsafe fn grid_remove(bl: *mut BlockList) -> bool {
+    if bl.is_null() {
+        return false;
+    }
     let bl = unsafe { &mut *bl };
 
     if bl.prev.is_null() {
@@ -155,7 +525,7 @@ pub unsafe extern "C" fn map_delblock(bl: *mut BlockList) -> c_int {
         if !bl.next.is_null() {
             tracing::error!("[map_delblock] bl->next != NULL but bl->prev is NULL id={}", bl.id);
         }
-        return 0;
+        return false;
     }
 
     let m = bl.m as usize;
@@ -188,7 +558,7 @@ pub unsafe extern "C" fn map_delblock(bl: *mut BlockList) -> c_int {
     bl.next = ptr::null_mut();
     bl.prev = ptr::null_mut();
 
-    0
+    true
 }
 
 /// Remove `bl` from its current cell, update coords, re-insert.
@@ -199,11 +569,32 @@ pub unsafe extern "C" fn map_delblock(bl: *mut BlockList) -> c_int {
 /// grid, and `(x1, y1)` must be valid coords for the map `bl->m`.
 #[no_mangle]
 pub unsafe extern "C" fn map_moveblock(bl: *mut BlockList, x1: c_int, y1: c_int) -> c_int {
-    map_delblock(bl);
-    if !bl.is_null() {
-        (*bl).x = x1 as c_ushort;
-        (*bl).y = y1 as c_ushort;
+    // Same map before and after, so the per-map online index is untouched.
+    if bl.is_null() {
+        return 0;
+    }
+    grid_remove(bl);
+    (*bl).x = x1 as c_ushort;
+    (*bl).y = y1 as c_ushort;
+    if grid_insert(bl) == 0 {
+        let mut all = cells();
+        let index = cell_index(&mut all, (*bl).m as usize);
+        if !index.relocate(bl as usize, (*bl).x, (*bl).y) {
+            index.insert(cell_entry(&*bl));
+        }
+        drop(all);
+        occupy(bl);
+    } else {
+        cell_remove(bl);
+        vacate(bl);
     }
-    map_addblock(bl);
     0
 }
+
+/// Drop `bl` from its map's cell index, if it has one.
+unsafe fn cell_remove(bl: *mut BlockList) {
+    let m = (*bl).m as usize;
+    if let Some(Some(index)) = cells().get_mut(m) {
+        index.remove(bl as usize);
+    }
+}
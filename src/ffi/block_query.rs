@@ -0,0 +1,79 @@
+//! FFI shims for game::block_query — typed spatial queries for C.
+//!
+//! `map_query_*` call `f(bl, ctx)` once per match; `map_collect_*` copy the
+//! matches into a caller buffer instead. The variadic `map_foreachin*`
+//! functions in map_server.c are adapters over `map_query_*`.
+
+use std::ffi::{c_int, c_void};
+
+use crate::database::map_db::BlockList;
+use crate::game::block_query::{self as q, Rect};
+
+/// `bl_visit_fn` in map_server.h.
+pub type BlVisitFn = unsafe extern "C" fn(*mut BlockList, *mut c_void) -> c_int;
+
+/// Copy `found` into `buf` (at most `cap` entries); returns the count copied.
+unsafe fn copy_out(found: &[*mut BlockList], buf: *mut *mut BlockList, cap: c_int) -> c_int {
+    if buf.is_null() || cap <= 0 {
+        return 0;
+    }
+    let n = found.len().min(cap as usize);
+    std::ptr::copy_nonoverlapping(found.as_ptr(), buf, n);
+    n as c_int
+}
+
+/// Visit entities of BL_* mask `type_` in an `area` (AREA, SAMEAREA,
+/// CORNER, SAMEMAP) query centred on (x, y). Returns the sum of `f`'s results.
+#[no_mangle]
+pub unsafe extern "C" fn map_query_area(
+    m: c_int, x: c_int, y: c_int, area: c_int, type_: c_int,
+    f: Option<BlVisitFn>, ctx: *mut c_void,
+) -> c_int {
+    let Some(f) = f else { return 0 };
+    q::foreach_in_area(m, x, y, area, type_, |bl| f(bl, ctx))
+}
+
+/// Visit entities of BL_* mask `type_` inside (x0, y0)-(x1, y1), inclusive.
+#[no_mangle]
+pub unsafe extern "C" fn map_query_block(
+    m: c_int, x0: c_int, y0: c_int, x1: c_int, y1: c_int, type_: c_int,
+    f: Option<BlVisitFn>, ctx: *mut c_void,
+) -> c_int {
+    let Some(f) = f else { return 0 };
+    q::foreach_in_rect(m, Rect::new(x0, y0, x1, y1), type_, |bl| f(bl, ctx))
+}
+
+/// Visit entities standing on (x, y). Trap floor items are skipped unless
+/// `traps` is non-zero.
+#[no_mangle]
+pub unsafe extern "C" fn map_query_cell(
+    m: c_int, x: c_int, y: c_int, type_: c_int, traps: c_int,
+    f: Option<BlVisitFn>, ctx: *mut c_void,
+) -> c_int {
+    let Some(f) = f else { return 0 };
+    q::foreach_in_cell(m, x, y, type_, traps != 0, |bl| f(bl, ctx))
+}
+
+/// Collect an `area` query into `buf`; returns the number of entries written.
+#[no_mangle]
+pub unsafe extern "C" fn map_collect_area(
+    m: c_int, x: c_int, y: c_int, area: c_int, type_: c_int,
+    buf: *mut *mut BlockList, cap: c_int,
+) -> c_int {
+    q::with_buffer(|found| {
+        q::collect_area(m, x, y, area, type_, found);
+        copy_out(found, buf, cap)
+    })
+}
+
+/// Collect a rectangle query into `buf`; returns the number of entries written.
+#[no_mangle]
+pub unsafe extern "C" fn map_collect_block(
+    m: c_int, x0: c_int, y0: c_int, x1: c_int, y1: c_int, type_: c_int,
+    buf: *mut *mut BlockList, cap: c_int,
+) -> c_int {
+    q::with_buffer(|found| {
+        q::collect_rect(m, Rect::new(x0, y0, x1, y1), type_, found);
+        copy_out(found, buf, cap)
+    })
+}
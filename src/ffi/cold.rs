@@ -0,0 +1,72 @@
+//! FFI bridge for game::cold — lazily allocated mob and player buffers.
+
+use std::ffi::c_char;
+
+use crate::game::cold::{self, Kind};
+use crate::game::mob::{self, MobSpawnData};
+use crate::game::pc::MapSessionData;
+use crate::servers::char::charstatus::Item;
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_mob_inventory(mob: *mut MobSpawnData) -> *mut Item {
+    if mob.is_null() {
+        return std::ptr::null_mut();
+    }
+    mob::mob_inventory(mob)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_mob_cold_free(mob: *mut MobSpawnData) {
+    if !mob.is_null() {
+        mob::free_cold(mob);
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_exchange_items(sd: *mut MapSessionData) -> *mut Item {
+    if sd.is_null() {
+        return std::ptr::null_mut();
+    }
+    cold::get_or_alloc(&raw mut (*sd).exchange.item, Kind::Exchange)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_exchange_free(sd: *mut MapSessionData) {
+    if !sd.is_null() {
+        cold::release(&raw mut (*sd).exchange.item, Kind::Exchange);
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_bod_items(sd: *mut MapSessionData) -> *mut Item {
+    if sd.is_null() {
+        return std::ptr::null_mut();
+    }
+    cold::get_or_alloc(&raw mut (*sd).boditems.item, Kind::BodItems)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_bod_free(sd: *mut MapSessionData) {
+    if !sd.is_null() {
+        cold::release(&raw mut (*sd).boditems.item, Kind::BodItems);
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_profilepic(sd: *mut MapSessionData) -> *mut c_char {
+    if sd.is_null() {
+        return std::ptr::null_mut();
+    }
+    cold::get_or_alloc(&raw mut (*sd).profilepic_data, Kind::ProfilePic)
+}
+
+/// Free every cold block of a player that is logging out.
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_cold_free(sd: *mut MapSessionData) {
+    if sd.is_null() {
+        return;
+    }
+    cold::release(&raw mut (*sd).exchange.item, Kind::Exchange);
+    cold::release(&raw mut (*sd).boditems.item, Kind::BodItems);
+    cold::release(&raw mut (*sd).profilepic_data, Kind::ProfilePic);
+}
@@ -90,6 +90,16 @@ pub extern "C" fn rust_request_shutdown() {
     }
 }
 
+/// Withdraw a shutdown requested with rust_request_shutdown, so the session
+/// loop can be run again
+#[no_mangle]
+pub extern "C" fn rust_cancel_shutdown() {
+    if let Some(state_lock) = GLOBAL_SERVER_STATE.lock().unwrap().as_ref() {
+        let mut state = state_lock.lock().unwrap();
+        state.cancel_shutdown();
+    }
+}
+
 /// Check if server shutdown has been requested
 /// Returns 1 if shutdown requested, 0 otherwise
 ///
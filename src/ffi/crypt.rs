@@ -102,6 +102,57 @@ pub unsafe extern "C" fn rust_crypt_generate_key2(
     keyout
 }
 
+/// Like `rust_crypt_generate_key2`, but served from the session's key cache
+/// (`sd->EncKeys`) when the packet's index bytes have been seen before.
+/// Returns `keyout` on success.
+#[no_mangle]
+pub unsafe extern "C" fn rust_crypt_generate_key2_cached(
+    packet: *mut c_uchar,
+    table: *const c_char,
+    cache: *mut crypt::CryptKeyCache,
+    keyout: *mut c_char,
+    fromclient: c_int,
+) -> *mut c_char {
+    if cache.is_null() {
+        return rust_crypt_generate_key2(packet, table, keyout, fromclient);
+    }
+    if packet.is_null() || table.is_null() || keyout.is_null() {
+        return std::ptr::null_mut();
+    }
+    let psize = ((*packet.add(1) as usize) << 8) | (*packet.add(2) as usize);
+    // Same bounds as rust_crypt_generate_key2
+    if psize == 0 || psize + 3 > RFIFO_SIZE {
+        return std::ptr::null_mut();
+    }
+    let packet_buf = slice::from_raw_parts(packet, psize + 3);
+    let table_buf = slice::from_raw_parts(table as *const u8, 0x401);
+    let mut key = [0u8; 10];
+    crypt::generate_key2_cached(packet_buf, table_buf, &mut *cache, &mut key, fromclient != 0);
+    let out = slice::from_raw_parts_mut(keyout as *mut u8, 10);
+    out.copy_from_slice(&key);
+    keyout
+}
+
+/// Empty a session's key cache (call whenever its EncHash table changes).
+#[no_mangle]
+pub unsafe extern "C" fn rust_crypt_key_cache_reset(cache: *mut crypt::CryptKeyCache) {
+    if !cache.is_null() {
+        *cache = crypt::CryptKeyCache::EMPTY;
+    }
+}
+
+/// Process-wide key cache hits/misses since startup. Either pointer may be NULL.
+#[no_mangle]
+pub unsafe extern "C" fn rust_crypt_key_cache_totals(hits: *mut u64, misses: *mut u64) {
+    let (h, m) = crypt::key_cache_totals();
+    if !hits.is_null() {
+        *hits = h;
+    }
+    if !misses.is_null() {
+        *misses = m;
+    }
+}
+
 /// XOR-encrypts/decrypts `buff` in-place using a 9-byte `key`.
 #[no_mangle]
 pub unsafe extern "C" fn rust_crypt_dynamic(buff: *mut c_uchar, key: *const c_char) {
@@ -40,3 +40,62 @@ pub extern "C" fn rust_db_connect(url: *const c_char) -> c_int {
         }
     }
 }
+
+/// Queue a game-thread write for the DB worker. A non-null `key` coalesces
+/// it with any queued write under the same key. Returns 0 if nothing was
+/// queued (no worker running); the caller then runs `sql` itself.
+#[no_mangle]
+pub extern "C" fn rust_dbq_push(key: *const c_char, sql: *const c_char) -> c_int {
+    ffi_catch!(0, {
+        if sql.is_null() {
+            return 0;
+        }
+        let sql = unsafe { std::ffi::CStr::from_ptr(sql) }.to_string_lossy().into_owned();
+        let key = (!key.is_null())
+            .then(|| unsafe { std::ffi::CStr::from_ptr(key) }.to_string_lossy().into_owned());
+        crate::database::write_behind::push(key, sql) as c_int
+    })
+}
+
+/// Block until every queued write has been executed, buffered registry
+/// writes included. Called from map_do_term.
+#[no_mangle]
+pub extern "C" fn rust_dbq_flush() {
+    ffi_catch!((), {
+        crate::database::registry_writes::flush();
+        crate::database::write_behind::flush();
+    })
+}
+
+/// Buffer map `m`'s registry `ident` (slot `pos`) as `val`; 0 deletes it.
+#[no_mangle]
+pub extern "C" fn rust_reg_write_map(m: c_int, ident: *const c_char, val: c_int, pos: c_int) {
+    ffi_catch!((), {
+        if ident.is_null() {
+            return;
+        }
+        let ident = unsafe { std::ffi::CStr::from_ptr(ident) }.to_string_lossy();
+        crate::database::registry_writes::writes().set_map(m as u32, &ident, val, pos as u32);
+    })
+}
+
+/// Buffer game registry `ident` of server `server_id` as `val`; 0 deletes it.
+#[no_mangle]
+pub extern "C" fn rust_reg_write_game(server_id: c_int, ident: *const c_char, val: c_int) {
+    ffi_catch!((), {
+        if ident.is_null() {
+            return;
+        }
+        let ident = unsafe { std::ffi::CStr::from_ptr(ident) }.to_string_lossy();
+        crate::database::registry_writes::writes().set_game(server_id as u32, &ident, val);
+    })
+}
+
+/// Timer callback: flush buffered registry writes every `FLUSH_MS`.
+#[no_mangle]
+pub unsafe extern "C" fn rust_reg_flush_timer(_id: c_int, _data: c_int) -> c_int {
+    ffi_catch!(0, {
+        crate::database::registry_writes::flush();
+        0
+    })
+}
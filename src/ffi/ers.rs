@@ -0,0 +1,40 @@
+//! FFI imports for the C entry reusage system
+//!
+//! The size-class pools in c_deps/ers.c back the high-churn game objects
+//! (floor items, temporary NPCs, onetime mobs), whichever side of the FFI
+//! allocates them. C frees them through `map_freebl`, so Rust must allocate
+//! them here rather than with `libc::calloc`.
+
+use std::os::raw::{c_int, c_void};
+
+/// Mirror of `struct ers_pool_stat`.
+#[repr(C)]
+#[derive(Debug, Default, Clone, Copy)]
+pub struct ErsPoolStat {
+    pub entry_size: usize,
+    pub used: u32,
+    pub high_water: u32,
+    pub allocs: u64,
+    pub frees: u64,
+    pub reserved: usize,
+}
+
+extern "C" {
+    /// Allocate a zeroed entry of `size` bytes. Thread-safe.
+    pub fn ers_pool_alloc(size: usize) -> *mut c_void;
+
+    /// Free an entry; `size` must be the size it was allocated with.
+    pub fn ers_pool_free(entry: *mut c_void, size: usize);
+
+    /// Copy the statistics of the used size classes into `out`.
+    /// Returns the number written.
+    pub fn ers_pool_stats(out: *mut ErsPoolStat, max: c_int) -> c_int;
+}
+
+/// Statistics of every size class used so far.
+pub fn pool_stats() -> Vec<ErsPoolStat> {
+    let mut out = vec![ErsPoolStat::default(); 32];
+    let n = unsafe { ers_pool_stats(out.as_mut_ptr(), out.len() as c_int) };
+    out.truncate(n.max(0) as usize);
+    out
+}
@@ -0,0 +1,38 @@
+//! FFI bridge for game::item_sweep — floor item expiry.
+
+use std::ffi::{c_int, c_uint};
+
+use crate::game::item_sweep::sweep;
+
+/// Register floor item `id` to expire `sweeptime` ms after server tick
+/// `now`. Returns 0 without registering while `item_sweep` is off.
+#[no_mangle]
+pub extern "C" fn rust_sweep_add(id: c_uint, now: c_uint, sweeptime: c_uint) -> c_int {
+    if !crate::ffi::config::config().item_sweep {
+        return 0;
+    }
+    sweep().add(id, now, sweeptime);
+    1
+}
+
+/// Cancel floor item `id`'s expiry. Returns 1 if it was registered.
+#[no_mangle]
+pub extern "C" fn rust_sweep_del(id: c_uint) -> c_int {
+    sweep().cancel(id) as c_int
+}
+
+/// Copy up to `cap` ids due by server tick `now` into `buf`; returns the
+/// count. Fewer than `cap` means nothing else is due.
+///
+/// # Safety
+/// `buf` must hold `cap` entries.
+#[no_mangle]
+pub unsafe extern "C" fn rust_sweep_due(now: c_uint, buf: *mut c_uint, cap: c_int) -> c_int {
+    if buf.is_null() || cap <= 0 {
+        return 0;
+    }
+    let mut out = Vec::with_capacity(cap as usize);
+    sweep().due(now, cap as usize, &mut out);
+    std::ptr::copy_nonoverlapping(out.as_ptr(), buf, out.len());
+    out.len() as c_int
+}
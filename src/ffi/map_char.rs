@@ -3,14 +3,17 @@
 // after startup via set_map_state(). Before that, calls are silently dropped.
 
 use std::ffi::c_char;
+use std::sync::atomic::Ordering;
 use std::sync::{Arc, OnceLock};
-use tokio::runtime::Handle;
-use crate::servers::map::{MapState, packet};
+use tokio::sync::mpsc;
+use crate::servers::map::MapState;
+use crate::servers::map::char::{run_outgoing, Outgoing, SAVE_BYTES_MAX, SAVE_BYTES_QUEUED};
+use crate::servers::save_frame::{self, Save};
 
 static MAP_STATE: OnceLock<Arc<MapState>> = OnceLock::new();
+/// Ordered queue to the char link; see servers::map::char::run_outgoing.
+static OUTGOING: OnceLock<mpsc::UnboundedSender<Outgoing>> = OnceLock::new();
 
-// Function pointer set by map_server.rs at startup so packet.rs can call
-// intif_mmo_tosd without the library depending on libmap_game.a.
 static MMO_TOSD_FN: OnceLock<unsafe extern "C" fn(i32, *mut u8) -> i32> = OnceLock::new();
 
 /// Called by map_server.rs main() to register the intif_mmo_tosd C function.
@@ -28,19 +31,34 @@ pub fn call_intif_mmo_tosd(fd: i32, raw: &mut Vec<u8>) -> i32 {
     }
 }
 
-/// Called by map_server.rs main() after MapState is constructed.
+/// Called by map_server.rs main() after MapState is constructed, inside
+/// the runtime: starts the task that drains the outgoing queue.
 pub fn set_map_state(state: Arc<MapState>) {
-    let _ = MAP_STATE.set(state);
+    if MAP_STATE.set(Arc::clone(&state)).is_err() {
+        return;
+    }
+    let (tx, rx) = mpsc::unbounded_channel();
+    let _ = OUTGOING.set(tx);
+    tokio::spawn(run_outgoing(state, rx));
+}
+
+/// Queue for char_server; dropped until set_map_state has run.
+fn queue(item: Outgoing) {
+    if let Some(tx) = OUTGOING.get() {
+        let _ = tx.send(item);
+    }
+}
+
+/// Wait until everything queued so far has gone to the char link.
+pub async fn drain() {
+    let (done, wait) = tokio::sync::oneshot::channel();
+    queue(Outgoing::Mark(done));
+    let _ = wait.await;
 }
 
 /// Send raw bytes to char_server via the Rust channel.
 fn send(data: Vec<u8>) {
-    if let Some(state) = MAP_STATE.get() {
-        let s = Arc::clone(state);
-        if let Ok(handle) = Handle::try_current() {
-            handle.spawn(async move { packet::send_to_char(&s, data).await; });
-        }
-    }
+    queue(Outgoing::Packet(data));
 }
 
 /// 0x3003 — Request char data (map→char, 24 bytes).
@@ -107,6 +125,24 @@ pub unsafe extern "C" fn rust_intif_savequit(data: *const u8, len: u32) {
     send(pkt);
 }
 
+/// Save one character (C: intif_save / intif_savequit).
+/// `status` is the raw `mmo_charstatus`; it is copied here and framed and
+/// compressed off the game thread, as 0x3012 or legacy 0x3004/0x3007.
+/// Once SAVE_BYTES_MAX raw bytes are waiting it is sent as a legacy save
+/// compressed right here instead.
+#[no_mangle]
+pub unsafe extern "C" fn rust_intif_save_status(status: *const u8, len: u32, logout: i32) {
+    if status.is_null() || len < 4 || OUTGOING.get().is_none() { return; }
+    let status = std::slice::from_raw_parts(status, len as usize).to_vec();
+    let save = Save { status, logout: logout != 0 };
+    if SAVE_BYTES_QUEUED.load(Ordering::Relaxed) + save.status.len() > SAVE_BYTES_MAX {
+        send(save_frame::encode_legacy(&save));
+        return;
+    }
+    SAVE_BYTES_QUEUED.fetch_add(save.status.len(), Ordering::Relaxed);
+    queue(Outgoing::Save(save));
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
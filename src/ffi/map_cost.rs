@@ -0,0 +1,18 @@
+//! FFI bridge for game::map_cost — per-map cost scopes opened from C.
+
+use std::ffi::c_int;
+
+use crate::game::map_cost::{self, Kind};
+
+/// Open a cost scope of kind `kind` (MAP_COST_*) for map `m`. Every call
+/// must be paired with rust_map_cost_leave, even for an unknown kind.
+#[no_mangle]
+pub extern "C" fn rust_map_cost_enter(m: c_int, kind: c_int) {
+    map_cost::enter(m as u16, Kind::from_c(kind).unwrap_or(Kind::Send));
+}
+
+/// Close the innermost cost scope, crediting its map `packets` packets.
+#[no_mangle]
+pub extern "C" fn rust_map_cost_leave(packets: c_int) {
+    map_cost::leave(packets.max(0) as u64);
+}
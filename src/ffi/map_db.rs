@@ -3,8 +3,10 @@
 //! Rust owns map and map_n as statics, exported to C via #[no_mangle].
 //! map_server.c must NOT define these — they're provided by libyuri.a.
 
+use std::collections::HashSet;
 use std::ffi::CStr;
 use std::os::raw::{c_char, c_int};
+use std::sync::{Mutex, OnceLock};
 
 use crate::database::map_db::{self as db, MapData, MAP_SLOTS};
 
@@ -34,7 +36,8 @@ pub unsafe extern "C" fn rust_map_init(maps_dir: *const c_char, server_id: c_int
             ptr as *mut MapData
         };
 
-        match db::load_maps(dir, server_id, unsafe { &mut *(raw as *mut [MapData; MAP_SLOTS]) }) {
+        let cache_dir = &crate::ffi::config::config().map_cache_dir;
+        match db::load_maps(dir, cache_dir, server_id, unsafe { &mut *(raw as *mut [MapData; MAP_SLOTS]) }) {
             Ok(count) => {
                 unsafe {
                     map = raw;
@@ -56,9 +59,10 @@ pub unsafe extern "C" fn rust_map_init(maps_dir: *const c_char, server_id: c_int
     })
 }
 
-/// Reload map metadata + registry in-place (tile arrays reallocated, block grid preserved).
-/// Replaces map_reload() body. Returns 0 on success, -1 on error.
-/// NOTE: C wrapper still calls map_foreachinarea(sl_updatepeople,...) after this returns.
+/// Reload the maps whose Maps row or map file changed, in place (block grid
+/// and entities preserved). Replaces map_reload() body. Returns 0 on success, -1 on error.
+/// NOTE: C wrapper still calls map_foreachinarea(sl_updatepeople,...) for each
+/// map rust_map_changed() reports.
 #[no_mangle]
 pub unsafe extern "C" fn rust_map_reload(maps_dir: *const c_char, server_id: c_int) -> c_int {
     ffi_catch!(-1, {
@@ -68,13 +72,57 @@ pub unsafe extern "C" fn rust_map_reload(maps_dir: *const c_char, server_id: c_i
             Err(_) => return -1,
         };
         let slots = unsafe { &mut *(map as *mut [MapData; MAP_SLOTS]) };
-        match db::reload_maps(dir, server_id, slots) {
-            Ok(_) => 0,
+        let cache_dir = &crate::ffi::config::config().map_cache_dir;
+        match db::reload_maps(dir, cache_dir, server_id, slots) {
+            Ok(r) => {
+                for &id in &r.new {
+                    let slot = &mut slots[id as usize];
+                    if slot.block.is_null() {
+                        unsafe { crate::ffi::block::init_block_grid(slot) };
+                    }
+                }
+                for &id in &r.changed {
+                    unsafe { crate::ffi::block::pass_reload(id as usize) };
+                }
+                tracing::info!(
+                    "[map] reload: {} changed ({} new), {} unchanged",
+                    r.changed.len(),
+                    r.new.len(),
+                    r.unchanged
+                );
+                *last_reload() = r.changed.into_iter().collect();
+                0
+            }
             Err(e) => { tracing::error!("[map] rust_map_reload failed: {e:#}"); -1 }
         }
     })
 }
 
+/// Maps the last rust_map_reload changed.
+fn last_reload() -> std::sync::MutexGuard<'static, HashSet<u32>> {
+    static CHANGED: OnceLock<Mutex<HashSet<u32>>> = OnceLock::new();
+    CHANGED.get_or_init(Default::default).lock().unwrap_or_else(|e| e.into_inner())
+}
+
+/// 1 if the last rust_map_reload changed map `map_id` (its players need
+/// refreshing), else 0.
+#[no_mangle]
+pub extern "C" fn rust_map_changed(map_id: c_int) -> c_int {
+    ffi_catch!(0, (map_id >= 0 && last_reload().contains(&(map_id as u32))) as c_int)
+}
+
+/// Free the tile arrays of map `map_id` (unmapping them if they came from the
+/// map cache). Called from map_do_term(); C must not FREE tile/pass/obj/map.
+#[no_mangle]
+pub unsafe extern "C" fn rust_map_free_tiles(map_id: c_int) {
+    ffi_catch!((), {
+        if unsafe { map.is_null() } || map_id < 0 || map_id as usize >= MAP_SLOTS { return; }
+        unsafe { db::free_tiles(&mut *map.add(map_id as usize)) };
+        // Its new tiles do not come from the Maps row; reload it in full next time
+        db::forget_loaded(map_id as u32);
+    })
+}
+
 /// Returns a raw pointer to the MapData slot for `id`, or null if out of range.
 pub unsafe fn get_map_ptr(id: u16) -> *mut MapData {
     if map.is_null() || id as usize >= MAP_SLOTS {
@@ -1,7 +1,9 @@
 //! FFI bridge for mob.rs — exposes #[no_mangle] symbols replacing mob.c logic.
 
 use std::ffi::{c_char, c_int, c_uint};
+use crate::database::map_db::BlockList;
 use crate::game::mob::{self as g, MobSpawnData};
+use crate::game::mob_sched;
 
 #[no_mangle]
 pub unsafe extern "C" fn rust_mobspawn_read() -> c_int {
@@ -13,6 +15,22 @@ pub unsafe extern "C" fn rust_mob_timer_spawns(id: c_int, n: c_int) -> c_int {
     g::mob_timer_spawns(id, n)
 }
 
+/// Register a mob with the tick scheduler. Called from map_addiddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_mob_sched_add(bl: *mut BlockList) {
+    if !bl.is_null() {
+        mob_sched::sched().add(bl as usize);
+    }
+}
+
+/// Drop a mob from the tick scheduler. Called from map_deliddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_mob_sched_del(bl: *mut BlockList) {
+    if !bl.is_null() {
+        mob_sched::sched().remove(bl as usize);
+    }
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn rust_mob_respawn_getstats(mob: *mut MobSpawnData) -> c_int {
     g::mob_respawn_getstats(mob)
@@ -22,10 +22,12 @@ pub mod config;
 pub mod core;
 pub mod crypt;
 pub mod database;
+pub mod ers;
 pub mod item_db;
 pub mod magic_db;
 pub mod map_db;
 pub mod mob_db;
+pub mod ranking_db;
 pub mod recipe_db;
 pub mod session;
 pub mod timer;
@@ -33,8 +35,22 @@ pub mod timer;
 // Without the feature, the npc game CGUs are absent from libyuri.a,
 // preventing transitive symbol pulls into non-map binaries.
 #[cfg(feature = "map-game")]
+pub mod aoi;
+#[cfg(feature = "map-game")]
+pub mod block_query;
+#[cfg(feature = "map-game")]
+pub mod cold;
+#[cfg(feature = "map-game")]
+pub mod item_sweep;
+#[cfg(feature = "map-game")]
+pub mod map_cost;
+#[cfg(feature = "map-game")]
 pub mod mob;
 #[cfg(feature = "map-game")]
+pub mod move_bundle;
+#[cfg(feature = "map-game")]
 pub mod npc;
 #[cfg(feature = "map-game")]
+pub mod reg_index;
+#[cfg(feature = "map-game")]
 pub mod scripting;
\ No newline at end of file
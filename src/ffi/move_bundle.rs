@@ -0,0 +1,69 @@
+//! FFI bridge for game::move_bundle — the per-tick move packet queue.
+
+use std::ffi::{c_int, c_uint};
+use std::sync::atomic::Ordering::Relaxed;
+
+use crate::game::move_bundle::{bundles, Move, QUEUED};
+
+/// Queue a move of entity `id` for the client on `fd` (player `owner`).
+#[no_mangle]
+pub extern "C" fn rust_move_queue(fd: c_int, owner: c_uint, id: c_uint, x: u16, y: u16, side: u8) {
+    let mut b = bundles();
+    b.push(fd, owner, Move { id, x, y, side });
+    QUEUED.store(b.pending(), Relaxed);
+}
+
+/// Copy up to `cap` queued moves of the next client into `buf`, storing its
+/// fd and owner. Returns the count, or 0 once the queue is empty.
+///
+/// # Safety
+/// `fd` and `owner` must be writable; `buf` must hold `cap` entries.
+#[no_mangle]
+pub unsafe extern "C" fn rust_move_take(
+    fd: *mut c_int, owner: *mut c_uint, buf: *mut Move, cap: c_int,
+) -> c_int {
+    if fd.is_null() || owner.is_null() || buf.is_null() || cap <= 0 {
+        return 0;
+    }
+    let mut out = Vec::with_capacity(cap as usize);
+    let taken = {
+        let mut b = bundles();
+        let taken = b.take(cap as usize, &mut out);
+        QUEUED.store(b.pending(), Relaxed);
+        taken
+    };
+    let Some((f, o)) = taken else { return 0 };
+    std::ptr::copy_nonoverlapping(out.as_ptr(), buf, out.len());
+    *fd = f;
+    *owner = o;
+    out.len() as c_int
+}
+
+/// Copy up to `cap` queued moves of the client on `fd` into `buf`, storing
+/// its owner. Returns the count, or 0 when it has none queued.
+///
+/// # Safety
+/// `owner` must be writable; `buf` must hold `cap` entries.
+#[no_mangle]
+pub unsafe extern "C" fn rust_move_take_fd(fd: c_int, owner: *mut c_uint, buf: *mut Move, cap: c_int) -> c_int {
+    if owner.is_null() || buf.is_null() || cap <= 0 || QUEUED.load(Relaxed) == 0 {
+        return 0;
+    }
+    let mut out = Vec::with_capacity(cap as usize);
+    let taken = {
+        let mut b = bundles();
+        let taken = b.take_fd(fd, cap as usize, &mut out);
+        QUEUED.store(b.pending(), Relaxed);
+        taken
+    };
+    let Some(o) = taken else { return 0 };
+    std::ptr::copy_nonoverlapping(out.as_ptr(), buf, out.len());
+    *owner = o;
+    out.len() as c_int
+}
+
+/// Number of queued moves.
+#[no_mangle]
+pub extern "C" fn rust_move_pending() -> c_int {
+    QUEUED.load(Relaxed) as c_int
+}
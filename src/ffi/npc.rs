@@ -1,6 +1,7 @@
 //! FFI bridge for npc.rs — exposes #[no_mangle] symbols replacing npc.c.
 
 use std::ffi::{c_char, c_int, c_uint};
+use crate::database::map_db::BlockList;
 use crate::game::npc::{
     self, NpcData,
     npc_readglobalreg, npc_setglobalreg,
@@ -29,6 +30,22 @@ pub unsafe extern "C" fn npc_runtimers(id: c_int, n: c_int) -> c_int {
     npc::npc_runtimers(id, n)
 }
 
+/// Queue an NPC's timers as it enters id_db. Called from map_addiddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_npc_timers_add(bl: *mut BlockList) {
+    if !bl.is_null() {
+        npc::npc_timers_schedule(bl as *mut NpcData);
+    }
+}
+
+/// Drop an NPC's timers as it leaves id_db. Called from map_deliddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_npc_timers_del(bl: *mut BlockList) {
+    if !bl.is_null() {
+        npc::npc_timers_remove(bl as *mut NpcData);
+    }
+}
+
 // ---------------------------------------------------------------------------
 // _ffi-suffix exports (avoid link collision with npc.c during transition;
 // npc.h inline wrappers redirect callers here; drop suffix after npc.c removed)
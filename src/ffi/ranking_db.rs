@@ -0,0 +1,76 @@
+//! FFI bridge for the event leaderboards.
+
+use std::os::raw::{c_char, c_int, c_uint};
+
+use crate::database::ranking_db::{self as db, ranking, CLAIM_NONE};
+
+/// One row of a ranking page, as filled in for C.
+#[repr(C)]
+pub struct RankingRow {
+    pub name: [c_char; 16],
+    pub score: c_int,
+    pub rank: c_int,
+}
+
+#[no_mangle]
+pub extern "C" fn rust_rankingdb_init() -> c_int { ffi_catch!(-1, db::init()) }
+
+/// Score of `cha_id` in `eventid`, 0 if they have none.
+#[no_mangle]
+pub extern "C" fn rust_ranking_score(eventid: c_int, cha_id: c_uint) -> c_int {
+    ffi_catch!(0, ranking().score(eventid as u32, cha_id).unwrap_or(0))
+}
+
+/// 1-based rank of `cha_id` in `eventid`, 0 if they have no score.
+#[no_mangle]
+pub extern "C" fn rust_ranking_rank(eventid: c_int, cha_id: c_uint) -> c_int {
+    ffi_catch!(0, ranking().rank(eventid as u32, cha_id).map_or(0, |r| r as c_int))
+}
+
+/// `EventClaim` of `cha_id` in `eventid`; 2 (no reward) if they have no row.
+#[no_mangle]
+pub extern "C" fn rust_ranking_claim(eventid: c_int, cha_id: c_uint) -> c_int {
+    ffi_catch!(CLAIM_NONE, ranking().claim(eventid as u32, cha_id).unwrap_or(CLAIM_NONE))
+}
+
+#[no_mangle]
+pub extern "C" fn rust_ranking_count(eventid: c_int) -> c_int {
+    ffi_catch!(0, ranking().count(eventid as u32) as c_int)
+}
+
+/// Fill `out` with up to `max` standings from 0-based position `offset`.
+/// Names are cut to 15 bytes. Returns the number written.
+///
+/// # Safety
+/// `out` must point to at least `max` writable `RankingRow`s.
+#[no_mangle]
+pub unsafe extern "C" fn rust_ranking_page(eventid: c_int, offset: c_int, out: *mut RankingRow, max: c_int) -> c_int {
+    if out.is_null() || offset < 0 || max <= 0 {
+        return 0;
+    }
+    ffi_catch!(0, {
+        let page = ranking().page(eventid as u32, offset as usize, max as usize);
+        for (i, s) in page.iter().enumerate() {
+            let row = &mut *out.add(i);
+            row.name = [0; 16];
+            for (d, &b) in row.name.iter_mut().zip(s.name.as_bytes().iter().take(15)) {
+                *d = b as c_char;
+            }
+            row.score = s.score;
+            row.rank = s.rank as c_int;
+        }
+        page.len() as c_int
+    })
+}
+
+/// Set the claim state of an existing row and queue its save.
+#[no_mangle]
+pub extern "C" fn rust_ranking_set_claim(eventid: c_int, cha_id: c_uint, claim: c_int) {
+    ffi_catch!((), {
+        db::set_claim(eventid as u32, cha_id, claim);
+    })
+}
+
+/// Queue a rewrite of the event's `Rank` column.
+#[no_mangle]
+pub extern "C" fn rust_ranking_save_ranks(eventid: c_int) { ffi_catch!((), db::save_ranks(eventid as u32)) }
@@ -0,0 +1,35 @@
+//! FFI bridge for game::reg_index — interned registry names for the hot
+//! `pc_readglobalreg_id` / `mob_readglobalreg_id` call sites.
+
+use std::ffi::{c_char, c_int, CStr};
+
+use crate::database::map_db::BlockList;
+use crate::game::mob::{mob_readglobalreg_id, MobSpawnData};
+use crate::game::reg_index;
+
+/// Interned id of registry name `reg`, for the `_id` read functions. Ids are
+/// stable for the life of the process, so callers may cache them.
+#[no_mangle]
+pub unsafe extern "C" fn rust_reg_intern(reg: *const c_char) -> c_int {
+    if reg.is_null() {
+        return 0;
+    }
+    ffi_catch!(0, reg_index::intern(CStr::from_ptr(reg)) as c_int)
+}
+
+/// Drop the registry index of the player or mob at `bl`. Called from
+/// map_addiddb and map_deliddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_reg_index_reset(bl: *mut BlockList) {
+    if !bl.is_null() {
+        reg_index::reset(bl as usize);
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_mob_readglobalreg_id(mob: *mut MobSpawnData, id: c_int) -> c_int {
+    if id <= 0 {
+        return 0;
+    }
+    mob_readglobalreg_id(mob, id as u32)
+}
@@ -1,6 +1,6 @@
 //! FFI bridge for scripting.rs — exposes #[no_mangle] symbols replacing scripting.c.
 
-use std::ffi::{c_char, c_int, c_uint};
+use std::ffi::{c_char, c_int, c_uint, CStr};
 use std::os::raw::c_void;
 use crate::game::scripting as sl;
 
@@ -53,6 +53,39 @@ pub unsafe extern "C" fn rust_sl_doscript_stackargs(
     ffi_catch!(0, sl::sl_doscript_stackargs(root, method, nargs))
 }
 
+/// Handle of `root.method` (`method` may be NULL) for
+/// `rust_sl_doscript_handle_vec`; 0 if `root` is NULL.
+#[no_mangle]
+pub unsafe extern "C" fn rust_sl_handle(root: *const c_char, method: *const c_char) -> c_int {
+    if root.is_null() {
+        return 0;
+    }
+    let method = if method.is_null() { None } else { Some(CStr::from_ptr(method)) };
+    ffi_catch!(0, sl::sl_handle(CStr::from_ptr(root), method) as c_int)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rust_sl_doscript_handle_vec(
+    handle: c_int,
+    nargs:  c_int,
+    args:   *const *mut c_void,
+) -> c_int {
+    let args = if nargs <= 0 || args.is_null() {
+        &[][..]
+    } else {
+        std::slice::from_raw_parts(args, nargs as usize)
+    };
+    ffi_catch!(0, sl::sl_doscript_handle(handle as u32, args))
+}
+
+/// Forget the cached script object of `bl`. Called from map_deliddb.
+#[no_mangle]
+pub unsafe extern "C" fn rust_sl_release_bl(bl: *mut c_void) {
+    if !bl.is_null() {
+        sl::sl_release_bl(bl);
+    }
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn rust_sl_updatepeople(
     bl: *mut c_void,
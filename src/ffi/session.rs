@@ -9,7 +9,8 @@
 //!   2. Inside the running Tokio runtime — timer callbacks, C parse callbacks
 //!      block_on() panics here ("cannot start a runtime from within a runtime")
 //!
-//! Solution: SessionManager uses std::sync primitives (RwLock, Mutex, AtomicI32).
+//! Solution: SessionManager uses std::sync primitives (an fd-indexed slab of
+//! per-slot RwLocks, with eof/increment held as atomics in the slot).
 //! Individual sessions use tokio::sync::Mutex, accessed via try_lock() from FFI.
 //! try_lock() always succeeds in practice because:
 //!   - parse callbacks run after session_io_task releases the session lock
@@ -46,9 +47,11 @@ fn update_fd_max(fd: i32) {
 /// Called from two contexts:
 /// 1. The LocalSet async thread (during clif_parse callbacks) — try_lock() always
 ///    succeeds here because no other task on the single-threaded LocalSet holds it.
-/// 2. spawn_blocking threads (intif_mmo_tosd, etc.) — try_lock() may fail if the
-///    async task briefly holds the lock. Falls back to blocking_lock() which waits
-///    until the async task releases it (microseconds).
+/// 2. The spawn_blocking init thread, before the game loop claims script
+///    ownership — try_lock() may fail if the async task briefly holds the lock.
+///    Falls back to blocking_lock() which waits until the async task releases it
+///    (microseconds). Game work from other threads after that is queued to the
+///    loop thread (see `game::scripting::executor`), so it never gets here.
 ///
 /// blocking_lock() panics inside an async runtime, so we only use it as fallback
 /// when try_lock fails (which proves we're NOT on the runtime thread).
@@ -57,8 +60,8 @@ where
     F: FnOnce(&mut Session) -> R,
 {
     let manager = crate::session::get_session_manager();
-    if let Some(session_arc) = manager.get_session(fd) {
-        match session_arc.try_lock() {
+    manager
+        .with_session(fd, |session_arc| match session_arc.try_lock() {
             Ok(mut guard) => f(&mut guard),
             Err(_) => {
                 // try_lock failed → we must be on a blocking thread (not the runtime
@@ -66,10 +69,8 @@ where
                 let mut guard = session_arc.blocking_lock();
                 f(&mut guard)
             }
-        }
-    } else {
-        default
-    }
+        })
+        .unwrap_or(default)
 }
 
 /// Initialize and run the async game server.
@@ -187,10 +188,7 @@ pub extern "C" fn rust_make_connection(ip: u32, port: c_int) -> c_int {
 /// Mark a session for closing.
 #[no_mangle]
 pub extern "C" fn rust_session_eof(fd: c_int) -> c_int {
-    with_session(fd, -1, |session| {
-        session.eof = 1;
-        0
-    })
+    if crate::session::get_session_manager().set_eof(fd, 1) { 0 } else { -1 }
 }
 
 /// Read unsigned 8-bit value from read buffer.
@@ -283,12 +281,12 @@ pub extern "C" fn rust_session_available(fd: c_int) -> usize {
     with_session(fd, 0, |session| session.available())
 }
 
-/// Commit write buffer (like WFIFOSET).
+/// Commit write buffer (like WFIFOSET) and release the pin WFIFOHEAD took.
 /// Returns 0 on success, -1 on error.
 #[no_mangle]
 pub extern "C" fn rust_session_commit(fd: c_int, len: usize) -> c_int {
     with_session(fd, -1, |session| {
-        session.commit_write(len).map(|_| 0).unwrap_or_else(|e| {
+        session.end_write(len).map(|_| 0).unwrap_or_else(|e| {
             tracing::error!("[FFI] commit error: {}", e);
             -1
         })
@@ -335,16 +333,110 @@ pub extern "C" fn rust_session_wdata_ptr(fd: c_int, pos: usize) -> *mut u8 {
 
 /// Ensure write buffer has room for `size` bytes (like WFIFOHEAD).
 /// Returns 0 on success, -1 on error.
+///
+/// WFIFOHEAD starts every outgoing packet, so this also pins the write span:
+/// the WFIFOB/WFIFOW/WFIFOL writes that follow go straight into the buffer
+/// instead of through rust_session_wdata_ptr. WFIFOSET releases the pin.
 #[no_mangle]
 pub extern "C" fn rust_session_wfifohead(fd: c_int, size: usize) -> c_int {
+    crate::session::run_before_write(fd);
     with_session(fd, -1, |session| {
-        session.ensure_wdata_capacity(size).map(|_| 0).unwrap_or_else(|e| {
+        session.pin_write(size).map(|_| 0).unwrap_or_else(|e| {
             tracing::error!("[FFI] wfifohead error: {}", e);
             -1
         })
     })
 }
 
+/// Pin the read buffer and return a pointer to the first unread byte.
+/// Writes the number of unread bytes to `len` (if non-NULL).
+/// Returns NULL if the session does not exist.
+///
+/// While pinned, RFIFOB/RFIFOW/RFIFOL/RFIFOP index the span published in
+/// rust_session_spans without a session lookup. RFIFOSKIP/RFIFOFLUSH keep
+/// the span current. session_io_task pins around every parse pass, so only
+/// code reading a session outside its own parse callback needs this.
+///
+/// # Safety
+/// `len` must be NULL or point to writable memory.
+#[no_mangle]
+pub unsafe extern "C" fn rust_session_begin_read(fd: c_int, len: *mut usize) -> *const u8 {
+    let (ptr, n) = with_session(fd, (std::ptr::null(), 0), |session| session.pin_read());
+    if !len.is_null() {
+        *len = n;
+    }
+    ptr
+}
+
+/// Release a read pin taken by rust_session_begin_read.
+#[no_mangle]
+pub extern "C" fn rust_session_end_read(fd: c_int) {
+    with_session(fd, (), |session| session.unpin_read());
+}
+
+/// Reserve `size` bytes, pin the write buffer and return a pointer to the
+/// next unwritten byte (WFIFOP(fd, 0)). Writes the writable length to `len`
+/// (if non-NULL). Returns NULL on error.
+///
+/// # Safety
+/// `len` must be NULL or point to writable memory.
+#[no_mangle]
+pub unsafe extern "C" fn rust_session_begin_write(
+    fd: c_int,
+    size: usize,
+    len: *mut usize,
+) -> *mut u8 {
+    crate::session::run_before_write(fd);
+    let (ptr, n) = with_session(fd, (std::ptr::null_mut(), 0), |session| {
+        session.pin_write(size).unwrap_or_else(|e| {
+            tracing::error!("[FFI] begin_write error: {}", e);
+            (std::ptr::null_mut(), 0)
+        })
+    });
+    if !len.is_null() {
+        *len = n;
+    }
+    ptr
+}
+
+/// Commit `len` bytes (0 = nothing) and release the write pin.
+/// Returns 0 on success, -1 on error.
+#[no_mangle]
+pub extern "C" fn rust_session_end_write(fd: c_int, len: usize) -> c_int {
+    with_session(fd, -1, |session| {
+        session.end_write(len).map(|_| 0).unwrap_or_else(|e| {
+            tracing::error!("[FFI] end_write error: {}", e);
+            -1
+        })
+    })
+}
+
+/// Append a finished (already encrypted) packet to the write buffer and
+/// commit it: WFIFOHEAD + memcpy + WFIFOSET under a single session lock.
+/// Used by broadcast fan-out, which encrypts once and copies to every fd.
+/// Returns 0 on success, -1 on error.
+///
+/// # Safety
+/// `buf` must point to at least `len` readable bytes.
+#[no_mangle]
+pub unsafe extern "C" fn rust_session_send_bytes(fd: c_int, buf: *const u8, len: usize) -> c_int {
+    if buf.is_null() || len == 0 {
+        return -1;
+    }
+    let src = std::slice::from_raw_parts(buf, len);
+    crate::session::run_before_write(fd);
+    with_session(fd, -1, |session| {
+        session
+            .write_buf(0, src)
+            .and_then(|_| session.commit_write(len))
+            .map(|_| 0)
+            .unwrap_or_else(|e| {
+                tracing::error!("[FFI] send_bytes error: {}", e);
+                -1
+            })
+    })
+}
+
 /// Flush read buffer - compact unread data (like RFIFOFLUSH).
 #[no_mangle]
 pub extern "C" fn rust_session_rfifoflush(fd: c_int) -> c_int {
@@ -426,15 +518,13 @@ pub extern "C" fn rust_session_set_data(fd: c_int, data: *mut std::ffi::c_void)
 /// Get session eof flag.
 #[no_mangle]
 pub extern "C" fn rust_session_get_eof(fd: c_int) -> c_int {
-    with_session(fd, -1, |session| session.eof)
+    crate::session::get_session_manager().eof(fd)
 }
 
 /// Set session eof flag.
 #[no_mangle]
 pub extern "C" fn rust_session_set_eof(fd: c_int, eof: c_int) {
-    with_session(fd, (), |session| {
-        session.eof = eof;
-    });
+    crate::session::get_session_manager().set_eof(fd, eof);
 }
 
 /// Get client IP address as u32 (network byte order, matches sin_addr.s_addr).
@@ -446,23 +536,19 @@ pub extern "C" fn rust_session_get_client_ip(fd: c_int) -> u32 {
 /// Get session increment value (packet sequence counter).
 #[no_mangle]
 pub extern "C" fn rust_session_get_increment(fd: c_int) -> u8 {
-    with_session(fd, 0, |session| session.increment)
+    crate::session::get_session_manager().increment(fd)
 }
 
 /// Increment packet counter and return new value.
 #[no_mangle]
 pub extern "C" fn rust_session_increment(fd: c_int) -> u8 {
-    with_session(fd, 0, |session| {
-        session.increment = session.increment.wrapping_add(1);
-        session.increment
-    })
+    crate::session::get_session_manager().next_increment(fd)
 }
 
 /// Check if session exists (returns 1 if exists, 0 if not).
 #[no_mangle]
 pub extern "C" fn rust_session_exists(fd: c_int) -> c_int {
-    let manager = crate::session::get_session_manager();
-    if manager.get_session(fd).is_some() { 1 } else { 0 }
+    if crate::session::get_session_manager().exists(fd) { 1 } else { 0 }
 }
 
 /// Override the parse callback for a specific session.
@@ -505,6 +591,8 @@ pub extern "C" fn rust_session_call_parse(fd: c_int) {
 /// Log a message from C code through Rust's tracing system.
 /// level: 0=error, 1=warn, 2=info, 3=debug
 ///
+/// Unfiltered and unlimited; the log.h macros use rust_log_admit/rust_log_emit.
+///
 /// # Safety
 /// msg must be a valid null-terminated C string.
 #[no_mangle]
@@ -512,15 +600,38 @@ pub unsafe extern "C" fn rust_log_c(level: c_int, msg: *const std::os::raw::c_ch
     if msg.is_null() {
         return;
     }
-    let s = std::ffi::CStr::from_ptr(msg).to_string_lossy();
-    match level {
-        0 => tracing::error!("{}", s),
-        1 => tracing::warn!("{}", s),
-        3 => tracing::debug!("{}", s),
-        _ => tracing::info!("{}", s),
+    crate::c_log::log(level, 0, std::ffi::CStr::from_ptr(msg).to_bytes());
+}
+
+/// Whether a log.h callsite should format its line: -1 to skip it (filtered
+/// out, or over the callsite's budget), else how many lines the site skipped
+/// since the last one it logged.
+///
+/// # Safety
+/// site must point to the callsite's static rust_log_site.
+#[no_mangle]
+pub unsafe extern "C" fn rust_log_admit(level: c_int, site: *const crate::c_log::LogSite) -> c_int {
+    if site.is_null() {
+        return -1;
+    }
+    match crate::c_log::admit(level, &*site) {
+        Some(skipped) => skipped.min(c_int::MAX as u32) as c_int,
+        None => -1,
     }
 }
 
+/// Queue a line rust_log_admit let through.
+///
+/// # Safety
+/// msg must be a valid null-terminated C string.
+#[no_mangle]
+pub unsafe extern "C" fn rust_log_emit(level: c_int, skipped: c_int, msg: *const std::os::raw::c_char) {
+    if msg.is_null() {
+        return;
+    }
+    crate::c_log::log(level, skipped.max(0) as u32, std::ffi::CStr::from_ptr(msg).to_bytes());
+}
+
 /// Get a snapshot of all active session fds (for iteration in C).
 /// Writes fds into caller-provided buffer, returns count written.
 #[no_mangle]
@@ -573,3 +684,23 @@ pub extern "C" fn rust_remove_throttle(_id: c_int, _data: c_int) -> c_int {
     crate::network::throttle::remove_throttle();
     0
 }
+
+/// Start time of a packet, for `rust_opcode_in` / `rust_opcode_out`.
+#[no_mangle]
+pub extern "C" fn rust_opcode_clock() -> u64 {
+    crate::core::monotonic_ns()
+}
+
+/// Record an inbound client packet of `len` bytes, handled since `start`.
+#[no_mangle]
+pub extern "C" fn rust_opcode_in(op: c_int, len: c_int, start: u64) {
+    use crate::network::opcode_stats::{record, Dir};
+    record(Dir::In, op as u8, len.max(0) as u64, start);
+}
+
+/// Record an outbound client packet of `len` bytes, encrypted since `start`.
+#[no_mangle]
+pub extern "C" fn rust_opcode_out(op: c_int, len: c_int, start: u64) {
+    use crate::network::opcode_stats::{record, Dir};
+    record(Dir::Out, op as u8, len.max(0) as u64, start);
+}
@@ -1,7 +1,8 @@
 //! FFI imports for C timer system
 //!
-//! The C timer system (c_deps/timer.c) provides a simple heap-based timer.
+//! The C timer system (c_deps/timer.c) provides a hierarchical timing wheel.
 //! We call it from the Rust event loop every 10ms to fire expired callbacks.
+//! It reports what each callback cost back through `rust_timer_*`.
 
 use std::os::raw::c_int;
 
@@ -21,6 +22,13 @@ extern "C" {
     /// Free all timer memory
     pub fn timer_clear() -> c_int;
 
+    /// Number of timers currently allocated
+    pub fn timer_count() -> c_int;
+
+    /// Take ticks from `source` instead of the monotonic clock; `None`
+    /// restores the clock. Used by packet replay.
+    pub fn timer_set_tick_source(source: Option<unsafe extern "C" fn() -> u32>);
+
     /// Insert a recurring or one-shot timer.
     /// `tick` — initial delay (ms), `interval` — repeat interval (ms, 0 = one-shot),
     /// `func` — callback `int (*)(int id, int data)`,
@@ -34,3 +42,23 @@ extern "C" {
         data: c_int,
     ) -> c_int;
 }
+
+/// Start time of a timer callback or of a whole `timer_do`.
+#[no_mangle]
+pub extern "C" fn rust_timer_clock() -> u64 {
+    crate::core::monotonic_ns()
+}
+
+/// Timer callback `func` ran from `start`, `late` ticks after it was due.
+#[no_mangle]
+pub extern "C" fn rust_timer_record(func: *const std::ffi::c_void, late: c_int, start: u64) {
+    let ns = crate::core::monotonic_ns().saturating_sub(start);
+    ffi_catch!((), crate::timer_stats::with(|s| s.record(func as usize, late, ns)))
+}
+
+/// `timer_do` started at `start` has finished; logs it if it was slow.
+#[no_mangle]
+pub extern "C" fn rust_timer_tick_end(start: u64) {
+    let ns = crate::core::monotonic_ns().saturating_sub(start);
+    ffi_catch!((), crate::timer_stats::end_tick(ns))
+}
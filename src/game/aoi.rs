@@ -0,0 +1,146 @@
+//! Per-session record of which grid entities a client has been shown.
+//!
+//! Each walk step the client asks for the strip of tiles that scrolled into
+//! view (clif_parsewalk/clif_noparsewalk), and the server used to send look
+//! packets for everything in it. A session's `Seen` set holds the entities
+//! it was sent looks for, each with the cell-index serial it had at the time.
+//! Before every strip the set is cut down to what is still alive and inside
+//! the client's 17x15 view from before the step, with the same serial. Then
+//! only strip entities missing from the set get looks. The view after the
+//! step would not do: it contains the strip, so an entity that had walked
+//! out of view and now stands in the strip would stay in the set and never
+//! be shown.
+//!
+//! Entities that leave the view, die, warp or are deleted therefore drop
+//! out of the set on the next step and are shown again when they come back.
+//! Changes to an entity that stays in view are broadcast by their own code
+//! paths, as before. The set is cleared on map change and on every
+//! clif_sendmapinfo (refresh), and removed when the player leaves id_db.
+
+use std::collections::HashMap;
+use std::ffi::c_int;
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+use crate::database::map_db::BlockList;
+use crate::game::block_query::{is_trap, scan_rect, Rect};
+
+/// Client view in tiles (viewx 0..=16, viewy 0..=14 in map_parse.c).
+pub const VIEW_W: i32 = 17;
+pub const VIEW_H: i32 = 15;
+
+/// BL_ALL from `map_server.h`.
+const BL_ALL: c_int = 0x0F;
+
+#[derive(Debug, Default)]
+pub struct Seen {
+    m: u16,
+    /// id -> cell-index serial the look was sent for
+    ids: HashMap<u32, u32>,
+}
+
+impl Seen {
+    /// Start tracking map `m`; anything seen on another map is forgotten.
+    pub fn enter_map(&mut self, m: u16) {
+        if self.m != m {
+            self.m = m;
+            self.ids.clear();
+        }
+    }
+
+    /// Keep only entries that are in `visible` with the same serial.
+    pub fn retain_visible(&mut self, visible: &[(u32, u32)]) {
+        let mut kept = HashMap::with_capacity(self.ids.len().min(visible.len()));
+        for &(id, serial) in visible {
+            if self.ids.get(&id) == Some(&serial) {
+                kept.insert(id, serial);
+            }
+        }
+        self.ids = kept;
+    }
+
+    /// Record a look for `id`; false if the client already has this one.
+    pub fn mark(&mut self, id: u32, serial: u32) -> bool {
+        self.ids.insert(id, serial) != Some(serial)
+    }
+
+    pub fn len(&self) -> usize {
+        self.ids.len()
+    }
+}
+
+static SEEN: OnceLock<Mutex<HashMap<usize, Seen>>> = OnceLock::new();
+
+fn seen() -> MutexGuard<'static, HashMap<usize, Seen>> {
+    SEEN.get_or_init(|| Mutex::new(HashMap::new()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// Forget everything the player at `sd` has been shown.
+pub fn reset(sd: usize) {
+    seen().remove(&sd);
+}
+
+/// Prune the set for player `sd`, whose view's top-left tile was (vx, vy)
+/// before this step, then append to `out` (at most `cap`) the entities in
+/// `strip` that it has not been shown, marking them as shown. Trap floor
+/// items are always returned, since whether one is drawn depends on its
+/// trap table.
+///
+/// # Safety
+/// `sd` must be a player in the grid.
+pub unsafe fn collect_entering(
+    sd: *mut BlockList,
+    vx: i32,
+    vy: i32,
+    strip: Rect,
+    cap: usize,
+    out: &mut Vec<*mut BlockList>,
+) {
+    let m = (*sd).m;
+    let mut table = seen();
+    let shown = table.entry(sd as usize).or_default();
+    shown.enter_map(m);
+
+    let mut visible = Vec::with_capacity(shown.len());
+    if shown.len() > 0 {
+        let view = Rect::new(vx, vy, vx + VIEW_W - 1, vy + VIEW_H - 1);
+        scan_rect(m as c_int, view, BL_ALL, |e| visible.push((e.id, e.serial)));
+    }
+    shown.retain_visible(&visible);
+
+    scan_rect(m as c_int, strip, BL_ALL, |e| {
+        if out.len() < cap && e.addr != sd as usize && (is_trap(e) || shown.mark(e.id, e.serial)) {
+            out.push(e.addr as *mut BlockList);
+        }
+    });
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_mark_and_retain() {
+        let mut s = Seen::default();
+        s.enter_map(3);
+        assert!(s.mark(10, 1));
+        assert!(s.mark(11, 1));
+        // Already shown
+        assert!(!s.mark(10, 1));
+        // Same id, re-inserted into the grid: show again
+        assert!(s.mark(11, 2));
+
+        // 10 left the view; 11 is visible but under an older serial
+        s.retain_visible(&[(11, 1), (12, 1)]);
+        assert_eq!(s.len(), 0);
+
+        s.mark(12, 1);
+        s.retain_visible(&[(12, 1)]);
+        assert!(!s.mark(12, 1));
+        s.enter_map(3);
+        assert_eq!(s.len(), 1);
+        s.enter_map(4);
+        assert_eq!(s.len(), 0);
+    }
+}
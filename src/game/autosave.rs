@@ -0,0 +1,180 @@
+//! Staggered autosave scheduler.
+//!
+//! Each player used to get a `save_time` timer of their own, so after a
+//! restart (or any burst of logins) the saves landed together and every
+//! cycle produced a spike of compression on the game thread and writes on
+//! the char server. Instead, the save interval is cut into `TICK_MS` slots
+//! and each player is hashed into one by char id. Every tick the players in
+//! the current slot join a FIFO, and at most `save_budget` of them are saved;
+//! anything left over waits for the next tick.
+//!
+//! `stats()` reports how far behind their slot saves are running; game::metrics
+//! exports it as the `yuri_autosave_*` series.
+
+use std::collections::{HashMap, HashSet, VecDeque};
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+/// Scheduler tick, and the size of each slot of the interval.
+pub const TICK_MS: u32 = 100;
+
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct SaveStats {
+    /// Saves issued since startup
+    pub saves: u64,
+    /// Players waiting for budget after the last tick
+    pub backlog: usize,
+    /// Delay between slot and save of the last save, in ms
+    pub last_lag_ms: u32,
+    /// Worst delay since startup, in ms
+    pub max_lag_ms: u32,
+}
+
+#[derive(Debug)]
+pub struct Autosave {
+    /// Player block ids by slot
+    slots: Vec<Vec<u32>>,
+    /// Player block id -> slot
+    slot_of: HashMap<u32, usize>,
+    /// (block id, tick queued); stale entries are skipped
+    queue: VecDeque<(u32, u64)>,
+    queued: HashSet<u32>,
+    tick: u64,
+    budget: usize,
+    stats: SaveStats,
+}
+
+impl Autosave {
+    /// `interval_ms` between saves of one player, at most `budget` saves a tick.
+    pub fn new(interval_ms: u32, budget: usize) -> Self {
+        let n = (interval_ms / TICK_MS).max(1) as usize;
+        Self {
+            slots: vec![Vec::new(); n],
+            slot_of: HashMap::new(),
+            queue: VecDeque::new(),
+            queued: HashSet::new(),
+            tick: 0,
+            budget: budget.max(1),
+            stats: SaveStats::default(),
+        }
+    }
+
+    fn slot_for(&self, char_id: u32) -> usize {
+        // Fibonacci hashing: consecutive char ids land far apart
+        let h = (char_id as u64).wrapping_mul(0x9E37_79B9_7F4A_7C15) >> 32;
+        (h % self.slots.len() as u64) as usize
+    }
+
+    /// Schedule player `id` (block id) with character `char_id`.
+    pub fn add(&mut self, id: u32, char_id: u32) {
+        self.remove(id);
+        let slot = self.slot_for(char_id);
+        self.slots[slot].push(id);
+        self.slot_of.insert(id, slot);
+    }
+
+    pub fn remove(&mut self, id: u32) {
+        if let Some(slot) = self.slot_of.remove(&id) {
+            let ids = &mut self.slots[slot];
+            if let Some(i) = ids.iter().position(|&x| x == id) {
+                ids.swap_remove(i);
+            }
+        }
+        self.queued.remove(&id);
+    }
+
+    /// Advance one tick; appends the players to save now to `out`.
+    pub fn tick(&mut self, out: &mut Vec<u32>) {
+        self.tick += 1;
+        let slot = (self.tick % self.slots.len() as u64) as usize;
+        for &id in &self.slots[slot] {
+            if self.queued.insert(id) {
+                self.queue.push_back((id, self.tick));
+            }
+        }
+        let mut n = 0;
+        while n < self.budget {
+            let Some((id, at)) = self.queue.pop_front() else { break };
+            if !self.queued.remove(&id) {
+                continue;
+            }
+            let lag = ((self.tick - at) * TICK_MS as u64).min(u32::MAX as u64) as u32;
+            self.stats.saves += 1;
+            self.stats.last_lag_ms = lag;
+            self.stats.max_lag_ms = self.stats.max_lag_ms.max(lag);
+            out.push(id);
+            n += 1;
+        }
+        self.stats.backlog = self.queued.len();
+    }
+
+    pub fn stats(&self) -> SaveStats {
+        self.stats
+    }
+
+    /// Slots in one interval.
+    pub fn slots(&self) -> usize {
+        self.slots.len()
+    }
+}
+
+static AUTOSAVE: OnceLock<Mutex<Autosave>> = OnceLock::new();
+
+/// The map server's scheduler, sized from `save_time` and `save_budget`.
+pub fn scheduler() -> MutexGuard<'static, Autosave> {
+    AUTOSAVE
+        .get_or_init(|| {
+            let cfg = crate::ffi::config::config();
+            let interval = if cfg.save_time > 0 { cfg.save_time as u32 * 1000 } else { 60_000 };
+            Mutex::new(Autosave::new(interval, cfg.save_budget.max(1) as usize))
+        })
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_players_spread_over_interval() {
+        let mut a = Autosave::new(60_000, 100);
+        for id in 0..600 {
+            a.add(id, 1000 + id);
+        }
+        let mut per_tick = Vec::new();
+        let mut all = Vec::new();
+        for _ in 0..a.slots() {
+            let mut out = Vec::new();
+            a.tick(&mut out);
+            per_tick.push(out.len());
+            all.extend(out);
+        }
+        all.sort();
+        assert_eq!(all, (0..600).collect::<Vec<_>>());
+        // 1 a tick on average; hashing must not pile them up
+        assert!(per_tick.iter().all(|&n| n <= 6), "{:?}", per_tick);
+        assert_eq!(a.stats().max_lag_ms, 0);
+    }
+
+    #[test]
+    fn test_budget_and_removal() {
+        let mut a = Autosave::new(TICK_MS, 2);
+        for id in 0..5 {
+            a.add(id, id);
+        }
+        let mut out = Vec::new();
+        a.tick(&mut out);
+        assert_eq!(out.len(), 2);
+        assert_eq!(a.stats().backlog, 3);
+
+        a.remove(out[0]);
+        let left: Vec<u32> = (0..5).filter(|id| !out.contains(id)).collect();
+        a.remove(left[0]);
+        out.clear();
+        a.tick(&mut out);
+        // Two still queued from the first tick, lagging one tick
+        assert_eq!(out, left[1..].to_vec());
+        assert_eq!(a.stats().last_lag_ms, TICK_MS);
+        assert_eq!(a.stats().backlog, 1);
+    }
+}
@@ -0,0 +1,437 @@
+//! Typed spatial queries over the block grid.
+//!
+//! Replaces the va_list walks behind map_foreachinarea/map_foreachinblock/
+//! map_foreachincell. Rust callers pass a closure; C callers pass a
+//! `bl_visit_fn(bl, ctx)` and a context struct through the shims in
+//! `ffi/block_query.rs`, and the old variadic functions are thin adapters
+//! over those shims.
+//!
+//! Every query first collects its matches, then visits them, skipping any
+//! that left the grid meanwhile. Visitors may therefore move, remove or query
+//! entities. Collection buffers come from a per-thread pool, so nested
+//! queries no longer overwrite the outer walk the way the shared C `bl_list`
+//! did.
+//!
+//! Matches are found through the compact per-cell index in
+//! `database::cell_index` rather than by walking the grid's intrusive chains.
+//! Area queries go through a cached `Plan`, so CORNER's overlapping strips
+//! scan each cell and report each entity once.
+
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::ffi::c_int;
+use std::rc::Rc;
+
+use crate::database::cell_index::{CellEntry, Plan};
+use crate::database::map_db::{BlockList, MapData, MAP_SLOTS};
+use crate::ffi::block::{scan_cells, scan_plan};
+use crate::ffi::map_db::map;
+use crate::game::mob::{MobSpawnData, MOB_DEAD};
+use crate::game::pc::{itemdb_type, ITM_TRAPS};
+use crate::game::scripting::types::floor::FloorItemData;
+
+pub const BL_PC: c_int = 0x01;
+pub const BL_MOB: c_int = 0x02;
+pub const BL_ITEM: c_int = 0x08;
+
+// Send modes from `map_parse.h` understood by `area_rects`.
+pub const SAMEMAP: c_int = 2;
+pub const AREA: c_int = 4;
+pub const SAMEAREA: c_int = 6;
+pub const CORNER: c_int = 8;
+
+// AREAX_SIZE / AREAY_SIZE from `map_server.h`.
+const AREAX: i32 = 18;
+const AREAY: i32 = 16;
+
+/// Most matches a single query collects (BL_LIST_MAX in map_server.c).
+pub const QUERY_MAX: usize = 32768;
+
+/// Inclusive tile rectangle.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Rect {
+    pub x0: i32,
+    pub y0: i32,
+    pub x1: i32,
+    pub y1: i32,
+}
+
+impl Rect {
+    pub const fn new(x0: i32, y0: i32, x1: i32, y1: i32) -> Self {
+        Self { x0, y0, x1, y1 }
+    }
+
+    /// Clamp to a `xs`×`ys` map; None if nothing is left.
+    pub fn clamp(self, xs: i32, ys: i32) -> Option<Rect> {
+        let r = Rect::new(self.x0.max(0), self.y0.max(0), self.x1.min(xs - 1), self.y1.min(ys - 1));
+        (r.x0 <= r.x1 && r.y0 <= r.y1).then_some(r)
+    }
+
+    #[inline]
+    fn contains(&self, x: i32, y: i32) -> bool {
+        x >= self.x0 && x <= self.x1 && y >= self.y0 && y <= self.y1
+    }
+}
+
+/// The rectangles one area query covers (CORNER needs up to six).
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Rects {
+    rects: [Rect; 6],
+    len: usize,
+}
+
+impl Rects {
+    fn push(&mut self, r: Rect) {
+        self.rects[self.len] = r;
+        self.len += 1;
+    }
+
+    pub fn as_slice(&self) -> &[Rect] {
+        &self.rects[..self.len]
+    }
+}
+
+/// Rectangles scanned by an `area` query centred on (x, y) of a `xs`×`ys`
+/// map. Unclamped; `collect_rect` clips them. Mirrors the switch in the old
+/// C `map_foreachinarea`.
+pub fn area_rects(xs: i32, ys: i32, x: i32, y: i32, area: c_int) -> Rects {
+    let mut out = Rects::default();
+    match area {
+        AREA => out.push(Rect::new(x - (AREAX + 1), y - (AREAY + 1), x + (AREAX + 1), y + (AREAY + 1))),
+        CORNER => {
+            if xs <= AREAX * 2 + 1 || ys <= AREAY * 2 + 1 {
+                return out;
+            }
+            let left = x < AREAX * 2 + 2 && x > AREAX;
+            let right = x > xs - (AREAX * 2 + 3) && x < xs - (AREAX + 1);
+            if left {
+                out.push(Rect::new(0, y - (AREAY + 1), x - (AREAX + 2), y + (AREAY + 1)));
+            }
+            if y < AREAY * 2 + 2 && y > AREAY {
+                out.push(Rect::new(x - (AREAX + 1), 0, x + (AREAX + 1), y - (AREAY + 2)));
+                if left {
+                    out.push(Rect::new(0, 0, x - (AREAX + 2), y - (AREAY + 2)));
+                } else if right {
+                    out.push(Rect::new(x + (AREAX + 2), 0, xs - 1, y + (AREAY + 2)));
+                }
+            }
+            if right {
+                out.push(Rect::new(x + (AREAX + 2), y - (AREAY + 1), xs - 1, y + (AREAY + 1)));
+            }
+            if y > ys - (AREAY * 2 + 3) && y < ys - (AREAY + 1) {
+                out.push(Rect::new(x - (AREAX + 1), y + (AREAY + 2), x + (AREAX + 1), ys - 1));
+                if left {
+                    out.push(Rect::new(0, y + (AREAY + 2), x - (AREAX + 2), ys - 1));
+                } else if right {
+                    out.push(Rect::new(x + (AREAX + 2), y + (AREAY + 2), xs - 1, ys - 1));
+                }
+            }
+        }
+        SAMEAREA => {
+            // A 19x17 view, shifted (not shrunk) to stay inside the map
+            let (mut x0, mut y0, mut x1, mut y1) = (x - 9, y - 8, x + 9, y + 8);
+            if x0 < 0 {
+                x1 = (x1 - x0).min(xs - 1);
+                x0 = 0;
+            }
+            if y0 < 0 {
+                y1 = (y1 - y0).min(ys - 1);
+                y0 = 0;
+            }
+            if x1 >= xs {
+                x0 = (x0 - (x1 - xs + 1)).max(0);
+                x1 = xs - 1;
+            }
+            if y1 >= ys {
+                y0 = (y0 - (y1 - ys + 1)).max(0);
+                y1 = ys - 1;
+            }
+            out.push(Rect::new(x0, y0, x1, y1));
+        }
+        SAMEMAP => out.push(Rect::new(0, 0, xs - 1, ys - 1)),
+        _ => {}
+    }
+    out
+}
+
+/// The map slot for `m` if it is loaded.
+unsafe fn loaded_map(m: c_int) -> Option<&'static MapData> {
+    if m < 0 || m as usize >= MAP_SLOTS || map.is_null() {
+        return None;
+    }
+    let slot = &*map.add(m as usize);
+    // map_isloaded(m): registry pointer is non-null iff the map was loaded.
+    (!slot.registry.is_null()).then_some(slot)
+}
+
+/// Append every indexed entry inside `r` on map `m` that passes `keep`.
+unsafe fn scan_index(m: c_int, r: Rect, out: &mut Vec<*mut BlockList>, mut keep: impl FnMut(&CellEntry) -> bool) {
+    scan_cells(m as usize, r.x0, r.y0, r.x1, r.y1, |e| {
+        if out.len() < QUERY_MAX && keep(e) {
+            out.push(e.addr as *mut BlockList);
+        }
+    });
+}
+
+#[inline]
+unsafe fn mob_alive(e: &CellEntry) -> bool {
+    (*(e.addr as *const MobSpawnData)).state != MOB_DEAD
+}
+
+/// Non-mob entries matching `mask`. Mobs are collected in a second pass,
+/// after everything else, as the separate mob chain always was.
+#[inline]
+fn other_of(e: &CellEntry, mask: c_int) -> bool {
+    let t = e.bl_type as c_int;
+    t != BL_MOB && t & mask != 0
+}
+
+/// Call `f` on each entity of the BL_* mask `mask` inside `r` on map `m`:
+/// everything else first, then mobs. Dead mobs are skipped.
+pub unsafe fn scan_rect(m: c_int, r: Rect, mask: c_int, mut f: impl FnMut(&CellEntry)) {
+    let Some(slot) = loaded_map(m) else { return };
+    let Some(r) = r.clamp(slot.xs as i32, slot.ys as i32) else { return };
+    if mask & !BL_MOB != 0 {
+        scan_cells(m as usize, r.x0, r.y0, r.x1, r.y1, |e| {
+            if other_of(e, mask) {
+                f(e);
+            }
+        });
+    }
+    if mask & BL_MOB != 0 {
+        scan_cells(m as usize, r.x0, r.y0, r.x1, r.y1, |e| {
+            if e.bl_type as c_int == BL_MOB && mob_alive(e) {
+                f(e);
+            }
+        });
+    }
+}
+
+/// Append entities of the BL_* mask `mask` inside `r` on map `m` to `out`.
+/// Dead mobs are skipped.
+pub unsafe fn collect_rect(m: c_int, r: Rect, mask: c_int, out: &mut Vec<*mut BlockList>) {
+    scan_rect(m, r, mask, |e| {
+        if out.len() < QUERY_MAX {
+            out.push(e.addr as *mut BlockList);
+        }
+    });
+    if out.len() >= QUERY_MAX {
+        tracing::warn!("[block_query] map {m}: query hit {QUERY_MAX} matches");
+    }
+}
+
+/// Whether `e` is a trap floor item.
+#[inline]
+pub unsafe fn is_trap(e: &CellEntry) -> bool {
+    e.bl_type as c_int == BL_ITEM && itemdb_type((*(e.addr as *const FloorItemData)).data.id) == ITM_TRAPS
+}
+
+/// Plans kept per thread before the cache is dropped and refilled.
+const PLAN_CACHE_MAX: usize = 4096;
+
+#[derive(Clone, Copy, PartialEq, Eq, Hash)]
+struct PlanKey {
+    xs: u16,
+    ys: u16,
+    area: c_int,
+    x: c_int,
+    y: c_int,
+}
+
+thread_local! {
+    static PLANS: RefCell<HashMap<PlanKey, Rc<Plan>>> = RefCell::new(HashMap::new());
+}
+
+/// The cell plan for an `area` query centred on (x, y) of a `xs`×`ys` map
+/// with `bxs`×`bys` block cells. Plans depend only on these, so they are
+/// cached; SAMEMAP ignores the position.
+pub fn area_plan(bxs: usize, bys: usize, xs: i32, ys: i32, x: c_int, y: c_int, area: c_int) -> Rc<Plan> {
+    let (x, y) = if area == SAMEMAP { (0, 0) } else { (x, y) };
+    let key = PlanKey { xs: xs as u16, ys: ys as u16, area, x, y };
+    PLANS.with(|plans| {
+        if let Some(plan) = plans.borrow().get(&key) {
+            if plan.dims() == (bxs, bys) {
+                return plan.clone();
+            }
+        }
+        let rects: Vec<_> = area_rects(xs, ys, x, y, area)
+            .as_slice()
+            .iter()
+            .map(|r| (r.x0, r.y0, r.x1, r.y1))
+            .collect();
+        let plan = Rc::new(Plan::build(bxs, bys, xs, ys, &rects));
+        let mut plans = plans.borrow_mut();
+        if plans.len() >= PLAN_CACHE_MAX {
+            plans.clear();
+        }
+        plans.insert(key, plan.clone());
+        plan
+    })
+}
+
+/// Append every indexed entry covered by `plan` on map `m` that passes `keep`.
+unsafe fn scan_plan_index(m: c_int, plan: &Plan, out: &mut Vec<*mut BlockList>, mut keep: impl FnMut(&CellEntry) -> bool) {
+    scan_plan(m as usize, plan, |e| {
+        if out.len() < QUERY_MAX && keep(e) {
+            out.push(e.addr as *mut BlockList);
+        }
+    });
+}
+
+/// Append entities in an `area` query centred on (x, y) to `out`.
+pub unsafe fn collect_area(m: c_int, x: c_int, y: c_int, area: c_int, mask: c_int, out: &mut Vec<*mut BlockList>) {
+    let Some(slot) = loaded_map(m) else { return };
+    let plan = area_plan(slot.bxs as usize, slot.bys as usize, slot.xs as i32, slot.ys as i32, x, y, area);
+    if plan.is_empty() {
+        return;
+    }
+    if mask & !BL_MOB != 0 {
+        scan_plan_index(m, &plan, out, |e| other_of(e, mask));
+    }
+    if mask & BL_MOB != 0 {
+        scan_plan_index(m, &plan, out, |e| e.bl_type as c_int == BL_MOB && mob_alive(e));
+    }
+    if out.len() >= QUERY_MAX {
+        tracing::warn!("[block_query] map {m}: query hit {QUERY_MAX} matches");
+    }
+}
+
+/// Append entities standing on (x, y) to `out`. Floor items that are traps
+/// are left out unless `traps` is set.
+pub unsafe fn collect_cell(m: c_int, x: c_int, y: c_int, mask: c_int, traps: bool, out: &mut Vec<*mut BlockList>) {
+    let Some(slot) = loaded_map(m) else { return };
+    if x < 0 || y < 0 || x >= slot.xs as i32 || y >= slot.ys as i32 {
+        return;
+    }
+    let r = Rect::new(x, y, x, y);
+    if mask & !BL_MOB != 0 {
+        scan_index(m, r, out, |e| other_of(e, mask) && (traps || !is_trap(e)));
+    }
+    if mask & BL_MOB != 0 {
+        scan_index(m, r, out, |e| e.bl_type as c_int == BL_MOB && mob_alive(e));
+    }
+}
+
+thread_local! {
+    static BUFFERS: RefCell<Vec<Vec<*mut BlockList>>> = const { RefCell::new(Vec::new()) };
+}
+
+/// Run `f` with an empty buffer from the per-thread pool.
+pub fn with_buffer<R>(f: impl FnOnce(&mut Vec<*mut BlockList>) -> R) -> R {
+    let mut buf = BUFFERS.with(|b| b.borrow_mut().pop()).unwrap_or_default();
+    buf.clear();
+    let ret = f(&mut buf);
+    BUFFERS.with(|b| b.borrow_mut().push(buf));
+    ret
+}
+
+/// Call `f` on each collected entry still in the grid; returns the sum of
+/// its results.
+unsafe fn visit(found: &[*mut BlockList], mut f: impl FnMut(*mut BlockList) -> c_int) -> c_int {
+    let mut total = 0;
+    for &bl in found {
+        if !(*bl).prev.is_null() {
+            total += f(bl);
+        }
+    }
+    total
+}
+
+pub unsafe fn foreach_in_rect(m: c_int, r: Rect, mask: c_int, f: impl FnMut(*mut BlockList) -> c_int) -> c_int {
+    with_buffer(|buf| {
+        collect_rect(m, r, mask, buf);
+        visit(buf, f)
+    })
+}
+
+pub unsafe fn foreach_in_area(
+    m: c_int,
+    x: c_int,
+    y: c_int,
+    area: c_int,
+    mask: c_int,
+    f: impl FnMut(*mut BlockList) -> c_int,
+) -> c_int {
+    with_buffer(|buf| {
+        collect_area(m, x, y, area, mask, buf);
+        visit(buf, f)
+    })
+}
+
+pub unsafe fn foreach_in_cell(
+    m: c_int,
+    x: c_int,
+    y: c_int,
+    mask: c_int,
+    traps: bool,
+    f: impl FnMut(*mut BlockList) -> c_int,
+) -> c_int {
+    with_buffer(|buf| {
+        collect_cell(m, x, y, mask, traps, buf);
+        visit(buf, f)
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const SELF_MODE: c_int = 9;
+
+    #[test]
+    fn test_area_rects_area_and_samemap() {
+        assert_eq!(area_rects(100, 100, 50, 50, AREA).as_slice(), &[Rect::new(31, 33, 69, 67)]);
+        assert_eq!(area_rects(100, 80, 5, 5, SAMEMAP).as_slice(), &[Rect::new(0, 0, 99, 79)]);
+        assert!(area_rects(100, 100, 50, 50, SELF_MODE).as_slice().is_empty());
+    }
+
+    #[test]
+    fn test_samearea_shifts_inside_map() {
+        assert_eq!(area_rects(100, 100, 2, 3, SAMEAREA).as_slice(), &[Rect::new(0, 0, 18, 16)]);
+        assert_eq!(area_rects(100, 100, 98, 99, SAMEAREA).as_slice(), &[Rect::new(81, 83, 99, 99)]);
+        // Map smaller than the view: clipped on both sides
+        assert_eq!(area_rects(10, 10, 5, 5, SAMEAREA).as_slice(), &[Rect::new(0, 0, 9, 9)]);
+    }
+
+    #[test]
+    fn test_corner_rects() {
+        // Small maps never send CORNER updates
+        assert!(area_rects(30, 30, 20, 20, CORNER).as_slice().is_empty());
+        // Centre of a big map: nothing near an edge
+        assert!(area_rects(200, 200, 100, 100, CORNER).as_slice().is_empty());
+        // Near the top-left: left strip, top strip and the corner between them
+        let r = area_rects(200, 200, 20, 20, CORNER);
+        assert_eq!(
+            r.as_slice(),
+            &[Rect::new(0, 3, 0, 37), Rect::new(1, 0, 39, 2), Rect::new(0, 0, 0, 2)]
+        );
+    }
+
+    #[test]
+    fn test_corner_plan_scans_each_cell_once() {
+        // Near the top-right the corner rect overlaps the right strip
+        let rects = area_rects(200, 200, 170, 20, CORNER);
+        assert!(rects.as_slice().len() >= 3);
+        let plan = area_plan(25, 25, 200, 200, 170, 20, CORNER);
+        let covered: usize = rects
+            .as_slice()
+            .iter()
+            .filter_map(|r| r.clamp(200, 200))
+            .map(|r| ((r.x1 / 8 - r.x0 / 8 + 1) * (r.y1 / 8 - r.y0 / 8 + 1)) as usize)
+            .sum();
+        assert!(plan.cell_count() < covered);
+        // Cached, and SAMEMAP shares one plan for every position
+        assert!(Rc::ptr_eq(&plan, &area_plan(25, 25, 200, 200, 170, 20, CORNER)));
+        assert!(Rc::ptr_eq(
+            &area_plan(25, 25, 200, 200, 3, 4, SAMEMAP),
+            &area_plan(25, 25, 200, 200, 90, 90, SAMEMAP)
+        ));
+        assert_eq!(area_plan(25, 25, 200, 200, 3, 4, SAMEMAP).cell_count(), 625);
+    }
+
+    #[test]
+    fn test_rect_clamp() {
+        assert_eq!(Rect::new(-5, -5, 200, 3).clamp(100, 100), Some(Rect::new(0, 0, 99, 3)));
+        assert_eq!(Rect::new(0, -20, 10, -2).clamp(100, 100), None);
+    }
+}
@@ -0,0 +1,108 @@
+//! Lazily allocated cold sub-structures of players and mobs.
+//!
+//! Every mobspawn_data used to embed a 52-slot inventory and a 50-slot
+//! registry, and every map_sessiondata two 52-item buffers (exchange and
+//! break-on-death) plus a 64 KB profile picture. Most mobs never hold an
+//! item or a registry value, and most players are not mid-exchange and
+//! never upload a picture, so those arrays are now pointers that stay NULL
+//! until the first write. Readers treat NULL as empty.
+//!
+//! Blocks are calloc'd so C can index them like the old arrays, and are
+//! counted per kind for the memory report.
+
+use std::ffi::c_void;
+use std::sync::atomic::{AtomicUsize, Ordering::Relaxed};
+
+use crate::database::map_db::GlobalReg;
+use crate::servers::char::charstatus::Item;
+
+/// Slots of the exchange and break-on-death buffers (`item[52]` in C).
+pub const TRADE_SLOTS: usize = 52;
+/// Bytes of a profile picture buffer.
+pub const PROFILEPIC_BYTES: usize = 65535;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Kind {
+    MobInventory,
+    MobRegistry,
+    Exchange,
+    BodItems,
+    ProfilePic,
+}
+
+impl Kind {
+    pub const ALL: [Kind; 5] =
+        [Kind::MobInventory, Kind::MobRegistry, Kind::Exchange, Kind::BodItems, Kind::ProfilePic];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Kind::MobInventory => "mob_inventory",
+            Kind::MobRegistry => "mob_registry",
+            Kind::Exchange => "exchange",
+            Kind::BodItems => "bod_items",
+            Kind::ProfilePic => "profilepic",
+        }
+    }
+
+    /// Bytes of one block of this kind.
+    pub fn size(self) -> usize {
+        match self {
+            Kind::MobInventory => crate::game::mob::MAX_INVENTORY * std::mem::size_of::<Item>(),
+            Kind::MobRegistry => crate::game::mob::MAX_GLOBALMOBREG * std::mem::size_of::<GlobalReg>(),
+            Kind::Exchange | Kind::BodItems => TRADE_SLOTS * std::mem::size_of::<Item>(),
+            Kind::ProfilePic => PROFILEPIC_BYTES,
+        }
+    }
+}
+
+static LIVE: [AtomicUsize; 5] =
+    [AtomicUsize::new(0), AtomicUsize::new(0), AtomicUsize::new(0), AtomicUsize::new(0), AtomicUsize::new(0)];
+
+/// Blocks of `kind` currently allocated.
+pub fn live(kind: Kind) -> usize {
+    LIVE[kind as usize].load(Relaxed)
+}
+
+/// The block in `*slot`, allocating a zeroed one of `kind` if it is NULL.
+/// Returns NULL only if the allocation failed.
+pub unsafe fn get_or_alloc<T>(slot: *mut *mut T, kind: Kind) -> *mut T {
+    if (*slot).is_null() {
+        let p = libc::calloc(1, kind.size()) as *mut T;
+        if !p.is_null() {
+            LIVE[kind as usize].fetch_add(1, Relaxed);
+        }
+        *slot = p;
+    }
+    *slot
+}
+
+/// Free the block in `*slot`, if any, and clear the slot.
+pub unsafe fn release<T>(slot: *mut *mut T, kind: Kind) {
+    let p = std::mem::replace(&mut *slot, std::ptr::null_mut());
+    if !p.is_null() {
+        libc::free(p as *mut c_void);
+        LIVE[kind as usize].fetch_sub(1, Relaxed);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_alloc_is_lazy_and_counted() {
+        let mut slot: *mut Item = std::ptr::null_mut();
+        let before = live(Kind::Exchange);
+        unsafe {
+            let p = get_or_alloc(&mut slot, Kind::Exchange);
+            assert!(!p.is_null());
+            assert_eq!((*p.add(TRADE_SLOTS - 1)).id, 0);
+            assert_eq!(get_or_alloc(&mut slot, Kind::Exchange), p);
+            assert_eq!(live(Kind::Exchange), before + 1);
+            release(&mut slot, Kind::Exchange);
+            release(&mut slot, Kind::Exchange);
+        }
+        assert!(slot.is_null());
+        assert_eq!(live(Kind::Exchange), before);
+    }
+}
@@ -131,6 +131,8 @@ extern "C" {
     fn boarddb_init() -> c_int;
     #[link_name = "rust_clandb_init"]
     fn clandb_init() -> c_int;
+    #[link_name = "rust_rankingdb_init"]
+    fn rankingdb_init() -> c_int;
     fn npc_init();
     fn warp_init();
     fn rust_mobdb_term();
@@ -234,11 +236,19 @@ static COMMANDS: &[CommandEntry] = &[
     CommandEntry { func: command_broadcast,       name: "bc",              level: 50 },
     CommandEntry { func: command_luasize,         name: "luasize",         level: 99 },
     CommandEntry { func: command_luafix,          name: "luafix",          level: 99 },
+    CommandEntry { func: command_luacache,        name: "luacache",        level: 99 },
+    CommandEntry { func: command_luagc,           name: "luagc",           level: 99 },
+    CommandEntry { func: command_opstats,         name: "opstats",         level: 99 },
+    CommandEntry { func: command_timers,          name: "timers",          level: 99 },
+    CommandEntry { func: command_mapcost,         name: "mapcost",         level: 99 },
     CommandEntry { func: command_respawn,         name: "respawn",         level: 99 },
     CommandEntry { func: command_ban,             name: "ban",             level: 99 },
     CommandEntry { func: command_unban,           name: "unban",           level: 99 },
     CommandEntry { func: command_kc,              name: "kc",              level: 99 },
     CommandEntry { func: command_blockcount,      name: "blockc",          level: 99 },
+    CommandEntry { func: command_pools,           name: "pools",           level: 99 },
+    CommandEntry { func: command_memory,          name: "memory",          level: 99 },
+    CommandEntry { func: command_profile,         name: "profile",         level: 99 },
     CommandEntry { func: command_stealth,         name: "stealth",         level: 1  },
     CommandEntry { func: command_ghosts,          name: "ghosts",          level: 1  },
     CommandEntry { func: command_unphysical,      name: "unphysical",      level: 99 },
@@ -278,6 +288,7 @@ static COMMANDS: &[CommandEntry] = &[
     CommandEntry { func: command_spellq,          name: "spellq",          level: 99 },
     CommandEntry { func: command_reloadboard,     name: "reloadboard",     level: 99 },
     CommandEntry { func: command_reloadclan,      name: "reloadclan",      level: 99 },
+    CommandEntry { func: command_reloadranking,   name: "reloadranking",   level: 99 },
     CommandEntry { func: command_item,            name: "i",               level: 50 },
     CommandEntry { func: command_reloadnpc,       name: "reloadnpc",       level: 99 },
     CommandEntry { func: command_reloadmaps,      name: "reloadmaps",      level: 99 },
@@ -582,7 +593,16 @@ unsafe fn command_legend(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut L
     }
     0
 }
-unsafe fn command_luareload(sd: *mut MapSessionData, _line: *mut c_char, s: *mut LuaState) -> c_int {
+unsafe fn command_luareload(sd: *mut MapSessionData, line: *mut c_char, s: *mut LuaState) -> c_int {
+    // "@luareload changed" recompiles changed files off the game thread
+    if parse_str32(line).is_some_and(|w| std::ffi::CStr::from_ptr(w.as_ptr()).to_bytes() == b"changed") {
+        let started = crate::game::scripting::sl_reload_changed();
+        if !sd.is_null() {
+            let msg: &[u8] = if started { b"Reloading changed LUA scripts...\0" } else { b"A LUA reload is already running\0" };
+            clif_sendminitext(sd, msg.as_ptr() as *const c_char);
+        }
+        return 0;
+    }
     let errors = sl_reload();
     if sd.is_null() { return errors; }
     clif_sendminitext(sd, b"LUA Scripts reloaded!\0".as_ptr() as *const c_char);
@@ -666,6 +686,133 @@ unsafe fn command_luafix(_sd: *mut MapSessionData, _line: *mut c_char, _s: *mut
     sl_fixmem();
     0
 }
+unsafe fn command_luacache(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
+    if sd.is_null() { return 0; }
+    let st = crate::game::scripting::sl_dispatch_stats();
+    let obj = crate::game::scripting::sl_obj_stats();
+    let rate = crate::game::scripting::sl_alloc_stats();
+    let lines = [
+        format!("Script handles: {} ({} hits, {} misses)\0", st.handles, st.hits, st.misses),
+        format!("Script objects: {} live ({} reused, {} created)\0", obj.live, obj.hits, obj.created),
+        format!(
+            "Lua heap: {} KB, +{:.1} KB/tick, {:.2} objects/tick\0",
+            rate.heap_bytes / 1024, rate.growth_per_tick / 1024.0, rate.objects_per_tick
+        ),
+    ];
+    for msg in &lines {
+        let mut buf = [0i8; 255];
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
+/// `@opstats [out|reset]`: the client opcodes that took the most handler time
+/// (or encrypt time, for `out`) since start or the last reset.
+unsafe fn command_opstats(sd: *mut MapSessionData, line: *mut c_char, _s: *mut LuaState) -> c_int {
+    use crate::network::opcode_stats::{stats, Dir};
+    if sd.is_null() { return 0; }
+    let arg = if line.is_null() { "" } else { std::ffi::CStr::from_ptr(line).to_str().unwrap_or("").trim() };
+    let mut lines = Vec::new();
+    if arg == "reset" {
+        stats().reset();
+        lines.push("Opcode stats reset.\0".to_string());
+    } else {
+        let dir = if arg == "out" { Dir::Out } else { Dir::In };
+        let ops = stats().snapshot(dir);
+        lines.push(format!("{} opcodes seen ({}), by total time:\0", ops.len(), if dir == Dir::In { "in" } else { "out" }));
+        for (op, s) in ops.iter().take(8) {
+            let p99 = s.quantile_us(0.99).map_or_else(|| "long".to_string(), |us| format!("<{us}"));
+            lines.push(format!(
+                "{:02X}: {} x, {} KB, {} ms, avg {} us, p99 {} us, max {} us\0",
+                op, s.count, s.bytes / 1024, s.total_ns / 1_000_000, s.avg_ns() / 1000, p99, s.max_ns / 1000
+            ));
+        }
+    }
+    for msg in &lines {
+        let mut buf = [0i8; 255];
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
+/// `@timers [reset]`: the timer callbacks that took the most time.
+unsafe fn command_timers(sd: *mut MapSessionData, line: *mut c_char, _s: *mut LuaState) -> c_int {
+    use crate::timer_stats::{fn_name, with};
+    if sd.is_null() { return 0; }
+    let arg = if line.is_null() { "" } else { std::ffi::CStr::from_ptr(line).to_str().unwrap_or("").trim() };
+    let mut lines = Vec::new();
+    if arg == "reset" {
+        with(|s| s.reset());
+        lines.push("Timer stats reset.\0".to_string());
+    } else {
+        let (fns, slow) = with(|s| (s.snapshot(), s.slow_ticks()));
+        lines.push(format!("{} timer callbacks, {} slow ticks:\0", fns.len(), slow));
+        for (func, s) in fns.iter().take(8) {
+            lines.push(format!(
+                "{}: {} x, {} ms, avg {} us, max {} us, late avg {} max {} ms\0",
+                fn_name(*func), s.calls, s.total_ns / 1_000_000, s.avg_ns() / 1000,
+                s.max_ns / 1000, s.avg_late_ms(), s.late_max_ms
+            ));
+        }
+    }
+    for msg in &lines {
+        let mut buf = [0i8; 255];
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
+/// `@mapcost [reset]`: the maps that took the most game-thread time, split
+/// into mob ticks, NPC timers, area broadcasts and Lua.
+unsafe fn command_mapcost(sd: *mut MapSessionData, line: *mut c_char, _s: *mut LuaState) -> c_int {
+    use crate::game::map_cost::{with, Kind};
+    if sd.is_null() { return 0; }
+    let arg = if line.is_null() { "" } else { std::ffi::CStr::from_ptr(line).to_str().unwrap_or("").trim() };
+    let mut lines = Vec::new();
+    if arg == "reset" {
+        with(|l| l.reset());
+        lines.push("Map costs reset.\0".to_string());
+    } else {
+        let top = with(|l| l.top(8));
+        lines.push(format!("{} maps by game-thread time (ms: mob/npc/send/lua):\0", top.len()));
+        for (m, c) in &top {
+            let ms = |k: Kind| c.ns[k as usize] / 1_000_000;
+            lines.push(format!(
+                "{} {}: {} ms = {}/{}/{}/{}, {} pkts\0",
+                m, crate::game::metrics::map_title(*m), c.total_ns() / 1_000_000,
+                ms(Kind::Mob), ms(Kind::Npc), ms(Kind::Send), ms(Kind::Lua), c.packets
+            ));
+        }
+    }
+    for msg in &lines {
+        let mut buf = [0i8; 255];
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
+unsafe fn command_luagc(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
+    if sd.is_null() { return 0; }
+    let gc = crate::game::scripting::sl_gc_stats();
+    let rate = crate::game::scripting::sl_alloc_stats();
+    let lines = [
+        format!(
+            "Lua heap: {} KB, +{:.1} KB/tick\0",
+            rate.heap_bytes / 1024, rate.growth_per_tick / 1024.0
+        ),
+        format!(
+            "GC steps: {} ({} cycles, {} skipped), avg {} us, max {} us\0",
+            gc.steps, gc.cycles, gc.skipped, gc.step_avg().as_micros(), gc.step_max.as_micros()
+        ),
+        format!("Full collects: {}, max {} ms\0", gc.full, gc.full_max.as_millis()),
+    ];
+    for msg in &lines {
+        let mut buf = [0i8; 255];
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
 // FFI-compatible callback for map_respawn: respawn dead non-onetime mobs.
 unsafe extern "C" fn command_handle_mob_ffi(bl: *mut BlockList, _ap: ...) -> c_int {
     if bl.is_null() { return 0; }
@@ -717,6 +864,56 @@ unsafe fn command_kc(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaSt
     0
 }
 unsafe fn command_blockcount    (_sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int { 0 }
+// ERS size-class pool usage, one line per class: entry size, live and peak
+// entries, and the memory the class holds.
+unsafe fn command_pools(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
+    if sd.is_null() { return 0; }
+    for st in crate::ffi::ers::pool_stats() {
+        let mut buf = [0i8; 255];
+        let msg = format!(
+            "{}B: {} used, {} high, {} KB\0",
+            st.entry_size, st.used, st.high_water, st.reserved / 1024
+        );
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
+/// `@memory`: bytes held by each kind of game object, cold buffer and heap,
+/// largest first.
+unsafe fn command_memory(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
+    if sd.is_null() { return 0; }
+    let rows = crate::game::mem_report::report();
+    let total: usize = rows.iter().map(|r| r.bytes).sum();
+    let mut lines = vec![format!("Game memory: {} KB\0", total / 1024)];
+    for r in &rows {
+        lines.push(format!("{}: {} x, {} KB\0", r.name, r.count, r.bytes / 1024));
+    }
+    for msg in &lines {
+        let mut buf = [0i8; 255];
+        for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+        clif_sendminitext(sd, buf.as_ptr());
+    }
+    0
+}
+/// `@profile [seconds]`: sample every thread's stacks into a folded-stack
+/// file under `profile_dir` (see `crate::profiler`).
+unsafe fn command_profile(sd: *mut MapSessionData, line: *mut c_char, _s: *mut LuaState) -> c_int {
+    if sd.is_null() { return 0; }
+    let mut opts = crate::profiler::Options::from_config(crate::ffi::config::config(), "map");
+    if !line.is_null() {
+        let arg = std::ffi::CStr::from_ptr(line).to_str().unwrap_or("");
+        if let Ok(secs) = arg.trim().parse::<u64>() { opts.seconds = secs; }
+    }
+    let msg = match crate::profiler::start(opts.clone()) {
+        Ok(path) => format!("Profiling {} s into {}\0", opts.seconds.clamp(1, crate::profiler::MAX_SECONDS), path.display()),
+        Err(e) => format!("Profile not started: {}\0", e),
+    };
+    let mut buf = [0i8; 255];
+    for (i, b) in msg.bytes().take(254).enumerate() { buf[i] = b as i8; }
+    clif_sendminitext(sd, buf.as_ptr());
+    0
+}
 unsafe fn command_stealth(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
     if sd.is_null() { return 0; }
     if (*sd).optFlags & OPT_STEALTH != 0 {
@@ -1157,6 +1354,12 @@ unsafe fn command_reloadclan(sd: *mut MapSessionData, _line: *mut c_char, _s: *m
     clif_sendminitext(sd, b"Clan DB reloaded!\0".as_ptr() as *const c_char);
     0
 }
+unsafe fn command_reloadranking(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
+    rankingdb_init();
+    if sd.is_null() { return 0; }
+    clif_sendminitext(sd, b"Ranking DB reloaded!\0".as_ptr() as *const c_char);
+    0
+}
 unsafe fn command_reloadnpc(sd: *mut MapSessionData, _line: *mut c_char, _s: *mut LuaState) -> c_int {
     npc_init();
     if sd.is_null() { return 0; }
@@ -0,0 +1,176 @@
+//! Game side of a hot restart (`handoff_socket`, `map_server --takeover`):
+//! what the old process captures once its loop has stopped, and how the new
+//! one adopts it. The protocol is in `servers::map::handoff`.
+
+use std::ffi::{c_int, CString};
+use std::io;
+use std::os::fd::{OwnedFd, RawFd};
+use std::os::unix::net::UnixStream;
+use std::time::Duration;
+
+use super::mob::{self, MOB_DEAD, MOB_START_NUM};
+use super::pc::MapSessionData;
+use super::scripting::executor::{self, Job};
+use crate::ffi::map_db::{get_map_ptr, map_is_loaded};
+use crate::servers::map::char::close_char_link;
+use crate::servers::map::handoff::{self, MobRecord, SessionRecord, Snapshot};
+use crate::servers::map::MapState;
+use crate::session;
+
+extern "C" {
+    fn map_savechars(none: c_int, nonetoo: c_int) -> c_int;
+}
+
+/// How long the char server gets to read the final saves
+const CHAR_CLOSE_TIMEOUT: Duration = Duration::from_secs(10);
+
+/// `handoff::serve` hook, on the listener thread: stop at the end of the
+/// current tick and leave the sessions open.
+pub fn request() {
+    executor::post(Job::Run(Box::new(|| {
+        session::set_handed_off();
+        crate::ffi::core::rust_request_shutdown();
+    })));
+}
+
+/// Old side, once the session loop has returned: save every player, make
+/// sure the char server and the DB have it all, then send the players and
+/// listeners to the process on `sock`. Returns the players handed over, or
+/// None when the final saves did not reach the char server: then nothing
+/// was sent, `sock` is closed and this process should go back to serving.
+pub async fn hand_off(state: &MapState, sock: UnixStream) -> io::Result<Option<usize>> {
+    let (snapshot, fds) = unsafe { capture() };
+    crate::ffi::map_char::drain().await;
+    // Also false when the link was already down and the saves were dropped
+    if !close_char_link(state, CHAR_CLOSE_TIMEOUT).await {
+        tracing::error!("[map] [handoff] final saves were not written to the char server, aborting");
+        return Ok(None);
+    }
+    tokio::task::spawn_blocking(crate::database::write_behind::flush).await.map_err(io::Error::other)?;
+    let players = snapshot.sessions.len();
+    tokio::task::spawn_blocking(move || handoff::send(&sock, &snapshot, &fds))
+        .await
+        .map_err(io::Error::other)??;
+    Ok(Some(players))
+}
+
+/// Queue the final saves and collect what goes to the next process. The
+/// descriptors stay owned by this process's sessions until it exits.
+unsafe fn capture() -> (Snapshot, Vec<RawFd>) {
+    map_savechars(0, 0);
+    crate::database::registry_writes::flush();
+
+    let mut fds = session::listening_fds();
+    let mut snapshot = Snapshot { listeners: fds.len() as u32, ..Default::default() };
+    let manager = session::get_session_manager();
+    for fd in manager.get_all_fds() {
+        let sd = crate::ffi::session::rust_session_get_data(fd) as *const MapSessionData;
+        // Not in game yet (or leaving): the client reconnects on its own
+        if sd.is_null() || manager.eof(fd) != 0 {
+            continue;
+        }
+        let Some((socket, rdata, wdata)) = session::handoff_io(fd) else { continue };
+        let name = &(*sd).status.name;
+        let len = name.iter().position(|&c| c == 0).unwrap_or(name.len());
+        let name = std::slice::from_raw_parts(name.as_ptr() as *const u8, len);
+        snapshot.sessions.push(SessionRecord {
+            char_id: (*sd).status.id,
+            name: String::from_utf8_lossy(name).into_owned(),
+            increment: manager.increment(fd),
+            rdata,
+            wdata,
+        });
+        fds.push(socket);
+    }
+
+    for id in MOB_START_NUM..=mob::MAX_NORMAL_ID {
+        let m = mob::map_id2mob(id);
+        if m.is_null() {
+            continue;
+        }
+        let m = &*m;
+        snapshot.mobs.push(MobRecord {
+            id,
+            mobid: m.mobid,
+            start: (m.startm, m.startx, m.starty),
+            pos: (m.bl.m, m.bl.x, m.bl.y),
+            side: m.side,
+            state: m.state,
+            hp: m.current_vita,
+            last_death: m.last_death,
+        });
+    }
+    (snapshot, fds)
+}
+
+/// New side, after the cold start and before the session loop: take over
+/// the listeners, mob state and players received from `take_over`. The
+/// players are loaded from the char server once the char link is up.
+pub unsafe fn adopt(snapshot: Snapshot, fds: Vec<OwnedFd>) -> usize {
+    let mut fds = fds.into_iter();
+    for fd in fds.by_ref().take(snapshot.listeners as usize) {
+        if let Err(e) = session::adopt_listener(std::net::TcpListener::from(fd)) {
+            tracing::error!("[map] [handoff] cannot adopt listener: {}", e);
+        }
+    }
+    let mobs = restore_mobs(&snapshot.mobs);
+
+    let manager = session::get_session_manager();
+    let mut players = Vec::with_capacity(snapshot.sessions.len());
+    for (rec, fd) in snapshot.sessions.into_iter().zip(fds) {
+        let stream = std::net::TcpStream::from(fd);
+        match session::adopt_connection(stream, rec.increment, &rec.rdata, &rec.wdata) {
+            Ok(fd) => players.push((fd, manager.generation(fd), rec.char_id, rec.name)),
+            Err(e) => tracing::warn!("[map] [handoff] cannot adopt {}: {}", rec.name, e),
+        }
+    }
+    let adopted = players.len();
+    tracing::info!("[map] [handoff] adopted {} players, {} of {} mobs", adopted, mobs, snapshot.mobs.len());
+
+    handoff::set_resume(Box::new(move || {
+        let manager = session::get_session_manager();
+        for (fd, generation, char_id, name) in players {
+            // Gone while the char link came up
+            if manager.generation(fd) != generation || manager.eof(fd) != 0 {
+                continue;
+            }
+            let Ok(name) = CString::new(name) else { continue };
+            unsafe { crate::ffi::map_char::rust_intif_load(fd, char_id, name.as_ptr()) };
+        }
+    }));
+    adopted
+}
+
+/// Carry over position, hp and death time of the normal spawns that are
+/// still the same spawn here. Returns how many matched.
+unsafe fn restore_mobs(mobs: &[MobRecord]) -> usize {
+    let mut restored = 0;
+    for r in mobs {
+        let m = mob::map_id2mob(r.id);
+        if m.is_null() || (*m).mobid != r.mobid || ((*m).startm, (*m).startx, (*m).starty) != r.start {
+            continue;
+        }
+        super::mob_sched::touch(m as usize);
+        (*m).side = r.side;
+        if r.state == MOB_DEAD {
+            (*m).state = MOB_DEAD;
+            (*m).last_death = r.last_death;
+        } else {
+            (*m).current_vita = r.hp.min((*m).maxvita);
+            let (map, x, y) = r.pos;
+            let fits = map_is_loaded(map) && {
+                let md = &*get_map_ptr(map);
+                x < md.xs && y < md.ys
+            };
+            if fits && ((*m).bl.m, (*m).bl.x, (*m).bl.y) != r.pos {
+                if (*m).bl.m == map {
+                    mob::map_moveblock(&mut (*m).bl, x as c_int, y as c_int);
+                } else {
+                    mob::mob_warp(m, map as c_int, x as c_int, y as c_int);
+                }
+            }
+        }
+        restored += 1;
+    }
+    restored
+}
@@ -0,0 +1,151 @@
+//! Floor item expiry, behind the `item_sweep` config switch (off by default).
+//!
+//! map_additem registers each dropped item with the server tick it should
+//! vanish at: the drop tick plus the map's `sweeptime`, both in
+//! milliseconds (a sweeptime of 0 keeps items forever). The deadlines go
+//! into the shared [`ExpiryWheel`], so the once-a-second sweep in
+//! map_cronjob only looks at the slots it has passed since the last call.
+//!
+//! map_deliddb cancels by dropping the id from `live`; its wheel entry goes
+//! stale and is discarded when the sweep reaches it. Floor ids are reused,
+//! so an entry only fires if `live` still holds the same deadline for it.
+
+use std::collections::HashMap;
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+use crate::expiry_wheel::{tick_reached, ExpiryWheel};
+
+#[derive(Default)]
+pub struct ItemSweep {
+    wheel: ExpiryWheel<u32>,
+    /// id -> deadline tick of every registered item
+    live: HashMap<u32, u32>,
+    /// Expired ids not yet handed out by `due`
+    pending: Vec<u32>,
+}
+
+impl ItemSweep {
+    /// Register `id` to expire `sweeptime` ms after tick `now`, replacing
+    /// any earlier deadline.
+    pub fn add(&mut self, id: u32, now: u32, sweeptime: u32) {
+        let at = now.wrapping_add(sweeptime);
+        self.live.insert(id, at);
+        self.wheel.schedule(id, at);
+    }
+
+    /// Forget `id`. Returns false if it was not registered.
+    pub fn cancel(&mut self, id: u32) -> bool {
+        self.live.remove(&id).is_some()
+    }
+
+    /// Move the ids due by tick `now` into `out`, at most `cap` of them.
+    /// Returns true when everything due has been taken; otherwise call again.
+    pub fn due(&mut self, now: u32, cap: usize, out: &mut Vec<u32>) -> bool {
+        if self.pending.is_empty() {
+            let live = &mut self.live;
+            let pending = &mut self.pending;
+            self.wheel.advance(now, |id, at| {
+                if live.get(&id) != Some(&at) {
+                    return None;
+                }
+                if !tick_reached(now, at) {
+                    return Some(at);
+                }
+                live.remove(&id);
+                pending.push(id);
+                None
+            });
+        }
+        let n = self.pending.len().min(cap);
+        out.extend(self.pending.drain(..n));
+        self.pending.is_empty()
+    }
+
+    pub fn len(&self) -> usize {
+        self.live.len()
+    }
+}
+
+static SWEEP: OnceLock<Mutex<ItemSweep>> = OnceLock::new();
+
+pub fn sweep() -> MutexGuard<'static, ItemSweep> {
+    SWEEP
+        .get_or_init(|| Mutex::new(ItemSweep::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::expiry_wheel::{TICK_MS, WHEEL_SLOTS};
+
+    #[test]
+    fn test_sweeptime_is_milliseconds() {
+        let mut s = ItemSweep::default();
+        let mut out = Vec::new();
+        assert!(s.due(10_000, 16, &mut out));
+        // 1.5 s: not due at the 11 s sweep, due at the 12 s one
+        s.add(1, 10_000, 1_500);
+        // 60 s, not 60 000 s
+        s.add(2, 10_000, 60_000);
+
+        assert!(s.due(11_000, 16, &mut out));
+        assert!(out.is_empty());
+        assert!(s.due(12_000, 16, &mut out));
+        assert_eq!(out, vec![1]);
+        out.clear();
+        assert!(s.due(69_000, 16, &mut out));
+        assert!(out.is_empty());
+        assert!(s.due(70_000, 16, &mut out));
+        assert_eq!(out, vec![2]);
+    }
+
+    #[test]
+    fn test_due_cancel_and_reuse() {
+        let mut s = ItemSweep::default();
+        let mut out = Vec::new();
+        assert!(s.due(1_000_000, 16, &mut out));
+        s.add(1, 1_000_000, 5_000);
+        s.add(2, 1_000_000, 5_000);
+        s.add(3, 1_000_000, 7_000);
+        // Same slot, one lap later
+        s.add(4, 1_000_000, 5_000 + WHEEL_SLOTS * TICK_MS);
+        assert!(s.cancel(2));
+        assert!(!s.cancel(2));
+        // Id 3 picked up and the id reused for a later drop
+        s.cancel(3);
+        s.add(3, 1_000_000, 9_000);
+
+        assert!(s.due(1_004_000, 16, &mut out));
+        assert!(out.is_empty());
+        assert!(s.due(1_007_000, 16, &mut out));
+        assert_eq!(out, vec![1]);
+        out.clear();
+        assert!(s.due(1_009_000, 16, &mut out));
+        assert_eq!(out, vec![3]);
+        assert_eq!(s.len(), 1);
+
+        out.clear();
+        assert!(s.due(1_005_000 + WHEEL_SLOTS * TICK_MS, 16, &mut out));
+        assert_eq!(out, vec![4]);
+        assert_eq!(s.len(), 0);
+    }
+
+    #[test]
+    fn test_capped_sweep_resumes() {
+        let mut s = ItemSweep::default();
+        for id in 0..10 {
+            s.add(id, 50_000, 1_000 * (id % 2));
+        }
+        let mut all = Vec::new();
+        for done in [false, false, true] {
+            let mut out = Vec::new();
+            assert_eq!(s.due(60_000, 4, &mut out), done);
+            all.extend(out);
+        }
+        all.sort();
+        assert_eq!(all, (0..10).collect::<Vec<_>>());
+        assert_eq!(s.len(), 0);
+    }
+}
@@ -0,0 +1,189 @@
+//! Per-map CPU time and packet counts.
+//!
+//! The mob tick, the NPC timer pass, AREA/SAMEAREA/CORNER broadcasts and
+//! Lua dispatch each open a scope for the map (`bl.m`) they are working on.
+//! Scopes nest (a mob tick runs its AI script, which broadcasts), and every
+//! scope is charged its own time only: what its children took is moved to
+//! them. Summed over kinds, a map's total is the game-thread time spent on
+//! it without double counting.
+//!
+//! The ledger is thread-local, so a scope costs two clock reads and no lock.
+//! Only the game thread's is read: by `@mapcost` and, once a second, by
+//! `game::metrics::sample` for the metrics endpoint.
+
+use std::cell::RefCell;
+use std::collections::HashMap;
+
+/// What a scope was doing.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Kind {
+    Mob,
+    Npc,
+    /// Area broadcasts: clif_send fan-out to the players around a block
+    Send,
+    Lua,
+}
+
+pub const KINDS: usize = 4;
+
+impl Kind {
+    pub const ALL: [Kind; KINDS] = [Kind::Mob, Kind::Npc, Kind::Send, Kind::Lua];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Kind::Mob => "mob",
+            Kind::Npc => "npc",
+            Kind::Send => "send",
+            Kind::Lua => "lua",
+        }
+    }
+
+    /// The MAP_COST_* value of yuri.h.
+    pub fn from_c(kind: i32) -> Option<Kind> {
+        Kind::ALL.get(usize::try_from(kind).ok()?).copied()
+    }
+}
+
+/// What one map cost since start or the last reset.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct MapCost {
+    /// Self time per kind
+    pub ns: [u64; KINDS],
+    /// Scopes closed per kind
+    pub calls: [u64; KINDS],
+    /// Packets queued by this map's broadcasts
+    pub packets: u64,
+}
+
+impl MapCost {
+    pub fn total_ns(&self) -> u64 {
+        self.ns.iter().sum()
+    }
+}
+
+struct Frame {
+    m: u16,
+    kind: Kind,
+    start: u64,
+    /// Time of the scopes opened inside this one
+    child: u64,
+}
+
+#[derive(Default)]
+pub struct Ledger {
+    maps: HashMap<u16, MapCost>,
+    stack: Vec<Frame>,
+}
+
+impl Ledger {
+    pub fn enter(&mut self, m: u16, kind: Kind, now: u64) {
+        self.stack.push(Frame { m, kind, start: now, child: 0 });
+    }
+
+    /// Close the innermost scope at `now`, crediting it `packets`.
+    pub fn leave(&mut self, now: u64, packets: u64) {
+        let Some(f) = self.stack.pop() else { return };
+        let took = now.saturating_sub(f.start);
+        if let Some(parent) = self.stack.last_mut() {
+            parent.child += took;
+        }
+        let cost = self.maps.entry(f.m).or_default();
+        cost.ns[f.kind as usize] += took.saturating_sub(f.child);
+        cost.calls[f.kind as usize] += 1;
+        cost.packets += packets;
+    }
+
+    /// The `n` maps with the most total time, most first.
+    pub fn top(&self, n: usize) -> Vec<(u16, MapCost)> {
+        let mut all: Vec<(u16, MapCost)> = self.maps.iter().map(|(&m, &c)| (m, c)).collect();
+        all.sort_by(|a, b| b.1.total_ns().cmp(&a.1.total_ns()).then(a.0.cmp(&b.0)));
+        all.truncate(n);
+        all
+    }
+
+    /// Forget the totals; open scopes still close normally.
+    pub fn reset(&mut self) {
+        self.maps.clear();
+    }
+}
+
+thread_local! {
+    static LEDGER: RefCell<Ledger> = RefCell::new(Ledger::default());
+}
+
+/// Run `f` on this thread's ledger.
+pub fn with<R>(f: impl FnOnce(&mut Ledger) -> R) -> R {
+    LEDGER.with(|l| f(&mut l.borrow_mut()))
+}
+
+/// Open a scope for map `m`; pair with `leave`.
+pub fn enter(m: u16, kind: Kind) {
+    let now = crate::core::monotonic_ns();
+    with(|l| l.enter(m, kind, now));
+}
+
+pub fn leave(packets: u64) {
+    let now = crate::core::monotonic_ns();
+    with(|l| l.leave(now, packets));
+}
+
+/// Closes its scope when dropped.
+#[must_use]
+pub struct Scope(());
+
+impl Drop for Scope {
+    fn drop(&mut self) {
+        leave(0);
+    }
+}
+
+/// A scope for map `m` that lasts as long as the returned guard.
+pub fn scope(m: u16, kind: Kind) -> Scope {
+    enter(m, kind);
+    Scope(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_nested_scopes_charge_self_time() {
+        let mut l = Ledger::default();
+        // Mob tick on map 3 from 0 to 100; its script runs 10..60 and
+        // broadcasts 20..30 to 4 players
+        l.enter(3, Kind::Mob, 0);
+        l.enter(3, Kind::Lua, 10);
+        l.enter(3, Kind::Send, 20);
+        l.leave(30, 4);
+        l.leave(60, 0);
+        l.leave(100, 0);
+        // NPC on map 7, 5 ns
+        l.enter(7, Kind::Npc, 100);
+        l.leave(105, 0);
+
+        let top = l.top(10);
+        assert_eq!(top.len(), 2);
+        let (m, c) = top[0];
+        assert_eq!(m, 3);
+        assert_eq!(c.ns, [50, 0, 10, 40]);
+        assert_eq!(c.calls, [1, 0, 1, 1]);
+        assert_eq!(c.packets, 4);
+        assert_eq!(c.total_ns(), 100);
+        assert_eq!(top[1].0, 7);
+        assert_eq!(l.top(1).len(), 1);
+    }
+
+    #[test]
+    fn test_reset_and_unbalanced_leave() {
+        let mut l = Ledger::default();
+        l.leave(10, 0);
+        l.enter(1, Kind::Send, 0);
+        l.reset();
+        l.leave(8, 2);
+        assert_eq!(l.top(5), vec![(1, MapCost { ns: [0, 0, 8, 0], calls: [0, 0, 1, 0], packets: 2 })]);
+        assert_eq!(Kind::from_c(2), Some(Kind::Send));
+        assert_eq!(Kind::from_c(4), None);
+        assert_eq!(Kind::from_c(-1), None);
+    }
+}
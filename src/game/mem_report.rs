@@ -0,0 +1,55 @@
+//! Memory footprint of the map server's game state, for `@memory` and the
+//! `yuri_mem_*` gauges.
+//!
+//! Per-object structs are reported as their size times the live count.
+//! The cold blocks of `game::cold`, session buffers and the Lua heap are
+//! reported as what is allocated right now. Game thread only: counting
+//! walks the id slabs.
+
+use std::ffi::c_int;
+
+use super::cold;
+use super::mob::{MobSpawnData, BL_ITEM, BL_MOB, BL_NPC};
+use super::npc::NpcData;
+use super::pc::MapSessionData;
+use super::scripting::types::floor::FloorItemData;
+
+extern "C" {
+    fn map_iddb_count(bl_type: c_int) -> c_int;
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct Row {
+    pub name: &'static str,
+    /// Objects, blocks or buffers behind `bytes`
+    pub count: usize,
+    pub bytes: usize,
+}
+
+impl Row {
+    fn of<T>(name: &'static str, count: usize) -> Self {
+        Row { name, count, bytes: count * std::mem::size_of::<T>() }
+    }
+}
+
+/// Rows of the report, largest first.
+pub unsafe fn report() -> Vec<Row> {
+    let count = |t| map_iddb_count(t).max(0) as usize;
+    let mut rows = vec![
+        Row::of::<MapSessionData>("player", crate::ffi::block::map_online_count(-1).max(0) as usize),
+        Row::of::<MobSpawnData>("mob", count(BL_MOB)),
+        Row::of::<NpcData>("npc", count(BL_NPC)),
+        Row::of::<FloorItemData>("flooritem", count(BL_ITEM)),
+    ];
+    for kind in cold::Kind::ALL {
+        let n = cold::live(kind);
+        rows.push(Row { name: kind.name(), count: n, bytes: n * kind.size() });
+    }
+    let sm = crate::session::get_session_manager();
+    rows.push(Row { name: "session_buffers", count: sm.session_count(), bytes: sm.buffer_bytes() });
+    let pool = crate::network::buffer_pool::pool().stats();
+    rows.push(Row { name: "pooled_buffers", count: pool.pooled.iter().sum(), bytes: pool.pooled_bytes() });
+    rows.push(Row { name: "lua_heap", count: 1, bytes: super::scripting::sl_alloc_stats().heap_bytes });
+    rows.sort_by(|a, b| b.bytes.cmp(&a.bytes));
+    rows
+}
@@ -0,0 +1,185 @@
+//! Map-server gauges owned by the game thread.
+//!
+//! Players per map, per-map costs, the mob scheduler, the autosave
+//! scheduler, the Lua heap, the memory report and the C timer table are
+//! only safe to read on the game thread. `sample` copies them out once a
+//! second from the start-of-tick hook, and the collector added by
+//! `register` renders the last copy, so a scrape never waits on or touches
+//! game state.
+
+use std::ffi::CStr;
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+use std::sync::Mutex;
+
+use super::autosave::SaveStats;
+use super::map_cost::{self, Kind, MapCost};
+use crate::metrics::{self, Writer};
+
+/// Time between samples.
+const EVERY_NS: u64 = 1_000_000_000;
+
+/// Maps exported with their costs, most expensive first.
+pub const COST_TOP: usize = 20;
+
+/// Title of map `id`, empty if it is not loaded.
+pub unsafe fn map_title(id: u16) -> String {
+    let base = crate::ffi::map_db::map;
+    if base.is_null() {
+        return String::new();
+    }
+    let md = &*base.add(id as usize);
+    CStr::from_ptr(md.title.as_ptr()).to_string_lossy().into_owned()
+}
+
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct Gauges {
+    /// (map id, title, players) of every map with players on it
+    pub maps: Vec<(u16, String, u32)>,
+    /// (map id, title, cost) of the COST_TOP maps with the most time
+    pub costs: Vec<(u16, String, MapCost)>,
+    pub mobs: usize,
+    pub awake_mobs: usize,
+    pub autosave: SaveStats,
+    pub lua_heap: usize,
+    pub timers: usize,
+    /// (kind, objects, bytes) rows of the memory report
+    pub mem: Vec<(&'static str, usize, usize)>,
+}
+
+impl Gauges {
+    pub fn write(&self, w: &mut Writer) {
+        w.family("yuri_map_players", "gauge", "Players on each map");
+        for (id, title, n) in &self.maps {
+            w.sample("yuri_map_players", &[("map", &id.to_string()), ("title", title)], *n as f64);
+        }
+        w.family("yuri_map_cost_seconds_total", "counter", "Game-thread time spent on each map, by kind");
+        for (id, title, c) in &self.costs {
+            let id = id.to_string();
+            for kind in Kind::ALL {
+                let labels = [("map", id.as_str()), ("title", title.as_str()), ("kind", kind.name())];
+                w.sample("yuri_map_cost_seconds_total", &labels, c.ns[kind as usize] as f64 / 1e9);
+            }
+        }
+        w.family("yuri_map_packets_total", "counter", "Packets queued by each map's area broadcasts");
+        for (id, title, c) in &self.costs {
+            w.sample("yuri_map_packets_total", &[("map", &id.to_string()), ("title", title)], c.packets as f64);
+        }
+        w.gauge("yuri_mobs", "Mobs registered with the scheduler", self.mobs as f64);
+        w.gauge("yuri_mobs_awake", "Mobs ticked every pass", self.awake_mobs as f64);
+        let a = &self.autosave;
+        w.counter("yuri_autosaves_total", "Autosaves issued", a.saves);
+        w.gauge("yuri_autosave_backlog", "Players past their autosave slot, waiting for budget", a.backlog as f64);
+        w.gauge("yuri_autosave_lag_seconds", "Delay between slot and save of the last autosave", a.last_lag_ms as f64 / 1e3);
+        w.gauge("yuri_autosave_lag_max_seconds", "Worst autosave delay since startup", a.max_lag_ms as f64 / 1e3);
+        w.gauge("yuri_lua_heap_bytes", "Lua heap in use", self.lua_heap as f64);
+        w.gauge("yuri_timers", "C timers allocated", self.timers as f64);
+        w.family("yuri_mem_bytes", "gauge", "Bytes held by each kind of game object or buffer");
+        for (kind, _, bytes) in &self.mem {
+            w.sample("yuri_mem_bytes", &[("kind", *kind)], *bytes as f64);
+        }
+        w.family("yuri_mem_objects", "gauge", "Live objects or blocks behind yuri_mem_bytes");
+        for (kind, count, _) in &self.mem {
+            w.sample("yuri_mem_objects", &[("kind", *kind)], *count as f64);
+        }
+    }
+}
+
+static LAST: Mutex<Option<Gauges>> = Mutex::new(None);
+static NEXT_NS: AtomicU64 = AtomicU64::new(0);
+
+/// Refresh the published gauges if a second has passed. Game thread only.
+pub unsafe fn sample() {
+    let now = crate::core::monotonic_ns();
+    if now < NEXT_NS.load(Relaxed) {
+        return;
+    }
+    NEXT_NS.store(now + EVERY_NS, Relaxed);
+
+    let mut g = Gauges::default();
+    let base = crate::ffi::map_db::map;
+    if !base.is_null() {
+        for id in 0..crate::database::map_db::MAP_SLOTS {
+            let md = &*base.add(id);
+            if md.tile.is_null() || md.user <= 0 {
+                continue;
+            }
+            let title = CStr::from_ptr(md.title.as_ptr()).to_string_lossy().into_owned();
+            g.maps.push((id as u16, title, md.user as u32));
+        }
+    }
+    for (id, cost) in map_cost::with(|l| l.top(COST_TOP)) {
+        g.costs.push((id, map_title(id), cost));
+    }
+    {
+        let s = super::mob_sched::sched();
+        g.mobs = s.len();
+        g.awake_mobs = s.awake_len();
+    }
+    g.autosave = super::autosave::scheduler().stats();
+    g.lua_heap = super::scripting::sl_alloc_stats().heap_bytes;
+    g.timers = crate::ffi::timer::timer_count().max(0) as usize;
+    #[cfg(feature = "map-game")]
+    {
+        g.mem = super::mem_report::report().into_iter().map(|r| (r.name, r.count, r.bytes)).collect();
+    }
+    *LAST.lock().unwrap_or_else(|e| e.into_inner()) = Some(g);
+}
+
+/// Serve the map server's metrics: sessions, client packets, the loop tick,
+/// the write-behind queue and the gauges above.
+pub fn register() {
+    metrics::register(|w| {
+        let online = crate::session::get_session_manager().session_count();
+        w.gauge("yuri_sessions", "Open client and server sessions", online as f64);
+        w.histogram("yuri_tick_seconds", "Server loop tick duration", &metrics::TICK_SECONDS.snapshot());
+
+        let q = crate::database::write_behind::backlog();
+        w.gauge("yuri_db_queue_writes", "Writes waiting for the DB worker", q.queued as f64);
+        w.gauge("yuri_db_queue_bytes", "SQL bytes waiting for the DB worker", q.bytes as f64);
+        w.gauge("yuri_db_queue_in_flight", "Writes the DB worker is running", q.in_flight as f64);
+        w.gauge("yuri_db_queue_lag_seconds", "Age of the oldest queued write", q.lag.as_secs_f64());
+        w.counter("yuri_db_writes_coalesced_total", "Queued writes replaced by a newer one", q.coalesced);
+        w.counter("yuri_db_writes_failed_total", "Queued writes that failed", q.failed);
+
+        if let Some(g) = LAST.lock().unwrap_or_else(|e| e.into_inner()).as_ref() {
+            g.write(w);
+        }
+    });
+    metrics::register_packets();
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_gauges_render() {
+        let g = Gauges {
+            maps: vec![(1, "Kugnae".into(), 12), (40, "Buya".into(), 3)],
+            costs: vec![(1, "Kugnae".into(), MapCost { ns: [2_000_000_000, 0, 500_000_000, 0], calls: [9, 0, 4, 0], packets: 70 })],
+            mobs: 900,
+            awake_mobs: 120,
+            autosave: SaveStats { saves: 30, backlog: 2, last_lag_ms: 200, max_lag_ms: 1500 },
+            lua_heap: 1 << 20,
+            timers: 64,
+            mem: vec![("mob", 900, 900 * 11976)],
+        };
+        let mut w = Writer::default();
+        g.write(&mut w);
+        let out = w.finish();
+        assert!(out.contains("yuri_map_players{map=\"1\",title=\"Kugnae\"} 12\n"));
+        assert!(out.contains("yuri_map_players{map=\"40\",title=\"Buya\"} 3\n"));
+        assert!(out.contains("yuri_map_cost_seconds_total{map=\"1\",title=\"Kugnae\",kind=\"mob\"} 2\n"));
+        assert!(out.contains("yuri_map_cost_seconds_total{map=\"1\",title=\"Kugnae\",kind=\"send\"} 0.5\n"));
+        assert!(out.contains("yuri_map_packets_total{map=\"1\",title=\"Kugnae\"} 70\n"));
+        assert!(out.contains("yuri_mobs_awake 120\n"));
+        assert!(out.contains("yuri_autosaves_total 30\n"));
+        assert!(out.contains("yuri_autosave_backlog 2\n"));
+        assert!(out.contains("yuri_autosave_lag_seconds 0.2\n"));
+        assert!(out.contains("yuri_autosave_lag_max_seconds 1.5\n"));
+        assert!(out.contains("yuri_lua_heap_bytes 1048576\n"));
+        assert!(out.contains("yuri_timers 64\n"));
+        assert!(out.contains("yuri_mem_bytes{kind=\"mob\"} 10778400\n"));
+        assert!(out.contains("yuri_mem_objects{kind=\"mob\"} 900\n"));
+    }
+}
@@ -7,11 +7,21 @@ use crate::database::map_db::BLOCK_SIZE;
 use crate::database::map_db::{BlockList, GlobalReg, WarpList};
 use crate::database::mob_db::MobDbData;
 #[cfg(not(test))]
+use crate::database::pass_grid::Step;
+#[cfg(not(test))]
 use crate::ffi::map_db::{get_map_ptr as ffi_get_map_ptr, map_is_loaded as ffi_map_is_loaded};
+#[cfg(not(test))]
+use crate::ffi::ers::{ers_pool_alloc, ers_pool_free};
+#[cfg(not(test))]
+use crate::game::map_cost;
+use crate::game::cold;
+use crate::game::mob_sched;
+use crate::game::reg_index;
+use crate::game::scripting::dispatch::ScriptHandle;
 use crate::game::pc::MapSessionData;
 use crate::game::types::GfxViewer;
 use crate::servers::char::charstatus::{Item, SkillInfo};
-use std::ffi::{c_char, c_double, c_float, c_int, c_schar, c_short, c_uchar, c_uint, c_ushort};
+use std::ffi::{c_char, c_double, c_float, c_int, c_schar, CStr, c_short, c_uchar, c_uint, c_ushort};
 
 // ─── Constants ──────────────────────────────────────────────────────────────
 pub const MOB_START_NUM: u32 = 1073741823;
@@ -65,28 +75,32 @@ pub struct ThreatTable {
 /// offset  field                    size
 ///      0  bl                         48  (BlockList)
 ///     48  da[200]                  9600  (200 × SkillInfo@48)
-///   9648  inventory[52]           45760  (52 × Item@880)
-///  55408  data*                       8  (pointer)
-///  55416  threat[50]                400  (50 × ThreatTable@8)
-///  55816  registry[50]             3400  (50 × GlobalReg@68)
-///  59216  gfx                        72  (GfxViewer)
-///  59288  startm..look               12  (6 × u16)
-///  59300  miss, protection            4  (2 × i16)
-///  59304  id..exp                    72  (18 × u32)
-///  59376  ac..will                   44  (11 × i32)
-///  59420  state..look_color           9  (9 × u8)
-///  59429  clone..charstate            5  (5 × i8)  → compiler pads 3 bytes here
-///  59437  sleep..invis               20  (5 × f32) — offset 59437 is wrong after pad
+///   9648  inventory*                  8  (52 × Item@880 when allocated)
+///   9656  data*                       8  (pointer)
+///   9664  threat[50]                400  (50 × ThreatTable@8)
+///  10064  registry*                   8  (50 × GlobalReg@68 when allocated)
+///  10072  gfx                        72  (GfxViewer)
+///  10144  startm..look               12  (6 × u16)
+///  10156  miss, protection            4  (2 × i16)
+///  10160  id..exp                    88  (22 × u32)
+///  10248  ac..will                   56  (14 × i32)
+///  10304  state..look_color           9  (9 × u8)
+///  10313  clone..charstate            5  (5 × i8)  → compiler pads 2 bytes here
+///  10320  sleep..invis               20  (5 × f32) → compiler pads 4 bytes here
+///  10344  dmgdealt..dmggrptable     1624  (3 + 2 × 100 f64)
 /// ```
-/// (Use the size test to verify total = 61120.)
+/// (Use the size test to verify total = 11976.)
+///
+/// `inventory` and `registry` are allocated on first write (see
+/// `game::cold`) and freed with the mob; NULL reads as empty.
 #[repr(C)]
 pub struct MobSpawnData {
     pub bl: BlockList,
     pub da: [SkillInfo; MAX_MAGIC_TIMERS],
-    pub inventory: [Item; MAX_INVENTORY],
+    pub inventory: *mut Item,
     pub data: *mut MobDbData,
     pub threat: [ThreatTable; MAX_THREATCOUNT],
-    pub registry: [GlobalReg; MAX_GLOBALMOBREG],
+    pub registry: *mut GlobalReg,
     pub gfx: GfxViewer,
     pub startm: c_ushort,
     pub startx: c_ushort,
@@ -193,6 +207,7 @@ pub static mut TIMERCHECK: c_uchar = 0; // internal only
 extern "C" {
     // map entity lookup
     pub fn map_id2bl(id: c_uint) -> *mut BlockList;
+    pub fn map_id2bl_gen(id: c_uint, gen: c_uint) -> *mut BlockList;
     pub fn map_id2mob(id: c_uint) -> *mut MobSpawnData;
     #[link_name = "map_id2sd"]
     pub fn map_id2sd_mob(id: c_uint) -> *mut MapSessionData;
@@ -327,13 +342,29 @@ pub unsafe fn onetime_avail(id: c_uint) -> *mut BlockList {
     map_id2bl(id)
 }
 
+/// The mob's inventory, allocated on first use. NULL only on OOM.
+pub unsafe fn mob_inventory(mob: *mut MobSpawnData) -> *mut Item {
+    cold::get_or_alloc(&raw mut (*mob).inventory, cold::Kind::MobInventory)
+}
+
+/// Free the mob's inventory and registry blocks. Called before its memory
+/// is released or reused.
+pub unsafe fn free_cold(mob: *mut MobSpawnData) {
+    cold::release(&raw mut (*mob).inventory, cold::Kind::MobInventory);
+    if !(*mob).registry.is_null() {
+        reg_index::reset(mob as usize);
+        cold::release(&raw mut (*mob).registry, cold::Kind::MobRegistry);
+    }
+}
+
 #[cfg(not(test))]
 pub unsafe fn free_onetime(mob: *mut MobSpawnData) -> c_int {
     if mob.is_null() {
         return 0;
     }
     (*mob).data = std::ptr::null_mut();
-    libc::free(mob as *mut libc::c_void);
+    free_cold(mob);
+    ers_pool_free(mob as *mut libc::c_void, std::mem::size_of::<MobSpawnData>());
     // compact onetime range downward
     let mut x = MOB_ONETIME_START;
     while x <= MOB_ONETIME_MAX {
@@ -917,6 +948,7 @@ pub unsafe fn mob_warp(mob: *mut MobSpawnData, m: c_int, x: c_int, y: c_int) ->
     if ((*mob).bl.id) < MOB_START_NUM || ((*mob).bl.id) >= NPC_START_NUM {
         return 0;
     }
+    mob_sched::touch(mob as usize);
     map_delblock(&mut (*mob).bl);
     clif_lookgone(&mut (*mob).bl);
     (*mob).bl.m = m as c_ushort;
@@ -955,6 +987,7 @@ pub unsafe fn mob_warp(mob: *mut MobSpawnData, m: c_int, x: c_int, y: c_int) ->
 pub unsafe fn kill_mob(mob: *mut MobSpawnData) -> c_int {
     #[cfg(not(test))]
     {
+        mob_sched::touch(mob as usize);
         clif_mob_kill(mob);
         mob_flushmagic(mob);
     }
@@ -1044,7 +1077,7 @@ pub unsafe fn mob_handle_sub(mob: *mut MobSpawnData) {
                 let pre_x = (*mob).bl.x;
                 let pre_y = (*mob).bl.y;
                 (*mob).time_ = 0;
-                dispatch_ai(mob, bl, c"move".as_ptr());
+                dispatch_ai(mob, bl, AI_MOVE);
                 // If the mob didn't actually move but Lua left newmove faster
                 // than the base speed (e.g. return-to-start mode while blocked),
                 // reset newmove so the mob doesn't rapid-fire move attempts.
@@ -1082,7 +1115,7 @@ pub unsafe fn mob_handle_sub(mob: *mut MobSpawnData) {
                     return;
                 }
                 (*mob).time_ = 0;
-                dispatch_ai(mob, bl, c"attack".as_ptr());
+                dispatch_ai(mob, bl, AI_ATTACK);
             }
         }
         MOB_ESCAPE => {
@@ -1110,7 +1143,7 @@ pub unsafe fn mob_handle_sub(mob: *mut MobSpawnData) {
                 }
                 let bl = mob_resolve_target(mob);
                 (*mob).time_ = 0;
-                dispatch_ai(mob, bl, c"escape".as_ptr());
+                dispatch_ai(mob, bl, AI_ESCAPE);
             }
         }
         _ => {}
@@ -1150,24 +1183,47 @@ unsafe fn mob_resolve_target(mob: *mut MobSpawnData) -> *mut BlockList {
     bl
 }
 
+/// Mob AI events, in `AI_HANDLES` column order.
+const AI_MOVE: usize = 0;
+const AI_ATTACK: usize = 1;
+const AI_ESCAPE: usize = 2;
+const AI_EVENTS: [&CStr; 3] = [c"move", c"attack", c"escape"];
+
+macro_rules! ai_handles {
+    ($($root:literal),*) => {
+        [$([
+            ScriptHandle::new($root, Some(c"move")),
+            ScriptHandle::new($root, Some(c"attack")),
+            ScriptHandle::new($root, Some(c"escape")),
+        ]),*]
+    };
+}
+
+/// Script handles of the stock AI scripts by mob subtype and event. Subtype
+/// 4 runs the mob's own script, named by `yname`, and is looked up by name.
+static AI_HANDLES: [[ScriptHandle; 3]; 6] = ai_handles!(
+    c"mob_ai_basic", c"mob_ai_normal", c"mob_ai_hard", c"mob_ai_boss", c"", c"mob_ai_ghost"
+);
+
 /// Dispatches to the correct Lua AI script based on mob subtype.
 #[cfg(not(test))]
-unsafe fn dispatch_ai(mob: *mut MobSpawnData, bl: *mut BlockList, event: *const c_char) {
+unsafe fn dispatch_ai(mob: *mut MobSpawnData, bl: *mut BlockList, event: usize) {
     let data = if (*mob).data.is_null() {
         return;
     } else {
         &*(*mob).data
     };
-    let script: *const c_char = match data.subtype {
-        0 => c"mob_ai_basic".as_ptr(),
-        1 => c"mob_ai_normal".as_ptr(),
-        2 => c"mob_ai_hard".as_ptr(),
-        3 => c"mob_ai_boss".as_ptr(),
-        4 => data.yname.as_ptr(),
-        5 => c"mob_ai_ghost".as_ptr(),
-        _ => return,
-    };
-    sl_doscript_blargs(script, event, 2, &raw mut (*mob).bl, bl);
+    match data.subtype {
+        4 => {
+            sl_doscript_blargs(data.yname.as_ptr(), AI_EVENTS[event].as_ptr(), 2, &raw mut (*mob).bl, bl);
+        }
+        sub @ (0..=3 | 5) => {
+            let h = AI_HANDLES[sub as usize][event].get();
+            let args = [&raw mut (*mob).bl as *mut libc::c_void, bl as *mut libc::c_void];
+            crate::game::scripting::sl_doscript_handle(h, &args);
+        }
+        _ => {}
+    }
 }
 
 // ─── mob_trap_look (va_list callback) ────────────────────────────────────────
@@ -1209,29 +1265,39 @@ pub unsafe extern "C" fn mob_trap_look_ffi(bl: *mut BlockList, mut ap: ...) -> c
 }
 
 /// Called every 50ms by the timer system.
+///
+/// Walks the awake set from `mob_sched` instead of every spawn/onetime id.
+/// A mob whose tick would do nothing (see `sleep_reason`) is taken off the
+/// awake set until its map has users again or a script touches it.
 #[cfg(not(test))]
 pub unsafe fn mob_timer_spawns(_id: c_int, _n: c_int) -> c_int {
     TIMERCHECK = TIMERCHECK.wrapping_add(1);
+    let tc = TIMERCHECK;
 
-    if MOB_SPAWN_START != MOB_SPAWN_MAX {
-        let mut x = MOB_SPAWN_START;
-        while x < MOB_SPAWN_MAX {
-            let mob = map_id2mob(x);
-            if !mob.is_null() {
-                tick_mob(mob);
-            }
-            x += 1;
+    wake_sleepers(tc);
+
+    let mut i = 0;
+    loop {
+        let Some(entry) = mob_sched::sched().awake_at(i) else { break };
+        let mob = entry.addr as *mut MobSpawnData;
+        {
+            let _cost = map_cost::scope((*mob).bl.m, map_cost::Kind::Mob);
+            tick_mob(mob, entry.dura);
         }
-    }
 
-    if MOB_ONETIME_START != MOB_ONETIME_MAX {
-        let mut x = MOB_ONETIME_START;
-        while x < MOB_ONETIME_MAX {
-            let mob = map_id2mob(x);
-            if !mob.is_null() {
-                tick_mob(mob);
+        let mut sched = mob_sched::sched();
+        // The tick freed this mob (or another one) and the slot was refilled
+        // from the end: look at slot i again.
+        if sched.awake_at(i).map(|e| e.addr) != Some(entry.addr) {
+            continue;
+        }
+        let dura = if tc % 20 == 0 { has_durations(mob) } else { entry.dura };
+        match sleep_reason(mob, dura) {
+            Some(why) => sched.sleep(i, why),
+            None => {
+                sched.set_dura(i, dura);
+                i += 1;
             }
-            x += 1;
         }
     }
 
@@ -1242,21 +1308,78 @@ pub unsafe fn mob_timer_spawns(_id: c_int, _n: c_int) -> c_int {
 }
 
 #[cfg(not(test))]
-unsafe fn tick_mob(mob: *mut MobSpawnData) {
+unsafe fn tick_mob(mob: *mut MobSpawnData, dura: bool) {
     let tc = TIMERCHECK;
-    if tc % 5 == 0 {
-        mob_secondduratimer(mob);
+    // Duration passes only act on active `da` slots; skip them when none are left.
+    if dura {
+        if tc % 5 == 0 {
+            mob_secondduratimer(mob);
+        }
+        if tc % 10 == 0 {
+            mob_thirdduratimer(mob);
+        }
+        if tc % 30 == 0 {
+            mob_fourthduratimer(mob);
+        }
+        if tc % 20 == 0 {
+            mob_duratimer(mob);
+        }
+    }
+    mob_handle_sub(mob);
+}
+
+#[cfg(not(test))]
+unsafe fn map_has_users(m: c_ushort) -> bool {
+    ffi_map_is_loaded(m) && (*ffi_get_map_ptr(m)).user > 0
+}
+
+#[cfg(not(test))]
+unsafe fn has_durations(mob: *const MobSpawnData) -> bool {
+    (*mob).da.iter().any(|d| d.id > 0)
+}
+
+/// Why `mob`'s next tick would be a no-op, or None if it must keep ticking.
+/// Mirrors the early returns in `mob_handle_sub`.
+#[cfg(not(test))]
+unsafe fn sleep_reason(mob: *const MobSpawnData, dura: bool) -> Option<mob_sched::Sleep> {
+    // Dead mobs respawn (or free themselves) from the tick
+    if (*mob).state == MOB_DEAD || dura {
+        return None;
     }
-    if tc % 10 == 0 {
-        mob_thirdduratimer(mob);
+    let Some(data) = (*mob).data.as_ref() else {
+        return Some(mob_sched::Sleep::Dormant);
+    };
+    if data.r#type >= 2 {
+        return Some(mob_sched::Sleep::Dormant);
     }
-    if tc % 30 == 0 {
-        mob_fourthduratimer(mob);
+    if map_has_users((*mob).bl.m) {
+        return None;
+    }
+    // These subtypes keep acting on empty maps
+    if ((*mob).onetime != 0 && data.subtype == 2) || ((*mob).onetime == 0 && data.subtype == 4) {
+        return None;
+    }
+    Some(mob_sched::Sleep::EmptyMap((*mob).bl.m))
+}
+
+/// Wake mobs on maps that have users again. Once a second also wake any
+/// sleeper that died while asleep, so it respawns on schedule.
+#[cfg(not(test))]
+unsafe fn wake_sleepers(tc: c_uchar) {
+    let maps = mob_sched::sched().sleeping_maps();
+    for m in maps {
+        if map_has_users(m) {
+            mob_sched::sched().wake_map(m);
+        }
     }
     if tc % 20 == 0 {
-        mob_duratimer(mob);
+        let sleepers = mob_sched::sched().sleepers();
+        for addr in sleepers {
+            if (*(addr as *const MobSpawnData)).state == MOB_DEAD {
+                mob_sched::touch(addr);
+            }
+        }
     }
-    mob_handle_sub(mob);
 }
 
 // ─── Movement functions ───────────────────────────────────────────────────────
@@ -1553,6 +1676,67 @@ unsafe fn check_pc_collision(moving_mob: *mut MobSpawnData, m: c_int, x: c_int,
     }
 }
 
+/// The pass planes' view of `mob` stepping from (x0, y0) onto (x1, y1).
+/// Without planes (map not loaded) the edges are checked exactly and the
+/// wall and occupant checks always run.
+#[cfg(not(test))]
+unsafe fn plane_step(mob: *mut MobSpawnData, m: c_int, x0: c_int, y0: c_int, x1: c_int, y1: c_int) -> Step {
+    let side = (*mob).side;
+    crate::ffi::block::pass_step(m as usize, x0 as u16, y0 as u16, x1 as u16, y1 as u16, side as usize)
+        .unwrap_or_else(|| Step {
+            edge: clif_object_canmove(m, x1, y1, side) != 0 || clif_object_canmove_from(m, x0, y0, side) != 0,
+            wall: true,
+            occupied: true,
+        })
+}
+
+/// Set `mob.canmove` if a live mob, a solid player or a plain NPC stands
+/// on (x, y).
+#[cfg(not(test))]
+unsafe fn collide(mob: *mut MobSpawnData, m: c_int, x: c_int, y: c_int) {
+    check_mob_collision(mob, m, x, y);
+    check_pc_collision(mob, m, x, y);
+    map_foreachincell(rust_mob_move, m, x, y, BL_NPC, mob as *mut _);
+}
+
+/// Sides (bit `1 << side`) `move_mob` could step to from where `mob`
+/// stands: all four steps are read from the planes at once, and only the
+/// sides with a wall or an occupant get the exact check. For AI that picks
+/// among directions rather than trying them one by one. Leaves
+/// `mob.canmove` as it found it.
+#[cfg(not(test))]
+pub unsafe fn mob_open_sides(mob: *mut MobSpawnData) -> u8 {
+    let slot = ffi_get_map_ptr((*mob).bl.m);
+    if slot.is_null() {
+        return 0;
+    }
+    let m = (*mob).bl.m as c_int;
+    let (x, y) = ((*mob).bl.x, (*mob).bl.y);
+    let Some(steps) = crate::ffi::block::pass_steps(m as usize, x, y) else { return 0 };
+    let (x, y) = (x as c_int, y as c_int);
+    let saved = (*mob).canmove;
+    let mut open = steps.clear();
+    for side in 0..4 {
+        let bit = 1u8 << side;
+        let (tx, ty) = [(x, y - 1), (x + 1, y), (x, y + 1), (x - 1, y)][side];
+        if steps.unsure() & bit != 0 {
+            (*mob).canmove = 0;
+            if steps.occupied & bit != 0 {
+                collide(mob, m, tx, ty);
+            }
+            let wall = steps.wall & bit != 0 && map_canmove(m, tx, ty) == 1;
+            if !wall && (*mob).canmove == 0 {
+                open |= bit;
+            }
+        }
+        if open & bit != 0 && warp_at(slot, tx, ty) {
+            open &= !bit;
+        }
+    }
+    (*mob).canmove = saved;
+    open
+}
+
 #[cfg(not(test))]
 pub unsafe fn move_mob(mob: *mut MobSpawnData) -> c_int {
     let m = (*mob).bl.m as c_int;
@@ -1579,19 +1763,11 @@ pub unsafe fn move_mob(mob: *mut MobSpawnData) -> c_int {
         return 0;
     }
 
-    check_mob_collision(mob, m, dx, dy);
-    check_pc_collision(mob, m, dx, dy);
-    map_foreachincell(rust_mob_move, m, dx, dy, BL_NPC, mob as *mut _);
-
-    if clif_object_canmove(m, dx, dy, (*mob).side) != 0 {
-        (*mob).canmove = 0;
-        return 0;
-    }
-    if clif_object_canmove_from(m, backx, backy, (*mob).side) != 0 {
-        (*mob).canmove = 0;
-        return 0;
+    let step = plane_step(mob, m, backx, backy, dx, dy);
+    if step.occupied {
+        collide(mob, m, dx, dy);
     }
-    if map_canmove(m, dx, dy) == 1 || (*mob).canmove == 1 {
+    if step.edge || (step.wall && map_canmove(m, dx, dy) == 1) || (*mob).canmove == 1 {
         (*mob).canmove = 0;
         return 0;
     }
@@ -1646,11 +1822,7 @@ pub unsafe fn move_mob_ignore_object(mob: *mut MobSpawnData) -> c_int {
     }
 
     // No collision callbacks — ignore objects
-    if clif_object_canmove(m, dx, dy, (*mob).side) != 0 {
-        (*mob).canmove = 0;
-        return 0;
-    }
-    if clif_object_canmove_from(m, backx, backy, (*mob).side) != 0 {
+    if plane_step(mob, m, backx, backy, dx, dy).edge {
         (*mob).canmove = 0;
         return 0;
     }
@@ -1703,24 +1875,17 @@ pub unsafe fn moveghost_mob(mob: *mut MobSpawnData) -> c_int {
         return 0;
     }
 
-    check_mob_collision(mob, m, dx, dy);
-    check_pc_collision(mob, m, dx, dy);
-    map_foreachincell(rust_mob_move, m, dx, dy, BL_NPC, mob as *mut _);
+    let step = plane_step(mob, m, backx, backy, dx, dy);
+    if step.occupied {
+        collide(mob, m, dx, dy);
+    }
 
     // Collision checks only apply when mob has no target
-    if (*mob).target == 0 {
-        if clif_object_canmove(m, dx, dy, (*mob).side) != 0 {
-            (*mob).canmove = 0;
-            return 0;
-        }
-        if clif_object_canmove_from(m, backx, backy, (*mob).side) != 0 {
-            (*mob).canmove = 0;
-            return 0;
-        }
-        if map_canmove(m, dx, dy) == 1 || (*mob).canmove == 1 {
-            (*mob).canmove = 0;
-            return 0;
-        }
+    if (*mob).target == 0
+        && (step.edge || (step.wall && map_canmove(m, dx, dy) == 1) || (*mob).canmove == 1)
+    {
+        (*mob).canmove = 0;
+        return 0;
     }
 
     let dx = if dx >= xs {
@@ -1757,11 +1922,18 @@ pub unsafe fn mob_move2(mob: *mut MobSpawnData, x: c_int, y: c_int, side: c_int)
         return 0;
     }
     let m = (*mob).bl.m as c_int;
+    let slot = ffi_get_map_ptr((*mob).bl.m);
+    if slot.is_null() || x >= (*slot).xs as c_int || y >= (*slot).ys as c_int {
+        return 0;
+    }
     (*mob).side = side;
-    check_mob_collision(mob, m, x, y);
-    check_pc_collision(mob, m, x, y);
+    let step = plane_step(mob, m, x, y, x, y);
+    if step.occupied {
+        check_mob_collision(mob, m, x, y);
+        check_pc_collision(mob, m, x, y);
+    }
     let cm = (*mob).canmove;
-    if map_canmove(m, x, y) == 0 && cm == 0 {
+    if !(step.wall && map_canmove(m, x, y) != 0) && cm == 0 {
         (*mob).bx = (*mob).bl.x;
         (*mob).by_ = (*mob).bl.y;
         map_moveblock(&mut (*mob).bl, x, y);
@@ -1823,43 +1995,35 @@ pub unsafe fn mob_readglobalreg(mob: *mut MobSpawnData, reg: *const c_char) -> c
     if mob.is_null() || reg.is_null() {
         return 0;
     }
-    for i in 0..MAX_GLOBALMOBREG {
-        if libc::strcasecmp((*mob).registry[i].str.as_ptr(), reg) == 0 {
-            return (*mob).registry[i].val;
-        }
+    mob_readglobalreg_id(mob, reg_index::intern(CStr::from_ptr(reg)))
+}
+
+/// `mob_readglobalreg` for a name interned with `reg_index::intern`.
+pub unsafe fn mob_readglobalreg_id(mob: *mut MobSpawnData, id: u32) -> c_int {
+    if mob.is_null() {
+        return 0;
     }
-    0
+    let regs = (*mob).registry;
+    if regs.is_null() {
+        return 0;
+    }
+    reg_index::read(mob as usize, std::slice::from_raw_parts(regs, MAX_GLOBALMOBREG), MAX_GLOBALMOBREG, id)
 }
 
 pub unsafe fn mob_setglobalreg(mob: *mut MobSpawnData, reg: *const c_char, val: c_int) -> c_int {
     if mob.is_null() || reg.is_null() {
         return 1;
     }
-    // find existing slot
-    for i in 0..MAX_GLOBALMOBREG {
-        if libc::strcasecmp((*mob).registry[i].str.as_ptr(), reg) == 0 {
-            if val == 0 {
-                libc::strcpy((*mob).registry[i].str.as_mut_ptr(), c"".as_ptr());
-            }
-            (*mob).registry[i].val = val;
-            return 0;
-        }
+    if (*mob).registry.is_null() && val == 0 {
+        return 0;
     }
-    // find empty slot
-    for i in 0..MAX_GLOBALMOBREG {
-        if libc::strcasecmp((*mob).registry[i].str.as_ptr(), c"".as_ptr()) == 0 {
-            let dst = (*mob).registry[i].str.as_mut_ptr();
-            let dst_len = core::mem::size_of_val(&(*mob).registry[i].str);
-            libc::strncpy(dst, reg, dst_len - 1);
-            *dst.add(dst_len - 1) = 0;
-            (*mob).registry[i].val = val;
-            return 0;
-        }
+    let regs = cold::get_or_alloc(&raw mut (*mob).registry, cold::Kind::MobRegistry);
+    if !regs.is_null()
+        && reg_index::set(mob as usize, std::slice::from_raw_parts_mut(regs, MAX_GLOBALMOBREG), CStr::from_ptr(reg), val)
+    {
+        return 0;
     }
-    eprintln!(
-        "[mob] mob_setglobalreg: couldn't set {:?}",
-        std::ffi::CStr::from_ptr(reg)
-    );
+    eprintln!("[mob] mob_setglobalreg: couldn't set {:?}", CStr::from_ptr(reg));
     1
 }
 
@@ -1929,7 +2093,7 @@ pub unsafe extern "C" fn rust_mob_dropitem(
         };
 
     let mut def: c_int = 0;
-    let fl = libc::calloc(1, std::mem::size_of::<FloorItemData>()) as *mut FloorItemData;
+    let fl = ers_pool_alloc(std::mem::size_of::<FloorItemData>()) as *mut FloorItemData;
     if fl.is_null() {
         return 0;
     }
@@ -1998,7 +2162,7 @@ pub unsafe extern "C" fn rust_mob_dropitem(
             &raw mut (*fl).bl,
         );
     } else {
-        libc::free(fl as *mut libc::c_void);
+        ers_pool_free(fl as *mut libc::c_void, std::mem::size_of::<FloorItemData>());
     }
     0
 }
@@ -2014,8 +2178,12 @@ pub unsafe fn mobdb_drops(mob: *mut MobSpawnData, sd: *mut std::ffi::c_void) ->
         &raw mut (*mob).bl,
     );
     let sd_typed = sd as *mut MapSessionData;
+    let inv = (*mob).inventory;
+    if inv.is_null() {
+        return 0;
+    }
     for i in 0..MAX_INVENTORY {
-        let slot = &(*mob).inventory[i];
+        let slot = &mut *inv.add(i);
         if slot.id != 0 && slot.amount >= 1 {
             rust_mob_dropitem(
                 (*mob).bl.id,
@@ -2029,11 +2197,11 @@ pub unsafe fn mobdb_drops(mob: *mut MobSpawnData, sd: *mut std::ffi::c_void) ->
                 (*mob).bl.y as c_int,
                 sd_typed,
             );
-            (*mob).inventory[i].id = 0;
-            (*mob).inventory[i].amount = 0;
-            (*mob).inventory[i].owner = 0;
-            (*mob).inventory[i].dura = 0;
-            (*mob).inventory[i].protected = 0;
+            slot.id = 0;
+            slot.amount = 0;
+            slot.owner = 0;
+            slot.dura = 0;
+            slot.protected = 0;
         }
     }
     0
@@ -2115,6 +2283,10 @@ pub unsafe extern "C" fn rust_mob_find_target(bl: *mut BlockList, mut ap: ...) -
     0
 }
 
+/// Per-hit scripts run for every mob swing.
+static HIT_CRIT_CHANCE: ScriptHandle = ScriptHandle::new(c"hitCritChance", None);
+static SWING_DAMAGE: ScriptHandle = ScriptHandle::new(c"swingDamage", None);
+
 /// Mob attacks a player (or another mob) by ID.
 /// Reads `sd->uFlags` and `sd->optFlags` to check immortal/stealth before attacking.
 /// Calls scripting hooks `hitCritChance` and `swingDamage`, then sends network damage.
@@ -2148,30 +2320,21 @@ pub unsafe extern "C" fn rust_mob_attack(mob: *mut MobSpawnData, id: c_int) -> c
         }
     }
     if !sd.is_null() {
-        sl_doscript_blargs(
-            c"hitCritChance".as_ptr(),
-            std::ptr::null(),
-            2,
-            &raw mut (*mob).bl,
-            &raw mut (*sd).bl,
+        crate::game::scripting::sl_doscript_handle(
+            HIT_CRIT_CHANCE.get(),
+            &[&raw mut (*mob).bl as *mut libc::c_void, &raw mut (*sd).bl as *mut libc::c_void],
         );
     } else if !tmob.is_null() {
-        sl_doscript_blargs(
-            c"hitCritChance".as_ptr(),
-            std::ptr::null(),
-            2,
-            &raw mut (*mob).bl,
-            &raw mut (*tmob).bl,
+        crate::game::scripting::sl_doscript_handle(
+            HIT_CRIT_CHANCE.get(),
+            &[&raw mut (*mob).bl as *mut libc::c_void, &raw mut (*tmob).bl as *mut libc::c_void],
         );
     }
     if (*mob).critchance != 0 {
         if !sd.is_null() {
-            sl_doscript_blargs(
-                c"swingDamage".as_ptr(),
-                std::ptr::null(),
-                2,
-                &raw mut (*mob).bl,
-                &raw mut (*sd).bl,
+            crate::game::scripting::sl_doscript_handle(
+                SWING_DAMAGE.get(),
+                &[&raw mut (*mob).bl as *mut libc::c_void, &raw mut (*sd).bl as *mut libc::c_void],
             );
             for x in 0..MAX_MAGIC_TIMERS {
                 if (*mob).da[x].id > 0 && (*mob).da[x].duration > 0 {
@@ -2185,12 +2348,9 @@ pub unsafe extern "C" fn rust_mob_attack(mob: *mut MobSpawnData, id: c_int) -> c
                 }
             }
         } else if !tmob.is_null() {
-            sl_doscript_blargs(
-                c"swingDamage".as_ptr(),
-                std::ptr::null(),
-                2,
-                &raw mut (*mob).bl,
-                &raw mut (*tmob).bl,
+            crate::game::scripting::sl_doscript_handle(
+                SWING_DAMAGE.get(),
+                &[&raw mut (*mob).bl as *mut libc::c_void, &raw mut (*tmob).bl as *mut libc::c_void],
             );
             for x in 0..MAX_MAGIC_TIMERS {
                 if (*mob).da[x].id > 0 && (*mob).da[x].duration > 0 {
@@ -2328,7 +2488,7 @@ pub unsafe fn mobspawn_onetime(
         return std::ptr::null_mut();
     }
     for z in 0..times {
-        let db = libc::calloc(1, std::mem::size_of::<MobSpawnData>()) as *mut MobSpawnData;
+        let db = ers_pool_alloc(std::mem::size_of::<MobSpawnData>()) as *mut MobSpawnData;
         if db.is_null() {
             continue;
         }
@@ -2356,7 +2516,7 @@ pub unsafe fn mobspawn_onetime(
         let new_id = mob_get_free_id();
         if new_id == 0 {
             eprintln!("[mob] mobspawn_onetime: no free onetime ID, skipping spawn");
-            libc::free(db as *mut libc::c_void);
+            ers_pool_free(db as *mut libc::c_void, std::mem::size_of::<MobSpawnData>());
             continue;
         }
         (*db).bl.id = new_id;
@@ -2382,7 +2542,7 @@ mod tests {
 
     #[test]
     fn mob_spawn_data_size() {
-        const EXPECTED: usize = 61120;
+        const EXPECTED: usize = 11976;
         assert_eq!(
             size_of::<MobSpawnData>(),
             EXPECTED,
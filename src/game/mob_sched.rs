@@ -0,0 +1,262 @@
+//! Active-set scheduler for the 50 ms mob tick.
+//!
+//! Every mob registered in id_db (map_addiddb/map_deliddb) lives in exactly
+//! one place: the dense `awake` array walked by `mob_timer_spawns`, a sleep
+//! list for its (player-less) map, or the dormant list for mobs whose tick
+//! is a no-op regardless of players. A map's sleepers are woken as soon as
+//! it has users again, and any script access to a mob wakes it, so the
+//! tick never looks up ids or visits mobs that have nothing to do.
+//!
+//! Awake mobs are still visited on every tick. Per-mob next-wakeup times are
+//! deferred: `mob_handle_sub` advances each mob's `time_` by 50 ms per tick,
+//! and scripts change `newmove`, targets and durations at any point, so
+//! there is no due time to schedule on without moving that state here first.
+//! The duration passes stay on the shared `TIMERCHECK` cadence for now.
+//!
+//! Entries are block_list addresses; this module never dereferences them.
+
+use std::collections::HashMap;
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+/// Why a mob was taken off the awake array.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Sleep {
+    /// Nothing to do until its map has users again.
+    EmptyMap(u16),
+    /// Nothing to do until a script touches it.
+    Dormant,
+}
+
+#[derive(Debug, Clone, Copy)]
+pub struct Awake {
+    pub addr: usize,
+    /// May have active magic durations; cleared by the 1 s duration pass
+    /// when none are left so the 250/500/1500 ms passes can be skipped.
+    pub dura: bool,
+}
+
+#[derive(Debug, Clone, Copy)]
+enum Place {
+    Awake(usize),
+    Map(u16, usize),
+    Dormant(usize),
+}
+
+#[derive(Default)]
+pub struct MobScheduler {
+    awake: Vec<Awake>,
+    by_map: HashMap<u16, Vec<usize>>,
+    dormant: Vec<usize>,
+    place: HashMap<usize, Place>,
+}
+
+impl MobScheduler {
+    /// Register a mob; new mobs start awake.
+    pub fn add(&mut self, addr: usize) {
+        if self.place.contains_key(&addr) {
+            return;
+        }
+        self.push_awake(addr, true);
+    }
+
+    pub fn remove(&mut self, addr: usize) {
+        if let Some(place) = self.place.remove(&addr) {
+            self.unlink(place);
+        }
+    }
+
+    /// Move a sleeping mob back onto the awake array and flag it for a
+    /// duration check. Returns false if `addr` is not registered.
+    pub fn wake(&mut self, addr: usize) -> bool {
+        match self.place.get(&addr).copied() {
+            None => false,
+            Some(Place::Awake(i)) => {
+                self.awake[i].dura = true;
+                true
+            }
+            Some(place) => {
+                self.unlink(place);
+                self.push_awake(addr, true);
+                true
+            }
+        }
+    }
+
+    /// Wake every mob sleeping on map `m`; returns how many woke.
+    pub fn wake_map(&mut self, m: u16) -> usize {
+        let Some(list) = self.by_map.remove(&m) else { return 0 };
+        for &addr in &list {
+            self.push_awake(addr, true);
+        }
+        list.len()
+    }
+
+    /// Maps that currently have sleeping mobs.
+    pub fn sleeping_maps(&self) -> Vec<u16> {
+        self.by_map.keys().copied().collect()
+    }
+
+    /// Every sleeping or dormant mob.
+    pub fn sleepers(&self) -> Vec<usize> {
+        self.by_map.values().flatten().chain(&self.dormant).copied().collect()
+    }
+
+    #[inline]
+    pub fn awake_at(&self, i: usize) -> Option<Awake> {
+        self.awake.get(i).copied()
+    }
+
+    pub fn set_dura(&mut self, i: usize, dura: bool) {
+        if let Some(entry) = self.awake.get_mut(i) {
+            entry.dura = dura;
+        }
+    }
+
+    /// Take `awake[i]` off the awake array. The last awake entry moves into
+    /// slot `i`, so the caller should revisit `i`.
+    pub fn sleep(&mut self, i: usize, why: Sleep) {
+        let Some(entry) = self.awake.get(i).copied() else { return };
+        self.unlink(Place::Awake(i));
+        let place = match why {
+            Sleep::EmptyMap(m) => {
+                let list = self.by_map.entry(m).or_default();
+                list.push(entry.addr);
+                Place::Map(m, list.len() - 1)
+            }
+            Sleep::Dormant => {
+                self.dormant.push(entry.addr);
+                Place::Dormant(self.dormant.len() - 1)
+            }
+        };
+        self.place.insert(entry.addr, place);
+    }
+
+    pub fn awake_len(&self) -> usize {
+        self.awake.len()
+    }
+
+    pub fn len(&self) -> usize {
+        self.place.len()
+    }
+
+    fn push_awake(&mut self, addr: usize, dura: bool) {
+        self.place.insert(addr, Place::Awake(self.awake.len()));
+        self.awake.push(Awake { addr, dura });
+    }
+
+    /// Swap-remove the entry at `place`, fixing up the entry that moved.
+    /// Leaves `self.place` for the removed address untouched.
+    fn unlink(&mut self, place: Place) {
+        match place {
+            Place::Awake(i) => {
+                self.awake.swap_remove(i);
+                if let Some(moved) = self.awake.get(i) {
+                    self.place.insert(moved.addr, Place::Awake(i));
+                }
+            }
+            Place::Map(m, i) => {
+                let Some(list) = self.by_map.get_mut(&m) else { return };
+                list.swap_remove(i);
+                if let Some(&moved) = list.get(i) {
+                    self.place.insert(moved, Place::Map(m, i));
+                }
+                if list.is_empty() {
+                    self.by_map.remove(&m);
+                }
+            }
+            Place::Dormant(i) => {
+                self.dormant.swap_remove(i);
+                if let Some(&moved) = self.dormant.get(i) {
+                    self.place.insert(moved, Place::Dormant(i));
+                }
+            }
+        }
+    }
+}
+
+static SCHED: OnceLock<Mutex<MobScheduler>> = OnceLock::new();
+
+/// The shared scheduler. Never hold the guard across a mob tick or a
+/// script call: both can register, remove or wake mobs.
+pub fn sched() -> MutexGuard<'static, MobScheduler> {
+    SCHED
+        .get_or_init(|| Mutex::new(MobScheduler::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// Wake a mob if it is asleep (script access, warp, kill).
+pub fn touch(addr: usize) {
+    sched().wake(addr);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn awake_addrs(s: &MobScheduler) -> Vec<usize> {
+        let mut v: Vec<usize> = (0..s.awake_len()).map(|i| s.awake_at(i).unwrap().addr).collect();
+        v.sort();
+        v
+    }
+
+    #[test]
+    fn test_sleep_and_wake_map() {
+        let mut s = MobScheduler::default();
+        for addr in [10, 20, 30, 40] {
+            s.add(addr);
+        }
+        // 10 sleeps on map 1; 40 moves into slot 0
+        s.sleep(0, Sleep::EmptyMap(1));
+        assert_eq!(s.awake_at(0).unwrap().addr, 40);
+        s.sleep(0, Sleep::EmptyMap(1));
+        s.sleep(0, Sleep::Dormant);
+        assert_eq!(awake_addrs(&s), vec![20]);
+        assert_eq!(s.sleeping_maps(), vec![1]);
+
+        assert_eq!(s.wake_map(1), 2);
+        assert_eq!(awake_addrs(&s), vec![10, 20, 40]);
+        assert!(s.sleeping_maps().is_empty());
+        assert_eq!(s.sleepers(), vec![30]);
+        assert_eq!(s.len(), 4);
+    }
+
+    #[test]
+    fn test_wake_and_remove_fix_up_positions() {
+        let mut s = MobScheduler::default();
+        for addr in 1..=5 {
+            s.add(addr);
+        }
+        for _ in 0..3 {
+            s.sleep(0, Sleep::EmptyMap(7));
+        }
+        let asleep = s.sleepers();
+        assert_eq!(asleep.len(), 3);
+
+        // Waking from the middle of a sleep list must keep the others findable
+        assert!(s.wake(asleep[1]));
+        s.remove(asleep[0]);
+        assert!(s.wake(asleep[2]));
+        assert!(s.sleeping_maps().is_empty());
+        assert!(!s.wake(asleep[0]));
+
+        s.remove(s.awake_at(0).unwrap().addr);
+        assert_eq!(s.awake_len(), 3);
+        for i in 0..s.awake_len() {
+            let addr = s.awake_at(i).unwrap().addr;
+            s.remove(addr);
+            s.add(addr);
+        }
+        assert_eq!(s.len(), 3);
+    }
+
+    #[test]
+    fn test_wake_flags_durations() {
+        let mut s = MobScheduler::default();
+        s.add(1);
+        s.set_dura(0, false);
+        assert!(!s.awake_at(0).unwrap().dura);
+        assert!(s.wake(1));
+        assert!(s.awake_at(0).unwrap().dura);
+    }
+}
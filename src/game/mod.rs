@@ -1,7 +1,22 @@
+pub mod aoi;
+pub mod autosave;
+pub mod block_query;
+pub mod cold;
+pub mod item_sweep;
+pub mod map_cost;
+pub mod metrics;
 pub mod mob;
+pub mod mob_sched;
+pub mod move_bundle;
 pub mod npc;
+pub mod npc_sched;
+pub mod reg_index;
 #[cfg(feature = "map-game")]
 pub mod gm_command;
+#[cfg(all(feature = "map-game", not(test)))]
+pub mod handoff;
+#[cfg(feature = "map-game")]
+pub mod mem_report;
 #[cfg(feature = "map-game")]
 pub mod pc;
 pub mod scripting;
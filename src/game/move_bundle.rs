@@ -0,0 +1,195 @@
+//! Per-client bundling of entity move packets within a tick.
+//!
+//! clif_mob_move and clif_npc_move queue a `Move` for each observing client
+//! instead of writing a 0x0C packet straight away. A second move of the same
+//! entity to the same client replaces the first in place: the packet carries
+//! the absolute origin and facing, so only the latest one matters. The queue
+//! is written out by clif_flush_moves at the end of each timer tick, before
+//! the coalesced socket flush. Any other packet written to a client first
+//! writes out that client's queued moves (session::set_before_write), so
+//! the client sees everything in the order it happened; a clif_lookgone
+//! never overtakes a pending move.
+//!
+//! Queue entries carry the observer's block id; the flush skips a client
+//! whose fd now belongs to someone else.
+
+use std::collections::{HashMap, VecDeque};
+use std::sync::atomic::AtomicUsize;
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+/// `struct pending_move` in map_server.h.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Move {
+    pub id: u32,
+    pub x: u16,
+    pub y: u16,
+    pub side: u8,
+}
+
+#[derive(Debug, Default)]
+struct ClientMoves {
+    owner: u32,
+    moves: Vec<Move>,
+    /// Entity id -> index in `moves`
+    slot: HashMap<u32, usize>,
+}
+
+#[derive(Debug, Default)]
+pub struct MoveBundles {
+    clients: HashMap<i32, ClientMoves>,
+    /// fds with queued moves, in first-queued order
+    order: VecDeque<i32>,
+    pending: usize,
+}
+
+impl MoveBundles {
+    /// Queue `mv` for the client on `fd` (player `owner`). Returns false if
+    /// it replaced an earlier move of the same entity.
+    pub fn push(&mut self, fd: i32, owner: u32, mv: Move) -> bool {
+        let client = self.clients.entry(fd).or_default();
+        if client.moves.is_empty() {
+            self.order.push_back(fd);
+        } else if client.owner != owner {
+            // The fd changed hands since the last flush; drop the stale moves
+            self.pending -= client.moves.len();
+            client.moves.clear();
+            client.slot.clear();
+        }
+        client.owner = owner;
+        if let Some(&i) = client.slot.get(&mv.id) {
+            client.moves[i] = mv;
+            return false;
+        }
+        client.slot.insert(mv.id, client.moves.len());
+        client.moves.push(mv);
+        self.pending += 1;
+        true
+    }
+
+    /// Move up to `cap` queued moves of the next client into `out`. Returns
+    /// the client's (fd, owner), or None when nothing is queued. A client
+    /// with more than `cap` moves stays at the front.
+    pub fn take(&mut self, cap: usize, out: &mut Vec<Move>) -> Option<(i32, u32)> {
+        while let Some(&fd) = self.order.front() {
+            let Some(owner) = self.take_fd(fd, cap, out) else {
+                self.order.pop_front();
+                continue;
+            };
+            if self.clients.get(&fd).is_none_or(|c| c.moves.is_empty()) {
+                self.order.pop_front();
+            }
+            return Some((fd, owner));
+        }
+        None
+    }
+
+    /// Move up to `cap` queued moves of the client on `fd` into `out`.
+    /// Returns its owner, or None when it has nothing queued. Its place in
+    /// the flush order is dropped once `take` reaches it empty.
+    pub fn take_fd(&mut self, fd: i32, cap: usize, out: &mut Vec<Move>) -> Option<u32> {
+        let client = self.clients.get_mut(&fd)?;
+        if client.moves.is_empty() {
+            return None;
+        }
+        let n = client.moves.len().min(cap);
+        out.extend(client.moves.drain(..n));
+        self.pending -= n;
+        if client.moves.is_empty() {
+            client.slot.clear();
+        } else {
+            for (i, mv) in client.moves.iter().enumerate() {
+                client.slot.insert(mv.id, i);
+            }
+        }
+        Some(client.owner)
+    }
+
+    pub fn pending(&self) -> usize {
+        self.pending
+    }
+}
+
+static BUNDLES: OnceLock<Mutex<MoveBundles>> = OnceLock::new();
+
+/// `pending()` of the shared queue as of its last change, so the check
+/// ahead of every packet write needs no lock.
+pub static QUEUED: AtomicUsize = AtomicUsize::new(0);
+
+/// The shared queue. Never hold the guard across a packet write.
+pub fn bundles() -> MutexGuard<'static, MoveBundles> {
+    BUNDLES
+        .get_or_init(|| Mutex::new(MoveBundles::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn mv(id: u32, x: u16) -> Move {
+        Move { id, x, y: 0, side: 0 }
+    }
+
+    #[test]
+    fn test_superseded_moves_collapse_in_place() {
+        let mut b = MoveBundles::default();
+        assert!(b.push(5, 100, mv(1, 10)));
+        assert!(b.push(5, 100, mv(2, 20)));
+        assert!(!b.push(5, 100, mv(1, 11)));
+        assert!(b.push(6, 101, mv(1, 11)));
+        assert_eq!(b.pending(), 3);
+
+        let mut out = Vec::new();
+        assert_eq!(b.take(64, &mut out), Some((5, 100)));
+        assert_eq!(out, vec![mv(1, 11), mv(2, 20)]);
+        out.clear();
+        assert_eq!(b.take(64, &mut out), Some((6, 101)));
+        assert_eq!(b.take(64, &mut out), None);
+        assert_eq!(b.pending(), 0);
+    }
+
+    #[test]
+    fn test_take_in_chunks_and_fd_reuse() {
+        let mut b = MoveBundles::default();
+        for id in 0..5 {
+            b.push(3, 7, mv(id, 0));
+        }
+        let mut out = Vec::new();
+        assert_eq!(b.take(2, &mut out), Some((3, 7)));
+        // Collapsing still finds the entries left after a partial take
+        assert!(!b.push(3, 7, mv(4, 9)));
+        assert_eq!(b.take(8, &mut out), Some((3, 7)));
+        assert_eq!(out.len(), 5);
+        assert_eq!(out[4], mv(4, 9));
+
+        // fd 3 handed to another player before its moves were flushed
+        b.push(3, 7, mv(1, 0));
+        b.push(3, 8, mv(2, 0));
+        out.clear();
+        assert_eq!(b.take(8, &mut out), Some((3, 8)));
+        assert_eq!(out, vec![mv(2, 0)]);
+        assert_eq!(b.pending(), 0);
+    }
+
+    #[test]
+    fn test_take_fd_ahead_of_the_flush() {
+        let mut b = MoveBundles::default();
+        b.push(3, 7, mv(1, 0));
+        b.push(4, 8, mv(2, 0));
+        let mut out = Vec::new();
+        // fd 4 gets another packet: its moves go out first, out of turn
+        assert_eq!(b.take_fd(4, 8, &mut out), Some(8));
+        assert_eq!(out, vec![mv(2, 0)]);
+        assert_eq!(b.take_fd(4, 8, &mut out), None);
+        // Queued again after that: one move, not a duplicate flush
+        b.push(4, 8, mv(5, 0));
+        out.clear();
+        assert_eq!(b.take(8, &mut out), Some((3, 7)));
+        assert_eq!(b.take(8, &mut out), Some((4, 8)));
+        assert_eq!(out, vec![mv(1, 0), mv(5, 0)]);
+        assert_eq!(b.take(8, &mut out), None);
+        assert_eq!(b.pending(), 0);
+    }
+}
@@ -5,6 +5,8 @@
 use std::ffi::{c_char, c_int, c_uint, c_uchar, c_ushort};
 use crate::database::map_db::{BlockList, GlobalReg};
 use crate::servers::char::charstatus::{Item, MAX_EQUIP};
+use crate::game::map_cost;
+use crate::game::npc_sched;
 use crate::game::types::GfxViewer;
 
 #[cfg(not(test))]
@@ -503,56 +505,111 @@ pub unsafe fn npc_duration(nd: *mut NpcData) -> c_int {
 
 /// Timer callback fired every 100 ms by the map-server timer wheel.
 ///
-/// Iterates all regular NPCs (IDs `NPC_START_NUM..=NPC_ID`) and all temp NPCs
-/// (`NPCT_START_NUM..=NPCTEMP_ID`).  For each non-null NPC it dispatches
-/// `npc_action`, `npc_movetime`, and `npc_duration` as appropriate based on
-/// their configured intervals.
+/// Steps only the NPCs that `npc_sched` has due this pass, in id order, and
+/// dispatches `npc_action`, `npc_movetime`, and `npc_duration` as
+/// appropriate based on their configured intervals. Counters of NPCs that
+/// sat out earlier passes are caught up first (see `npc_sched`).
 ///
 /// Mirrors `npc_runtimers` in `c_src/npc.c`.
 ///
 /// # Safety
 ///
-/// Caller must hold the server-wide lock.  `map_id2npc` must be safe to call
-/// for any ID in the scanned ranges.
+/// Caller must hold the server-wide lock.
 pub unsafe fn npc_runtimers(_id: c_int, _n: c_int) -> c_int {
-    // regular NPCs
-    let mut x = NPC_START_NUM;
-    while x <= NPC_ID {
-        let nd = map_id2npc(x);
-        if !nd.is_null() {
-            if (*nd).actiontime > 0 {
-                npc_action(nd);
-            }
-            if (*nd).movetime > 0 {
-                npc_movetime(nd);
-            }
-            if (*nd).duration > 0 {
-                npc_duration(nd);
-            }
+    npc_sched::sched().begin_pass();
+    loop {
+        let Some((id, owed)) = npc_sched::sched().pop_due() else { break };
+        let nd = map_id2npc(id);
+        if nd.is_null() {
+            npc_sched::sched().remove(id);
+            continue;
         }
-        x += 1;
-    }
+        npc_timers_catch_up(nd, owed);
+        let _cost = map_cost::scope((*nd).bl.m, map_cost::Kind::Npc);
 
-    // temp NPCs
-    let mut x = NPCT_START_NUM;
-    while x <= NPCTEMP_ID {
-        let nd = map_id2npc(x);
-        if !nd.is_null() {
-            if (*nd).actiontime > 0 {
-                npc_action(nd);
-            }
-            if (*nd).movetime > 0 {
-                npc_movetime(nd);
-            }
-            if (*nd).duration > 0 {
-                npc_duration(nd);
-            }
+        // Each event may delete the NPC; stop as soon as it is gone.
+        if (*nd).actiontime > 0 {
+            npc_action(nd);
+        }
+        if map_id2npc(id) == nd && (*nd).movetime > 0 {
+            npc_movetime(nd);
+        }
+        if map_id2npc(id) == nd && (*nd).duration > 0 {
+            npc_duration(nd);
+        }
+        if map_id2npc(id) == nd {
+            npc_timers_schedule(nd);
         }
-        x += 1;
     }
     0
 }
 
+/// Add `passes` skipped 100 ms steps to each running counter of `nd`.
+unsafe fn npc_timers_catch_up(nd: *mut NpcData, passes: u64) {
+    if passes == 0 {
+        return;
+    }
+    let ms = (passes as c_uint).wrapping_mul(npc_sched::STEP_MS);
+    let nd = &mut *nd;
+    if nd.actiontime > 0 {
+        nd.time = nd.time.wrapping_add(ms);
+    }
+    if nd.movetime > 0 {
+        nd.movetimer = nd.movetimer.wrapping_add(ms);
+    }
+    if nd.duration > 0 {
+        nd.duratime = nd.duratime.wrapping_add(ms);
+    }
+}
+
+/// (Re)queue `nd` for the pass its earliest timer fires on, or drop it from
+/// the queue if none is running. The F1 NPC never ran timers and stays out.
+pub unsafe fn npc_timers_schedule(nd: *mut NpcData) {
+    let nd = &*nd;
+    if nd.bl.id < NPC_START_NUM || nd.bl.id == F1_NPC {
+        return;
+    }
+    let due = [
+        npc_sched::passes_until(nd.actiontime, nd.time),
+        npc_sched::passes_until(nd.movetime, nd.movetimer),
+        npc_sched::passes_until(nd.duration, nd.duratime),
+    ]
+    .into_iter()
+    .flatten()
+    .min();
+    npc_sched::sched().schedule(nd.bl.id, due);
+}
+
+/// Change `nd`'s timer intervals through `f` and reschedule it. Every write
+/// to `actiontime`, `movetime` or `duration` after the NPC is in id_db
+/// must go through here so its counters stay in step.
+pub unsafe fn npc_timers_update(nd: *mut NpcData, f: impl FnOnce(&mut NpcData)) {
+    if map_id2npc((*nd).bl.id) != nd {
+        f(&mut *nd);
+        return;
+    }
+    let owed = npc_sched::sched().advance((*nd).bl.id);
+    npc_timers_catch_up(nd, owed);
+    f(&mut *nd);
+    npc_timers_schedule(nd);
+}
+
+/// Drop `nd` from the timer queue as it leaves id_db, catching its counters
+/// up first so a reload that re-adds it keeps its place in each interval.
+pub unsafe fn npc_timers_remove(nd: *mut NpcData) {
+    let id = (*nd).bl.id;
+    if map_id2npc(id) != nd {
+        return;
+    }
+    let owed = {
+        let mut q = npc_sched::sched();
+        let owed = q.advance(id);
+        q.remove(id);
+        owed
+    };
+    npc_timers_catch_up(nd, owed);
+}
+
 // ---------------------------------------------------------------------------
 // npc_src_* — no-ops: the file-based NPC loader was replaced by SQL and is
 // fully commented out in the C source.  These stubs exist only for ABI
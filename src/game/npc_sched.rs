@@ -0,0 +1,215 @@
+//! Due-pass queue for the 100 ms NPC timer pass.
+//!
+//! Only NPCs with a non-zero `actiontime`, `movetime` or `duration` are
+//! queued, keyed by the pass on which their next timer fires. Their
+//! `time`/`movetimer`/`duratime` counters are brought up to date lazily:
+//! an entry records the last pass its counters reflect, and the owner adds
+//! the skipped passes (`STEP_MS` each) back before stepping a due NPC or
+//! changing its intervals. No timer can fire during a skipped pass, so the
+//! counters end up exactly where the per-pass scan would have left them.
+//!
+//! Entries are keyed by block id; this module never dereferences NPCs.
+
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap};
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+/// Milliseconds each pass adds to an active counter.
+pub const STEP_MS: u32 = 100;
+
+#[derive(Debug, Clone, Copy)]
+struct Entry {
+    /// Last pass the NPC's counters account for
+    synced: u64,
+    /// Pass on which the NPC is next stepped
+    due: u64,
+}
+
+#[derive(Default)]
+pub struct NpcTimers {
+    pass: u64,
+    /// (due, id); an item is stale once its entry's `due` has moved on
+    heap: BinaryHeap<Reverse<(u64, u32)>>,
+    entries: HashMap<u32, Entry>,
+}
+
+impl NpcTimers {
+    /// Start the next pass and return its number.
+    pub fn begin_pass(&mut self) -> u64 {
+        self.pass += 1;
+        self.pass
+    }
+
+    /// Pop the next NPC due this pass, lowest id first. Returns the id and
+    /// how many passes its counters are behind, not counting this one.
+    ///
+    /// The entry is marked as stepped for this pass, so an `advance` from a
+    /// script fired while stepping it owes nothing; the caller reschedules
+    /// (or removes) it once the step is done.
+    pub fn pop_due(&mut self) -> Option<(u32, u64)> {
+        while let Some(&Reverse((due, id))) = self.heap.peek() {
+            if due > self.pass {
+                return None;
+            }
+            self.heap.pop();
+            let Some(entry) = self.entries.get_mut(&id) else { continue };
+            if entry.due != due {
+                continue;
+            }
+            let owed = (self.pass - 1).saturating_sub(entry.synced);
+            entry.synced = self.pass;
+            entry.due = self.pass + 1;
+            return Some((id, owed));
+        }
+        None
+    }
+
+    /// Bring an NPC's bookkeeping up to now before its intervals change.
+    /// Returns the passes its counters must be advanced by. An NPC still
+    /// waiting to be stepped this pass is only caught up to the previous one.
+    pub fn advance(&mut self, id: u32) -> u64 {
+        let Some(entry) = self.entries.get_mut(&id) else { return 0 };
+        let upto = self.pass.min(entry.due - 1);
+        let owed = upto.saturating_sub(entry.synced);
+        entry.synced = upto.max(entry.synced);
+        owed
+    }
+
+    /// Queue `id` to be stepped `passes` passes after the one its counters
+    /// reflect (new NPCs: after the current pass). `None` drops it.
+    pub fn schedule(&mut self, id: u32, passes: Option<u64>) {
+        let Some(passes) = passes else {
+            self.entries.remove(&id);
+            return;
+        };
+        let pass = self.pass;
+        let entry = self.entries.entry(id).or_insert(Entry { synced: pass, due: 0 });
+        entry.due = entry.synced + passes.max(1);
+        self.heap.push(Reverse((entry.due, id)));
+    }
+
+    pub fn remove(&mut self, id: u32) {
+        self.entries.remove(&id);
+    }
+
+    pub fn contains(&self, id: u32) -> bool {
+        self.entries.contains_key(&id)
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+}
+
+/// Passes until a timer with this interval and counter fires, or None if
+/// the timer is off. Mirrors the `+= 100; if counter >= interval` step.
+pub fn passes_until(interval: u32, counter: u32) -> Option<u64> {
+    if interval == 0 {
+        return None;
+    }
+    let left = interval.saturating_sub(counter) as u64;
+    Some(left.div_ceil(STEP_MS as u64).max(1))
+}
+
+static TIMERS: OnceLock<Mutex<NpcTimers>> = OnceLock::new();
+
+/// The shared queue. Never hold the guard across a script call: scripts can
+/// spawn, delete and retime NPCs.
+pub fn sched() -> MutexGuard<'static, NpcTimers> {
+    TIMERS
+        .get_or_init(|| Mutex::new(NpcTimers::default()))
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Per-pass reference model of one timer: returns the passes it fired on.
+    fn scan(interval: u32, passes: u64) -> Vec<u64> {
+        let mut counter = 0u32;
+        let mut fired = Vec::new();
+        for pass in 1..=passes {
+            counter += STEP_MS;
+            if counter >= interval {
+                counter = 0;
+                fired.push(pass);
+            }
+        }
+        fired
+    }
+
+    #[test]
+    fn test_passes_until() {
+        assert_eq!(passes_until(0, 0), None);
+        assert_eq!(passes_until(1000, 0), Some(10));
+        assert_eq!(passes_until(1050, 0), Some(11));
+        assert_eq!(passes_until(250, 200), Some(1));
+        // Interval shortened below the counter: fires on the next pass
+        assert_eq!(passes_until(100, 900), Some(1));
+    }
+
+    #[test]
+    fn test_queue_matches_per_pass_scan() {
+        let mut q = NpcTimers::default();
+        let intervals = [(7u32, 300u32), (3, 1000), (5, 50)];
+        let mut counters = [0u32; 3];
+        let mut fired: Vec<Vec<u64>> = vec![Vec::new(); 3];
+        for (i, &(id, interval)) in intervals.iter().enumerate() {
+            q.schedule(id, passes_until(interval, counters[i]));
+        }
+        let mut visits = 0;
+        for _ in 0..60 {
+            let pass = q.begin_pass();
+            let mut order = Vec::new();
+            while let Some((id, owed)) = q.pop_due() {
+                visits += 1;
+                order.push(id);
+                let i = intervals.iter().position(|&(x, _)| x == id).unwrap();
+                counters[i] += STEP_MS * owed as u32 + STEP_MS;
+                if counters[i] >= intervals[i].1 {
+                    counters[i] = 0;
+                    fired[i].push(pass);
+                }
+                q.schedule(id, passes_until(intervals[i].1, counters[i]));
+            }
+            let mut sorted = order.clone();
+            sorted.sort();
+            assert_eq!(order, sorted);
+        }
+        for (i, &(_, interval)) in intervals.iter().enumerate() {
+            assert_eq!(fired[i], scan(interval, 60));
+        }
+        // 20 + 6 + 60 steps instead of 3 × 60
+        assert_eq!(visits, 86);
+    }
+
+    #[test]
+    fn test_advance_catches_up_between_and_during_passes() {
+        let mut q = NpcTimers::default();
+        q.schedule(1, Some(10));
+        q.schedule(2, Some(3));
+        for _ in 0..3 {
+            q.begin_pass();
+        }
+        // Between passes 3 and 4, NPC 1 has missed 3 steps
+        assert_eq!(q.advance(1), 3);
+        assert_eq!(q.advance(1), 0);
+        q.schedule(1, Some(1));
+
+        // NPC 2 is due on pass 3, which has started but not stepped it yet
+        assert_eq!(q.advance(2), 2);
+        let (id, owed) = q.pop_due().unwrap();
+        assert_eq!((id, owed), (2, 0));
+        // Re-entrant change while NPC 2 is being stepped owes nothing
+        assert_eq!(q.advance(2), 0);
+        q.schedule(2, None);
+        assert!(!q.contains(2));
+
+        q.begin_pass();
+        assert_eq!(q.pop_due(), Some((1, 0)));
+        assert_eq!(q.pop_due(), None);
+        assert_eq!(q.len(), 1);
+    }
+}
@@ -2,11 +2,14 @@
 
 #![allow(non_snake_case, dead_code, unused_variables)]
 
-use std::ffi::{c_char, c_double, c_float, c_int, c_long, c_short, c_uchar, c_uint, c_ulong, c_ushort};
+use std::ffi::{c_char, c_double, CStr, c_float, c_int, c_long, c_short, c_uchar, c_uint, c_ulong, c_ushort};
 use std::os::raw::c_void;
 
 use crate::database::map_db::BlockList;
+#[cfg(not(test))]
+use crate::ffi::ers::{ers_pool_alloc, ers_pool_free};
 // MobSpawnData is used by future porting tasks (Tasks 6+); import it when needed.
+use crate::game::reg_index;
 use crate::game::types::GfxViewer;
 use crate::servers::char::charstatus::MmoCharStatus;
 
@@ -52,9 +55,10 @@ unsafe impl Send for SdIgnoreList {}
 use crate::servers::char::charstatus::Item;
 
 /// Anonymous `exchange` sub-struct inside `map_sessiondata`.
+/// `item` holds 52 entries during an exchange and is NULL otherwise.
 #[repr(C)]
 pub struct PcExchange {
-    pub item:          [Item; 52],
+    pub item:          *mut Item,
     pub item_count:    c_int,
     pub exchange_done: c_int,
     pub list_count:    c_int,
@@ -69,9 +73,10 @@ pub struct PcState {
 }
 
 /// Anonymous `boditems` sub-struct inside `map_sessiondata`.
+/// `item` holds 52 entries during a break-on-death pass and is NULL otherwise.
 #[repr(C)]
 pub struct PcBodItems {
-    pub item:      [Item; 52],
+    pub item:      *mut Item,
     pub bod_count: c_int,
 }
 
@@ -238,6 +243,7 @@ pub struct MapSessionData {
 
     // encryption hash buffer (0x401 = 1025 bytes)
     pub EncHash:           [i8; 0x401],
+    pub EncKeys:           crate::network::crypt::CryptKeyCache,
 
     // npc
     pub npc_id:            c_int,
@@ -295,8 +301,9 @@ pub struct MapSessionData {
 
     pub question:          [i8; 64],
     pub speech:            [i8; 255],
-    pub profilepic_data:   [i8; 65535],
     pub profile_data:      [i8; 255],
+    /// 65535 bytes once a picture is uploaded, NULL before
+    pub profilepic_data:   *mut i8,
 
     pub profilepic_size:   u16,
     pub profile_size:      u8,
@@ -340,7 +347,7 @@ unsafe impl Send for MapSessionData {}
 mod layout_tests {
     use super::*;
     // Verified with: printf("%zu\n", sizeof(struct map_sessiondata))
-    const EXPECTED_SIZE: usize = 3335344;
+    const EXPECTED_SIZE: usize = 3178440;
     #[test]
     fn map_session_data_size() {
         assert_eq!(std::mem::size_of::<MapSessionData>(), EXPECTED_SIZE);
@@ -941,13 +948,15 @@ extern "C" {
 // All functions gated on #[cfg(not(test))] because they call C FFI.
 // Each function is `#[no_mangle]` so C can call it back as a timer callback.
 
-/// `int pc_item_timer(int id, int none)` — removes a floor item when its timer expires.
+/// `int pc_item_timer(int id, int gen)` — removes a floor item when its timer expires.
+/// `gen` is `map_id_gen(id)` taken when the timer was set, so an item that was
+/// picked up and whose id went to a new item is left alone.
 /// Calls `clif_lookgone` to hide it from clients, then `map_delitem` to remove it.
 #[cfg(not(test))]
 #[no_mangle]
-pub unsafe extern "C" fn rust_pc_item_timer(id: c_int, _none: c_int) -> c_int {
-    use crate::game::mob::{map_id2bl, BL_ITEM};
-    let fl = map_id2bl(id as c_uint);
+pub unsafe extern "C" fn rust_pc_item_timer(id: c_int, gen: c_int) -> c_int {
+    use crate::game::mob::map_id2bl_gen;
+    let fl = map_id2bl_gen(id as c_uint, gen as c_uint);
     if fl.is_null() { return 1; }
     clif_lookgone_pc(fl);
     map_delitem(id as c_uint);
@@ -965,6 +974,28 @@ pub unsafe extern "C" fn rust_pc_savetimer(id: c_int, _none: c_int) -> c_int {
     0
 }
 
+/// Map-wide autosave tick, every `autosave::TICK_MS`: saves the players
+/// whose slot came up, within the per-tick budget.
+#[cfg(not(test))]
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_autosave_timer(_id: c_int, _none: c_int) -> c_int {
+    use crate::game::autosave;
+    let mut due = Vec::new();
+    let stats = {
+        let mut sched = autosave::scheduler();
+        sched.tick(&mut due);
+        sched.stats()
+    };
+    for id in due {
+        rust_pc_savetimer(id as c_int, 0);
+    }
+    if stats.backlog > 0 {
+        tracing::debug!("[map] [autosave] backlog={} last_lag_ms={} max_lag_ms={}",
+            stats.backlog, stats.last_lag_ms, stats.max_lag_ms);
+    }
+    0
+}
+
 /// `int pc_castusetimer(int id, int none)` — resets `castusetimer` field to 0 each tick.
 #[cfg(not(test))]
 #[no_mangle]
@@ -1034,9 +1065,8 @@ pub unsafe extern "C" fn rust_pc_starttimer(sd: *mut MapSessionData) -> c_int {
     (*sd).pongtimer = timer_insert(30000, 30000,
         rust_pc_sendpong as unsafe extern "C" fn(c_int, c_int) -> c_int,
         (*sd).bl.id as c_int, 0);
-    (*sd).savetimer = timer_insert(60000, 60000,
-        rust_pc_savetimer as unsafe extern "C" fn(c_int, c_int) -> c_int,
-        (*sd).bl.id as c_int, 0);
+    // Saves run from rust_pc_autosave_timer; savetimer stays 0.
+    crate::game::autosave::scheduler().add((*sd).bl.id, (*sd).status.id);
     if (*sd).status.gm_level < 50 {
         (*sd).afktimer = timer_insert(10000, 10000,
             rust_pc_afktimer as unsafe extern "C" fn(c_int, c_int) -> c_int,
@@ -1076,6 +1106,7 @@ pub unsafe extern "C" fn rust_pc_stoptimer(sd: *mut MapSessionData) -> c_int {
     if (*sd).afktimer != 0      { timer_remove((*sd).afktimer);      (*sd).afktimer = 0; }
     if (*sd).duratimer != 0     { timer_remove((*sd).duratimer);     (*sd).duratimer = 0; }
     if (*sd).savetimer != 0     { timer_remove((*sd).savetimer);     (*sd).savetimer = 0; }
+    crate::game::autosave::scheduler().remove((*sd).bl.id);
     if (*sd).secondduratimer != 0 { timer_remove((*sd).secondduratimer); (*sd).secondduratimer = 0; }
     if (*sd).thirdduratimer != 0  { timer_remove((*sd).thirdduratimer);  (*sd).thirdduratimer = 0; }
     if (*sd).fourthduratimer != 0 { timer_remove((*sd).fourthduratimer); (*sd).fourthduratimer = 0; }
@@ -2297,7 +2328,8 @@ pub unsafe extern "C" fn rust_pc_setglobalregstring(
 
 /// `int pc_readglobalreg(USER *sd, const char *reg)` — reads a global integer variable.
 ///
-/// Scans `sd->status.global_reg[0..MAX_GLOBALPLAYERREG]` for a case-insensitive match.
+/// Looks `reg` up in the hash index over `sd->status.global_reg` (`reg_index`);
+/// only the first MAX_GLOBALPLAYERREG slots are visible, as in the old scan.
 /// Returns the integer value or 0. Translated from `pc.c:2572`.
 #[cfg(not(test))]
 #[no_mangle]
@@ -2305,19 +2337,23 @@ pub unsafe extern "C" fn rust_pc_readglobalreg(
     sd: *mut MapSessionData, reg: *const i8,
 ) -> c_int {
     if sd.is_null() || reg.is_null() { return 0; }
+    rust_pc_readglobalreg_id(sd, reg_index::intern(CStr::from_ptr(reg)) as c_int)
+}
+
+/// `int pc_readglobalreg_id(USER *sd, int id)` — `pc_readglobalreg` for a name
+/// already interned with `rust_reg_intern`.
+#[cfg(not(test))]
+#[no_mangle]
+pub unsafe extern "C" fn rust_pc_readglobalreg_id(sd: *mut MapSessionData, id: c_int) -> c_int {
+    if sd.is_null() || id <= 0 { return 0; }
     let sd = &*sd;
-    for i in 0..MAX_GLOBALPLAYERREG {
-        if libc::strcasecmp(sd.status.global_reg[i].str.as_ptr(), reg) == 0 {
-            return sd.status.global_reg[i].val;
-        }
-    }
-    0
+    reg_index::read(sd as *const _ as usize, &sd.status.global_reg, MAX_GLOBALPLAYERREG, id as u32)
 }
 
 /// `int pc_setglobalreg(USER *sd, const char *reg, unsigned long val)` — sets a global integer variable.
 ///
-/// Finds an existing slot by case-insensitive key match (scanning all MAX_GLOBALREG slots),
-/// or claims the first empty slot. Setting val to 0 also clears the key string.
+/// Updates the slot holding `reg` (anywhere in the MAX_GLOBALREG slots), or claims
+/// the first empty slot. Setting val to 0 also clears the key string.
 /// Translated from `pc.c:2594`.
 #[cfg(not(test))]
 #[no_mangle]
@@ -2326,31 +2362,10 @@ pub unsafe extern "C" fn rust_pc_setglobalreg(
 ) -> c_int {
     if sd.is_null() || reg.is_null() { return 0; }
     let sd = &mut *sd;
-    // Find existing slot (scan full array)
-    let mut exist: c_int = -1;
-    for i in 0..MAX_GLOBALREG {
-        if libc::strcasecmp(sd.status.global_reg[i].str.as_ptr(), reg) == 0 {
-            exist = i as c_int;
-            break;
-        }
-    }
-    if exist != -1 {
-        let idx = exist as usize;
-        if val == 0 {
-            libc::strcpy(sd.status.global_reg[idx].str.as_mut_ptr() as *mut libc::c_char, c"".as_ptr());
-        }
-        sd.status.global_reg[idx].val = val as i32;
+    let owner = sd as *const _ as usize;
+    if reg_index::set(owner, &mut sd.status.global_reg, CStr::from_ptr(reg), val as i32) {
         return 0;
     }
-    // Find empty slot (scan full MAX_GLOBALREG array, matching C behavior)
-    for i in 0..MAX_GLOBALREG {
-        if libc::strcasecmp(sd.status.global_reg[i].str.as_ptr(), c"".as_ptr()) == 0 {
-            libc::strcpy(sd.status.global_reg[i].str.as_mut_ptr() as *mut libc::c_char,
-                         reg as *const libc::c_char);
-            sd.status.global_reg[i].val = val as i32;
-            return 0;
-        }
-    }
     libc::printf(c"pc_setglobalreg : couldn't set %s\n".as_ptr(), reg);
     1
 }
@@ -2768,7 +2783,7 @@ pub unsafe extern "C" fn rust_pc_isinvenitemspace(
 unsafe fn pc_dropitemfull_inner(sd: *mut MapSessionData, fl2: *const Item) -> c_int {
     use std::mem;
 
-    let fl = libc::calloc(1, mem::size_of::<FloorItemData>()) as *mut FloorItemData;
+    let fl = ers_pool_alloc(mem::size_of::<FloorItemData>()) as *mut FloorItemData;
     if fl.is_null() { return 0; }
 
     (*fl).bl.m = (*sd).bl.m;
@@ -2815,7 +2830,7 @@ unsafe fn pc_dropitemfull_inner(sd: *mut MapSessionData, fl2: *const Item) -> c_
             &mut (*fl).bl as *mut BlockList,
         );
     } else {
-        libc::free(fl as *mut libc::c_void);
+        ers_pool_free(fl as *mut libc::c_void, std::mem::size_of::<FloorItemData>());
     }
     0
 }
@@ -3248,7 +3263,7 @@ pub unsafe extern "C" fn rust_pc_dropitemmap(
 
     let mut def = [0i32; 2];
 
-    let fl = libc::calloc(1, std::mem::size_of::<FloorItemData>()) as *mut FloorItemData;
+    let fl = ers_pool_alloc(std::mem::size_of::<FloorItemData>()) as *mut FloorItemData;
     if fl.is_null() { return 0; }
 
     (*fl).bl.m = (*sd).bl.m;
@@ -3327,7 +3342,7 @@ pub unsafe extern "C" fn rust_pc_dropitemmap(
             &mut (*fl).bl as *mut BlockList,
         );
     } else {
-        libc::free(fl as *mut libc::c_void);
+        ers_pool_free(fl as *mut libc::c_void, std::mem::size_of::<FloorItemData>());
     }
     0
 }
@@ -0,0 +1,331 @@
+//! Hash indexes over the fixed `global_reg` arrays of players and mobs.
+//!
+//! `pc_readglobalreg` used to strcasecmp its way through 500 slots of
+//! `status.global_reg` (and `pc_setglobalreg` through 5000), and
+//! clif_send_sub does that for every recipient of every channel message.
+//! Registry names are now interned to integer ids, and each registry array
+//! gets a small open-addressing table from id to slot, built from the array
+//! the first time it is used. Reads and writes become a hash probe. The
+//! arrays themselves are unchanged: they are what gets saved and sent to
+//! the char server.
+//!
+//! An index is only valid while every write to its array goes through
+//! `set`. Indexes are keyed by the owner's block_list address and dropped
+//! whenever the owner enters or leaves id_db, which covers the status being
+//! loaded at login and the memory being reused after logout or mob free.
+
+use std::collections::HashMap;
+use std::ffi::{c_char, CStr};
+use std::sync::{Mutex, MutexGuard, OnceLock};
+
+use crate::database::map_db;
+use crate::servers::char::charstatus;
+
+/// Bytes of a `global_reg.str` name, excluding the terminator.
+const NAME_MAX: usize = 63;
+
+/// Case-insensitive registry name -> id. Ids start at 1; 0 is never issued.
+#[derive(Default)]
+pub struct Interner {
+    ids: HashMap<Vec<u8>, u32>,
+}
+
+impl Interner {
+    pub fn intern(&mut self, name: &[u8]) -> u32 {
+        let key: Vec<u8> = name[..name.len().min(NAME_MAX)].to_ascii_lowercase();
+        let next = self.ids.len() as u32 + 1;
+        *self.ids.entry(key).or_insert(next)
+    }
+}
+
+const EMPTY: u32 = 0;
+
+/// Open-addressing map from name id to slot, linear probing with
+/// backward-shift deletion (no tombstones).
+#[derive(Default)]
+pub struct SlotTable {
+    /// (name id, slot); `EMPTY` id marks a free bucket
+    buckets: Vec<(u32, u16)>,
+    len: usize,
+}
+
+impl SlotTable {
+    fn home(&self, id: u32) -> usize {
+        (id.wrapping_mul(0x9E37_79B1) as usize) & (self.buckets.len() - 1)
+    }
+
+    pub fn get(&self, id: u32) -> Option<usize> {
+        if self.buckets.is_empty() {
+            return None;
+        }
+        let mask = self.buckets.len() - 1;
+        let mut i = self.home(id);
+        loop {
+            match self.buckets[i] {
+                (EMPTY, _) => return None,
+                (k, slot) if k == id => return Some(slot as usize),
+                _ => i = (i + 1) & mask,
+            }
+        }
+    }
+
+    pub fn insert(&mut self, id: u32, slot: usize) {
+        if (self.len + 1) * 4 > self.buckets.len() * 3 {
+            self.grow();
+        }
+        let mask = self.buckets.len() - 1;
+        let mut i = self.home(id);
+        loop {
+            match self.buckets[i] {
+                (EMPTY, _) => {
+                    self.buckets[i] = (id, slot as u16);
+                    self.len += 1;
+                    return;
+                }
+                (k, _) if k == id => {
+                    self.buckets[i].1 = slot as u16;
+                    return;
+                }
+                _ => i = (i + 1) & mask,
+            }
+        }
+    }
+
+    pub fn remove(&mut self, id: u32) {
+        if self.buckets.is_empty() {
+            return;
+        }
+        let mask = self.buckets.len() - 1;
+        let mut i = self.home(id);
+        loop {
+            match self.buckets[i].0 {
+                EMPTY => return,
+                k if k == id => break,
+                _ => i = (i + 1) & mask,
+            }
+        }
+        self.len -= 1;
+        // Pull later members of the probe run back over the hole
+        let mut hole = i;
+        let mut j = (i + 1) & mask;
+        while self.buckets[j].0 != EMPTY {
+            let home = self.home(self.buckets[j].0);
+            if (j.wrapping_sub(home) & mask) >= (j.wrapping_sub(hole) & mask) {
+                self.buckets[hole] = self.buckets[j];
+                hole = j;
+            }
+            j = (j + 1) & mask;
+        }
+        self.buckets[hole] = (EMPTY, 0);
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    fn grow(&mut self) {
+        let cap = (self.buckets.len() * 2).max(16);
+        let old = std::mem::replace(&mut self.buckets, vec![(EMPTY, 0); cap]);
+        self.len = 0;
+        for (id, slot) in old.into_iter().filter(|b| b.0 != EMPTY) {
+            self.insert(id, slot as usize);
+        }
+    }
+}
+
+/// Index of one registry array.
+#[derive(Default)]
+pub struct RegIndex {
+    /// Name id -> lowest slot holding that name
+    slots: SlotTable,
+    /// Every slot below this one is in use
+    first_free: usize,
+    /// Some name occupies more than one slot (only possible in loaded data)
+    dups: bool,
+}
+
+impl RegIndex {
+    /// Index `names` (one per slot, empty for a free slot).
+    pub fn build<'a>(interner: &mut Interner, names: impl Iterator<Item = &'a [u8]>) -> Self {
+        let mut idx = RegIndex { first_free: usize::MAX, ..Default::default() };
+        let mut count = 0;
+        for (slot, name) in names.enumerate() {
+            count = slot + 1;
+            if name.is_empty() {
+                idx.first_free = idx.first_free.min(slot);
+                continue;
+            }
+            let id = interner.intern(name);
+            if idx.slots.get(id).is_some() {
+                idx.dups = true;
+            } else {
+                idx.slots.insert(id, slot);
+            }
+        }
+        idx.first_free = idx.first_free.min(count);
+        idx
+    }
+
+    pub fn find(&self, id: u32) -> Option<usize> {
+        self.slots.get(id)
+    }
+}
+
+struct Indexes {
+    interner: Interner,
+    /// Owner block_list address -> index of its registry
+    by_owner: HashMap<usize, RegIndex>,
+}
+
+static INDEXES: OnceLock<Mutex<Indexes>> = OnceLock::new();
+
+fn indexes() -> MutexGuard<'static, Indexes> {
+    INDEXES
+        .get_or_init(|| {
+            Mutex::new(Indexes { interner: Interner::default(), by_owner: HashMap::new() })
+        })
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+}
+
+/// A `struct global_reg` slot; mobs and player status use separate
+/// mirrors of it.
+pub trait Reg {
+    fn key(&self) -> &[c_char; 64];
+    fn key_mut(&mut self) -> &mut [c_char; 64];
+    fn val(&self) -> i32;
+    fn val_mut(&mut self) -> &mut i32;
+}
+
+macro_rules! impl_reg {
+    ($t:ty) => {
+        impl Reg for $t {
+            fn key(&self) -> &[c_char; 64] { &self.str }
+            fn key_mut(&mut self) -> &mut [c_char; 64] { &mut self.str }
+            fn val(&self) -> i32 { self.val }
+            fn val_mut(&mut self) -> &mut i32 { &mut self.val }
+        }
+    };
+}
+impl_reg!(map_db::GlobalReg);
+impl_reg!(charstatus::GlobalReg);
+
+fn name_of<R: Reg>(reg: &R) -> &[u8] {
+    let s = unsafe { &*(reg.key() as *const [c_char; 64] as *const [u8; 64]) };
+    let n = s.iter().position(|&b| b == 0).unwrap_or(s.len());
+    &s[..n]
+}
+
+/// Interned id of registry name `reg`.
+pub fn intern(reg: &CStr) -> u32 {
+    indexes().interner.intern(reg.to_bytes())
+}
+
+/// Forget the index of `owner`'s registry.
+pub fn reset(owner: usize) {
+    indexes().by_owner.remove(&owner);
+}
+
+/// `owner`'s index, built from `regs` on first use.
+fn index_of<'a, R: Reg>(ix: &'a mut Indexes, owner: usize, regs: &[R]) -> (&'a mut RegIndex, &'a mut Interner) {
+    let Indexes { interner, by_owner } = ix;
+    let idx = by_owner
+        .entry(owner)
+        .or_insert_with(|| RegIndex::build(interner, regs.iter().map(name_of)));
+    (idx, interner)
+}
+
+/// Value of name `id` in `regs`, looking only at the first `limit` slots.
+pub fn read<R: Reg>(owner: usize, regs: &[R], limit: usize, id: u32) -> i32 {
+    let mut ix = indexes();
+    let (idx, _) = index_of(&mut ix, owner, regs);
+    match idx.find(id) {
+        Some(slot) if slot < limit => regs[slot].val(),
+        _ => 0,
+    }
+}
+
+/// Set `reg` to `val` in `regs`: update its slot, or claim the lowest free
+/// one. A value of 0 frees the slot. Returns false if `regs` is full.
+pub fn set<R: Reg>(owner: usize, regs: &mut [R], reg: &CStr, val: i32) -> bool {
+    let name = &reg.to_bytes()[..reg.to_bytes().len().min(NAME_MAX)];
+    let mut ix = indexes();
+    let (idx, interner) = index_of(&mut ix, owner, regs);
+    let id = interner.intern(name);
+
+    if let Some(slot) = idx.find(id) {
+        *regs[slot].val_mut() = val;
+        if val == 0 {
+            regs[slot].key_mut()[0] = 0;
+            idx.slots.remove(id);
+            idx.first_free = idx.first_free.min(slot);
+            if idx.dups {
+                // A later copy of the name becomes the one reads see
+                if let Some(next) = (slot + 1..regs.len())
+                    .find(|&i| name_of(&regs[i]).eq_ignore_ascii_case(name))
+                {
+                    idx.slots.insert(id, next);
+                }
+            }
+        }
+        return true;
+    }
+
+    if val == 0 {
+        // Nothing to clear; the old scan would have named a slot holding 0
+        return true;
+    }
+    let Some(slot) = (idx.first_free..regs.len()).find(|&i| regs[i].key()[0] == 0) else {
+        idx.first_free = regs.len();
+        return false;
+    };
+    let key = regs[slot].key_mut();
+    for (d, &b) in key.iter_mut().zip(name) {
+        *d = b as c_char;
+    }
+    key[name.len()] = 0;
+    *regs[slot].val_mut() = val;
+    idx.first_free = slot + 1;
+    idx.slots.insert(id, slot);
+    true
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_slot_table_probe_and_delete() {
+        let mut t = SlotTable::default();
+        for id in 1..=200u32 {
+            t.insert(id, id as usize * 2);
+        }
+        assert_eq!(t.len(), 200);
+        for id in (1..=200u32).step_by(3) {
+            t.remove(id);
+        }
+        for id in 1..=200u32 {
+            let want = if (id - 1) % 3 == 0 { None } else { Some(id as usize * 2) };
+            assert_eq!(t.get(id), want, "id {id}");
+        }
+        t.insert(4, 9);
+        assert_eq!(t.get(4), Some(9));
+        assert_eq!(t.get(999), None);
+    }
+
+    #[test]
+    fn test_index_matches_linear_scan() {
+        let mut interner = Interner::default();
+        let names: Vec<&[u8]> = vec![b"chann_en", b"", b"Kills", b"kills", b""];
+        let idx = RegIndex::build(&mut interner, names.into_iter());
+        assert!(idx.dups);
+        assert_eq!(idx.first_free, 1);
+        assert_eq!(idx.find(interner.intern(b"CHANN_EN")), Some(0));
+        assert_eq!(idx.find(interner.intern(b"KILLS")), Some(2));
+        assert_eq!(idx.find(interner.intern(b"missing")), None);
+    }
+}
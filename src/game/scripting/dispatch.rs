@@ -0,0 +1,206 @@
+//! Cached function lookups for `sl_doscript_*` dispatch.
+//!
+//! Every script event used to resolve `root` (and `method`) from scratch: two
+//! UTF-8 checks, a lookup of `root` in the globals table and one of `method`
+//! in the result. Mob AI hooks, per-hit damage scripts and timer events do
+//! that many thousands of times a second for the same handful of names.
+//!
+//! A (root, method) pair is now interned once into a handle, and the function
+//! it names is kept in the Lua registry under that handle. Dispatch by handle
+//! is an index into `entries`. The string entry points (`call_lua`) intern
+//! their arguments on every call, which costs one hash of the bytes instead of
+//! the Lua lookups. Hot call sites hold a `ScriptHandle` and skip even that.
+//!
+//! Scripts can redefine anything when they are reloaded, so `sl_reload` and
+//! `sl_exec` invalidate every resolved entry. Misses are cached too: most
+//! events have no handler for most roots, and those lookups were the most
+//! common of all.
+
+use std::collections::HashMap;
+use std::ffi::CStr;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+/// What a handle last resolved to, and in which generation.
+struct Entry<V> {
+    root: Box<[u8]>,
+    method: Option<Box<[u8]>>,
+    /// `None` until resolved in the current generation
+    resolved: Option<(u32, Option<V>)>,
+}
+
+/// Handle table from (root, method) to a cached function `V`.
+pub struct FnCache<V> {
+    /// root, separator, method -> handle
+    handles: HashMap<Vec<u8>, u32>,
+    /// Handle `h` is `entries[h - 1]`; 0 is never issued
+    entries: Vec<Entry<V>>,
+    generation: u32,
+    scratch: Vec<u8>,
+    hits: u64,
+    misses: u64,
+}
+
+impl<V> Default for FnCache<V> {
+    fn default() -> Self {
+        FnCache {
+            handles: HashMap::new(),
+            entries: Vec::new(),
+            generation: 0,
+            scratch: Vec::new(),
+            hits: 0,
+            misses: 0,
+        }
+    }
+}
+
+/// Cache counters, for the `@luacache` command.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct CacheStats {
+    pub handles: usize,
+    pub hits: u64,
+    pub misses: u64,
+}
+
+impl<V> FnCache<V> {
+    /// Handle of `root.method` (or of the global function `root`).
+    pub fn handle(&mut self, root: &[u8], method: Option<&[u8]>) -> u32 {
+        // 0xff never appears in UTF-8, so keys cannot collide
+        self.scratch.clear();
+        self.scratch.extend_from_slice(root);
+        if let Some(m) = method {
+            self.scratch.push(0xff);
+            self.scratch.extend_from_slice(m);
+        }
+        if let Some(&h) = self.handles.get(self.scratch.as_slice()) {
+            return h;
+        }
+        self.entries.push(Entry {
+            root: root.into(),
+            method: method.map(Into::into),
+            resolved: None,
+        });
+        let h = self.entries.len() as u32;
+        self.handles.insert(self.scratch.clone(), h);
+        h
+    }
+
+    /// The cached function of handle `h`: `Some(Some(f))` or, for a name with
+    /// no function behind it, `Some(None)`. `None` if `h` is not resolved in
+    /// the current generation; the caller looks it up and calls `fill`.
+    /// The lookup is left to the caller so that Lua code it runs (an
+    /// `__index` metamethod) may dispatch scripts itself.
+    pub fn cached(&mut self, h: u32) -> Option<Option<&V>> {
+        let generation = self.generation;
+        let e = self.entries.get(h.checked_sub(1)? as usize)?;
+        match &e.resolved {
+            Some((g, v)) if *g == generation => {
+                self.hits += 1;
+                Some(v.as_ref())
+            }
+            _ => {
+                self.misses += 1;
+                None
+            }
+        }
+    }
+
+    /// Root and method of handle `h`.
+    pub fn names(&self, h: u32) -> Option<(&[u8], Option<&[u8]>)> {
+        let e = self.entries.get(h.checked_sub(1)? as usize)?;
+        Some((&e.root, e.method.as_deref()))
+    }
+
+    /// Record what handle `h` resolved to in the current generation.
+    pub fn fill(&mut self, h: u32, v: Option<V>) {
+        let generation = self.generation;
+        if let Some(e) = h.checked_sub(1).and_then(|i| self.entries.get_mut(i as usize)) {
+            e.resolved = Some((generation, v));
+        }
+    }
+
+    /// Drop every resolved function; handles stay valid.
+    pub fn invalidate(&mut self) {
+        self.generation = self.generation.wrapping_add(1);
+        for e in &mut self.entries {
+            e.resolved = None;
+        }
+    }
+
+    /// Name of handle `h`, for error messages.
+    pub fn name(&self, h: u32) -> String {
+        let Some(e) = h.checked_sub(1).and_then(|i| self.entries.get(i as usize)) else {
+            return format!("<handle {h}>");
+        };
+        let root = String::from_utf8_lossy(&e.root);
+        match &e.method {
+            Some(m) => format!("{root}.{}", String::from_utf8_lossy(m)),
+            None => root.into_owned(),
+        }
+    }
+
+    pub fn stats(&self) -> CacheStats {
+        CacheStats { handles: self.entries.len(), hits: self.hits, misses: self.misses }
+    }
+}
+
+/// A (root, method) pair named in the source, interned on first use.
+pub struct ScriptHandle {
+    root: &'static CStr,
+    method: Option<&'static CStr>,
+    id: AtomicU32,
+}
+
+impl ScriptHandle {
+    pub const fn new(root: &'static CStr, method: Option<&'static CStr>) -> Self {
+        ScriptHandle { root, method, id: AtomicU32::new(0) }
+    }
+
+    /// The interned handle.
+    pub fn get(&self) -> u32 {
+        match self.id.load(Ordering::Relaxed) {
+            0 => {
+                let h = super::sl_handle(self.root, self.method);
+                self.id.store(h, Ordering::Relaxed);
+                h
+            }
+            h => h,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_handles_resolve_once_per_generation() {
+        let mut c: FnCache<&'static str> = FnCache::default();
+        let ai = c.handle(b"mob_ai_basic", Some(b"on_attacked"));
+        let crit = c.handle(b"hitCritChance", None);
+        assert_ne!(ai, crit);
+        assert_eq!(c.handle(b"mob_ai_basic", Some(b"on_attacked")), ai);
+        // "a" + "bc" and "ab" + "c" are different pairs
+        assert_ne!(c.handle(b"a", Some(b"bc")), c.handle(b"ab", Some(b"c")));
+
+        assert_eq!(c.names(ai), Some((&b"mob_ai_basic"[..], Some(&b"on_attacked"[..]))));
+        assert!(c.cached(ai).is_none());
+        c.fill(ai, Some("fn"));
+        for _ in 0..3 {
+            assert_eq!(c.cached(ai), Some(Some(&"fn")));
+        }
+        // A missing function is cached as missing
+        assert!(c.cached(crit).is_none());
+        c.fill(crit, None);
+        assert_eq!(c.cached(crit), Some(None));
+        assert_eq!(c.stats(), CacheStats { handles: 4, hits: 4, misses: 2 });
+
+        c.invalidate();
+        assert!(c.cached(crit).is_none());
+        c.fill(crit, Some("defined"));
+        assert_eq!(c.cached(crit), Some(Some(&"defined")));
+        assert!(c.cached(0).is_none());
+        assert_eq!(c.names(99), None);
+        assert_eq!(c.name(ai), "mob_ai_basic.on_attacked");
+        assert_eq!(c.name(crit), "hitCritChance");
+    }
+}
@@ -0,0 +1,178 @@
+//! The script owner thread and the queue other threads post work to.
+//!
+//! LuaJIT is single-threaded, and scripts call straight back into the C game
+//! state (block lists, id_db, session buffers), so scripts must only run on
+//! the thread that drives `timer_do`. Until this existed, the char server
+//! connection ran `intif_mmo_tosd` (and the login scripts behind it) on a
+//! tokio worker, racing timer callbacks for the Lua state and falling into
+//! `blocking_lock` inside the runtime.
+//!
+//! The game loop claims ownership with `claim` once init is done. From then
+//! on, work that arrives on any other thread is posted here as a `Job` and
+//! run by `drain` at the start of the next tick, before `timer_do`. Packets
+//! those jobs write go into the session buffers like any others and leave in
+//! the end-of-tick flush, so each job's side effects are applied as one
+//! batch at a point where nothing else is touching the game state.
+//!
+//! Script calls (`sl_doscript_*`) made on the wrong thread are not run
+//! inline either: their block-list arguments are converted to ids and the
+//! call is queued, to be resolved again at drain time. An entity that is gone
+//! by then drops the call. Such calls return `QUEUED` instead of the usual
+//! found (1) / not found (0), since neither is known until the call runs.
+
+use std::ffi::{c_int, CString};
+use std::sync::mpsc::{channel, Receiver, Sender};
+use std::sync::{Mutex, OnceLock};
+use std::thread::{self, ThreadId};
+
+/// What `sl_doscript_*` returns for a call posted to the owner thread
+/// (`SL_QUEUED` in scripting.h). The script has not run yet.
+pub const QUEUED: c_int = -1;
+
+/// A unit of work for the owner thread.
+pub enum Job {
+    /// `sl_doscript_blargs(root, method, ids...)`
+    Named { root: CString, method: Option<CString>, ids: Vec<u32> },
+    /// `sl_doscript_handle(handle, ids...)`
+    Handle { handle: u32, ids: Vec<u32> },
+    /// Anything else that must run on the owner thread.
+    Run(Box<dyn FnOnce() + Send>),
+}
+
+struct Queue {
+    tx: Sender<Job>,
+    /// Only `drain` receives; the mutex is never contended.
+    rx: Mutex<Receiver<Job>>,
+}
+
+static OWNER: OnceLock<ThreadId> = OnceLock::new();
+static QUEUE: OnceLock<Queue> = OnceLock::new();
+
+fn queue() -> &'static Queue {
+    QUEUE.get_or_init(|| {
+        let (tx, rx) = channel();
+        Queue { tx, rx: Mutex::new(rx) }
+    })
+}
+
+/// Make the calling thread the script owner. Only the first call counts.
+pub fn claim() {
+    let _ = OWNER.set(thread::current().id());
+}
+
+/// Whether the calling thread may run scripts now. True everywhere until a
+/// thread claims ownership, so init can run its startup scripts.
+pub fn on_owner() -> bool {
+    OWNER.get().map_or(true, |&id| id == thread::current().id())
+}
+
+/// Queue `job` for the owner thread. Never blocks.
+pub fn post(job: Job) {
+    // The receiver lives in a static, so the send cannot fail
+    let _ = queue().tx.send(job);
+}
+
+/// Run `f` on the owner thread: now if this is it, else at the next drain.
+pub fn run_on_owner(f: impl FnOnce() + Send + 'static) {
+    if on_owner() {
+        f();
+    } else {
+        post(Job::Run(Box::new(f)));
+    }
+}
+
+/// Take everything posted so far, in order. Jobs posted while these run wait
+/// for the next drain, so one tick cannot be held up indefinitely.
+pub fn take_pending() -> Vec<Job> {
+    let rx = queue().rx.lock().unwrap_or_else(|e| e.into_inner());
+    rx.try_iter().collect()
+}
+
+/// Run every pending job. Called by the game loop before each `timer_do`.
+#[cfg(not(test))]
+pub fn drain() {
+    for job in take_pending() {
+        unsafe { run_job(job) };
+    }
+}
+
+#[cfg(not(test))]
+unsafe fn run_job(job: Job) {
+    use std::os::raw::c_void;
+
+    let resolve = |ids: &[u32]| -> Option<Vec<*mut c_void>> {
+        ids.iter()
+            .map(|&id| match id {
+                0 => Some(std::ptr::null_mut()),
+                id => Some(super::ffi::map_id2bl(id)).filter(|p| !p.is_null()),
+            })
+            .collect()
+    };
+    match job {
+        Job::Named { root, method, ids } => {
+            let Some(args) = resolve(&ids) else {
+                tracing::debug!("[scripting] queued {root:?} dropped: argument gone");
+                return;
+            };
+            let method = method.as_deref().map_or(std::ptr::null(), |m| m.as_ptr());
+            super::sl_doscript_blargs_vec(root.as_ptr(), method, args.len() as _, args.as_ptr());
+        }
+        Job::Handle { handle, ids } => {
+            let Some(args) = resolve(&ids) else {
+                tracing::debug!("[scripting] queued handle {handle} dropped: argument gone");
+                return;
+            };
+            super::sl_doscript_handle(handle, &args);
+        }
+        Job::Run(f) => f(),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicU32, Ordering};
+    use std::sync::Arc;
+
+    #[test]
+    fn test_off_thread_work_waits_for_drain() {
+        claim();
+        assert!(on_owner());
+
+        let ran = Arc::new(AtomicU32::new(0));
+        let r = Arc::clone(&ran);
+        thread::spawn(move || {
+            assert!(!on_owner());
+            for i in 1..=3 {
+                let r = Arc::clone(&r);
+                run_on_owner(move || {
+                    // Jobs run in posting order
+                    assert_eq!(r.fetch_add(1, Ordering::SeqCst), i - 1);
+                });
+            }
+            post(Job::Handle { handle: 7, ids: vec![1, 0] });
+        })
+        .join()
+        .unwrap();
+        assert_eq!(ran.load(Ordering::SeqCst), 0);
+
+        let jobs = take_pending();
+        assert_eq!(jobs.len(), 4);
+        for job in jobs {
+            match job {
+                Job::Run(f) => f(),
+                Job::Handle { handle, ids } => assert_eq!((handle, ids), (7, vec![1, 0])),
+                Job::Named { .. } => unreachable!(),
+            }
+        }
+        assert_eq!(ran.load(Ordering::SeqCst), 3);
+        assert!(take_pending().is_empty());
+
+        // On the owner, work runs inline
+        let r = Arc::clone(&ran);
+        run_on_owner(move || {
+            r.fetch_add(1, Ordering::SeqCst);
+        });
+        assert_eq!(ran.load(Ordering::SeqCst), 4);
+    }
+}
@@ -172,6 +172,7 @@ pub fn register(lua: &Lua) -> mlua::Result<()> {
         if x < 0 || y < 0 || x >= md.xs as i32 || y >= md.ys as i32 { return Ok(()); }
         let idx = (x + y * md.xs as i32) as usize;
         unsafe { *md.obj.add(idx) = val as u16; }
+        unsafe { crate::ffi::block::pass_tile_changed(m as usize, x as u16, y as u16); }
         // map_foreachinarea(sl_updatepeople) omitted until foreachinarea is ported.
         Ok(())
     })?)?;
@@ -205,6 +206,7 @@ pub fn register(lua: &Lua) -> mlua::Result<()> {
         if x < 0 || y < 0 || x >= md.xs as i32 || y >= md.ys as i32 { return Ok(()); }
         let idx = (x + y * md.xs as i32) as usize;
         unsafe { *md.pass.add(idx) = val as u16; }
+        unsafe { crate::ffi::block::pass_tile_changed(m as usize, x as u16, y as u16); }
         Ok(())
     })?)?;
 
@@ -393,10 +395,35 @@ pub fn register(lua: &Lua) -> mlua::Result<()> {
                 vi(&args, 12), vi(&args, 13), vi(&args, 14),
                 vi(&args, 15), vi(&args, 16), vi(&args, 17), vi(&args, 18),
             );
+            let m = vi(&args, 0);
+            if m >= 0 {
+                crate::ffi::block::pass_reload(m as usize);
+            }
         }
         Ok(())
     })?)?;
 
+    // -----------------------------------------------------------------------
+    // Event rankings (RankingScores). The board is held in memory, so scores
+    // go through these rather than straight into the table.
+    // -----------------------------------------------------------------------
+    g.set("getRankingScore", lua.create_function(|_, (ev, cha): (u32, u32)| {
+        Ok(crate::database::ranking_db::ranking().score(ev, cha).unwrap_or(0) as i64)
+    })?)?;
+
+    g.set("getRankingRank", lua.create_function(|_, (ev, cha): (u32, u32)| {
+        Ok(crate::database::ranking_db::ranking().rank(ev, cha).unwrap_or(0) as i64)
+    })?)?;
+
+    g.set("setRankingScore", lua.create_function(|_, (ev, cha, name, score): (u32, u32, String, i32)| {
+        crate::database::ranking_db::record(ev, cha, &name, score);
+        Ok(())
+    })?)?;
+
+    g.set("addRankingScore", lua.create_function(|_, (ev, cha, name, delta): (u32, u32, String, i32)| {
+        Ok(crate::database::ranking_db::add(ev, cha, &name, delta) as i64)
+    })?)?;
+
     // -----------------------------------------------------------------------
     // setPostColor / throw / saveMap
     // -----------------------------------------------------------------------
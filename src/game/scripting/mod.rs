@@ -2,14 +2,20 @@
 #![allow(non_snake_case, dead_code, unused_variables)]
 
 pub mod async_coro;
+pub mod dispatch;
+pub mod executor;
 pub mod ffi;
 pub mod globals;
+pub mod objcache;
+pub mod reload;
+pub mod telemetry;
 pub mod types;
 
 use mlua::Lua;
+use std::cell::RefCell;
 use std::ffi::{CStr, CString, c_char, c_int, c_uint};
 use std::os::raw::c_void;
-use std::sync::{Arc, atomic::{AtomicBool}};
+use std::sync::{Arc, Mutex, atomic::{AtomicBool}};
 
 use crate::database::map_db::BlockList;
 use types::floor::FloorListObject;
@@ -27,8 +33,8 @@ static mut SL_STATE: Option<Lua> = None;
 
 /// Returns a reference to the global Lua state.
 /// # Safety
-/// Must only be called after `sl_init()`.  All scripting runs on the LocalSet
-/// thread (timer_do + session_io_task), so no external locking is needed.
+/// Must only be called after `sl_init()`, on the script owner thread (see
+/// `executor`), so no external locking is needed.
 pub unsafe fn sl_state() -> &'static Lua {
     SL_STATE.as_ref().expect("sl_init() not called")
 }
@@ -38,6 +44,36 @@ pub unsafe fn sl_state() -> &'static Lua {
 #[no_mangle]
 pub static mut sl_gstate: *mut c_void = std::ptr::null_mut();
 
+/// Resolved script functions. Like `SL_STATE`, only touched by the thread
+/// running scripts; init and the game loop run on different threads, so it
+/// cannot be a thread_local.
+static mut FN_CACHE: Option<RefCell<dispatch::FnCache<mlua::RegistryKey>>> = None;
+
+fn with_fn_cache<R>(f: impl FnOnce(&RefCell<dispatch::FnCache<mlua::RegistryKey>>) -> R) -> R {
+    f(unsafe { (*std::ptr::addr_of_mut!(FN_CACHE)).get_or_insert_with(Default::default) })
+}
+
+/// Userdata of live players, mobs and NPCs; see `objcache`.
+static mut OBJ_CACHE: Option<RefCell<objcache::ObjCache<mlua::RegistryKey>>> = None;
+
+fn with_obj_cache<R>(f: impl FnOnce(&RefCell<objcache::ObjCache<mlua::RegistryKey>>) -> R) -> R {
+    f(unsafe { (*std::ptr::addr_of_mut!(OBJ_CACHE)).get_or_insert_with(Default::default) })
+}
+
+/// Heap samples taken by `sl_tick`.
+static mut ALLOC_RATE: Option<telemetry::AllocRate> = None;
+
+fn alloc_rate() -> &'static mut telemetry::AllocRate {
+    unsafe { (*std::ptr::addr_of_mut!(ALLOC_RATE)).get_or_insert_with(Default::default) }
+}
+
+/// Collector work started by `sl_gc_idle` and `sl_fixmem`.
+static mut GC_STATS: Option<telemetry::GcStats> = None;
+
+fn gc_stats() -> &'static mut telemetry::GcStats {
+    unsafe { (*std::ptr::addr_of_mut!(GC_STATS)).get_or_insert_with(Default::default) }
+}
+
 // ---------------------------------------------------------------------------
 // sl_init
 // ---------------------------------------------------------------------------
@@ -64,6 +100,11 @@ pub fn sl_init() {
 
         // Reload scripts (lua_dir comes from config).
         sl_reload();
+
+        let cfg = crate::ffi::config::config();
+        if let Ok(gc) = sl_state().globals().get::<mlua::Function>("collectgarbage") {
+            let _ = gc.call::<()>(("setpause", cfg.lua_gc_pause));
+        }
     }
 }
 
@@ -232,48 +273,158 @@ fn register_types(lua: &Lua) -> mlua::Result<()> {
 pub unsafe fn sl_reload() -> c_int {
     let lua = sl_state();
     let cfg = crate::ffi::config::config();
-    match load_lua_dir(lua, &cfg.lua_dir) {
-        Ok(_)  => 0,
-        Err(e) => { tracing::error!("[scripting] sl_reload failed: {e:#}"); -1 }
+    invalidate_fn_cache(lua);
+    let cache = reload::BytecodeCache::new(&cfg.lua_cache_dir, &jit_version(lua));
+    let mut loaded = reload::Loaded::default();
+    let mut sources = Vec::new();
+    for (i, path) in reload::script_files(&cfg.lua_dir).into_iter().enumerate() {
+        let result = std::fs::read(&path)
+            .map_err(mlua::Error::external)
+            .and_then(|src| {
+                let r = load_chunk(lua, &cache, &path, &src);
+                loaded.record(path.clone(), reload::Loaded::fingerprint(&path, &src));
+                sources.push((path.clone(), src));
+                r
+            });
+        if let Err(e) = result {
+            // Everything else builds on sys.lua
+            if i == 0 && path.ends_with("sys.lua") {
+                tracing::error!("[scripting] sl_reload failed: {e:#}");
+                return -1;
+            }
+            tracing::warn!("[scripting] error loading {}: {e}", path.display());
+        }
     }
+    cache.prune(&sources);
+    *LOADED.lock().unwrap_or_else(|e| e.into_inner()) = Some(loaded);
+    0
 }
 
-fn load_lua_file(lua: &Lua, path: &std::path::Path) -> mlua::Result<()> {
-    let src = std::fs::read(path)
-        .map_err(|e| mlua::Error::external(e))?;
-    let name = path.to_string_lossy();
-    lua.load(src.as_slice()).set_name(name.as_ref()).eval::<()>()
+/// Fingerprints of the loaded scripts, for `sl_reload_changed`.
+static LOADED: Mutex<Option<reload::Loaded>> = Mutex::new(None);
+
+/// A `sl_reload_changed` scan or its swap is pending.
+static RELOADING: AtomicBool = AtomicBool::new(false);
+
+/// Build id of the LuaJIT in `lua`, keying the bytecode cache.
+fn jit_version(lua: &Lua) -> String {
+    lua.globals()
+        .get::<mlua::Table>("jit")
+        .and_then(|jit| jit.get::<String>("version"))
+        .unwrap_or_else(|_| "LuaJIT".into())
 }
 
-fn load_lua_dir(lua: &Lua, dir: &str) -> mlua::Result<()> {
-    // Load sys.lua first.
-    let sys = std::path::PathBuf::from(format!("{dir}/sys.lua"));
-    if sys.exists() {
-        load_lua_file(lua, &sys)?;
+/// Compile `src` to bytecode, through the cache.
+fn compile(lua: &Lua, cache: &reload::BytecodeCache, path: &std::path::Path, src: &[u8]) -> mlua::Result<Vec<u8>> {
+    if let Some(bc) = cache.get(path, src) {
+        return Ok(bc);
     }
-    load_dir_recursive(lua, dir)
+    let bc = lua.load(src).set_name(path.to_string_lossy()).into_function()?.dump(false);
+    cache.put(path, src, &bc);
+    Ok(bc)
 }
 
-fn load_dir_recursive(lua: &Lua, dir: &str) -> mlua::Result<()> {
-    let rd = match std::fs::read_dir(dir) {
-        Ok(r) => r, Err(_) => return Ok(()),
-    };
-    for entry in rd.flatten() {
-        let path = entry.path();
-        let name = path.file_name().and_then(|n| n.to_str()).unwrap_or("");
-        if name.starts_with('.') || name == "sys.lua" { continue; }
-        if path.is_dir() {
-            if path.to_str().is_none() {
-                tracing::warn!("[scripting] skipping non-UTF8 directory path: {}", path.display());
-            }
-            load_dir_recursive(lua, &path.to_string_lossy())?;
-        } else if path.extension().and_then(|e| e.to_str()) == Some("lua") {
-            if let Err(e) = load_lua_file(lua, &path) {
-                tracing::warn!("[scripting] error loading {}: {e}", path.display());
+/// Load LuaJIT bytecode as a function, or `None` if it does not load.
+unsafe fn load_bytecode(lua: &Lua, path: &std::path::Path, bc: &[u8]) -> Option<mlua::Function> {
+    // mlua refuses binary chunks in safe mode; the bytes come from our own
+    // compiler, via the cache or the reload thread
+    let name = CString::new(path.to_string_lossy().as_bytes()).ok()?;
+    let v = lua.exec_raw::<mlua::Value>((), |L| {
+        let rc = mlua::ffi::luaL_loadbuffer(L, bc.as_ptr() as *const c_char, bc.len(), name.as_ptr());
+        if rc != 0 {
+            mlua::ffi::lua_pop(L, 1);
+            mlua::ffi::lua_pushnil(L);
+        }
+    }).ok()?;
+    v.as_function().cloned()
+}
+
+/// Run the script `src` read from `path`, from cached bytecode if there is
+/// any. Stale or foreign cache entries fall back to the source.
+unsafe fn load_chunk(lua: &Lua, cache: &reload::BytecodeCache, path: &std::path::Path, src: &[u8]) -> mlua::Result<()> {
+    if let Some(f) = cache.get(path, src).and_then(|bc| load_bytecode(lua, path, &bc)) {
+        return f.call::<()>(());
+    }
+    let f = lua.load(src).set_name(path.to_string_lossy()).into_function()?;
+    cache.put(path, src, &f.dump(false));
+    f.call::<()>(())
+}
+
+/// Reload only the scripts that changed since they were loaded. Files are
+/// read and compiled on a separate thread; the new chunks run on the game
+/// thread at the start of a later tick. Returns false if a reload is
+/// already in progress.
+pub fn sl_reload_changed() -> bool {
+    use std::sync::atomic::Ordering;
+
+    if RELOADING.swap(true, Ordering::AcqRel) {
+        return false;
+    }
+    let cfg = crate::ffi::config::config();
+    let (dir, cache_dir) = (cfg.lua_dir.clone(), cfg.lua_cache_dir.clone());
+    let spawned = std::thread::Builder::new().name("lua-reload".into()).spawn(move || {
+        let start = std::time::Instant::now();
+        // Only the parser is used; nothing runs in this state
+        let lua = Lua::new();
+        let cache = reload::BytecodeCache::new(&cache_dir, &jit_version(&lua));
+        let mut chunks = Vec::new();
+        for path in reload::script_files(&dir) {
+            let check = LOADED
+                .lock()
+                .unwrap_or_else(|e| e.into_inner())
+                .get_or_insert_with(Default::default)
+                .check(&path);
+            match check {
+                Ok(reload::Check::Unchanged) => {}
+                Ok(reload::Check::SameContent(fp)) => {
+                    LOADED.lock().unwrap_or_else(|e| e.into_inner())
+                        .get_or_insert_with(Default::default)
+                        .record(path, fp);
+                }
+                Ok(reload::Check::Changed(fp, src)) => match compile(&lua, &cache, &path, &src) {
+                    Ok(bc) => chunks.push((path, fp, bc)),
+                    // Left unrecorded, so the next reload tries it again
+                    Err(e) => tracing::warn!("[scripting] error compiling {}: {e}", path.display()),
+                },
+                Err(e) => tracing::warn!("[scripting] error reading {}: {e}", path.display()),
             }
         }
+        tracing::info!(
+            "[scripting] reload scan: {} changed, compiled in {:?}",
+            chunks.len(),
+            start.elapsed()
+        );
+        executor::post(executor::Job::Run(Box::new(move || unsafe { apply_reload(chunks) })));
+    });
+    if spawned.is_err() {
+        RELOADING.store(false, Ordering::Release);
+        return false;
     }
-    Ok(())
+    true
+}
+
+/// Swap in the chunks compiled by `sl_reload_changed`.
+unsafe fn apply_reload(chunks: Vec<(std::path::PathBuf, reload::Fingerprint, Vec<u8>)>) {
+    let lua = sl_state();
+    let start = std::time::Instant::now();
+    let n = chunks.len();
+    for (path, fp, bc) in chunks {
+        let result = match load_bytecode(lua, &path, &bc) {
+            Some(f) => f.call::<()>(()),
+            None => Err(mlua::Error::runtime("bytecode did not load")),
+        };
+        if let Err(e) = result {
+            tracing::warn!("[scripting] error loading {}: {e}", path.display());
+        }
+        LOADED.lock().unwrap_or_else(|e| e.into_inner())
+            .get_or_insert_with(Default::default)
+            .record(path, fp);
+    }
+    if n > 0 {
+        invalidate_fn_cache(lua);
+    }
+    RELOADING.store(false, std::sync::atomic::Ordering::Release);
+    tracing::info!("[scripting] reloaded {n} changed scripts in {:?}", start.elapsed());
 }
 
 // ---------------------------------------------------------------------------
@@ -281,8 +432,36 @@ fn load_dir_recursive(lua: &Lua, dir: &str) -> mlua::Result<()> {
 // ---------------------------------------------------------------------------
 pub unsafe fn sl_fixmem() {
     if let Ok(gc) = sl_state().globals().get::<mlua::Function>("collectgarbage") {
+        let start = std::time::Instant::now();
         let _ = gc.call::<()>("collect");
+        gc_stats().record_full(start.elapsed());
+    }
+}
+
+/// Shortest idle time worth spending on a GC step.
+const GC_MIN_IDLE: std::time::Duration = std::time::Duration::from_millis(2);
+
+/// Spend idle loop time on one incremental GC step of `lua_gc_step_kb`, so
+/// the collector keeps ahead of allocation instead of catching up inside a
+/// player-facing event. `idle` is what is left of the tick.
+pub unsafe fn sl_gc_idle(idle: std::time::Duration) {
+    let step_kb = crate::ffi::config::config().lua_gc_step_kb;
+    let Some(lua) = SL_STATE.as_ref() else { return };
+    if step_kb == 0 {
+        return;
     }
+    if idle < GC_MIN_IDLE {
+        gc_stats().skipped += 1;
+        return;
+    }
+    let start = std::time::Instant::now();
+    let finished = lua.gc_step_kbytes(step_kb as c_int).unwrap_or(false);
+    gc_stats().record_step(start.elapsed(), finished);
+}
+
+/// Collector counters, for the `@luagc` command.
+pub fn sl_gc_stats() -> telemetry::GcStats {
+    *gc_stats()
 }
 
 pub unsafe fn sl_luasize() -> c_int {
@@ -300,44 +479,156 @@ pub unsafe fn sl_luasize() -> c_int {
 pub(crate) unsafe fn bl_to_lua(lua: &Lua, bl: *mut c_void) -> mlua::Result<mlua::Value> {
     debug_assert!(!bl.is_null(), "bl_to_lua: caller must not pass a null pointer");
     if bl.is_null() { return Ok(mlua::Value::Nil); }
-    let bl_type = (*(bl as *const BlockList)).bl_type as c_int;
-    match bl_type {
-        ffi::BL_PC   => lua.pack(PcObject       { ptr: bl }),
-        ffi::BL_MOB  => lua.pack(MobObject      { ptr: bl, deleted: Arc::new(AtomicBool::new(false)) }),
-        ffi::BL_NPC  => lua.pack(NpcObject      { ptr: bl }),
-        ffi::BL_ITEM => lua.pack(FloorListObject::new(bl)),
+    let (id, bl_type) = ((*(bl as *const BlockList)).id, (*(bl as *const BlockList)).bl_type);
+    let cached = with_obj_cache(|c| {
+        c.borrow_mut().get(bl as usize, id, bl_type).and_then(|k| lua.registry_value::<mlua::Value>(k).ok())
+    });
+    if let Some(v) = cached {
+        return Ok(v);
+    }
+    let v = match bl_type as c_int {
+        ffi::BL_PC   => lua.pack(PcObject       { ptr: bl })?,
+        ffi::BL_MOB  => lua.pack(MobObject      { ptr: bl, deleted: Arc::new(AtomicBool::new(false)) })?,
+        ffi::BL_NPC  => lua.pack(NpcObject      { ptr: bl })?,
+        // Floor items are short-lived and their object tracks pickups; not cached
+        ffi::BL_ITEM => return lua.pack(FloorListObject::new(bl)),
         other => {
             tracing::warn!("[scripting] bl_to_lua: unhandled bl_type={other:#04x}, returning nil");
-            Ok(mlua::Value::Nil)
+            return Ok(mlua::Value::Nil);
+        }
+    };
+    let key = lua.create_registry_value(v.clone())?;
+    with_obj_cache(|c| c.borrow_mut().insert(bl as usize, id, bl_type, key));
+    Ok(v)
+}
+
+/// Drop the cached userdata of the entity at `bl`, when it leaves id_db.
+/// Scripts still holding the object keep it alive; only reuse ends.
+pub fn sl_release_bl(bl: *mut c_void) {
+    with_obj_cache(|c| c.borrow_mut().release(bl as usize));
+}
+
+/// Userdata cache counters.
+pub fn sl_obj_stats() -> objcache::ObjStats {
+    with_obj_cache(|c| c.borrow().stats())
+}
+
+/// Sample the Lua heap at a tick boundary. Called from the game loop.
+pub unsafe fn sl_tick() {
+    let Some(lua) = SL_STATE.as_ref() else { return };
+    alloc_rate().sample(lua.used_memory(), sl_obj_stats().created);
+}
+
+/// Heap growth and userdata creation per tick, over the last
+/// `telemetry::WINDOW` ticks.
+pub fn sl_alloc_stats() -> telemetry::RateStats {
+    alloc_rate().stats()
+}
+
+/// Handle of the script function `root.method`, or of the global function
+/// `root` when `method` is `None`. Handles stay valid across `sl_reload`.
+pub fn sl_handle(root: &CStr, method: Option<&CStr>) -> u32 {
+    with_fn_cache(|c| c.borrow_mut().handle(root.to_bytes(), method.map(CStr::to_bytes)))
+}
+
+/// Hit/miss counters of the function cache.
+pub fn sl_dispatch_stats() -> dispatch::CacheStats {
+    with_fn_cache(|c| c.borrow().stats())
+}
+
+/// Forget every resolved function, after scripts may have redefined them.
+fn invalidate_fn_cache(lua: &Lua) {
+    with_fn_cache(|c| c.borrow_mut().invalidate());
+    lua.expire_registry_values();
+}
+
+/// Look up the function a handle names, the way `call_lua` always did.
+fn lookup_fn(lua: &Lua, root: &[u8], method: Option<&[u8]>) -> Option<mlua::Function> {
+    let root = std::str::from_utf8(root).ok()?;
+    match method {
+        None => lua.globals().get(root).ok(),
+        Some(m) => {
+            let tbl: mlua::Table = lua.globals().get(root).ok()?;
+            tbl.get(std::str::from_utf8(m).ok()?).ok()
         }
     }
 }
 
+/// Call the function handle `h` names. Returns false if there is none.
+unsafe fn call_handle(h: u32, args: mlua::MultiValue) -> bool {
+    let lua = sl_state();
+    let cached = with_fn_cache(|c| {
+        c.borrow_mut().cached(h).map(|key| key.and_then(|k| lua.registry_value::<mlua::Function>(k).ok()))
+    });
+    let func = match cached {
+        Some(func) => func,
+        None => {
+            // Resolve outside the borrow: the lookup can run Lua (__index)
+            let Some((root, method)) = with_fn_cache(|c| {
+                c.borrow().names(h).map(|(r, m)| (r.to_vec(), m.map(<[u8]>::to_vec)))
+            }) else {
+                return false;
+            };
+            let func = lookup_fn(lua, &root, method.as_deref());
+            let key = func.as_ref().and_then(|f| lua.create_registry_value(f.clone()).ok());
+            with_fn_cache(|c| c.borrow_mut().fill(h, key));
+            func
+        }
+    };
+    let Some(func) = func else { return false };
+    if let Err(e) = func.call::<mlua::MultiValue>(args) {
+        let name = with_fn_cache(|c| c.borrow().name(h));
+        tracing::warn!("[scripting] {name}: {e}");
+    }
+    true
+}
+
 unsafe fn call_lua(
     root: *const c_char,
     method: *const c_char,
     args: mlua::MultiValue,
 ) -> bool {
-    let lua = sl_state();
-    let root_s = match CStr::from_ptr(root).to_str() { Ok(s) => s, Err(_) => return false };
+    let method = if method.is_null() { None } else { Some(CStr::from_ptr(method)) };
+    call_handle(sl_handle(CStr::from_ptr(root), method), args)
+}
 
-    if method.is_null() {
-        // Direct function call: sl_doscript_blargs("startup", NULL, 0) → startup()
-        let func: mlua::Function = match lua.globals().get(root_s) { Ok(f) => f, Err(_) => return false };
-        if let Err(e) = func.call::<mlua::MultiValue>(args) {
-            tracing::warn!("[scripting] {root_s}: {e}");
-        }
-        return true;
+/// Block-list arguments as Lua values.
+unsafe fn bl_args(lua: &Lua, args: &[*mut c_void]) -> mlua::MultiValue {
+    let mut mv = mlua::MultiValue::new();
+    for &bl in args {
+        let val = if bl.is_null() {
+            mlua::Value::Nil
+        } else {
+            bl_to_lua(lua, bl).unwrap_or(mlua::Value::Nil)
+        };
+        mv.push_back(val);
     }
+    mv
+}
 
-    let method_s = match CStr::from_ptr(method).to_str() { Ok(s) => s, Err(_) => return false };
-    let tbl: mlua::Table  = match lua.globals().get(root_s)  { Ok(t) => t, Err(_) => return false };
-    let func: mlua::Function = match tbl.get(method_s)       { Ok(f) => f, Err(_) => return false };
+/// Ids of block-list arguments, for a call queued to the owner thread.
+unsafe fn bl_ids(args: &[*mut c_void]) -> Vec<u32> {
+    args.iter()
+        .map(|&bl| if bl.is_null() { 0 } else { (*(bl as *const BlockList)).id })
+        .collect()
+}
 
-    if let Err(e) = func.call::<mlua::MultiValue>(args) {
-        tracing::warn!("[scripting] {root_s}.{method_s}: {e}");
+/// Per-map cost scope of a call, charged to the map of its first
+/// block-list argument.
+unsafe fn cost_scope(args: &[*mut c_void]) -> Option<crate::game::map_cost::Scope> {
+    let bl = args.iter().find(|bl| !bl.is_null())?;
+    let m = (*(*bl as *const BlockList)).m;
+    Some(crate::game::map_cost::scope(m, crate::game::map_cost::Kind::Lua))
+}
+
+/// `sl_doscript_blargs` by handle; see `sl_handle`.
+pub unsafe fn sl_doscript_handle(h: u32, args: &[*mut c_void]) -> c_int {
+    if !executor::on_owner() {
+        executor::post(executor::Job::Handle { handle: h, ids: bl_ids(args) });
+        return executor::QUEUED;
     }
-    true
+    let _cost = cost_scope(args);
+    call_handle(h, bl_args(sl_state(), args)) as c_int
 }
 
 /// # Safety
@@ -350,27 +641,48 @@ pub unsafe fn sl_doscript_blargs_vec(
 ) -> c_int {
     debug_assert!(nargs >= 0, "sl_doscript_blargs_vec: nargs must be non-negative");
     debug_assert!(nargs <= 64, "sl_doscript_blargs_vec: nargs={nargs} exceeds sanity limit");
-    if nargs <= 0 || args.is_null() {
-        return call_lua(root, method, mlua::MultiValue::new()) as c_int;
+    let slice: &[*mut c_void] = if nargs <= 0 || args.is_null() {
+        &[]
+    } else {
+        std::slice::from_raw_parts(args, nargs as usize)
+    };
+    if !executor::on_owner() {
+        executor::post(executor::Job::Named {
+            root: CStr::from_ptr(root).to_owned(),
+            method: (!method.is_null()).then(|| CStr::from_ptr(method).to_owned()),
+            ids: bl_ids(slice),
+        });
+        return executor::QUEUED;
     }
-    let lua = sl_state();
-    let slice = std::slice::from_raw_parts(args, nargs as usize);
-    let mut mv = mlua::MultiValue::new();
-    for &bl in slice {
-        let val = if bl.is_null() {
-            mlua::Value::Nil
-        } else {
-            bl_to_lua(lua, bl).unwrap_or(mlua::Value::Nil)
-        };
-        mv.push_back(val);
+    if slice.is_empty() {
+        return call_lua(root, method, mlua::MultiValue::new()) as c_int;
     }
-    call_lua(root, method, mv) as c_int
+    let _cost = cost_scope(slice);
+    call_lua(root, method, bl_args(sl_state(), slice)) as c_int
 }
 
 pub unsafe fn sl_doscript_strings_vec(
     root: *const c_char, method: *const c_char,
     nargs: c_int, args: *const *const c_char,
 ) -> c_int {
+    if !executor::on_owner() {
+        let root = CStr::from_ptr(root).to_owned();
+        let method = (!method.is_null()).then(|| CStr::from_ptr(method).to_owned());
+        let n = if args.is_null() { 0 } else { nargs.max(0) as usize };
+        let strings: Vec<Option<CString>> = (0..n)
+            .map(|i| *args.add(i))
+            .map(|p| (!p.is_null()).then(|| CStr::from_ptr(p).to_owned()))
+            .collect();
+        executor::post(executor::Job::Run(Box::new(move || unsafe {
+            let ptrs: Vec<*const c_char> = strings
+                .iter()
+                .map(|s| s.as_deref().map_or(std::ptr::null(), CStr::as_ptr))
+                .collect();
+            let method = method.as_deref().map_or(std::ptr::null(), CStr::as_ptr);
+            sl_doscript_strings_vec(root.as_ptr(), method, ptrs.len() as c_int, ptrs.as_ptr());
+        })));
+        return executor::QUEUED;
+    }
     if nargs <= 0 || args.is_null() {
         return call_lua(root, method, mlua::MultiValue::new()) as c_int;
     }
@@ -404,6 +716,8 @@ pub unsafe fn sl_exec_str(user: *mut c_void, code: *const c_char) {
     if let Err(e) = lua.load(s.as_ref()).eval::<()>() {
         tracing::warn!("[scripting] sl_exec error: {e}");
     }
+    // The snippet may have (re)defined script functions
+    invalidate_fn_cache(lua);
 }
 
 pub unsafe fn sl_updatepeople_impl(_bl: *mut c_void, _ap: *mut c_void) -> c_int {
@@ -0,0 +1,92 @@
+//! Lua userdata for block lists, reused across script calls.
+//!
+//! `bl_to_lua` used to build a fresh userdata for every argument of every
+//! script call, so a per-hit damage script made several GC objects per hit.
+//! Players, mobs and NPCs now get one userdata each, created on first use and
+//! kept in the Lua registry until the entity leaves id_db (`map_deliddb`
+//! calls `sl_release_bl`). Scripts also see the same object for the same
+//! entity, so it works as a table key.
+//!
+//! Entries are keyed by block_list address and checked against the id and
+//! type, so memory reused by another entity never yields a stale object even
+//! if a release was missed.
+
+use std::collections::HashMap;
+
+struct Cached<V> {
+    id: u32,
+    bl_type: u8,
+    value: V,
+}
+
+/// block_list address -> its userdata `V`.
+pub struct ObjCache<V> {
+    entries: HashMap<usize, Cached<V>>,
+    hits: u64,
+    created: u64,
+}
+
+impl<V> Default for ObjCache<V> {
+    fn default() -> Self {
+        ObjCache { entries: HashMap::new(), hits: 0, created: 0 }
+    }
+}
+
+/// Cache counters, for the `@luacache` command.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct ObjStats {
+    pub live: usize,
+    pub hits: u64,
+    pub created: u64,
+}
+
+impl<V> ObjCache<V> {
+    /// The object of the entity at `addr`, if it is the one cached there.
+    pub fn get(&mut self, addr: usize, id: u32, bl_type: u8) -> Option<&V> {
+        match self.entries.get(&addr) {
+            Some(c) if c.id == id && c.bl_type == bl_type => {
+                self.hits += 1;
+                Some(&c.value)
+            }
+            _ => None,
+        }
+    }
+
+    /// Cache a newly created object; replaces whatever was at `addr`.
+    pub fn insert(&mut self, addr: usize, id: u32, bl_type: u8, value: V) {
+        self.created += 1;
+        self.entries.insert(addr, Cached { id, bl_type, value });
+    }
+
+    /// Forget the object of the entity at `addr`.
+    pub fn release(&mut self, addr: usize) -> Option<V> {
+        self.entries.remove(&addr).map(|c| c.value)
+    }
+
+    pub fn stats(&self) -> ObjStats {
+        ObjStats { live: self.entries.len(), hits: self.hits, created: self.created }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_reuse_until_release() {
+        let mut c: ObjCache<&'static str> = ObjCache::default();
+        assert!(c.get(0x1000, 7, 1).is_none());
+        c.insert(0x1000, 7, 1, "pc7");
+        assert_eq!(c.get(0x1000, 7, 1), Some(&"pc7"));
+        assert_eq!(c.get(0x1000, 7, 1), Some(&"pc7"));
+        // Same memory, different entity
+        assert!(c.get(0x1000, 8, 1).is_none());
+        assert!(c.get(0x1000, 7, 2).is_none());
+        assert_eq!(c.stats(), ObjStats { live: 1, hits: 2, created: 1 });
+
+        assert_eq!(c.release(0x1000), Some("pc7"));
+        assert!(c.get(0x1000, 7, 1).is_none());
+        assert_eq!(c.release(0x1000), None);
+        assert_eq!(c.stats().live, 0);
+    }
+}
@@ -0,0 +1,225 @@
+//! Incremental script reload and the on-disk bytecode cache.
+//!
+//! A full `sl_reload` reads, parses and runs every file under `lua_dir` on
+//! the game thread, which on a large tree stops the world for seconds. Two
+//! things make that cheaper:
+//!
+//! - Every chunk is cached as LuaJIT bytecode in `lua_cache_dir`, under the
+//!   MD5 of the LuaJIT version, the path and the source. Cold start and full
+//!   reloads only parse files that changed since the cache was written.
+//! - `sl_reload_changed` does the scan off the game thread. A file whose
+//!   mtime and size are unchanged is skipped without being read, and one
+//!   that was only touched is skipped by its hash. Changed files are compiled
+//!   to bytecode on that thread, with a private Lua state. The game thread
+//!   then runs the bytecode at the start of the next tick, so globals are
+//!   swapped at a tick boundary.
+//!
+//! Files that were deleted are not undone: whatever they defined stays
+//! defined until the next restart, as with a full reload.
+
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use std::time::SystemTime;
+
+use md5::{Digest, Md5};
+
+/// What a script file looked like when it was last loaded.
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub struct Fingerprint {
+    mtime: Option<SystemTime>,
+    len: u64,
+    digest: [u8; 16],
+}
+
+/// Fingerprints of every loaded script file.
+#[derive(Default)]
+pub struct Loaded {
+    files: HashMap<PathBuf, Fingerprint>,
+}
+
+/// Outcome of checking one file against `Loaded`.
+pub enum Check {
+    /// Same mtime and size; not read
+    Unchanged,
+    /// Touched but the same content
+    SameContent(Fingerprint),
+    Changed(Fingerprint, Vec<u8>),
+}
+
+impl Loaded {
+    /// Compare `path` with the fingerprint it was loaded with.
+    pub fn check(&self, path: &Path) -> std::io::Result<Check> {
+        let meta = std::fs::metadata(path)?;
+        let (mtime, len) = (meta.modified().ok(), meta.len());
+        let old = self.files.get(path);
+        if let Some(old) = old {
+            if old.mtime.is_some() && old.mtime == mtime && old.len == len {
+                return Ok(Check::Unchanged);
+            }
+        }
+        let src = std::fs::read(path)?;
+        let fp = Fingerprint { mtime, len, digest: Md5::digest(&src).into() };
+        Ok(match old {
+            Some(old) if old.digest == fp.digest => Check::SameContent(fp),
+            _ => Check::Changed(fp, src),
+        })
+    }
+
+    pub fn record(&mut self, path: PathBuf, fp: Fingerprint) {
+        self.files.insert(path, fp);
+    }
+
+    /// Fingerprint of `src`, just read from `path`.
+    pub fn fingerprint(path: &Path, src: &[u8]) -> Fingerprint {
+        let meta = std::fs::metadata(path).ok();
+        Fingerprint {
+            mtime: meta.as_ref().and_then(|m| m.modified().ok()),
+            len: meta.map_or(src.len() as u64, |m| m.len()),
+            digest: Md5::digest(src).into(),
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.files.len()
+    }
+}
+
+/// Script files under `dir` in load order: `sys.lua` first, then the rest
+/// depth-first in directory order, skipping dot files.
+pub fn script_files(dir: &str) -> Vec<PathBuf> {
+    let mut out = Vec::new();
+    let sys = PathBuf::from(format!("{dir}/sys.lua"));
+    if sys.exists() {
+        out.push(sys);
+    }
+    walk(Path::new(dir), &mut out);
+    out
+}
+
+fn walk(dir: &Path, out: &mut Vec<PathBuf>) {
+    let Ok(rd) = std::fs::read_dir(dir) else { return };
+    for entry in rd.flatten() {
+        let path = entry.path();
+        let name = path.file_name().and_then(|n| n.to_str()).unwrap_or("");
+        if name.starts_with('.') || name == "sys.lua" {
+            continue;
+        }
+        if path.is_dir() {
+            if path.to_str().is_none() {
+                tracing::warn!("[scripting] skipping non-UTF8 directory path: {}", path.display());
+            }
+            walk(&path, out);
+        } else if path.extension().and_then(|e| e.to_str()) == Some("lua") {
+            out.push(path);
+        }
+    }
+}
+
+/// Bytecode cache in a directory; disabled when the directory is empty.
+pub struct BytecodeCache {
+    dir: Option<PathBuf>,
+    version: String,
+}
+
+impl BytecodeCache {
+    /// `version` identifies the LuaJIT build; bytecode of another build is
+    /// never loaded.
+    pub fn new(dir: &str, version: &str) -> Self {
+        let dir = (!dir.is_empty()).then(|| PathBuf::from(dir));
+        if let Some(d) = &dir {
+            if let Err(e) = std::fs::create_dir_all(d) {
+                tracing::warn!("[scripting] bytecode cache {} disabled: {e}", d.display());
+                return BytecodeCache { dir: None, version: version.into() };
+            }
+        }
+        BytecodeCache { dir, version: version.into() }
+    }
+
+    fn file(&self, path: &Path, src: &[u8]) -> Option<PathBuf> {
+        let mut h = Md5::new();
+        h.update(self.version.as_bytes());
+        h.update([0]);
+        h.update(path.to_string_lossy().as_bytes());
+        h.update([0]);
+        h.update(src);
+        Some(self.dir.as_ref()?.join(format!("{}.ljbc", hex::encode(h.finalize()))))
+    }
+
+    pub fn get(&self, path: &Path, src: &[u8]) -> Option<Vec<u8>> {
+        std::fs::read(self.file(path, src)?).ok()
+    }
+
+    /// Store `bytecode`; written to a temporary name first so a crash never
+    /// leaves a truncated entry.
+    pub fn put(&self, path: &Path, src: &[u8], bytecode: &[u8]) {
+        let Some(file) = self.file(path, src) else { return };
+        let tmp = file.with_extension("tmp");
+        if std::fs::write(&tmp, bytecode).and_then(|_| std::fs::rename(&tmp, &file)).is_err() {
+            let _ = std::fs::remove_file(&tmp);
+        }
+    }
+
+    /// Delete entries not among `keep` (file names), after a full load.
+    pub fn prune(&self, keep: &[(PathBuf, Vec<u8>)]) {
+        let Some(dir) = &self.dir else { return };
+        let live: std::collections::HashSet<PathBuf> =
+            keep.iter().filter_map(|(p, src)| self.file(p, src)).collect();
+        let Ok(rd) = std::fs::read_dir(dir) else { return };
+        for entry in rd.flatten() {
+            let p = entry.path();
+            if p.extension().and_then(|e| e.to_str()) == Some("ljbc") && !live.contains(&p) {
+                let _ = std::fs::remove_file(p);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_change_detection_and_cache() {
+        let root = std::env::temp_dir().join(format!("yuri_reload_{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&root);
+        std::fs::create_dir_all(root.join("scripts/npc")).unwrap();
+        let dir = root.join("scripts");
+        std::fs::write(dir.join("npc/guard.lua"), "guard = {}").unwrap();
+        std::fs::write(dir.join("sys.lua"), "sys = 1").unwrap();
+        std::fs::write(dir.join(".hidden.lua"), "x").unwrap();
+
+        let files = script_files(dir.to_str().unwrap());
+        assert_eq!(files.len(), 2);
+        assert!(files[0].ends_with("sys.lua"));
+
+        let mut loaded = Loaded::default();
+        for f in &files {
+            match loaded.check(f).unwrap() {
+                Check::Changed(fp, _) => loaded.record(f.clone(), fp),
+                _ => panic!("new file not reported as changed"),
+            }
+        }
+        assert!(matches!(loaded.check(&files[1]).unwrap(), Check::Unchanged));
+
+        // Same length, new content; the length-only check must not hide it
+        std::fs::write(&files[1], "guard = []").unwrap();
+        let mut fp = loaded.files[&files[1]];
+        fp.mtime = None;
+        loaded.record(files[1].clone(), fp);
+        assert!(matches!(loaded.check(&files[1]).unwrap(), Check::Changed(..)));
+        std::fs::write(&files[1], "guard = {}").unwrap();
+        assert!(matches!(loaded.check(&files[1]).unwrap(), Check::SameContent(_)));
+
+        let cache = BytecodeCache::new(root.join("cache").to_str().unwrap(), "LuaJIT 2.1");
+        assert_eq!(cache.get(&files[0], b"sys = 1"), None);
+        cache.put(&files[0], b"sys = 1", b"\x1bLJbytes");
+        assert_eq!(cache.get(&files[0], b"sys = 1").as_deref(), Some(&b"\x1bLJbytes"[..]));
+        assert_eq!(cache.get(&files[0], b"sys = 2"), None);
+        let other = BytecodeCache::new(root.join("cache").to_str().unwrap(), "LuaJIT 2.0");
+        assert_eq!(other.get(&files[0], b"sys = 1"), None);
+        cache.prune(&[]);
+        assert_eq!(cache.get(&files[0], b"sys = 1"), None);
+
+        let _ = std::fs::remove_dir_all(&root);
+    }
+}
@@ -0,0 +1,153 @@
+//! Per-tick Lua heap and collector figures.
+//!
+//! LuaJIT on 64-bit cannot take a custom allocator (see `sl_init`), so
+//! allocations are not counted one by one. Instead the heap size is sampled
+//! at the start of every game tick. Growth between two samples is what the
+//! tick allocated minus whatever the collector freed during it, so it is a
+//! lower bound on the allocation rate, and exact for ticks with no GC step.
+//!
+//! `GcStats` times the collector work the scripting layer starts itself:
+//! the incremental steps run in idle tick time (`sl_gc_idle`) and full
+//! collections (`sl_fixmem`). Steps LuaJIT takes on its own inside an
+//! allocation cannot be timed from here; fewer of them is the point of the
+//! idle steps.
+
+use std::time::Duration;
+
+/// Ticks averaged over.
+pub const WINDOW: usize = 100;
+
+#[derive(Clone, Copy, Default)]
+struct Sample {
+    growth: u64,
+    objects: u64,
+}
+
+/// Heap growth and userdata creation over the last `WINDOW` ticks.
+pub struct AllocRate {
+    samples: [Sample; WINDOW],
+    next: usize,
+    filled: usize,
+    last_heap: Option<usize>,
+    last_objects: u64,
+}
+
+impl Default for AllocRate {
+    fn default() -> Self {
+        AllocRate {
+            samples: [Sample::default(); WINDOW],
+            next: 0,
+            filled: 0,
+            last_heap: None,
+            last_objects: 0,
+        }
+    }
+}
+
+/// Averages per tick over the window.
+#[derive(Debug, Default, Clone, Copy, PartialEq)]
+pub struct RateStats {
+    pub heap_bytes: usize,
+    pub growth_per_tick: f64,
+    pub objects_per_tick: f64,
+}
+
+impl AllocRate {
+    /// Record a tick boundary: the heap is `heap` bytes and `objects`
+    /// block-list userdata have been created in total.
+    pub fn sample(&mut self, heap: usize, objects: u64) {
+        if let Some(last) = self.last_heap {
+            self.samples[self.next] = Sample {
+                growth: heap.saturating_sub(last) as u64,
+                objects: objects.saturating_sub(self.last_objects),
+            };
+            self.next = (self.next + 1) % WINDOW;
+            self.filled = (self.filled + 1).min(WINDOW);
+        }
+        self.last_heap = Some(heap);
+        self.last_objects = objects;
+    }
+
+    pub fn stats(&self) -> RateStats {
+        let n = self.filled.max(1) as f64;
+        let (growth, objects) = self.samples[..self.filled]
+            .iter()
+            .fold((0, 0), |(g, o), s| (g + s.growth, o + s.objects));
+        RateStats {
+            heap_bytes: self.last_heap.unwrap_or(0),
+            growth_per_tick: growth as f64 / n,
+            objects_per_tick: objects as f64 / n,
+        }
+    }
+}
+
+/// Collector work started by the scripting layer, and how long it paused
+/// the game loop.
+#[derive(Debug, Default, Clone, Copy, PartialEq, Eq)]
+pub struct GcStats {
+    pub steps: u64,
+    /// Cycles finished by an idle step
+    pub cycles: u64,
+    pub step_total: Duration,
+    pub step_max: Duration,
+    /// Ticks with too little idle time for a step
+    pub skipped: u64,
+    pub full: u64,
+    pub full_max: Duration,
+}
+
+impl GcStats {
+    pub fn record_step(&mut self, took: Duration, finished_cycle: bool) {
+        self.steps += 1;
+        self.cycles += finished_cycle as u64;
+        self.step_total += took;
+        self.step_max = self.step_max.max(took);
+    }
+
+    pub fn record_full(&mut self, took: Duration) {
+        self.full += 1;
+        self.full_max = self.full_max.max(took);
+    }
+
+    pub fn step_avg(&self) -> Duration {
+        self.step_total / self.steps.max(1) as u32
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_rate_over_window() {
+        let mut r = AllocRate::default();
+        assert_eq!(r.stats(), RateStats::default());
+        r.sample(1000, 0);
+        r.sample(1400, 2);
+        // A collection shrinks the heap; counts as no growth
+        r.sample(900, 2);
+        r.sample(1100, 6);
+        let s = r.stats();
+        assert_eq!(s.heap_bytes, 1100);
+        assert_eq!(s.growth_per_tick, 200.0);
+        assert_eq!(s.objects_per_tick, 2.0);
+
+        for _ in 0..WINDOW {
+            r.sample(1100, 6);
+        }
+        assert_eq!(r.stats().growth_per_tick, 0.0);
+    }
+
+    #[test]
+    fn test_gc_pauses() {
+        let mut g = GcStats::default();
+        assert_eq!(g.step_avg(), Duration::ZERO);
+        g.record_step(Duration::from_micros(100), false);
+        g.record_step(Duration::from_micros(300), true);
+        g.record_full(Duration::from_millis(4));
+        assert_eq!((g.steps, g.cycles, g.full), (2, 1, 1));
+        assert_eq!(g.step_avg(), Duration::from_micros(200));
+        assert_eq!(g.step_max, Duration::from_micros(300));
+        assert_eq!(g.full_max, Duration::from_millis(4));
+    }
+}
@@ -7,7 +7,8 @@ use crate::database::map_db::{BlockList, MapData};
 use crate::ffi::map_db::get_map_ptr;
 use crate::database::mob_db::MobDbData;
 use crate::game::mob::{
-    mob_calcstat, mob_warp, move_mob, move_mob_ignore_object, move_mob_intent, moveghost_mob,
+    mob_calcstat, mob_open_sides, mob_warp, move_mob, move_mob_ignore_object, move_mob_intent,
+    moveghost_mob,
     MobSpawnData, BL_MOB, BL_PC, MAX_MAGIC_TIMERS, MAX_THREATCOUNT,
 };
 use crate::game::scripting::ffi as sffi;
@@ -102,6 +103,9 @@ impl UserData for MobObject {
             if this.ptr.is_null() || this.deleted.load(Ordering::Acquire) {
                 return Ok(mlua::Value::Nil);
             }
+            // Method calls resolve through __index; a script may be about to
+            // change state the sleeping tick would not see.
+            crate::game::mob_sched::touch(this.ptr as usize);
             let mob = unsafe { &*(this.ptr as *const MobSpawnData) };
             let bl = &mob.bl;
             let ptr = this.ptr;
@@ -201,6 +205,17 @@ impl UserData for MobObject {
                         },
                     )?))
                 }
+                "openSides" => {
+                    let df = Arc::clone(&deleted);
+                    return Ok(mlua::Value::Function(lua.create_function(
+                        move |_, _: mlua::MultiValue| {
+                            if ptr.is_null() || df.load(Ordering::Acquire) {
+                                return Ok(0i32);
+                            }
+                            Ok(unsafe { mob_open_sides(ptr as *mut MobSpawnData) } as i32)
+                        },
+                    )?))
+                }
                 "moveIgnoreObject" => {
                     let df = Arc::clone(&deleted);
                     return Ok(mlua::Value::Function(lua.create_function(
@@ -872,6 +887,7 @@ impl UserData for MobObject {
                 if this.ptr.is_null() || this.deleted.load(Ordering::Acquire) {
                     return Ok(());
                 }
+                crate::game::mob_sched::touch(this.ptr as usize);
                 let mob = unsafe { &mut *(this.ptr as *mut MobSpawnData) };
                 let mp = unsafe { mob_map(mob as *const MobSpawnData) };
 
@@ -5,7 +5,7 @@ use mlua::{MetaMethod, UserData, UserDataMethods};
 
 use crate::database::map_db::{BlockList, MapData};
 use crate::ffi::map_db::get_map_ptr;
-use crate::game::npc::{NpcData, npc_move, npc_warp};
+use crate::game::npc::{NpcData, npc_move, npc_timers_update, npc_warp};
 use crate::game::scripting::ffi as sffi;
 use crate::game::scripting::types::mob::MobObject;
 use crate::game::scripting::types::pc::PcObject;
@@ -508,8 +508,15 @@ impl UserData for NpcObject {
                 "skinColor"   => nd.skin_color  = val_to_int(&val) as u16,
                 "armorColor"  => nd.armor_color = val_to_int(&val) as u16,
                 "lastAction"  => nd.lastaction  = val_to_int(&val) as u32,
-                "actionTime"  => nd.actiontime  = val_to_int(&val) as u32,
-                "duration"    => nd.duration    = val_to_int(&val) as u32,
+                // Timer intervals: keep the NPC timer queue in step.
+                "actionTime"  => {
+                    let v = val_to_int(&val) as u32;
+                    unsafe { npc_timers_update(nd, |nd| nd.actiontime = v); }
+                }
+                "duration"    => {
+                    let v = val_to_int(&val) as u32;
+                    unsafe { npc_timers_update(nd, |nd| nd.duration = v); }
+                }
                 "returning"   => nd.returning   = val_to_int(&val) as _,
                 // GfxViewer fields — delegated to shared module.
                 key if key.starts_with("gfx") && key != "gfxClone" => {
@@ -20,6 +20,18 @@ pub mod database;
 pub mod servers;
 /// Session management (replaces session.c)
 pub mod session;
+/// Timing wheel shared by the DDoS tracker and the floor item sweep
+pub mod expiry_wheel;
+/// Per-callback timer costs and slow-tick logging (timer_do)
+pub mod timer_stats;
+/// Prometheus text endpoint of the three servers
+pub mod metrics;
+/// Map-server packet capture and replay
+pub mod capture;
+/// Rate-limited, asynchronous sink for C log lines
+pub mod c_log;
+/// Opt-in sampling profiler writing folded stacks
+pub mod profiler;
 
 // ============================================
 // FFI Layer (Temporary - for C interop)
@@ -0,0 +1,324 @@
+//! Prometheus text endpoint shared by the login, char and map servers.
+//!
+//! Each server registers collectors that write its gauges and counters into
+//! a `Writer` when `/metrics` is scraped, and `serve` answers scrapes on the
+//! server's own tokio runtime. Nothing here runs until a scrape arrives:
+//! hot paths only bump relaxed atomics (`Histogram::observe`, the counters
+//! of `network::opcode_stats`), and state owned by the game thread is copied
+//! out by that thread (see `game::metrics`) rather than read from here.
+//!
+//! Rates such as packets per second are exported as `_total` counters; the
+//! scraper derives the rate (`rate(yuri_packets_total[1m])`).
+
+use std::fmt::Write as _;
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+use std::sync::{Mutex, OnceLock};
+use std::time::Duration;
+
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpStream};
+
+/// Longest request head read before answering.
+const MAX_REQUEST: usize = 4096;
+/// Scrapers that stall sending their request are dropped after this.
+const READ_TIMEOUT: Duration = Duration::from_secs(5);
+
+/// Bucket bounds of a tick histogram, in µs: 1 ms to 1 s.
+pub const TICK_BOUNDS_US: [u64; 10] =
+    [1_000, 2_000, 5_000, 10_000, 20_000, 50_000, 100_000, 200_000, 500_000, 1_000_000];
+
+/// An atomic histogram over fixed upper bounds in µs. Bucket `i` counts
+/// observations at or under `bounds[i]` and over the bound before it;
+/// observations past the last bound only count towards `count`.
+pub struct Histogram<const N: usize> {
+    bounds: [u64; N],
+    buckets: [AtomicU64; N],
+    count: AtomicU64,
+    sum_ns: AtomicU64,
+}
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU64 = AtomicU64::new(0);
+
+impl<const N: usize> Histogram<N> {
+    pub const fn new(bounds: [u64; N]) -> Self {
+        Histogram { bounds, buckets: [ZERO; N], count: ZERO, sum_ns: ZERO }
+    }
+
+    pub fn observe(&self, d: Duration) {
+        let ns = d.as_nanos().min(u64::MAX as u128) as u64;
+        let us = ns / 1000;
+        if let Some(i) = self.bounds.iter().position(|&b| us <= b) {
+            self.buckets[i].fetch_add(1, Relaxed);
+        }
+        self.count.fetch_add(1, Relaxed);
+        self.sum_ns.fetch_add(ns, Relaxed);
+    }
+
+    /// Cumulative counts per bound, the total count and the sum in seconds,
+    /// as the exposition format wants them.
+    pub fn snapshot(&self) -> HistSnapshot {
+        let mut seen = 0;
+        let buckets = self
+            .bounds
+            .iter()
+            .zip(&self.buckets)
+            .map(|(&b, n)| {
+                seen += n.load(Relaxed);
+                (b as f64 / 1e6, seen)
+            })
+            .collect();
+        HistSnapshot {
+            buckets,
+            count: self.count.load(Relaxed).max(seen),
+            sum: self.sum_ns.load(Relaxed) as f64 / 1e9,
+        }
+    }
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct HistSnapshot {
+    /// (upper bound in seconds, observations at or under it)
+    pub buckets: Vec<(f64, u64)>,
+    pub count: u64,
+    pub sum: f64,
+}
+
+/// Duration of every map-server loop tick: timers, pending connections and
+/// the end-of-tick flush.
+pub static TICK_SECONDS: Histogram<10> = Histogram::new(TICK_BOUNDS_US);
+
+/// Builds one scrape in the text exposition format (version 0.0.4).
+#[derive(Default)]
+pub struct Writer {
+    out: String,
+}
+
+impl Writer {
+    /// Start the metric `name`; its samples follow with `sample`.
+    pub fn family(&mut self, name: &str, kind: &str, help: &str) {
+        let _ = writeln!(self.out, "# HELP {name} {help}");
+        let _ = writeln!(self.out, "# TYPE {name} {kind}");
+    }
+
+    pub fn sample(&mut self, name: &str, labels: &[(&str, &str)], v: f64) {
+        self.out.push_str(name);
+        if !labels.is_empty() {
+            self.out.push('{');
+            for (i, (k, val)) in labels.iter().enumerate() {
+                if i > 0 {
+                    self.out.push(',');
+                }
+                let _ = write!(self.out, "{k}=\"");
+                for c in val.chars() {
+                    match c {
+                        '\\' => self.out.push_str("\\\\"),
+                        '"' => self.out.push_str("\\\""),
+                        '\n' => self.out.push_str("\\n"),
+                        c => self.out.push(c),
+                    }
+                }
+                self.out.push('"');
+            }
+            self.out.push('}');
+        }
+        let _ = writeln!(self.out, " {v}");
+    }
+
+    pub fn gauge(&mut self, name: &str, help: &str, v: f64) {
+        self.family(name, "gauge", help);
+        self.sample(name, &[], v);
+    }
+
+    pub fn counter(&mut self, name: &str, help: &str, v: u64) {
+        self.family(name, "counter", help);
+        self.sample(name, &[], v as f64);
+    }
+
+    pub fn histogram(&mut self, name: &str, help: &str, h: &HistSnapshot) {
+        self.family(name, "histogram", help);
+        let bucket = format!("{name}_bucket");
+        for (le, n) in &h.buckets {
+            self.sample(&bucket, &[("le", &le.to_string())], *n as f64);
+        }
+        self.sample(&bucket, &[("le", "+Inf")], h.count as f64);
+        self.sample(&format!("{name}_sum"), &[], h.sum);
+        self.sample(&format!("{name}_count"), &[], h.count as f64);
+    }
+
+    pub fn finish(self) -> String {
+        self.out
+    }
+}
+
+type Collector = Box<dyn Fn(&mut Writer) + Send + Sync>;
+
+fn collectors() -> &'static Mutex<Vec<Collector>> {
+    static COLLECTORS: OnceLock<Mutex<Vec<Collector>>> = OnceLock::new();
+    COLLECTORS.get_or_init(Default::default)
+}
+
+/// Run `f` on every scrape. Collectors run on a runtime worker, never on the
+/// game thread.
+pub fn register(f: impl Fn(&mut Writer) + Send + Sync + 'static) {
+    collectors().lock().unwrap_or_else(|e| e.into_inner()).push(Box::new(f));
+}
+
+/// One scrape of every registered collector.
+pub fn render() -> String {
+    let mut w = Writer::default();
+    for f in collectors().lock().unwrap_or_else(|e| e.into_inner()).iter() {
+        f(&mut w);
+    }
+    w.finish()
+}
+
+/// Connections of a server's sqlx pool.
+pub fn db_pool(w: &mut Writer, pool: &sqlx::MySqlPool) {
+    w.gauge("yuri_db_pool_connections", "Open DB pool connections", pool.size() as f64);
+    w.gauge("yuri_db_pool_idle", "Idle DB pool connections", pool.num_idle() as f64);
+}
+
+/// Packet counters of `network::opcode_stats`, per direction and opcode.
+pub fn register_packets() {
+    use crate::network::opcode_stats::{stats, Dir};
+    register(|w| {
+        for (name, help, bytes) in [
+            ("yuri_packets_total", "Client packets by direction and opcode", false),
+            ("yuri_packet_bytes_total", "Client packet bytes by direction and opcode", true),
+        ] {
+            w.family(name, "counter", help);
+            for (dir, label) in [(Dir::In, "in"), (Dir::Out, "out")] {
+                for (op, s) in stats().snapshot(dir) {
+                    let op = format!("0x{op:02X}");
+                    let v = if bytes { s.bytes } else { s.count };
+                    w.sample(name, &[("dir", label), ("op", &op)], v as f64);
+                }
+            }
+        }
+    });
+}
+
+/// Answer `GET /metrics` on `addr` until the runtime shuts down. A bind
+/// failure is logged and leaves the server running without metrics.
+pub async fn serve(addr: String) {
+    let listener = match TcpListener::bind(&addr).await {
+        Ok(l) => l,
+        Err(e) => {
+            tracing::error!("[metrics] cannot listen on {addr}: {e}");
+            return;
+        }
+    };
+    tracing::info!("[metrics] listening on {addr}");
+    loop {
+        match listener.accept().await {
+            Ok((stream, _)) => {
+                tokio::spawn(async move {
+                    if let Err(e) = answer(stream).await {
+                        tracing::debug!("[metrics] scrape failed: {e}");
+                    }
+                });
+            }
+            Err(e) => {
+                tracing::warn!("[metrics] accept failed: {e}");
+                tokio::time::sleep(Duration::from_millis(100)).await;
+            }
+        }
+    }
+}
+
+/// Start `serve` on the current runtime if `port` is set.
+pub fn spawn(ip: &str, port: u16) {
+    if port != 0 {
+        tokio::spawn(serve(format!("{ip}:{port}")));
+    }
+}
+
+async fn answer(mut stream: TcpStream) -> std::io::Result<()> {
+    let mut buf = Vec::with_capacity(512);
+    let mut chunk = [0u8; 512];
+    while !buf.windows(4).any(|w| w == b"\r\n\r\n") && buf.len() < MAX_REQUEST {
+        let n = tokio::time::timeout(READ_TIMEOUT, stream.read(&mut chunk))
+            .await
+            .map_err(|_| std::io::ErrorKind::TimedOut)??;
+        if n == 0 {
+            break;
+        }
+        buf.extend_from_slice(&chunk[..n]);
+    }
+    let (status, body) = if is_scrape(&buf) {
+        ("200 OK", render())
+    } else {
+        ("404 Not Found", String::from("not found\n"))
+    };
+    let head = format!(
+        "HTTP/1.1 {status}\r\nContent-Type: text/plain; version=0.0.4\r\n\
+         Content-Length: {}\r\nConnection: close\r\n\r\n",
+        body.len()
+    );
+    stream.write_all(head.as_bytes()).await?;
+    stream.write_all(body.as_bytes()).await?;
+    stream.shutdown().await
+}
+
+/// Whether the request line asks for the metrics page.
+fn is_scrape(req: &[u8]) -> bool {
+    let line = req.split(|&b| b == b'\r' || b == b'\n').next().unwrap_or_default();
+    let mut parts = line.split(|&b| b == b' ');
+    let (Some(method), Some(path)) = (parts.next(), parts.next()) else { return false };
+    let path = path.split(|&b| b == b'?').next().unwrap_or_default();
+    method == b"GET" && (path == b"/metrics" || path == b"/")
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_histogram_is_cumulative() {
+        let h = Histogram::new([1_000, 10_000]);
+        h.observe(Duration::from_micros(500));
+        h.observe(Duration::from_micros(1_000));
+        h.observe(Duration::from_millis(5));
+        h.observe(Duration::from_secs(1));
+        let s = h.snapshot();
+        assert_eq!(s.buckets, vec![(0.001, 2), (0.01, 3)]);
+        assert_eq!(s.count, 4);
+        assert!((s.sum - 1.0065).abs() < 1e-9);
+    }
+
+    #[test]
+    fn test_exposition_format() {
+        let h = Histogram::new([1_000]);
+        h.observe(Duration::from_micros(250));
+        let mut w = Writer::default();
+        w.gauge("yuri_online", "Sessions online", 3.0);
+        w.family("yuri_map_users", "gauge", "Players per map");
+        w.sample("yuri_map_users", &[("map", "1"), ("name", "Kugnae \"East\"")], 2.0);
+        w.histogram("yuri_tick_seconds", "Tick duration", &h.snapshot());
+        assert_eq!(
+            w.finish(),
+            "# HELP yuri_online Sessions online\n\
+             # TYPE yuri_online gauge\n\
+             yuri_online 3\n\
+             # HELP yuri_map_users Players per map\n\
+             # TYPE yuri_map_users gauge\n\
+             yuri_map_users{map=\"1\",name=\"Kugnae \\\"East\\\"\"} 2\n\
+             # HELP yuri_tick_seconds Tick duration\n\
+             # TYPE yuri_tick_seconds histogram\n\
+             yuri_tick_seconds_bucket{le=\"0.001\"} 1\n\
+             yuri_tick_seconds_bucket{le=\"+Inf\"} 1\n\
+             yuri_tick_seconds_sum 0.00025\n\
+             yuri_tick_seconds_count 1\n"
+        );
+    }
+
+    #[test]
+    fn test_is_scrape() {
+        assert!(is_scrape(b"GET /metrics HTTP/1.1\r\nHost: x\r\n\r\n"));
+        assert!(is_scrape(b"GET /metrics?x=1 HTTP/1.0\r\n\r\n"));
+        assert!(!is_scrape(b"POST /metrics HTTP/1.1\r\n\r\n"));
+        assert!(!is_scrape(b"GET /other HTTP/1.1\r\n\r\n"));
+        assert!(!is_scrape(b""));
+    }
+}
@@ -0,0 +1,189 @@
+//! Size-class buffer pool for session I/O
+//!
+//! Session rdata/wdata buffers are taken from here when a connection starts
+//! (or wakes up after an idle trim) and handed back when the session closes
+//! or goes quiet, so idle connections do not each pin 16 KB+ of buffers and
+//! new connections reuse pre-warmed allocations instead of hitting malloc.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+
+/// Buffer capacities handed out by the pool, smallest first.
+pub const SIZE_CLASSES: [usize; 3] = [4 * 1024, 16 * 1024, 64 * 1024];
+
+/// Most buffers kept per class; anything returned beyond this is freed.
+const MAX_POOLED: [usize; 3] = [1024, 512, 64];
+
+/// Snapshot of pool counters
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct PoolStats {
+    /// take() served from a free list
+    pub hits: u64,
+    /// take() had to allocate
+    pub misses: u64,
+    /// give() kept the buffer
+    pub returned: u64,
+    /// give() freed the buffer (class full or size not poolable)
+    pub dropped: u64,
+    /// Buffers currently pooled, per class
+    pub pooled: [usize; 3],
+}
+
+pub struct BufferPool {
+    free: [Mutex<Vec<Vec<u8>>>; 3],
+    hits: AtomicU64,
+    misses: AtomicU64,
+    returned: AtomicU64,
+    dropped: AtomicU64,
+}
+
+impl BufferPool {
+    pub fn new() -> Self {
+        Self {
+            free: [Mutex::new(Vec::new()), Mutex::new(Vec::new()), Mutex::new(Vec::new())],
+            hits: AtomicU64::new(0),
+            misses: AtomicU64::new(0),
+            returned: AtomicU64::new(0),
+            dropped: AtomicU64::new(0),
+        }
+    }
+
+    /// Class index for a request of `min` bytes (smallest class that fits)
+    fn class_for_take(min: usize) -> Option<usize> {
+        SIZE_CLASSES.iter().position(|&size| size >= min)
+    }
+
+    /// Class index for a returned buffer (largest class it can serve)
+    fn class_for_give(capacity: usize) -> Option<usize> {
+        // Buffers that grew far past the largest class (bursty inter-server
+        // writes) would waste memory if pooled as a 64 KB buffer.
+        if capacity > SIZE_CLASSES[SIZE_CLASSES.len() - 1] * 2 {
+            return None;
+        }
+        SIZE_CLASSES.iter().rposition(|&size| size <= capacity)
+    }
+
+    /// Take an empty buffer with capacity of at least `min` bytes.
+    pub fn take(&self, min: usize) -> Vec<u8> {
+        let Some(class) = Self::class_for_take(min) else {
+            self.misses.fetch_add(1, Ordering::Relaxed);
+            return Vec::with_capacity(min);
+        };
+        if let Some(buf) = self.free[class].lock().unwrap().pop() {
+            self.hits.fetch_add(1, Ordering::Relaxed);
+            return buf;
+        }
+        self.misses.fetch_add(1, Ordering::Relaxed);
+        Vec::with_capacity(SIZE_CLASSES[class])
+    }
+
+    /// Return a buffer. Its contents are discarded.
+    pub fn give(&self, mut buf: Vec<u8>) {
+        let Some(class) = Self::class_for_give(buf.capacity()) else {
+            if buf.capacity() > 0 {
+                self.dropped.fetch_add(1, Ordering::Relaxed);
+            }
+            return;
+        };
+        buf.clear();
+        let mut free = self.free[class].lock().unwrap();
+        if free.len() < MAX_POOLED[class] {
+            free.push(buf);
+            self.returned.fetch_add(1, Ordering::Relaxed);
+        } else {
+            self.dropped.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    /// Pre-allocate up to `count` buffers of the class serving `size` bytes.
+    pub fn prewarm(&self, size: usize, count: usize) {
+        let Some(class) = Self::class_for_take(size) else { return };
+        let mut free = self.free[class].lock().unwrap();
+        let target = count.min(MAX_POOLED[class]);
+        while free.len() < target {
+            free.push(Vec::with_capacity(SIZE_CLASSES[class]));
+        }
+    }
+
+    pub fn stats(&self) -> PoolStats {
+        PoolStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+            returned: self.returned.load(Ordering::Relaxed),
+            dropped: self.dropped.load(Ordering::Relaxed),
+            pooled: [
+                self.free[0].lock().unwrap().len(),
+                self.free[1].lock().unwrap().len(),
+                self.free[2].lock().unwrap().len(),
+            ],
+        }
+    }
+}
+
+impl PoolStats {
+    /// Bytes held by the pooled buffers.
+    pub fn pooled_bytes(&self) -> usize {
+        self.pooled.iter().zip(SIZE_CLASSES).map(|(n, size)| n * size).sum()
+    }
+}
+
+impl Default for BufferPool {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+static POOL: OnceLock<BufferPool> = OnceLock::new();
+
+/// Shared pool used by the session layer
+pub fn pool() -> &'static BufferPool {
+    POOL.get_or_init(BufferPool::new)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_take_rounds_up_to_class() {
+        let pool = BufferPool::new();
+        assert!(pool.take(100).capacity() >= 4 * 1024);
+        assert!(pool.take(5000).capacity() >= 16 * 1024);
+        // Larger than every class: plain allocation
+        assert!(pool.take(1 << 20).capacity() >= 1 << 20);
+        assert_eq!(pool.stats().misses, 3);
+    }
+
+    #[test]
+    fn test_give_then_take_reuses_buffer() {
+        let pool = BufferPool::new();
+        let mut buf = pool.take(16 * 1024);
+        buf.extend_from_slice(b"stale");
+        let ptr = buf.as_ptr();
+        pool.give(buf);
+
+        let again = pool.take(16 * 1024);
+        assert_eq!(again.as_ptr(), ptr);
+        assert!(again.is_empty());
+        let stats = pool.stats();
+        assert_eq!(stats.hits, 1);
+        assert_eq!(stats.returned, 1);
+    }
+
+    #[test]
+    fn test_give_drops_unpoolable_buffers() {
+        let pool = BufferPool::new();
+        pool.give(Vec::with_capacity(1024)); // below the smallest class
+        pool.give(Vec::with_capacity(4 * 1024 * 1024)); // far above the largest
+        let stats = pool.stats();
+        assert_eq!(stats.dropped, 2);
+        assert_eq!(stats.pooled, [0, 0, 0]);
+    }
+
+    #[test]
+    fn test_prewarm_respects_class_limit() {
+        let pool = BufferPool::new();
+        pool.prewarm(64 * 1024, 10_000);
+        assert_eq!(pool.stats().pooled[2], MAX_POOLED[2]);
+    }
+}
@@ -1,4 +1,6 @@
 use md5::{Digest, Md5};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::OnceLock;
 
 /// Opcodes that use key1 (static XOR) on the client side.
 const CL_KEY1_PACKETS: &[u8] = &[2, 3, 4, 11, 21, 38, 58, 66, 67, 75, 80, 87, 98, 113, 115, 123];
@@ -128,6 +130,79 @@ pub fn generate_key2(packet: &[u8], table: &[u8], keyout: &mut [u8; 10], fromcli
     keyout[9] = 0;
 }
 
+/// Number of keys remembered per session.
+pub const CRYPT_KEY_CACHE_SLOTS: usize = 8;
+const _: () = assert!(CRYPT_KEY_CACHE_SLOTS.is_power_of_two());
+
+/// Per-session cache of generate_key2 results.
+///
+/// Embedded in USER next to `EncHash` (a zeroed struct is an empty cache).
+/// A key depends only on the session's table, the direction and the three
+/// index bytes in the packet trailer. The table is fixed for the session,
+/// so the trailer bytes plus direction are the whole cache key. Server-bound
+/// packets always carry the same trailer (see set_packet_indexes), so
+/// encrypt() hits every time after the first packet.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct CryptKeyCache {
+    /// Per slot: 1<<25 (valid) | fromclient<<24 | k1<<16 | k2
+    pub tags: [u32; CRYPT_KEY_CACHE_SLOTS],
+    /// Cached 9-byte keys
+    pub keys: [[u8; 9]; CRYPT_KEY_CACHE_SLOTS],
+    /// Lookups served from this cache
+    pub hits: u32,
+    /// Lookups that had to derive the key
+    pub misses: u32,
+}
+
+impl CryptKeyCache {
+    pub const EMPTY: CryptKeyCache = CryptKeyCache {
+        tags: [0; CRYPT_KEY_CACHE_SLOTS],
+        keys: [[0; 9]; CRYPT_KEY_CACHE_SLOTS],
+        hits: 0,
+        misses: 0,
+    };
+}
+
+/// Hits/misses over every session since startup.
+static KEY_CACHE_HITS: AtomicU64 = AtomicU64::new(0);
+static KEY_CACHE_MISSES: AtomicU64 = AtomicU64::new(0);
+
+/// Process-wide (hits, misses) of generate_key2_cached.
+pub fn key_cache_totals() -> (u64, u64) {
+    (KEY_CACHE_HITS.load(Ordering::Relaxed), KEY_CACHE_MISSES.load(Ordering::Relaxed))
+}
+
+/// generate_key2 through a session's key cache.
+pub fn generate_key2_cached(
+    packet: &[u8],
+    table: &[u8],
+    cache: &mut CryptKeyCache,
+    keyout: &mut [u8; 10],
+    fromclient: bool,
+) {
+    let psize = ((packet[1] as usize) << 8) | (packet[2] as usize);
+    let k1 = packet[psize + 1] as u32;
+    let k2 = ((packet[psize + 2] as u32) << 8) | (packet[psize] as u32);
+    let tag = (1 << 25) | ((fromclient as u32) << 24) | (k1 << 16) | k2;
+    // Fibonacci hash: top bits of tag * 2^32/phi pick the slot
+    let slot = (tag.wrapping_mul(0x9E37_79B1) >> (32 - CRYPT_KEY_CACHE_SLOTS.trailing_zeros())) as usize;
+
+    if cache.tags[slot] == tag {
+        cache.hits = cache.hits.wrapping_add(1);
+        KEY_CACHE_HITS.fetch_add(1, Ordering::Relaxed);
+        keyout[..9].copy_from_slice(&cache.keys[slot]);
+        keyout[9] = 0;
+        return;
+    }
+
+    generate_key2(packet, table, keyout, fromclient);
+    cache.tags[slot] = tag;
+    cache.keys[slot].copy_from_slice(&keyout[..9]);
+    cache.misses = cache.misses.wrapping_add(1);
+    KEY_CACHE_MISSES.fetch_add(1, Ordering::Relaxed);
+}
+
 /// XOR-encrypts/decrypts packet data in-place using a 9-byte key.
 /// Mirrors C `tk_crypt_dynamic`.
 ///
@@ -139,7 +214,6 @@ pub fn tk_crypt_dynamic(buff: &mut [u8], key: &[u8]) {
     // C uses a fixed 9-byte key array (null-padded); mirror that by padding here
     let mut k9 = [0u8; 9];
     k9[..key.len().min(9)].copy_from_slice(&key[..key.len().min(9)]);
-    let key = &k9;
 
     let packet_len = (((buff[1] as u32) << 8) | (buff[2] as u32)).saturating_sub(5) as usize;
     let packet_inc = buff[4];
@@ -148,23 +222,146 @@ pub fn tk_crypt_dynamic(buff: &mut [u8], key: &[u8]) {
         return;
     }
 
-    let data = &mut buff[5..5 + packet_len];
-    let mut group: u32 = 0;
-    let mut group_count: u32 = 0;
+    (crypt_kernel().run)(&mut buff[5..5 + packet_len], &k9, packet_inc);
+}
+
+/// Name of the tk_crypt kernel picked for this CPU ("avx2", "sse2" or "scalar").
+pub fn crypt_kernel_name() -> &'static str {
+    crypt_kernel().name
+}
+
+// ─── Kernels ────────────────────────────────────────────────────────────────
+//
+// Byte i of the body is XORed with
+//     key[i % 9] ^ inc ^ (g != inc ? g : 0),   g = (i / 9) mod 256
+//
+// 144 and 288 are multiples of both 9 and the vector width, so every SIMD
+// block starts on a key and group boundary: the key part is one fixed
+// pattern per call, and the group part is a constant j/9 table plus the
+// block's first group number (u8 lanes wrap mod 256 for free).
+
+struct CryptKernel {
+    name: &'static str,
+    run: fn(&mut [u8], &[u8; 9], u8),
+}
+
+static KERNEL: OnceLock<CryptKernel> = OnceLock::new();
 
-    for i in 0..packet_len {
-        data[i] ^= key[i % 9];
-        let key_val = (group % 256) as u8;
-        if key_val != packet_inc {
-            data[i] ^= key_val;
+fn crypt_kernel() -> &'static CryptKernel {
+    KERNEL.get_or_init(select_kernel)
+}
+
+fn select_kernel() -> CryptKernel {
+    #[cfg(target_arch = "x86_64")]
+    {
+        if is_x86_feature_detected!("avx2") {
+            return CryptKernel { name: "avx2", run: simd::avx2 };
+        }
+        // SSE2 is part of the x86_64 baseline
+        return CryptKernel { name: "sse2", run: simd::sse2 };
+    }
+    #[allow(unreachable_code)]
+    CryptKernel { name: "scalar", run: crypt_scalar }
+}
+
+/// Portable kernel; also the reference the SIMD kernels are tested against.
+fn crypt_scalar(data: &mut [u8], key: &[u8; 9], inc: u8) {
+    crypt_scalar_from(data, 0, key, inc);
+}
+
+/// Scalar kernel for `data` starting at body offset `start`.
+fn crypt_scalar_from(data: &mut [u8], start: usize, key: &[u8; 9], inc: u8) {
+    for (j, byte) in data.iter_mut().enumerate() {
+        let i = start + j;
+        let group = (i / 9) as u8;
+        *byte ^= key[i % 9] ^ inc ^ if group != inc { group } else { 0 };
+    }
+}
+
+/// j / 9 for one AVX2 block (the SSE2 block uses the first half).
+const GROUP_INDEX: [u8; 288] = {
+    let mut table = [0u8; 288];
+    let mut j = 0;
+    while j < 288 {
+        table[j] = (j / 9) as u8;
+        j += 1;
+    }
+    table
+};
+
+#[cfg(target_arch = "x86_64")]
+mod simd {
+    use super::{crypt_scalar_from, GROUP_INDEX};
+    use std::arch::x86_64::*;
+
+    const SSE2_BLOCK: usize = 144;
+    const AVX2_BLOCK: usize = 288;
+
+    pub(super) fn sse2(data: &mut [u8], key: &[u8; 9], inc: u8) {
+        // SAFETY: SSE2 is always available on x86_64
+        unsafe { crypt_sse2(data, key, inc) }
+    }
+
+    pub(super) fn avx2(data: &mut [u8], key: &[u8; 9], inc: u8) {
+        // SAFETY: only selected (or tested) after is_x86_feature_detected!("avx2")
+        unsafe { crypt_avx2(data, key, inc) }
+    }
+
+    /// key[j % 9] ^ inc over one block
+    fn key_pattern<const N: usize>(key: &[u8; 9], inc: u8) -> [u8; N] {
+        let mut pattern = [0u8; N];
+        for (j, k) in pattern.iter_mut().enumerate() {
+            *k = key[j % 9] ^ inc;
         }
-        data[i] ^= packet_inc;
+        pattern
+    }
 
-        group_count += 1;
-        if group_count == 9 {
-            group += 1;
-            group_count = 0;
+    #[target_feature(enable = "sse2")]
+    unsafe fn crypt_sse2(data: &mut [u8], key: &[u8; 9], inc: u8) {
+        let blocks = data.len() / SSE2_BLOCK;
+        if blocks == 0 {
+            return crypt_scalar_from(data, 0, key, inc);
         }
+        let pattern = key_pattern::<SSE2_BLOCK>(key, inc);
+        let vinc = _mm_set1_epi8(inc as i8);
+        for b in 0..blocks {
+            // 16 groups per block
+            let g0 = _mm_set1_epi8((b * 16) as u8 as i8);
+            let base = data.as_mut_ptr().add(b * SSE2_BLOCK);
+            for off in (0..SSE2_BLOCK).step_by(16) {
+                let g = _mm_add_epi8(_mm_loadu_si128(GROUP_INDEX.as_ptr().add(off) as *const __m128i), g0);
+                let g = _mm_andnot_si128(_mm_cmpeq_epi8(g, vinc), g);
+                let k = _mm_loadu_si128(pattern.as_ptr().add(off) as *const __m128i);
+                let p = base.add(off) as *mut __m128i;
+                _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), _mm_xor_si128(k, g)));
+            }
+        }
+        let done = blocks * SSE2_BLOCK;
+        crypt_scalar_from(&mut data[done..], done, key, inc);
+    }
+
+    #[target_feature(enable = "avx2")]
+    unsafe fn crypt_avx2(data: &mut [u8], key: &[u8; 9], inc: u8) {
+        let blocks = data.len() / AVX2_BLOCK;
+        if blocks == 0 {
+            return crypt_sse2(data, key, inc);
+        }
+        let pattern = key_pattern::<AVX2_BLOCK>(key, inc);
+        let vinc = _mm256_set1_epi8(inc as i8);
+        for b in 0..blocks {
+            // 32 groups per block
+            let g0 = _mm256_set1_epi8((b * 32) as u8 as i8);
+            let base = data.as_mut_ptr().add(b * AVX2_BLOCK);
+            for off in (0..AVX2_BLOCK).step_by(32) {
+                let g = _mm256_add_epi8(_mm256_loadu_si256(GROUP_INDEX.as_ptr().add(off) as *const __m256i), g0);
+                let g = _mm256_andnot_si256(_mm256_cmpeq_epi8(g, vinc), g);
+                let k = _mm256_loadu_si256(pattern.as_ptr().add(off) as *const __m256i);
+                let p = base.add(off) as *mut __m256i;
+                _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), _mm256_xor_si256(k, g)));
+            }
+        }
+        let done = blocks * AVX2_BLOCK;
+        crypt_scalar_from(&mut data[done..], done, key, inc);
     }
 }
 
@@ -225,4 +422,159 @@ mod tests {
         tk_crypt_dynamic(&mut packet, key); // XOR twice = identity
         assert_eq!(&packet[5..], original);
     }
+
+    /// The original byte loop, kept verbatim as the bit-exact reference.
+    fn legacy_crypt(data: &mut [u8], key: &[u8; 9], packet_inc: u8) {
+        let mut group: u32 = 0;
+        let mut group_count: u32 = 0;
+        for i in 0..data.len() {
+            data[i] ^= key[i % 9];
+            let key_val = (group % 256) as u8;
+            if key_val != packet_inc {
+                data[i] ^= key_val;
+            }
+            data[i] ^= packet_inc;
+            group_count += 1;
+            if group_count == 9 {
+                group += 1;
+                group_count = 0;
+            }
+        }
+    }
+
+    /// xorshift64*: deterministic inputs without a dev-dependency
+    struct Rng(u64);
+
+    impl Rng {
+        fn next(&mut self) -> u64 {
+            self.0 ^= self.0 >> 12;
+            self.0 ^= self.0 << 25;
+            self.0 ^= self.0 >> 27;
+            self.0.wrapping_mul(0x2545_F491_4F6C_DD1D)
+        }
+
+        fn fill(&mut self, buf: &mut [u8]) {
+            for b in buf {
+                *b = self.next() as u8;
+            }
+        }
+    }
+
+    fn kernels() -> Vec<(&'static str, fn(&mut [u8], &[u8; 9], u8))> {
+        let mut list: Vec<(&'static str, fn(&mut [u8], &[u8; 9], u8))> =
+            vec![("scalar", crypt_scalar), ("dispatch", crypt_kernel().run)];
+        #[cfg(target_arch = "x86_64")]
+        {
+            list.push(("sse2", simd::sse2));
+            if is_x86_feature_detected!("avx2") {
+                list.push(("avx2", simd::avx2));
+            }
+        }
+        list
+    }
+
+    #[test]
+    fn test_kernels_match_legacy_loop() {
+        let mut rng = Rng(0x9E37_79B9_7F4A_7C15);
+        // Block edges, the 2304-byte keystream period, and the largest body
+        let mut lengths = vec![0, 1, 8, 9, 15, 16, 31, 32, 143, 144, 145, 287, 288, 289, 2303, 2304, 2305, 65530];
+        lengths.extend((0..200).map(|_| (rng.next() % 6000) as usize));
+
+        for len in lengths {
+            let mut key = [0u8; 9];
+            rng.fill(&mut key);
+            // Small inc values collide with group numbers, exercising the g == inc lane
+            let inc = if rng.next() % 2 == 0 { (rng.next() % 40) as u8 } else { rng.next() as u8 };
+            let mut input = vec![0u8; len];
+            rng.fill(&mut input);
+
+            let mut expected = input.clone();
+            legacy_crypt(&mut expected, &key, inc);
+
+            for (name, kernel) in kernels() {
+                let mut got = input.clone();
+                kernel(&mut got, &key, inc);
+                assert!(got == expected, "{} kernel differs: len={} inc={} key={:?}", name, len, inc, key);
+            }
+        }
+    }
+
+    #[test]
+    fn test_kernels_leave_bytes_past_body_alone() {
+        let key = *b"Urk#nI7ni";
+        let mut buf = vec![0x5Au8; 1000];
+        for (_, kernel) in kernels() {
+            kernel(&mut buf[..700], &key, 3);
+            kernel(&mut buf[..700], &key, 3);
+            assert!(buf.iter().all(|&b| b == 0x5A));
+        }
+    }
+
+    /// Packet with a 3-byte trailer (k2 lo, k1, k2 hi) after `body` bytes
+    fn trailer_packet(body: usize, k1: u8, k2: u16) -> Vec<u8> {
+        let psize = body + 2;
+        let mut packet = vec![0u8; psize + 3];
+        packet[0] = 0xAA;
+        packet[1] = (psize >> 8) as u8;
+        packet[2] = psize as u8;
+        packet[psize] = k2 as u8;
+        packet[psize + 1] = k1;
+        packet[psize + 2] = (k2 >> 8) as u8;
+        packet
+    }
+
+    #[test]
+    fn test_key_cache_matches_generate_key2() {
+        let mut table = vec![0u8; 0x401];
+        let mut rng = Rng(7);
+        rng.fill(&mut table);
+        let mut cache = CryptKeyCache::EMPTY;
+
+        for round in 0..3 {
+            for (k1, k2, fromclient) in [(0x10, 0x2222, true), (0x99, 0x0101, false), (0x10, 0x2222, false)] {
+                let packet = trailer_packet(20, k1, k2);
+                let mut expected = [0u8; 10];
+                generate_key2(&packet, &table, &mut expected, fromclient);
+                let mut got = [0xFFu8; 10];
+                generate_key2_cached(&packet, &table, &mut cache, &mut got, fromclient);
+                assert_eq!(got, expected, "round {} k1={} k2={}", round, k1, k2);
+            }
+        }
+        // First round derives all three; same-trailer/other-direction is a distinct key
+        assert_eq!(cache.misses, 3);
+        assert_eq!(cache.hits, 6);
+    }
+
+    #[test]
+    fn test_key_cache_evicts_on_slot_collision() {
+        let table = vec![0x41u8; 0x401];
+        let mut cache = CryptKeyCache::EMPTY;
+        let mut key = [0u8; 10];
+        // Many distinct trailers through 8 slots: every lookup stays correct
+        for k2 in 0..200u16 {
+            let packet = trailer_packet(4, 1, k2);
+            generate_key2_cached(&packet, &table, &mut cache, &mut key, true);
+            let mut expected = [0u8; 10];
+            generate_key2(&packet, &table, &mut expected, true);
+            assert_eq!(key, expected);
+        }
+        assert_eq!(cache.hits + cache.misses, 200);
+    }
+
+    #[test]
+    fn test_tk_crypt_dynamic_large_packet_matches_legacy() {
+        let mut rng = Rng(42);
+        let total = 5 + 9000;
+        let mut packet = vec![0u8; total];
+        rng.fill(&mut packet);
+        packet[1] = (total >> 8) as u8;
+        packet[2] = total as u8;
+        packet[4] = 7;
+        let key = *b"abcdefghi";
+
+        let mut expected = packet.clone();
+        legacy_crypt(&mut expected[5..], &key, 7);
+        tk_crypt_dynamic(&mut packet, &key);
+        assert!(packet == expected);
+    }
 }
@@ -2,9 +2,17 @@
 //!
 //! Ports ConnectHistory from session.c to Rust.
 //! Tracks connection attempts per IP and supports manual lockout.
+//!
+//! Entries live in a sharded table so `is_ip_locked` on accept only takes
+//! one shard's read lock (and none at all while nothing is locked out), and
+//! expiry is driven by a timing wheel so the once-a-second sweep only looks
+//! at entries whose deadline came due.
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::OnceLock;
 
-use std::collections::HashMap;
-use std::sync::{Mutex, OnceLock};
+use super::ip_table::ShardedIpMap;
+use crate::expiry_wheel::{tick_reached, ExpiryWheel};
 
 /// Non-DDoS entries expire after 3× this interval (ms).
 pub const DDOS_INTERVAL: u32 = 3 * 1000;
@@ -12,6 +20,7 @@ pub const DDOS_INTERVAL: u32 = 3 * 1000;
 /// DDoS-locked entries are cleared after this interval (ms).
 pub const DDOS_AUTORESET: u32 = 10 * 60 * 1000;
 
+#[derive(Clone, Copy)]
 struct ConnectEntry {
     /// Tick (ms) when this entry was last updated.
     tick: u32,
@@ -21,7 +30,11 @@ struct ConnectEntry {
 
 struct DdosState {
     /// Map from host-byte-order IPv4 to entry.
-    entries: HashMap<u32, ConnectEntry>,
+    entries: ShardedIpMap<ConnectEntry>,
+    /// Expiry deadlines for `entries`.
+    wheel: ExpiryWheel<u32>,
+    /// Entries with `ddos` set; lets `is_locked` skip the table when zero.
+    locked: AtomicUsize,
     /// Normal entry expiry interval (ms).
     ddos_interval: u32,
     /// Lockout entry expiry interval (ms).
@@ -31,17 +44,69 @@ struct DdosState {
 impl DdosState {
     fn new() -> Self {
         Self {
-            entries: HashMap::new(),
+            entries: ShardedIpMap::new(),
+            wheel: ExpiryWheel::new(),
+            locked: AtomicUsize::new(0),
             ddos_interval: DDOS_INTERVAL,
             ddos_autoreset: DDOS_AUTORESET,
         }
     }
+
+    /// First tick at which `entry` is stale.
+    fn deadline(&self, entry: &ConnectEntry) -> u32 {
+        let keep = if entry.ddos {
+            self.ddos_autoreset
+        } else {
+            self.ddos_interval * 3
+        };
+        entry.tick.wrapping_add(keep).wrapping_add(1)
+    }
+
+    fn lockout(&self, ip: u32, tick: u32) {
+        let entry = ConnectEntry { tick, ddos: true };
+        let was_locked = self
+            .entries
+            .update(ip, |map| map.insert(ip, entry).is_some_and(|old| old.ddos));
+        if !was_locked {
+            self.locked.fetch_add(1, Ordering::Relaxed);
+        }
+        self.wheel.schedule(ip, self.deadline(&entry));
+    }
+
+    fn is_locked(&self, ip: u32) -> bool {
+        if self.locked.load(Ordering::Relaxed) == 0 {
+            return false;
+        }
+        self.entries.read(ip, |e| e.is_some_and(|e| e.ddos))
+    }
+
+    /// Drop entries whose deadline passed; returns how many remain.
+    fn sweep(&self, tick: u32) -> usize {
+        self.wheel.advance(tick, |ip, deadline| {
+            self.entries.update(ip, |map| {
+                let entry = *map.get(&ip)?;
+                // Refreshed since this pair was scheduled; a newer pair covers it
+                if self.deadline(&entry) != deadline {
+                    return None;
+                }
+                if !tick_reached(tick, deadline) {
+                    return Some(deadline);
+                }
+                map.remove(&ip);
+                if entry.ddos {
+                    self.locked.fetch_sub(1, Ordering::Relaxed);
+                }
+                None
+            })
+        });
+        self.entries.len()
+    }
 }
 
-static DDOS: OnceLock<Mutex<DdosState>> = OnceLock::new();
+static DDOS: OnceLock<DdosState> = OnceLock::new();
 
-fn get_ddos() -> &'static Mutex<DdosState> {
-    DDOS.get_or_init(|| Mutex::new(DdosState::new()))
+fn get_ddos() -> &'static DdosState {
+    DDOS.get_or_init(DdosState::new)
 }
 
 /// Mark an IP as DDoS-locked.
@@ -54,13 +119,7 @@ pub fn add_ip_lockout(ip_net: u32) {
     let tick = unsafe { crate::ffi::timer::gettick() };
     #[cfg(test)]
     let tick: u32 = 0;
-    let mut state = get_ddos().lock().unwrap();
-    let entry = state.entries.entry(ip).or_insert(ConnectEntry {
-        tick: 0,
-        ddos: false,
-    });
-    entry.ddos = true;
-    entry.tick = tick;
+    get_ddos().lockout(ip, tick);
     tracing::info!(
         "[ddos] lockout ip={}.{}.{}.{}",
         (ip >> 24) & 0xFF,
@@ -74,9 +133,7 @@ pub fn add_ip_lockout(ip_net: u32) {
 ///
 /// `ip_net` is in network byte order.
 pub fn is_ip_locked(ip_net: u32) -> bool {
-    let ip = u32::from_be(ip_net);
-    let state = get_ddos().lock().unwrap();
-    state.entries.get(&ip).map(|e| e.ddos).unwrap_or(false)
+    get_ddos().is_locked(u32::from_be(ip_net))
 }
 
 /// Prune stale connection history entries.
@@ -87,19 +144,49 @@ pub fn connect_check_clear() -> i32 {
     #[cfg(not(test))]
     let tick = unsafe { crate::ffi::timer::gettick() };
     #[cfg(test)]
-    let tick: u32 = u32::MAX; // expire everything in tests
-    let mut state = get_ddos().lock().unwrap();
-    let ddos_interval = state.ddos_interval;
-    let ddos_autoreset = state.ddos_autoreset;
-
-    state.entries.retain(|_, entry| {
-        let age = tick.wrapping_sub(entry.tick);
-        if entry.ddos {
-            age <= ddos_autoreset
-        } else {
-            age <= ddos_interval * 3
-        }
-    });
+    let tick: u32 = DDOS_AUTORESET + 1; // everything added at tick 0 is stale
+    get_ddos().sweep(tick) as i32
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_lockout_expires_after_autoreset() {
+        let state = DdosState::new();
+        assert!(!state.is_locked(0x0A00_0001));
+
+        state.lockout(0x0A00_0001, 1_000);
+        assert!(state.is_locked(0x0A00_0001));
+        assert!(!state.is_locked(0x0A00_0002));
 
-    state.entries.len() as i32
+        assert_eq!(state.sweep(1_000 + DDOS_AUTORESET), 1);
+        assert!(state.is_locked(0x0A00_0001));
+        assert_eq!(state.sweep(2_000 + DDOS_AUTORESET), 0);
+        assert!(!state.is_locked(0x0A00_0001));
+        assert_eq!(state.locked.load(Ordering::Relaxed), 0);
+    }
+
+    #[test]
+    fn test_relock_pushes_expiry_out() {
+        let state = DdosState::new();
+        state.lockout(0x0A00_0001, 0);
+        state.lockout(0x0A00_0001, 300_000);
+        assert_eq!(state.locked.load(Ordering::Relaxed), 1);
+
+        // The first deadline passes, but the refresh keeps the lockout
+        assert_eq!(state.sweep(DDOS_AUTORESET + 1_000), 1);
+        assert!(state.is_locked(0x0A00_0001));
+        assert_eq!(state.sweep(300_000 + DDOS_AUTORESET + 1_000), 0);
+    }
+
+    #[test]
+    fn test_public_api_round_trip() {
+        let ip_net = 0xC0A8_0101u32.to_be();
+        add_ip_lockout(ip_net);
+        assert!(is_ip_locked(ip_net));
+        connect_check_clear();
+        assert!(!is_ip_locked(ip_net));
+    }
 }
@@ -0,0 +1,80 @@
+//! Sharded per-IP tables
+//!
+//! Shared by the throttle and DDoS trackers. Lookups lock one shard for
+//! reading, so accept-time checks from different IPs never contend.
+
+use std::collections::HashMap;
+use std::sync::RwLock;
+
+/// Number of shards (power of two).
+const SHARDS: usize = 16;
+
+/// HashMap keyed by host-byte-order IPv4, split into independently locked shards.
+pub struct ShardedIpMap<V> {
+    shards: [RwLock<HashMap<u32, V>>; SHARDS],
+}
+
+impl<V> ShardedIpMap<V> {
+    pub fn new() -> Self {
+        Self {
+            shards: std::array::from_fn(|_| RwLock::new(HashMap::new())),
+        }
+    }
+
+    #[inline]
+    fn shard(&self, ip: u32) -> &RwLock<HashMap<u32, V>> {
+        // Fibonacci hash so sequential addresses in one subnet spread out
+        let index = (ip.wrapping_mul(0x9E37_79B1) >> (32 - SHARDS.trailing_zeros())) as usize;
+        &self.shards[index]
+    }
+
+    /// Run `f` on the entry for `ip` under the shard's read lock.
+    pub fn read<R>(&self, ip: u32, f: impl FnOnce(Option<&V>) -> R) -> R {
+        f(self.shard(ip).read().unwrap().get(&ip))
+    }
+
+    /// Run `f` on the shard holding `ip` under its write lock.
+    pub fn update<R>(&self, ip: u32, f: impl FnOnce(&mut HashMap<u32, V>) -> R) -> R {
+        f(&mut self.shard(ip).write().unwrap())
+    }
+
+    /// Empty every shard. `on_clear` sees each shard's map just before it is cleared.
+    pub fn clear(&self, mut on_clear: impl FnMut(&HashMap<u32, V>)) {
+        for shard in &self.shards {
+            let mut map = shard.write().unwrap();
+            on_clear(&map);
+            map.clear();
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|s| s.read().unwrap().len()).sum()
+    }
+}
+
+impl<V> Default for ShardedIpMap<V> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_sharded_map_update_and_read() {
+        let map: ShardedIpMap<u32> = ShardedIpMap::new();
+        for ip in 0..100u32 {
+            map.update(ip, |m| *m.entry(ip).or_insert(0) += ip);
+        }
+        assert_eq!(map.len(), 100);
+        assert_eq!(map.read(42, |v| v.copied()), Some(42));
+        assert_eq!(map.read(1000, |v| v.copied()), None);
+
+        let mut seen = 0;
+        map.clear(|m| seen += m.len());
+        assert_eq!(seen, 100);
+        assert_eq!(map.len(), 0);
+    }
+}
@@ -1,6 +1,9 @@
 pub mod acl;
+pub mod buffer_pool;
 pub mod crypt;
 pub mod ddos;
+pub mod ip_table;
+pub mod opcode_stats;
 pub mod throttle;
 
 use anyhow::{bail, Result};
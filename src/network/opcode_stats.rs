@@ -0,0 +1,207 @@
+//! Per-opcode packet counts, bytes and latency.
+//!
+//! `clif_parse` records every client packet it dispatches, timed from
+//! decryption to the end of its handler. `encrypt` and the shared broadcast
+//! encrypt record every packet queued to a client, timing the encryption.
+//! Counters are relaxed atomics indexed by opcode, so a record is two clock
+//! reads and a few adds with no lock, cheap enough to leave on. Any thread
+//! can read them through `stats`, as `@opstats` does; `@opstats reset`
+//! zeroes them.
+
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+
+/// Latency buckets: bucket `i` holds times under 2^i µs, the last one the rest.
+pub const BUCKETS: usize = 16;
+
+/// Which way a packet went.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Dir {
+    In,
+    Out,
+}
+
+/// Counters of one opcode in one direction.
+pub struct Counters {
+    count: AtomicU64,
+    bytes: AtomicU64,
+    total_ns: AtomicU64,
+    max_ns: AtomicU64,
+    hist: [AtomicU64; BUCKETS],
+}
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU64 = AtomicU64::new(0);
+
+impl Counters {
+    pub const fn new() -> Self {
+        Counters { count: ZERO, bytes: ZERO, total_ns: ZERO, max_ns: ZERO, hist: [ZERO; BUCKETS] }
+    }
+
+    fn record(&self, bytes: u64, ns: u64) {
+        self.count.fetch_add(1, Relaxed);
+        self.bytes.fetch_add(bytes, Relaxed);
+        self.total_ns.fetch_add(ns, Relaxed);
+        self.max_ns.fetch_max(ns, Relaxed);
+        self.hist[bucket(ns)].fetch_add(1, Relaxed);
+    }
+
+    fn snapshot(&self) -> OpStat {
+        OpStat {
+            count: self.count.load(Relaxed),
+            bytes: self.bytes.load(Relaxed),
+            total_ns: self.total_ns.load(Relaxed),
+            max_ns: self.max_ns.load(Relaxed),
+            hist: std::array::from_fn(|i| self.hist[i].load(Relaxed)),
+        }
+    }
+
+    fn reset(&self) {
+        for c in [&self.count, &self.bytes, &self.total_ns, &self.max_ns] {
+            c.store(0, Relaxed);
+        }
+        for h in &self.hist {
+            h.store(0, Relaxed);
+        }
+    }
+}
+
+fn bucket(ns: u64) -> usize {
+    let us = ns / 1000;
+    ((u64::BITS - us.leading_zeros()) as usize).min(BUCKETS - 1)
+}
+
+/// Upper bound of bucket `i` in µs; `None` for the open-ended last bucket.
+pub fn bucket_bound_us(i: usize) -> Option<u64> {
+    (i < BUCKETS - 1).then(|| 1u64 << i)
+}
+
+/// A read of one opcode's counters.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct OpStat {
+    pub count: u64,
+    pub bytes: u64,
+    pub total_ns: u64,
+    pub max_ns: u64,
+    pub hist: [u64; BUCKETS],
+}
+
+impl OpStat {
+    pub fn avg_ns(&self) -> u64 {
+        self.total_ns / self.count.max(1)
+    }
+
+    /// Upper bound in µs of the bucket holding the `q` quantile (0..=1);
+    /// `None` if it falls in the last bucket, past 2^(BUCKETS-2) µs.
+    pub fn quantile_us(&self, q: f64) -> Option<u64> {
+        let want = ((self.count as f64 * q).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (i, n) in self.hist.iter().enumerate() {
+            seen += n;
+            if seen >= want {
+                return bucket_bound_us(i);
+            }
+        }
+        None
+    }
+}
+
+/// Inbound and outbound counters for every opcode.
+pub struct OpcodeStats {
+    inbound: [Counters; 256],
+    outbound: [Counters; 256],
+}
+
+impl OpcodeStats {
+    pub const fn new() -> Self {
+        #[allow(clippy::declare_interior_mutable_const)]
+        const C: Counters = Counters::new();
+        OpcodeStats { inbound: [C; 256], outbound: [C; 256] }
+    }
+
+    fn side(&self, dir: Dir) -> &[Counters; 256] {
+        match dir {
+            Dir::In => &self.inbound,
+            Dir::Out => &self.outbound,
+        }
+    }
+
+    pub fn record(&self, dir: Dir, op: u8, bytes: u64, ns: u64) {
+        self.side(dir)[op as usize].record(bytes, ns);
+    }
+
+    /// Opcodes seen in `dir`, most total time first.
+    pub fn snapshot(&self, dir: Dir) -> Vec<(u8, OpStat)> {
+        let mut out: Vec<(u8, OpStat)> = self
+            .side(dir)
+            .iter()
+            .enumerate()
+            .map(|(op, c)| (op as u8, c.snapshot()))
+            .filter(|(_, s)| s.count > 0)
+            .collect();
+        out.sort_by(|a, b| b.1.total_ns.cmp(&a.1.total_ns).then(a.0.cmp(&b.0)));
+        out
+    }
+
+    pub fn reset(&self) {
+        for c in self.inbound.iter().chain(self.outbound.iter()) {
+            c.reset();
+        }
+    }
+}
+
+static STATS: OpcodeStats = OpcodeStats::new();
+
+pub fn stats() -> &'static OpcodeStats {
+    &STATS
+}
+
+/// Record a packet of `bytes` whose handling started at `start`
+/// (`core::monotonic_ns`).
+pub fn record(dir: Dir, op: u8, bytes: u64, start: u64) {
+    STATS.record(dir, op, bytes, crate::core::monotonic_ns().saturating_sub(start));
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_buckets() {
+        assert_eq!(bucket(0), 0);
+        assert_eq!(bucket(999), 0);
+        assert_eq!(bucket(1_000), 1);
+        assert_eq!(bucket(3_999), 2);
+        assert_eq!(bucket(4_000), 3);
+        assert_eq!(bucket(u64::MAX), BUCKETS - 1);
+        assert_eq!(bucket_bound_us(3), Some(8));
+        assert_eq!(bucket_bound_us(BUCKETS - 1), None);
+    }
+
+    #[test]
+    fn test_record_snapshot_reset() {
+        let s = OpcodeStats::new();
+        for _ in 0..99 {
+            s.record(Dir::In, 0x06, 10, 500);
+        }
+        s.record(Dir::In, 0x06, 10, 50_000);
+        s.record(Dir::In, 0x05, 40, 2_000_000);
+        s.record(Dir::Out, 0x0B, 30, 200);
+
+        let inbound = s.snapshot(Dir::In);
+        assert_eq!(inbound.len(), 2);
+        // 0x05 cost more in total, so it sorts first
+        assert_eq!(inbound[0].0, 0x05);
+        let (op, walk) = inbound[1];
+        assert_eq!(op, 0x06);
+        assert_eq!((walk.count, walk.bytes, walk.max_ns), (100, 1000, 50_000));
+        assert_eq!(walk.avg_ns(), (99 * 500 + 50_000) / 100);
+        assert_eq!(walk.quantile_us(0.5), Some(1));
+        assert_eq!(walk.quantile_us(1.0), Some(64));
+        let out = s.snapshot(Dir::Out);
+        assert_eq!((out.len(), out[0].0, out[0].1.bytes), (1, 0x0B, 30));
+
+        s.reset();
+        assert!(s.snapshot(Dir::In).is_empty());
+        assert!(s.snapshot(Dir::Out).is_empty());
+    }
+}
@@ -3,27 +3,64 @@
 //! Ports the stThrottle linked list from session.c to Rust.
 //! Tracks per-IP connection counts and blocks repeat offenders.
 //! Resets every 10 minutes via a timer callback (matching C's Remove_Throttle).
+//!
+//! Counts live in a sharded table so `is_throttled` on accept only takes one
+//! shard's read lock, and none at all while the table is empty.
+//!
+//! `InFlight` applies the same per-IP bookkeeping to expensive work that is
+//! still running (password hashing), so one address cannot hold more than
+//! its share of a bounded worker pool.
 
-use std::collections::HashMap;
-use std::sync::{Mutex, OnceLock};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::OnceLock;
+
+use super::ip_table::ShardedIpMap;
 
 struct ThrottleState {
     /// Map from host-byte-order IPv4 to connection count.
-    counts: HashMap<u32, u32>,
+    counts: ShardedIpMap<u32>,
+    /// Number of IPs in `counts`; lets `is_throttled` skip the table when zero.
+    tracked: AtomicUsize,
 }
 
 impl ThrottleState {
     fn new() -> Self {
         Self {
-            counts: HashMap::new(),
+            counts: ShardedIpMap::new(),
+            tracked: AtomicUsize::new(0),
+        }
+    }
+
+    /// Increment the count for `ip`, returning the new count.
+    fn add(&self, ip: u32) -> u32 {
+        self.counts.update(ip, |map| {
+            let count = map.entry(ip).or_insert_with(|| {
+                self.tracked.fetch_add(1, Ordering::Relaxed);
+                0
+            });
+            *count += 1;
+            *count
+        })
+    }
+
+    fn is_throttled(&self, ip: u32) -> bool {
+        if self.tracked.load(Ordering::Relaxed) == 0 {
+            return false;
         }
+        self.counts.read(ip, |c| c.copied().unwrap_or(0) > 0)
+    }
+
+    fn clear(&self) {
+        self.counts.clear(|map| {
+            self.tracked.fetch_sub(map.len(), Ordering::Relaxed);
+        });
     }
 }
 
-static THROTTLE: OnceLock<Mutex<ThrottleState>> = OnceLock::new();
+static THROTTLE: OnceLock<ThrottleState> = OnceLock::new();
 
-fn get_throttle() -> &'static Mutex<ThrottleState> {
-    THROTTLE.get_or_init(|| Mutex::new(ThrottleState::new()))
+fn get_throttle() -> &'static ThrottleState {
+    THROTTLE.get_or_init(ThrottleState::new)
 }
 
 /// Record a connection attempt from an IP (increment count).
@@ -31,15 +68,14 @@ fn get_throttle() -> &'static Mutex<ThrottleState> {
 /// `ip_net` is in network byte order (sin_addr.s_addr).
 pub fn add_throttle(ip_net: u32) {
     let ip = u32::from_be(ip_net);
-    let mut state = get_throttle().lock().unwrap();
-    *state.counts.entry(ip).or_insert(0) += 1;
+    let count = get_throttle().add(ip);
     tracing::debug!(
         "[throttle] add ip={}.{}.{}.{} count={}",
         (ip >> 24) & 0xFF,
         (ip >> 16) & 0xFF,
         (ip >> 8) & 0xFF,
         ip & 0xFF,
-        state.counts[&ip],
+        count,
     );
 }
 
@@ -47,16 +83,97 @@ pub fn add_throttle(ip_net: u32) {
 ///
 /// `ip_net` is in network byte order.
 pub fn is_throttled(ip_net: u32) -> bool {
-    let ip = u32::from_be(ip_net);
-    let state = get_throttle().lock().unwrap();
-    state.counts.get(&ip).copied().unwrap_or(0) > 0
+    get_throttle().is_throttled(u32::from_be(ip_net))
 }
 
 /// Reset all throttle counts (matches C's Remove_Throttle).
 ///
 /// Called as a timer callback every 10 minutes.
 pub fn remove_throttle() {
-    let mut state = get_throttle().lock().unwrap();
-    state.counts.clear();
+    get_throttle().clear();
     tracing::debug!("[throttle] cleared all entries");
 }
+
+/// Per-IP cap on concurrent work. A slot is held until its guard drops.
+pub struct InFlight {
+    limit: u32,
+    counts: ShardedIpMap<u32>,
+}
+
+impl InFlight {
+    pub fn new(limit: u32) -> Self {
+        Self { limit: limit.max(1), counts: ShardedIpMap::new() }
+    }
+
+    /// Take a slot for `ip_net` (network byte order), or None if it already
+    /// holds `limit`.
+    pub fn try_enter(&self, ip_net: u32) -> Option<InFlightGuard<'_>> {
+        let ip = u32::from_be(ip_net);
+        let admitted = self.counts.update(ip, |map| {
+            let n = map.entry(ip).or_insert(0);
+            if *n >= self.limit {
+                return false;
+            }
+            *n += 1;
+            true
+        });
+        admitted.then_some(InFlightGuard { table: self, ip })
+    }
+
+    /// Slots held by `ip_net`.
+    pub fn held(&self, ip_net: u32) -> u32 {
+        self.counts.read(u32::from_be(ip_net), |c| c.copied().unwrap_or(0))
+    }
+}
+
+pub struct InFlightGuard<'a> {
+    table: &'a InFlight,
+    ip: u32,
+}
+
+impl Drop for InFlightGuard<'_> {
+    fn drop(&mut self) {
+        self.table.counts.update(self.ip, |map| {
+            if let Some(n) = map.get_mut(&self.ip) {
+                *n -= 1;
+                if *n == 0 {
+                    map.remove(&self.ip);
+                }
+            }
+        });
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_add_and_clear() {
+        let state = ThrottleState::new();
+        assert!(!state.is_throttled(0x0A00_0001));
+        assert_eq!(state.add(0x0A00_0001), 1);
+        assert_eq!(state.add(0x0A00_0001), 2);
+        state.add(0x0A00_0002);
+        assert!(state.is_throttled(0x0A00_0001));
+        assert!(!state.is_throttled(0x0A00_0003));
+        assert_eq!(state.tracked.load(Ordering::Relaxed), 2);
+
+        state.clear();
+        assert!(!state.is_throttled(0x0A00_0001));
+        assert_eq!(state.tracked.load(Ordering::Relaxed), 0);
+    }
+
+    #[test]
+    fn test_in_flight_limit_per_ip() {
+        let t = InFlight::new(2);
+        let ip = u32::to_be(0x0A00_0001);
+        let a = t.try_enter(ip).unwrap();
+        let _b = t.try_enter(ip).unwrap();
+        assert!(t.try_enter(ip).is_none());
+        assert!(t.try_enter(u32::to_be(0x0A00_0002)).is_some());
+        drop(a);
+        assert_eq!(t.held(ip), 1);
+        assert!(t.try_enter(ip).is_some());
+    }
+}
@@ -0,0 +1,368 @@
+//! In-process sampling profiler with folded-stack output.
+//!
+//! `start` arms `ITIMER_PROF` at `hz` samples per CPU-second for a fixed
+//! number of seconds. Each `SIGPROF` lands on whichever thread was burning
+//! CPU; the handler walks that thread's frame-pointer chain from the
+//! interrupted RIP/RBP and copies the return addresses into a preallocated
+//! sample buffer. No allocation, locking or symbol lookup happens in the
+//! handler. When the window closes a background thread symbolizes the
+//! stacks with `dladdr` and writes one `root;...;leaf count` line per
+//! distinct stack, the input `flamegraph.pl` and speedscope take.
+//!
+//! Stacks are only as deep as the frame pointers go: build with
+//! `make RUST_PROFILE=profiling`, which keeps them in libyuri, common, deps
+//! and map_game. A frame built without them ends its stack early. Frames
+//! `dladdr` cannot name are written as `object+0xoffset`, which addr2line
+//! can resolve offline.
+//!
+//! Triggered by `@profile [seconds]` on the map server and by SIGUSR2 on
+//! all three servers.
+
+use std::collections::HashMap;
+use std::fmt::Write as _;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, AtomicPtr, AtomicUsize, Ordering};
+use std::time::Duration;
+
+/// Deepest stack recorded; deeper ones are cut at the root end.
+const MAX_DEPTH: usize = 64;
+/// Words per sample slot: the frame count, then the addresses.
+const SLOT: usize = MAX_DEPTH + 1;
+/// Samples kept per run; later samples are dropped and counted.
+const MAX_SAMPLES: usize = 1 << 16;
+/// A frame pointer further than this above the handler's own stack
+/// is taken to be garbage, not a caller's frame.
+const STACK_SPAN: usize = 8 << 20;
+/// Longest window `start` accepts.
+pub const MAX_SECONDS: u64 = 600;
+
+static RUNNING: AtomicBool = AtomicBool::new(false);
+/// Sample buffer of the current run, NULL when none is armed.
+static BUF: AtomicPtr<AtomicUsize> = AtomicPtr::new(std::ptr::null_mut());
+/// Slots claimed in BUF, including ones past MAX_SAMPLES.
+static CLAIMED: AtomicUsize = AtomicUsize::new(0);
+/// SIGPROF handlers currently running. A handler counts itself in before it
+/// loads BUF, so once BUF is cleared and this reads 0 none can still hold it.
+static IN_FLIGHT: AtomicUsize = AtomicUsize::new(0);
+
+#[derive(Clone, Debug)]
+pub struct Options {
+    pub seconds: u64,
+    pub hz: u32,
+    /// Directory the `.folded` file is written to
+    pub dir: PathBuf,
+    /// Server name used in the file name
+    pub tag: &'static str,
+}
+
+impl Options {
+    /// Options from the `profile_*` keys; `seconds` can be overridden after.
+    pub fn from_config(config: &crate::config::ServerConfig, tag: &'static str) -> Self {
+        Options {
+            seconds: config.profile_seconds,
+            hz: config.profile_hz,
+            dir: PathBuf::from(&config.profile_dir),
+            tag,
+        }
+    }
+}
+
+/// Outcome of one run, logged when it finishes.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct Report {
+    pub samples: usize,
+    pub dropped: usize,
+    pub stacks: usize,
+}
+
+/// Start a profile in the background. Returns the file it will write, or
+/// why it could not start (one already running, unsupported target,
+/// setitimer failure).
+pub fn start(opts: Options) -> Result<PathBuf, String> {
+    if RUNNING.swap(true, Ordering::AcqRel) {
+        return Err("a profile is already running".into());
+    }
+    let seconds = opts.seconds.clamp(1, MAX_SECONDS);
+    let hz = opts.hz.clamp(1, 1000);
+    let stamp = chrono::Local::now().format("%Y%m%d-%H%M%S");
+    let path = opts.dir.join(format!("{}-{}-{}.folded", opts.tag, std::process::id(), stamp));
+
+    let buf: Box<[AtomicUsize]> = (0..MAX_SAMPLES * SLOT).map(|_| AtomicUsize::new(0)).collect();
+    let buf = Box::into_raw(buf) as *mut AtomicUsize;
+    CLAIMED.store(0, Ordering::Relaxed);
+    BUF.store(buf, Ordering::Release);
+    if let Err(e) = unsafe { arm(hz) } {
+        unpublish();
+        drop(unsafe { Box::from_raw(std::ptr::slice_from_raw_parts_mut(buf, MAX_SAMPLES * SLOT)) });
+        RUNNING.store(false, Ordering::Release);
+        return Err(e);
+    }
+
+    let out = path.clone();
+    let addr = buf as usize;
+    std::thread::Builder::new()
+        .name("profiler".into())
+        .spawn(move || {
+            std::thread::sleep(Duration::from_secs(seconds));
+            unsafe { disarm() };
+            unpublish();
+            let buf = addr as *mut AtomicUsize;
+            let all = unsafe { Box::from_raw(std::ptr::slice_from_raw_parts_mut(buf, MAX_SAMPLES * SLOT)) };
+            let claimed = CLAIMED.load(Ordering::Acquire);
+            let (folded, mut report) = fold(&all, claimed.min(MAX_SAMPLES));
+            report.dropped = claimed.saturating_sub(MAX_SAMPLES);
+            match write_folded(&out, &folded) {
+                Ok(()) => tracing::info!(
+                    "[profiler] wrote {} ({} samples, {} stacks, {} dropped)",
+                    out.display(), report.samples, report.stacks, report.dropped
+                ),
+                Err(e) => tracing::error!("[profiler] cannot write {}: {}", out.display(), e),
+            }
+            RUNNING.store(false, Ordering::Release);
+        })
+        .map_err(|e| {
+            unsafe { disarm() };
+            RUNNING.store(false, Ordering::Release);
+            e.to_string()
+        })?;
+    Ok(path)
+}
+
+/// Clear BUF and wait until no handler that loaded it before can still be
+/// writing to it; the buffer may be freed after this returns.
+fn unpublish() {
+    BUF.store(std::ptr::null_mut(), Ordering::SeqCst);
+    while IN_FLIGHT.load(Ordering::SeqCst) != 0 {
+        std::thread::sleep(Duration::from_millis(1));
+    }
+}
+
+/// Whether a profile is being taken right now.
+pub fn running() -> bool {
+    RUNNING.load(Ordering::Acquire)
+}
+
+/// Start a profile with `opts` each time the process gets SIGUSR2. Must be
+/// called inside the tokio runtime.
+pub fn spawn_signal_trigger(opts: Options) {
+    use tokio::signal::unix::{signal, SignalKind};
+    let mut sig = match signal(SignalKind::user_defined2()) {
+        Ok(s) => s,
+        Err(e) => {
+            tracing::warn!("[profiler] SIGUSR2 trigger unavailable: {}", e);
+            return;
+        }
+    };
+    tokio::spawn(async move {
+        while sig.recv().await.is_some() {
+            match start(opts.clone()) {
+                Ok(path) => tracing::info!("[profiler] profiling {} s into {}", opts.seconds, path.display()),
+                Err(e) => tracing::warn!("[profiler] not started: {}", e),
+            }
+        }
+    });
+}
+
+/// Collapse the first `n` sample slots into folded lines, most frequent first.
+fn fold(buf: &[AtomicUsize], n: usize) -> (Vec<(String, usize)>, Report) {
+    let mut counts: HashMap<Vec<usize>, usize> = HashMap::new();
+    let mut report = Report::default();
+    for slot in buf.chunks(SLOT).take(n) {
+        let depth = slot[0].load(Ordering::Acquire).min(MAX_DEPTH);
+        if depth == 0 {
+            continue; // claimed but never filled
+        }
+        let stack: Vec<usize> = slot[1..=depth].iter().map(|a| a.load(Ordering::Relaxed)).collect();
+        *counts.entry(stack).or_insert(0) += 1;
+        report.samples += 1;
+    }
+    report.stacks = counts.len();
+
+    let mut names: HashMap<usize, String> = HashMap::new();
+    let mut lines: Vec<(String, usize)> = counts
+        .into_iter()
+        .map(|(stack, count)| {
+            let mut line = String::new();
+            // Samples are leaf first; folded lines are root first
+            for (i, &addr) in stack.iter().rev().enumerate() {
+                if i > 0 {
+                    line.push(';');
+                }
+                // Return addresses point past the call; look up the call itself
+                let pc = if i + 1 == stack.len() { addr } else { addr.saturating_sub(1) };
+                line.push_str(names.entry(pc).or_insert_with(|| symbolize(pc)));
+            }
+            (line, count)
+        })
+        .collect();
+    lines.sort_by(|a, b| b.1.cmp(&a.1).then_with(|| a.0.cmp(&b.0)));
+    (lines, report)
+}
+
+fn write_folded(path: &Path, lines: &[(String, usize)]) -> std::io::Result<()> {
+    if let Some(dir) = path.parent() {
+        std::fs::create_dir_all(dir)?;
+    }
+    let mut out = String::new();
+    for (stack, count) in lines {
+        let _ = writeln!(out, "{} {}", stack, count);
+    }
+    std::fs::write(path, out)
+}
+
+/// Function name at `pc`, or `object+0xoffset` if it has no symbol.
+fn symbolize(pc: usize) -> String {
+    let mut info: libc::Dl_info = unsafe { std::mem::zeroed() };
+    if unsafe { libc::dladdr(pc as *const libc::c_void, &mut info) } == 0 {
+        return format!("{pc:#x}");
+    }
+    if !info.dli_sname.is_null() {
+        let raw = unsafe { std::ffi::CStr::from_ptr(info.dli_sname) }.to_string_lossy();
+        return demangle(&raw);
+    }
+    let object = if info.dli_fname.is_null() {
+        "?".into()
+    } else {
+        let path = unsafe { std::ffi::CStr::from_ptr(info.dli_fname) }.to_string_lossy().into_owned();
+        path.rsplit('/').next().unwrap_or("?").to_string()
+    };
+    format!("{}+{:#x}", object, pc.wrapping_sub(info.dli_fbase as usize))
+}
+
+/// Readable form of a legacy-mangled Rust symbol (`_ZN4yuri7session3run17h…E`
+/// becomes `yuri::session::run`). Anything else is returned unchanged.
+pub fn demangle(sym: &str) -> String {
+    let Some(mut rest) = sym.strip_prefix("_ZN") else { return sym.to_string() };
+    let mut parts: Vec<String> = Vec::new();
+    while rest.starts_with(|c: char| c.is_ascii_digit()) {
+        let digits = rest.bytes().take_while(u8::is_ascii_digit).count();
+        let Ok(len) = rest[..digits].parse::<usize>() else { return sym.to_string() };
+        let Some(part) = rest.get(digits..digits + len) else { return sym.to_string() };
+        // Segments that would start with `$` are mangled with a leading `_`
+        let part = if part.starts_with("_$") { &part[1..] } else { part };
+        parts.push(part.replace("$LT$", "<").replace("$GT$", ">").replace("$u20$", " ")
+            .replace("$RF$", "&").replace("$C$", ",").replace("..", "::"));
+        rest = &rest[digits + len..];
+    }
+    if rest != "E" || parts.is_empty() {
+        return sym.to_string();
+    }
+    // Drop the trailing hash segment
+    if parts.last().is_some_and(|p| p.len() == 17 && p.starts_with('h')) {
+        parts.pop();
+    }
+    parts.join("::")
+}
+
+#[cfg(all(target_os = "linux", target_arch = "x86_64"))]
+unsafe fn arm(hz: u32) -> Result<(), String> {
+    let mut sa: libc::sigaction = std::mem::zeroed();
+    sa.sa_sigaction = on_sigprof as usize;
+    sa.sa_flags = libc::SA_SIGINFO | libc::SA_RESTART;
+    libc::sigemptyset(&mut sa.sa_mask);
+    if libc::sigaction(libc::SIGPROF, &sa, std::ptr::null_mut()) != 0 {
+        return Err(std::io::Error::last_os_error().to_string());
+    }
+    let usec = (1_000_000 / hz as libc::suseconds_t).max(1);
+    let tv = libc::timeval { tv_sec: 0, tv_usec: usec };
+    let it = libc::itimerval { it_interval: tv, it_value: tv };
+    if libc::setitimer(libc::ITIMER_PROF, &it, std::ptr::null_mut()) != 0 {
+        let e = std::io::Error::last_os_error().to_string();
+        disarm();
+        return Err(e);
+    }
+    Ok(())
+}
+
+#[cfg(not(all(target_os = "linux", target_arch = "x86_64")))]
+unsafe fn arm(_hz: u32) -> Result<(), String> {
+    Err("sampling needs Linux on x86_64".into())
+}
+
+/// Stop the timer and ignore any SIGPROF still pending.
+unsafe fn disarm() {
+    let off: libc::itimerval = std::mem::zeroed();
+    libc::setitimer(libc::ITIMER_PROF, &off, std::ptr::null_mut());
+    libc::signal(libc::SIGPROF, libc::SIG_IGN);
+}
+
+#[cfg(all(target_os = "linux", target_arch = "x86_64"))]
+extern "C" fn on_sigprof(_sig: libc::c_int, _info: *mut libc::siginfo_t, ctx: *mut libc::c_void) {
+    IN_FLIGHT.fetch_add(1, Ordering::SeqCst);
+    let buf = BUF.load(Ordering::SeqCst);
+    if !buf.is_null() && !ctx.is_null() {
+        sample(buf, ctx);
+    }
+    IN_FLIGHT.fetch_sub(1, Ordering::SeqCst);
+}
+
+/// Record the stack interrupted at `ctx` into the next slot of `buf`.
+#[cfg(all(target_os = "linux", target_arch = "x86_64"))]
+fn sample(buf: *mut AtomicUsize, ctx: *mut libc::c_void) {
+    let slot_no = CLAIMED.fetch_add(1, Ordering::AcqRel);
+    if slot_no >= MAX_SAMPLES {
+        return;
+    }
+    let slot = unsafe { std::slice::from_raw_parts(buf.add(slot_no * SLOT), SLOT) };
+    let uc = unsafe { &*(ctx as *const libc::ucontext_t) };
+    let rip = uc.uc_mcontext.gregs[libc::REG_RIP as usize] as usize;
+    let mut fp = uc.uc_mcontext.gregs[libc::REG_RBP as usize] as usize;
+
+    // The interrupted frames sit above this handler on the same stack
+    let marker = 0u8;
+    let low = &marker as *const u8 as usize;
+    let high = low.saturating_add(STACK_SPAN);
+
+    slot[1].store(rip, Ordering::Relaxed);
+    let mut depth = 1;
+    while depth < MAX_DEPTH && fp >= low && fp < high && fp % 8 == 0 {
+        let ret = unsafe { *((fp + 8) as *const usize) };
+        let next = unsafe { *(fp as *const usize) };
+        if ret == 0 {
+            break;
+        }
+        depth += 1;
+        slot[depth].store(ret, Ordering::Relaxed);
+        if next <= fp {
+            break;
+        }
+        fp = next;
+    }
+    slot[0].store(depth, Ordering::Release);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_demangle_legacy() {
+        assert_eq!(demangle("_ZN4yuri7session8run_loop17h0123456789abcdefE"), "yuri::session::run_loop");
+        assert_eq!(
+            demangle("_ZN58_$LT$yuri..metrics..Writer$u20$as$u20$core..fmt..Debug$GT$3fmt17h0123456789abcdefE"),
+            "<yuri::metrics::Writer as core::fmt::Debug>::fmt"
+        );
+        assert_eq!(demangle("clif_parse"), "clif_parse");
+        assert_eq!(demangle("_ZN4yuri"), "_ZN4yuri");
+    }
+
+    #[test]
+    fn test_fold_counts_stacks_root_first() {
+        let buf: Vec<AtomicUsize> = (0..SLOT * 4).map(|_| AtomicUsize::new(0)).collect();
+        let put = |i: usize, frames: &[usize]| {
+            buf[i * SLOT].store(frames.len(), Ordering::Relaxed);
+            for (d, &a) in frames.iter().enumerate() {
+                buf[i * SLOT + 1 + d].store(a, Ordering::Relaxed);
+            }
+        };
+        put(0, &[0x10, 0x21, 0x31]);
+        put(1, &[0x10, 0x21, 0x31]);
+        put(2, &[0x11, 0x31]);
+        // slot 3 claimed but empty
+        let (lines, report) = fold(&buf, 4);
+        assert_eq!(report, Report { samples: 3, dropped: 0, stacks: 2 });
+        assert_eq!(lines[0].1, 2);
+        assert_eq!(lines[0].0, format!("{};{};{}", symbolize(0x30), symbolize(0x20), symbolize(0x10)));
+        assert_eq!(lines[1].1, 1);
+    }
+}
@@ -0,0 +1,218 @@
+//! Board pages, posts and mailbox listings, kept in memory between reads.
+//!
+//! Opening a board sends 0x3009 for the first page and 0x300A for every post
+//! read, each of which used to query `Boards` or `Mail` again even though the
+//! same few pages are read far more often than they change. Pages (20 rows
+//! at an offset), the highest position, and posts as looked up by position
+//! are cached per board, and per character for mailboxes (board 0).
+//!
+//! A listing is dropped whole by any write to it: a post or delete on the
+//! char server, or an 0x3011 from a map server that wrote to `Boards` itself
+//! (post colour, poems). Reading mail only clears the unread flag, which is
+//! patched into the cached pages instead. Results fetched while a write was
+//! in flight are not stored (see `generation`).
+
+use std::collections::{HashMap, VecDeque};
+use std::sync::Arc;
+
+/// One row of a 0x3809 page: colour, user, topic, position, month, day, id.
+pub type PageRow = (i32, String, String, i32, i32, i32, i32);
+/// A post as 0x380F sends it: user, topic, body, position, month, day, id.
+pub type PostRow = (String, String, String, u32, u32, u32, u32);
+
+/// Posts kept per listing; the posts of a listing are dropped past this.
+const MAX_POSTS: usize = 64;
+
+#[derive(Clone, Debug, PartialEq, Eq, Hash)]
+pub enum Listing {
+    Board(u32),
+    /// Mailbox of a character, by lowercased name (names compare without case)
+    Mail(String),
+}
+
+impl Listing {
+    /// Board `board`, or the mailbox of `name` for board 0.
+    pub fn of(board: u32, name: &str) -> Self {
+        if board == 0 { Listing::Mail(name.to_ascii_lowercase()) } else { Listing::Board(board) }
+    }
+}
+
+#[derive(Default)]
+struct Entry {
+    pages: HashMap<u32, Arc<Vec<PageRow>>>,
+    max_pos: Option<u32>,
+    /// By the position asked for; `None` when no post is at or after it
+    posts: HashMap<u32, Option<Arc<PostRow>>>,
+    used: u64,
+}
+
+pub struct BoardCache {
+    entries: HashMap<Listing, Entry>,
+    /// Listings by last use, oldest first; stale stamps are skipped on eviction
+    order: VecDeque<(Listing, u64)>,
+    cap: usize,
+    clock: u64,
+    generation: u64,
+}
+
+impl BoardCache {
+    /// At most `cap` listings; 0 disables the cache.
+    pub fn new(cap: usize) -> Self {
+        Self { entries: HashMap::new(), order: VecDeque::new(), cap, clock: 0, generation: 0 }
+    }
+
+    /// Taken before querying the DB and passed to the `put_*` calls after,
+    /// so rows read before a concurrent write are never stored.
+    pub fn generation(&self) -> u64 {
+        self.generation
+    }
+
+    fn touch(&mut self, key: &Listing) -> Option<&mut Entry> {
+        self.clock += 1;
+        let e = self.entries.get_mut(key)?;
+        e.used = self.clock;
+        self.order.push_back((key.clone(), self.clock));
+        Some(e)
+    }
+
+    /// The entry to store into, or `None` if `gen` is stale or caching is off.
+    fn slot(&mut self, key: &Listing, gen: u64) -> Option<&mut Entry> {
+        if self.cap == 0 || gen != self.generation {
+            return None;
+        }
+        if !self.entries.contains_key(key) {
+            self.entries.insert(key.clone(), Entry::default());
+            self.evict();
+        }
+        self.touch(key)
+    }
+
+    fn evict(&mut self) {
+        while self.entries.len() > self.cap {
+            let Some((key, stamp)) = self.order.pop_front() else { break };
+            if self.entries.get(&key).map_or(false, |e| e.used == stamp) {
+                self.entries.remove(&key);
+            }
+        }
+        if self.order.len() > self.cap * 4 {
+            let entries = &self.entries;
+            self.order.retain(|(k, s)| entries.get(k).map_or(false, |e| e.used == *s));
+        }
+    }
+
+    pub fn page(&mut self, key: &Listing, offset: u32) -> Option<Arc<Vec<PageRow>>> {
+        self.touch(key)?.pages.get(&offset).cloned()
+    }
+
+    pub fn put_page(&mut self, key: &Listing, offset: u32, rows: Arc<Vec<PageRow>>, gen: u64) {
+        if let Some(e) = self.slot(key, gen) {
+            e.pages.insert(offset, rows);
+        }
+    }
+
+    pub fn max_pos(&mut self, key: &Listing) -> Option<u32> {
+        self.touch(key)?.max_pos
+    }
+
+    pub fn put_max_pos(&mut self, key: &Listing, max_pos: u32, gen: u64) {
+        if let Some(e) = self.slot(key, gen) {
+            e.max_pos = Some(max_pos);
+        }
+    }
+
+    /// The post at or after `pos`; `Some(None)` if known to be none.
+    pub fn post(&mut self, key: &Listing, pos: u32) -> Option<Option<Arc<PostRow>>> {
+        self.touch(key)?.posts.get(&pos).cloned()
+    }
+
+    pub fn put_post(&mut self, key: &Listing, pos: u32, post: Option<Arc<PostRow>>, gen: u64) {
+        if let Some(e) = self.slot(key, gen) {
+            if e.posts.len() >= MAX_POSTS {
+                e.posts.clear();
+            }
+            e.posts.insert(pos, post);
+        }
+    }
+
+    /// Mail at `pos` was read: clear its unread colour in cached pages.
+    pub fn mark_read(&mut self, key: &Listing, pos: u32) {
+        self.generation += 1;
+        let Some(e) = self.entries.get_mut(key) else { return };
+        for rows in e.pages.values_mut() {
+            if rows.iter().any(|r| r.3 as u32 == pos && r.0 != 0) {
+                for r in Arc::make_mut(rows).iter_mut().filter(|r| r.3 as u32 == pos) {
+                    r.0 = 0;
+                }
+            }
+        }
+    }
+
+    /// `key` was written to; drop everything cached for it.
+    pub fn invalidate(&mut self, key: &Listing) {
+        self.generation += 1;
+        self.entries.remove(key);
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn row(pos: i32, color: i32) -> PageRow {
+        (color, "Ann".into(), format!("topic {pos}"), pos, 10, 14, 0)
+    }
+
+    #[test]
+    fn test_pages_posts_and_invalidation() {
+        let mut c = BoardCache::new(2);
+        let board = Listing::of(3, "Ann");
+        assert_eq!(board, Listing::Board(3));
+        assert_eq!(Listing::of(0, "Ann"), Listing::Mail("ann".into()));
+
+        assert!(c.page(&board, 0).is_none());
+        let gen = c.generation();
+        c.put_page(&board, 0, Arc::new(vec![row(2, 1), row(1, 0)]), gen);
+        c.put_max_pos(&board, 2, gen);
+        c.put_post(&board, 5, None, gen);
+        assert_eq!(c.page(&board, 0).unwrap().len(), 2);
+        assert!(c.page(&board, 20).is_none());
+        assert_eq!(c.max_pos(&board), Some(2));
+        assert_eq!(c.post(&board, 5), Some(None));
+
+        // A read that started before a write is not stored
+        let before = c.generation();
+        c.invalidate(&board);
+        assert!(c.page(&board, 0).is_none());
+        c.put_page(&board, 0, Arc::new(vec![row(1, 0)]), before);
+        assert!(c.page(&board, 0).is_none());
+    }
+
+    #[test]
+    fn test_mark_read_and_lru() {
+        let mut c = BoardCache::new(2);
+        let mail = Listing::of(0, "Bob");
+        let gen = c.generation();
+        c.put_page(&mail, 0, Arc::new(vec![row(4, 1), row(3, 1)]), gen);
+        c.mark_read(&Listing::Mail("bob".into()), 3);
+        let rows = c.page(&mail, 0).unwrap();
+        assert_eq!((rows[0].0, rows[1].0), (1, 0));
+
+        let (a, b) = (Listing::Board(1), Listing::Board(2));
+        c.put_max_pos(&a, 1, gen);
+        // `a` is used last, so the mailbox is the one evicted
+        c.page(&mail, 0);
+        c.max_pos(&a);
+        c.put_max_pos(&b, 1, gen);
+        assert_eq!(c.len(), 2);
+        assert!(c.page(&mail, 0).is_none());
+        assert_eq!(c.max_pos(&a), Some(1));
+
+        let mut off = BoardCache::new(0);
+        off.put_max_pos(&a, 1, 0);
+        assert_eq!(off.len(), 0);
+    }
+}
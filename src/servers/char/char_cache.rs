@@ -0,0 +1,338 @@
+//! Recently logged-out characters, kept in memory for a quick return.
+//!
+//! A relog or a hop to another map server saves the character on logout
+//! (0x3007) and loads it again a moment later. When the logout save is
+//! committed, the char server builds the status a DB load would now return
+//! (`stored_view`), compresses it like a 0x3803 reply and keeps it here with
+//! its section digests. The next 0x3003 for that character takes the entry
+//! instead of reading a dozen tables back.
+//!
+//! An entry is only valid while the DB still holds what it was built from:
+//! it is taken (removed) by the load that uses it, and dropped by any other
+//! save of the character, so it never outlives the session it came from.
+//! The map server and the login path also update the `Character` row
+//! directly (clans, paths, nation, bans), so a taken entry is checked
+//! against that row (`db::character_row_current`) before it is used.
+
+use std::collections::{HashMap, VecDeque};
+use std::time::{Duration, Instant};
+
+use crate::servers::char::charstatus::*;
+use crate::servers::char::dirty::Digests;
+
+/// Entries older than this are reloaded from the DB.
+pub const CACHE_TTL: Duration = Duration::from_secs(600);
+
+pub struct CachedChar {
+    /// zlib-compressed `stored_view`, ready for a 0x3803 reply
+    pub packed: Vec<u8>,
+    pub digests: Digests,
+    name: String,
+    at: Instant,
+}
+
+pub struct CharCache {
+    entries: HashMap<u32, CachedChar>,
+    /// Char ids oldest first; ids already removed are skipped on eviction
+    order: VecDeque<u32>,
+    cap: usize,
+}
+
+impl CharCache {
+    /// At most `cap` entries; 0 disables the cache.
+    pub fn new(cap: usize) -> Self {
+        Self { entries: HashMap::new(), order: VecDeque::new(), cap }
+    }
+
+    pub fn put(&mut self, char_id: u32, name: String, packed: Vec<u8>, digests: Digests, now: Instant) {
+        if self.cap == 0 {
+            return;
+        }
+        if self.entries.insert(char_id, CachedChar { packed, digests, name, at: now }).is_none() {
+            self.order.push_back(char_id);
+        }
+        while self.entries.len() > self.cap {
+            let Some(old) = self.order.pop_front() else { break };
+            self.entries.remove(&old);
+        }
+        // Keep removed ids from piling up in `order`
+        if self.order.len() > self.cap * 2 {
+            let entries = &self.entries;
+            self.order.retain(|id| entries.contains_key(id));
+        }
+    }
+
+    /// Remove `char_id`'s entry; returned if it is fresh and was saved under
+    /// `login_name` (a load renames the character to it).
+    pub fn take(&mut self, char_id: u32, login_name: &str, now: Instant) -> Option<CachedChar> {
+        let c = self.entries.remove(&char_id)?;
+        (c.name == login_name && now.duration_since(c.at) < CACHE_TTL).then_some(c)
+    }
+
+    pub fn remove(&mut self, char_id: u32) {
+        self.entries.remove(&char_id);
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+}
+
+fn zeroed_status() -> Box<MmoCharStatus> {
+    // 3MB: allocate on the heap directly, not via a stack temporary
+    unsafe {
+        let layout = std::alloc::Layout::new::<MmoCharStatus>();
+        let ptr = std::alloc::alloc_zeroed(layout) as *mut MmoCharStatus;
+        if ptr.is_null() {
+            std::alloc::handle_alloc_error(layout);
+        }
+        Box::from_raw(ptr)
+    }
+}
+
+/// C string up to the first NUL, always terminated, zero-filled after.
+fn cstr<const N: usize>(src: &[i8; N]) -> [i8; N] {
+    let n = src.iter().position(|&c| c == 0).unwrap_or(N).min(N - 1);
+    let mut out = [0i8; N];
+    out[..n].copy_from_slice(&src[..n]);
+    out
+}
+
+fn name_to_i8(name: &str) -> [i8; 16] {
+    let mut out = [0i8; 16];
+    for (d, &b) in out.iter_mut().zip(name.as_bytes().iter().take(15)) {
+        *d = b as i8;
+    }
+    out
+}
+
+fn stored_item(it: &Item) -> Item {
+    let mut out: Item = bytemuck::Zeroable::zeroed();
+    if it.id == 0 {
+        return out;
+    }
+    out.id = it.id;
+    out.amount = it.amount;
+    out.dura = it.dura;
+    out.owner = it.owner;
+    out.time = it.time;
+    out.custom = it.custom;
+    out.custom_look = it.custom_look;
+    out.custom_look_color = it.custom_look_color;
+    out.custom_icon = it.custom_icon;
+    out.custom_icon_color = it.custom_icon_color;
+    out.protected = it.protected;
+    out.real_name = cstr(&it.real_name);
+    out.note = cstr(&it.note);
+    out
+}
+
+/// Non-zero registry entries packed to the front, as a load returns them.
+fn packed_regs(src: &[GlobalReg], dst: &mut [GlobalReg], limit: usize) -> usize {
+    let mut n = 0;
+    for reg in src.iter().filter(|r| r.val != 0).take(limit.min(dst.len())) {
+        dst[n].str = cstr(&reg.str);
+        dst[n].val = reg.val;
+        n += 1;
+    }
+    n
+}
+
+/// What `db::load_char_bytes(char_id, login_name)` returns once `s` has been
+/// saved: only the columns the DB keeps, with the sub-table rows laid out
+/// the way a load puts them back. Keep in step with both.
+pub fn stored_view(s: &MmoCharStatus, login_name: &str) -> Box<MmoCharStatus> {
+    let mut v = zeroed_status();
+    v.id = s.id;
+    v.name = name_to_i8(login_name);
+    v.clan = s.clan;
+    v.clan_title = cstr(&s.clan_title);
+    v.title = cstr(&s.title);
+    v.f1name = cstr(&s.f1name);
+    v.level = s.level;
+    v.class = s.class;
+    v.mark = s.mark;
+    v.totem = s.totem;
+    v.karma = s.karma;
+    v.hp = s.hp;
+    v.basehp = s.basehp;
+    v.mp = s.mp;
+    v.basemp = s.basemp;
+    v.exp = s.exp;
+    v.money = s.money;
+    v.sex = s.sex;
+    v.country = s.country;
+    v.face = s.face;
+    v.hair_color = s.hair_color;
+    v.armor_color = s.armor_color;
+    v.last_pos = s.last_pos;
+    v.side = s.side;
+    v.state = s.state;
+    v.hair = s.hair;
+    v.face_color = s.face_color;
+    v.skin_color = s.skin_color;
+    v.partner = s.partner;
+    v.clan_chat = s.clan_chat;
+    v.subpath_chat = s.subpath_chat;
+    v.novice_chat = s.novice_chat;
+    v.setting_flags = s.setting_flags;
+    v.gm_level = s.gm_level;
+    v.disguise = s.disguise;
+    v.disguise_color = s.disguise_color;
+    v.maxslots = s.maxslots;
+    v.bankmoney = s.bankmoney;
+    v.maxinv = s.maxinv;
+    v.pk = s.pk;
+    v.killedby = s.killedby;
+    v.killspk = s.killspk;
+    v.pkduration = s.pkduration;
+    v.mute = s.mute;
+    v.heroes = s.heroes;
+    v.tier = s.tier;
+    v.expsold_magic = s.expsold_magic;
+    v.expsold_health = s.expsold_health;
+    v.expsold_stats = s.expsold_stats;
+    v.basemight = s.basemight;
+    v.basewill = s.basewill;
+    v.basegrace = s.basegrace;
+    v.basearmor = s.basearmor;
+    v.mini_map_toggle = s.mini_map_toggle;
+    // ChaLastIP is not written by a save; the session carried the loaded one
+    v.ipaddress = cstr(&s.ipaddress);
+    v.afkmessage = cstr(&s.afkmessage);
+    v.tutor = s.tutor;
+    v.alignment = s.alignment;
+    v.profile_vitastats = s.profile_vitastats;
+    v.profile_equiplist = s.profile_equiplist;
+    v.profile_legends = s.profile_legends;
+    v.profile_spells = s.profile_spells;
+    v.profile_inventory = s.profile_inventory;
+    v.profile_bankitems = s.profile_bankitems;
+    v.class_rank = s.class_rank;
+    v.clan_rank = s.clan_rank;
+
+    for (d, it) in v.inventory.iter_mut().zip(&s.inventory) {
+        *d = stored_item(it);
+    }
+    for (d, it) in v.equip.iter_mut().zip(&s.equip) {
+        *d = stored_item(it);
+        if d.id != 0 {
+            // Equipment has no amount column; a load reads 1
+            d.amount = 1;
+        }
+    }
+    v.skill = s.skill;
+    for (d, a) in v.dura_aether.iter_mut().zip(&s.dura_aether) {
+        if a.id != 0 {
+            d.id = a.id;
+            d.duration = a.duration;
+            d.aether = a.aether;
+        }
+    }
+
+    let regs = (s.global_reg_num.max(0) as usize).min(MAX_GLOBALREG);
+    v.global_reg_num = packed_regs(&s.global_reg[..regs], &mut v.global_reg, MAX_GLOBALREG) as i32;
+    let strs = (s.global_regstring_num.max(0) as usize).min(MAX_GLOBALREG);
+    let mut n = 0;
+    for reg in s.global_regstring[..strs].iter().filter(|r| r.val[0] != 0) {
+        v.global_regstring[n].str = cstr(&reg.str);
+        v.global_regstring[n].val = cstr(&reg.val);
+        n += 1;
+    }
+    v.global_regstring_num = n as i32;
+    // The load reads at most 100 NPC registry rows
+    packed_regs(&s.npcintreg, &mut v.npcintreg, 100);
+    packed_regs(&s.questreg, &mut v.questreg, MAX_GLOBALQUESTREG);
+
+    for (d, k) in v.killreg.iter_mut().zip(&s.killreg) {
+        if k.mob_id != 0 {
+            *d = *k;
+        }
+    }
+    for (d, leg) in v.legends.iter_mut().zip(&s.legends) {
+        if leg.name[0] != 0 {
+            d.icon = leg.icon;
+            d.color = leg.color;
+            d.text = cstr(&leg.text);
+            d.name = cstr(&leg.name);
+            d.tchaid = leg.tchaid;
+        }
+    }
+    for (d, b) in v.banks.iter_mut().zip(&s.banks) {
+        if b.item_id != 0 {
+            d.item_id = b.item_id;
+            d.amount = b.amount;
+            d.owner = b.owner;
+            d.custom_look = b.custom_look;
+            d.custom_look_color = b.custom_look_color;
+            d.custom_icon = b.custom_icon;
+            d.custom_icon_color = b.custom_icon_color;
+            d.protected = b.protected;
+            d.real_name = cstr(&b.real_name);
+            d.note = cstr(&b.note);
+        }
+    }
+    v
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_take_evict_and_expire() {
+        let t0 = Instant::now();
+        let mut c = CharCache::new(2);
+        c.put(1, "a".into(), vec![1], [0; 10], t0);
+        c.put(2, "b".into(), vec![2], [0; 10], t0);
+        c.put(3, "c".into(), vec![3], [0; 10], t0);
+        assert_eq!(c.len(), 2);
+        assert!(c.take(1, "a", t0).is_none());
+        assert_eq!(c.take(2, "b", t0).map(|e| e.packed), Some(vec![2]));
+        // Taken once only
+        assert!(c.take(2, "b", t0).is_none());
+        // Renamed since the save: reload from the DB
+        assert!(c.take(3, "x", t0).is_none());
+
+        c.put(4, "d".into(), vec![4], [0; 10], t0);
+        assert!(c.take(4, "d", t0 + CACHE_TTL).is_none());
+        assert!(c.is_empty());
+
+        let mut off = CharCache::new(0);
+        off.put(1, "a".into(), vec![1], [0; 10], t0);
+        assert!(off.is_empty());
+    }
+
+    #[test]
+    fn test_stored_view_drops_session_state() {
+        let mut s = zeroed_status();
+        s.id = 9;
+        s.hp = 50;
+        s.map_server = 3;
+        s.tnl = 77;
+        s.inventory[4].id = 10;
+        s.inventory[4].traps_table[0] = 5;
+        s.inventory[6].amount = 3; // empty slot, not saved
+        s.equip[1].id = 20;
+        s.global_reg_num = 3;
+        s.global_reg[0].val = 1;
+        s.global_reg[2].val = 2;
+        s.acctreg[0].val = 4;
+        s.title[..3].copy_from_slice(&[104, 0, 105]);
+
+        let v = stored_view(&s, "bob");
+        assert_eq!((v.id, v.hp, v.map_server, v.tnl), (9, 50, 0, 0));
+        assert_eq!(&v.name[..4], &[98, 111, 98, 0]);
+        assert_eq!((v.inventory[4].id, v.inventory[4].traps_table[0]), (10, 0));
+        assert_eq!(v.inventory[6].amount, 0);
+        assert_eq!(v.equip[1].amount, 1);
+        assert_eq!(v.global_reg_num, 2);
+        assert_eq!((v.global_reg[0].val, v.global_reg[1].val), (1, 2));
+        assert_eq!(v.acctreg[0].val, 0);
+        assert_eq!(&v.title[..3], &[104, 0, 0]);
+    }
+}
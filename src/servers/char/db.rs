@@ -1,7 +1,9 @@
-use sqlx::{MySqlPool, Row, Transaction, MySql};
+use sqlx::{MySqlPool, QueryBuilder, Row, Transaction, MySql};
 use anyhow::Result;
 use md5::{Md5, Digest};
 use crate::servers::char::charstatus::*;
+use crate::servers::char::dirty::*;
+use crate::servers::char::hash_pool;
 
 /// Compute MD5 of `input` and return it as a lowercase hex string.
 /// Kept for legacy password verification only.
@@ -20,55 +22,49 @@ pub(crate) fn is_legacy_hash(stored: &str) -> bool {
 }
 
 /// Hash a plaintext password with bcrypt at cost 10.
-/// Runs on a blocking thread to avoid stalling the async executor.
+/// Runs on the bcrypt pool; fails without waiting when its queue is full.
 pub async fn hash_password(pass: &str) -> Result<String> {
     let pass = pass.to_owned();
-    tokio::task::spawn_blocking(move || {
-        bcrypt::hash(&pass, 10).map_err(|e| anyhow::anyhow!("bcrypt hash failed: {}", e))
+    hash_pool::run(move || bcrypt::hash(&pass, 10))
+        .await?
+        .map_err(|e| anyhow::anyhow!("bcrypt hash failed: {}", e))
+}
+
+/// bcrypt::verify on the bcrypt pool.
+async fn bcrypt_verify(pass: &str, stored: &str) -> Result<bool> {
+    let pass = pass.to_owned();
+    let stored = stored.to_owned();
+    Ok(hash_pool::run(move || {
+        bcrypt::verify(&pass, &stored).unwrap_or_else(|e| {
+            tracing::error!("[auth] bcrypt::verify error: {}", e);
+            false
+        })
     })
-    .await
-    .map_err(|e| anyhow::anyhow!("spawn_blocking failed: {}", e))?
+    .await?)
 }
 
 /// Verify password against stored hash.
-/// If stored is a bcrypt hash ($2b$/$2a$ prefix), uses bcrypt::verify on a blocking thread.
+/// If stored is a bcrypt hash ($2b$/$2a$ prefix), verifies on the bcrypt pool.
 /// Otherwise falls back to MD5("lowercase_name password") or MD5(password).
-pub async fn ispass(name: &str, pass: &str, stored_hash: &str) -> bool {
+/// Errs only when the pool is saturated.
+pub async fn ispass(name: &str, pass: &str, stored_hash: &str) -> Result<bool> {
     if !is_legacy_hash(stored_hash) {
-        let pass = pass.to_owned();
-        let stored_hash = stored_hash.to_owned();
-        return tokio::task::spawn_blocking(move || {
-            bcrypt::verify(&pass, &stored_hash).unwrap_or_else(|e| {
-                tracing::error!("[auth] bcrypt::verify error: {}", e);
-                false
-            })
-        })
-        .await
-        .unwrap_or(false);
+        return bcrypt_verify(pass, stored_hash).await;
     }
     let form1 = md5_hex(&format!("{} {}", name.to_lowercase(), pass));
     let form2 = md5_hex(pass);
-    stored_hash == form1 || stored_hash == form2
+    Ok(stored_hash == form1 || stored_hash == form2)
 }
 
 /// Returns true if master password matches and hasn't expired.
 /// Supports both bcrypt and legacy MD5 stored hashes.
-pub async fn ismastpass(pass: &str, stored: &str, expire: u32) -> bool {
+pub async fn ismastpass(pass: &str, stored: &str, expire: u32) -> Result<bool> {
     let now = chrono::Utc::now().timestamp();
-    if now > expire as i64 { return false; }
+    if now > expire as i64 { return Ok(false); }
     if !is_legacy_hash(stored) {
-        let pass = pass.to_owned();
-        let stored = stored.to_owned();
-        return tokio::task::spawn_blocking(move || {
-            bcrypt::verify(&pass, &stored).unwrap_or_else(|e| {
-                tracing::error!("[auth] bcrypt::verify error: {}", e);
-                false
-            })
-        })
-        .await
-        .unwrap_or(false);
+        return bcrypt_verify(pass, stored).await;
     }
-    md5_hex(pass) == stored
+    Ok(md5_hex(pass) == stored)
 }
 
 /// Returns true if character name is already taken.
@@ -200,7 +196,14 @@ pub async fn set_char_password(pool: &MySqlPool, name: &str, pass: &str, newpass
         Ok(None) => return -2,
         Err(_) => return -1,
     };
-    if !ispass(name, pass, &stored).await { return -3; }
+    match ispass(name, pass, &stored).await {
+        Ok(true) => {}
+        Ok(false) => return -3,
+        Err(e) => {
+            tracing::warn!("[char] password check refused: {}", e);
+            return -1;
+        }
+    }
     let hashed = match hash_password(newpass).await {
         Ok(h) => h,
         Err(e) => {
@@ -218,47 +221,29 @@ pub async fn set_char_password(pool: &MySqlPool, name: &str, pass: &str, newpass
 
 /// Load a character from DB and return it as a raw byte blob for zlib transfer.
 /// Mirrors mmo_char_fromdb in char_db.c.
-pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -> Result<Vec<u8>> {
-
-    // Update character name to match login name (mirrors C line 427)
-    let _ = sqlx::query("UPDATE `Character` SET `ChaName` = ? WHERE `ChaId` = ?")
-        .bind(login_name).bind(char_id).execute(pool).await;
-
-    // ── Main character row ────────────────────────────────────────────────────
-    // Use manual row access because 67 columns exceeds sqlx's tuple FromRow limit (16).
-    let row = sqlx::query(
-        "SELECT `ChaName`, `ChaClnId`, `ChaClanTitle`, `ChaTitle`, \
-         `ChaF1Name`, `ChaLevel`, `ChaPthId`, `ChaMark`, \
-         `ChaTotem`, `ChaKarma`, `ChaCurrentVita`, `ChaBaseVita`, \
-         `ChaCurrentMana`, `ChaBaseMana`, `ChaExperience`, `ChaGold`, `ChaSex`, \
-         `ChaNation`, `ChaFace`, `ChaHairColor`, `ChaArmorColor`, \
-         `ChaMapId`, `ChaX`, `ChaY`, `ChaSide`, `ChaState`, `ChaHair`, `ChaFaceColor`, \
-         `ChaSkinColor`, `ChaPartner`, `ChaClanChat`, `ChaPathChat`, `ChaNoviceChat`, \
-         `ChaSettings`, `ChaGMLevel`, `ChaDisguise`, `ChaDisguiseColor`, \
-         `ChaMaximumBankSlots`, `ChaBankGold`, `ChaMaximumInventory`, `ChaPK`, \
-         `ChaKilledBy`, `ChaKillsPK`, `ChaPKDuration`, `ChaMuted`, `ChaHeroes`, `ChaTier`, \
-         `ChaExperienceSoldMagic`, `ChaExperienceSoldHealth`, `ChaExperienceSoldStats`, \
-         `ChaBaseMight`, `ChaBaseWill`, `ChaBaseGrace`, `ChaBaseArmor`, `ChaMiniMapToggle`, \
-         `ChaLastIP`, `ChaAFKMessage`, `ChaTutor`, `ChaAlignment`, \
-         `ChaProfileVitaStats`, `ChaProfileEquipList`, `ChaProfileLegends`, \
-         `ChaProfileSpells`, `ChaProfileInventory`, `ChaProfileBankItems`, \
-         `ChaPthRank`, `ChaClnRank` \
-         FROM `Character` WHERE `ChaId` = ? LIMIT 1"
-    ).bind(char_id).fetch_optional(pool).await?;
-
-    let row = match row { Some(r) => r, None => anyhow::bail!("character not found") };
-
-    // Allocate directly on heap — MmoCharStatus is 3MB, so Box::new(zeroed()) would
-    // stack-allocate it first and overflow the tokio worker thread stack.
-    let mut s: Box<MmoCharStatus> = unsafe {
-        let layout = std::alloc::Layout::new::<MmoCharStatus>();
-        let ptr = std::alloc::alloc_zeroed(layout) as *mut MmoCharStatus;
-        if ptr.is_null() {
-            std::alloc::handle_alloc_error(layout);
-        }
-        Box::from_raw(ptr)
-    };
-    s.id = char_id;
+/// The main `Character` row of a load, in the column order of
+/// `fill_character_row`.
+const CHARACTER_ROW: &str =
+    "SELECT `ChaName`, `ChaClnId`, `ChaClanTitle`, `ChaTitle`, \
+     `ChaF1Name`, `ChaLevel`, `ChaPthId`, `ChaMark`, \
+     `ChaTotem`, `ChaKarma`, `ChaCurrentVita`, `ChaBaseVita`, \
+     `ChaCurrentMana`, `ChaBaseMana`, `ChaExperience`, `ChaGold`, `ChaSex`, \
+     `ChaNation`, `ChaFace`, `ChaHairColor`, `ChaArmorColor`, \
+     `ChaMapId`, `ChaX`, `ChaY`, `ChaSide`, `ChaState`, `ChaHair`, `ChaFaceColor`, \
+     `ChaSkinColor`, `ChaPartner`, `ChaClanChat`, `ChaPathChat`, `ChaNoviceChat`, \
+     `ChaSettings`, `ChaGMLevel`, `ChaDisguise`, `ChaDisguiseColor`, \
+     `ChaMaximumBankSlots`, `ChaBankGold`, `ChaMaximumInventory`, `ChaPK`, \
+     `ChaKilledBy`, `ChaKillsPK`, `ChaPKDuration`, `ChaMuted`, `ChaHeroes`, `ChaTier`, \
+     `ChaExperienceSoldMagic`, `ChaExperienceSoldHealth`, `ChaExperienceSoldStats`, \
+     `ChaBaseMight`, `ChaBaseWill`, `ChaBaseGrace`, `ChaBaseArmor`, `ChaMiniMapToggle`, \
+     `ChaLastIP`, `ChaAFKMessage`, `ChaTutor`, `ChaAlignment`, \
+     `ChaProfileVitaStats`, `ChaProfileEquipList`, `ChaProfileLegends`, \
+     `ChaProfileSpells`, `ChaProfileInventory`, `ChaProfileBankItems`, \
+     `ChaPthRank`, `ChaClnRank` \
+     FROM `Character` WHERE `ChaId` = ? LIMIT 1";
+
+/// Copy the `CHARACTER_ROW` columns into `s`; nothing else is touched.
+fn fill_character_row(s: &mut MmoCharStatus, row: &sqlx::mysql::MySqlRow) {
     copy_str_to_i8(&mut s.name,       &row.try_get::<String, _>(0).unwrap_or_default());
     s.clan           = row.try_get::<u32, _>(1).unwrap_or(0);
     copy_str_to_i8(&mut s.clan_title,  &row.try_get::<String, _>(2).unwrap_or_default());
@@ -359,18 +344,118 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
     s.class_rank         = row.try_get::<u32, _>(65).unwrap_or(0) as i32;
     // col 66: ChaClnRank — int(10) unsigned → u32, cast to i32
     s.clan_rank          = row.try_get::<u32, _>(66).unwrap_or(0) as i32;
+}
+
+/// Whether `packed` (a zlib-compressed status as a load of `char_id`
+/// under `login_name` returned it) still agrees with the `Character` row.
+/// The map server and the login path update that row directly (clan and
+/// path changes, nation, marks), without going through a save.
+pub async fn character_row_current(pool: &MySqlPool, char_id: u32, login_name: &str, packed: Vec<u8>) -> bool {
+    let row = match sqlx::query(CHARACTER_ROW).bind(char_id).fetch_optional(pool).await {
+        Ok(Some(row)) => row,
+        _ => return false,
+    };
+    let login_name = login_name.to_owned();
+    tokio::task::spawn_blocking(move || {
+        use std::io::Read;
+        let mut raw = Vec::new();
+        if flate2::read::ZlibDecoder::new(&packed[..]).read_to_end(&mut raw).is_err() {
+            return false;
+        }
+        // Overlay the row on a copy: a no-op if nothing changed
+        let Some(mut fresh) = char_status_from_bytes(&raw) else { return false };
+        fill_character_row(&mut fresh, &row);
+        copy_str_to_i8(&mut fresh.name, &login_name);
+        char_status_to_bytes(&fresh) == &raw[..std::mem::size_of::<MmoCharStatus>()]
+    })
+    .await
+    .unwrap_or(false)
+}
+
+pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -> Result<Vec<u8>> {
+
+    // Update character name to match login name (mirrors C line 427)
+    let rename = async {
+        let _ = sqlx::query("UPDATE `Character` SET `ChaName` = ? WHERE `ChaId` = ?")
+            .bind(login_name).bind(char_id).execute(pool).await;
+        Ok::<_, sqlx::Error>(())
+    };
+
+    // ── Main character row ────────────────────────────────────────────────────
+    // Use manual row access because 67 columns exceeds sqlx's tuple FromRow limit (16).
+    let row = sqlx::query(CHARACTER_ROW).bind(char_id).fetch_optional(pool);
+
+    // ── Sub-tables ────────────────────────────────────────────────────────────
+    // Issued together: each query takes its own pool connection, so a load
+    // costs about one round trip instead of twelve in a row.
+    let banks = sqlx::query_as::<_, (String, u32, u32, u32, u32, u32, u32, u32, u32, u32, String)>(
+        "SELECT `BnkEngrave`, `BnkItmId`, `BnkAmount`, `BnkChaIdOwner`, \
+         `BnkPosition`, `BnkCustomLook`, `BnkCustomLookColor`, \
+         `BnkCustomIcon`, `BnkCustomIconColor`, `BnkProtected`, `BnkNote` \
+         FROM `Banks` WHERE `BnkChaId` = ? LIMIT 255"
+    ).bind(char_id).fetch_all(pool);
+    let items = sqlx::query_as::<_, (String, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, String)>(
+        "SELECT `InvEngrave`, `InvItmId`, `InvAmount`, `InvDurability`, \
+         `InvChaIdOwner`, `InvTimer`, `InvPosition`, `InvCustom`, \
+         `InvCustomLook`, `InvCustomLookColor`, `InvCustomIcon`, \
+         `InvCustomIconColor`, `InvProtected`, `InvNote` \
+         FROM `Inventory` WHERE `InvChaId` = ? LIMIT 52"
+    ).bind(char_id).fetch_all(pool);
+    let equips = sqlx::query_as::<_, (String, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, String)>(
+        "SELECT `EqpEngrave`, `EqpItmId`, CAST(1 AS UNSIGNED), `EqpDurability`, \
+         `EqpChaIdOwner`, `EqpTimer`, `EqpSlot`, `EqpCustom`, \
+         `EqpCustomLook`, `EqpCustomLookColor`, `EqpCustomIcon`, \
+         `EqpCustomIconColor`, `EqpProtected`, `EqpNote` \
+         FROM `Equipment` WHERE `EqpChaId` = ? LIMIT 15"
+    ).bind(char_id).fetch_all(pool);
+    let spells = sqlx::query_as::<_, (u32, u32)>(
+        "SELECT `SbkSplId`, `SbkPosition` FROM `SpellBook` WHERE `SbkChaId` = ? LIMIT 52"
+    ).bind(char_id).fetch_all(pool);
+    let aethers = sqlx::query_as::<_, (u32, u32, u32, u32)>(
+        "SELECT `AthAether`, `AthSplId`, `AthDuration`, `AthPosition` \
+         FROM `Aethers` WHERE `AthChaId` = ? LIMIT 200"
+    ).bind(char_id).fetch_all(pool);
+    let regs = sqlx::query_as::<_, (String, u32)>(
+        "SELECT `RegIdentifier`, `RegValue` FROM `Registry` WHERE `RegChaId` = ? LIMIT 5000"
+    ).bind(char_id).fetch_all(pool);
+    let regstrs = sqlx::query_as::<_, (String, String)>(
+        "SELECT `RegIdentifier`, `RegValue` FROM `RegistryString` WHERE `RegChaId` = ? LIMIT 5000"
+    ).bind(char_id).fetch_all(pool);
+    let npcregs = sqlx::query_as::<_, (String, u32)>(
+        "SELECT `NrgIdentifier`, `NrgValue` FROM `NPCRegistry` WHERE `NrgChaId` = ? LIMIT 100"
+    ).bind(char_id).fetch_all(pool);
+    let questregs = sqlx::query_as::<_, (String, u32)>(
+        "SELECT `QrgIdentifier`, `QrgValue` FROM `QuestRegistry` WHERE `QrgChaId` = ? LIMIT 250"
+    ).bind(char_id).fetch_all(pool);
+    let legends = sqlx::query_as::<_, (u32, u32, u32, String, String, u32)>(
+        "SELECT `LegPosition`, `LegIcon`, `LegColor`, `LegDescription`, \
+         `LegIdentifier`, `LegTChaId` FROM `Legends` WHERE `LegChaId` = ? LIMIT 1000"
+    ).bind(char_id).fetch_all(pool);
+    let kills = sqlx::query_as::<_, (u32, u32, u32)>(
+        "SELECT `KilPosition`, `KilMobId`, `KilAmount` FROM `Kills` WHERE `KilChaId` = ? LIMIT 5000"
+    ).bind(char_id).fetch_all(pool);
+    let (_, row, banks, items, equips, spells, aethers, regs, regstrs, npcregs, questregs, legends, kills) =
+        tokio::try_join!(rename, row, banks, items, equips, spells, aethers, regs, regstrs, npcregs, questregs, legends, kills)?;
+
+    let row = match row { Some(r) => r, None => anyhow::bail!("character not found") };
+
+    // Allocate directly on heap — MmoCharStatus is 3MB, so Box::new(zeroed()) would
+    // stack-allocate it first and overflow the tokio worker thread stack.
+    let mut s: Box<MmoCharStatus> = unsafe {
+        let layout = std::alloc::Layout::new::<MmoCharStatus>();
+        let ptr = std::alloc::alloc_zeroed(layout) as *mut MmoCharStatus;
+        if ptr.is_null() {
+            std::alloc::handle_alloc_error(layout);
+        }
+        Box::from_raw(ptr)
+    };
+    s.id = char_id;
+    fill_character_row(&mut s, &row);
     // mirror C line 616: overwrite name with login_name
     copy_str_to_i8(&mut s.name, login_name);
 
     // ── Banks ─────────────────────────────────────────────────────────────────
     // BnkPosition is int(10) unsigned → u32 (not u8)
-    let banks: Vec<(String, u32, u32, u32, u32, u32, u32, u32, u32, u32, String)> =
-        sqlx::query_as(
-            "SELECT `BnkEngrave`, `BnkItmId`, `BnkAmount`, `BnkChaIdOwner`, \
-             `BnkPosition`, `BnkCustomLook`, `BnkCustomLookColor`, \
-             `BnkCustomIcon`, `BnkCustomIconColor`, `BnkProtected`, `BnkNote` \
-             FROM `Banks` WHERE `BnkChaId` = ? LIMIT 255"
-        ).bind(char_id).fetch_all(pool).await?;
     for (engrave, item_id, amount, owner, pos, custom_look, custom_look_color,
          custom_icon, custom_icon_color, protected, note) in banks {
         let p = pos as usize;
@@ -390,14 +475,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
     // ── Inventory ─────────────────────────────────────────────────────────────
     // InvDurability is int(10) unsigned → u32 (not i32)
     // InvPosition is int(10) unsigned → u32 (not u8)
-    let items: Vec<(String, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, String)> =
-        sqlx::query_as(
-            "SELECT `InvEngrave`, `InvItmId`, `InvAmount`, `InvDurability`, \
-             `InvChaIdOwner`, `InvTimer`, `InvPosition`, `InvCustom`, \
-             `InvCustomLook`, `InvCustomLookColor`, `InvCustomIcon`, \
-             `InvCustomIconColor`, `InvProtected`, `InvNote` \
-             FROM `Inventory` WHERE `InvChaId` = ? LIMIT 52"
-        ).bind(char_id).fetch_all(pool).await?;
     for (engrave, id, amount, dura, owner, time, pos, custom,
          custom_look, custom_look_color, custom_icon, custom_icon_color, protected, note) in items {
         let p = pos as usize;
@@ -419,14 +496,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── Equipment ─────────────────────────────────────────────────────────────
     // EqpDurability is int(10) unsigned → u32, EqpSlot is int(10) unsigned → u32
-    let equips: Vec<(String, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, u32, String)> =
-        sqlx::query_as(
-            "SELECT `EqpEngrave`, `EqpItmId`, CAST(1 AS UNSIGNED), `EqpDurability`, \
-             `EqpChaIdOwner`, `EqpTimer`, `EqpSlot`, `EqpCustom`, \
-             `EqpCustomLook`, `EqpCustomLookColor`, `EqpCustomIcon`, \
-             `EqpCustomIconColor`, `EqpProtected`, `EqpNote` \
-             FROM `Equipment` WHERE `EqpChaId` = ? LIMIT 15"
-        ).bind(char_id).fetch_all(pool).await?;
     for (engrave, id, amount, dura, owner, time, pos, custom,
          custom_look, custom_look_color, custom_icon, custom_icon_color, protected, note) in equips {
         let p = pos as usize;
@@ -448,9 +517,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── SpellBook ─────────────────────────────────────────────────────────────
     // SbkSplId and SbkPosition are int(10) unsigned → u32
-    let spells: Vec<(u32, u32)> = sqlx::query_as(
-        "SELECT `SbkSplId`, `SbkPosition` FROM `SpellBook` WHERE `SbkChaId` = ? LIMIT 52"
-    ).bind(char_id).fetch_all(pool).await?;
     for (spell_id, pos) in spells {
         let p = pos as usize;
         if p < MAX_SPELLS { s.skill[p] = spell_id as u16; }
@@ -458,10 +524,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── Aethers ───────────────────────────────────────────────────────────────
     // AthAether, AthDuration, AthPosition are int(10) unsigned → u32; AthSplId stays u16-ish
-    let aethers: Vec<(u32, u32, u32, u32)> = sqlx::query_as(
-        "SELECT `AthAether`, `AthSplId`, `AthDuration`, `AthPosition` \
-         FROM `Aethers` WHERE `AthChaId` = ? LIMIT 200"
-    ).bind(char_id).fetch_all(pool).await?;
     for (aether, spell_id, duration, pos) in aethers {
         let p = pos as usize;
         if p >= MAX_MAGIC_TIMERS { continue; }
@@ -472,9 +534,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── Registry (int) ────────────────────────────────────────────────────────
     // RegValue is int(10) unsigned → u32, cast to i32 in struct
-    let regs: Vec<(String, u32)> = sqlx::query_as(
-        "SELECT `RegIdentifier`, `RegValue` FROM `Registry` WHERE `RegChaId` = ? LIMIT 5000"
-    ).bind(char_id).fetch_all(pool).await?;
     s.global_reg_num = regs.len().min(MAX_GLOBALREG) as i32;
     for (i, (key, val)) in regs.into_iter().enumerate() {
         if i >= MAX_GLOBALREG { break; }
@@ -483,9 +542,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
     }
 
     // ── Registry (string) ─────────────────────────────────────────────────────
-    let regstrs: Vec<(String, String)> = sqlx::query_as(
-        "SELECT `RegIdentifier`, `RegValue` FROM `RegistryString` WHERE `RegChaId` = ? LIMIT 5000"
-    ).bind(char_id).fetch_all(pool).await?;
     s.global_regstring_num = regstrs.len().min(MAX_GLOBALREG) as i32;
     for (i, (key, val)) in regstrs.into_iter().enumerate() {
         if i >= MAX_GLOBALREG { break; }
@@ -495,9 +551,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── NPC Registry ──────────────────────────────────────────────────────────
     // NrgValue is int(10) unsigned → u32, cast to i32
-    let npcregs: Vec<(String, u32)> = sqlx::query_as(
-        "SELECT `NrgIdentifier`, `NrgValue` FROM `NPCRegistry` WHERE `NrgChaId` = ? LIMIT 100"
-    ).bind(char_id).fetch_all(pool).await?;
     for (i, (key, val)) in npcregs.into_iter().enumerate() {
         if i >= MAX_GLOBALREG { break; }
         copy_str_to_i8(&mut s.npcintreg[i].str, &key);
@@ -506,9 +559,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── Quest Registry ────────────────────────────────────────────────────────
     // QrgValue is int(10) unsigned → u32, cast to i32
-    let questregs: Vec<(String, u32)> = sqlx::query_as(
-        "SELECT `QrgIdentifier`, `QrgValue` FROM `QuestRegistry` WHERE `QrgChaId` = ? LIMIT 250"
-    ).bind(char_id).fetch_all(pool).await?;
     for (i, (key, val)) in questregs.into_iter().enumerate() {
         if i >= MAX_GLOBALQUESTREG { break; }
         copy_str_to_i8(&mut s.questreg[i].str, &key);
@@ -517,10 +567,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── Legends ───────────────────────────────────────────────────────────────
     // LegPosition, LegIcon, LegColor are int(10) unsigned → u32, cast to u16 where needed
-    let legends: Vec<(u32, u32, u32, String, String, u32)> = sqlx::query_as(
-        "SELECT `LegPosition`, `LegIcon`, `LegColor`, `LegDescription`, \
-         `LegIdentifier`, `LegTChaId` FROM `Legends` WHERE `LegChaId` = ? LIMIT 1000"
-    ).bind(char_id).fetch_all(pool).await?;
     for (pos, icon, color, text, name, tchaid) in legends {
         let p = pos as usize;
         if p >= MAX_LEGENDS { continue; }
@@ -533,9 +579,6 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
 
     // ── Kill counts ───────────────────────────────────────────────────────────
     // KilPosition, KilMobId, KilAmount are all int(10) unsigned → u32 (already correct)
-    let kills: Vec<(u32, u32, u32)> = sqlx::query_as(
-        "SELECT `KilPosition`, `KilMobId`, `KilAmount` FROM `Kills` WHERE `KilChaId` = ? LIMIT 5000"
-    ).bind(char_id).fetch_all(pool).await?;
     for (pos, mob_id, amount) in kills {
         let p = pos as usize;
         if p >= MAX_KILLREG { continue; }
@@ -547,15 +590,45 @@ pub async fn load_char_bytes(pool: &MySqlPool, char_id: u32, login_name: &str) -
     Ok(char_status_to_bytes(&s).to_vec())
 }
 
-/// Save a character from a raw byte blob back to the DB.
-/// Mirrors mmo_char_todb + sub-table save functions in char_db.c.
-pub async fn save_char_bytes(pool: &MySqlPool, raw: &[u8]) -> Result<()> {
+/// Save one character back to the DB. See `save_chars`.
+pub async fn save_char(pool: &MySqlPool, s: &MmoCharStatus, dirty: u32) -> Result<()> {
+    save_chars(pool, &[(s, dirty)]).await
+}
 
-    let s = match char_status_from_bytes(raw) {
-        Some(s) => s,
-        None => anyhow::bail!("invalid char status bytes: got {} bytes, need {}", raw.len(), std::mem::size_of::<crate::servers::char::charstatus::MmoCharStatus>()),
-    };
-    if s.id == 0 { return Ok(()); }
+/// Save a batch of characters in one transaction.
+/// Mirrors mmo_char_todb + sub-table save functions in char_db.c. Each
+/// `Character` row is always written; sub-tables only for the `dirty::SEC_*`
+/// sections set in that character's mask. The sub-table rows of the whole
+/// batch go out as multi-row upserts keyed on (char, position), then one
+/// delete per character and table clears the positions that are now empty.
+pub async fn save_chars(pool: &MySqlPool, batch: &[(&MmoCharStatus, u32)]) -> Result<()> {
+    let mut tx = pool.begin().await?;
+    for &(s, dirty) in batch {
+        if s.id != 0 { update_character(&mut tx, s, dirty).await?; }
+    }
+
+    let mut rows = Vec::new();
+    let mut owners = Vec::new();
+    for table in SUB_TABLES {
+        rows.clear();
+        owners.clear();
+        for &(s, dirty) in batch {
+            if s.id == 0 || dirty & table.section == 0 { continue; }
+            let start = rows.len();
+            (table.rows)(s, &mut rows);
+            owners.push((s.id, start..rows.len()));
+        }
+        upsert_rows(&mut tx, table, &rows).await?;
+        for (char_id, range) in &owners {
+            prune_rows(&mut tx, table, *char_id, &rows[range.clone()]).await?;
+        }
+    }
+    tx.commit().await?;
+
+    Ok(())
+}
+
+async fn update_character(tx: &mut Transaction<'_, MySql>, s: &MmoCharStatus, dirty: u32) -> Result<()> {
 
     let name      = i8_slice_to_str(&s.name);
     let clan_title = i8_slice_to_str(&s.clan_title);
@@ -563,9 +636,7 @@ pub async fn save_char_bytes(pool: &MySqlPool, raw: &[u8]) -> Result<()> {
     let f1name    = i8_slice_to_str(&s.f1name);
     let afkmsg    = i8_slice_to_str(&s.afkmessage);
 
-    tracing::info!("[char] [save_char] name={} map={} x={} y={}", name, s.last_pos.m, s.last_pos.x, s.last_pos.y);
-
-    let mut tx = pool.begin().await?;
+    tracing::info!("[char] [save_char] name={} map={} x={} y={} dirty={:#05x}", name, s.last_pos.m, s.last_pos.x, s.last_pos.y, dirty);
 
     sqlx::query(
         "UPDATE `Character` SET \
@@ -607,21 +678,7 @@ pub async fn save_char_bytes(pool: &MySqlPool, raw: &[u8]) -> Result<()> {
     .bind(s.profile_spells).bind(s.profile_inventory).bind(s.profile_bankitems)
     .bind(s.class_rank as u32).bind(s.clan_rank as u32)
     .bind(s.id)
-    .execute(&mut *tx).await?;
-
-    // ── Sub-table saves (position-keyed upsert matching C pattern) ────────────
-    save_items_inventory(&mut tx, s.id, &s.inventory).await?;
-    save_items_equipment(&mut tx, s.id, &s.equip).await?;
-    save_spells(&mut tx, s.id, &s.skill).await?;
-    save_aethers(&mut tx, s.id, &s.dura_aether).await?;
-    save_registry(&mut tx, s.id, &s.global_reg, s.global_reg_num as usize).await?;
-    save_registry_string(&mut tx, s.id, &s.global_regstring, s.global_regstring_num as usize).await?;
-    save_npc_registry(&mut tx, s.id, &s.npcintreg).await?;
-    save_quest_registry(&mut tx, s.id, &s.questreg).await?;
-    save_kills(&mut tx, s.id, &s.killreg).await?;
-    save_legends(&mut tx, s.id, &s.legends).await?;
-    save_banks(&mut tx, s.id, &s.banks).await?;
-    tx.commit().await?;
+    .execute(&mut **tx).await?;
 
     Ok(())
 }
@@ -653,170 +710,225 @@ fn i8_slice_to_str(src: &[i8]) -> String {
 }
 
 
-async fn save_items_inventory(tx: &mut Transaction<'_, MySql>, char_id: u32, items: &[crate::servers::char::charstatus::Item]) -> Result<()> {
-    sqlx::query("DELETE FROM `Inventory` WHERE `InvChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, item) in items.iter().enumerate().take(MAX_INVENTORY) {
-        if item.id == 0 { continue; }
-        let name = i8_slice_to_str(&item.real_name);
-        let note = i8_slice_to_str(&item.note);
-        sqlx::query(
-            "INSERT INTO `Inventory` \
-             (`InvChaId`,`InvItmId`,`InvAmount`,`InvDurability`,`InvChaIdOwner`,\
-              `InvCustom`,`InvTimer`,`InvEngrave`,`InvCustomLook`,`InvCustomLookColor`,\
-              `InvCustomIcon`,`InvCustomIconColor`,`InvProtected`,`InvNote`,`InvPosition`) \
-             VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)"
-        ).bind(char_id).bind(item.id).bind(item.amount).bind(item.dura).bind(item.owner)
-         .bind(item.custom).bind(item.time).bind(&name)
-         .bind(item.custom_look).bind(item.custom_look_color)
-         .bind(item.custom_icon).bind(item.custom_icon_color)
-         .bind(item.protected).bind(&note).bind(i as u32)
-         .execute(&mut **tx).await?;
-    }
-    Ok(())
-}
+// ── Sub-table saves ───────────────────────────────────────────────────────────
 
-async fn save_items_equipment(tx: &mut Transaction<'_, MySql>, char_id: u32, items: &[crate::servers::char::charstatus::Item]) -> Result<()> {
-    sqlx::query("DELETE FROM `Equipment` WHERE `EqpChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, item) in items.iter().enumerate().take(MAX_EQUIP) {
-        if item.id == 0 { continue; }
-        let name = i8_slice_to_str(&item.real_name);
-        let note = i8_slice_to_str(&item.note);
-        sqlx::query(
-            "INSERT INTO `Equipment` \
-             (`EqpChaId`,`EqpItmId`,`EqpDurability`,`EqpChaIdOwner`,`EqpCustom`,`EqpTimer`,\
-              `EqpEngrave`,`EqpCustomLook`,`EqpCustomLookColor`,`EqpCustomIcon`,\
-              `EqpCustomIconColor`,`EqpProtected`,`EqpNote`,`EqpSlot`) \
-             VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?)"
-        ).bind(char_id).bind(item.id).bind(item.dura).bind(item.owner)
-         .bind(item.custom).bind(item.time)
-         .bind(&name).bind(item.custom_look).bind(item.custom_look_color)
-         .bind(item.custom_icon).bind(item.custom_icon_color)
-         .bind(item.protected).bind(&note).bind(i as u32)
-         .execute(&mut **tx).await?;
-    }
-    Ok(())
-}
+/// Bind parameters per statement, under MySQL's 65535 placeholder limit.
+const MAX_BINDS: usize = 60_000;
 
-async fn save_spells(tx: &mut Transaction<'_, MySql>, char_id: u32, skills: &[u16]) -> Result<()> {
-    sqlx::query("DELETE FROM `SpellBook` WHERE `SbkChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, &spell_id) in skills.iter().enumerate().take(MAX_SPELLS) {
-        if spell_id == 0 { continue; }
-        sqlx::query(
-            "INSERT INTO `SpellBook` (`SbkChaId`,`SbkSplId`,`SbkPosition`) VALUES(?,?,?)"
-        ).bind(char_id).bind(spell_id).bind(i as u32).execute(&mut **tx).await?;
-    }
-    Ok(())
+/// One column value of a sub-table row.
+enum Col {
+    Int(i64),
+    Text(String),
 }
 
-async fn save_aethers(tx: &mut Transaction<'_, MySql>, char_id: u32, aethers: &[crate::servers::char::charstatus::SkillInfo]) -> Result<()> {
-    sqlx::query("DELETE FROM `Aethers` WHERE `AthChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, a) in aethers.iter().enumerate().take(MAX_MAGIC_TIMERS) {
-        if a.id == 0 { continue; }
-        sqlx::query(
-            "INSERT INTO `Aethers` (`AthChaId`,`AthSplId`,`AthDuration`,`AthAether`,`AthPosition`) VALUES(?,?,?,?,?)"
-        ).bind(char_id).bind(a.id).bind(a.duration).bind(a.aether).bind(i as u32)
-         .execute(&mut **tx).await?;
-    }
-    Ok(())
+/// One sub-table row: owner, slot position and the `SubTable::cols` values.
+struct SubRow {
+    char_id: u32,
+    pos: u32,
+    vals: Vec<Col>,
 }
 
-async fn save_registry(tx: &mut Transaction<'_, MySql>, char_id: u32, regs: &[crate::servers::char::charstatus::GlobalReg], count: usize) -> Result<()> {
-    sqlx::query("DELETE FROM `Registry` WHERE `RegChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, reg) in regs.iter().enumerate().take(count.min(MAX_GLOBALREG)) {
-        if reg.val == 0 { continue; }
-        let key = i8_slice_to_str(&reg.str);
-        sqlx::query("INSERT INTO `Registry` (`RegChaId`,`RegIdentifier`,`RegValue`,`RegPosition`) VALUES(?,?,?,?)")
-            .bind(char_id).bind(&key).bind(reg.val).bind(i as u32).execute(&mut **tx).await?;
-    }
-    Ok(())
+/// A position-keyed per-character table, unique on (`cha`, `pos`).
+struct SubTable {
+    name: &'static str,
+    cha: &'static str,
+    pos: &'static str,
+    cols: &'static [&'static str],
+    section: u32,
+    rows: fn(&MmoCharStatus, &mut Vec<SubRow>),
 }
 
-async fn save_registry_string(tx: &mut Transaction<'_, MySql>, char_id: u32, regs: &[crate::servers::char::charstatus::GlobalRegString], count: usize) -> Result<()> {
-    sqlx::query("DELETE FROM `RegistryString` WHERE `RegChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, reg) in regs.iter().enumerate().take(count.min(MAX_GLOBALREG)) {
-        let key = i8_slice_to_str(&reg.str);
-        let val = i8_slice_to_str(&reg.val);
-        if val.is_empty() { continue; }
-        sqlx::query("INSERT INTO `RegistryString` (`RegChaId`,`RegIdentifier`,`RegValue`,`RegPosition`) VALUES(?,?,?,?)")
-            .bind(char_id).bind(&key).bind(&val).bind(i as u32).execute(&mut **tx).await?;
-    }
-    Ok(())
+fn row(char_id: u32, pos: usize, vals: Vec<Col>) -> SubRow {
+    SubRow { char_id, pos: pos as u32, vals }
 }
 
-async fn save_npc_registry(tx: &mut Transaction<'_, MySql>, char_id: u32, regs: &[crate::servers::char::charstatus::GlobalReg]) -> Result<()> {
-    sqlx::query("DELETE FROM `NPCRegistry` WHERE `NrgChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, reg) in regs.iter().enumerate().take(MAX_GLOBALREG) {
-        if reg.val == 0 { continue; }
-        let key = i8_slice_to_str(&reg.str);
-        sqlx::query("INSERT INTO `NPCRegistry` (`NrgChaId`,`NrgIdentifier`,`NrgValue`,`NrgPosition`) VALUES(?,?,?,?)")
-            .bind(char_id).bind(&key).bind(reg.val).bind(i as u32).execute(&mut **tx).await?;
-    }
-    Ok(())
+fn int(v: impl Into<i64>) -> Col {
+    Col::Int(v.into())
 }
 
-async fn save_quest_registry(tx: &mut Transaction<'_, MySql>, char_id: u32, regs: &[crate::servers::char::charstatus::GlobalReg]) -> Result<()> {
-    sqlx::query("DELETE FROM `QuestRegistry` WHERE `QrgChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, reg) in regs.iter().enumerate().take(MAX_GLOBALQUESTREG) {
-        if reg.val == 0 { continue; }
-        let key = i8_slice_to_str(&reg.str);
-        sqlx::query("INSERT INTO `QuestRegistry` (`QrgChaId`,`QrgIdentifier`,`QrgValue`,`QrgPosition`) VALUES(?,?,?,?)")
-            .bind(char_id).bind(&key).bind(reg.val).bind(i as u32).execute(&mut **tx).await?;
-    }
-    Ok(())
+fn text(v: &[i8]) -> Col {
+    Col::Text(i8_slice_to_str(v))
 }
 
-async fn save_kills(tx: &mut Transaction<'_, MySql>, char_id: u32, kills: &[crate::servers::char::charstatus::KillReg]) -> Result<()> {
-    sqlx::query("DELETE FROM `Kills` WHERE `KilChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, k) in kills.iter().enumerate().take(MAX_KILLREG) {
-        if k.mob_id == 0 { continue; }
-        sqlx::query(
-            "INSERT INTO `Kills` (`KilChaId`,`KilMobId`,`KilAmount`,`KilPosition`) VALUES(?,?,?,?)"
-        ).bind(char_id).bind(k.mob_id).bind(k.amount).bind(i as u32).execute(&mut **tx).await?;
+fn item_rows(char_id: u32, items: &[Item], amounts: bool, out: &mut Vec<SubRow>) {
+    for (i, item) in items.iter().enumerate() {
+        if item.id == 0 { continue; }
+        let mut vals = vec![int(item.id)];
+        if amounts { vals.push(int(item.amount)); }
+        vals.extend([
+            int(item.dura), int(item.owner), int(item.custom), int(item.time),
+            text(&item.real_name), int(item.custom_look), int(item.custom_look_color),
+            int(item.custom_icon), int(item.custom_icon_color), int(item.protected),
+            text(&item.note),
+        ]);
+        out.push(row(char_id, i, vals));
     }
-    Ok(())
 }
 
-async fn save_legends(tx: &mut Transaction<'_, MySql>, char_id: u32, legends: &[crate::servers::char::charstatus::Legend]) -> Result<()> {
-    sqlx::query("DELETE FROM `Legends` WHERE `LegChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, leg) in legends.iter().enumerate().take(MAX_LEGENDS) {
-        let name = i8_slice_to_str(&leg.name);
-        let text = i8_slice_to_str(&leg.text);
-        if name.is_empty() { continue; }
-        sqlx::query(
-            "INSERT INTO `Legends` (`LegChaId`,`LegIcon`,`LegColor`,`LegDescription`,`LegIdentifier`,`LegTChaId`,`LegPosition`) VALUES(?,?,?,?,?,?,?)"
-        ).bind(char_id).bind(leg.icon).bind(leg.color).bind(&text).bind(&name).bind(leg.tchaid).bind(i as u32)
-         .execute(&mut **tx).await?;
+fn reg_rows(char_id: u32, regs: &[GlobalReg], out: &mut Vec<SubRow>) {
+    for (i, reg) in regs.iter().enumerate() {
+        if reg.val == 0 { continue; }
+        out.push(row(char_id, i, vec![text(&reg.str), int(reg.val)]));
+    }
+}
+
+static SUB_TABLES: &[SubTable] = &[
+    SubTable {
+        name: "Inventory", cha: "InvChaId", pos: "InvPosition",
+        cols: &["InvItmId", "InvAmount", "InvDurability", "InvChaIdOwner", "InvCustom", "InvTimer",
+                "InvEngrave", "InvCustomLook", "InvCustomLookColor", "InvCustomIcon",
+                "InvCustomIconColor", "InvProtected", "InvNote"],
+        section: SEC_INVENTORY,
+        rows: |s, out| item_rows(s.id, &s.inventory[..MAX_INVENTORY], true, out),
+    },
+    SubTable {
+        name: "Equipment", cha: "EqpChaId", pos: "EqpSlot",
+        cols: &["EqpItmId", "EqpDurability", "EqpChaIdOwner", "EqpCustom", "EqpTimer",
+                "EqpEngrave", "EqpCustomLook", "EqpCustomLookColor", "EqpCustomIcon",
+                "EqpCustomIconColor", "EqpProtected", "EqpNote"],
+        section: SEC_EQUIPMENT,
+        rows: |s, out| item_rows(s.id, &s.equip[..MAX_EQUIP], false, out),
+    },
+    SubTable {
+        name: "SpellBook", cha: "SbkChaId", pos: "SbkPosition",
+        cols: &["SbkSplId"],
+        section: SEC_SPELLS,
+        rows: |s, out| {
+            for (i, &spell_id) in s.skill.iter().enumerate().take(MAX_SPELLS) {
+                if spell_id == 0 { continue; }
+                out.push(row(s.id, i, vec![int(spell_id)]));
+            }
+        },
+    },
+    SubTable {
+        name: "Aethers", cha: "AthChaId", pos: "AthPosition",
+        cols: &["AthSplId", "AthDuration", "AthAether"],
+        section: SEC_AETHERS,
+        rows: |s, out| {
+            for (i, a) in s.dura_aether.iter().enumerate().take(MAX_MAGIC_TIMERS) {
+                if a.id == 0 { continue; }
+                out.push(row(s.id, i, vec![int(a.id), int(a.duration), int(a.aether)]));
+            }
+        },
+    },
+    SubTable {
+        name: "Registry", cha: "RegChaId", pos: "RegPosition",
+        cols: &["RegIdentifier", "RegValue"],
+        section: SEC_REGISTRY,
+        rows: |s, out| {
+            let n = (s.global_reg_num.max(0) as usize).min(MAX_GLOBALREG);
+            reg_rows(s.id, &s.global_reg[..n], out);
+        },
+    },
+    SubTable {
+        name: "RegistryString", cha: "RegChaId", pos: "RegPosition",
+        cols: &["RegIdentifier", "RegValue"],
+        section: SEC_REGISTRY,
+        rows: |s, out| {
+            let n = (s.global_regstring_num.max(0) as usize).min(MAX_GLOBALREG);
+            for (i, reg) in s.global_regstring[..n].iter().enumerate() {
+                if reg.val[0] == 0 { continue; }
+                out.push(row(s.id, i, vec![text(&reg.str), text(&reg.val)]));
+            }
+        },
+    },
+    SubTable {
+        name: "NPCRegistry", cha: "NrgChaId", pos: "NrgPosition",
+        cols: &["NrgIdentifier", "NrgValue"],
+        section: SEC_NPC_REGISTRY,
+        rows: |s, out| reg_rows(s.id, &s.npcintreg[..MAX_GLOBALREG], out),
+    },
+    SubTable {
+        name: "QuestRegistry", cha: "QrgChaId", pos: "QrgPosition",
+        cols: &["QrgIdentifier", "QrgValue"],
+        section: SEC_QUEST_REGISTRY,
+        rows: |s, out| reg_rows(s.id, &s.questreg[..MAX_GLOBALQUESTREG], out),
+    },
+    SubTable {
+        name: "Kills", cha: "KilChaId", pos: "KilPosition",
+        cols: &["KilMobId", "KilAmount"],
+        section: SEC_KILLS,
+        rows: |s, out| {
+            for (i, k) in s.killreg.iter().enumerate().take(MAX_KILLREG) {
+                if k.mob_id == 0 { continue; }
+                out.push(row(s.id, i, vec![int(k.mob_id), int(k.amount)]));
+            }
+        },
+    },
+    SubTable {
+        name: "Legends", cha: "LegChaId", pos: "LegPosition",
+        cols: &["LegIcon", "LegColor", "LegDescription", "LegIdentifier", "LegTChaId"],
+        section: SEC_LEGENDS,
+        rows: |s, out| {
+            for (i, leg) in s.legends.iter().enumerate().take(MAX_LEGENDS) {
+                if leg.name[0] == 0 { continue; }
+                out.push(row(s.id, i, vec![
+                    int(leg.icon), int(leg.color), text(&leg.text), text(&leg.name), int(leg.tchaid),
+                ]));
+            }
+        },
+    },
+    SubTable {
+        name: "Banks", cha: "BnkChaId", pos: "BnkPosition",
+        cols: &["BnkItmId", "BnkAmount", "BnkChaIdOwner", "BnkCustomLook", "BnkCustomLookColor",
+                "BnkCustomIcon", "BnkCustomIconColor", "BnkProtected", "BnkEngrave", "BnkNote"],
+        section: SEC_BANKS,
+        rows: |s, out| {
+            for (i, bank) in s.banks.iter().enumerate().take(MAX_BANK_SLOTS) {
+                if bank.item_id == 0 { continue; }
+                out.push(row(s.id, i, vec![
+                    int(bank.item_id), int(bank.amount), int(bank.owner),
+                    int(bank.custom_look), int(bank.custom_look_color),
+                    int(bank.custom_icon), int(bank.custom_icon_color), int(bank.protected),
+                    text(&bank.real_name), text(&bank.note),
+                ]));
+            }
+        },
+    },
+];
+
+/// `INSERT ... ON DUPLICATE KEY UPDATE` `rows` into `t`, as few statements
+/// as the bind limit allows.
+async fn upsert_rows(tx: &mut Transaction<'_, MySql>, t: &SubTable, rows: &[SubRow]) -> Result<()> {
+    let per_stmt = (MAX_BINDS / (t.cols.len() + 2)).max(1);
+    for chunk in rows.chunks(per_stmt) {
+        let mut qb = QueryBuilder::<MySql>::new(format!("INSERT INTO `{}` (`{}`,`{}`", t.name, t.cha, t.pos));
+        for c in t.cols {
+            qb.push(format_args!(",`{c}`"));
+        }
+        qb.push(") ");
+        qb.push_values(chunk, |mut b, r| {
+            b.push_bind(r.char_id).push_bind(r.pos);
+            for v in &r.vals {
+                match v {
+                    Col::Int(i) => b.push_bind(*i),
+                    Col::Text(s) => b.push_bind(s.clone()),
+                };
+            }
+        });
+        qb.push(" ON DUPLICATE KEY UPDATE ");
+        for (i, c) in t.cols.iter().enumerate() {
+            if i > 0 { qb.push(","); }
+            qb.push(format_args!("`{c}`=VALUES(`{c}`)"));
+        }
+        qb.build().execute(&mut **tx).await?;
     }
     Ok(())
 }
 
-async fn save_banks(tx: &mut Transaction<'_, MySql>, char_id: u32, banks: &[crate::servers::char::charstatus::BankData]) -> Result<()> {
-    sqlx::query("DELETE FROM `Banks` WHERE `BnkChaId`=?")
-        .bind(char_id).execute(&mut **tx).await?;
-    for (i, bank) in banks.iter().enumerate().take(MAX_BANK_SLOTS) {
-        if bank.item_id == 0 { continue; }
-        let name = i8_slice_to_str(&bank.real_name);
-        let note = i8_slice_to_str(&bank.note);
-        sqlx::query(
-            "INSERT INTO `Banks` (`BnkChaId`,`BnkItmId`,`BnkAmount`,`BnkChaIdOwner`,\
-             `BnkCustomLook`,`BnkCustomLookColor`,`BnkCustomIcon`,`BnkCustomIconColor`,\
-             `BnkProtected`,`BnkEngrave`,`BnkNote`,`BnkPosition`) VALUES(?,?,?,?,?,?,?,?,?,?,?,?)"
-        ).bind(char_id).bind(bank.item_id).bind(bank.amount).bind(bank.owner)
-         .bind(bank.custom_look).bind(bank.custom_look_color)
-         .bind(bank.custom_icon).bind(bank.custom_icon_color)
-         .bind(bank.protected).bind(&name).bind(&note).bind(i as u32)
-         .execute(&mut **tx).await?;
+/// Delete `char_id`'s rows in `t` at positions not in `kept`.
+async fn prune_rows(tx: &mut Transaction<'_, MySql>, t: &SubTable, char_id: u32, kept: &[SubRow]) -> Result<()> {
+    let mut qb = QueryBuilder::<MySql>::new(format!("DELETE FROM `{}` WHERE `{}`=", t.name, t.cha));
+    qb.push_bind(char_id);
+    if !kept.is_empty() {
+        qb.push(format_args!(" AND `{}` NOT IN (", t.pos));
+        let mut sep = qb.separated(",");
+        for r in kept {
+            sep.push_bind(r.pos);
+        }
+        qb.push(")");
     }
+    qb.build().execute(&mut **tx).await?;
     Ok(())
 }
 
@@ -840,31 +952,31 @@ mod tests {
     #[tokio::test]
     async fn test_ispass_legacy_md5_form1() {
         let hash = md5_hex("alice password");
-        assert!(ispass("Alice", "password", &hash).await);
+        assert!(ispass("Alice", "password", &hash).await.unwrap());
     }
 
     #[tokio::test]
     async fn test_ispass_legacy_md5_form2() {
         let hash = md5_hex("mypass");
-        assert!(ispass("bob", "mypass", &hash).await);
+        assert!(ispass("bob", "mypass", &hash).await.unwrap());
     }
 
     #[tokio::test]
     async fn test_ispass_wrong_legacy() {
         let hash = md5_hex("correct");
-        assert!(!ispass("bob", "wrong", &hash).await);
+        assert!(!ispass("bob", "wrong", &hash).await.unwrap());
     }
 
     #[tokio::test]
     async fn test_ispass_bcrypt() {
         let hash = bcrypt::hash("secret", 4).unwrap();
-        assert!(ispass("alice", "secret", &hash).await);
+        assert!(ispass("alice", "secret", &hash).await.unwrap());
     }
 
     #[tokio::test]
     async fn test_ispass_bcrypt_wrong() {
         let hash = bcrypt::hash("secret", 4).unwrap();
-        assert!(!ispass("alice", "wrong", &hash).await);
+        assert!(!ispass("alice", "wrong", &hash).await.unwrap());
     }
 
     #[tokio::test]
@@ -876,20 +988,20 @@ mod tests {
     #[tokio::test]
     async fn test_ismastpass_expired() {
         let hash = bcrypt::hash("secret", 4).unwrap();
-        assert!(!ismastpass("secret", &hash, 0).await); // expire=0 is always in the past
+        assert!(!ismastpass("secret", &hash, 0).await.unwrap()); // expire=0 is always in the past
     }
 
     #[tokio::test]
     async fn test_ismastpass_bcrypt_valid() {
         let hash = bcrypt::hash("adminpass", 4).unwrap();
         let expire = (chrono::Utc::now().timestamp() + 3600) as u32;
-        assert!(ismastpass("adminpass", &hash, expire).await);
+        assert!(ismastpass("adminpass", &hash, expire).await.unwrap());
     }
 
     #[tokio::test]
     async fn test_ismastpass_legacy_md5_valid() {
         let hash = md5_hex("adminpass");
         let expire = (chrono::Utc::now().timestamp() + 3600) as u32;
-        assert!(ismastpass("adminpass", &hash, expire).await);
+        assert!(ismastpass("adminpass", &hash, expire).await.unwrap());
     }
 }
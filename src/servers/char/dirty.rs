@@ -0,0 +1,147 @@
+//! Dirty-section tracking for character saves.
+//!
+//! Every 0x3004/0x3007 save carries the whole `mmo_charstatus`, but most of
+//! it is unchanged between autosaves. The char server keeps a digest of
+//! each section as last written to the DB (seeded when the character is
+//! loaded) and `save_char_bytes` rewrites only the sub-tables whose digest
+//! moved. Each section also has a version counter, bumped on every write.
+//!
+//! Nothing but the char server writes these tables, so the digests stay in
+//! step with the DB. A character with no entry (char server restarted while
+//! it was online) saves every section once.
+
+use std::collections::HashMap;
+use std::hash::{DefaultHasher, Hasher};
+
+use bytemuck::Pod;
+
+use crate::servers::char::charstatus::MmoCharStatus;
+
+pub const SEC_INVENTORY: u32 = 1 << 0;
+pub const SEC_EQUIPMENT: u32 = 1 << 1;
+pub const SEC_SPELLS: u32 = 1 << 2;
+pub const SEC_AETHERS: u32 = 1 << 3;
+/// Registry and RegistryString
+pub const SEC_REGISTRY: u32 = 1 << 4;
+pub const SEC_NPC_REGISTRY: u32 = 1 << 5;
+pub const SEC_QUEST_REGISTRY: u32 = 1 << 6;
+pub const SEC_KILLS: u32 = 1 << 7;
+pub const SEC_LEGENDS: u32 = 1 << 8;
+pub const SEC_BANKS: u32 = 1 << 9;
+
+pub const SECTIONS: usize = 10;
+pub const SEC_ALL: u32 = (1 << SECTIONS) - 1;
+
+pub type Digests = [u64; SECTIONS];
+
+fn bytes_of<T: Pod>(v: &[T]) -> &[u8] {
+    bytemuck::cast_slice(v)
+}
+
+fn digest<T: Pod>(v: &[T]) -> u64 {
+    let mut h = DefaultHasher::new();
+    h.write(bytes_of(v));
+    h.finish()
+}
+
+/// Digest of every section, indexed by bit position.
+pub fn section_digests(s: &MmoCharStatus) -> Digests {
+    let regs = (s.global_reg_num.max(0) as usize).min(s.global_reg.len());
+    let strs = (s.global_regstring_num.max(0) as usize).min(s.global_regstring.len());
+    let mut registry = DefaultHasher::new();
+    registry.write(bytes_of(&s.global_reg[..regs]));
+    registry.write_u8(0xff);
+    registry.write(bytes_of(&s.global_regstring[..strs]));
+    [
+        digest(&s.inventory),
+        digest(&s.equip),
+        digest(&s.skill),
+        digest(&s.dura_aether),
+        registry.finish(),
+        digest(&s.npcintreg),
+        digest(&s.questreg),
+        digest(&s.killreg),
+        digest(&s.legends),
+        digest(&s.banks),
+    ]
+}
+
+#[derive(Debug, Clone)]
+struct Saved {
+    digests: Digests,
+    versions: [u32; SECTIONS],
+}
+
+/// Section digests of each online character as stored in the DB.
+#[derive(Debug, Default)]
+pub struct SaveTracker {
+    chars: HashMap<u32, Saved>,
+}
+
+impl SaveTracker {
+    /// Sections of `char_id` that differ from what was last written.
+    pub fn dirty(&self, char_id: u32, digests: &Digests) -> u32 {
+        let Some(saved) = self.chars.get(&char_id) else { return SEC_ALL };
+        (0..SECTIONS).filter(|&i| saved.digests[i] != digests[i]).fold(0, |m, i| m | 1 << i)
+    }
+
+    /// Record that the DB now holds `digests` for `char_id`, bumping the
+    /// version of each section that changed.
+    pub fn saved(&mut self, char_id: u32, digests: Digests) {
+        let entry = self
+            .chars
+            .entry(char_id)
+            .or_insert(Saved { digests, versions: [0; SECTIONS] });
+        for i in 0..SECTIONS {
+            if entry.digests[i] != digests[i] {
+                entry.versions[i] = entry.versions[i].wrapping_add(1);
+            }
+        }
+        entry.digests = digests;
+    }
+
+    pub fn versions(&self, char_id: u32) -> Option<[u32; SECTIONS]> {
+        self.chars.get(&char_id).map(|s| s.versions)
+    }
+
+    pub fn forget(&mut self, char_id: u32) {
+        self.chars.remove(&char_id);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::servers::char::charstatus::char_status_from_bytes;
+
+    fn blank() -> Box<MmoCharStatus> {
+        char_status_from_bytes(&vec![0u8; std::mem::size_of::<MmoCharStatus>()]).unwrap()
+    }
+
+    #[test]
+    fn test_only_changed_sections_are_dirty() {
+        let mut s = blank();
+        let mut t = SaveTracker::default();
+        assert_eq!(t.dirty(7, &section_digests(&s)), SEC_ALL);
+        t.saved(7, section_digests(&s));
+        assert_eq!(t.dirty(7, &section_digests(&s)), 0);
+
+        s.inventory[3].id = 100;
+        s.skill[0] = 5;
+        s.hp = 1234;
+        let d = section_digests(&s);
+        assert_eq!(t.dirty(7, &d), SEC_INVENTORY | SEC_SPELLS);
+        t.saved(7, d);
+        assert_eq!(t.versions(7).unwrap()[0], 1);
+        assert_eq!(t.versions(7).unwrap()[1], 0);
+
+        // Registry slots past the count are not saved and do not count
+        s.global_reg[5].val = 9;
+        assert_eq!(t.dirty(7, &section_digests(&s)), 0);
+        s.global_reg_num = 6;
+        assert_eq!(t.dirty(7, &section_digests(&s)), SEC_REGISTRY);
+
+        t.forget(7);
+        assert_eq!(t.dirty(7, &section_digests(&s)), SEC_ALL);
+    }
+}
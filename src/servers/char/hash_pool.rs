@@ -0,0 +1,147 @@
+//! Bounded bcrypt pool for the char server's password checks.
+//!
+//! bcrypt at cost 10 is tens of milliseconds of CPU. On tokio's blocking
+//! pool a reconnect storm after a restart queued thousands of them and
+//! starved every other blocking job. Here a fixed set of `hash_workers`
+//! threads takes jobs from a queue of `hash_queue` slots. A job that finds
+//! the queue full fails at once with `Busy::Queue`, and the login is
+//! answered with an error the client sees right away instead of a timeout.
+//!
+//! Admission is per address first: `admit` lets one client IP have at most
+//! `hash_per_ip` logins in flight (network::throttle's `InFlight`), so a
+//! single host cannot fill the queue. The login link runs each login as
+//! its own task holding its guard.
+
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering::Relaxed};
+use std::sync::mpsc::{self, Receiver, SyncSender, TrySendError};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::Instant;
+
+use crate::config::ServerConfig;
+use crate::metrics::{Histogram, Writer};
+use crate::network::throttle::{InFlight, InFlightGuard};
+
+#[derive(Debug, thiserror::Error)]
+pub enum Busy {
+    #[error("password check queue is full")]
+    Queue,
+    #[error("too many logins in progress from this address")]
+    PerIp,
+}
+
+type Job = Box<dyn FnOnce() + Send>;
+
+struct Pool {
+    tx: SyncSender<(Instant, Job)>,
+    workers: usize,
+    capacity: usize,
+    /// Jobs waiting for a worker
+    queued: AtomicUsize,
+    admission: InFlight,
+}
+
+/// Queue wait plus hashing time, 5 ms to 5 s.
+static SECONDS: Histogram<10> = Histogram::new(
+    [5_000, 10_000, 20_000, 50_000, 100_000, 200_000, 500_000, 1_000_000, 2_000_000, 5_000_000],
+);
+static REJECTED_QUEUE: AtomicU64 = AtomicU64::new(0);
+static REJECTED_IP: AtomicU64 = AtomicU64::new(0);
+
+static POOL: OnceLock<Pool> = OnceLock::new();
+
+/// Start the workers with the `hash_*` settings. Later calls do nothing;
+/// a pool used before `start` gets the defaults.
+pub fn start(config: &ServerConfig) {
+    pool_with(config.hash_workers, config.hash_queue, config.hash_per_ip);
+}
+
+fn pool() -> &'static Pool {
+    pool_with(0, 128, 2)
+}
+
+fn pool_with(workers: u32, queue: u32, per_ip: u32) -> &'static Pool {
+    POOL.get_or_init(|| {
+        let workers = match workers {
+            0 => std::thread::available_parallelism().map_or(1, |n| n.get() / 2).max(1),
+            n => n as usize,
+        };
+        let capacity = queue.max(1) as usize;
+        let (tx, rx) = mpsc::sync_channel(capacity);
+        let rx = Arc::new(Mutex::new(rx));
+        for i in 0..workers {
+            let rx = Arc::clone(&rx);
+            let spawned = std::thread::Builder::new()
+                .name(format!("bcrypt-{i}"))
+                .spawn(move || worker(rx));
+            if let Err(e) = spawned {
+                tracing::error!("[char] [hash] cannot start worker {}: {}", i, e);
+            }
+        }
+        tracing::info!("[char] [hash] {} bcrypt workers, queue {}, {} per IP", workers, capacity, per_ip);
+        Pool { tx, workers, capacity, queued: AtomicUsize::new(0), admission: InFlight::new(per_ip) }
+    })
+}
+
+fn worker(rx: Arc<Mutex<Receiver<(Instant, Job)>>>) {
+    loop {
+        let next = rx.lock().unwrap_or_else(|e| e.into_inner()).recv();
+        let Ok((queued_at, job)) = next else { return };
+        pool().queued.fetch_sub(1, Relaxed);
+        job();
+        SECONDS.observe(queued_at.elapsed());
+    }
+}
+
+/// Admit a login from `ip_net` (network byte order) to the password check.
+/// Hold the guard until the check is done.
+pub fn admit(ip_net: u32) -> Result<InFlightGuard<'static>, Busy> {
+    pool().admission.try_enter(ip_net).ok_or_else(|| {
+        REJECTED_IP.fetch_add(1, Relaxed);
+        Busy::PerIp
+    })
+}
+
+/// Run `f` on a bcrypt worker, or fail at once if the queue is full.
+pub async fn run<T: Send + 'static>(f: impl FnOnce() -> T + Send + 'static) -> Result<T, Busy> {
+    let p = pool();
+    let (tx, rx) = tokio::sync::oneshot::channel();
+    let job: Job = Box::new(move || {
+        let _ = tx.send(f());
+    });
+    p.queued.fetch_add(1, Relaxed);
+    if let Err(e) = p.tx.try_send((Instant::now(), job)) {
+        p.queued.fetch_sub(1, Relaxed);
+        if let TrySendError::Full(_) = e {
+            REJECTED_QUEUE.fetch_add(1, Relaxed);
+        }
+        return Err(Busy::Queue);
+    }
+    rx.await.map_err(|_| Busy::Queue)
+}
+
+pub fn write_metrics(w: &mut Writer) {
+    let Some(p) = POOL.get() else { return };
+    w.gauge("yuri_hash_workers", "bcrypt worker threads", p.workers as f64);
+    w.gauge("yuri_hash_queue", "Password checks waiting for a bcrypt worker", p.queued.load(Relaxed) as f64);
+    w.gauge("yuri_hash_queue_capacity", "Password checks the bcrypt queue holds", p.capacity as f64);
+    w.family("yuri_hash_rejected_total", "counter", "Password checks refused, by reason");
+    w.sample("yuri_hash_rejected_total", &[("reason", "queue")], REJECTED_QUEUE.load(Relaxed) as f64);
+    w.sample("yuri_hash_rejected_total", &[("reason", "ip")], REJECTED_IP.load(Relaxed) as f64);
+    w.histogram("yuri_hash_seconds", "Password check time including queue wait", &SECONDS.snapshot());
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[tokio::test]
+    async fn test_run_returns_result() {
+        assert_eq!(run(|| 6 * 7).await.unwrap(), 42);
+        let ip = u32::to_be(0x7F00_0009);
+        let a = admit(ip).unwrap();
+        let _b = admit(ip).unwrap();
+        assert!(matches!(admit(ip), Err(Busy::PerIp)));
+        drop(a);
+        assert!(admit(ip).is_ok());
+    }
+}
@@ -5,6 +5,7 @@ use tokio::sync::mpsc;
 use tokio::time::{Duration, interval};
 use super::{CharState, LoginEntry};
 use super::db;
+use super::hash_pool;
 use crate::network::crypt::tk_crypt_static;
 
 // Packet length table for 0x1000–0x1006 (0 = end/unused)
@@ -136,7 +137,7 @@ async fn dispatch_login_packet(state: &Arc<CharState>, cmd: u16, pkt: &[u8]) {
         }
         0x1001 => handle_usedname(state, pkt).await,
         0x1002 => handle_newchar(state, pkt).await,
-        0x1003 => handle_login(state, pkt).await,
+        0x1003 => spawn_login(state, pkt).await,
         0x1004 => handle_setpass(state, pkt).await,
         _ => tracing::warn!("[char] [logif] unhandled cmd={:04X}", cmd),
     }
@@ -182,11 +183,37 @@ async fn handle_newchar(state: &Arc<CharState>, pkt: &[u8]) {
     send_to_login(state, resp.to_vec()).await;
 }
 
-async fn handle_login(state: &Arc<CharState>, pkt: &[u8]) {
+/// Logins run as their own tasks so the link keeps reading while bcrypt
+/// works; the admission guard goes with the task. At most hash_per_ip logins
+/// per client address are in flight at once, and a refused one is answered
+/// with the DB error straight away.
+async fn spawn_login(state: &Arc<CharState>, pkt: &[u8]) {
     if pkt.len() < 40 {
         tracing::warn!("[char] [login] pkt too short: {}", pkt.len());
         return;
     }
+    let client_ip = u32::from_ne_bytes([pkt[36], pkt[37], pkt[38], pkt[39]]);
+    let admitted = match hash_pool::admit(client_ip) {
+        Ok(g) => g,
+        Err(e) => {
+            tracing::warn!("[char] [login] {}", e);
+            let mut resp = vec![0u8; 27];
+            resp[0] = 0x03; resp[1] = 0x20; // cmd 0x2003 LE
+            resp[2] = pkt[2]; resp[3] = pkt[3];
+            resp[4] = 0x01;
+            send_to_login(state, resp).await;
+            return;
+        }
+    };
+    let state = Arc::clone(state);
+    let pkt = pkt.to_vec();
+    tokio::spawn(async move {
+        handle_login(&state, &pkt).await;
+        drop(admitted);
+    });
+}
+
+async fn handle_login(state: &Arc<CharState>, pkt: &[u8]) {
     let name = std::str::from_utf8(&pkt[4..20]).unwrap_or("").trim_end_matches('\0');
     let pass = std::str::from_utf8(&pkt[20..36]).unwrap_or("").trim_end_matches('\0');
     tracing::debug!("[char] [login] attempt name={}", name);
@@ -203,12 +230,20 @@ async fn handle_login(state: &Arc<CharState>, pkt: &[u8]) {
         Err(e)    => { tracing::warn!("[char] [login] db err: {}", e); resp[4] = 0x01; send_to_login(state, resp).await; return; }
     };
 
+    // A queue-full check answers with the DB error straight away
     let (mast_ok, mast_hash) = match db::get_master_password(&state.db).await {
-        Ok(Some((mhash, exp))) => (db::ismastpass(pass, &mhash, exp).await, Some(mhash)),
+        Ok(Some((mhash, exp))) => match db::ismastpass(pass, &mhash, exp).await {
+            Ok(ok) => (ok, Some(mhash)),
+            Err(e) => { tracing::warn!("[char] [login] {}: {}", name, e); resp[4] = 0x01; send_to_login(state, resp).await; return; }
+        },
         _ => (false, None),
     };
 
-    if !db::ispass(name, pass, &stored_hash).await && !mast_ok {
+    let user_ok = match db::ispass(name, pass, &stored_hash).await {
+        Ok(ok) => ok,
+        Err(e) => { tracing::warn!("[char] [login] {}: {}", name, e); resp[4] = 0x01; send_to_login(state, resp).await; return; }
+    };
+    if !user_ok && !mast_ok {
         tracing::warn!("[char] [login] wrong password");
         resp[4] = 0x03;
         send_to_login(state, resp).await;
@@ -293,10 +328,19 @@ async fn handle_login(state: &Arc<CharState>, pkt: &[u8]) {
         None => { resp[4] = 0x05; send_to_login(state, resp).await; return; }
     };
 
-    // Check if already online — lock online, record result, then drop before locking map_servers.
+    // Check if already online and claim the entry in the same lock, so two
+    // logins of one character running side by side cannot both get through.
+    // Drop it before locking map_servers.
     let already_online = {
-        let online = state.online.lock().await;
-        online.contains_key(&char_info.char_id)
+        let mut online = state.online.lock().await;
+        let taken = online.contains_key(&char_info.char_id);
+        if !taken {
+            online.insert(char_info.char_id, LoginEntry {
+                map_server_idx: map_idx,
+                char_name: name.to_string(),
+            });
+        }
+        taken
     };
     if already_online {
         resp[4] = 0x06;
@@ -336,6 +380,8 @@ async fn handle_login(state: &Arc<CharState>, pkt: &[u8]) {
             resp[21..25].copy_from_slice(&s.ip.to_le_bytes());
             resp[25..27].copy_from_slice(&s.port.to_le_bytes());
         } else {
+            drop(servers);
+            state.online.lock().await.remove(&char_info.char_id);
             resp[4] = 0x05;
             send_to_login(state, resp).await;
             return;
@@ -343,15 +389,6 @@ async fn handle_login(state: &Arc<CharState>, pkt: &[u8]) {
     }
 
     send_to_login(state, resp).await;
-
-    // Register as online
-    {
-        let mut online = state.online.lock().await;
-        online.insert(char_info.char_id, LoginEntry {
-            map_server_idx: map_idx,
-            char_name: name.to_string(),
-        });
-    }
     db::set_online(&state.db, char_info.char_id, true).await;
 }
 
@@ -1,13 +1,19 @@
-use std::io::{Read, Write};
+use std::io::Write;
 use std::sync::Arc;
+use std::time::Instant;
 use flate2::Compression;
-use flate2::read::ZlibDecoder;
 use flate2::write::ZlibEncoder;
 use tokio::io::{AsyncReadExt, AsyncWriteExt};
 use tokio::net::TcpStream;
 use tokio::sync::mpsc;
-use super::{CharState, MapFifo};
+use super::{CharState, LoginEntry, MapFifo};
+use super::board_cache::{Listing, PageRow, PostRow};
+use super::char_cache::stored_view;
+use super::charstatus::{char_status_from_bytes, char_status_to_bytes, MmoCharStatus};
 use super::db;
+use super::dirty::section_digests;
+use super::save_queue::PendingSave;
+use crate::servers::save_frame;
 
 const MAX_PKT_LEN: usize = 16 * 1024 * 1024; // 16 MiB hard cap for variable-length packets
 
@@ -32,8 +38,8 @@ const PKT_LENS: &[i32] = &[
     20,   // 0x300E findnewmp
     4124, // 0x300F nmail write copy
     30,   // 0x3010
-    255,  // 0x3011
-    255,  // 0x3012
+    6,    // 0x3011 board changed by a map server
+    -1,   // 0x3012 batched saves (variable, see save_frame)
     255,  // 0x3013
     255,  // 0x3014
     255,  // 0x3015
@@ -152,6 +158,7 @@ pub async fn handle_map_server(state: Arc<CharState>, mut stream: TcpStream, fir
     };
     for char_id in affected {
         db::set_online(&state.db, char_id, false).await;
+        state.saves.lock().await.forget(char_id);
     }
     writer.abort();
     tracing::info!("[char] [mapif] Map Server #{} disconnected", idx);
@@ -162,7 +169,7 @@ async fn dispatch_map_packet(state: &Arc<CharState>, map_idx: usize, cmd: u16, p
         0x3001 => handle_mapset(state, map_idx, pkt).await,
         0x3002 => handle_map_login(state, pkt).await,
         0x3003 => handle_request_char(state, map_idx, pkt).await,
-        0x3004 => { let _ = handle_save_char(state, pkt).await; }
+        0x3004 => { let _ = handle_save_char(state, pkt, false).await; }
         0x3005 => handle_logout(state, pkt).await,
         0x3007 => handle_save_char_logout(state, pkt).await,
         0x3008 => handle_delete_post(state, map_idx, pkt).await,
@@ -173,6 +180,8 @@ async fn dispatch_map_packet(state: &Arc<CharState>, map_idx: usize, cmd: u16, p
         0x300D => handle_nmail_write(state, map_idx, pkt).await,
         0x300E => { /* findnewmp — no-op in C */ }
         0x300F => handle_nmail_write_copy(state, pkt).await,
+        0x3011 => handle_board_changed(state, pkt).await,
+        0x3012 => handle_save_batch(state, pkt).await,
         _ => tracing::warn!("[char] [mapif] unhandled cmd={:04X}", cmd),
     }
 }
@@ -198,6 +207,14 @@ async fn handle_mapset(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
         }
     }
     tracing::info!("[char] [mapif] Map Server #{} registered {} maps", map_idx, map_n);
+
+    // Newer map servers append their capabilities after the map ids
+    let off = 8 + map_n * 2;
+    if let Some(b) = pkt.get(off..off + 4) {
+        let caps = u32::from_le_bytes([b[0], b[1], b[2], b[3]]) & save_frame::CAPS;
+        tracing::info!("[char] [mapif] Map Server #{} save capabilities {:#x}", map_idx, caps);
+        send_to_map(state, map_idx, save_frame::encode_caps_ack(caps)).await;
+    }
 }
 
 async fn handle_map_login(state: &Arc<CharState>, pkt: &[u8]) {
@@ -228,19 +245,59 @@ async fn handle_request_char(state: &Arc<CharState>, map_idx: usize, pkt: &[u8])
 
     tracing::info!("[char] [mapif] handle_request_char char_id={} session_id={} login_name={}", char_id, session_id, login_name);
 
-    let char_bytes = match db::load_char_bytes(&state.db, char_id, login_name).await {
-        Ok(b) => b,
-        Err(e) => {
-            tracing::error!("[char] [mapif] load_char_bytes FAILED for char_id={}: {}", char_id, e);
-            return;
+    // A save still queued from the last session must land before the load
+    {
+        let _commit = state.save_commit.lock().await;
+        let pending = state.save_queue.lock().await.take(char_id);
+        if let Some(p) = pending {
+            commit_saves(state, vec![(char_id, p)]).await;
+        }
+    }
+
+    // Back within a few minutes of logging out: the DB holds what the cache
+    // entry was built from, unless the Character row was updated directly
+    let cached = state.char_cache.lock().await.take(char_id, login_name, Instant::now());
+    let cached = match cached {
+        Some(c) if db::character_row_current(&state.db, char_id, login_name, c.packed.clone()).await => Some(c),
+        Some(_) => {
+            tracing::info!("[char] [mapif] handle_request_char char_id={} cache entry stale", char_id);
+            None
         }
+        None => None,
     };
+    let compressed = match cached {
+        Some(c) => {
+            tracing::info!("[char] [mapif] handle_request_char char_id={} from logout cache", char_id);
+            state.saves.lock().await.saved(char_id, c.digests);
+            c.packed
+        }
+        None => {
+            let char_bytes = match db::load_char_bytes(&state.db, char_id, login_name).await {
+                Ok(b) => b,
+                Err(e) => {
+                    tracing::error!("[char] [mapif] load_char_bytes FAILED for char_id={}: {}", char_id, e);
+                    return;
+                }
+            };
+
+            if let Some(s) = char_status_from_bytes(&char_bytes) {
+                state.saves.lock().await.saved(char_id, section_digests(&s));
+            }
 
-    let mut enc = ZlibEncoder::new(Vec::new(), Compression::default());
-    let _ = enc.write_all(&char_bytes);
-    let compressed = enc.finish().unwrap_or_default();
+            let mut enc = ZlibEncoder::new(Vec::new(), Compression::default());
+            let _ = enc.write_all(&char_bytes);
+            enc.finish().unwrap_or_default()
+        }
+    };
     let clen = compressed.len() as u32;
 
+    // After a map server hot restart the new process loads players that
+    // the old link's disconnect dropped from `online`
+    state.online.lock().await.entry(char_id).or_insert_with(|| LoginEntry {
+        map_server_idx: map_idx,
+        char_name: login_name.to_string(),
+    });
+
     // Build response 0x3803
     let total_len = clen + 8;
     let mut resp = Vec::with_capacity(8 + compressed.len());
@@ -253,48 +310,159 @@ async fn handle_request_char(state: &Arc<CharState>, map_idx: usize, pkt: &[u8])
     send_to_map(state, map_idx, resp).await;
 }
 
-async fn handle_save_char(state: &Arc<CharState>, pkt: &[u8]) -> Option<u32> {
-    if pkt.len() < 6 {
-        return None;
-    }
-    let total_len = u32::from_le_bytes([pkt[2], pkt[3], pkt[4], pkt[5]]) as usize;
-    let data_len = total_len.saturating_sub(6);
-    if pkt.len() < 6 + data_len {
-        return None;
-    }
-    let compressed = &pkt[6..6 + data_len];
+/// Decode a 0x3004/0x3007 save and queue it for the next group commit.
+async fn handle_save_char(state: &Arc<CharState>, pkt: &[u8], logout: bool) -> Option<u32> {
+    let raw = save_frame::decode_legacy(pkt)?;
+    queue_save(state, &raw, logout).await
+}
 
-    let mut dec = ZlibDecoder::new(compressed);
-    let mut raw = Vec::new();
-    if dec.read_to_end(&mut raw).is_err() {
-        return None;
-    }
+/// Queue one raw `mmo_charstatus` for the next group commit.
+async fn queue_save(state: &Arc<CharState>, raw: &[u8], logout: bool) -> Option<u32> {
     if raw.len() < 4 {
         return None;
     }
     let char_id = u32::from_le_bytes([raw[0], raw[1], raw[2], raw[3]]);
     tracing::debug!("[char] [save_char] char_id={} decompressed_bytes={}", char_id, raw.len());
-    if let Err(e) = db::save_char_bytes(&state.db, &raw).await {
-        tracing::error!("[char] [save_char] char_id={} failed: {}", char_id, e);
+    let Some(s) = char_status_from_bytes(raw) else {
+        tracing::error!("[char] [save_char] char_id={} invalid char status: got {} bytes", char_id, raw.len());
+        return Some(char_id);
+    };
+    if s.id != 0 && !state.save_queue.lock().await.push(s, logout) {
+        tracing::debug!("[char] [save_char] char_id={} merged with queued save", char_id);
     }
     Some(char_id)
 }
 
+/// Commit every queued save in one transaction.
+pub async fn flush_saves(state: &Arc<CharState>) {
+    let _commit = state.save_commit.lock().await;
+    let batch = state.save_queue.lock().await.drain();
+    commit_saves(state, batch).await;
+}
+
+/// Write `batch`, sub-tables limited to each character's dirty sections.
+/// If the batch transaction fails, each save is retried on its own so one
+/// bad row does not lose the rest. Caller holds `save_commit`.
+async fn commit_saves(state: &Arc<CharState>, batch: Vec<(u32, PendingSave)>) {
+    if batch.is_empty() {
+        return;
+    }
+    let digests: Vec<_> = batch.iter().map(|(_, p)| section_digests(&p.status)).collect();
+    let masks: Vec<u32> = {
+        let saves = state.saves.lock().await;
+        batch.iter().zip(&digests).map(|((id, _), d)| saves.dirty(*id, d)).collect()
+    };
+    let rows: Vec<_> = batch.iter().zip(&masks).map(|((_, p), &m)| (&*p.status, m)).collect();
+
+    let ok = match db::save_chars(&state.db, &rows).await {
+        Ok(()) => vec![true; rows.len()],
+        Err(e) if rows.len() > 1 => {
+            tracing::warn!("[char] [save_char] batch of {} failed, saving one by one: {}", rows.len(), e);
+            let mut ok = Vec::with_capacity(rows.len());
+            for (&(s, m), (id, _)) in rows.iter().zip(&batch) {
+                let r = db::save_char(&state.db, s, m).await;
+                if let Err(e) = &r {
+                    tracing::error!("[char] [save_char] char_id={} failed: {}", id, e);
+                }
+                ok.push(r.is_ok());
+            }
+            ok
+        }
+        Err(e) => {
+            tracing::error!("[char] [save_char] char_id={} failed: {}", batch[0].0, e);
+            vec![false]
+        }
+    };
+
+    let mut logged_out = Vec::new();
+    {
+        let mut saves = state.saves.lock().await;
+        let mut cache = state.char_cache.lock().await;
+        for (((id, p), d), ok) in batch.into_iter().zip(digests).zip(ok) {
+            if ok {
+                saves.saved(id, d);
+            }
+            // Any save supersedes a cached copy
+            cache.remove(id);
+            if p.logout {
+                saves.forget(id);
+                if ok {
+                    logged_out.push(p.status);
+                }
+            }
+        }
+    }
+    if state.config.char_cache_size > 0 && !logged_out.is_empty() {
+        cache_logged_out(state, logged_out).await;
+    }
+}
+
+/// Keep the load reply for each character just saved on logout. Caller
+/// holds `save_commit`, so no load can run until the entries are in.
+async fn cache_logged_out(state: &Arc<CharState>, chars: Vec<Box<MmoCharStatus>>) {
+    let entries = tokio::task::spawn_blocking(move || {
+        chars
+            .into_iter()
+            .map(|s| {
+                let name: String = s.name.iter().take_while(|&&c| c != 0).map(|&c| c as u8 as char).collect();
+                let view = stored_view(&s, &name);
+                let mut enc = ZlibEncoder::new(Vec::new(), Compression::default());
+                let _ = enc.write_all(char_status_to_bytes(&view));
+                (s.id, name, enc.finish().unwrap_or_default(), section_digests(&view))
+            })
+            .collect::<Vec<_>>()
+    })
+    .await
+    .unwrap_or_default();
+
+    let now = Instant::now();
+    let mut cache = state.char_cache.lock().await;
+    for (id, name, packed, digests) in entries {
+        if !packed.is_empty() {
+            cache.put(id, name, packed, digests, now);
+        }
+    }
+}
+
 async fn handle_logout(state: &Arc<CharState>, pkt: &[u8]) {
     if pkt.len() < 6 {
         return;
     }
     let char_id = u32::from_le_bytes([pkt[2], pkt[3], pkt[4], pkt[5]]);
     db::set_online(&state.db, char_id, false).await;
+    state.saves.lock().await.forget(char_id);
     let mut online = state.online.lock().await;
     online.remove(&char_id);
 }
 
 async fn handle_save_char_logout(state: &Arc<CharState>, pkt: &[u8]) {
-    if let Some(char_id) = handle_save_char(state, pkt).await {
-        db::set_online(&state.db, char_id, false).await;
-        let mut online = state.online.lock().await;
-        online.remove(&char_id);
+    if let Some(char_id) = handle_save_char(state, pkt, true).await {
+        set_logged_out(state, char_id).await;
+    }
+}
+
+async fn set_logged_out(state: &Arc<CharState>, char_id: u32) {
+    db::set_online(&state.db, char_id, false).await;
+    let mut online = state.online.lock().await;
+    online.remove(&char_id);
+}
+
+// ── 0x3012 — Batched saves ───────────────────────────────────────────────────
+
+async fn handle_save_batch(state: &Arc<CharState>, pkt: &[u8]) {
+    let saves = match save_frame::decode_batch(pkt, std::mem::size_of::<MmoCharStatus>()) {
+        Ok(s) => s,
+        Err(e) => {
+            tracing::error!("[char] [save_char] bad 0x3012 frame len={}: {}", pkt.len(), e);
+            return;
+        }
+    };
+    for save in saves {
+        if let Some(char_id) = queue_save(state, &save.status, save.logout).await {
+            if save.logout {
+                set_logged_out(state, char_id).await;
+            }
+        }
     }
 }
 
@@ -362,6 +530,9 @@ async fn handle_delete_post(state: &Arc<CharState>, map_idx: usize, pkt: &[u8])
             _ => 1,
         }
     };
+    if result == 0 {
+        state.board_cache.lock().await.invalidate(&Listing::of(board as u32, &name));
+    }
 
     let mut resp = Vec::with_capacity(5);
     write_u16_le(&mut resp, 0x3808);
@@ -404,21 +575,35 @@ async fn handle_show_posts(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
     };
 
     let offset = bcount * 20;
+    let key = Listing::of(board, &name);
 
     // boards_show_array_1: board_name(4)+color(4)+post_id(4)+month(4)+day(4)+user[32]+topic[64] = 116
-    let rows: Vec<(i32, String, String, i32, i32, i32, i32)> = if board == 0 {
-        sqlx::query_as(
-            "SELECT `MalNew`, `MalChaName`, `MalSubject`, `MalPosition`, \
-             `MalMonth`, `MalDay`, `MalId` FROM `Mail` \
-             WHERE `MalChaNameDestination` = ? AND `MalDeleted` = 0 \
-             ORDER BY `MalPosition` DESC LIMIT 20 OFFSET ?"
-        ).bind(&name).bind(offset).fetch_all(&state.db).await.unwrap_or_default()
-    } else {
-        sqlx::query_as(
-            "SELECT `BrdHighlighted`, `BrdChaName`, `BrdTopic`, `BrdPosition`, \
-             `BrdMonth`, `BrdDay`, `BrdBtlId` FROM `Boards` \
-             WHERE `BrdBnmId` = ? ORDER BY `BrdPosition` DESC LIMIT 20 OFFSET ?"
-        ).bind(board).bind(offset).fetch_all(&state.db).await.unwrap_or_default()
+    let cached = state.board_cache.lock().await.page(&key, offset);
+    let rows = match cached {
+        Some(rows) => rows,
+        None => {
+            let gen = state.board_cache.lock().await.generation();
+            let res: Result<Vec<PageRow>, _> = if board == 0 {
+                sqlx::query_as(
+                    "SELECT `MalNew`, `MalChaName`, `MalSubject`, `MalPosition`, \
+                     `MalMonth`, `MalDay`, `MalId` FROM `Mail` \
+                     WHERE `MalChaNameDestination` = ? AND `MalDeleted` = 0 \
+                     ORDER BY `MalPosition` DESC LIMIT 20 OFFSET ?"
+                ).bind(&name).bind(offset).fetch_all(&state.db).await
+            } else {
+                sqlx::query_as(
+                    "SELECT `BrdHighlighted`, `BrdChaName`, `BrdTopic`, `BrdPosition`, \
+                     `BrdMonth`, `BrdDay`, `BrdBtlId` FROM `Boards` \
+                     WHERE `BrdBnmId` = ? ORDER BY `BrdPosition` DESC LIMIT 20 OFFSET ?"
+                ).bind(board).bind(offset).fetch_all(&state.db).await
+            };
+            let ok = res.is_ok();
+            let rows = Arc::new(res.unwrap_or_default());
+            if ok {
+                state.board_cache.lock().await.put_page(&key, offset, Arc::clone(&rows), gen);
+            }
+            rows
+        }
     };
 
     let header = build_header(rows.len() as u32);
@@ -428,7 +613,7 @@ async fn handle_show_posts(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
     write_u16_le(&mut resp, 0x3809);
     write_u32_le(&mut resp, total_len);
     resp.extend_from_slice(&header);
-    for (color, user, topic, post_id, month, day, board_name) in &rows {
+    for (color, user, topic, post_id, month, day, board_name) in rows.iter() {
         write_u32_le(&mut resp, *board_name as u32);
         write_u32_le(&mut resp, *color as u32);
         write_u32_le(&mut resp, *post_id as u32);
@@ -454,39 +639,51 @@ async fn handle_read_post(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
     let post_type: u32  = if board == 0 { 5 } else { 3 };
     let buttons: u32 = if board == 0 || flags & 1 != 0 { 3 } else { 1 };
 
+    let key = Listing::of(board, &name);
+    let gen = state.board_cache.lock().await.generation();
+
     // Get MAX position
-    let max_row: Option<(Option<u32>,)> = if board == 0 {
-        sqlx::query_as(
-            "SELECT MAX(`MalPosition`) FROM `Mail` \
-             WHERE `MalChaNameDestination` = ? AND `MalDeleted` = 0"
-        ).bind(&name).fetch_optional(&state.db).await.unwrap_or(None)
-    } else {
-        sqlx::query_as(
-            "SELECT MAX(`BrdPosition`) FROM `Boards` WHERE `BrdBnmId` = ?"
-        ).bind(board).fetch_optional(&state.db).await.unwrap_or(None)
+    let cached = state.board_cache.lock().await.max_pos(&key);
+    let max_pos = match cached {
+        Some(max_pos) => max_pos,
+        None => {
+            let res: Result<Option<(Option<u32>,)>, _> = if board == 0 {
+                sqlx::query_as(
+                    "SELECT MAX(`MalPosition`) FROM `Mail` \
+                     WHERE `MalChaNameDestination` = ? AND `MalDeleted` = 0"
+                ).bind(&name).fetch_optional(&state.db).await
+            } else {
+                sqlx::query_as(
+                    "SELECT MAX(`BrdPosition`) FROM `Boards` WHERE `BrdBnmId` = ?"
+                ).bind(board).fetch_optional(&state.db).await
+            };
+            let ok = res.is_ok();
+            let max_pos = res.unwrap_or(None).and_then(|(v,)| v).unwrap_or(0);
+            if ok {
+                state.board_cache.lock().await.put_max_pos(&key, max_pos, gen);
+            }
+            max_pos
+        }
     };
-    let max_pos = max_row.and_then(|(v,)| v).unwrap_or(0);
     let post = if post > max_pos { 1 } else { post };
 
     // Fetch post content
-    let row: Option<(String, String, String, u32, u32, u32, u32)> = if board == 0 {
-        sqlx::query_as(
-            "SELECT `MalChaName`, `MalSubject`, `MalBody`, `MalPosition`, \
-             `MalMonth`, `MalDay`, `MalId` FROM `Mail` \
-             WHERE `MalChaNameDestination` = ? AND `MalPosition` >= ? \
-             AND `MalDeleted` = 0 ORDER BY `MalPosition` LIMIT 1"
-        ).bind(&name).bind(post).fetch_optional(&state.db).await.unwrap_or(None)
-    } else {
-        sqlx::query_as(
-            "SELECT `BrdChaName`, `BrdTopic`, `BrdPost`, `BrdPosition`, \
-             `BrdMonth`, `BrdDay`, `BrdBtlId` FROM `Boards` \
-             WHERE `BrdBnmId` = ? AND `BrdPosition` >= ? \
-             ORDER BY `BrdPosition` LIMIT 1"
-        ).bind(board).bind(post).fetch_optional(&state.db).await.unwrap_or(None)
+    let cached = state.board_cache.lock().await.post(&key, post);
+    let row = match cached {
+        Some(row) => row,
+        None => {
+            let res = fetch_post(state, board, &name, post).await;
+            let ok = res.is_ok();
+            let row = res.unwrap_or(None).map(Arc::new);
+            if ok {
+                state.board_cache.lock().await.put_post(&key, post, row.clone(), gen);
+            }
+            row
+        }
     };
 
-    let (user, topic, msg, real_post, month, day, board_name) = match row {
-        Some(r) => r,
+    let (user, topic, msg, real_post, month, day, board_name) = match row.as_deref() {
+        Some(r) => r.clone(),
         None => return,
     };
 
@@ -514,6 +711,7 @@ async fn handle_read_post(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
             "UPDATE `Mail` SET `MalNew` = 0 \
              WHERE `MalPosition` = ? AND `MalChaNameDestination` = ?"
         ).bind(real_post).bind(&name).execute(&state.db).await;
+        state.board_cache.lock().await.mark_read(&key, real_post);
 
         let unread: Option<(i64,)> = sqlx::query_as(
             "SELECT COUNT(*) FROM `Mail` WHERE `MalChaNameDestination` = ? AND `MalNew` = 1"
@@ -529,6 +727,25 @@ async fn handle_read_post(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
     }
 }
 
+/// The first post at or after `post` on `board`, or in the mailbox of `name`.
+async fn fetch_post(state: &Arc<CharState>, board: u32, name: &str, post: u32) -> Result<Option<PostRow>, sqlx::Error> {
+    if board == 0 {
+        sqlx::query_as(
+            "SELECT `MalChaName`, `MalSubject`, `MalBody`, `MalPosition`, \
+             `MalMonth`, `MalDay`, `MalId` FROM `Mail` \
+             WHERE `MalChaNameDestination` = ? AND `MalPosition` >= ? \
+             AND `MalDeleted` = 0 ORDER BY `MalPosition` LIMIT 1"
+        ).bind(name).bind(post).fetch_optional(&state.db).await
+    } else {
+        sqlx::query_as(
+            "SELECT `BrdChaName`, `BrdTopic`, `BrdPost`, `BrdPosition`, \
+             `BrdMonth`, `BrdDay`, `BrdBtlId` FROM `Boards` \
+             WHERE `BrdBnmId` = ? AND `BrdPosition` >= ? \
+             ORDER BY `BrdPosition` LIMIT 1"
+        ).bind(board).bind(post).fetch_optional(&state.db).await
+    }
+}
+
 // ── 0x300B — User list ───────────────────────────────────────────────────────
 
 async fn handle_user_list(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
@@ -596,6 +813,7 @@ async fn handle_board_post(state: &Arc<CharState>, map_idx: usize, pkt: &[u8]) {
     ).bind(board).bind(&name).bind(&topic).bind(&post)
      .bind(new_id).bind(nval)
      .execute(&state.db).await;
+    state.board_cache.lock().await.invalidate(&Listing::Board(board));
 
     let mut resp = Vec::with_capacity(6);
     write_u16_le(&mut resp, 0x380B);
@@ -614,7 +832,7 @@ async fn handle_nmail_write(state: &Arc<CharState>, map_idx: usize, pkt: &[u8])
     let topic = read_str(pkt, 72, 52);
     let msg   = read_str(pkt, 124, 4000);
 
-    let result = nmail_insert(&state.db, &from, &to, &topic, &msg).await;
+    let result = nmail_insert(state, &from, &to, &topic, &msg).await;
 
     let mut resp = Vec::with_capacity(6);
     write_u16_le(&mut resp, 0x380C);
@@ -631,10 +849,11 @@ async fn handle_nmail_write_copy(state: &Arc<CharState>, pkt: &[u8]) {
     let to    = read_str(pkt, 20, 52);
     let topic = read_str(pkt, 72, 52);
     let msg   = read_str(pkt, 124, 4000);
-    let _ = nmail_insert(&state.db, &from, &to, &topic, &msg).await;
+    let _ = nmail_insert(state, &from, &to, &topic, &msg).await;
 }
 
-async fn nmail_insert(pool: &sqlx::MySqlPool, from: &str, to: &str, topic: &str, msg: &str) -> u16 {
+async fn nmail_insert(state: &Arc<CharState>, from: &str, to: &str, topic: &str, msg: &str) -> u16 {
+    let pool = &state.db;
     // Verify recipient exists
     let exists: Option<(u32,)> = sqlx::query_as(
         "SELECT `ChaId` FROM `Character` WHERE `ChaName` = ?"
@@ -655,10 +874,21 @@ async fn nmail_insert(pool: &sqlx::MySqlPool, from: &str, to: &str, topic: &str,
                 DATE_FORMAT(CURDATE(),'%d'), 1)"
     ).bind(from).bind(to).bind(new_id).bind(topic).bind(msg)
      .execute(pool).await;
+    state.board_cache.lock().await.invalidate(&Listing::of(0, to));
 
     if result.is_err() { 1 } else { 0 }
 }
 
+// ── 0x3011 — Board written by a map server ───────────────────────────────────
+
+/// A map server changed `Boards` itself (post colour, poem board); drop the
+/// cached pages of that board.
+async fn handle_board_changed(state: &Arc<CharState>, pkt: &[u8]) {
+    if pkt.len() < 6 { return; }
+    let board = u32::from_le_bytes([pkt[2], pkt[3], pkt[4], pkt[5]]);
+    state.board_cache.lock().await.invalidate(&Listing::Board(board));
+}
+
 async fn send_to_map(state: &Arc<CharState>, map_idx: usize, msg: Vec<u8>) {
     let servers = state.map_servers.lock().await;
     if let Some(Some(s)) = servers.get(map_idx) {
@@ -695,5 +925,7 @@ mod tests {
         assert_eq!(PKT_LENS[9], 38);   // board_show_0 + 2
         assert_eq!(PKT_LENS[10], 34);  // boards_read_post_0 + 2
         assert_eq!(PKT_LENS[12], 4086); // boards_post_0 + 2
+        assert_eq!(PKT_LENS[0x11], 6);  // board changed
+        assert_eq!(PKT_LENS[0x12], -1); // batched saves
     }
 }
@@ -1,8 +1,13 @@
+pub mod board_cache;
+pub mod char_cache;
 pub mod charstatus;
 pub mod db;
+pub mod dirty;
+pub mod hash_pool;
 pub mod login;
 pub mod map;
 pub mod packet;
+pub mod save_queue;
 
 use anyhow::Result;
 use std::sync::Arc;
@@ -39,22 +44,79 @@ pub struct CharState {
     pub map_servers: Mutex<Vec<Option<MapFifo>>>,
     /// sender to login server connection task
     pub login_tx: Mutex<Option<tokio::sync::mpsc::Sender<Vec<u8>>>>,
+    /// Section digests of online characters as last written to the DB
+    pub saves: Mutex<dirty::SaveTracker>,
+    /// Saves waiting for the next group commit
+    pub save_queue: Mutex<save_queue::SaveQueue>,
+    /// Held while a batch is drained and committed, so a load never reads
+    /// around an in-flight save
+    pub save_commit: Mutex<()>,
+    /// Load replies of recently logged-out characters
+    pub char_cache: Mutex<char_cache::CharCache>,
+    /// Board pages, posts and mailbox listings served without a query
+    pub board_cache: Mutex<board_cache::BoardCache>,
 }
 
 impl CharState {
     pub fn new(db: MySqlPool, config: ServerConfig) -> Self {
+        let cache_size = config.char_cache_size.max(0) as usize;
+        let board_cache_size = config.board_cache_size.max(0) as usize;
         Self {
             db,
             config,
             online: Mutex::new(HashMap::new()),
             map_servers: Mutex::new(Vec::new()),
             login_tx: Mutex::new(None),
+            saves: Mutex::new(dirty::SaveTracker::default()),
+            save_queue: Mutex::new(save_queue::SaveQueue::default()),
+            save_commit: Mutex::new(()),
+            char_cache: Mutex::new(char_cache::CharCache::new(cache_size)),
+            board_cache: Mutex::new(board_cache::BoardCache::new(board_cache_size)),
         }
     }
 
+    /// Serve the char server's gauges on the metrics endpoint. Tables busy
+    /// at scrape time are left out of that scrape.
+    pub fn register_metrics(state: &Arc<Self>) {
+        let s = Arc::clone(state);
+        crate::metrics::register(move |w| {
+            if let Ok(o) = s.online.try_lock() {
+                w.gauge("yuri_chars_online", "Characters online", o.len() as f64);
+            }
+            if let Ok(m) = s.map_servers.try_lock() {
+                let up = m.iter().flatten().count();
+                w.gauge("yuri_map_servers", "Map servers connected", up as f64);
+            }
+            if let Ok(q) = s.save_queue.try_lock() {
+                w.gauge("yuri_save_queue", "Saves waiting for the next group commit", q.len() as f64);
+            }
+            if let Ok(c) = s.char_cache.try_lock() {
+                w.gauge("yuri_char_cache", "Logged-out characters cached", c.len() as f64);
+            }
+            if let Ok(c) = s.board_cache.try_lock() {
+                w.gauge("yuri_board_cache", "Boards and mailboxes cached", c.len() as f64);
+            }
+            if let Ok(tx) = s.login_tx.try_lock() {
+                w.gauge("yuri_login_server_up", "Login server connected", tx.is_some() as u8 as f64);
+            }
+            hash_pool::write_metrics(w);
+            crate::metrics::db_pool(w, &s.db);
+        });
+    }
+
     pub async fn run(state: Arc<Self>, bind_addr: &str) -> Result<()> {
         let listener = TcpListener::bind(bind_addr).await?;
         tracing::info!("[char] [ready] addr={}", bind_addr);
+        {
+            let s = Arc::clone(&state);
+            let window = Duration::from_millis(s.config.save_batch_ms.max(1) as u64);
+            tokio::spawn(async move {
+                loop {
+                    sleep(window).await;
+                    map::flush_saves(&s).await;
+                }
+            });
+        }
         loop {
             match listener.accept().await {
                 Ok((stream, _peer)) => {
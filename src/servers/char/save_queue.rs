@@ -0,0 +1,99 @@
+//! Character saves waiting for the next group commit.
+//!
+//! 0x3004/0x3007 handlers queue the decoded status here instead of writing
+//! it straight away. A later save of the same character replaces the queued
+//! one (each carries the full status), so a character saved twice inside one
+//! batch window costs one write. `map::flush_saves` drains the queue every
+//! `save_batch_ms` and commits it in a single transaction.
+
+use std::collections::HashMap;
+
+use crate::servers::char::charstatus::MmoCharStatus;
+
+pub struct PendingSave {
+    pub status: Box<MmoCharStatus>,
+    /// Saved on logout (0x3007): forget the section digests once written
+    pub logout: bool,
+}
+
+#[derive(Default)]
+pub struct SaveQueue {
+    pending: HashMap<u32, PendingSave>,
+    /// Char ids in first-queued order
+    order: Vec<u32>,
+}
+
+impl SaveQueue {
+    /// Queue `status`. Returns false if it replaced a queued save.
+    pub fn push(&mut self, status: Box<MmoCharStatus>, logout: bool) -> bool {
+        let char_id = status.id;
+        match self.pending.get_mut(&char_id) {
+            Some(p) => {
+                p.status = status;
+                p.logout |= logout;
+                false
+            }
+            None => {
+                self.pending.insert(char_id, PendingSave { status, logout });
+                self.order.push(char_id);
+                true
+            }
+        }
+    }
+
+    /// Remove and return the queued save of `char_id`.
+    pub fn take(&mut self, char_id: u32) -> Option<PendingSave> {
+        let p = self.pending.remove(&char_id)?;
+        self.order.retain(|&id| id != char_id);
+        Some(p)
+    }
+
+    /// Remove every queued save, oldest first.
+    pub fn drain(&mut self) -> Vec<(u32, PendingSave)> {
+        let order = std::mem::take(&mut self.order);
+        order.into_iter().filter_map(|id| self.pending.remove(&id).map(|p| (id, p))).collect()
+    }
+
+    pub fn len(&self) -> usize {
+        self.pending.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.pending.is_empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::servers::char::charstatus::char_status_from_bytes;
+
+    fn status(id: u32, hp: u32) -> Box<MmoCharStatus> {
+        let mut s = char_status_from_bytes(&vec![0u8; std::mem::size_of::<MmoCharStatus>()]).unwrap();
+        s.id = id;
+        s.hp = hp;
+        s
+    }
+
+    #[test]
+    fn test_repeated_saves_merge() {
+        let mut q = SaveQueue::default();
+        assert!(q.push(status(1, 10), false));
+        assert!(q.push(status(2, 10), false));
+        assert!(!q.push(status(1, 20), true));
+        assert!(!q.push(status(1, 30), false));
+        assert_eq!(q.len(), 2);
+
+        let batch = q.drain();
+        assert_eq!(batch.iter().map(|(id, _)| *id).collect::<Vec<_>>(), vec![1, 2]);
+        assert_eq!(batch[0].1.status.hp, 30);
+        assert!(batch[0].1.logout);
+        assert!(q.is_empty());
+
+        q.push(status(3, 0), false);
+        q.push(status(4, 0), false);
+        assert_eq!(q.take(3).map(|p| p.status.id), Some(3));
+        assert!(q.take(3).is_none());
+        assert_eq!(q.drain().len(), 1);
+    }
+}
@@ -7,6 +7,7 @@ pub mod packet;
 use anyhow::Result;
 use std::os::unix::io::AsRawFd;
 use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering::Relaxed};
 use std::collections::HashMap;
 use std::net::SocketAddr;
 use tokio::io::AsyncWriteExt;
@@ -69,6 +70,10 @@ pub struct CharResponse {
     pub data: Vec<u8>,
 }
 
+/// Client connections being served, and accepted since startup
+static CLIENTS: AtomicUsize = AtomicUsize::new(0);
+static ACCEPTED: AtomicU64 = AtomicU64::new(0);
+
 pub struct LoginState {
     pub db: Option<MySqlPool>,
     pub config: ServerConfig,
@@ -170,15 +175,40 @@ start_point:
             // Use the OS socket fd as session_id, matching the C login server where
             // session_id == the client's file descriptor (typically 4, 5, 6, ...).
             let session_id = stream.as_raw_fd() as u16;
+            CLIENTS.fetch_add(1, Relaxed);
             client::handle_client(state, stream, peer, session_id, first).await;
+            CLIENTS.fetch_sub(1, Relaxed);
         }
     }
 
+    /// Serve the login server's gauges on the metrics endpoint. Tables busy
+    /// at scrape time are left out of that scrape.
+    pub fn register_metrics(state: &Arc<Self>) {
+        let s = Arc::clone(state);
+        crate::metrics::register(move |w| {
+            w.gauge("yuri_login_clients", "Client connections being served", CLIENTS.load(Relaxed) as f64);
+            w.counter("yuri_login_accepted_total", "Connections accepted", ACCEPTED.load(Relaxed));
+            if let Ok(p) = s.pending.try_lock() {
+                w.gauge("yuri_login_pending", "Requests waiting for the char server", p.len() as f64);
+            }
+            if let Ok(l) = s.lockout.try_lock() {
+                w.gauge("yuri_login_lockouts", "Addresses with failed logins", l.len() as f64);
+            }
+            if let Ok(tx) = s.char_tx.try_lock() {
+                w.gauge("yuri_char_server_up", "Char server connected", tx.is_some() as u8 as f64);
+            }
+            if let Some(pool) = &s.db {
+                crate::metrics::db_pool(w, pool);
+            }
+        });
+    }
+
     pub async fn run(state: Arc<Self>, bind_addr: &str) -> anyhow::Result<()> {
         let listener = TcpListener::bind(bind_addr).await?;
         tracing::info!("[login] [ready] addr={}", bind_addr);
         loop {
             let (stream, peer) = listener.accept().await?;
+            ACCEPTED.fetch_add(1, Relaxed);
             let s = Arc::clone(&state);
             tokio::spawn(async move {
                 LoginState::handle_new_connection(s, stream, peer).await;
@@ -1,17 +1,29 @@
 use std::sync::Arc;
+use std::sync::atomic::{AtomicUsize, Ordering};
 use tokio::io::{AsyncReadExt, AsyncWriteExt};
 use tokio::net::TcpStream;
-use tokio::sync::mpsc;
+use tokio::sync::{mpsc, oneshot};
+use tokio::time::Duration;
 use super::MapState;
-use super::packet::{PKT_LENS, dispatch};
+use super::packet::{PKT_LENS, dispatch, send_to_char};
+use crate::servers::save_frame::{self, Save};
 
 const MAX_PKT_LEN: usize = 16 * 1024 * 1024;
 
+/// Raw `mmo_charstatus` bytes queued as `Outgoing::Save` and not encoded yet.
+pub static SAVE_BYTES_QUEUED: AtomicUsize = AtomicUsize::new(0);
+/// Past this many queued raw bytes (about 20 characters) a save is encoded
+/// on the game thread before it is queued, as intif_save used to do, so a
+/// mass save (shutdown, handoff) does not hold a raw copy of every player.
+pub const SAVE_BYTES_MAX: usize = 64 * 1024 * 1024;
+
 pub async fn connect_to_char(state: Arc<MapState>) {
-    use tokio::time::{Duration, interval};
+    use tokio::time::interval;
     let mut ticker = interval(Duration::from_secs(1));
     loop {
         ticker.tick().await;
+        // Handing off: the link stays closed unless the handoff is aborted
+        if crate::session::handed_off() { continue; }
         {
             let tx = state.char_tx.lock().await;
             if tx.is_some() { continue; }
@@ -43,6 +55,8 @@ async fn run_char_connection(state: Arc<MapState>, mut stream: TcpStream) {
     pkt[66..70].copy_from_slice(&map_ip_u32.to_be_bytes());
     pkt[70..72].copy_from_slice(&state.config.map_port.to_le_bytes());
 
+    // Legacy saves until this char server acknowledges more (0x3801)
+    state.save_caps.store(0, Ordering::Release);
     if stream.write_all(&pkt).await.is_err() { return; }
 
     let (tx, mut rx) = mpsc::channel::<Vec<u8>>(64);
@@ -55,9 +69,12 @@ async fn run_char_connection(state: Arc<MapState>, mut stream: TcpStream) {
 
     let writer = tokio::spawn(async move {
         while let Some(msg) = rx.recv().await {
-            if wh.write_all(&msg).await.is_err() { break; }
+            if wh.write_all(&msg).await.is_err() { return; }
         }
+        // Closed by close_char_link: everything queued is written
+        let _ = wh.shutdown().await;
     });
+    *state.char_writer.lock().await = Some(writer);
 
     loop {
         let mut cmd_bytes = [0u8; 2];
@@ -101,10 +118,91 @@ async fn run_char_connection(state: Arc<MapState>, mut stream: TcpStream) {
         let mut ct = state.char_tx.lock().await;
         *ct = None;
     }
-    writer.abort();
+    state.save_caps.store(0, Ordering::Release);
+    if let Some(writer) = state.char_writer.lock().await.take() {
+        writer.abort();
+    }
     tracing::warn!("[map] [charif] Char server connection lost, reconnecting...");
 }
 
+/// Write out what is already queued for the char server and close the
+/// link. A hot restart does this after its final saves, so the char server
+/// has them before the next map server asks for the characters.
+pub async fn close_char_link(state: &MapState, timeout: Duration) -> bool {
+    state.char_tx.lock().await.take();
+    let Some(writer) = state.char_writer.lock().await.take() else { return false };
+    matches!(tokio::time::timeout(timeout, writer).await, Ok(Ok(())))
+}
+
+/// What the game thread hands to the char link, in the order it happened.
+pub enum Outgoing {
+    /// A packet already built
+    Packet(Vec<u8>),
+    /// A raw `mmo_charstatus` still to be framed and compressed
+    Save(Save),
+    /// Answered once everything queued before it went to the link
+    Mark(oneshot::Sender<()>),
+}
+
+/// Send the game thread's char-server traffic in order. Saves are encoded
+/// on the blocking pool, not the game thread: a run of queued saves
+/// becomes one 0x3012 frame once the char server has accepted
+/// CAP_SAVE_ZSTD, else one legacy 0x3004/0x3007 each.
+pub async fn run_outgoing(state: Arc<MapState>, mut rx: mpsc::UnboundedReceiver<Outgoing>) {
+    let mut next = None;
+    loop {
+        let item = match next.take() {
+            Some(item) => item,
+            None => match rx.recv().await {
+                Some(item) => item,
+                None => return,
+            },
+        };
+        let first = match item {
+            Outgoing::Packet(pkt) => {
+                send_to_char(&state, pkt).await;
+                continue;
+            }
+            Outgoing::Mark(done) => {
+                let _ = done.send(());
+                continue;
+            }
+            Outgoing::Save(save) => save,
+        };
+        let mut saves = vec![first];
+        while saves.len() < save_frame::MAX_BATCH {
+            match rx.try_recv() {
+                Ok(Outgoing::Save(save)) => saves.push(save),
+                Ok(other) => {
+                    next = Some(other);
+                    break;
+                }
+                Err(_) => break,
+            }
+        }
+        let batched = state.save_caps.load(Ordering::Acquire) & save_frame::CAP_SAVE_ZSTD != 0;
+        let level = state.config.save_zstd_level;
+        let bytes: usize = saves.iter().map(|s| s.status.len()).sum();
+        let frames = tokio::task::spawn_blocking(move || encode_saves(saves, batched, level))
+            .await
+            .unwrap_or_default();
+        SAVE_BYTES_QUEUED.fetch_sub(bytes, Ordering::Relaxed);
+        for frame in frames {
+            send_to_char(&state, frame).await;
+        }
+    }
+}
+
+fn encode_saves(saves: Vec<Save>, batched: bool, level: i32) -> Vec<Vec<u8>> {
+    if batched {
+        match save_frame::encode_batch(&saves, level) {
+            Ok(frame) => return vec![frame],
+            Err(e) => tracing::warn!("[map] [charif] 0x3012 encode failed, sending legacy saves: {}", e),
+        }
+    }
+    saves.iter().map(save_frame::encode_legacy).collect()
+}
+
 #[cfg(test)]
 mod tests {
     #[test]
@@ -0,0 +1,401 @@
+//! Hot restart: a new map server takes over the listener and the connected
+//! players of the running one.
+//!
+//! The running server listens on `handoff_socket`. `map_server --takeover`
+//! does its whole cold start first (maps, tables, spawns, scripts) without
+//! binding the game port, then connects and says hello. The old server
+//! stops at the end of that tick. It saves every player to the char server,
+//! drains its DB writes and closes the char link. Then it sends this:
+//!
+//! ```text
+//! header   magic "YURIHOFF", version u32, fd count u32, snapshot len u64
+//! fds      SCM_RIGHTS chunks of at most FDS_PER_MSG, each with a u32 count
+//! snapshot listener count, sessions, mob spawn state (see encode)
+//! ```
+//!
+//! The fds are the listeners first, then one client socket per session
+//! record, in the same order. Passing a socket keeps the TCP connection
+//! open, so clients never see a disconnect. The new server adopts the
+//! sockets into its session manager, carrying over the packet counter and
+//! any bytes still buffered either way. Once its char link is up it loads
+//! each character from the char server, as a map server hop would, and the
+//! client sees the map sent again.
+//!
+//! Player state travels through the char server as an ordinary save. The
+//! in-memory `USER` is full of pointers and is not worth serializing.
+//! Registries are flushed to the database first. Mob spawns are matched by
+//! id, template and spawn point, so a changed Spawns table just starts
+//! those mobs fresh.
+
+use std::io::{self, Read, Write};
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::sync::Mutex;
+
+const MAGIC: [u8; 8] = *b"YURIHOFF";
+const VERSION: u32 = 1;
+/// Below the kernel's SCM_MAX_FD of 253
+const FDS_PER_MSG: usize = 250;
+const MAX_SNAPSHOT: u64 = 1 << 30;
+
+/// A connected player, in fd order after the listeners.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SessionRecord {
+    pub char_id: u32,
+    pub name: String,
+    /// Server→client packet counter
+    pub increment: u8,
+    /// Input not yet parsed
+    pub rdata: Vec<u8>,
+    /// Output not yet sent
+    pub wdata: Vec<u8>,
+}
+
+/// Live state of one normal (not one-time) mob spawn.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MobRecord {
+    pub id: u32,
+    pub mobid: u32,
+    pub start: (u16, u16, u16),
+    pub pos: (u16, u16, u16),
+    pub side: i32,
+    pub state: u8,
+    pub hp: u32,
+    pub last_death: u32,
+}
+
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct Snapshot {
+    pub listeners: u32,
+    pub sessions: Vec<SessionRecord>,
+    pub mobs: Vec<MobRecord>,
+}
+
+fn bad(what: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, format!("handoff: {what}"))
+}
+
+pub fn encode(s: &Snapshot) -> Vec<u8> {
+    let mut out = Vec::new();
+    out.extend_from_slice(&s.listeners.to_le_bytes());
+    out.extend_from_slice(&(s.sessions.len() as u32).to_le_bytes());
+    for r in &s.sessions {
+        out.extend_from_slice(&r.char_id.to_le_bytes());
+        let name = &r.name.as_bytes()[..r.name.len().min(16)];
+        out.push(name.len() as u8);
+        out.extend_from_slice(name);
+        out.push(r.increment);
+        for buf in [&r.rdata, &r.wdata] {
+            out.extend_from_slice(&(buf.len() as u32).to_le_bytes());
+            out.extend_from_slice(buf);
+        }
+    }
+    out.extend_from_slice(&(s.mobs.len() as u32).to_le_bytes());
+    for m in &s.mobs {
+        out.extend_from_slice(&m.id.to_le_bytes());
+        out.extend_from_slice(&m.mobid.to_le_bytes());
+        for v in [m.start.0, m.start.1, m.start.2, m.pos.0, m.pos.1, m.pos.2] {
+            out.extend_from_slice(&v.to_le_bytes());
+        }
+        out.extend_from_slice(&m.side.to_le_bytes());
+        out.push(m.state);
+        out.extend_from_slice(&m.hp.to_le_bytes());
+        out.extend_from_slice(&m.last_death.to_le_bytes());
+    }
+    out
+}
+
+struct Reader<'a>(&'a [u8]);
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> io::Result<&'a [u8]> {
+        if self.0.len() < n {
+            return Err(bad("snapshot truncated"));
+        }
+        let (head, rest) = self.0.split_at(n);
+        self.0 = rest;
+        Ok(head)
+    }
+    fn u8(&mut self) -> io::Result<u8> {
+        Ok(self.take(1)?[0])
+    }
+    fn u16(&mut self) -> io::Result<u16> {
+        Ok(u16::from_le_bytes(self.take(2)?.try_into().unwrap()))
+    }
+    fn u32(&mut self) -> io::Result<u32> {
+        Ok(u32::from_le_bytes(self.take(4)?.try_into().unwrap()))
+    }
+}
+
+pub fn decode(buf: &[u8]) -> io::Result<Snapshot> {
+    let mut r = Reader(buf);
+    let listeners = r.u32()?;
+    let n = r.u32()? as usize;
+    let mut sessions = Vec::with_capacity(n.min(buf.len()));
+    for _ in 0..n {
+        let char_id = r.u32()?;
+        let len = r.u8()? as usize;
+        let name = String::from_utf8_lossy(r.take(len)?).into_owned();
+        let increment = r.u8()?;
+        let len = r.u32()? as usize;
+        let rdata = r.take(len)?.to_vec();
+        let len = r.u32()? as usize;
+        let wdata = r.take(len)?.to_vec();
+        sessions.push(SessionRecord { char_id, name, increment, rdata, wdata });
+    }
+    let n = r.u32()? as usize;
+    let mut mobs = Vec::with_capacity(n.min(buf.len()));
+    for _ in 0..n {
+        mobs.push(MobRecord {
+            id: r.u32()?,
+            mobid: r.u32()?,
+            start: (r.u16()?, r.u16()?, r.u16()?),
+            pos: (r.u16()?, r.u16()?, r.u16()?),
+            side: r.u32()? as i32,
+            state: r.u8()?,
+            hp: r.u32()?,
+            last_death: r.u32()?,
+        });
+    }
+    if !r.0.is_empty() {
+        return Err(bad("trailing bytes"));
+    }
+    Ok(Snapshot { listeners, sessions, mobs })
+}
+
+/// Control buffer for `n` fds, aligned for `cmsghdr`.
+fn cmsg_buf(n: usize) -> Vec<u64> {
+    let space = unsafe { libc::CMSG_SPACE((n * std::mem::size_of::<RawFd>()) as u32) } as usize;
+    vec![0u64; space.div_ceil(8)]
+}
+
+/// Send `data` with `fds` attached to its first byte.
+fn send_fds(sock: &UnixStream, data: &[u8], fds: &[RawFd]) -> io::Result<()> {
+    let mut iov = libc::iovec { iov_base: data.as_ptr() as *mut libc::c_void, iov_len: data.len() };
+    let mut cbuf = cmsg_buf(fds.len());
+    let mut msg: libc::msghdr = unsafe { std::mem::zeroed() };
+    msg.msg_iov = &mut iov;
+    msg.msg_iovlen = 1;
+    if !fds.is_empty() {
+        msg.msg_control = cbuf.as_mut_ptr() as *mut libc::c_void;
+        msg.msg_controllen = (cbuf.len() * 8) as _;
+        unsafe {
+            let c = libc::CMSG_FIRSTHDR(&msg);
+            (*c).cmsg_level = libc::SOL_SOCKET;
+            (*c).cmsg_type = libc::SCM_RIGHTS;
+            (*c).cmsg_len = libc::CMSG_LEN((fds.len() * std::mem::size_of::<RawFd>()) as u32) as _;
+            std::ptr::copy_nonoverlapping(fds.as_ptr(), libc::CMSG_DATA(c) as *mut RawFd, fds.len());
+        }
+    }
+    let sent = unsafe { libc::sendmsg(sock.as_raw_fd(), &msg, libc::MSG_NOSIGNAL) };
+    if sent < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    (&*sock).write_all(&data[sent as usize..])
+}
+
+/// Receive into `buf`, taking up to `max_fds` fds. A read stops at the end
+/// of a message that carried fds, so the chunks stay apart.
+fn recv_fds(sock: &UnixStream, buf: &mut [u8], max_fds: usize) -> io::Result<(usize, Vec<OwnedFd>)> {
+    let mut iov = libc::iovec { iov_base: buf.as_mut_ptr() as *mut libc::c_void, iov_len: buf.len() };
+    let mut cbuf = cmsg_buf(max_fds);
+    let mut msg: libc::msghdr = unsafe { std::mem::zeroed() };
+    msg.msg_iov = &mut iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.as_mut_ptr() as *mut libc::c_void;
+    msg.msg_controllen = (cbuf.len() * 8) as _;
+    let got = unsafe { libc::recvmsg(sock.as_raw_fd(), &mut msg, libc::MSG_CMSG_CLOEXEC) };
+    if got < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    let mut fds = Vec::new();
+    unsafe {
+        let mut c = libc::CMSG_FIRSTHDR(&msg);
+        while !c.is_null() {
+            if (*c).cmsg_level == libc::SOL_SOCKET && (*c).cmsg_type == libc::SCM_RIGHTS {
+                let bytes = (*c).cmsg_len as usize - libc::CMSG_LEN(0) as usize;
+                let data = libc::CMSG_DATA(c) as *const RawFd;
+                for i in 0..bytes / std::mem::size_of::<RawFd>() {
+                    fds.push(OwnedFd::from_raw_fd(data.add(i).read_unaligned()));
+                }
+            }
+            c = libc::CMSG_NXTHDR(&msg, c);
+        }
+    }
+    if msg.msg_flags & libc::MSG_CTRUNC != 0 {
+        return Err(bad("fds truncated"));
+    }
+    if got == 0 {
+        return Err(io::ErrorKind::UnexpectedEof.into());
+    }
+    Ok((got as usize, fds))
+}
+
+/// Old side: send `snapshot` and `fds` (listeners, then one per session).
+pub fn send(sock: &UnixStream, snapshot: &Snapshot, fds: &[RawFd]) -> io::Result<()> {
+    let body = encode(snapshot);
+    let mut head = Vec::with_capacity(24);
+    head.extend_from_slice(&MAGIC);
+    head.extend_from_slice(&VERSION.to_le_bytes());
+    head.extend_from_slice(&(fds.len() as u32).to_le_bytes());
+    head.extend_from_slice(&(body.len() as u64).to_le_bytes());
+    (&*sock).write_all(&head)?;
+    for chunk in fds.chunks(FDS_PER_MSG) {
+        send_fds(sock, &(chunk.len() as u32).to_le_bytes(), chunk)?;
+    }
+    (&*sock).write_all(&body)
+}
+
+/// New side: receive what `send` sent.
+pub fn receive(sock: &UnixStream) -> io::Result<(Snapshot, Vec<OwnedFd>)> {
+    let mut head = [0u8; 24];
+    (&*sock).read_exact(&mut head)?;
+    if head[..8] != MAGIC || head[8..12] != VERSION.to_le_bytes() {
+        return Err(bad("version mismatch"));
+    }
+    let nfds = u32::from_le_bytes(head[12..16].try_into().unwrap()) as usize;
+    let len = u64::from_le_bytes(head[16..24].try_into().unwrap());
+    if len > MAX_SNAPSHOT {
+        return Err(bad("snapshot too large"));
+    }
+    let mut fds = Vec::with_capacity(nfds);
+    while fds.len() < nfds {
+        let mut count = [0u8; 4];
+        let (got, mut chunk) = recv_fds(sock, &mut count, FDS_PER_MSG)?;
+        (&*sock).read_exact(&mut count[got..])?;
+        if chunk.len() != u32::from_le_bytes(count) as usize {
+            return Err(bad("fd chunk does not match its count"));
+        }
+        fds.append(&mut chunk);
+    }
+    let mut body = vec![0u8; len as usize];
+    (&*sock).read_exact(&mut body)?;
+    let snapshot = decode(&body)?;
+    if fds.len() != snapshot.listeners as usize + snapshot.sessions.len() {
+        return Err(bad("fd count does not match the snapshot"));
+    }
+    Ok((snapshot, fds))
+}
+
+/// New side: ask the server on `path` to hand over, and wait for it.
+pub fn take_over(path: &str) -> io::Result<(Snapshot, Vec<OwnedFd>)> {
+    let sock = UnixStream::connect(path)?;
+    let mut hello = MAGIC.to_vec();
+    hello.extend_from_slice(&VERSION.to_le_bytes());
+    (&sock).write_all(&hello)?;
+    receive(&sock)
+}
+
+/// A takeover request, waiting for the game loop to stop.
+static REQUEST: Mutex<Option<UnixStream>> = Mutex::new(None);
+
+/// Old side: listen on `path` for one `--takeover`. `on_request` runs on the
+/// listener thread once a valid hello arrives and has to stop the game loop.
+pub fn serve(path: &str, on_request: fn()) -> io::Result<()> {
+    // A socket file left by the process this one took over
+    let _ = std::fs::remove_file(path);
+    let listener = UnixListener::bind(path)?;
+    tracing::info!("[map] [handoff] waiting for a takeover on {}", path);
+    std::thread::Builder::new().name("handoff".into()).spawn(move || loop {
+        let Ok((sock, _)) = listener.accept() else { return };
+        let mut hello = [0u8; 12];
+        let valid = (&sock).read_exact(&mut hello).is_ok()
+            && hello[..8] == MAGIC
+            && hello[8..] == VERSION.to_le_bytes();
+        if !valid {
+            tracing::warn!("[map] [handoff] ignored a connection without a valid hello");
+            continue;
+        }
+        tracing::info!("[map] [handoff] takeover requested, stopping at the end of this tick");
+        *REQUEST.lock().unwrap_or_else(|e| e.into_inner()) = Some(sock);
+        on_request();
+    })?;
+    Ok(())
+}
+
+/// The pending takeover request, if any.
+pub fn requested() -> Option<UnixStream> {
+    REQUEST.lock().unwrap_or_else(|e| e.into_inner()).take()
+}
+
+type Resume = Box<dyn FnOnce() + Send>;
+
+/// New side: what to run once the char link is up (load the players).
+static RESUME: Mutex<Option<Resume>> = Mutex::new(None);
+
+pub fn set_resume(f: Resume) {
+    *RESUME.lock().unwrap_or_else(|e| e.into_inner()) = Some(f);
+}
+
+/// Called when the char server accepts the link; runs the resume once.
+pub fn resume() {
+    let f = RESUME.lock().unwrap_or_else(|e| e.into_inner()).take();
+    if let Some(f) = f {
+        f();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn snapshot() -> Snapshot {
+        Snapshot {
+            listeners: 1,
+            sessions: vec![
+                SessionRecord { char_id: 7, name: "Hocari".into(), increment: 200, rdata: vec![0xAA, 0, 3], wdata: vec![] },
+                SessionRecord { char_id: 9, name: "Amberly".into(), increment: 0, rdata: vec![], wdata: vec![1; 40] },
+            ],
+            mobs: vec![MobRecord {
+                id: 1073741824,
+                mobid: 12,
+                start: (3, 10, 11),
+                pos: (3, 12, 9),
+                side: 2,
+                state: 1,
+                hp: 55,
+                last_death: 1_700_000_000,
+            }],
+        }
+    }
+
+    #[test]
+    fn test_snapshot_round_trip() {
+        let s = snapshot();
+        let buf = encode(&s);
+        assert_eq!(decode(&buf).unwrap(), s);
+        assert!(decode(&buf[..buf.len() - 1]).is_err());
+        let mut long = buf.clone();
+        long.push(0);
+        assert!(decode(&long).is_err());
+    }
+
+    #[test]
+    fn test_send_passes_fds_in_chunks() {
+        let (a, b) = UnixStream::pair().unwrap();
+        let file = std::fs::File::open("/dev/null").unwrap();
+        let ino = |fd: RawFd| {
+            let mut st: libc::stat = unsafe { std::mem::zeroed() };
+            assert_eq!(unsafe { libc::fstat(fd, &mut st) }, 0);
+            st.st_ino
+        };
+        // More sessions than fit in one SCM_RIGHTS message
+        let mut s = snapshot();
+        let proto = s.sessions[0].clone();
+        s.sessions = (0..300).map(|i| SessionRecord { char_id: i, ..proto.clone() }).collect();
+        let fds = vec![file.as_raw_fd(); 301];
+        let sender = std::thread::spawn(move || send(&a, &s, &fds).map(|_| s));
+        let (got, owned) = receive(&b).unwrap();
+        let sent = sender.join().unwrap().unwrap();
+        assert_eq!(got, sent);
+        assert_eq!(owned.len(), 301);
+        assert!(owned.iter().all(|fd| ino(fd.as_raw_fd()) == ino(file.as_raw_fd())));
+    }
+
+    #[test]
+    fn test_receive_rejects_other_versions() {
+        let (a, b) = UnixStream::pair().unwrap();
+        (&a).write_all(b"YURIHOFF\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0").unwrap();
+        assert!(receive(&b).is_err());
+    }
+}
@@ -1,7 +1,9 @@
 pub mod char;
+pub mod handoff;
 pub mod packet;
 
 use std::sync::Arc;
+use std::sync::atomic::AtomicU32;
 use tokio::sync::Mutex;
 use sqlx::MySqlPool;
 use crate::config::ServerConfig;
@@ -13,6 +15,11 @@ pub struct MapState {
     pub char_tx: Mutex<Option<tokio::sync::mpsc::Sender<Vec<u8>>>>,
     /// Pending auth tokens: char_name → session fd on map server
     pub auth_db: Mutex<std::collections::HashMap<String, AuthEntry>>,
+    /// save_frame::CAP_* the char server acknowledged; 0 until it does and
+    /// after the link drops
+    pub save_caps: AtomicU32,
+    /// Task writing `char_tx` to the socket, while connected
+    pub char_writer: Mutex<Option<tokio::task::JoinHandle<()>>>,
 }
 
 #[derive(Debug, Clone)]
@@ -30,6 +37,8 @@ impl MapState {
             config,
             char_tx: Mutex::new(None),
             auth_db: Mutex::new(std::collections::HashMap::new()),
+            save_caps: AtomicU32::new(0),
+            char_writer: Mutex::new(None),
         }
     }
 }
@@ -1,5 +1,6 @@
 use std::sync::Arc;
 use super::MapState;
+use crate::servers::save_frame;
 
 /// Packet length table for incoming 0x3800–0x3811 packets from char_server.
 /// Index = cmd - 0x3800. -1 = variable (read 4-byte len at offset 2). 0 = unknown.
@@ -27,7 +28,7 @@ pub const PKT_LENS: &[i32] = &[
 pub async fn dispatch(state: &Arc<MapState>, cmd: u16, pkt: &[u8]) {
     match cmd {
         0x3800 => handle_accept(state, pkt).await,
-        0x3801 => { /* mapset — no-op in C, intif_parse_mapset is commented out */ }
+        0x3801 => handle_caps_ack(state, pkt),
         0x3802 => handle_authadd(state, pkt).await,
         0x3803 => handle_charload(state, pkt).await,
         0x3804 => handle_checkonline(state, pkt).await,
@@ -68,9 +69,10 @@ async fn handle_accept(state: &Arc<MapState>, pkt: &[u8]) {
     let map_ids: Vec<u16> = vec![];
 
     // 0x3001 packet: [0..2]=cmd, [2..6]=total_len (u32 LE), [6..8]=map_count (u16 LE),
-    //                [8..] = map_ids (u16 LE each)
+    //                [8..] = map_ids (u16 LE each), then save capabilities (u32 LE)
+    let caps = if state.config.save_zstd_level > 0 { save_frame::CAPS } else { 0 };
     let map_count = map_ids.len() as u16;
-    let total_len = 8u32 + map_count as u32 * 2;
+    let total_len = 12u32 + map_count as u32 * 2;
     let mut resp = Vec::with_capacity(total_len as usize);
     resp.extend_from_slice(&0x3001u16.to_le_bytes());
     resp.extend_from_slice(&total_len.to_le_bytes());
@@ -78,8 +80,20 @@ async fn handle_accept(state: &Arc<MapState>, pkt: &[u8]) {
     for id in &map_ids {
         resp.extend_from_slice(&id.to_le_bytes());
     }
+    resp.extend_from_slice(&caps.to_le_bytes());
     tracing::info!("[map] [charif] sending map list count={}", map_count);
     send_to_char(state, resp).await;
+    // Players adopted in a hot restart load once the map list is in
+    super::handoff::resume();
+}
+
+/// 0x3801 — save capabilities the char_server accepted (see save_frame).
+/// Char servers without them never send it (C intif_parse_mapset was a no-op).
+fn handle_caps_ack(state: &Arc<MapState>, pkt: &[u8]) {
+    let Some(b) = pkt.get(6..10) else { return };
+    let caps = u32::from_le_bytes([b[0], b[1], b[2], b[3]]) & save_frame::CAPS;
+    state.save_caps.store(caps, std::sync::atomic::Ordering::Release);
+    tracing::info!("[map] [charif] char server accepted save capabilities {:#x}", caps);
 }
 
 /// 0x3802 — char_server is routing a player to this map server.
@@ -142,33 +156,30 @@ async fn handle_charload(_state: &Arc<MapState>, pkt: &[u8]) {
     let fd = session_fd as i32;
     tracing::info!("[map] [charif] calling intif_mmo_tosd fd={} raw_bytes={}", fd, raw.len());
 
-    // Suppress notifications before spawning
-    {
+    // intif_mmo_tosd runs login scripts and touches the C game state, so it
+    // must run on the script owner thread (the one driving timer_do), not on
+    // this char-connection task. It runs at the start of the next tick.
+    crate::game::scripting::executor::run_on_owner(move || {
         let manager = crate::session::get_session_manager();
-        if let Some(session_arc) = manager.get_session(fd) {
-            session_arc.lock().await.suppress_notify = true;
+        let set_suppress = |on: bool| {
+            // Uncontended on the owner thread, as in ffi::session::with_session
+            if let Some(mut session) = manager.get_session(fd).and_then(|a| a.try_lock_owned().ok()) {
+                session.suppress_notify = on;
+                if !on {
+                    session.write_notify.notify_one();
+                }
+            }
+        };
+        set_suppress(true);
+        crate::capture::char_load(fd, &raw);
+        #[cfg(not(test))]
+        {
+            let rc = crate::ffi::map_char::call_intif_mmo_tosd(fd, &mut raw);
+            tracing::info!("[map] [charif] intif_mmo_tosd returned rc={}", rc);
         }
-    }
-
-    // Call intif_mmo_tosd synchronously on the LocalSet thread (same thread as timer_do).
-    // This prevents concurrent Lua state access: timer callbacks (mob AI, NPC timers) and
-    // charload both call sl_doscript_blargs, and LuaJIT is single-threaded.
-    // spawn_blocking would put this on a separate OS thread, racing with timer_do.
-    #[cfg(not(test))]
-    {
-        let rc = crate::ffi::map_char::call_intif_mmo_tosd(fd, &mut raw);
-        tracing::info!("[map] [charif] intif_mmo_tosd returned rc={}", rc);
-    }
-
-    // Re-enable notifications and trigger a single flush of all buffered data
-    {
-        let manager = crate::session::get_session_manager();
-        if let Some(session_arc) = manager.get_session(fd) {
-            let mut session = session_arc.lock().await;
-            session.suppress_notify = false;
-            session.write_notify.notify_one();
-        }
-    }
+        // Re-enable notifications and trigger a single flush of all buffered data
+        set_suppress(false);
+    });
 }
 
 /// 0x3804 — char_server is checking / forcing a player offline.
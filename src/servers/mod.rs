@@ -9,3 +9,5 @@
 pub mod login;
 pub mod char;
 pub mod map;
+/// Save frames shared by the map→char link
+pub mod save_frame;
@@ -0,0 +1,176 @@
+//! Character save frames on the map→char link.
+//!
+//! Legacy: one 0x3004 (save) or 0x3007 (save and log out) per character,
+//! the `mmo_charstatus` zlib-compressed on its own. Every char server
+//! understands it.
+//!
+//! Batched: 0x3012 carries up to `MAX_BATCH` statuses compressed together
+//! with zstd. The map server only sends it after the char server has
+//! acknowledged `CAP_SAVE_ZSTD`:
+//! - The map server appends a u32 capability mask after the map ids of
+//!   0x3001. Older char servers read only the ids and ignore it.
+//! - The char server answers with 0x3801 carrying the capabilities it
+//!   accepts. Older map servers treat 0x3801 as a no-op and keep sending
+//!   legacy saves.
+//!
+//! ```text
+//! 0x3012  [0..2] cmd  [2..6] total_len  [6] codec  [7..9] count
+//!         [9..13] raw_len  [13..] zstd(count × ([logout u8] [mmo_charstatus]))
+//! ```
+//!
+//! No trained dictionary: a status is 3.1 MB, mostly zero runs and repeated
+//! item records, so zstd finds its matches inside the record itself and a
+//! dictionary of at most a few hundred KB adds nothing.
+
+use std::io::{self, Read, Write};
+
+use flate2::read::ZlibDecoder;
+use flate2::write::ZlibEncoder;
+use flate2::Compression;
+
+pub const CMD_SAVE: u16 = 0x3004;
+pub const CMD_SAVE_QUIT: u16 = 0x3007;
+pub const CMD_SAVE_BATCH: u16 = 0x3012;
+/// 0x3801 payload: capabilities the char server accepted
+pub const CMD_CAPS_ACK: u16 = 0x3801;
+
+/// 0x3012 frames with the zstd codec
+pub const CAP_SAVE_ZSTD: u32 = 1 << 0;
+/// Capabilities this build implements on either side
+pub const CAPS: u32 = CAP_SAVE_ZSTD;
+
+const CODEC_ZSTD: u8 = 1;
+const HEADER: usize = 13;
+/// Statuses per 0x3012 frame; keeps a frame well under the 16 MiB cap.
+pub const MAX_BATCH: usize = 4;
+
+/// One character's raw `mmo_charstatus`.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct Save {
+    pub status: Vec<u8>,
+    pub logout: bool,
+}
+
+/// 0x3004/0x3007 for one save, zlib level 1 as intif_save used.
+pub fn encode_legacy(save: &Save) -> Vec<u8> {
+    let mut out = vec![0u8; 6];
+    let cmd = if save.logout { CMD_SAVE_QUIT } else { CMD_SAVE };
+    out[0..2].copy_from_slice(&cmd.to_le_bytes());
+    let mut enc = ZlibEncoder::new(out, Compression::fast());
+    let _ = enc.write_all(&save.status);
+    let mut out = enc.finish().unwrap_or_default();
+    let total = out.len() as u32;
+    out[2..6].copy_from_slice(&total.to_le_bytes());
+    out
+}
+
+/// Inflate the status of a 0x3004/0x3007.
+pub fn decode_legacy(pkt: &[u8]) -> Option<Vec<u8>> {
+    let total = u32::from_le_bytes(pkt.get(2..6)?.try_into().ok()?) as usize;
+    let data = pkt.get(6..total.max(6))?;
+    let mut raw = Vec::new();
+    ZlibDecoder::new(data).read_to_end(&mut raw).ok()?;
+    Some(raw)
+}
+
+/// A 0x3012 frame holding `saves`, all statuses of one size.
+pub fn encode_batch(saves: &[Save], level: i32) -> io::Result<Vec<u8>> {
+    if saves.is_empty() || saves.len() > MAX_BATCH {
+        return Err(io::Error::new(io::ErrorKind::InvalidInput, "batch size"));
+    }
+    let mut raw = Vec::with_capacity(saves.iter().map(|s| s.status.len() + 1).sum());
+    for s in saves {
+        raw.push(s.logout as u8);
+        raw.extend_from_slice(&s.status);
+    }
+    let packed = zstd::bulk::compress(&raw, level)?;
+    let total = (HEADER + packed.len()) as u32;
+    let mut out = Vec::with_capacity(total as usize);
+    out.extend_from_slice(&CMD_SAVE_BATCH.to_le_bytes());
+    out.extend_from_slice(&total.to_le_bytes());
+    out.push(CODEC_ZSTD);
+    out.extend_from_slice(&(saves.len() as u16).to_le_bytes());
+    out.extend_from_slice(&(raw.len() as u32).to_le_bytes());
+    out.extend_from_slice(&packed);
+    Ok(out)
+}
+
+/// The saves of a 0x3012 frame whose statuses are `status_len` long.
+pub fn decode_batch(pkt: &[u8], status_len: usize) -> io::Result<Vec<Save>> {
+    let bad = |why: &str| io::Error::new(io::ErrorKind::InvalidData, why.to_string());
+    if pkt.len() < HEADER {
+        return Err(bad("short frame"));
+    }
+    if pkt[6] != CODEC_ZSTD {
+        return Err(bad("unknown codec"));
+    }
+    let count = u16::from_le_bytes([pkt[7], pkt[8]]) as usize;
+    let raw_len = u32::from_le_bytes([pkt[9], pkt[10], pkt[11], pkt[12]]) as usize;
+    let entry = status_len + 1;
+    if count == 0 || count > MAX_BATCH || raw_len != count * entry {
+        return Err(bad("bad batch header"));
+    }
+    let raw = zstd::bulk::decompress(&pkt[HEADER..], raw_len)?;
+    if raw.len() != raw_len {
+        return Err(bad("short payload"));
+    }
+    Ok(raw
+        .chunks_exact(entry)
+        .map(|e| Save { logout: e[0] != 0, status: e[1..].to_vec() })
+        .collect())
+}
+
+/// 0x3801 acknowledging `caps`.
+pub fn encode_caps_ack(caps: u32) -> Vec<u8> {
+    let mut out = Vec::with_capacity(10);
+    out.extend_from_slice(&CMD_CAPS_ACK.to_le_bytes());
+    out.extend_from_slice(&10u32.to_le_bytes());
+    out.extend_from_slice(&caps.to_le_bytes());
+    out
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn status(id: u32, len: usize) -> Vec<u8> {
+        let mut s = vec![0u8; len];
+        s[0..4].copy_from_slice(&id.to_le_bytes());
+        s[len / 2] = id as u8;
+        s
+    }
+
+    #[test]
+    fn test_legacy_round_trip() {
+        let save = Save { status: status(7, 4096), logout: true };
+        let pkt = encode_legacy(&save);
+        assert_eq!(u16::from_le_bytes([pkt[0], pkt[1]]), CMD_SAVE_QUIT);
+        assert_eq!(u32::from_le_bytes([pkt[2], pkt[3], pkt[4], pkt[5]]) as usize, pkt.len());
+        assert_eq!(decode_legacy(&pkt), Some(save.status));
+        assert_eq!(decode_legacy(&pkt[..4]), None);
+    }
+
+    #[test]
+    fn test_batch_round_trip() {
+        let saves = vec![
+            Save { status: status(1, 4096), logout: false },
+            Save { status: status(2, 4096), logout: true },
+        ];
+        let pkt = encode_batch(&saves, 1).unwrap();
+        assert_eq!(u16::from_le_bytes([pkt[0], pkt[1]]), CMD_SAVE_BATCH);
+        assert_eq!(u32::from_le_bytes([pkt[2], pkt[3], pkt[4], pkt[5]]) as usize, pkt.len());
+        assert!(pkt.len() < 512);
+        assert_eq!(decode_batch(&pkt, 4096).unwrap(), saves);
+        // Statuses of another size are rejected, not misparsed
+        assert!(decode_batch(&pkt, 4000).is_err());
+        assert!(encode_batch(&[], 1).is_err());
+    }
+
+    #[test]
+    fn test_caps_ack_layout() {
+        let pkt = encode_caps_ack(CAPS);
+        assert_eq!(pkt.len(), 10);
+        assert_eq!(u16::from_le_bytes([pkt[0], pkt[1]]), 0x3801);
+        assert_eq!(u32::from_le_bytes([pkt[6], pkt[7], pkt[8], pkt[9]]), CAP_SAVE_ZSTD);
+    }
+}
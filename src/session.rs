@@ -2,18 +2,20 @@
 //!
 //! This module replaces session.c with memory-safe async Rust implementation.
 
-use std::collections::HashMap;
+use std::collections::{HashMap, VecDeque};
 use std::net::SocketAddr;
-use std::os::unix::io::AsRawFd;
+use std::os::unix::io::{AsRawFd, RawFd};
 use std::sync::{Arc, OnceLock};
-use std::sync::atomic::{AtomicI32, Ordering};
+use std::sync::atomic::{AtomicBool, AtomicI32, AtomicU32, AtomicU8, AtomicUsize, Ordering};
 use std::sync::{Mutex as StdMutex, RwLock};
 use std::time::{Duration, Instant};
-use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::io::AsyncWriteExt;
 use tokio::net::TcpStream;
 use tokio::runtime::Runtime;
 use tokio::sync::Mutex;
 
+use crate::network::buffer_pool;
+
 /// Buffer size constants
 pub const RFIFO_SIZE: usize = 16 * 1024;
 pub const WFIFO_SIZE: usize = 16 * 1024;
@@ -29,6 +31,16 @@ const MAX_RDATA_SIZE: usize = 64 * 1024;
 /// Maximum number of sessions
 pub const MAX_SESSIONS: usize = 1024;
 
+/// Most bytes pulled from the socket per read event.
+const READ_CHUNK: usize = 4096;
+
+/// A session whose buffers have been empty and untouched this long hands
+/// them back to the buffer pool; they are re-taken on the next read/write.
+const IDLE_TRIM_AFTER: Duration = Duration::from_secs(30);
+
+/// Sessions' worth of rdata/wdata buffers allocated up front at server start.
+const PREWARM_SESSIONS: usize = 64;
+
 /// Maximum write buffer size (4MB).
 ///
 /// Must accommodate inter-server packets that compress struct mmo_charstatus
@@ -38,6 +50,53 @@ pub const MAX_SESSIONS: usize = 1024;
 /// the original behaviour while providing a reasonable upper bound.
 const MAX_WDATA_SIZE: usize = 4 * 1024 * 1024;
 
+/// Number of span slots. Session fds are allocated in 1..=MAX_SESSIONS.
+pub const SESSION_SPAN_SLOTS: usize = MAX_SESSIONS + 1;
+
+/// Pinned view of one session's FIFO buffers.
+///
+/// The RFIFO and WFIFO macros in session.h index straight into these pointers
+/// instead of taking the session lock for every byte. A side is only valid
+/// while pinned; unpinned sides are NULL and the macros fall back to the
+/// locked rust_session_rdata_ptr / rust_session_wdata_ptr path.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct SessionSpan {
+    /// rdata + rdata_pos, or NULL when the read side is not pinned
+    pub rdata: *const u8,
+    /// Unread bytes available at `rdata`
+    pub rlen: usize,
+    /// wdata + wdata_size, or NULL when the write side is not pinned
+    pub wdata: *mut u8,
+    /// Bytes writable at `wdata` before the buffer has to grow
+    pub wlen: usize,
+}
+
+impl SessionSpan {
+    pub const EMPTY: SessionSpan = SessionSpan {
+        rdata: std::ptr::null(),
+        rlen: 0,
+        wdata: std::ptr::null_mut(),
+        wlen: 0,
+    };
+}
+
+/// Span table indexed by fd, read directly by C (declared in yuri.h).
+///
+/// Only written by Session methods while the session lock is held, so every
+/// update is ordered with the buffer mutation it describes.
+#[no_mangle]
+pub static mut rust_session_spans: [SessionSpan; SESSION_SPAN_SLOTS] =
+    [SessionSpan::EMPTY; SESSION_SPAN_SLOTS];
+
+/// Reset the span slot for a session that is going away.
+fn clear_session_span(fd: i32) {
+    let slot = fd as usize;
+    if fd >= 0 && slot < SESSION_SPAN_SLOTS {
+        unsafe { std::ptr::addr_of_mut!(rust_session_spans[slot]).write(SessionSpan::EMPTY) };
+    }
+}
+
 /// Error types for session operations
 #[derive(Debug, thiserror::Error)]
 pub enum SessionError {
@@ -94,12 +153,52 @@ pub struct SessionCallbacks {
     pub shutdown: Option<unsafe extern "C" fn(i32) -> i32>,
 }
 
+/// One fd's entry in the session slab.
+///
+/// Slots are allocated once with the manager and reused for the life of the
+/// process; only the occupant changes. `eof` and `increment` live here rather
+/// than on `Session` so the hot paths (C's per-packet eof check, the packet
+/// sequence counter) never touch the session mutex.
+struct SessionSlot {
+    /// Bumped every time a session is inserted into this slot. A (fd,
+    /// generation) pair captured earlier no longer matches once the fd has
+    /// been closed and handed to a new connection.
+    generation: AtomicU32,
+    /// Set while the slot holds a session; checked before taking `session`.
+    live: AtomicBool,
+    /// Connection state (0=ok, 1=eof, 2=write error, 3=read error, 4=peer closed)
+    eof: AtomicI32,
+    /// Packet increment counter
+    increment: AtomicU8,
+    /// Occupant. Per-slot lock, so a lookup never contends with other fds and
+    /// is only ever write-locked on insert/remove.
+    session: RwLock<Option<Arc<Mutex<Session>>>>,
+}
+
+impl SessionSlot {
+    fn new() -> Self {
+        Self {
+            generation: AtomicU32::new(0),
+            live: AtomicBool::new(false),
+            eof: AtomicI32::new(0),
+            increment: AtomicU8::new(0),
+            session: RwLock::new(None),
+        }
+    }
+}
+
 /// Global session manager (thread-safe, sync-accessible from C callbacks)
 pub struct SessionManager {
-    /// Active sessions: std::sync::RwLock so FFI can access without block_on
-    sessions: RwLock<HashMap<i32, Arc<Mutex<Session>>>>,
-    /// Next fd counter: atomic so FFI can allocate without block_on
+    /// Session slab indexed directly by fd (0..SESSION_SPAN_SLOTS)
+    slots: Box<[SessionSlot]>,
+    /// Number of live slots
+    live_count: AtomicUsize,
+    /// Next never-used fd: atomic so FFI can allocate without block_on
     next_fd: AtomicI32,
+    /// Closed fds waiting for reuse, oldest first. Handing out the fd that
+    /// has been closed longest keeps stale C references away from fresh
+    /// sessions for as long as possible.
+    free_fds: StdMutex<VecDeque<i32>>,
     /// Default callbacks for new sessions: std::sync::Mutex
     pub default_callbacks: StdMutex<SessionCallbacks>,
     /// Pending listening sockets (std::net, converted to tokio at server start)
@@ -111,41 +210,167 @@ pub struct SessionManager {
 impl SessionManager {
     pub fn new() -> Self {
         Self {
-            sessions: RwLock::new(HashMap::new()),
+            slots: (0..SESSION_SPAN_SLOTS).map(|_| SessionSlot::new()).collect(),
+            live_count: AtomicUsize::new(0),
             next_fd: AtomicI32::new(1), // 0 reserved
+            free_fds: StdMutex::new(VecDeque::new()),
             default_callbacks: StdMutex::new(SessionCallbacks::default()),
             listeners: StdMutex::new(HashMap::new()),
             listen_fds: StdMutex::new(Vec::new()),
         }
     }
 
+    /// Slot for `fd`, whether or not it is occupied.
+    #[inline]
+    fn slot(&self, fd: i32) -> Option<&SessionSlot> {
+        if fd < 0 {
+            return None;
+        }
+        self.slots.get(fd as usize)
+    }
+
+    /// Slot for `fd` if it currently holds a session.
+    #[inline]
+    fn live_slot(&self, fd: i32) -> Option<&SessionSlot> {
+        self.slot(fd).filter(|slot| slot.live.load(Ordering::Acquire))
+    }
+
     /// Allocate a new file descriptor (sync)
+    ///
+    /// Fresh fds are handed out first; once 1..=MAX_SESSIONS have all been
+    /// used, closed fds are recycled.
     pub fn allocate_fd(&self) -> Result<i32, SessionError> {
-        let fd = self.next_fd.fetch_add(1, Ordering::Relaxed);
-        if fd > MAX_SESSIONS as i32 {
-            return Err(SessionError::MaxSessionsExceeded);
+        let fd = self.next_fd.load(Ordering::Relaxed);
+        if fd <= MAX_SESSIONS as i32 {
+            let fd = self.next_fd.fetch_add(1, Ordering::Relaxed);
+            if fd <= MAX_SESSIONS as i32 {
+                return Ok(fd);
+            }
         }
-        Ok(fd)
+        self.free_fds
+            .lock()
+            .unwrap()
+            .pop_front()
+            .ok_or(SessionError::MaxSessionsExceeded)
     }
 
     /// Insert a session (sync)
     pub fn insert_session(&self, fd: i32, session: Arc<Mutex<Session>>) -> Result<(), SessionError> {
-        let mut sessions = self.sessions.write().unwrap();
-        if sessions.len() >= MAX_SESSIONS {
-            return Err(SessionError::MaxSessionsExceeded);
+        let slot = self.slot(fd).ok_or(SessionError::MaxSessionsExceeded)?;
+        let mut occupant = slot.session.write().unwrap();
+        if occupant.is_none() {
+            if self.live_count.load(Ordering::Relaxed) >= MAX_SESSIONS {
+                return Err(SessionError::MaxSessionsExceeded);
+            }
+            self.live_count.fetch_add(1, Ordering::Relaxed);
         }
-        sessions.insert(fd, session);
+        *occupant = Some(session);
+        slot.eof.store(0, Ordering::Relaxed);
+        slot.increment.store(0, Ordering::Relaxed);
+        slot.generation.fetch_add(1, Ordering::Relaxed);
+        slot.live.store(true, Ordering::Release);
         Ok(())
     }
 
     /// Get a session by fd (sync)
+    ///
+    /// Clones the Arc; for a one-off access from FFI prefer `with_session`,
+    /// which borrows it in place.
     pub fn get_session(&self, fd: i32) -> Option<Arc<Mutex<Session>>> {
-        self.sessions.read().unwrap().get(&fd).cloned()
+        let slot = self.live_slot(fd)?;
+        slot.session.read().unwrap().clone()
+    }
+
+    /// Run `f` on the session handle for `fd` without bumping its refcount.
+    /// `f` must not insert or remove sessions.
+    #[inline]
+    pub fn with_session<R>(&self, fd: i32, f: impl FnOnce(&Arc<Mutex<Session>>) -> R) -> Option<R> {
+        let slot = self.live_slot(fd)?;
+        let occupant = slot.session.read().unwrap();
+        occupant.as_ref().map(f)
+    }
+
+    /// Whether `fd` currently holds a session
+    #[inline]
+    pub fn exists(&self, fd: i32) -> bool {
+        self.live_slot(fd).is_some()
+    }
+
+    /// Generation of the session currently in `fd`
+    #[inline]
+    pub fn generation(&self, fd: i32) -> Option<u32> {
+        self.live_slot(fd).map(|slot| slot.generation.load(Ordering::Relaxed))
+    }
+
+    /// Whether `fd` still holds the session that had `generation`
+    #[inline]
+    pub fn is_current(&self, fd: i32, generation: u32) -> bool {
+        self.generation(fd) == Some(generation)
+    }
+
+    /// Connection state of `fd`, or -1 if there is no session
+    #[inline]
+    pub fn eof(&self, fd: i32) -> i32 {
+        self.live_slot(fd).map_or(-1, |slot| slot.eof.load(Ordering::Acquire))
+    }
+
+    /// Set the connection state of `fd`. Returns false if there is no session.
+    #[inline]
+    pub fn set_eof(&self, fd: i32, eof: i32) -> bool {
+        match self.live_slot(fd) {
+            Some(slot) => {
+                slot.eof.store(eof, Ordering::Release);
+                true
+            }
+            None => false,
+        }
+    }
+
+    /// Packet increment counter of `fd` (0 if there is no session)
+    #[inline]
+    pub fn increment(&self, fd: i32) -> u8 {
+        self.live_slot(fd).map_or(0, |slot| slot.increment.load(Ordering::Relaxed))
+    }
+
+    /// Continue the packet increment counter of `fd` from `value` (a session
+    /// inherited from another process).
+    pub fn set_increment(&self, fd: i32, value: u8) {
+        if let Some(slot) = self.live_slot(fd) {
+            slot.increment.store(value, Ordering::Relaxed);
+        }
+    }
+
+    /// Bump the packet increment counter of `fd` and return the new value
+    #[inline]
+    pub fn next_increment(&self, fd: i32) -> u8 {
+        self.live_slot(fd).map_or(0, |slot| {
+            slot.increment.fetch_add(1, Ordering::Relaxed).wrapping_add(1)
+        })
     }
 
     /// Remove a session (sync)
     pub fn remove_session(&self, fd: i32) {
-        self.sessions.write().unwrap().remove(&fd);
+        let Some(slot) = self.slot(fd) else { return };
+        let removed = {
+            let mut occupant = slot.session.write().unwrap();
+            slot.live.store(false, Ordering::Release);
+            occupant.take()
+        };
+        if removed.is_some() {
+            self.live_count.fetch_sub(1, Ordering::Relaxed);
+            if fd > 0 {
+                self.free_fds.lock().unwrap().push_back(fd);
+            }
+        }
+        clear_session_span(fd);
+    }
+
+    /// Remove the session in `fd` only if it is still the one that had
+    /// `generation`.
+    pub fn remove_session_if_current(&self, fd: i32, generation: u32) {
+        if self.is_current(fd, generation) {
+            self.remove_session(fd);
+        }
     }
 
     /// Get default callbacks (sync)
@@ -160,12 +385,24 @@ impl SessionManager {
 
     /// Get session count (sync)
     pub fn session_count(&self) -> usize {
-        self.sessions.read().unwrap().len()
+        self.live_count.load(Ordering::Relaxed)
     }
 
     /// Get snapshot of all active session fds (sync)
     pub fn get_all_fds(&self) -> Vec<i32> {
-        self.sessions.read().unwrap().keys().copied().collect()
+        (0..self.slots.len() as i32).filter(|&fd| self.exists(fd)).collect()
+    }
+
+    /// Bytes of rdata/wdata capacity held by open sessions. Sessions that
+    /// are locked right now are skipped rather than waited on.
+    pub fn buffer_bytes(&self) -> usize {
+        self.get_all_fds()
+            .into_iter()
+            .filter_map(|fd| {
+                self.with_session(fd, |arc| arc.try_lock().ok().map(|s| s.rdata.capacity() + s.wdata.capacity()))
+                    .flatten()
+            })
+            .sum()
     }
 
     /// Register a listener socket (sync, called before server starts)
@@ -198,21 +435,147 @@ pub fn get_session_manager() -> &'static SessionManager {
 /// Timer callbacks run synchronously inside the Tokio select! arm, so they cannot
 /// use block_on or spawn_local directly. Instead they push fds here and
 /// run_async_server drains this queue after each timer_do() call.
-pub static PENDING_CONNECTIONS: OnceLock<StdMutex<Vec<i32>>> = OnceLock::new();
+///
+/// Entries carry the session generation so a connection that was closed (and
+/// its fd reused) before the queue drained is dropped instead of getting a
+/// second I/O task.
+pub static PENDING_CONNECTIONS: OnceLock<StdMutex<Vec<(i32, u32)>>> = OnceLock::new();
 
 pub fn push_pending_connection(fd: i32) {
+    let Some(generation) = get_session_manager().generation(fd) else { return };
     PENDING_CONNECTIONS
         .get_or_init(|| StdMutex::new(Vec::new()))
         .lock()
         .unwrap()
-        .push(fd);
+        .push((fd, generation));
 }
 
 fn drain_pending_connections() -> Vec<i32> {
-    PENDING_CONNECTIONS
+    let pending = PENDING_CONNECTIONS
         .get()
         .map(|m| std::mem::take(&mut *m.lock().unwrap()))
-        .unwrap_or_default()
+        .unwrap_or_default();
+    let manager = get_session_manager();
+    pending
+        .into_iter()
+        .filter(|&(fd, generation)| manager.is_current(fd, generation))
+        .map(|(fd, _)| fd)
+        .collect()
+}
+
+/// Socket write tuning, set once from ServerConfig before run_async_server.
+#[derive(Debug, Clone, Copy)]
+pub struct WriteConfig {
+    /// Defer flushes from commit_write to the end of the tick / flush interval
+    pub coalesce: bool,
+    /// Longest a coalesced write may wait before it is flushed
+    pub flush_latency: Duration,
+    /// Set TCP_NODELAY on accepted sockets
+    pub tcp_nodelay: bool,
+    /// Keep accepted sockets corked, uncorking once per flush (Linux only)
+    pub tcp_cork: bool,
+}
+
+impl Default for WriteConfig {
+    fn default() -> Self {
+        Self {
+            coalesce: false,
+            flush_latency: Duration::from_millis(10),
+            tcp_nodelay: false,
+            tcp_cork: false,
+        }
+    }
+}
+
+static WRITE_CONFIG: OnceLock<WriteConfig> = OnceLock::new();
+
+/// Mirror of WRITE_CONFIG.coalesce, read on every commit_write.
+static WRITE_COALESCE: AtomicBool = AtomicBool::new(false);
+
+/// Install the write tuning. Only the first call takes effect.
+pub fn set_write_config(config: WriteConfig) {
+    if WRITE_CONFIG.set(config).is_ok() {
+        WRITE_COALESCE.store(config.coalesce, Ordering::Relaxed);
+    }
+}
+
+fn write_config() -> WriteConfig {
+    WRITE_CONFIG.get().copied().unwrap_or_default()
+}
+
+/// Runs before every flush_queued_writes pass from the server loop, so a
+/// server can write out packets it holds back within a tick.
+static BEFORE_FLUSH: OnceLock<fn()> = OnceLock::new();
+
+/// Install the pre-flush hook. Only the first call takes effect.
+pub fn set_before_flush(f: fn()) {
+    let _ = BEFORE_FLUSH.set(f);
+}
+
+pub(crate) fn run_before_flush() {
+    if let Some(f) = BEFORE_FLUSH.get() {
+        f();
+    }
+}
+
+/// Runs before a packet is started on a session's write buffer, so a server
+/// can write out packets for that fd it holds back ahead of the new one.
+static BEFORE_WRITE: OnceLock<fn(i32)> = OnceLock::new();
+
+/// Install the pre-write hook. Only the first call takes effect.
+pub fn set_before_write(f: fn(i32)) {
+    let _ = BEFORE_WRITE.set(f);
+}
+
+pub(crate) fn run_before_write(fd: i32) {
+    if let Some(f) = BEFORE_WRITE.get() {
+        f(fd);
+    }
+}
+
+/// Runs at the start of every timer tick, before timer_do, so a server can
+/// apply work queued from other threads at a safe point.
+static BEFORE_TICK: OnceLock<fn()> = OnceLock::new();
+
+/// Install the start-of-tick hook. Only the first call takes effect.
+pub fn set_before_tick(f: fn()) {
+    let _ = BEFORE_TICK.set(f);
+}
+
+pub(crate) fn run_before_tick() {
+    if let Some(f) = BEFORE_TICK.get() {
+        f();
+    }
+}
+
+/// Runs at the end of every timer tick with the time left before the next
+/// one, so a server can do deferrable work while the loop would be idle.
+static AFTER_TICK: OnceLock<fn(Duration)> = OnceLock::new();
+
+/// Install the end-of-tick hook. Only the first call takes effect.
+pub fn set_after_tick(f: fn(Duration)) {
+    let _ = AFTER_TICK.set(f);
+}
+
+fn run_after_tick(idle: Duration) {
+    if let Some(f) = AFTER_TICK.get() {
+        f(idle);
+    }
+}
+
+/// Sessions with committed-but-unflushed writes in coalescing mode.
+/// Each session appears at most once (see Session::flush_queued); the
+/// server loop wakes them all in one pass via flush_queued_writes.
+static FLUSH_QUEUE: StdMutex<Vec<Arc<tokio::sync::Notify>>> = StdMutex::new(Vec::new());
+
+/// Wake every session queued by commit_write since the last call.
+/// Returns the number of sessions woken.
+pub fn flush_queued_writes() -> usize {
+    let queued = std::mem::take(&mut *FLUSH_QUEUE.lock().unwrap());
+    for notify in &queued {
+        notify.notify_one();
+    }
+    queued.len()
 }
 
 /// Set up a new session from an established TCP connection (sync).
@@ -229,8 +592,10 @@ pub fn setup_connection(
         std::net::IpAddr::V4(ipv4) => u32::from(ipv4).to_be(),
         _ => 0,
     };
+    session.socket_fd = stream.as_raw_fd();
     session.socket = Some(Arc::new(Mutex::new(stream)));
     session.callbacks = manager.get_default_callbacks();
+    session.corked = write_config().tcp_cork;
 
     let session_arc = Arc::new(Mutex::new(session));
     manager.insert_session(fd, session_arc)?;
@@ -241,6 +606,86 @@ pub fn setup_connection(
     Ok(fd)
 }
 
+/// Set up a session for a client connection inherited from another process
+/// (`map_server --takeover`). The packet counter continues from `increment`,
+/// `rdata` is input the old process had not parsed yet and `wdata` output
+/// it had not sent. The I/O task starts with the next tick.
+pub fn adopt_connection(
+    stream: std::net::TcpStream,
+    increment: u8,
+    rdata: &[u8],
+    wdata: &[u8],
+) -> Result<i32, SessionError> {
+    stream.set_nonblocking(true)?;
+    let addr = stream.peer_addr()?;
+    let stream = TcpStream::from_std(stream)?;
+    apply_socket_opts(&stream);
+    let manager = get_session_manager();
+    let fd = setup_connection(stream, addr, manager)?;
+    manager.set_increment(fd, increment);
+    if let Some(arc) = manager.get_session(fd) {
+        let mut session = arc.try_lock().map_err(|_| SessionError::SessionNotFound(fd))?;
+        session.push_read(rdata);
+        if !wdata.is_empty() {
+            session.write_buf(0, wdata)?;
+            session.commit_write(wdata.len())?;
+        }
+    }
+    push_pending_connection(fd);
+    Ok(fd)
+}
+
+/// Register a listener inherited from another process; its accept loop
+/// starts with run_async_server, like one from rust_make_listen_port.
+pub fn adopt_listener(listener: std::net::TcpListener) -> Result<i32, SessionError> {
+    let manager = get_session_manager();
+    let fd = manager.allocate_fd()?;
+    manager.add_listener(fd, listener);
+    #[cfg(not(test))]
+    crate::ffi::session::update_fd_max_pub(fd);
+    Ok(fd)
+}
+
+/// The socket of `fd` with its unparsed input and unsent output, for a
+/// handoff. None if the session is busy or not connected.
+pub fn handoff_io(fd: i32) -> Option<(RawFd, Vec<u8>, Vec<u8>)> {
+    let arc = get_session_manager().get_session(fd)?;
+    let session = arc.try_lock().ok()?;
+    if session.socket_fd < 0 {
+        return None;
+    }
+    Some((
+        session.socket_fd,
+        session.rdata[session.rdata_pos..session.rdata_size].to_vec(),
+        session.wdata[..session.wdata_size].to_vec(),
+    ))
+}
+
+/// OS descriptors of the listeners the accept loops own, for a handoff.
+static LISTENING: StdMutex<Vec<RawFd>> = StdMutex::new(Vec::new());
+
+pub fn listening_fds() -> Vec<RawFd> {
+    LISTENING.lock().unwrap().clone()
+}
+
+/// Set when the sessions are to be handed to another process. Shutdown then
+/// leaves them as they are instead of running their shutdown callbacks,
+/// which would log the players out.
+static HANDED_OFF: AtomicBool = AtomicBool::new(false);
+
+pub fn set_handed_off() {
+    HANDED_OFF.store(true, Ordering::SeqCst);
+}
+
+pub fn handed_off() -> bool {
+    HANDED_OFF.load(Ordering::SeqCst)
+}
+
+/// The handoff was aborted: the sessions stay with this process.
+pub fn clear_handed_off() {
+    HANDED_OFF.store(false, Ordering::SeqCst);
+}
+
 /// Global Tokio runtime
 pub static RUNTIME: OnceLock<Runtime> = OnceLock::new();
 
@@ -262,6 +707,11 @@ pub struct Session {
     /// TCP socket (Tokio async)
     pub socket: Option<Arc<Mutex<TcpStream>>>,
 
+    /// OS descriptor of `socket`, or -1. The I/O task holds the socket lock
+    /// while it waits for input, so this is how the rest of the process
+    /// names the socket.
+    pub socket_fd: RawFd,
+
     /// Client address
     pub client_addr: Option<SocketAddr>,
 
@@ -282,12 +732,6 @@ pub struct Session {
     pub wdata: Vec<u8>,
     pub wdata_size: usize,
 
-    /// Connection state (0=ok, 1=eof, 2=write error, 3=read error, etc.)
-    pub eof: i32,
-
-    /// Packet increment counter
-    pub increment: u8,
-
     /// Last activity timestamp
     pub last_activity: Instant,
 
@@ -319,6 +763,22 @@ pub struct Session {
     /// The caller is responsible for calling write_notify.notify_one() once
     /// after all writes are complete.
     pub suppress_notify: bool,
+
+    /// In FLUSH_QUEUE waiting for the next coalesced flush.
+    /// Cleared by flush_wdata_to_socket when it takes the buffer.
+    flush_queued: bool,
+
+    /// Socket was corked by apply_socket_opts; flushes uncork it to push.
+    corked: bool,
+
+    /// wdata was reserved or committed since the last idle trim pass.
+    wdata_touched: bool,
+
+    /// Read side is published in rust_session_spans (see pin_read).
+    read_pinned: bool,
+
+    /// Write side is published in rust_session_spans (see pin_write).
+    write_pinned: bool,
 }
 
 impl Session {
@@ -327,25 +787,99 @@ impl Session {
         Self {
             fd,
             socket: None,
+            socket_fd: -1,
             client_addr: None,
             client_addr_raw: 0,
             connect_addr: None,
             write_notify: Arc::new(tokio::sync::Notify::new()),
-            rdata: Vec::with_capacity(RFIFO_SIZE),
+            rdata: buffer_pool::pool().take(RFIFO_SIZE),
             rdata_pos: 0,
             rdata_size: 0,
-            wdata: Vec::with_capacity(WFIFO_SIZE),
+            wdata: buffer_pool::pool().take(WFIFO_SIZE),
             wdata_size: 0,
-            eof: 0,
-            increment: 0,
             last_activity: Instant::now(),
             session_data: None,
             callbacks: SessionCallbacks::default(),
             shutdown_called: false,
             suppress_notify: false,
+            flush_queued: false,
+            corked: false,
+            wdata_touched: false,
+            read_pinned: false,
+            write_pinned: false,
+        }
+    }
+
+    /// Write the current span for this session into rust_session_spans.
+    fn publish_span(&mut self) {
+        let slot = self.fd as usize;
+        if self.fd < 0 || slot >= SESSION_SPAN_SLOTS {
+            return;
+        }
+        let mut span = SessionSpan::EMPTY;
+        if self.read_pinned {
+            span.rdata = self.rdata.as_ptr().wrapping_add(self.rdata_pos);
+            span.rlen = self.rdata_size - self.rdata_pos;
+        }
+        if self.write_pinned {
+            span.wdata = self.wdata.as_mut_ptr().wrapping_add(self.wdata_size);
+            span.wlen = self.wdata.len().saturating_sub(self.wdata_size);
+        }
+        unsafe { std::ptr::addr_of_mut!(rust_session_spans[slot]).write(span) };
+    }
+
+    /// Republish the span after a buffer moved or changed size.
+    /// Cheap no-op for sessions that have never been pinned.
+    #[inline]
+    pub fn sync_span(&mut self) {
+        if self.read_pinned || self.write_pinned {
+            self.publish_span();
         }
     }
 
+    /// Pin the read buffer so RFIFO* macros can index it without the lock.
+    /// Returns the unread region (rdata + rdata_pos, available()).
+    pub fn pin_read(&mut self) -> (*const u8, usize) {
+        self.read_pinned = true;
+        self.publish_span();
+        (self.rdata.as_ptr().wrapping_add(self.rdata_pos), self.available())
+    }
+
+    /// Unpin the read buffer; RFIFO* falls back to the locked path.
+    pub fn unpin_read(&mut self) {
+        if self.read_pinned {
+            self.read_pinned = false;
+            self.publish_span();
+        }
+    }
+
+    /// Reserve `size` bytes and pin the write buffer so WFIFO* macros can
+    /// index it without the lock. Returns the writable region at wdata_size.
+    pub fn pin_write(&mut self, size: usize) -> Result<(*mut u8, usize), SessionError> {
+        self.ensure_wdata_capacity(size)?;
+        self.write_pinned = true;
+        self.publish_span();
+        let len = self.wdata.len() - self.wdata_size;
+        Ok((self.wdata.as_mut_ptr().wrapping_add(self.wdata_size), len))
+    }
+
+    /// Unpin the write buffer; WFIFO* falls back to the locked path.
+    pub fn unpin_write(&mut self) {
+        if self.write_pinned {
+            self.write_pinned = false;
+            self.publish_span();
+        }
+    }
+
+    /// Finish a packet started with pin_write: commit `len` bytes (0 =
+    /// nothing) and release the pin, also when the commit fails. A pin left
+    /// behind would keep wdata out of the idle trim for good.
+    pub fn end_write(&mut self, len: usize) -> Result<(), SessionError> {
+        let ret = if len > 0 { self.commit_write(len) } else { Ok(()) };
+        self.unpin_write();
+        ret
+    }
+
     /// Read u8 with bounds checking
     pub fn read_u8(&self, pos: usize) -> Result<u8, SessionError> {
         let actual_pos = self.rdata_pos.checked_add(pos).ok_or(SessionError::ReadOutOfBounds {
@@ -445,7 +979,8 @@ impl Session {
 
         // Auto-grow in 1KB chunks, clamped to MAX_WDATA_SIZE
         if end > self.wdata.len() {
-            self.wdata.resize(end.saturating_add(1024).min(MAX_WDATA_SIZE), 0);
+            self.grow_wdata(end.saturating_add(1024).min(MAX_WDATA_SIZE));
+            self.sync_span();
         }
 
         self.wdata[actual_pos] = val;
@@ -473,7 +1008,8 @@ impl Session {
         }
 
         if end > self.wdata.len() {
-            self.wdata.resize(end.saturating_add(1024).min(MAX_WDATA_SIZE), 0);
+            self.grow_wdata(end.saturating_add(1024).min(MAX_WDATA_SIZE));
+            self.sync_span();
         }
 
         let bytes = val.to_le_bytes();
@@ -503,7 +1039,8 @@ impl Session {
         }
 
         if end > self.wdata.len() {
-            self.wdata.resize(end.saturating_add(1024).min(MAX_WDATA_SIZE), 0);
+            self.grow_wdata(end.saturating_add(1024).min(MAX_WDATA_SIZE));
+            self.sync_span();
         }
 
         let bytes = val.to_le_bytes();
@@ -540,18 +1077,33 @@ impl Session {
         }
 
         self.wdata_size = new_size;
+        self.wdata_touched = true;
+        self.sync_span();
         // Wake session_io_task so it flushes immediately rather than waiting for
         // the next read event. This is critical when a C parse callback writes
         // to a *different* session's buffer (e.g. login server writing to char_fd
         // while handling a client packet).
         // Skip notification when suppress_notify is set — the caller will
         // batch-notify after all writes are done.
+        // In coalescing mode the wake is deferred to flush_queued_writes, so
+        // every packet committed this tick leaves in a single write.
         if !self.suppress_notify {
-            self.write_notify.notify_one();
+            self.wake_writer(WRITE_COALESCE.load(Ordering::Relaxed), &FLUSH_QUEUE);
         }
         Ok(())
     }
 
+    /// Wake session_io_task now, or with `coalesce` put this session on
+    /// `queue` (once) for the next flush_queued_writes.
+    fn wake_writer(&mut self, coalesce: bool, queue: &StdMutex<Vec<Arc<tokio::sync::Notify>>>) {
+        if !coalesce {
+            self.write_notify.notify_one();
+        } else if !self.flush_queued {
+            self.flush_queued = true;
+            queue.lock().unwrap().push(self.write_notify.clone());
+        }
+    }
+
     /// Skip N bytes in read buffer (like RFIFOSKIP)
     pub fn skip(&mut self, len: usize) -> Result<(), SessionError> {
         let new_pos = self.rdata_pos.saturating_add(len);
@@ -573,6 +1125,7 @@ impl Session {
             self.rdata.clear();
         }
 
+        self.sync_span();
         Ok(())
     }
 
@@ -625,7 +1178,8 @@ impl Session {
 
         // Ensure buffer is large enough, clamped to MAX_WDATA_SIZE
         if end > self.wdata.len() {
-            self.wdata.resize(end.saturating_add(1024).min(MAX_WDATA_SIZE), 0);
+            self.grow_wdata(end.saturating_add(1024).min(MAX_WDATA_SIZE));
+            self.sync_span();
         }
 
         Ok(self.wdata.as_mut_ptr().wrapping_add(actual_pos))
@@ -650,13 +1204,91 @@ impl Session {
             });
         }
 
+        self.wdata_touched = true;
         if needed > self.wdata.len() {
-            self.wdata.resize(needed.saturating_add(1024).min(MAX_WDATA_SIZE), 0);
+            self.grow_wdata(needed.saturating_add(1024).min(MAX_WDATA_SIZE));
+            self.sync_span();
         }
 
         Ok(())
     }
 
+    /// Resize wdata to `len`, first taking a pooled buffer if it was trimmed.
+    fn grow_wdata(&mut self, len: usize) {
+        if self.wdata.capacity() == 0 {
+            self.wdata = buffer_pool::pool().take(len.max(WFIFO_SIZE));
+        }
+        self.wdata.resize(len, 0);
+    }
+
+    /// Read up to `max` bytes straight from `socket` onto the end of rdata.
+    ///
+    /// Non-blocking: call after the socket reported readable; a spurious
+    /// wake-up returns WouldBlock. Ok(0) means the peer closed.
+    pub fn read_from(&mut self, socket: &TcpStream, max: usize) -> std::io::Result<usize> {
+        use bytes::BufMut;
+        if self.rdata.capacity() == 0 {
+            self.rdata = buffer_pool::pool().take(RFIFO_SIZE);
+        }
+        self.rdata.reserve(max);
+        let n = socket.try_read_buf(&mut (&mut self.rdata).limit(max))?;
+        self.rdata_size += n;
+        Ok(n)
+    }
+
+    /// Append `bytes` to rdata as if they had just been read (packet replay).
+    pub fn push_read(&mut self, bytes: &[u8]) {
+        if self.rdata.capacity() == 0 {
+            self.rdata = buffer_pool::pool().take(RFIFO_SIZE);
+        }
+        self.rdata.extend_from_slice(bytes);
+        self.rdata_size += bytes.len();
+        self.last_activity = Instant::now();
+        self.sync_span();
+    }
+
+    /// Drop everything committed to wdata, as a flush would, without a
+    /// socket to send it to (packet replay). Returns the bytes dropped.
+    pub fn discard_wdata(&mut self) -> usize {
+        let n = self.wdata_size;
+        if n > 0 {
+            self.wdata[..n].fill(0);
+            self.wdata_size = 0;
+            self.sync_span();
+        }
+        self.flush_queued = false;
+        n
+    }
+
+    /// The shutdown callback, the first time only.
+    pub(crate) fn claim_shutdown(&mut self) -> Option<unsafe extern "C" fn(i32) -> i32> {
+        if self.shutdown_called {
+            return None;
+        }
+        self.shutdown_called = true;
+        self.callbacks.shutdown
+    }
+
+    /// Give empty buffers back to the pool if they have been idle for `quiet`.
+    /// Returns true if anything was released.
+    pub fn trim_idle_buffers(&mut self, quiet: Duration) -> bool {
+        let mut trimmed = false;
+        if !self.read_pinned
+            && self.rdata_size == 0
+            && self.rdata.capacity() > 0
+            && self.last_activity.elapsed() >= quiet
+        {
+            buffer_pool::pool().give(std::mem::take(&mut self.rdata));
+            trimmed = true;
+        }
+        if !self.write_pinned && !self.wdata_touched && self.wdata_size == 0 && self.wdata.capacity() > 0 {
+            buffer_pool::pool().give(std::mem::take(&mut self.wdata));
+            trimmed = true;
+        }
+        self.wdata_touched = false;
+        trimmed
+    }
+
     /// Copy data from read buffer into a destination buffer (safe RFIFOP + memcpy)
     pub fn read_buf(&self, pos: usize, dst: &mut [u8]) -> Result<(), SessionError> {
         let actual_pos = self.rdata_pos.checked_add(pos).ok_or(SessionError::ReadOutOfBounds {
@@ -704,7 +1336,8 @@ impl Session {
         }
 
         if end > self.wdata.len() {
-            self.wdata.resize(end.saturating_add(1024).min(MAX_WDATA_SIZE), 0);
+            self.grow_wdata(end.saturating_add(1024).min(MAX_WDATA_SIZE));
+            self.sync_span();
         }
 
         self.wdata[actual_pos..end].copy_from_slice(src);
@@ -723,6 +1356,7 @@ impl Session {
             self.rdata_pos = 0;
             self.rdata.truncate(self.rdata_size);
         }
+        self.sync_span();
     }
 }
 
@@ -733,6 +1367,35 @@ impl Session {
 unsafe impl Send for Session {}
 unsafe impl Sync for Session {}
 
+impl Drop for Session {
+    fn drop(&mut self) {
+        let pool = buffer_pool::pool();
+        pool.give(std::mem::take(&mut self.rdata));
+        pool.give(std::mem::take(&mut self.wdata));
+    }
+}
+
+/// Hand idle sessions' buffers back to the pool (runs every IDLE_TRIM_AFTER).
+fn trim_idle_sessions(manager: &SessionManager) {
+    let mut trimmed = 0;
+    for fd in manager.get_all_fds() {
+        // try_lock only: a session that is busy right now is not idle
+        let released = manager
+            .with_session(fd, |arc| arc.try_lock().is_ok_and(|mut s| s.trim_idle_buffers(IDLE_TRIM_AFTER)))
+            .unwrap_or(false);
+        if released {
+            trimmed += 1;
+        }
+    }
+    if trimmed > 0 {
+        tracing::debug!(
+            "[session] trimmed buffers of {} idle sessions, pool {:?}",
+            trimmed,
+            buffer_pool::pool().stats()
+        );
+    }
+}
+
 /// Run the async game server.
 ///
 /// Replaces the C main loop in core.c:
@@ -746,9 +1409,16 @@ pub async fn run_async_server(_port: u16) -> Result<(), Box<dyn std::error::Erro
 
     let manager = get_session_manager();
 
-    // Register the DDoS history cleanup timer (1s interval, matching C's do_socket).
+    // Pre-warm rdata + wdata buffers so the first wave of logins skips malloc
+    buffer_pool::pool().prewarm(RFIFO_SIZE.max(WFIFO_SIZE), PREWARM_SESSIONS * 2);
+
+    // Register the DDoS history cleanup timer (1s interval, matching C's do_socket)
+    // and the throttle reset timer (10 min interval, matching login_server.c).
+    // Once only: the loop runs again after an aborted handoff.
     #[cfg(not(test))]
-    unsafe {
+    static TIMERS: std::sync::Once = std::sync::Once::new();
+    #[cfg(not(test))]
+    TIMERS.call_once(|| unsafe {
         crate::ffi::timer::timer_insert(
             1000,
             1000,
@@ -756,11 +1426,6 @@ pub async fn run_async_server(_port: u16) -> Result<(), Box<dyn std::error::Erro
             0,
             0,
         );
-    }
-
-    // Register throttle reset timer (10 min interval, matching login_server.c).
-    #[cfg(not(test))]
-    unsafe {
         crate::ffi::timer::timer_insert(
             10 * 60 * 1000,
             10 * 60 * 1000,
@@ -768,7 +1433,7 @@ pub async fn run_async_server(_port: u16) -> Result<(), Box<dyn std::error::Erro
             0,
             0,
         );
-    }
+    });
 
     // Take all registered std::net listeners, convert to tokio, spawn accept tasks
     let listen_fds = manager.listen_fds.lock().unwrap().clone();
@@ -777,17 +1442,31 @@ pub async fn run_async_server(_port: u16) -> Result<(), Box<dyn std::error::Erro
         if let Some(std_listener) = manager.take_listener(fd) {
             std_listener.set_nonblocking(true)?;
             let listener = tokio::net::TcpListener::from_std(std_listener)?;
+            LISTENING.lock().unwrap().push(listener.as_raw_fd());
             tracing::info!("[rust_server] Spawning accept loop for listener fd={}", fd);
             tokio::task::spawn_local(accept_loop(listener, fd));
         }
     }
 
     // Timer tick interval (10ms, matching C's SERVER_TICK_RATE_NS)
-    let mut timer_interval = tokio::time::interval(Duration::from_millis(10));
+    let tick_len = Duration::from_millis(10);
+    let mut timer_interval = tokio::time::interval(tick_len);
+
+    // Coalesced writes committed from parse callbacks are flushed here, or at
+    // the end of the next timer tick if that comes first.
+    let write_cfg = write_config();
+    let mut flush_interval = tokio::time::interval(write_cfg.flush_latency);
+    flush_interval.set_missed_tick_behavior(tokio::time::MissedTickBehavior::Delay);
+
+    let mut trim_interval = tokio::time::interval(IDLE_TRIM_AFTER);
+    trim_interval.set_missed_tick_behavior(tokio::time::MissedTickBehavior::Delay);
 
     loop {
         tokio::select! {
             _ = timer_interval.tick() => {
+                let tick_start = Instant::now();
+                run_before_tick();
+
                 // Drive C timer system (synchronous call - no block_on needed)
                 #[cfg(not(test))]
                 unsafe {
@@ -802,6 +1481,13 @@ pub async fn run_async_server(_port: u16) -> Result<(), Box<dyn std::error::Erro
                     tokio::task::spawn_local(session_io_task(fd));
                 }
 
+                // End of tick: one flush per session for everything the timers wrote
+                run_before_flush();
+                flush_queued_writes();
+                let elapsed = tick_start.elapsed();
+                crate::metrics::TICK_SECONDS.observe(elapsed);
+                run_after_tick(tick_len.saturating_sub(elapsed));
+
                 // Check shutdown signal
                 #[cfg(not(test))]
                 if crate::ffi::core::rust_should_shutdown() != 0 {
@@ -809,6 +1495,13 @@ pub async fn run_async_server(_port: u16) -> Result<(), Box<dyn std::error::Erro
                     break;
                 }
             }
+            _ = flush_interval.tick(), if write_cfg.coalesce => {
+                run_before_flush();
+                flush_queued_writes();
+            }
+            _ = trim_interval.tick() => {
+                trim_idle_sessions(manager);
+            }
         }
     }
 
@@ -859,6 +1552,7 @@ async fn accept_loop(listener: tokio::net::TcpListener, _listen_fd: i32) {
 /// - `IPPROTO_TCP / 0`: matches what the C code did (TCP_NODELAY was
 ///   intentionally commented out; the `0` call was kept as-is).
 /// - `SO_LINGER` with `l_onoff=0`: graceful close, no hard timeout.
+/// - `TCP_NODELAY` / `TCP_CORK` when enabled in WriteConfig.
 fn apply_socket_opts(stream: &TcpStream) {
     let fd = stream.as_raw_fd();
     let yes: libc::c_int = 1;
@@ -902,6 +1596,32 @@ fn apply_socket_opts(stream: &TcpStream) {
             tracing::warn!("[accept] Unable to set SO_LINGER for fd={}", fd);
         }
     }
+
+    let write_cfg = write_config();
+    if write_cfg.tcp_nodelay {
+        if let Err(e) = stream.set_nodelay(true) {
+            tracing::warn!("[accept] Unable to set TCP_NODELAY for fd={}: {}", fd, e);
+        }
+    }
+    if write_cfg.tcp_cork {
+        set_tcp_cork(fd, true);
+    }
+}
+
+/// Toggle TCP_CORK. No-op outside Linux.
+#[allow(unused_variables)]
+fn set_tcp_cork(fd: std::os::unix::io::RawFd, on: bool) {
+    #[cfg(target_os = "linux")]
+    unsafe {
+        let val: libc::c_int = on as libc::c_int;
+        libc::setsockopt(
+            fd,
+            libc::IPPROTO_TCP,
+            libc::TCP_CORK,
+            &val as *const _ as *const libc::c_void,
+            std::mem::size_of_val(&val) as libc::socklen_t,
+        );
+    }
 }
 
 /// Set up session from an accepted connection and run its I/O task.
@@ -916,15 +1636,19 @@ async fn session_io_task_from_accept(stream: TcpStream, addr: SocketAddr) {
             return;
         }
     };
+    if crate::capture::enabled() {
+        let ip = match addr.ip() {
+            std::net::IpAddr::V4(ipv4) => u32::from(ipv4).to_be(),
+            _ => 0,
+        };
+        crate::capture::open(fd, ip);
+    }
 
     // Call the accept callback — servers use this to send the initial handshake.
     // The callback may write to the session's write buffer; we flush it below.
-    let accept_cb = {
-        match manager.get_session(fd) {
-            Some(arc) => arc.try_lock().ok().and_then(|s| s.callbacks.accept),
-            None => None,
-        }
-    };
+    let accept_cb = manager
+        .with_session(fd, |arc| arc.try_lock().ok().and_then(|s| s.callbacks.accept))
+        .flatten();
     if let Some(cb) = accept_cb {
         unsafe { cb(fd); }
 
@@ -937,13 +1661,14 @@ async fn session_io_task_from_accept(stream: TcpStream, addr: SocketAddr) {
 
 /// Flush session write buffer to socket immediately (used after accept callback).
 async fn flush_wdata_to_socket(fd: i32, manager: &SessionManager) {
-    let session_arc = match manager.get_session(fd) {
-        Some(a) => a,
-        None => return,
+    let (session_arc, generation) = match (manager.get_session(fd), manager.generation(fd)) {
+        (Some(a), Some(g)) => (a, g),
+        _ => return,
     };
 
-    let (socket_arc, wdata) = {
+    let (socket_arc, wdata, corked) = {
         let mut session = session_arc.lock().await;
+        session.flush_queued = false;
         let socket_arc = match session.socket.as_ref() {
             Some(s) => s.clone(),
             None => return,
@@ -959,18 +1684,28 @@ async fn flush_wdata_to_socket(fd: i32, manager: &SessionManager) {
             // valid even if a flush races with C code writing to the buffer.
             session.wdata[..prev_size].fill(0);
             session.wdata_size = 0;
+            session.sync_span();
             data
         } else {
             return;
         };
-        (socket_arc, wdata)
+        (socket_arc, wdata, session.corked)
     };
 
     let mut socket = socket_arc.lock().await;
-    if let Err(e) = socket.write_all(&wdata).await {
+    let result = socket.write_all(&wdata).await;
+    if corked {
+        // Uncork to push the partial frame out, then cork again for the next batch
+        let raw = socket.as_raw_fd();
+        set_tcp_cork(raw, false);
+        set_tcp_cork(raw, true);
+    }
+    if let Err(e) = result {
         tracing::error!("[session] fd={} flush write error: {}", fd, e);
-        if let Some(arc) = manager.get_session(fd) {
-            arc.lock().await.eof = 2;
+        // The write may have waited; don't flag a session that has since
+        // taken over this fd.
+        if manager.is_current(fd, generation) {
+            manager.set_eof(fd, 2);
         }
     }
 }
@@ -982,9 +1717,9 @@ async fn flush_wdata_to_socket(fd: i32, manager: &SessionManager) {
 /// This task performs the actual connect before entering the I/O loop.
 async fn session_io_task(fd: i32) {
     let manager = get_session_manager();
-    let session_arc = match manager.get_session(fd) {
-        Some(s) => s,
-        None => {
+    let (session_arc, generation) = match (manager.get_session(fd), manager.generation(fd)) {
+        (Some(s), Some(g)) => (s, g),
+        _ => {
             tracing::error!("[session] fd={} not found in manager", fd);
             return;
         }
@@ -999,7 +1734,11 @@ async fn session_io_task(fd: i32) {
     if let Some(addr) = connect_addr {
         match TcpStream::connect(addr).await {
             Ok(stream) => {
-                session_arc.lock().await.socket = Some(Arc::new(Mutex::new(stream)));
+                {
+                    let mut session = session_arc.lock().await;
+                    session.socket_fd = stream.as_raw_fd();
+                    session.socket = Some(Arc::new(Mutex::new(stream)));
+                }
                 tracing::info!("[session] fd={} connected to {}", fd, addr);
                 // Flush any write data queued before the connection was established
                 // (e.g. auth packet written by check_connect_login before connect completes)
@@ -1007,35 +1746,29 @@ async fn session_io_task(fd: i32) {
             }
             Err(e) => {
                 tracing::error!("[session] fd={} connect to {} failed: {}", fd, addr, e);
-                let shutdown_cb = {
-                    let mut session = session_arc.lock().await;
-                    if session.shutdown_called {
-                        None
-                    } else {
-                        session.shutdown_called = true;
-                        session.callbacks.shutdown
-                    }
-                };
+                let shutdown_cb = session_arc.lock().await.claim_shutdown();
                 if let Some(cb) = shutdown_cb {
                     unsafe { cb(fd); }
                 }
-                manager.remove_session(fd);
+                manager.remove_session_if_current(fd, generation);
                 return;
             }
         }
     }
 
-    let mut read_buf = vec![0u8; 4096];
+    // Accepted client connections are recorded when capture is on
+    let captured = connect_addr.is_none() && crate::capture::enabled();
 
-    // Get the write_notify Arc once (it never changes for the lifetime of the session)
-    let write_notify = session_arc.lock().await.write_notify.clone();
+    // The socket and write_notify never change once the connection is up, so
+    // take them once instead of re-locking the session every iteration.
+    let (socket_arc, write_notify) = {
+        let session = session_arc.lock().await;
+        (session.socket.clone(), session.write_notify.clone())
+    };
 
     loop {
-        // Check eof
-        let eof = {
-            let session = session_arc.lock().await;
-            session.eof
-        };
+        // Check eof (atomic in the slab; no session lock)
+        let eof = manager.eof(fd);
         if eof != 0 {
             tracing::info!("[session] fd={} server-initiated eof={}, invoking parse for cleanup", fd, eof);
             // Give C one final parse call so clif_handle_disconnect / clif_closeit
@@ -1051,28 +1784,45 @@ async fn session_io_task(fd: i32) {
             break;
         }
 
-        // Get socket reference
-        let socket_arc = {
-            let session = session_arc.lock().await;
-            match session.socket.as_ref() {
-                Some(s) => s.clone(),
-                None => break,
-            }
-        };
+        let Some(socket_arc) = socket_arc.as_ref() else { break };
 
         // Select on either incoming data OR a write_notify signal.
         // write_notify fires when C code commits data to this session's write
         // buffer from another session's parse callback (e.g. login server
         // writing to char_fd while handling a client packet).
+        //
+        // Reads go straight into rdata once the socket is readable, so an idle
+        // connection parked here holds no read buffer at all.
         enum Event {
             Read(std::io::Result<usize>),
+            Overflow(usize),
             WriteReady,
         }
 
         let event = {
-            let mut socket = socket_arc.lock().await;
+            let socket = socket_arc.lock().await;
             tokio::select! {
-                result = socket.read(&mut read_buf) => Event::Read(result),
+                result = socket.readable() => match result {
+                    Ok(()) => {
+                        let mut session = session_arc.lock().await;
+                        // Dropping bytes in a stream protocol corrupts all
+                        // subsequent packet framing, so we grow up to
+                        // MAX_RDATA_SIZE instead of silently truncating.  Once
+                        // that limit is reached we close the connection rather
+                        // than corrupt it.
+                        let room = MAX_RDATA_SIZE - session.rdata_size;
+                        if room == 0 {
+                            Event::Overflow(session.rdata_size)
+                        } else {
+                            let read = session.read_from(&socket, READ_CHUNK.min(room));
+                            if let (true, Ok(n)) = (captured, &read) {
+                                crate::capture::data(fd, &session.rdata[session.rdata_size - n..session.rdata_size]);
+                            }
+                            Event::Read(read)
+                        }
+                    }
+                    Err(e) => Event::Read(Err(e)),
+                },
                 _ = write_notify.notified() => Event::WriteReady,
             }
         };
@@ -1083,10 +1833,7 @@ async fn session_io_task(fd: i32) {
             }
             Event::Read(Ok(0)) => {
                 // Peer closed connection — set eof and give C one last parse call
-                {
-                    let mut session = session_arc.lock().await;
-                    session.eof = 4;
-                }
+                manager.set_eof(fd, 4);
                 let parse_cb = {
                     let session = session_arc.lock().await;
                     session.callbacks.parse
@@ -1096,75 +1843,59 @@ async fn session_io_task(fd: i32) {
                 }
                 break;
             }
-            Event::Read(Ok(n)) => {
-                // Append data and update activity timestamp.
-                //
-                // Dropping bytes in a stream protocol corrupts all subsequent
-                // packet framing, so we grow up to MAX_RDATA_SIZE instead of
-                // silently truncating.  If that limit is exceeded we close the
-                // connection rather than corrupt it.
-                let overflow = {
+            Event::Read(Err(e)) if e.kind() == std::io::ErrorKind::WouldBlock => {
+                // Spurious readiness; wait again
+            }
+            Event::Overflow(size) => {
+                tracing::warn!(
+                    "[session] fd={} rdata overflow ({} bytes), closing connection",
+                    fd, size
+                );
+                manager.set_eof(fd, 3);
+                break;
+            }
+            Event::Read(Ok(_)) => {
+                // Data is already in rdata; update activity timestamp.
+                // The parse callback is read under the same lock.
+                let (parse_cb, mut available) = {
                     let mut session = session_arc.lock().await;
-                    let new_size = session.rdata_size + n;
-                    if new_size > MAX_RDATA_SIZE {
-                        tracing::warn!(
-                            "[session] fd={} rdata overflow ({} bytes), closing connection",
-                            fd, new_size
-                        );
-                        session.eof = 3;
-                        true
-                    } else {
-                        session.rdata.extend_from_slice(&read_buf[..n]);
-                        session.rdata_size += n;
-                        session.last_activity = Instant::now();
-                        false
-                    }
+                    session.last_activity = Instant::now();
+                    // Pin for the parse loop below: clif_parse reads the
+                    // packet through the span instead of one locked FFI
+                    // call per RFIFOB/RFIFOW.
+                    let (_, available) = session.pin_read();
+                    (session.callbacks.parse, available)
                 };
-                if overflow {
-                    break;
-                }
 
                 // Call C parse callback in a loop until all packets are consumed.
                 // The C parser processes ONE packet per call (RFIFOSKIP at the end).
                 // Multiple packets may arrive in a single read(), so we loop.
                 // Break if: no bytes available, parser needs more data (ret==2),
                 // or no progress was made (avoids infinite loop on unknown packets).
-                let parse_cb = {
-                    let session = session_arc.lock().await;
-                    session.callbacks.parse
-                };
                 if let Some(cb) = parse_cb {
-                    loop {
-                        let available = {
-                            let session = session_arc.lock().await;
-                            session.available()
-                        };
-                        if available == 0 { break; }
-
+                    while available > 0 {
                         let ret = unsafe { cb(fd) };
-                        if ret == 2 { break; }
+                        if ret == 2 || manager.eof(fd) != 0 { break; }
 
-                        let (new_available, eof) = {
-                            let session = session_arc.lock().await;
-                            (session.available(), session.eof)
-                        };
-                        if eof != 0 || new_available >= available { break; }
+                        let new_available = session_arc.lock().await.available();
+                        if new_available >= available { break; }
+                        available = new_available;
                     }
                 }
 
                 // Flush this session's write buffer (may have been written by parse cb)
                 flush_wdata_to_socket(fd, manager).await;
 
-                // Compact read buffer
+                // Compact read buffer and drop the read pin taken above
                 {
                     let mut session = session_arc.lock().await;
                     session.flush_read_buffer();
+                    session.unpin_read();
                 }
             }
             Event::Read(Err(e)) => {
                 tracing::error!("[session] fd={} read error: {}", fd, e);
-                let mut session = session_arc.lock().await;
-                session.eof = 3;
+                manager.set_eof(fd, 3);
                 break;
             }
         }
@@ -1172,19 +1903,14 @@ async fn session_io_task(fd: i32) {
 
     // Invoke C shutdown callback then remove session.
     // The flag prevents a double-call if shutdown_all_sessions races here.
-    let shutdown_cb = {
-        let mut session = session_arc.lock().await;
-        if session.shutdown_called {
-            None
-        } else {
-            session.shutdown_called = true;
-            session.callbacks.shutdown
-        }
-    };
+    if captured {
+        crate::capture::close(fd);
+    }
+    let shutdown_cb = session_arc.lock().await.claim_shutdown();
     if let Some(cb) = shutdown_cb {
         unsafe { cb(fd); }
     }
-    manager.remove_session(fd);
+    manager.remove_session_if_current(fd, generation);
     tracing::info!("[session] fd={} closed", fd);
 }
 
@@ -1192,20 +1918,17 @@ async fn session_io_task(fd: i32) {
 async fn shutdown_all_sessions() {
     tracing::info!("[rust_server] Shutting down all sessions");
 
+    if handed_off() {
+        tracing::info!("[rust_server] Sessions are being handed off, leaving them open");
+        return;
+    }
+
     let manager = get_session_manager();
     let fds = manager.get_all_fds();
 
     for fd in fds {
         if let Some(session_arc) = manager.get_session(fd) {
-            let shutdown_cb = {
-                let mut session = session_arc.lock().await;
-                if session.shutdown_called {
-                    None
-                } else {
-                    session.shutdown_called = true;
-                    session.callbacks.shutdown
-                }
-            };
+            let shutdown_cb = session_arc.lock().await.claim_shutdown();
             if let Some(cb) = shutdown_cb {
                 tracing::debug!("[rust_server] Calling shutdown callback for fd={}", fd);
                 unsafe { cb(fd); }
@@ -1223,7 +1946,6 @@ mod tests {
     fn test_session_new() {
         let session = Session::new(1);
         assert_eq!(session.fd, 1);
-        assert_eq!(session.eof, 0);
         assert_eq!(session.rdata_pos, 0);
         assert_eq!(session.rdata_size, 0);
         assert_eq!(session.wdata_size, 0);
@@ -1419,6 +2141,110 @@ mod tests {
         }
     }
 
+    #[test]
+    fn test_read_span_tracks_skip() {
+        // fd chosen away from the other tests so the shared span slot is ours
+        let mut session = Session::new(901);
+        session.rdata = vec![1, 2, 3, 4, 5];
+        session.rdata_size = 5;
+
+        let (ptr, len) = session.pin_read();
+        assert_eq!(len, 5);
+        assert_eq!(unsafe { *ptr }, 1);
+
+        session.skip(2).unwrap();
+        let span = unsafe { rust_session_spans[901] };
+        assert_eq!(span.rlen, 3);
+        assert_eq!(unsafe { *span.rdata }, 3);
+
+        session.unpin_read();
+        let span = unsafe { rust_session_spans[901] };
+        assert!(span.rdata.is_null());
+        assert_eq!(span.rlen, 0);
+    }
+
+    #[test]
+    fn test_write_span_follows_commit_and_growth() {
+        let mut session = Session::new(902);
+
+        let (ptr, len) = session.pin_write(8).unwrap();
+        assert!(len >= 8);
+        unsafe { *ptr = 0xAA };
+        session.commit_write(1).unwrap();
+
+        let span = unsafe { rust_session_spans[902] };
+        assert_eq!(span.wdata, session.wdata.as_mut_ptr().wrapping_add(1));
+        assert_eq!(span.wlen, session.wdata.len() - 1);
+
+        // Growing the buffer may move it; the span must follow
+        session.ensure_wdata_capacity(64 * 1024).unwrap();
+        let span = unsafe { rust_session_spans[902] };
+        assert_eq!(span.wdata, session.wdata.as_mut_ptr().wrapping_add(1));
+        assert_eq!(session.wdata[0], 0xAA);
+
+        session.unpin_write();
+        assert!(unsafe { rust_session_spans[902] }.wdata.is_null());
+    }
+
+    #[test]
+    fn test_coalesced_commits_queue_session_once() {
+        // A local queue and no global mode switch, so other tests committing
+        // writes in parallel neither see coalescing nor touch this queue
+        let queue = StdMutex::new(Vec::new());
+        let mut session = Session::new(903);
+        session.suppress_notify = true;
+        session.write_u8(0, 0x01).unwrap();
+        session.commit_write(1).unwrap();
+        session.wake_writer(true, &queue);
+        session.write_u8(0, 0x02).unwrap();
+        session.commit_write(1).unwrap();
+        session.wake_writer(true, &queue);
+
+        // Both packets sit in one buffer behind a single queued wake-up
+        assert_eq!(&session.wdata[..2], &[0x01, 0x02]);
+        let queue = queue.into_inner().unwrap();
+        assert_eq!(queue.len(), 1);
+        assert!(Arc::ptr_eq(&queue[0], &session.write_notify));
+    }
+
+    #[test]
+    fn test_idle_trim_releases_and_regrows_buffers() {
+        let mut session = Session::new(904);
+        session.write_u8(0, 0xAA).unwrap();
+        session.commit_write(1).unwrap();
+        session.wdata_size = 0; // as if flushed
+
+        // Written to during this pass: wdata stays, rdata is not idle yet
+        assert!(!session.trim_idle_buffers(IDLE_TRIM_AFTER));
+        assert!(session.wdata.capacity() > 0);
+
+        session.last_activity = Instant::now() - IDLE_TRIM_AFTER;
+        assert!(session.trim_idle_buffers(IDLE_TRIM_AFTER));
+        assert_eq!(session.rdata.capacity(), 0);
+        assert_eq!(session.wdata.capacity(), 0);
+
+        // Next write takes a fresh zeroed buffer
+        session.write_u16(0, 0x1234).unwrap();
+        assert!(session.wdata.capacity() >= WFIFO_SIZE);
+        assert_eq!(&session.wdata[..3], &[0x34, 0x12, 0x00]);
+    }
+
+    #[test]
+    fn test_idle_trim_releases_buffer_after_packet() {
+        // What WFIFOHEAD ... WFIFOSET does through the FFI
+        let mut session = Session::new(905);
+        let (ptr, len) = session.pin_write(16).unwrap();
+        assert!(len >= 16);
+        unsafe { *ptr = 0xAA };
+        session.end_write(1).unwrap();
+        assert!(unsafe { rust_session_spans[905] }.wdata.is_null());
+        session.wdata_size = 0; // as if flushed
+
+        assert!(!session.trim_idle_buffers(IDLE_TRIM_AFTER));
+        assert!(session.trim_idle_buffers(IDLE_TRIM_AFTER));
+        assert_eq!(session.wdata.capacity(), 0);
+    }
+
     #[test]
     fn test_session_manager_allocate_fd() {
         let manager = SessionManager::new();
@@ -1479,4 +2305,59 @@ mod tests {
         assert!(result.is_err());
         assert!(matches!(result, Err(SessionError::MaxSessionsExceeded)));
     }
+
+    #[test]
+    fn test_session_manager_generation_catches_reuse() {
+        let manager = SessionManager::new();
+
+        manager.insert_session(7, Arc::new(Mutex::new(Session::new(7)))).unwrap();
+        let first = manager.generation(7).unwrap();
+        manager.set_eof(7, 1);
+        manager.next_increment(7);
+
+        manager.remove_session(7);
+        assert!(manager.generation(7).is_none());
+        assert_eq!(manager.eof(7), -1);
+        assert!(!manager.set_eof(7, 1));
+
+        // Same fd, new connection: old generation is stale, flags start clean
+        manager.insert_session(7, Arc::new(Mutex::new(Session::new(7)))).unwrap();
+        assert!(!manager.is_current(7, first));
+        assert_eq!(manager.eof(7), 0);
+        assert_eq!(manager.increment(7), 0);
+
+        // A stale remove must not evict the new occupant
+        manager.remove_session_if_current(7, first);
+        assert!(manager.exists(7));
+    }
+
+    #[test]
+    fn test_session_manager_increment_wraps() {
+        let manager = SessionManager::new();
+        manager.insert_session(3, Arc::new(Mutex::new(Session::new(3)))).unwrap();
+
+        for _ in 0..255 {
+            manager.next_increment(3);
+        }
+        assert_eq!(manager.increment(3), 255);
+        assert_eq!(manager.next_increment(3), 0);
+    }
+
+    #[test]
+    fn test_session_manager_recycles_closed_fds() {
+        let manager = SessionManager::new();
+
+        for _ in 0..MAX_SESSIONS {
+            let fd = manager.allocate_fd().unwrap();
+            manager.insert_session(fd, Arc::new(Mutex::new(Session::new(fd)))).unwrap();
+        }
+        assert!(manager.allocate_fd().is_err());
+
+        manager.remove_session(42);
+        manager.remove_session(17);
+        assert_eq!(manager.session_count(), MAX_SESSIONS - 2);
+        // Oldest closed fd comes back first
+        assert_eq!(manager.allocate_fd().unwrap(), 42);
+        assert_eq!(manager.allocate_fd().unwrap(), 17);
+    }
 }
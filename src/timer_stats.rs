@@ -0,0 +1,203 @@
+//! Per-callback timer costs and slow-tick logging.
+//!
+//! `timer_do` (c_deps/timer.c) reports every callback it runs: how long the
+//! callback took and how late it ran, in ticks past the tick it was due.
+//! Figures are kept per callback function, so every player's `pc_timer` adds
+//! into one entry. When one `timer_do` takes longer than the slow-tick
+//! budget, the callbacks that cost the most in that tick are logged on one
+//! line.
+//!
+//! Callbacks are named with `dladdr`, so the binary must export its symbols
+//! (build.rs links map_server with `--export-dynamic`); anything unresolved
+//! is shown by address.
+
+use std::collections::HashMap;
+use std::sync::{Mutex, OnceLock};
+
+/// Offenders named in a slow-tick line.
+const SLOW_TOP: usize = 3;
+
+/// Totals of one callback function.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct FnStat {
+    pub calls: u64,
+    pub total_ns: u64,
+    pub max_ns: u64,
+    /// Sum and max of ticks (ms) past due, for the average and worst case
+    pub late_total_ms: u64,
+    pub late_max_ms: u32,
+}
+
+impl FnStat {
+    pub fn avg_ns(&self) -> u64 {
+        self.total_ns / self.calls.max(1)
+    }
+
+    pub fn avg_late_ms(&self) -> u64 {
+        self.late_total_ms / self.calls.max(1)
+    }
+}
+
+/// What one callback cost within one tick.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct TickCost {
+    pub func: usize,
+    pub calls: u32,
+    pub ns: u64,
+    pub late_max_ms: u32,
+}
+
+#[derive(Default)]
+pub struct TimerStats {
+    by_fn: HashMap<usize, FnStat>,
+    /// Callbacks run in the current tick; a few distinct functions at most
+    tick: Vec<TickCost>,
+    budget_ns: u64,
+    slow_ticks: u64,
+}
+
+impl TimerStats {
+    /// `func` ran for `ns`, `late_ms` ticks after it was due.
+    pub fn record(&mut self, func: usize, late_ms: i32, ns: u64) {
+        let late = late_ms.max(0) as u32;
+        let s = self.by_fn.entry(func).or_default();
+        s.calls += 1;
+        s.total_ns += ns;
+        s.max_ns = s.max_ns.max(ns);
+        s.late_total_ms += late as u64;
+        s.late_max_ms = s.late_max_ms.max(late);
+
+        match self.tick.iter_mut().find(|t| t.func == func) {
+            Some(t) => {
+                t.calls += 1;
+                t.ns += ns;
+                t.late_max_ms = t.late_max_ms.max(late);
+            }
+            None => self.tick.push(TickCost { func, calls: 1, ns, late_max_ms: late }),
+        }
+    }
+
+    /// End of a `timer_do` that ran for `ns`. Returns the costliest callbacks
+    /// of the tick if it went over the budget.
+    pub fn end_tick(&mut self, ns: u64) -> Option<Vec<TickCost>> {
+        let mut tick = std::mem::take(&mut self.tick);
+        if self.budget_ns == 0 || ns <= self.budget_ns {
+            tick.clear();
+            self.tick = tick;
+            return None;
+        }
+        self.slow_ticks += 1;
+        tick.sort_by(|a, b| b.ns.cmp(&a.ns));
+        tick.truncate(SLOW_TOP);
+        Some(tick)
+    }
+
+    /// Slow-tick budget in ms; 0 turns the log off.
+    pub fn set_budget_ms(&mut self, ms: u32) {
+        self.budget_ns = ms as u64 * 1_000_000;
+    }
+
+    /// Every callback seen, most total time first.
+    pub fn snapshot(&self) -> Vec<(usize, FnStat)> {
+        let mut out: Vec<(usize, FnStat)> = self.by_fn.iter().map(|(f, s)| (*f, *s)).collect();
+        out.sort_by(|a, b| b.1.total_ns.cmp(&a.1.total_ns).then(a.0.cmp(&b.0)));
+        out
+    }
+
+    pub fn slow_ticks(&self) -> u64 {
+        self.slow_ticks
+    }
+
+    pub fn reset(&mut self) {
+        self.by_fn.clear();
+        self.slow_ticks = 0;
+    }
+}
+
+fn global() -> &'static Mutex<TimerStats> {
+    static STATS: OnceLock<Mutex<TimerStats>> = OnceLock::new();
+    STATS.get_or_init(Default::default)
+}
+
+pub fn with<R>(f: impl FnOnce(&mut TimerStats) -> R) -> R {
+    f(&mut global().lock().unwrap_or_else(|e| e.into_inner()))
+}
+
+/// Name of the function at `addr`, or the address if it has no symbol.
+pub fn fn_name(addr: usize) -> String {
+    static NAMES: OnceLock<Mutex<HashMap<usize, String>>> = OnceLock::new();
+    let mut names = NAMES.get_or_init(Default::default).lock().unwrap_or_else(|e| e.into_inner());
+    names
+        .entry(addr)
+        .or_insert_with(|| {
+            let mut info: libc::Dl_info = unsafe { std::mem::zeroed() };
+            let found = unsafe { libc::dladdr(addr as *const libc::c_void, &mut info) } != 0;
+            if found && !info.dli_sname.is_null() {
+                unsafe { std::ffi::CStr::from_ptr(info.dli_sname) }.to_string_lossy().into_owned()
+            } else {
+                format!("{addr:#x}")
+            }
+        })
+        .clone()
+}
+
+/// One `timer_do` finished after `ns`; log it if it was slow.
+pub fn end_tick(ns: u64) {
+    let Some(top) = with(|s| s.end_tick(ns)) else { return };
+    let offenders: Vec<String> = top
+        .iter()
+        .map(|t| {
+            format!(
+                "{} {:.1} ms ({}x, {} ms late)",
+                fn_name(t.func), t.ns as f64 / 1e6, t.calls, t.late_max_ms
+            )
+        })
+        .collect();
+    tracing::warn!("[timer] slow tick {:.1} ms: {}", ns as f64 / 1e6, offenders.join(", "));
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_per_fn_totals_and_slow_ticks() {
+        let mut s = TimerStats::default();
+        s.record(0x10, 0, 1_000_000);
+        s.record(0x10, 4, 3_000_000);
+        s.record(0x20, -1, 500_000);
+        // No budget set: never slow
+        assert_eq!(s.end_tick(100_000_000), None);
+
+        let snap = s.snapshot();
+        assert_eq!(snap[0].0, 0x10);
+        assert_eq!(
+            snap[0].1,
+            FnStat { calls: 2, total_ns: 4_000_000, max_ns: 3_000_000, late_total_ms: 4, late_max_ms: 4 }
+        );
+        assert_eq!(snap[0].1.avg_ns(), 2_000_000);
+        assert_eq!(snap[1].1.late_max_ms, 0);
+
+        s.set_budget_ms(5);
+        s.record(0x20, 0, 1_000_000);
+        s.record(0x30, 2, 2_000_000);
+        s.record(0x20, 7, 6_000_000);
+        assert_eq!(s.end_tick(4_000_000), None);
+        s.record(0x20, 7, 6_000_000);
+        s.record(0x30, 2, 2_000_000);
+        let slow = s.end_tick(9_000_000).unwrap();
+        assert_eq!(slow[0], TickCost { func: 0x20, calls: 1, ns: 6_000_000, late_max_ms: 7 });
+        assert_eq!(slow[1].func, 0x30);
+        assert_eq!(s.slow_ticks(), 1);
+        // The next tick starts empty
+        assert_eq!(s.end_tick(9_000_000).unwrap(), vec![]);
+
+        s.reset();
+        assert!(s.snapshot().is_empty());
+    }
+
+    #[test]
+    fn test_unresolved_names_show_the_address() {
+        assert_eq!(fn_name(0x10), "0x10");
+    }
+}